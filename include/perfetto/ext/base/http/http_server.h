@@ -32,6 +32,7 @@
 namespace perfetto {
 namespace base {
 
+class HttpServer;
 class HttpServerConnection;
 
 struct HttpRequest {
@@ -83,7 +84,7 @@ class HttpServerConnection {
  public:
   static constexpr size_t kOmitContentLength = static_cast<size_t>(-1);
 
-  explicit HttpServerConnection(std::unique_ptr<UnixSocket>);
+  HttpServerConnection(std::unique_ptr<UnixSocket>, HttpServer*);
   ~HttpServerConnection();
 
   void SendResponseHeaders(const char* http_code,
@@ -105,6 +106,16 @@ class HttpServerConnection {
     SendResponse(http_code, headers, content, true);
   }
 
+  // By default the response must be sent (or at least its headers) within the
+  // OnHttpRequest() call. A handler that replies asynchronously (e.g. from
+  // another thread, via a task posted back on the server's task runner) must
+  // call DeferResponse() within OnHttpRequest() and EndDeferredResponse() once
+  // the last byte of the response has been sent. In the meantime the requests
+  // pipelined on the same connection are buffered and not handled, so that
+  // responses are sent in order.
+  void DeferResponse();
+  void EndDeferredResponse();
+
   // The metods below are only valid for websocket connections.
 
   // Upgrade an existing connection to a websocket. This can be called only in
@@ -129,10 +140,13 @@ class HttpServerConnection {
   size_t rxbuf_avail() { return rxbuf.size() - rxbuf_used; }
 
   std::unique_ptr<UnixSocket> sock;
+  HttpServer* const server_;
   PagedMemory rxbuf;
   size_t rxbuf_used = 0;
   bool is_websocket_ = false;
   bool headers_sent_ = false;
+  bool response_deferred_ = false;
+  bool parsing_requests_ = false;
   size_t content_len_headers_ = 0;
   size_t content_len_actual_ = 0;
 
@@ -162,6 +176,9 @@ class HttpServer : public UnixSocket::EventListener {
   void AddAllowedOrigin(const std::string&);
 
  private:
+  friend class HttpServerConnection;
+
+  void ParseRequests(HttpServerConnection*);
   size_t ParseOneHttpRequest(HttpServerConnection*);
   size_t ParseOneWebsocketFrame(HttpServerConnection*);
   void HandleCorsPreflightRequest(const HttpRequest&);
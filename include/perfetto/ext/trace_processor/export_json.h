@@ -17,11 +17,14 @@
 #ifndef INCLUDE_PERFETTO_EXT_TRACE_PROCESSOR_EXPORT_JSON_H_
 #define INCLUDE_PERFETTO_EXT_TRACE_PROCESSOR_EXPORT_JSON_H_
 
+#include <stdint.h>
 #include <stdio.h>
 
 #include <functional>
+#include <limits>
 
 #include "perfetto/base/export.h"
+#include "perfetto/ext/base/optional.h"
 #include "perfetto/trace_processor/status.h"
 
 namespace perfetto {
@@ -39,6 +42,22 @@ using ArgumentFilterPredicate =
 using MetadataFilterPredicate = std::function<bool(const char* metadata_name)>;
 using LabelFilterPredicate = std::function<bool(const char* label_name)>;
 
+// Restricts the events exported by ExportJson(). Unlike the predicates above,
+// which are called on each converted JSON event, these are evaluated on the
+// trace processor tables so events which are filtered out are never converted.
+// Data which applies to the whole trace (e.g. metadata and stats) is always
+// exported.
+struct EventFilter {
+  // Only events starting in [min_ts, max_ts] (in nanoseconds) are exported.
+  // Process and thread names are exported regardless of the time range.
+  int64_t min_ts = std::numeric_limits<int64_t>::min();
+  int64_t max_ts = std::numeric_limits<int64_t>::max();
+
+  // If set, only the events of the process with this upid (i.e. on its tracks
+  // or those of its threads) are exported.
+  base::Optional<uint32_t> upid;
+};
+
 class PERFETTO_EXPORT OutputWriter {
  public:
   OutputWriter();
@@ -55,6 +74,14 @@ util::Status PERFETTO_EXPORT ExportJson(TraceProcessorStorage*,
                                         MetadataFilterPredicate = nullptr,
                                         LabelFilterPredicate = nullptr);
 
+// As above, but only exports the events selected by |event_filter|.
+util::Status PERFETTO_EXPORT ExportJson(TraceProcessorStorage*,
+                                        OutputWriter*,
+                                        const EventFilter& event_filter,
+                                        ArgumentFilterPredicate = nullptr,
+                                        MetadataFilterPredicate = nullptr,
+                                        LabelFilterPredicate = nullptr);
+
 }  // namespace json
 }  // namespace trace_processor
 }  // namespace perfetto
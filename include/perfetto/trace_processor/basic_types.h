@@ -100,6 +100,21 @@ struct PERFETTO_EXPORT Config {
   // trace packets. See the enum documentation for more details.
   SortingMode sorting_mode = SortingMode::kDefaultHeuristics;
 
+  // When non-zero, bounds the memory used for sorting by only keeping events
+  // spanning at most |sorting_window_ns| of trace time in the sorter: older
+  // events are extracted and parsed eagerly as newer ones are pushed. Applies
+  // on top of (and takes precedence over) |sorting_mode|.
+  //
+  // Events which arrive after the window has already moved past them are
+  // dropped and counted in the |sorter_window_late_event_dropped| stat.
+  int64_t sorting_window_ns = 0;
+
+  // When non-zero, bounds the memory used for sorting by extracting events
+  // eagerly once the events buffered in the sorter exceed this many bytes.
+  // Can be combined with |sorting_window_ns|, in which case whichever limit is
+  // hit first triggers the extraction. Late events are handled as above.
+  uint64_t sorting_window_bytes = 0;
+
   // When set to false, this option makes the trace processor not include ftrace
   // events in the raw table; this makes converting events back to the systrace
   // text format impossible. On the other hand, it also saves ~50% of memory
@@ -115,6 +130,20 @@ struct PERFETTO_EXPORT Config {
   DropFtraceDataBefore drop_ftrace_data_before =
       DropFtraceDataBefore::kTracingStarted;
 
+  // Bounds the memory used by the cache of tables trace processor derives from
+  // the trace tables to speed up repeated queries (e.g. copies of a table
+  // sorted on a column repeatedly filtered for equality). When the bound is
+  // exceeded, the least recently used tables are evicted. Setting this to 0
+  // disables the cache.
+  uint64_t query_cache_max_bytes = 256ull * 1024 * 1024;
+
+  // The thread_state table is computed from the sched data once the trace is
+  // fully loaded. When this option is set, the computation is done on a
+  // background thread so that NotifyEndOfFile() and LoadSnapshot() return
+  // without waiting for it; queries issued before it is done block until the
+  // table is ready. Ignored on platforms without threads (e.g. WASM).
+  bool compute_thread_state_in_background = false;
+
   // Any built-in metric proto or sql files matching these paths are skipped
   // during trace processor metric initialization.
   std::vector<std::string> skip_builtin_metric_paths;
@@ -124,6 +124,17 @@ class PERFETTO_EXPORT TraceProcessor : public TraceProcessorStorage {
   // loaded by trace processor shell at runtime. The message is encoded as
   // DescriptorSet, defined in perfetto/trace_processor/trace_processor.proto.
   virtual std::vector<uint8_t> GetMetricDescriptors() = 0;
+
+  // Writes a snapshot of all the tables of the loaded trace to the file at
+  // |path|. The snapshot can be reopened with LoadSnapshot() much faster than
+  // parsing the original trace. Should be called after NotifyEndOfFile().
+  virtual base::Status SaveSnapshot(const std::string& path) = 0;
+
+  // Loads a snapshot previously written by SaveSnapshot(). This replaces the
+  // usual Parse()/NotifyEndOfFile() sequence and so must be called on a fresh
+  // instance which has not parsed any data; no more data can be parsed after
+  // loading a snapshot.
+  virtual base::Status LoadSnapshot(const std::string& path) = 0;
 };
 
 // When set, logs SQLite actions on the console.
@@ -81,7 +81,7 @@ void HttpServer::OnNewIncomingConnection(
     UnixSocket*,  // The listening socket, irrelevant here.
     std::unique_ptr<UnixSocket> sock) {
   PERFETTO_LOG("[HTTP] New connection");
-  clients_.emplace_back(std::move(sock));
+  clients_.emplace_back(std::move(sock), this);
 }
 
 void HttpServer::OnConnect(UnixSocket*, bool) {}
@@ -118,9 +118,20 @@ void HttpServer::OnDataAvailable(UnixSocket* sock) {
       break;
   }
 
+  ParseRequests(conn);
+}
+
+void HttpServer::ParseRequests(HttpServerConnection* conn) {
+  // EndDeferredResponse() can be called while a request is being handled. The
+  // loop below takes care of the remaining requests in that case.
+  if (conn->parsing_requests_)
+    return;
+  conn->parsing_requests_ = true;
+
   // At this point |rxbuf| can contain a partial HTTP request, a full one or
   // more (in case of HTTP Keepalive pipelining).
-  for (;;) {
+  char* rxbuf = reinterpret_cast<char*>(conn->rxbuf.Get());
+  while (!conn->response_deferred_) {
     size_t bytes_consumed;
 
     if (conn->is_websocket()) {
@@ -134,6 +145,7 @@ void HttpServer::OnDataAvailable(UnixSocket* sock) {
     memmove(rxbuf, &rxbuf[bytes_consumed], conn->rxbuf_used - bytes_consumed);
     conn->rxbuf_used -= bytes_consumed;
   }
+  conn->parsing_requests_ = false;
 }
 
 // Parses the HTTP request and invokes HandleRequest(). It returns the size of
@@ -237,6 +249,11 @@ size_t HttpServer::ParseOneHttpRequest(HttpServerConnection* conn) {
     req_handler_->OnHttpRequest(http_req);
   }
 
+  // A deferred response is completed (and |headers_sent_| reset) by
+  // EndDeferredResponse().
+  if (conn->response_deferred_)
+    return headers_size + body_size;
+
   // The handler is expected to send a response. If not, bail with a HTTP 500.
   if (!conn->headers_sent_)
     conn->SendResponseAndClose("500 Internal Server Error");
@@ -526,6 +543,29 @@ void HttpServerConnection::SendResponse(
     Close();
 }
 
+void HttpServerConnection::DeferResponse() {
+  PERFETTO_CHECK(!is_websocket_);
+  PERFETTO_CHECK(parsing_requests_ && !response_deferred_);
+  response_deferred_ = true;
+}
+
+void HttpServerConnection::EndDeferredResponse() {
+  PERFETTO_CHECK(response_deferred_);
+  if (!headers_sent_)
+    SendResponseAndClose("500 Internal Server Error");
+  response_deferred_ = false;
+
+  // If the response has been sent within OnHttpRequest() there is nothing
+  // else to do, ParseOneHttpRequest() takes care of the rest.
+  if (parsing_requests_)
+    return;
+
+  // Otherwise handle the requests that have been pipelined in the meantime.
+  headers_sent_ = false;
+  if (sock->is_connected())
+    server_->ParseRequests(this);
+}
+
 void HttpServerConnection::SendWebsocketMessage(const void* data, size_t len) {
   SendWebsocketFrame(kOpcodeBinary, data, len);
 }
@@ -559,8 +599,11 @@ void HttpServerConnection::SendWebsocketFrame(uint8_t opcode,
     sock->Send(payload, payload_len);
 }
 
-HttpServerConnection::HttpServerConnection(std::unique_ptr<UnixSocket> s)
-    : sock(std::move(s)), rxbuf(PagedMemory::Allocate(kMaxRequestSize)) {}
+HttpServerConnection::HttpServerConnection(std::unique_ptr<UnixSocket> s,
+                                           HttpServer* server)
+    : sock(std::move(s)),
+      server_(server),
+      rxbuf(PagedMemory::Allocate(kMaxRequestSize)) {}
 
 HttpServerConnection::~HttpServerConnection() = default;
 
@@ -18,6 +18,7 @@
 
 #include <initializer_list>
 #include <string>
+#include <vector>
 
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/unix_socket.h"
@@ -218,6 +219,45 @@ TEST_F(HttpServerTest, POST_Keepalive) {
   EXPECT_EQ(cli.RecvAndWaitConnClose(), expected_response);
 }
 
+// A deferred response must hold back the requests pipelined after it.
+TEST_F(HttpServerTest, DeferredResponse_Pipelined) {
+  HttpCli cli(&task_runner_);
+  std::vector<std::string> handled;
+  EXPECT_CALL(handler_, OnHttpConnectionClosed(_)).Times(1);
+  EXPECT_CALL(handler_, OnHttpRequest(_))
+      .Times(2)
+      .WillRepeatedly(Invoke([&](const HttpRequest& req) {
+        handled.push_back(req.uri.ToStdString());
+        HttpServerConnection* conn = req.conn;
+        if (req.uri == "/slow") {
+          conn->DeferResponse();
+          task_runner_.PostTask([&handled, conn] {
+            EXPECT_EQ(handled.size(), 1u);
+            conn->SendResponse("200 OK", {}, "slow");
+            conn->EndDeferredResponse();
+          });
+          return;
+        }
+        conn->SendResponseAndClose("200 OK", {}, "fast");
+      }));
+
+  cli.SendHttpReq({"GET /slow HTTP/1.1", "Connection: keep-alive"});
+  cli.SendHttpReq({"GET /fast HTTP/1.1", "Connection: keep-alive"});
+
+  EXPECT_EQ(cli.RecvAndWaitConnClose(),
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Length: 4\r\n"
+            "Connection: keep-alive\r\n"
+            "\r\n"
+            "slow"
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Length: 4\r\n"
+            "Connection: close\r\n"
+            "\r\n"
+            "fast");
+  EXPECT_EQ(handled, (std::vector<std::string>{"/slow", "/fast"}));
+}
+
 TEST_F(HttpServerTest, Websocket) {
   srv_.AddAllowedOrigin("http://foo.com");
   srv_.AddAllowedOrigin("http://websocket.com");
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/analysis/dominator_tree.h"
+
+#include <utility>
+
+namespace perfetto {
+namespace trace_processor {
+
+// static
+constexpr uint32_t DominatorTree::kNoNode;
+
+namespace {
+
+// State of the Lengauer-Tarjan algorithm. Nodes are identified by their
+// number in the depth first traversal, the virtual root being 0.
+class LengauerTarjan {
+ public:
+  LengauerTarjan(std::vector<uint32_t> parent,
+                 std::vector<uint32_t> pred_offsets,
+                 std::vector<uint32_t> preds)
+      : parent_(std::move(parent)),
+        pred_offsets_(std::move(pred_offsets)),
+        preds_(std::move(preds)) {}
+
+  // Returns the immediate dominator of each node.
+  std::vector<uint32_t> Run() {
+    const uint32_t n = static_cast<uint32_t>(parent_.size());
+    semi_.resize(n);
+    label_.resize(n);
+    for (uint32_t i = 0; i < n; ++i)
+      semi_[i] = label_[i] = i;
+    ancestor_.assign(n, DominatorTree::kNoNode);
+    bucket_head_.assign(n, DominatorTree::kNoNode);
+    bucket_next_.assign(n, DominatorTree::kNoNode);
+    std::vector<uint32_t> idom(n, DominatorTree::kNoNode);
+
+    for (uint32_t w = n - 1; w > 0; --w) {
+      // The semi-dominator of w is the node with the smallest number from
+      // which there is a path to w going only through nodes numbered after w.
+      for (uint32_t i = pred_offsets_[w]; i < pred_offsets_[w + 1]; ++i) {
+        uint32_t u = Eval(preds_[i]);
+        if (semi_[u] < semi_[w])
+          semi_[w] = semi_[u];
+      }
+      bucket_next_[w] = bucket_head_[semi_[w]];
+      bucket_head_[semi_[w]] = w;
+
+      uint32_t p = parent_[w];
+      ancestor_[w] = p;
+
+      // All the nodes with p as semi-dominator can now be (implicitly)
+      // resolved: their immediate dominator is either p or the immediate
+      // dominator of another node, fixed up below.
+      for (uint32_t v = bucket_head_[p]; v != DominatorTree::kNoNode;
+           v = bucket_next_[v]) {
+        uint32_t u = Eval(v);
+        idom[v] = semi_[u] < semi_[v] ? u : p;
+      }
+      bucket_head_[p] = DominatorTree::kNoNode;
+    }
+
+    // Nodes are processed in increasing order so that the immediate dominator
+    // of idom[w] is already final.
+    for (uint32_t w = 1; w < n; ++w) {
+      if (idom[w] != semi_[w])
+        idom[w] = idom[idom[w]];
+    }
+    return idom;
+  }
+
+ private:
+  // Returns the node with the smallest semi-dominator on the path from |v| to
+  // the root of its tree in the forest built by linking the processed nodes.
+  uint32_t Eval(uint32_t v) {
+    if (ancestor_[v] == DominatorTree::kNoNode)
+      return v;
+    Compress(v);
+    return label_[v];
+  }
+
+  // Path compression, without recursion: compresses the path from the root of
+  // the tree to |v|, top down.
+  void Compress(uint32_t v) {
+    compress_stack_.clear();
+    for (uint32_t x = v; ancestor_[ancestor_[x]] != DominatorTree::kNoNode;
+         x = ancestor_[x]) {
+      compress_stack_.push_back(x);
+    }
+    while (!compress_stack_.empty()) {
+      uint32_t x = compress_stack_.back();
+      compress_stack_.pop_back();
+      uint32_t a = ancestor_[x];
+      if (semi_[label_[a]] < semi_[label_[x]])
+        label_[x] = label_[a];
+      ancestor_[x] = ancestor_[a];
+    }
+  }
+
+  std::vector<uint32_t> parent_;
+  std::vector<uint32_t> pred_offsets_;
+  std::vector<uint32_t> preds_;
+
+  std::vector<uint32_t> semi_;
+  std::vector<uint32_t> label_;
+  std::vector<uint32_t> ancestor_;
+
+  // Linked lists of the nodes with the same semi-dominator.
+  std::vector<uint32_t> bucket_head_;
+  std::vector<uint32_t> bucket_next_;
+
+  std::vector<uint32_t> compress_stack_;
+};
+
+}  // namespace
+
+DominatorTree::DominatorTree(const CsrGraph& graph,
+                             const std::vector<uint32_t>& roots) {
+  const uint32_t node_count = graph.node_count();
+  pre_order_.assign(node_count, 0);
+
+  // Depth first traversal from the virtual root, numbering the nodes in
+  // pre-order.
+  struct Frame {
+    uint32_t number;
+    const uint32_t* next;
+    const uint32_t* end;
+  };
+  std::vector<uint32_t> parent{kNoNode};
+  std::vector<Frame> stack{{0, roots.data(), roots.data() + roots.size()}};
+  while (!stack.empty()) {
+    Frame& frame = stack.back();
+    if (frame.next == frame.end) {
+      stack.pop_back();
+      continue;
+    }
+    uint32_t node = *frame.next++;
+    if (pre_order_[node] != 0)
+      continue;
+    uint32_t number = static_cast<uint32_t>(reachable_nodes_.size() + 1);
+    pre_order_[node] = number;
+    reachable_nodes_.push_back(node);
+    parent.push_back(frame.number);
+    stack.push_back(
+        {number, graph.successors_begin(node), graph.successors_end(node)});
+  }
+
+  // Predecessors of the reachable nodes, by number.
+  const uint32_t n = static_cast<uint32_t>(parent.size());
+  std::vector<uint32_t> pred_offsets(n + 1, 0);
+  for (uint32_t root : roots)
+    pred_offsets[pre_order_[root] + 1]++;
+  for (uint32_t node : reachable_nodes_) {
+    for (const uint32_t* it = graph.successors_begin(node);
+         it != graph.successors_end(node); ++it) {
+      pred_offsets[pre_order_[*it] + 1]++;
+    }
+  }
+  for (uint32_t i = 1; i <= n; ++i)
+    pred_offsets[i] += pred_offsets[i - 1];
+
+  std::vector<uint32_t> preds(pred_offsets[n]);
+  std::vector<uint32_t> next_pred(pred_offsets.begin(), pred_offsets.end() - 1);
+  for (uint32_t root : roots)
+    preds[next_pred[pre_order_[root]]++] = 0;
+  for (uint32_t node : reachable_nodes_) {
+    for (const uint32_t* it = graph.successors_begin(node);
+         it != graph.successors_end(node); ++it) {
+      preds[next_pred[pre_order_[*it]]++] = pre_order_[node];
+    }
+  }
+
+  std::vector<uint32_t> idom =
+      LengauerTarjan(std::move(parent), std::move(pred_offsets),
+                     std::move(preds))
+          .Run();
+
+  immediate_dominator_.assign(node_count, kNoNode);
+  for (uint32_t number = 1; number < n; ++number) {
+    uint32_t dominator = idom[number];
+    immediate_dominator_[reachable_nodes_[number - 1]] =
+        dominator == 0 ? kNoNode : reachable_nodes_[dominator - 1];
+  }
+}
+
+DominatorTree::~DominatorTree() = default;
+
+}  // namespace trace_processor
+}  // namespace perfetto
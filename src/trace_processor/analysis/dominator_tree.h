@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_ANALYSIS_DOMINATOR_TREE_H_
+#define SRC_TRACE_PROCESSOR_ANALYSIS_DOMINATOR_TREE_H_
+
+#include <stdint.h>
+
+#include <limits>
+#include <vector>
+
+namespace perfetto {
+namespace trace_processor {
+
+// A directed graph with nodes numbered from 0, in compressed sparse row
+// format: the successors of node n are targets[offsets[n]] to
+// targets[offsets[n + 1] - 1].
+struct CsrGraph {
+  uint32_t node_count() const {
+    return offsets.empty() ? 0 : static_cast<uint32_t>(offsets.size() - 1);
+  }
+
+  const uint32_t* successors_begin(uint32_t node) const {
+    return targets.data() + offsets[node];
+  }
+  const uint32_t* successors_end(uint32_t node) const {
+    return targets.data() + offsets[node + 1];
+  }
+
+  // Has node_count() + 1 entries.
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> targets;
+};
+
+// The dominator tree of a graph: a node d dominates a node n if every path
+// from the roots to n goes through d. The immediate dominator of n is the
+// dominator of n closest to it, its parent in the tree.
+//
+// The roots are treated as the successors of a virtual root, which is the
+// immediate dominator of the nodes that no other node dominates (e.g. the
+// roots themselves).
+//
+// Computed with the Lengauer-Tarjan algorithm (the "simple" version, with
+// path compression), in O(E log(V)), without recursion as graphs can have
+// very long chains (e.g. Java linked lists).
+class DominatorTree {
+ public:
+  static constexpr uint32_t kNoNode = std::numeric_limits<uint32_t>::max();
+
+  DominatorTree(const CsrGraph& graph, const std::vector<uint32_t>& roots);
+  ~DominatorTree();
+
+  bool IsReachable(uint32_t node) const { return pre_order_[node] != 0; }
+
+  // Returns the immediate dominator of |node|, or kNoNode if it is the
+  // virtual root or if |node| is not reachable from the roots.
+  uint32_t ImmediateDominator(uint32_t node) const {
+    return immediate_dominator_[node];
+  }
+
+  // Returns the nodes reachable from the roots, in the pre-order of a depth
+  // first traversal of the graph. The dominators of a node always come
+  // before it.
+  const std::vector<uint32_t>& reachable_nodes() const {
+    return reachable_nodes_;
+  }
+
+ private:
+  // 1-based index of each node in |reachable_nodes_| (the virtual root being
+  // 0), or 0 if it is not reachable.
+  std::vector<uint32_t> pre_order_;
+  std::vector<uint32_t> immediate_dominator_;
+  std::vector<uint32_t> reachable_nodes_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_ANALYSIS_DOMINATOR_TREE_H_
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/analysis/dominator_tree.h"
+
+#include <random>
+#include <utility>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+constexpr uint32_t kNoNode = DominatorTree::kNoNode;
+
+CsrGraph MakeGraph(uint32_t node_count,
+                   const std::vector<std::pair<uint32_t, uint32_t>>& edges) {
+  std::vector<std::vector<uint32_t>> successors(node_count);
+  for (const auto& edge : edges)
+    successors[edge.first].push_back(edge.second);
+
+  CsrGraph graph;
+  graph.offsets.push_back(0);
+  for (const auto& node_successors : successors) {
+    graph.targets.insert(graph.targets.end(), node_successors.begin(),
+                         node_successors.end());
+    graph.offsets.push_back(static_cast<uint32_t>(graph.targets.size()));
+  }
+  return graph;
+}
+
+std::vector<uint32_t> ImmediateDominators(const DominatorTree& tree,
+                                          uint32_t node_count) {
+  std::vector<uint32_t> idoms;
+  for (uint32_t node = 0; node < node_count; ++node)
+    idoms.push_back(tree.ImmediateDominator(node));
+  return idoms;
+}
+
+// Computes the immediate dominators from the definition: d dominates n if n
+// is not reachable anymore when d is removed.
+std::vector<uint32_t> BruteForceImmediateDominators(
+    const CsrGraph& graph,
+    const std::vector<uint32_t>& roots) {
+  uint32_t node_count = graph.node_count();
+  auto reachable_without = [&](uint32_t removed) {
+    std::vector<bool> reachable(node_count, false);
+    std::vector<uint32_t> stack;
+    for (uint32_t root : roots) {
+      if (root != removed && !reachable[root]) {
+        reachable[root] = true;
+        stack.push_back(root);
+      }
+    }
+    while (!stack.empty()) {
+      uint32_t node = stack.back();
+      stack.pop_back();
+      for (const uint32_t* it = graph.successors_begin(node);
+           it != graph.successors_end(node); ++it) {
+        if (*it != removed && !reachable[*it]) {
+          reachable[*it] = true;
+          stack.push_back(*it);
+        }
+      }
+    }
+    return reachable;
+  };
+
+  std::vector<bool> reachable = reachable_without(kNoNode);
+  // dominators[n] are the strict dominators of n.
+  std::vector<std::vector<uint32_t>> dominators(node_count);
+  for (uint32_t d = 0; d < node_count; ++d) {
+    std::vector<bool> reachable_without_d = reachable_without(d);
+    for (uint32_t n = 0; n < node_count; ++n) {
+      if (n != d && reachable[n] && !reachable_without_d[n])
+        dominators[n].push_back(d);
+    }
+  }
+
+  // The immediate dominator is the strict dominator with the most dominators.
+  std::vector<uint32_t> idoms(node_count, kNoNode);
+  for (uint32_t n = 0; n < node_count; ++n) {
+    size_t max_dominators = 0;
+    for (uint32_t d : dominators[n]) {
+      if (idoms[n] == kNoNode || dominators[d].size() > max_dominators) {
+        idoms[n] = d;
+        max_dominators = dominators[d].size();
+      }
+    }
+  }
+  return idoms;
+}
+
+TEST(DominatorTreeTest, Empty) {
+  CsrGraph graph = MakeGraph(0, {});
+  DominatorTree tree(graph, {});
+  ASSERT_THAT(tree.reachable_nodes(), IsEmpty());
+}
+
+TEST(DominatorTreeTest, Diamond) {
+  //     0
+  //    / \
+  //   1   2
+  //    \ /
+  //     3 -> 4
+  //
+  //  5 (unreachable) -> 3
+  CsrGraph graph =
+      MakeGraph(6, {{0, 1}, {0, 2}, {1, 3}, {2, 3}, {3, 4}, {5, 3}});
+  DominatorTree tree(graph, {0});
+
+  ASSERT_THAT(ImmediateDominators(tree, 6),
+              ElementsAre(kNoNode, 0u, 0u, 0u, 3u, kNoNode));
+  ASSERT_THAT(tree.reachable_nodes(), ElementsAre(0u, 1u, 3u, 4u, 2u));
+  ASSERT_TRUE(tree.IsReachable(4));
+  ASSERT_FALSE(tree.IsReachable(5));
+}
+
+TEST(DominatorTreeTest, MultipleRoots) {
+  // 0 -> 2 <- 1, 2 -> 3, 1 -> 4
+  CsrGraph graph = MakeGraph(5, {{0, 2}, {1, 2}, {2, 3}, {1, 4}});
+  DominatorTree tree(graph, {0, 1});
+
+  // 2 is reachable from both roots so it's only dominated by the virtual
+  // root.
+  ASSERT_THAT(ImmediateDominators(tree, 5),
+              ElementsAre(kNoNode, kNoNode, kNoNode, 2u, 1u));
+}
+
+TEST(DominatorTreeTest, Cycles) {
+  // 0 -> 1 -> 2 -> 3 -> 1, 2 -> 4 -> 2, 3 -> 3
+  CsrGraph graph =
+      MakeGraph(5, {{0, 1}, {1, 2}, {2, 3}, {3, 1}, {2, 4}, {4, 2}, {3, 3}});
+  DominatorTree tree(graph, {0});
+
+  ASSERT_THAT(ImmediateDominators(tree, 5),
+              ElementsAre(kNoNode, 0u, 1u, 2u, 2u));
+}
+
+TEST(DominatorTreeTest, LongChain) {
+  // Deep enough to overflow the stack if the traversal or the path
+  // compression were recursive.
+  constexpr uint32_t kNodes = 1000000;
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+  for (uint32_t i = 0; i + 1 < kNodes; ++i) {
+    edges.emplace_back(i, i + 1);
+    // Back edges to force path compressions.
+    if (i > 0)
+      edges.emplace_back(i + 1, i / 2);
+  }
+  CsrGraph graph = MakeGraph(kNodes, edges);
+  DominatorTree tree(graph, {0});
+
+  ASSERT_EQ(tree.reachable_nodes().size(), kNodes);
+  ASSERT_EQ(tree.ImmediateDominator(0), kNoNode);
+  for (uint32_t i = 1; i < kNodes; ++i)
+    ASSERT_EQ(tree.ImmediateDominator(i), i - 1);
+}
+
+TEST(DominatorTreeTest, MatchesBruteForce) {
+  std::minstd_rand0 rnd(42);
+  for (int iteration = 0; iteration < 200; ++iteration) {
+    uint32_t node_count = 1 + rnd() % 30;
+    uint32_t edge_count = rnd() % (3 * node_count);
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    for (uint32_t i = 0; i < edge_count; ++i)
+      edges.emplace_back(rnd() % node_count, rnd() % node_count);
+    std::vector<uint32_t> roots;
+    for (uint32_t i = 0; i < 1 + rnd() % 3; ++i)
+      roots.push_back(rnd() % node_count);
+
+    CsrGraph graph = MakeGraph(node_count, edges);
+    DominatorTree tree(graph, roots);
+    ASSERT_EQ(ImmediateDominators(tree, node_count),
+              BruteForceImmediateDominators(graph, roots))
+        << "iteration " << iteration;
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
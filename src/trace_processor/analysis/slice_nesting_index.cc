@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/analysis/slice_nesting_index.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+constexpr uint32_t kNoParent = std::numeric_limits<uint32_t>::max();
+}  // namespace
+
+SliceNestingIndex::SliceNestingIndex(const tables::SliceTable& slices)
+    : slices_(&slices) {
+  const uint32_t row_count = slices.row_count();
+  const auto& parent_id = slices.parent_id();
+
+  std::vector<uint32_t> parent_rows(row_count);
+  for (uint32_t i = 0; i < row_count; ++i) {
+    base::Optional<SliceId> parent = parent_id[i];
+    parent_rows[i] = parent ? *slices.id().IndexOf(*parent) : kNoParent;
+
+    // Slices are always inserted after their parent (the parent has to be on
+    // the stack when the child begins): this allows computing the index in two
+    // linear passes instead of doing an actual depth first traversal.
+    PERFETTO_DCHECK(parent_rows[i] == kNoParent || parent_rows[i] < i);
+  }
+
+  // Pass 1: compute the size of the subtrees bottom up.
+  subtree_size_.assign(row_count, 0);
+  for (uint32_t i = row_count; i > 0; --i) {
+    uint32_t row = i - 1;
+    if (parent_rows[row] != kNoParent)
+      subtree_size_[parent_rows[row]] += subtree_size_[row] + 1;
+  }
+
+  // Pass 2: number the slices top down. The first child of a slice is
+  // numbered right after it and each following sibling right after the
+  // subtree of the previous one; |next_child| tracks the number of the next
+  // child of each slice.
+  pre_order_.resize(row_count);
+  rows_.resize(row_count);
+  std::vector<uint32_t> next_child(row_count);
+  uint32_t next_root = 0;
+  for (uint32_t row = 0; row < row_count; ++row) {
+    uint32_t number;
+    if (parent_rows[row] == kNoParent) {
+      number = next_root;
+      next_root += subtree_size_[row] + 1;
+    } else {
+      number = next_child[parent_rows[row]];
+      next_child[parent_rows[row]] += subtree_size_[row] + 1;
+    }
+    pre_order_[row] = number;
+    rows_[number] = row;
+    next_child[row] = number + 1;
+  }
+}
+
+SliceNestingIndex::~SliceNestingIndex() = default;
+
+// static
+const SliceNestingIndex& SliceNestingIndex::GetOrCreate(
+    TraceProcessorContext* context) {
+  const auto& slices = context->storage->slice_table();
+  auto* index = static_cast<SliceNestingIndex*>(
+      context->slice_nesting_index.get());
+  if (!index || index->row_count() != slices.row_count()) {
+    index = new SliceNestingIndex(slices);
+    context->slice_nesting_index.reset(index);
+  }
+  return *index;
+}
+
+std::vector<uint32_t> SliceNestingIndex::GetDescendantRows(
+    uint32_t row) const {
+  auto begin = rows_.begin() + pre_order_[row] + 1;
+  std::vector<uint32_t> descendants(begin, begin + subtree_size_[row]);
+
+  // Rows are in pre-order: sort them to return them in the same order as a
+  // filter on the table would. Slices on a track are usually inserted in
+  // pre-order already so this is often a no-op.
+  if (!std::is_sorted(descendants.begin(), descendants.end()))
+    std::sort(descendants.begin(), descendants.end());
+  return descendants;
+}
+
+std::vector<uint32_t> SliceNestingIndex::GetAncestorRows(uint32_t row) const {
+  std::vector<uint32_t> ancestors;
+  base::Optional<SliceId> parent = slices_->parent_id()[row];
+  while (parent) {
+    uint32_t parent_row = *slices_->id().IndexOf(*parent);
+    ancestors.push_back(parent_row);
+    parent = slices_->parent_id()[parent_row];
+  }
+  return ancestors;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
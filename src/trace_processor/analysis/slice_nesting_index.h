@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_ANALYSIS_SLICE_NESTING_INDEX_H_
+#define SRC_TRACE_PROCESSOR_ANALYSIS_SLICE_NESTING_INDEX_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "src/trace_processor/tables/slice_tables.h"
+#include "src/trace_processor/types/destructible.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceProcessorContext;
+
+// Index over the parent/child relationships of the slices in the slice table
+// which turns ancestor/descendant queries into range lookups.
+//
+// The slices are numbered in pre-order (i.e. in the order of a depth first
+// traversal of the forest formed by the parent_id column, visiting children
+// in row order). The descendants of a slice are then exactly the slices
+// numbered between the slice itself and the slice plus the size of its
+// subtree, so they can be listed without looking at any other slice and
+// containment can be checked in O(1).
+class SliceNestingIndex : public Destructible {
+ public:
+  // Builds the index for all the slices currently in |slices|.
+  explicit SliceNestingIndex(const tables::SliceTable& slices);
+  ~SliceNestingIndex() override;
+
+  // Returns the index for the slice table in the storage of |context|,
+  // building it on first use and rebuilding it if slices were added since it
+  // was built.
+  static const SliceNestingIndex& GetOrCreate(TraceProcessorContext* context);
+
+  // Returns the rows of all the descendants of the slice at |row|, in
+  // increasing row order.
+  std::vector<uint32_t> GetDescendantRows(uint32_t row) const;
+
+  // Returns the rows of all the ancestors of the slice at |row|, starting
+  // from its parent and ending with the root of its stack.
+  std::vector<uint32_t> GetAncestorRows(uint32_t row) const;
+
+  // Returns whether the slice at |ancestor| is a (strict) ancestor of the
+  // slice at |row|.
+  bool IsAncestor(uint32_t ancestor, uint32_t row) const {
+    return pre_order_[ancestor] < pre_order_[row] &&
+           pre_order_[row] <= pre_order_[ancestor] + subtree_size_[ancestor];
+  }
+
+  // Returns the number of descendants of the slice at |row|.
+  uint32_t DescendantCount(uint32_t row) const { return subtree_size_[row]; }
+
+  // Returns the number of slices in the table when the index was built.
+  uint32_t row_count() const {
+    return static_cast<uint32_t>(pre_order_.size());
+  }
+
+ private:
+  const tables::SliceTable* slices_ = nullptr;
+
+  // The pre-order number of the slice at each row.
+  std::vector<uint32_t> pre_order_;
+
+  // The number of descendants of the slice at each row.
+  std::vector<uint32_t> subtree_size_;
+
+  // The row of the slice with each pre-order number (i.e. the inverse of
+  // |pre_order_|).
+  std::vector<uint32_t> rows_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_ANALYSIS_SLICE_NESTING_INDEX_H_
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "src/trace_processor/analysis/slice_nesting_index.h"
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr uint32_t kRandomSeed = 476;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Args: {num slices, max depth of the stacks}.
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Args({1024, 16});
+  } else {
+    for (int64_t depth : {8, 64, 200})
+      b->Args({1024 * 1024, depth});
+  }
+  b->ArgNames({"slices", "depth"});
+}
+
+// Fills |storage| with slices resembling a Chrome trace with deep stacks: the
+// slices of a few dozen threads are interleaved in the table and each thread
+// repeatedly builds up stacks of up to |max_depth| slices.
+void GenerateSlices(TraceStorage* storage,
+                    uint32_t num_slices,
+                    uint32_t max_depth) {
+  static constexpr uint32_t kNumTracks = 32;
+  std::minstd_rand0 rnd(kRandomSeed);
+
+  auto* slices = storage->mutable_slice_table();
+  std::vector<std::vector<uint32_t>> stacks(kNumTracks);
+  int64_t ts = 0;
+  for (uint32_t i = 0; i < num_slices; ++i) {
+    uint32_t track = rnd() % kNumTracks;
+    std::vector<uint32_t>& stack = stacks[track];
+    ts += 10;
+
+    // Close a random number of slices, favouring building deeper stacks.
+    while (!stack.empty() && (stack.size() >= max_depth || rnd() % 4 == 0)) {
+      uint32_t row = stack.back();
+      slices->mutable_dur()->Set(row, ts - slices->ts()[row]);
+      stack.pop_back();
+    }
+
+    tables::SliceTable::Row row;
+    row.ts = ts;
+    row.dur = -1;
+    row.track_id = TrackId(track);
+    row.depth = static_cast<uint32_t>(stack.size());
+    if (!stack.empty())
+      row.parent_id = slices->id()[stack.back()];
+    stack.push_back(slices->Insert(row).row);
+  }
+
+  ts += 10;
+  for (std::vector<uint32_t>& stack : stacks) {
+    for (uint32_t row : stack)
+      slices->mutable_dur()->Set(row, ts - slices->ts()[row]);
+  }
+}
+
+// Picks slices to query the descendants of: the same slices are queried by
+// both benchmarks so the results are comparable.
+std::vector<uint32_t> PickSlices(const tables::SliceTable& slices) {
+  std::minstd_rand0 rnd(kRandomSeed);
+  std::vector<uint32_t> rows(1024);
+  for (uint32_t& row : rows)
+    row = rnd() % slices.row_count();
+  return rows;
+}
+
+}  // namespace
+
+// Computes the descendants by filtering the table on track, ts and depth
+// (i.e. how descendant_slice worked before the nesting index).
+static void BM_SliceDescendantsByFilter(benchmark::State& state) {
+  TraceStorage storage;
+  GenerateSlices(&storage, static_cast<uint32_t>(state.range(0)),
+                 static_cast<uint32_t>(state.range(1)));
+  const auto& slices = storage.slice_table();
+  std::vector<uint32_t> rows = PickSlices(slices);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    uint32_t row = rows[i++ % rows.size()];
+    benchmark::DoNotOptimize(slices.FilterToRowMap(
+        {slices.ts().ge(slices.ts()[row]),
+         slices.ts().le(slices.ts()[row] + slices.dur()[row]),
+         slices.track_id().eq(slices.track_id()[row].value),
+         slices.depth().gt(slices.depth()[row])}));
+  }
+}
+BENCHMARK(BM_SliceDescendantsByFilter)->Apply(BenchmarkArgs);
+
+static void BM_SliceDescendantsByIndex(benchmark::State& state) {
+  TraceStorage storage;
+  GenerateSlices(&storage, static_cast<uint32_t>(state.range(0)),
+                 static_cast<uint32_t>(state.range(1)));
+  const auto& slices = storage.slice_table();
+  std::vector<uint32_t> rows = PickSlices(slices);
+  SliceNestingIndex index(slices);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    uint32_t row = rows[i++ % rows.size()];
+    benchmark::DoNotOptimize(RowMap(index.GetDescendantRows(row)));
+  }
+}
+BENCHMARK(BM_SliceDescendantsByIndex)->Apply(BenchmarkArgs);
+
+static void BM_SliceNestingIndexBuild(benchmark::State& state) {
+  TraceStorage storage;
+  GenerateSlices(&storage, static_cast<uint32_t>(state.range(0)),
+                 static_cast<uint32_t>(state.range(1)));
+
+  for (auto _ : state) {
+    SliceNestingIndex index(storage.slice_table());
+    benchmark::DoNotOptimize(index.row_count());
+  }
+}
+BENCHMARK(BM_SliceNestingIndexBuild)->Apply(BenchmarkArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/analysis/slice_nesting_index.h"
+
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+class SliceNestingIndexTest : public ::testing::Test {
+ public:
+  SliceNestingIndexTest() { context_.storage.reset(new TraceStorage()); }
+
+ protected:
+  uint32_t AddSlice(uint32_t track, base::Optional<uint32_t> parent_row) {
+    auto* slices = context_.storage->mutable_slice_table();
+    tables::SliceTable::Row row;
+    row.ts = static_cast<int64_t>(slices->row_count());
+    row.dur = 1;
+    row.track_id = TrackId(track);
+    if (parent_row) {
+      row.parent_id = slices->id()[*parent_row];
+      row.depth = slices->depth()[*parent_row] + 1;
+    }
+    return slices->Insert(row).row;
+  }
+
+  TraceProcessorContext context_;
+};
+
+TEST_F(SliceNestingIndexTest, Descendants) {
+  // Two stacks on different tracks, interleaved in the table.
+  uint32_t a = AddSlice(1, base::nullopt);
+  uint32_t b = AddSlice(1, a);
+  uint32_t c = AddSlice(1, b);
+  uint32_t e = AddSlice(2, base::nullopt);
+  uint32_t d = AddSlice(1, a);
+  uint32_t f = AddSlice(1, d);
+  uint32_t g = AddSlice(2, e);
+
+  SliceNestingIndex index(context_.storage->slice_table());
+  ASSERT_EQ(index.row_count(), 7u);
+
+  ASSERT_THAT(index.GetDescendantRows(a), ElementsAre(b, c, d, f));
+  ASSERT_THAT(index.GetDescendantRows(b), ElementsAre(c));
+  ASSERT_THAT(index.GetDescendantRows(d), ElementsAre(f));
+  ASSERT_THAT(index.GetDescendantRows(e), ElementsAre(g));
+  ASSERT_THAT(index.GetDescendantRows(c), IsEmpty());
+  ASSERT_EQ(index.DescendantCount(a), 4u);
+
+  ASSERT_THAT(index.GetAncestorRows(f), ElementsAre(d, a));
+  ASSERT_THAT(index.GetAncestorRows(g), ElementsAre(e));
+  ASSERT_THAT(index.GetAncestorRows(a), IsEmpty());
+
+  ASSERT_TRUE(index.IsAncestor(a, f));
+  ASSERT_TRUE(index.IsAncestor(b, c));
+  ASSERT_TRUE(index.IsAncestor(e, g));
+  ASSERT_FALSE(index.IsAncestor(b, f));
+  ASSERT_FALSE(index.IsAncestor(a, g));
+  ASSERT_FALSE(index.IsAncestor(c, b));
+  ASSERT_FALSE(index.IsAncestor(a, a));
+}
+
+TEST_F(SliceNestingIndexTest, RebuiltWhenSlicesAdded) {
+  uint32_t a = AddSlice(1, base::nullopt);
+  uint32_t b = AddSlice(1, a);
+
+  const SliceNestingIndex* index = &SliceNestingIndex::GetOrCreate(&context_);
+  ASSERT_THAT(index->GetDescendantRows(a), ElementsAre(b));
+  ASSERT_EQ(&SliceNestingIndex::GetOrCreate(&context_), index);
+
+  uint32_t c = AddSlice(1, b);
+  index = &SliceNestingIndex::GetOrCreate(&context_);
+  ASSERT_EQ(index->row_count(), 3u);
+  ASSERT_THAT(index->GetDescendantRows(a), ElementsAre(b, c));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -301,6 +301,45 @@ class BitVector {
     return bv;
   }
 
+  // Creates a BitVector of size |end| with the bits between |start| and |end|
+  // filled using the word filler function |f|.
+  //
+  // This is equivalent to Range except that |f| computes up to 64 bits at a
+  // time: |f(idx, count)| should return a word where bit i is set iff the bit
+  // at index |idx + i| should be set, for all i < |count|. |count| is at most
+  // 64 and any bits at or above |count| in the returned word are ignored.
+  template <typename WordFiller = uint64_t(uint32_t, uint32_t)>
+  static BitVector RangeFromWords(uint32_t start, uint32_t end, WordFiller f) {
+    // Compute the block index and bitvector index where we start and end
+    // working one block at a time.
+    uint32_t start_fast_block = BlockCeil(start);
+    uint32_t start_fast_idx = BlockToIndex(start_fast_block);
+    uint32_t end_fast_block = BlockFloor(end);
+    uint32_t end_fast_idx = BlockToIndex(end_fast_block);
+
+    BitVector bv(start, false);
+    if (start_fast_block > end_fast_block) {
+      // |start| and |end| are in the same block so there's no block we can
+      // fill at once.
+      bv.AppendFromWords(start, end, f);
+      return bv;
+    }
+
+    // Fill up to |start_fast_index| with values from the filler.
+    bv.AppendFromWords(start, start_fast_idx, f);
+
+    // At this point we can work one block at a time.
+    for (uint32_t i = start_fast_block; i < end_fast_block; ++i) {
+      bv.counts_.emplace_back(bv.GetNumBitsSet());
+      bv.blocks_.emplace_back(Block::FromWordFiller(bv.size_, f));
+      bv.size_ += Block::kBits;
+    }
+
+    // Add the last few elements to finish up to |end|.
+    bv.AppendFromWords(end_fast_idx, end, f);
+    return bv;
+  }
+
   // Updates the ith set bit of this bitvector with the value of
   // |other.IsSet(i)|.
   //
@@ -347,6 +386,7 @@ class BitVector {
   friend class internal::BaseIterator;
   friend class internal::AllBitsIterator;
   friend class internal::SetBitsIterator;
+  friend class StorageSnapshot;
 
   // Represents the offset of a bit within a block.
   struct BlockOffset {
@@ -652,6 +692,17 @@ class BitVector {
       return b;
     }
 
+    // Creates a block by using the output of the given word filler function
+    // (see RangeFromWords) starting at the given |offset|.
+    template <typename WordFiller = uint64_t(uint32_t, uint32_t)>
+    static Block FromWordFiller(uint32_t offset, WordFiller f) {
+      Block b;
+      for (uint32_t i = 0; i < kWords; ++i) {
+        b.words_[i].Or(f(offset + i * BitWord::kBits, BitWord::kBits));
+      }
+      return b;
+    }
+
    private:
     std::array<BitWord, kWords> words_{};
   };
@@ -663,6 +714,19 @@ class BitVector {
   BitVector(const BitVector&) = delete;
   BitVector& operator=(const BitVector&) = delete;
 
+  // Appends the bits between |start| and |end| (exclusive) using the output of
+  // the given word filler function (see RangeFromWords).
+  template <typename WordFiller = uint64_t(uint32_t, uint32_t)>
+  void AppendFromWords(uint32_t start, uint32_t end, WordFiller f) {
+    for (uint32_t i = start; i < end; i += BitWord::kBits) {
+      uint32_t count = end - i < BitWord::kBits ? end - i : BitWord::kBits;
+      uint64_t word = f(i, count);
+      for (uint32_t j = 0; j < count; ++j) {
+        Append((word >> j) & 1ull);
+      }
+    }
+  }
+
   // Set all the bits between the addresses given by |start| and |end|
   // (inclusive).
   // Note: this method does not update the counts vector - that is the
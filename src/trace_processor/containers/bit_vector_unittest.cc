@@ -411,6 +411,40 @@ TEST(BitVectorUnittest, Range) {
   ASSERT_EQ(bv.GetNumBitsSet(), 341u);
 }
 
+TEST(BitVectorUnittest, RangeFromWords) {
+  auto filler = [](uint32_t idx, uint32_t count) {
+    EXPECT_LE(count, 64u);
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      word |= static_cast<uint64_t>((idx + i) % 3 == 0) << i;
+    }
+    // Set bits above |count| to check they are ignored.
+    return count == 64 ? word : word | (~0ull << count);
+  };
+  BitVector bv = BitVector::RangeFromWords(1, 1025, filler);
+
+  ASSERT_FALSE(bv.IsSet(0));
+  for (uint32_t i = 1; i < 1025; ++i) {
+    ASSERT_EQ(i % 3 == 0, bv.IsSet(i));
+  }
+  ASSERT_EQ(bv.size(), 1025u);
+  ASSERT_EQ(bv.GetNumBitsSet(), 341u);
+
+  // Check a range starting and ending inside the same block.
+  BitVector small = BitVector::RangeFromWords(3, 100, filler);
+  ASSERT_EQ(small.size(), 100u);
+  for (uint32_t i = 0; i < 100; ++i) {
+    ASSERT_EQ(i >= 3 && i % 3 == 0, small.IsSet(i));
+  }
+
+  // Check a range spanning several blocks.
+  BitVector large = BitVector::RangeFromWords(0, 123456, filler);
+  ASSERT_EQ(large.size(), 123456u);
+  ASSERT_EQ(large.GetNumBitsSet(), 41152u);
+  ASSERT_TRUE(large.IsSet(123453));
+  ASSERT_FALSE(large.IsSet(123455));
+}
+
 TEST(BitVectorUnittest, QueryStressTest) {
   BitVector bv;
   std::vector<bool> bool_vec;
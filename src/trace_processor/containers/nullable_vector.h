@@ -19,7 +19,8 @@
 
 #include <stdint.h>
 
-#include <deque>
+#include <algorithm>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
@@ -42,13 +43,93 @@ class NullableVectorBase {
   NullableVectorBase& operator=(NullableVectorBase&&) noexcept = default;
 };
 
+// Stores a list of values in fixed size chunks rather than in one contiguous
+// buffer. Like a std::deque, appending never moves the existing values so
+// growing a large column does not need twice its memory while the values are
+// copied (as reallocating a std::vector does). Unlike a std::deque, the chunks
+// are known so batch operations can work directly on their values (see
+// ContiguousCount()).
+template <typename T>
+class ChunkedVector {
+ public:
+  // The number of values in each chunk. As it is a multiple of 64, words of
+  // 64 values starting at a multiple of 64 never straddle two chunks.
+  static constexpr uint32_t kChunkSize = 64 * 1024;
+
+  const T& operator[](uint32_t idx) const {
+    return chunks_[idx / kChunkSize][idx % kChunkSize];
+  }
+  T& operator[](uint32_t idx) {
+    return chunks_[idx / kChunkSize][idx % kChunkSize];
+  }
+
+  // Returns the number of values stored contiguously from |idx| (i.e. the
+  // values from |idx| to the end of its chunk).
+  uint32_t ContiguousCount(uint32_t idx) const {
+    return std::min(kChunkSize - idx % kChunkSize, size_ - idx);
+  }
+
+  void push_back(T val) {
+    if (chunks_.empty() || chunks_.back().size() == kChunkSize) {
+      chunks_.emplace_back();
+      // The first chunk grows as needed so that small vectors stay small.
+      if (chunks_.size() > 1)
+        chunks_.back().reserve(kChunkSize);
+    }
+    chunks_.back().push_back(val);
+    size_++;
+  }
+
+  // Inserts |val| at |idx|, moving all the following values. O(n).
+  void Insert(uint32_t idx, T val) {
+    PERFETTO_DCHECK(idx <= size_);
+    push_back(val);
+
+    // Shift the values in each chunk by one, starting from the last chunk and
+    // carrying the last value of the previous chunk to the front of the
+    // current one.
+    uint32_t first_chunk = idx / kChunkSize;
+    for (uint32_t c = static_cast<uint32_t>(chunks_.size() - 1);; --c) {
+      std::vector<T>& chunk = chunks_[c];
+      auto begin = chunk.begin() + (c == first_chunk ? idx % kChunkSize : 0);
+      std::move_backward(begin, chunk.end() - 1, chunk.end());
+      if (c == first_chunk)
+        break;
+      chunk.front() = chunks_[c - 1].back();
+    }
+    (*this)[idx] = val;
+  }
+
+  // Replaces the contents of the vector with the values in [|begin|, |end|).
+  void Assign(const T* begin, const T* end) {
+    chunks_.clear();
+    size_ = 0;
+    while (begin != end) {
+      uint32_t count = static_cast<uint32_t>(
+          std::min<ptrdiff_t>(end - begin, static_cast<ptrdiff_t>(kChunkSize)));
+      chunks_.emplace_back(begin, begin + count);
+      begin += count;
+      size_ += count;
+    }
+  }
+
+  uint32_t size() const { return size_; }
+
+  // Returns the chunks of values: all but the last one hold kChunkSize values.
+  const std::vector<std::vector<T>>& chunks() const { return chunks_; }
+
+ private:
+  std::vector<std::vector<T>> chunks_;
+  uint32_t size_ = 0;
+};
+
 // A data structure which compactly stores a list of possibly nullable data.
 //
-// Internally, this class is implemented using a combination of a std::deque
-// with a BitVector used to store whether each index is null or not.
-// By default, for each null value, it only uses a single bit inside the
+// Internally, this class is implemented using a combination of a
+// ChunkedVector with a BitVector used to store whether each index is null or
+// not. By default, for each null value, it only uses a single bit inside the
 // BitVector at a slight cost (searching the BitVector to find the index into
-// the std::deque) when looking up the data.
+// the ChunkedVector) when looking up the data.
 template <typename T>
 class NullableVector : public NullableVectorBase {
  private:
@@ -114,14 +195,14 @@ class NullableVector : public NullableVectorBase {
 
   // Adds the given value to the NullableVector.
   void Append(T val) {
-    data_.emplace_back(val);
+    data_.push_back(val);
     valid_.Insert(size_++);
   }
 
   // Adds a null value to the NullableVector.
   void AppendNull() {
     if (mode_ == Mode::kDense) {
-      data_.emplace_back();
+      data_.push_back(T());
     }
     size_++;
   }
@@ -154,7 +235,7 @@ class NullableVector : public NullableVectorBase {
 
         opt_row = valid_.RowOf(idx);
         PERFETTO_DCHECK(opt_row);
-        data_.insert(data_.begin() + static_cast<ptrdiff_t>(*opt_row), val);
+        data_.Insert(*opt_row, val);
       }
     }
   }
@@ -165,12 +246,20 @@ class NullableVector : public NullableVectorBase {
   // Returns whether data in this NullableVector is stored densely.
   bool IsDense() const { return mode_ == Mode::kDense; }
 
+  // Returns the storage backing this NullableVector. If there are no null
+  // values (or this NullableVector is dense), the value at |idx| is stored at
+  // index |idx| of this vector; this allows batch operations to work directly
+  // on the data rather than calling Get() for every index.
+  const ChunkedVector<T>& non_null_vector() const { return data_; }
+
  private:
+  friend class StorageSnapshot;
+
   explicit NullableVector(Mode mode) : mode_(mode) {}
 
   Mode mode_ = Mode::kSparse;
 
-  std::deque<T> data_;
+  ChunkedVector<T> data_;
   RowMap valid_;
   uint32_t size_ = 0;
 };
@@ -98,6 +98,40 @@ TEST(NullableVector, Dense) {
   ASSERT_EQ(sv.GetNonNull(2), 2);
 }
 
+TEST(NullableVector, SetAcrossChunks) {
+  auto sv = NullableVector<int64_t>::Sparse();
+  const uint32_t kSize = 2 * ChunkedVector<int64_t>::kChunkSize + 10;
+  for (uint32_t i = 0; i < kSize; ++i) {
+    if (i % 2)
+      sv.Append(i);
+    else
+      sv.AppendNull();
+  }
+
+  // Setting a null value in the first chunk shifts the values of all the
+  // chunks after it.
+  sv.Set(10, 10);
+  for (uint32_t i = 0; i < kSize; ++i) {
+    if (i % 2 || i == 10)
+      ASSERT_EQ(sv.Get(i), static_cast<int64_t>(i));
+    else
+      ASSERT_EQ(sv.Get(i), base::nullopt);
+  }
+}
+
+TEST(ChunkedVector, ContiguousCount) {
+  ChunkedVector<int64_t> cv;
+  const uint32_t kChunkSize = ChunkedVector<int64_t>::kChunkSize;
+  for (uint32_t i = 0; i < kChunkSize + 5; ++i)
+    cv.push_back(i);
+
+  ASSERT_EQ(cv.chunks().size(), 2u);
+  ASSERT_EQ(cv.ContiguousCount(0), kChunkSize);
+  ASSERT_EQ(cv.ContiguousCount(kChunkSize - 1), 1u);
+  ASSERT_EQ(cv.ContiguousCount(kChunkSize), 5u);
+  ASSERT_EQ(cv[kChunkSize + 4], kChunkSize + 4);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -486,6 +486,28 @@ class RowMap {
     }
   }
 
+  // Same as FilterInto except that |w| computes the result of the predicate
+  // for up to 64 indices at a time: |w(idx, count)| should return a word where
+  // bit i is set iff index |idx + i| should be retained, for all i < |count|.
+  // This allows the predicate to be evaluated using vectorized code.
+  //
+  // Only supported if both |this| and |out| are ranges; callers should check
+  // this and use FilterInto otherwise.
+  template <typename WordPredicate = uint64_t(uint32_t, uint32_t)>
+  void FilterIntoByWords(RowMap* out, WordPredicate w) const {
+    PERFETTO_DCHECK(IsRange() && out->IsRange());
+    PERFETTO_DCHECK(size() >= out->size());
+
+    if (out->empty())
+      return;
+
+    // As |this| is a range, index |i| of |this| is simply |start_index_ + i|
+    // so consecutive rows of |out| map to consecutive indices.
+    out->FilterRangeByWords([this, &w](uint32_t row, uint32_t count) {
+      return w(GetRange(row), count);
+    });
+  }
+
   template <typename Comparator = bool(uint32_t, uint32_t)>
   void StableSort(std::vector<uint32_t>* out, Comparator c) const {
     switch (mode_) {
@@ -517,6 +539,8 @@ class RowMap {
   bool IsRange() const { return mode_ == Mode::kRange; }
 
  private:
+  friend class StorageSnapshot;
+
   enum class Mode {
     kRange,
     kBitVector,
@@ -648,6 +672,47 @@ class RowMap {
     *this = RowMap(BitVector::Range(start_index_, end_index_, p));
   }
 
+  // Same as FilterRange but with a predicate computing 64 indices at a time
+  // (see FilterIntoByWords).
+  template <typename WordPredicate>
+  void FilterRangeByWords(WordPredicate w) {
+    uint32_t count = end_index_ - start_index_;
+
+    // See FilterRange for an explanation of the choice between BitVector and
+    // index vector.
+    constexpr uint32_t kSmallRangeLimit = 2048;
+    bool is_small_range = count < kSmallRangeLimit;
+    uint32_t bit_vector_cost = BitVector::ApproxBytesCost(end_index_);
+    uint32_t index_vector_cost_ub = sizeof(uint32_t) * count;
+    if (is_small_range || index_vector_cost_ub <= bit_vector_cost ||
+        optimize_for_ == OptimizeFor::kLookupSpeed) {
+      std::vector<uint32_t> iv(std::min(kSmallRangeLimit, count));
+
+      uint32_t out_i = 0;
+      for (uint32_t i = start_index_; i < end_index_; i += 64) {
+        // Make sure there is space for every index in this word.
+        uint32_t word_count = std::min(end_index_ - i, 64u);
+        if (PERFETTO_UNLIKELY(out_i + word_count > iv.size()))
+          iv.resize(iv.size() + kSmallRangeLimit);
+
+        uint64_t word = w(i, word_count);
+
+        // As in FilterRange, keep this branch free by always writing the index
+        // but only incrementing the out index if the bit is set.
+        for (uint32_t j = 0; j < word_count; ++j) {
+          iv[out_i] = i + j;
+          out_i += (word >> j) & 1u;
+        }
+      }
+      iv.resize(out_i);
+      iv.shrink_to_fit();
+
+      *this = RowMap(std::move(iv));
+      return;
+    }
+    *this = RowMap(BitVector::RangeFromWords(start_index_, end_index_, w));
+  }
+
   void InsertIntoBitVector(uint32_t row) {
     PERFETTO_DCHECK(mode_ == Mode::kBitVector);
 
@@ -114,6 +114,47 @@ void BenchRowMapFilterInto(benchmark::State& state,
   }
 }
 
+std::vector<int64_t> CreateNumericColumn(uint32_t size) {
+  static constexpr uint32_t kRandomSeed = 89;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+  std::vector<int64_t> column(size);
+  for (uint32_t i = 0; i < size; ++i) {
+    column[i] = static_cast<int64_t>(rnd_engine() % 100);
+  }
+  return column;
+}
+
+// Benchmarks filtering a range with the predicate |column[row] < value| for
+// a random |value|; this is the common case when filtering a numeric column.
+template <bool by_words>
+void BenchRowMapFilterIntoNumeric(benchmark::State& state) {
+  std::vector<int64_t> column = CreateNumericColumn(kSize);
+  auto pool_vec = CreateIndexVector(kPoolSize, 100);
+
+  RowMap rm(0, kSize);
+  uint32_t pool_idx = 0;
+  for (auto _ : state) {
+    RowMap out(0, kSize);
+    int64_t value = pool_vec[pool_idx];
+    const int64_t* data = column.data();
+    if (by_words) {
+      rm.FilterIntoByWords(&out, [data, value](uint32_t idx, uint32_t count) {
+        uint64_t word = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+          word |= static_cast<uint64_t>(data[idx + i] < value) << i;
+        }
+        return word;
+      });
+    } else {
+      rm.FilterInto(&out,
+                    [data, value](uint32_t row) { return data[row] < value; });
+    }
+    pool_idx = (pool_idx + 1) % kPoolSize;
+
+    benchmark::ClobberMemory();
+  }
+}
+
 }  // namespace
 
 static void BM_RowMapRangeGet(benchmark::State& state) {
@@ -263,3 +304,13 @@ static void BM_RowMapFilterIntoIvWithBv(benchmark::State& state) {
   });
 }
 BENCHMARK(BM_RowMapFilterIntoIvWithBv);
+
+static void BM_RowMapFilterIntoRangeNumeric(benchmark::State& state) {
+  BenchRowMapFilterIntoNumeric<false>(state);
+}
+BENCHMARK(BM_RowMapFilterIntoRangeNumeric);
+
+static void BM_RowMapFilterIntoRangeNumericByWords(benchmark::State& state) {
+  BenchRowMapFilterIntoNumeric<true>(state);
+}
+BENCHMARK(BM_RowMapFilterIntoRangeNumericByWords);
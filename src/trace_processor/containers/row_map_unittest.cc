@@ -398,6 +398,39 @@ TEST(RowMapUnittest, FilterIntoLargeRangeWithRange) {
   }
 }
 
+TEST(RowMapUnittest, FilterIntoByWordsRangeWithRange) {
+  RowMap rm(93, 157);
+  RowMap filter(4, 7);
+  rm.FilterIntoByWords(&filter, [](uint32_t idx, uint32_t count) {
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      word |= static_cast<uint64_t>(idx + i == 97u || idx + i == 98u) << i;
+    }
+    return word;
+  });
+
+  ASSERT_EQ(filter.size(), 2u);
+  ASSERT_EQ(filter.Get(0u), 4u);
+  ASSERT_EQ(filter.Get(1u), 5u);
+}
+
+TEST(RowMapUnittest, FilterIntoByWordsLargeRangeWithRange) {
+  RowMap rm(0, 100000);
+  RowMap filter(1, 100000);
+  rm.FilterIntoByWords(&filter, [](uint32_t idx, uint32_t count) {
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      word |= static_cast<uint64_t>((idx + i) % 2 == 0) << i;
+    }
+    return word;
+  });
+
+  ASSERT_EQ(filter.size(), 100000u / 2 - 1);
+  for (uint32_t i = 0; i < 100000 / 2 - 1; ++i) {
+    ASSERT_EQ(filter.Get(i), (i + 1) * 2);
+  }
+}
+
 TEST(RowMapUnittest, FilterIntoBitVectorWithRange) {
   RowMap rm(
       BitVector{true, false, false, true, false, true, false, true, true});
@@ -38,8 +38,14 @@ constexpr size_t StringPool::kBlockIndexBitMask;
 constexpr size_t StringPool::kBlockSizeBytes;
 // static
 constexpr size_t StringPool::kMinLargeStringSizeBytes;
+// static
+constexpr size_t StringPool::kNumIndexShardBits;
+// static
+constexpr size_t StringPool::kNumIndexShards;
 
-StringPool::StringPool() {
+StringPool::StringPool()
+    : index_shards_(new IndexShard[kNumIndexShards]),
+      storage_mutex_(new std::mutex()) {
   static_assert(
       StringPool::kMinLargeStringSizeBytes <= StringPool::kBlockSizeBytes + 1,
       "minimum size of large strings must be small enough to support any "
@@ -56,7 +62,44 @@ StringPool::~StringPool() = default;
 StringPool::StringPool(StringPool&&) noexcept = default;
 StringPool& StringPool::operator=(StringPool&&) noexcept = default;
 
+void StringPool::SetConcurrent(bool concurrent) {
+  // Ids index directly into |blocks_| without locking, so the vector must
+  // never be reallocated while other threads are reading from it.
+  if (concurrent)
+    blocks_.reserve(1u << kNumBlockIndexBits);
+  concurrent_ = concurrent;
+}
+
+size_t StringPool::size() const {
+  size_t size = 0;
+  for (size_t i = 0; i < kNumIndexShards; ++i) {
+    std::unique_lock<std::mutex> lock(index_shards_[i].mutex, std::defer_lock);
+    if (concurrent_)
+      lock.lock();
+    size += index_shards_[i].index.size();
+  }
+  return size;
+}
+
+void StringPool::RebuildIndex() {
+  for (size_t i = 0; i < kNumIndexShards; ++i)
+    index_shards_[i].index.Clear();
+  for (auto it = CreateIterator(); it; ++it) {
+    Id id = it.StringId();
+    if (id.is_null())
+      continue;
+    StringHash hash = it.StringView().Hash();
+    ShardForHash(hash).index.Insert(hash, id);
+  }
+}
+
 StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
+  // The caller holds the lock of the index shard of |hash|, which is always
+  // taken before this one.
+  std::unique_lock<std::mutex> lock(*storage_mutex_, std::defer_lock);
+  if (concurrent_)
+    lock.lock();
+
   // Try and find enough space in the current block for the string and the
   // metadata (varint-encoded size + the string data + the null terminator).
   bool success;
@@ -71,6 +114,7 @@ StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
     if (str.size() + kMaxMetadataSize >= kMinLargeStringSizeBytes) {
       return InsertLargeString(str, hash);
     }
+    PERFETTO_CHECK(!concurrent_ || blocks_.size() < blocks_.capacity());
     blocks_.emplace_back(kBlockSizeBytes);
 
     // Try and reserve space again - this time we should definitely succeed.
@@ -82,9 +126,9 @@ StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
   // hash to the id.
   Id string_id = Id::BlockString(blocks_.size() - 1, offset);
 
-  // Deliberately not adding |string_id| to |string_index_|. The caller
+  // Deliberately not adding |string_id| to the index. The caller
   // (InternString()) must take care of this.
-  PERFETTO_DCHECK(string_index_.Find(hash));
+  PERFETTO_DCHECK(ShardForHash(hash).index.Find(hash));
 
   return string_id;
 }
@@ -95,9 +139,9 @@ StringPool::Id StringPool::InsertLargeString(base::StringView str,
   // Compute id from the index and add a mapping from the hash to the id.
   Id string_id = Id::LargeString(large_strings_.size() - 1);
 
-  // Deliberately not adding |string_id| to |string_index_|. The caller
+  // Deliberately not adding |string_id| to the index. The caller
   // (InternString()) must take care of this.
-  PERFETTO_DCHECK(string_index_.Find(hash));
+  PERFETTO_DCHECK(ShardForHash(hash).index.Find(hash));
 
   return string_id;
 }
@@ -19,8 +19,11 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "perfetto/ext/base/flat_hash_map.h"
@@ -35,6 +38,9 @@ namespace trace_processor {
 
 // Interns strings in a string pool and hands out compact StringIds which can
 // be used to retrieve the string in O(1).
+//
+// By default the pool must only be used from a single thread. See
+// SetConcurrent() to intern strings from multiple threads.
 class StringPool {
  public:
   struct Id {
@@ -114,22 +120,27 @@ class StringPool {
   StringPool(const StringPool&) = delete;
   StringPool& operator=(const StringPool&) = delete;
 
+  // When |concurrent| is true, InternString(), GetId() and Get() can be
+  // called concurrently from multiple threads. The index of the strings is
+  // sharded by hash, with one lock per shard, so interning strings which are
+  // already in the pool rarely contends; copying new strings into the pool
+  // takes a single lock. Iterating over, moving or destroying the pool still
+  // requires that no other thread is using it.
+  //
+  // Must be called while no other thread is using the pool.
+  void SetConcurrent(bool concurrent);
+
   Id InternString(base::StringView str) {
     if (str.data() == nullptr)
       return Id::Null();
 
     auto hash = str.Hash();
-
-    // Perform a hashtable insertion with a null ID just to check if the string
-    // is already inserted. If it's not, overwrite 0 with the actual Id.
-    auto it_and_inserted = string_index_.Insert(hash, Id());
-    Id* id = it_and_inserted.first;
-    if (!it_and_inserted.second) {
-      PERFETTO_DCHECK(Get(*id) == str);
-      return *id;
+    IndexShard* shard = &ShardForHash(hash);
+    if (PERFETTO_UNLIKELY(concurrent_)) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      return InternStringInShard(shard, str, hash);
     }
-    *id = InsertString(str, hash);
-    return *id;
+    return InternStringInShard(shard, str, hash);
   }
 
   base::Optional<Id> GetId(base::StringView str) const {
@@ -137,7 +148,12 @@ class StringPool {
       return Id::Null();
 
     auto hash = str.Hash();
-    Id* id = string_index_.Find(hash);
+    IndexShard& shard = ShardForHash(hash);
+    std::unique_lock<std::mutex> lock(shard.mutex, std::defer_lock);
+    if (PERFETTO_UNLIKELY(concurrent_))
+      lock.lock();
+
+    Id* id = shard.index.Find(hash);
     if (id) {
       PERFETTO_DCHECK(Get(*id) == str);
       return *id;
@@ -155,11 +171,24 @@ class StringPool {
 
   Iterator CreateIterator() const { return Iterator(this); }
 
-  size_t size() const { return string_index_.size(); }
+  size_t size() const;
 
  private:
   using StringHash = uint64_t;
 
+  // Maps hashes of strings to the Id in the string pool.
+  using StringIndex = base::FlatHashMap<StringHash,
+                                        Id,
+                                        base::AlreadyHashed<StringHash>,
+                                        base::LinearProbe,
+                                        /*AppendOnly=*/true>;
+
+  struct IndexShard {
+    // Only locked in concurrent mode.
+    std::mutex mutex;
+    StringIndex index{/*initial_capacity=*/1024u * 1024u / kNumIndexShards};
+  };
+
   struct Block {
     explicit Block(size_t size)
         : mem_(base::PagedMemory::Allocate(size,
@@ -190,6 +219,16 @@ class StringPool {
 
     uint32_t pos() const { return pos_; }
 
+    // Replaces the contents of this block with the first |size| bytes of
+    // another block (i.e. Get(0) to Get(pos())). Used to restore a block
+    // which was previously serialized (see StorageSnapshot).
+    void Restore(const uint8_t* data, uint32_t size) {
+      PERFETTO_CHECK(size <= size_);
+      mem_.EnsureCommitted(size);
+      memcpy(Get(0), data, size);
+      pos_ = size;
+    }
+
    private:
     base::PagedMemory mem_;
     uint32_t pos_ = 0;
@@ -198,6 +237,7 @@ class StringPool {
 
   friend class Iterator;
   friend class StringPoolTest;
+  friend class StorageSnapshot;
 
   // StringPool IDs are 32-bit. If the MSB is 1, the remaining bits of the ID
   // are an index into the |large_strings_| vector. Otherwise, the next 6 bits
@@ -230,6 +270,34 @@ class StringPool {
   // plus 1 byte for null terminator. The actual size may be lower.
   static constexpr uint8_t kMaxMetadataSize = 6;
 
+  // The index is split into shards on the top bits of the hashes (the bottom
+  // bits pick the slot in each shard's hash table).
+  static constexpr size_t kNumIndexShardBits = 5;
+  static constexpr size_t kNumIndexShards = 1u << kNumIndexShardBits;
+
+  IndexShard& ShardForHash(StringHash hash) const {
+    return index_shards_[hash >> (64 - kNumIndexShardBits)];
+  }
+
+  // Rebuilds the index from the strings in the pool.
+  void RebuildIndex();
+
+  // Must be called with the lock of |shard| held in concurrent mode.
+  Id InternStringInShard(IndexShard* shard,
+                         base::StringView str,
+                         StringHash hash) {
+    // Perform a hashtable insertion with a null ID just to check if the string
+    // is already inserted. If it's not, overwrite 0 with the actual Id.
+    auto it_and_inserted = shard->index.Insert(hash, Id());
+    Id* id = it_and_inserted.first;
+    if (!it_and_inserted.second) {
+      PERFETTO_DCHECK(Get(*id) == str);
+      return *id;
+    }
+    *id = InsertString(str, hash);
+    return *id;
+  }
+
   // Inserts the string with the given hash into the pool and return its Id.
   Id InsertString(base::StringView, uint64_t hash);
 
@@ -246,8 +314,9 @@ class StringPool {
     size_t block_index = id.block_index();
     uint32_t block_offset = id.block_offset();
 
-    PERFETTO_DCHECK(block_index < blocks_.size());
-    PERFETTO_DCHECK(block_offset < blocks_[block_index].pos());
+    // The sizes can change under our feet in concurrent mode.
+    PERFETTO_DCHECK(concurrent_ || block_index < blocks_.size());
+    PERFETTO_DCHECK(concurrent_ || block_offset < blocks_[block_index].pos());
 
     return blocks_[block_index].Get(block_offset);
   }
@@ -277,6 +346,10 @@ class StringPool {
   // set.
   NullTermStringView GetLargeString(Id id) const {
     PERFETTO_DCHECK(id.is_large_string());
+    // |large_strings_| may be reallocated by another thread.
+    std::unique_lock<std::mutex> lock(*storage_mutex_, std::defer_lock);
+    if (PERFETTO_UNLIKELY(concurrent_))
+      lock.lock();
     size_t index = id.large_string_index();
     PERFETTO_DCHECK(index < large_strings_.size());
     const std::string* str = large_strings_[index].get();
@@ -291,13 +364,12 @@ class StringPool {
   // |large_strings_| is resized).
   std::vector<std::unique_ptr<std::string>> large_strings_;
 
-  // Maps hashes of strings to the Id in the string pool.
-  base::FlatHashMap<StringHash,
-                    Id,
-                    base::AlreadyHashed<StringHash>,
-                    base::LinearProbe,
-                    /*AppendOnly=*/true>
-      string_index_{/*initial_capacity=*/1024u * 1024u};
+  std::unique_ptr<IndexShard[]> index_shards_;
+
+  // Guards |blocks_| and |large_strings_| in concurrent mode.
+  std::unique_ptr<std::mutex> storage_mutex_;
+
+  bool concurrent_ = false;
 };
 
 }  // namespace trace_processor
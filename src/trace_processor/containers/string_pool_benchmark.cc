@@ -0,0 +1,110 @@
+// Copyright (C) 2022 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "src/trace_processor/containers/string_pool.h"
+
+using perfetto::trace_processor::StringPool;
+
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+size_t NumInternsPerThread() {
+  return IsBenchmarkFunctionalOnly() ? 1024 : 1024 * 1024;
+}
+
+// Creates the strings interned by each thread. As in traces, a small set of
+// distinct strings (e.g. slice and arg names) is interned over and over, so
+// most interning calls find a string which is already in the pool.
+std::vector<std::string> CreateStrings(size_t count, uint32_t seed) {
+  static constexpr uint32_t kNumDistinctStrings = 64 * 1024;
+  std::minstd_rand0 rnd_engine(seed);
+  std::vector<std::string> strings;
+  strings.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t n = rnd_engine() % kNumDistinctStrings;
+    strings.push_back("some.category.name_" + std::to_string(n));
+  }
+  return strings;
+}
+
+void InternStrings(StringPool* pool, const std::vector<std::string>& strings) {
+  for (const std::string& str : strings) {
+    benchmark::DoNotOptimize(
+        pool->InternString(perfetto::base::StringView(str)));
+  }
+}
+
+void StringPoolThreadArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(2);
+    return;
+  }
+  for (int threads = 1; threads <= 32; threads *= 2)
+    b->Arg(threads);
+}
+
+}  // namespace
+
+static void BM_StringPoolIntern(benchmark::State& state) {
+  std::vector<std::string> strings = CreateStrings(NumInternsPerThread(), 0);
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::unique_ptr<StringPool> pool(new StringPool());
+    state.ResumeTiming();
+
+    InternStrings(pool.get(), strings);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(strings.size()) *
+                          static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_StringPoolIntern)->Unit(benchmark::kMillisecond);
+
+// Arg: the number of threads interning into the pool.
+static void BM_StringPoolInternConcurrent(benchmark::State& state) {
+  size_t num_threads = static_cast<size_t>(state.range(0));
+  std::vector<std::vector<std::string>> strings;
+  for (uint32_t i = 0; i < num_threads; ++i)
+    strings.emplace_back(CreateStrings(NumInternsPerThread(), i));
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::unique_ptr<StringPool> pool(new StringPool());
+    pool->SetConcurrent(true);
+    state.ResumeTiming();
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i)
+      threads.emplace_back(InternStrings, pool.get(), std::cref(strings[i]));
+    for (std::thread& thread : threads)
+      thread.join();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(num_threads) *
+                          static_cast<int64_t>(NumInternsPerThread()) *
+                          static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_StringPoolInternConcurrent)
+    ->Apply(StringPoolThreadArgs)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
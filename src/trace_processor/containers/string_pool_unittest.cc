@@ -18,6 +18,7 @@
 
 #include <array>
 #include <random>
+#include <thread>
 
 #include "test/gtest_and_gmock.h"
 
@@ -128,6 +129,44 @@ TEST_F(StringPoolTest, StressTest) {
   ASSERT_EQ(string_map.size(), 0u);
 }
 
+TEST_F(StringPoolTest, ConcurrentIntern) {
+  constexpr size_t kNumThreads = 8;
+  constexpr size_t kNumStrings = 20000;
+
+  std::vector<std::string> strings;
+  for (size_t i = 0; i < kNumStrings; ++i)
+    strings.push_back("string_" + std::to_string(i));
+
+  // All the threads intern the same strings, in different orders, so that
+  // most strings are raced for.
+  pool_.SetConcurrent(true);
+  std::array<std::vector<StringPool::Id>, kNumThreads> ids;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([this, t, &strings, &ids] {
+      ids[t].resize(strings.size());
+      for (size_t i = 0; i < strings.size(); ++i) {
+        size_t idx = (i + t * 997) % strings.size();
+        if (t % 2)
+          idx = strings.size() - 1 - idx;
+        StringPool::Id id = pool_.InternString(base::StringView(strings[idx]));
+        ASSERT_EQ(pool_.Get(id), base::StringView(strings[idx]));
+        ids[t][idx] = id;
+      }
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+  pool_.SetConcurrent(false);
+
+  ASSERT_EQ(pool_.size(), kNumStrings);
+  for (size_t i = 0; i < kNumStrings; ++i) {
+    for (size_t t = 1; t < kNumThreads; ++t)
+      ASSERT_EQ(ids[t][i], ids[0][i]);
+    ASSERT_EQ(pool_.GetId(base::StringView(strings[i])), ids[0][i]);
+  }
+}
+
 TEST_F(StringPoolTest, BigString) {
   // Two of these should fit into one block, but the third one should go into
   // the |large_strings_| list.
@@ -16,12 +16,26 @@
 
 #include "src/trace_processor/db/column.h"
 
+#include <algorithm>
+
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "src/trace_processor/db/compare.h"
+#include "src/trace_processor/db/compare_kernels.h"
 #include "src/trace_processor/db/table.h"
+#include "src/trace_processor/util/glob.h"
 
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+// The rows appended to a column since its secondary index was last updated
+// are merged into the index once there are at least 1/kIndexMergeRatio as
+// many of them as there are rows in the index.
+constexpr uint32_t kIndexMergeRatio = 8;
+
+}  // namespace
+
 Column::Column(const Column& column,
                Table* table,
                uint32_t col_idx,
@@ -33,7 +47,11 @@ Column::Column(const Column& column,
              col_idx,
              row_map_idx,
              column.nullable_vector_,
-             column.owned_nullable_vector_) {}
+             column.owned_nullable_vector_) {
+  // Share the index so that any changes to the data through this column
+  // invalidate it for the original column as well.
+  sorted_index_ = column.sorted_index_;
+}
 
 Column::Column(const char* name,
                ColumnType type,
@@ -142,6 +160,266 @@ void Column::FilterIntoSlow(FilterOp op, SqlValue value, RowMap* rm) const {
   }
 }
 
+bool Column::FilterIntoIndexed(FilterOp op, SqlValue value, RowMap* rm) const {
+  PERFETTO_DCHECK(IsIndexed());
+  PERFETTO_DCHECK(value.type == type());
+
+  if (!sorted_index_)
+    return false;
+
+  // The index stores indices into the NullableVector so it can only be used
+  // if the rows of the table map directly onto those indices. This is always
+  // the case for columns in the table which inserted the data.
+  const RowMap& col_rm = row_map();
+  if (!col_rm.IsRange() || (!col_rm.empty() && col_rm.Get(0) != 0))
+    return false;
+
+  switch (type_) {
+    case ColumnType::kInt32:
+      return FilterIntoIndexedNumeric<int32_t>(op, value, rm);
+    case ColumnType::kUint32:
+      return FilterIntoIndexedNumeric<uint32_t>(op, value, rm);
+    case ColumnType::kInt64:
+      return FilterIntoIndexedNumeric<int64_t>(op, value, rm);
+    case ColumnType::kDouble:
+      return FilterIntoIndexedNumeric<double>(op, value, rm);
+    case ColumnType::kString: {
+      // The index is sorted by string id rather than by the contents of the
+      // strings so it can only be used for equality.
+      if (op != FilterOp::kEq)
+        return false;
+
+      base::Optional<StringPool::Id> opt_id =
+          string_pool_->GetId(value.string_value);
+      if (!opt_id) {
+        // If the string was never interned, no row can contain it.
+        rm->Intersect(RowMap());
+        return true;
+      }
+      StringPool::Id id = *opt_id;
+      auto fn = [id](StringPool::Id v) {
+        return v < id ? -1 : (id < v ? 1 : 0);
+      };
+      return FilterIntoIndexedWithComparator<StringPool::Id>(op, rm, fn);
+    }
+    case ColumnType::kId:
+    case ColumnType::kDummy:
+      break;
+  }
+  return false;
+}
+
+template <typename T>
+bool Column::FilterIntoIndexedNumeric(FilterOp op,
+                                      SqlValue value,
+                                      RowMap* rm) const {
+  PERFETTO_DCHECK(type_ == ToColumnType<T>());
+  PERFETTO_DCHECK(std::is_arithmetic<T>::value);
+
+  if (std::is_same<T, double>::value) {
+    double double_value = value.double_value;
+    auto fn = [double_value](T v) {
+      // We static cast here as this code will be compiled even when T ==
+      // int64_t as we don't have if constexpr in C++11. In reality the cast
+      // is a noop but we cannot statically verify that for the compiler.
+      return compare::Numeric(static_cast<double>(v), double_value);
+    };
+    return FilterIntoIndexedWithComparator<T>(op, rm, fn);
+  }
+  int64_t long_value = value.long_value;
+  auto fn = [long_value](T v) {
+    // We static cast here as this code will be compiled even when T ==
+    // double as we don't have if constexpr in C++11. In reality the cast is
+    // a noop but we cannot statically verify that for the compiler.
+    return compare::Numeric(static_cast<int64_t>(v), long_value);
+  };
+  return FilterIntoIndexedWithComparator<T>(op, rm, fn);
+}
+
+template <typename T, typename Comparator>
+bool Column::FilterIntoIndexedWithComparator(FilterOp op,
+                                             RowMap* rm,
+                                             Comparator cmp) const {
+  switch (op) {
+    case FilterOp::kEq:
+    case FilterOp::kLt:
+    case FilterOp::kLe:
+    case FilterOp::kGt:
+    case FilterOp::kGe:
+      break;
+    case FilterOp::kNe:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+    case FilterOp::kLike:
+      return false;
+  }
+
+  SortedIndex* index = sorted_index_.get();
+  std::lock_guard<std::mutex> lock(index->mutex);
+  MaybeUpdateSortedIndex<T>(index);
+
+  // Rows appended since the index was last updated are checked one by one.
+  auto matches = [op](int c) {
+    switch (op) {
+      case FilterOp::kEq:
+        return c == 0;
+      case FilterOp::kLt:
+        return c < 0;
+      case FilterOp::kLe:
+        return c <= 0;
+      case FilterOp::kGt:
+        return c > 0;
+      case FilterOp::kGe:
+        return c >= 0;
+      case FilterOp::kNe:
+      case FilterOp::kIsNull:
+      case FilterOp::kIsNotNull:
+      case FilterOp::kGlob:
+      case FilterOp::kLike:
+        break;
+    }
+    PERFETTO_FATAL("Unexpected filter op");
+  };
+  std::vector<uint32_t> unindexed_rows;
+  for (uint32_t i = index->indexed_size; i < row_map().size(); ++i) {
+    base::Optional<T> key = GetIndexKeyAtIdx<T>(i);
+    if (key && matches(cmp(*key)))
+      unindexed_rows.push_back(i);
+  }
+
+  // As the index is sorted by value, the indices with values less than (and
+  // less than or equal to) the constraint value form a prefix of the index.
+  auto lt = [this, &cmp](uint32_t idx) {
+    return cmp(*GetIndexKeyAtIdx<T>(idx)) < 0;
+  };
+  auto le = [this, &cmp](uint32_t idx) {
+    return cmp(*GetIndexKeyAtIdx<T>(idx)) <= 0;
+  };
+  const std::vector<uint32_t>& sorted_idx = index->sorted_idx;
+  auto b = sorted_idx.begin();
+  auto e = sorted_idx.end();
+  switch (op) {
+    case FilterOp::kEq: {
+      auto lower = std::partition_point(b, e, lt);
+      auto upper = std::partition_point(lower, e, le);
+
+      // Indices with equal values are sorted by index.
+      IntersectIndexRange(lower, upper, true /* sorted_by_row */,
+                          unindexed_rows, rm);
+      return true;
+    }
+    case FilterOp::kLt:
+      IntersectIndexRange(b, std::partition_point(b, e, lt), false,
+                          unindexed_rows, rm);
+      return true;
+    case FilterOp::kLe:
+      IntersectIndexRange(b, std::partition_point(b, e, le), false,
+                          unindexed_rows, rm);
+      return true;
+    case FilterOp::kGt:
+      IntersectIndexRange(std::partition_point(b, e, le), e, false,
+                          unindexed_rows, rm);
+      return true;
+    case FilterOp::kGe:
+      IntersectIndexRange(std::partition_point(b, e, lt), e, false,
+                          unindexed_rows, rm);
+      return true;
+    case FilterOp::kNe:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+    case FilterOp::kLike:
+      break;
+  }
+  return false;
+}
+
+template <typename T>
+void Column::MaybeUpdateSortedIndex(SortedIndex* index) const {
+  // Rows are only ever appended to the table so we only need to add the
+  // indices of the rows inserted since the index was last updated. Merging
+  // them costs O(n) so, to avoid paying for it on every filter while rows
+  // are being appended, only merge once the new rows are a sizable fraction
+  // of the index: until then, the caller checks them one by one.
+  uint32_t size = row_map().size();
+  if (index->indexed_size >= size)
+    return;
+  uint32_t unindexed = size - index->indexed_size;
+  if (index->indexed_size > 0 &&
+      unindexed < index->indexed_size / kIndexMergeRatio) {
+    return;
+  }
+
+  // Fetch the values once upfront as looking up values in the NullableVector
+  // is much more expensive than comparing them.
+  std::vector<std::pair<T, uint32_t>> new_entries;
+  for (uint32_t i = index->indexed_size; i < size; ++i) {
+    base::Optional<T> key = GetIndexKeyAtIdx<T>(i);
+    if (key)
+      new_entries.emplace_back(*key, i);
+  }
+  std::sort(new_entries.begin(), new_entries.end());
+
+  // Rows are appended in index order so all the new indices are greater than
+  // the existing ones; merging on the values alone keeps indices with equal
+  // values sorted by index.
+  std::vector<uint32_t>& sorted_idx = index->sorted_idx;
+  std::vector<uint32_t> merged;
+  merged.reserve(sorted_idx.size() + new_entries.size());
+  auto it = sorted_idx.begin();
+  for (const auto& entry : new_entries) {
+    while (it != sorted_idx.end() &&
+           !(entry.first < *GetIndexKeyAtIdx<T>(*it))) {
+      merged.push_back(*it++);
+    }
+    merged.push_back(entry.second);
+  }
+  merged.insert(merged.end(), it, sorted_idx.end());
+  sorted_idx = std::move(merged);
+  index->indexed_size = size;
+}
+
+void Column::IntersectIndexRange(std::vector<uint32_t>::const_iterator begin,
+                                 std::vector<uint32_t>::const_iterator end,
+                                 bool sorted_by_row,
+                                 const std::vector<uint32_t>& unindexed_rows,
+                                 RowMap* rm) const {
+  if (rm->empty())
+    return;
+
+  // Other tables sharing the index may have inserted more rows than this
+  // table can see; ignore those rows.
+  uint32_t size = row_map().size();
+  if (rm->IsRange() && sorted_by_row) {
+    // This is the common case of the first constraint being an equality
+    // constraint; just pick out the rows in the range. The unindexed rows
+    // come after all the indexed ones so the rows stay sorted.
+    uint32_t start = rm->Get(0);
+    uint32_t rm_end = start + rm->size();
+    std::vector<uint32_t> rows;
+    for (auto it = begin; it != end; ++it) {
+      if (*it >= start && *it < rm_end)
+        rows.push_back(*it);
+    }
+    for (uint32_t row : unindexed_rows) {
+      if (row >= start && row < rm_end)
+        rows.push_back(row);
+    }
+    *rm = RowMap(std::move(rows));
+    return;
+  }
+
+  BitVector bv(size, false);
+  for (auto it = begin; it != end; ++it) {
+    if (*it < size)
+      bv.Set(*it);
+  }
+  for (uint32_t row : unindexed_rows)
+    bv.Set(row);
+  rm->Intersect(RowMap(std::move(bv)));
+}
+
 template <typename T, bool is_nullable>
 void Column::FilterIntoNumericSlow(FilterOp op,
                                    SqlValue value,
@@ -170,6 +448,9 @@ void Column::FilterIntoNumericSlow(FilterOp op,
     return;
   }
 
+  if (!is_nullable && FilterIntoNumericWithKernels<T>(op, value, rm))
+    return;
+
   if (value.type == SqlValue::Type::kDouble) {
     double double_value = value.double_value;
     if (std::is_same<T, double>::value) {
@@ -214,6 +495,68 @@ void Column::FilterIntoNumericSlow(FilterOp op,
   }
 }
 
+template <typename T>
+bool Column::FilterIntoNumericWithKernels(FilterOp op,
+                                          SqlValue value,
+                                          RowMap* rm) const {
+  // The kernels need the rows being filtered to map directly onto the storage
+  // and the result to be a range of rows.
+  if (!row_map().IsRange() || !rm->IsRange())
+    return false;
+
+  // Only handle the common case where the value has the same type as the
+  // column; mixed comparisons fall back to the comparators in compare.h.
+  T typed_value;
+  if (std::is_same<T, int64_t>::value && value.type == SqlValue::kLong) {
+    typed_value = static_cast<T>(value.long_value);
+  } else if (std::is_same<T, double>::value &&
+             value.type == SqlValue::kDouble) {
+    typed_value = static_cast<T>(value.double_value);
+  } else {
+    return false;
+  }
+
+  // As the column is not nullable, the value at storage index |idx| is at
+  // index |idx| of the backing vector.
+  const ChunkedVector<T>& data = nullable_vector<T>().non_null_vector();
+  row_map().FilterIntoByWords(rm, [op, &data, typed_value](uint32_t idx,
+                                                           uint32_t count) {
+    // The values of a word may be split between two chunks of the storage.
+    uint32_t first_count = std::min(count, data.ContiguousCount(idx));
+    compare_kernels::CompareWords res =
+        compare_kernels::Compare(&data[idx], first_count, typed_value);
+    if (first_count < count) {
+      compare_kernels::CompareWords rest = compare_kernels::Compare(
+          &data[idx + first_count], count - first_count, typed_value);
+      res.lt |= rest.lt << first_count;
+      res.gt |= rest.gt << first_count;
+    }
+    uint64_t mask = count == 64 ? ~0ull : (1ull << count) - 1;
+    switch (op) {
+      case FilterOp::kLt:
+        return res.lt;
+      case FilterOp::kGt:
+        return res.gt;
+      case FilterOp::kEq:
+        return ~(res.lt | res.gt) & mask;
+      case FilterOp::kNe:
+        return res.lt | res.gt;
+      case FilterOp::kLe:
+        return ~res.gt & mask;
+      case FilterOp::kGe:
+        return ~res.lt & mask;
+      case FilterOp::kIsNull:
+      case FilterOp::kIsNotNull:
+        PERFETTO_FATAL("Should be handled above");
+      case FilterOp::kGlob:
+      case FilterOp::kLike:
+        PERFETTO_FATAL("Should be handled in FilterInto");
+    }
+    PERFETTO_FATAL("For GCC");
+  });
+  return true;
+}
+
 template <typename T, bool is_nullable, typename Comparator>
 void Column::FilterIntoNumericWithComparatorSlow(FilterOp op,
                                                  RowMap* rm,
@@ -276,6 +619,9 @@ void Column::FilterIntoNumericWithComparatorSlow(FilterOp op,
     case FilterOp::kIsNull:
     case FilterOp::kIsNotNull:
       PERFETTO_FATAL("Should be handled above");
+    case FilterOp::kGlob:
+    case FilterOp::kLike:
+      PERFETTO_FATAL("Should be handled in FilterInto");
   }
 }
 
@@ -284,16 +630,17 @@ void Column::FilterIntoStringSlow(FilterOp op,
                                   RowMap* rm) const {
   PERFETTO_DCHECK(type_ == ColumnType::kString);
 
+  const auto& nv = nullable_vector<StringPool::Id>();
   if (op == FilterOp::kIsNull) {
     PERFETTO_DCHECK(value.is_null());
-    row_map().FilterInto(rm, [this](uint32_t row) {
-      return GetStringPoolStringAtIdx(row).data() == nullptr;
+    row_map().FilterInto(rm, [&nv](uint32_t row) {
+      return nv.GetNonNull(row).is_null();
     });
     return;
   } else if (op == FilterOp::kIsNotNull) {
     PERFETTO_DCHECK(value.is_null());
-    row_map().FilterInto(rm, [this](uint32_t row) {
-      return GetStringPoolStringAtIdx(row).data() != nullptr;
+    row_map().FilterInto(rm, [&nv](uint32_t row) {
+      return !nv.GetNonNull(row).is_null();
     });
     return;
   }
@@ -306,49 +653,105 @@ void Column::FilterIntoStringSlow(FilterOp op,
   NullTermStringView str_value = value.string_value;
   PERFETTO_DCHECK(str_value.data() != nullptr);
 
+  // As strings are interned, (in)equality with a string is (in)equality with
+  // its id: this avoids looking up and comparing the strings in every row.
+  if (op == FilterOp::kEq || op == FilterOp::kNe) {
+    base::Optional<StringPool::Id> opt_id = string_pool_->GetId(str_value);
+    if (!opt_id) {
+      // If the string was never interned, no row can be equal to it.
+      if (op == FilterOp::kEq) {
+        rm->Intersect(RowMap());
+      } else {
+        row_map().FilterInto(rm, [&nv](uint32_t row) {
+          return !nv.GetNonNull(row).is_null();
+        });
+      }
+      return;
+    }
+    StringPool::Id id = *opt_id;
+    if (op == FilterOp::kEq) {
+      row_map().FilterInto(
+          rm, [&nv, id](uint32_t row) { return nv.GetNonNull(row) == id; });
+    } else {
+      row_map().FilterInto(rm, [&nv, id](uint32_t row) {
+        StringPool::Id v = nv.GetNonNull(row);
+        return !v.is_null() && v != id;
+      });
+    }
+    return;
+  }
+
   switch (op) {
     case FilterOp::kLt:
-      row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
-        auto v = GetStringPoolStringAtIdx(idx);
-        return v.data() != nullptr && compare::String(v, str_value) < 0;
+      FilterIntoStringWithPredicateSlow(rm, [str_value](NullTermStringView v) {
+        return compare::String(v, str_value) < 0;
       });
       break;
-    case FilterOp::kEq:
-      row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
-        auto v = GetStringPoolStringAtIdx(idx);
-        return v.data() != nullptr && compare::String(v, str_value) == 0;
+    case FilterOp::kGt:
+      FilterIntoStringWithPredicateSlow(rm, [str_value](NullTermStringView v) {
+        return compare::String(v, str_value) > 0;
       });
       break;
-    case FilterOp::kGt:
-      row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
-        auto v = GetStringPoolStringAtIdx(idx);
-        return v.data() != nullptr && compare::String(v, str_value) > 0;
+    case FilterOp::kLe:
+      FilterIntoStringWithPredicateSlow(rm, [str_value](NullTermStringView v) {
+        return compare::String(v, str_value) <= 0;
       });
       break;
-    case FilterOp::kNe:
-      row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
-        auto v = GetStringPoolStringAtIdx(idx);
-        return v.data() != nullptr && compare::String(v, str_value) != 0;
+    case FilterOp::kGe:
+      FilterIntoStringWithPredicateSlow(rm, [str_value](NullTermStringView v) {
+        return compare::String(v, str_value) >= 0;
       });
       break;
-    case FilterOp::kLe:
-      row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
-        auto v = GetStringPoolStringAtIdx(idx);
-        return v.data() != nullptr && compare::String(v, str_value) <= 0;
+    case FilterOp::kGlob:
+      FilterIntoStringWithPredicateSlow(rm, [str_value](NullTermStringView v) {
+        return util::GlobMatches(str_value.c_str(), v.c_str());
       });
       break;
-    case FilterOp::kGe:
-      row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
-        auto v = GetStringPoolStringAtIdx(idx);
-        return v.data() != nullptr && compare::String(v, str_value) >= 0;
+    case FilterOp::kLike:
+      FilterIntoStringWithPredicateSlow(rm, [str_value](NullTermStringView v) {
+        return util::LikeMatches(str_value.c_str(), v.c_str());
       });
       break;
+    case FilterOp::kEq:
+    case FilterOp::kNe:
     case FilterOp::kIsNull:
     case FilterOp::kIsNotNull:
       PERFETTO_FATAL("Should be handled above");
   }
 }
 
+template <typename Predicate>
+void Column::FilterIntoStringWithPredicateSlow(RowMap* rm,
+                                               Predicate pred) const {
+  // Columns usually contain few distinct strings compared to their number of
+  // rows so cache the result of |pred| for every string id seen: most rows
+  // then only need a hash lookup rather than a string comparison. Runs of
+  // the same string are common so the last result is also kept aside.
+  const auto& nv = nullable_vector<StringPool::Id>();
+  base::FlatHashMap<StringPool::Id, bool> results;
+  StringPool::Id last_id = StringPool::Id::Null();
+  bool last_result = false;
+  row_map().FilterInto(rm, [&](uint32_t row) {
+    StringPool::Id id = nv.GetNonNull(row);
+    if (id.is_null())
+      return false;
+    if (id == last_id)
+      return last_result;
+
+    bool* cached = results.Find(id);
+    bool result;
+    if (cached) {
+      result = *cached;
+    } else {
+      result = pred(string_pool_->Get(id));
+      results.Insert(id, result);
+    }
+    last_id = id;
+    last_result = result;
+    return result;
+  });
+}
+
 void Column::FilterIntoIdSlow(FilterOp op, SqlValue value, RowMap* rm) const {
   PERFETTO_DCHECK(type_ == ColumnType::kId);
 
@@ -401,6 +804,9 @@ void Column::FilterIntoIdSlow(FilterOp op, SqlValue value, RowMap* rm) const {
     case FilterOp::kIsNull:
     case FilterOp::kIsNotNull:
       PERFETTO_FATAL("Should be handled above");
+    case FilterOp::kGlob:
+    case FilterOp::kLike:
+      PERFETTO_FATAL("Should be handled in FilterInto");
   }
 }
 
@@ -19,6 +19,10 @@
 
 #include <stdint.h>
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/trace_processor/basic_types.h"
@@ -54,6 +58,11 @@ enum class FilterOp {
   kLe,
   kIsNull,
   kIsNotNull,
+
+  // Pattern matching with the semantics of SQLite's GLOB and LIKE (without
+  // ESCAPE) operators. Only string columns can match these.
+  kGlob,
+  kLike,
 };
 
 // Represents a constraint on a column.
@@ -72,6 +81,12 @@ struct Order {
 class Table;
 
 // Represents a named, strongly typed list of data.
+//
+// Thread safety: like the tables, columns are not thread safe. Any number of
+// threads can read (e.g. filter) a column at the same time as long as no
+// thread modifies it (i.e. appends rows to or sets values in its table).
+// The secondary index of columns with Flag::kIndexed, which is updated by
+// const methods, is protected by its own lock so it does not break this.
 class Column {
  public:
   // Flags which indicate properties of the data in the column. These features
@@ -105,6 +120,17 @@ class Column {
     // This flag is only meaningful for nullable columns has no effect for
     // non-null columns.
     kDense = 1 << 3,
+
+    // Indicates that a secondary index should be maintained for the data in
+    // this column. The index is a permutation of the rows sorted by value
+    // which is built the first time the column is filtered on and allows
+    // equality and range constraints on non-sorted columns to be answered
+    // with a binary search instead of a full table scan.
+    //
+    // This flag should be set on columns which are frequently filtered on
+    // with equality constraints (e.g. track_id or utid columns). It has no
+    // effect on id and sorted columns which already have faster paths.
+    kIndexed = 1 << 4,
   };
 
   // Iterator over a column which conforms to std iterator interface
@@ -171,7 +197,10 @@ class Column {
                col_idx_in_table,
                row_map_idx,
                storage,
-               nullptr) {}
+               nullptr) {
+    if (IsIndexed())
+      sorted_index_.reset(new SortedIndex());
+  }
 
   // Create a Column has the same name and is backed by the same data as
   // |column| but is associated to a different table.
@@ -240,6 +269,7 @@ class Column {
   // Sets the value of the column at the given |row|.
   void Set(uint32_t row, SqlValue value) {
     PERFETTO_CHECK(value.type == type());
+    InvalidateIndex();
     switch (type_) {
       case ColumnType::kInt32: {
         mutable_nullable_vector<int32_t>()->Set(
@@ -279,6 +309,12 @@ class Column {
   // Updates the given RowMap by only keeping rows where this column meets the
   // given filter constraint.
   void FilterInto(FilterOp op, SqlValue value, RowMap* rm) const {
+    if ((op == FilterOp::kGlob || op == FilterOp::kLike) &&
+        type_ != ColumnType::kString) {
+      rm->Intersect(RowMap());
+      return;
+    }
+
     if (IsId() && op == FilterOp::kEq) {
       // If this is an equality constraint on an id column, try and find the
       // single row with the id (if it exists).
@@ -300,6 +336,15 @@ class Column {
         return;
     }
 
+    if (IsIndexed() && value.type == type()) {
+      // If the column has a secondary index, we can binary search the index
+      // to find the rows matching the constraint instead of doing a full table
+      // scan.
+      bool handled = FilterIntoIndexed(op, value, rm);
+      if (handled)
+        return;
+    }
+
     FilterIntoSlow(op, value, rm);
   }
 
@@ -346,6 +391,9 @@ class Column {
   // Returns true if this column is a dense column.
   bool IsDense() const { return (flags_ & Flag::kDense) != 0; }
 
+  // Returns true if this column has a secondary index.
+  bool IsIndexed() const { return (flags_ & Flag::kIndexed) != 0; }
+
   // Returns the backing RowMap for this Column.
   // This function is defined out of line because of a circular dependency
   // between |Table| and |Column|.
@@ -391,6 +439,12 @@ class Column {
   Constraint is_null() const {
     return Constraint{col_idx_in_table_, FilterOp::kIsNull, SqlValue()};
   }
+  Constraint glob_value(SqlValue value) const {
+    return Constraint{col_idx_in_table_, FilterOp::kGlob, value};
+  }
+  Constraint like_value(SqlValue value) const {
+    return Constraint{col_idx_in_table_, FilterOp::kLike, value};
+  }
 
   // Returns an Order for each Order type for this Column.
   Order ascending() const { return Order{col_idx_in_table_, false}; }
@@ -427,6 +481,17 @@ class Column {
 
   const StringPool& string_pool() const { return *string_pool_; }
 
+  // Discards the secondary index of this column (if any). Should be called
+  // before any existing value in the column is changed; the index will be
+  // rebuilt the next time it is needed.
+  void InvalidateIndex() {
+    if (!sorted_index_)
+      return;
+    std::lock_guard<std::mutex> lock(sorted_index_->mutex);
+    sorted_index_->sorted_idx.clear();
+    sorted_index_->indexed_size = 0;
+  }
+
  private:
   enum class ColumnType {
     // Standard primitive types.
@@ -443,7 +508,24 @@ class Column {
     kDummy,
   };
 
+  // Secondary index over the data of a column with Flag::kIndexed.
+  //
+  // Note: the index is built over indices into the backing NullableVector and
+  // is shared between all the columns backed by the same data so that a
+  // change to the data through any of them invalidates it.
+  struct SortedIndex {
+    // Guards the fields below: the index is updated when the column is
+    // filtered, which can happen on several threads at once.
+    std::mutex mutex;
+
+    // Indices of the non-null values among the first |indexed_size| entries
+    // of the NullableVector, sorted by value and then by index.
+    std::vector<uint32_t> sorted_idx;
+    uint32_t indexed_size = 0;
+  };
+
   friend class Table;
+  friend class StorageSnapshot;
 
   // Base constructor for this class which all other constructors call into.
   Column(const char* name,
@@ -533,11 +615,52 @@ class Column {
       case FilterOp::kNe:
       case FilterOp::kIsNull:
       case FilterOp::kIsNotNull:
+      case FilterOp::kGlob:
+      case FilterOp::kLike:
         break;
     }
     return false;
   }
 
+  // Filter method for columns with a secondary index.
+  // Returns whether the constraint was handled by the method.
+  bool FilterIntoIndexed(FilterOp op, SqlValue value, RowMap* rm) const;
+
+  // Filter method for numerics with a secondary index.
+  // Returns whether the constraint was handled by the method.
+  template <typename T>
+  bool FilterIntoIndexedNumeric(FilterOp op, SqlValue value, RowMap* rm) const;
+
+  // Filter method using the secondary index with a comparator.
+  // Returns whether the constraint was handled by the method.
+  template <typename T, typename Comparator = int(T)>
+  bool FilterIntoIndexedWithComparator(FilterOp op,
+                                       RowMap* rm,
+                                       Comparator cmp) const;
+
+  // Merges the rows appended since the secondary index was last updated into
+  // it if there are enough of them to be worth the cost of the merge. Rows
+  // which are not merged have to be checked by the caller. Must be called
+  // with the lock of |index| held.
+  template <typename T>
+  void MaybeUpdateSortedIndex(SortedIndex* index) const;
+
+  // Returns the value at |idx| as stored in the secondary index or nullopt if
+  // the value is null (nulls are not stored in the index).
+  template <typename T>
+  base::Optional<T> GetIndexKeyAtIdx(uint32_t idx) const {
+    return nullable_vector<T>().Get(idx);
+  }
+
+  // Intersects |rm| with the rows in [|begin|, |end|) of the secondary index
+  // and |unindexed_rows|, the sorted matching rows not covered by the index.
+  // |sorted_by_row| should be true if the rows in the range are sorted.
+  void IntersectIndexRange(std::vector<uint32_t>::const_iterator begin,
+                           std::vector<uint32_t>::const_iterator end,
+                           bool sorted_by_row,
+                           const std::vector<uint32_t>& unindexed_rows,
+                           RowMap* rm) const;
+
   // Slow path filter method which will perform a full table scan.
   void FilterIntoSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
@@ -545,6 +668,15 @@ class Column {
   template <typename T, bool is_nullable>
   void FilterIntoNumericSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
+  // Fast path for FilterIntoNumericSlow which compares 64 values at a time
+  // directly on the storage of the column using the kernels in
+  // compare_kernels.h. Returns false (without touching |rm|) if the kernels
+  // cannot be used for this filter.
+  template <typename T>
+  bool FilterIntoNumericWithKernels(FilterOp op,
+                                    SqlValue value,
+                                    RowMap* rm) const;
+
   // Slow path filter method for numerics with a comparator which will perform a
   // full table scan.
   template <typename T, bool is_nullable, typename Comparator = int(T)>
@@ -555,6 +687,12 @@ class Column {
   // Slow path filter method for strings which will perform a full table scan.
   void FilterIntoStringSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
+  // Slow path filter method for strings which keeps the rows where |pred|
+  // returns true for the (non-null) string in the row. |pred| is evaluated
+  // once per distinct string rather than once per row.
+  template <typename Predicate>
+  void FilterIntoStringWithPredicateSlow(RowMap* rm, Predicate pred) const;
+
   // Slow path filter method for ids which will perform a full table scan.
   void FilterIntoIdSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
@@ -623,8 +761,21 @@ class Column {
   uint32_t col_idx_in_table_ = 0;
   uint32_t row_map_idx_ = 0;
   const StringPool* string_pool_ = nullptr;
+
+  // Only set for columns with Flag::kIndexed. Lazily populated the first time
+  // the column is filtered on and then updated as rows are appended.
+  std::shared_ptr<SortedIndex> sorted_index_;
 };
 
+// String columns store null strings as the null StringPool::Id rather than
+// using the NullableVector so they need special handling.
+template <>
+inline base::Optional<StringPool::Id> Column::GetIndexKeyAtIdx(
+    uint32_t idx) const {
+  StringPool::Id id = nullable_vector<StringPool::Id>().GetNonNull(idx);
+  return id.is_null() ? base::nullopt : base::make_optional(id);
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
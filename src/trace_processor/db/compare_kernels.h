@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_COMPARE_KERNELS_H_
+#define SRC_TRACE_PROCESSOR_DB_COMPARE_KERNELS_H_
+
+#include <stdint.h>
+
+#include "perfetto/base/build_config.h"
+#include "src/trace_processor/util/cpu_features.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT) || PERFETTO_TP_AVX2_DISPATCH()
+#include <immintrin.h>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace compare_kernels {
+
+// This file contains kernels which compare a contiguous array of numerics
+// against a single value, producing the results for 64 values at a time as the
+// bits of a word. These are used to speed up filtering of numeric columns as
+// the words can be directly used to build a BitVector.
+//
+// The results are consistent with compare::Numeric: a value is "equal" to
+// |value| iff it is neither less than nor greater than it.
+
+// The result of comparing up to 64 values against a single value: bit i of
+// |lt| (|gt|) is set iff the ith value is less (greater) than the value.
+struct CompareWords {
+  uint64_t lt;
+  uint64_t gt;
+};
+
+// Compares the first |count| (at most 64) values in |data| with |value|.
+template <typename T>
+inline CompareWords CompareScalar(const T* data, uint32_t count, T value) {
+  // This loop is branch-free to allow the compiler to vectorize it.
+  uint64_t lt = 0;
+  uint64_t gt = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    lt |= static_cast<uint64_t>(data[i] < value) << i;
+    gt |= static_cast<uint64_t>(data[i] > value) << i;
+  }
+  return CompareWords{lt, gt};
+}
+
+// Compares the 64 values in |data| with |value|.
+template <typename T>
+inline CompareWords CompareWord(const T* data, T value) {
+  return CompareScalar(data, 64, value);
+}
+
+#if PERFETTO_TP_AVX2_DISPATCH()
+
+// Only called if util::HasAvx2(): compare four values at a time.
+PERFETTO_TP_AVX2_TARGET inline CompareWords CompareWordAvx2(
+    const int64_t* data,
+    int64_t value) {
+  __m256i v = _mm256_set1_epi64x(value);
+  uint64_t lt = 0;
+  uint64_t gt = 0;
+  for (uint32_t i = 0; i < 64; i += 4) {
+    __m256i d =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    auto lt_bits =
+        _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, d)));
+    auto gt_bits =
+        _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(d, v)));
+    lt |= static_cast<uint64_t>(lt_bits) << i;
+    gt |= static_cast<uint64_t>(gt_bits) << i;
+  }
+  return CompareWords{lt, gt};
+}
+
+PERFETTO_TP_AVX2_TARGET inline CompareWords CompareWordAvx2(const double* data,
+                                                            double value) {
+  __m256d v = _mm256_set1_pd(value);
+  uint64_t lt = 0;
+  uint64_t gt = 0;
+  for (uint32_t i = 0; i < 64; i += 4) {
+    __m256d d = _mm256_loadu_pd(data + i);
+    auto lt_bits = _mm256_movemask_pd(_mm256_cmp_pd(d, v, _CMP_LT_OQ));
+    auto gt_bits = _mm256_movemask_pd(_mm256_cmp_pd(d, v, _CMP_GT_OQ));
+    lt |= static_cast<uint64_t>(lt_bits) << i;
+    gt |= static_cast<uint64_t>(gt_bits) << i;
+  }
+  return CompareWords{lt, gt};
+}
+
+#endif  // PERFETTO_TP_AVX2_DISPATCH()
+
+// The kernels used when AVX2 is not available.
+inline CompareWords CompareWordFallback(const int64_t* data, int64_t value) {
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+  // When building with x64 optimizations, SSE4.2 is guaranteed to be
+  // available (see CheckCpuOptimizations() in src/base/utils.cc): compare two
+  // values at a time.
+  __m128i v = _mm_set1_epi64x(value);
+  uint64_t lt = 0;
+  uint64_t gt = 0;
+  for (uint32_t i = 0; i < 64; i += 2) {
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    auto lt_bits = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(v, d)));
+    auto gt_bits = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(d, v)));
+    lt |= static_cast<uint64_t>(lt_bits) << i;
+    gt |= static_cast<uint64_t>(gt_bits) << i;
+  }
+  return CompareWords{lt, gt};
+#else
+  return CompareScalar(data, 64, value);
+#endif
+}
+
+inline CompareWords CompareWordFallback(const double* data, double value) {
+  return CompareScalar(data, 64, value);
+}
+
+inline CompareWords CompareWord(const int64_t* data, int64_t value) {
+#if PERFETTO_TP_AVX2_DISPATCH()
+  if (util::HasAvx2())
+    return CompareWordAvx2(data, value);
+#endif
+  return CompareWordFallback(data, value);
+}
+
+inline CompareWords CompareWord(const double* data, double value) {
+#if PERFETTO_TP_AVX2_DISPATCH()
+  if (util::HasAvx2())
+    return CompareWordAvx2(data, value);
+#endif
+  return CompareWordFallback(data, value);
+}
+
+// Compares the first |count| (at most 64) values in |data| with |value|.
+template <typename T>
+inline CompareWords Compare(const T* data, uint32_t count, T value) {
+  return count == 64 ? CompareWord(data, value)
+                     : CompareScalar(data, count, value);
+}
+
+}  // namespace compare_kernels
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_COMPARE_KERNELS_H_
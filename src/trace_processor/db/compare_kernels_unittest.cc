@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/compare_kernels.h"
+
+#include <limits>
+#include <vector>
+
+#include "src/trace_processor/db/compare.h"
+#include "src/trace_processor/util/cpu_features.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Checks that the kernels agree with compare::Numeric for every value in
+// |data| and for every |count|.
+template <typename T>
+void CheckMatchesCompare(const std::vector<T>& data, T value) {
+  ASSERT_GE(data.size(), 64u);
+
+  // Compare() only uses one of the kernels which work on full words, so also
+  // check the others.
+  compare_kernels::CompareWords expected =
+      compare_kernels::CompareScalar(data.data(), 64, value);
+  std::vector<compare_kernels::CompareWords> words{
+      compare_kernels::CompareWordFallback(data.data(), value)};
+#if PERFETTO_TP_AVX2_DISPATCH()
+  if (util::HasAvx2())
+    words.push_back(compare_kernels::CompareWordAvx2(data.data(), value));
+#endif
+  for (const compare_kernels::CompareWords& res : words) {
+    ASSERT_EQ(res.lt, expected.lt);
+    ASSERT_EQ(res.gt, expected.gt);
+  }
+
+  for (uint32_t count = 1; count <= 64; ++count) {
+    compare_kernels::CompareWords res =
+        compare_kernels::Compare(data.data(), count, value);
+    for (uint32_t i = 0; i < 64; ++i) {
+      int cmp = compare::Numeric(data[i], value);
+      bool in_range = i < count;
+      bool lt = (res.lt >> i) & 1;
+      bool gt = (res.gt >> i) & 1;
+      ASSERT_EQ(lt, in_range && cmp < 0) << count << " " << i;
+      ASSERT_EQ(gt, in_range && cmp > 0) << count << " " << i;
+    }
+  }
+}
+
+TEST(CompareKernelsTest, Long) {
+  std::vector<int64_t> data;
+  for (int64_t i = 0; i < 64; ++i) {
+    data.push_back((i * 37) % 23 - 11);
+  }
+  data[3] = std::numeric_limits<int64_t>::min();
+  data[40] = std::numeric_limits<int64_t>::max();
+
+  CheckMatchesCompare<int64_t>(data, 0);
+  CheckMatchesCompare<int64_t>(data, -11);
+  CheckMatchesCompare<int64_t>(data, std::numeric_limits<int64_t>::min());
+  CheckMatchesCompare<int64_t>(data, std::numeric_limits<int64_t>::max());
+}
+
+TEST(CompareKernelsTest, Double) {
+  std::vector<double> data;
+  for (int i = 0; i < 64; ++i) {
+    data.push_back(((i * 37) % 23 - 11) / 2.0);
+  }
+  data[5] = std::numeric_limits<double>::quiet_NaN();
+  data[17] = -std::numeric_limits<double>::infinity();
+  data[63] = std::numeric_limits<double>::infinity();
+
+  CheckMatchesCompare<double>(data, 0.0);
+  CheckMatchesCompare<double>(data, 1.5);
+  CheckMatchesCompare<double>(data, std::numeric_limits<double>::quiet_NaN());
+  CheckMatchesCompare<double>(data, std::numeric_limits<double>::infinity());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
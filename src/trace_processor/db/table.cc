@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/db/table.h"
 
+#include <algorithm>
+
 namespace perfetto {
 namespace trace_processor {
 
@@ -46,6 +48,14 @@ Table& Table::operator=(Table&& other) noexcept {
   return *this;
 }
 
+void Table::ClearRows() {
+  for (RowMap& rm : row_maps_)
+    rm = RowMap();
+  row_count_ = 0;
+  for (Column& col : columns_)
+    col.InvalidateIndex();
+}
+
 Table Table::Copy() const {
   Table table = CopyExceptRowMaps();
   for (const RowMap& rm : row_maps_) {
@@ -64,6 +74,27 @@ Table Table::CopyExceptRowMaps() const {
   return table;
 }
 
+Table::LazyIterator::LazyIterator(const Table* table,
+                                  RowMap rm,
+                                  const BitVector& cols_used)
+    : table_(table), rm_(std::move(rm)), row_count_(rm_.size()) {
+  selected_.resize(table->row_maps_.size());
+  for (auto it = cols_used.IterateSetBits(); it; it.Next()) {
+    uint32_t row_map_idx = table->columns_[it.index()].row_map_idx_;
+    if (!selected_[row_map_idx])
+      Select(row_map_idx);
+  }
+}
+
+void Table::LazyIterator::Select(uint32_t row_map_idx) {
+  std::unique_ptr<SelectedRowMap> selected(
+      new SelectedRowMap(table_->row_maps_[row_map_idx].SelectRows(rm_)));
+  for (uint32_t i = 0; i < row_; ++i) {
+    selected->it.Next();
+  }
+  selected_[row_map_idx] = std::move(selected);
+}
+
 Table Table::Sort(const std::vector<Order>& od) const {
   if (od.empty())
     return Copy();
@@ -74,8 +105,49 @@ Table Table::Sort(const std::vector<Order>& od) const {
   if (od.size() == 1 && first_col.IsSorted() && !od.front().desc)
     return Copy();
 
-  // Build an index vector with all the indices for the first |size_| rows.
-  std::vector<uint32_t> idx(row_count_);
+  // Return a copy of this table with the RowMaps using the computed ordered
+  // RowMap.
+  Table table = CopyExceptRowMaps();
+  RowMap rm = SortToRowMap(RowMap(0, row_count_), od);
+  for (const RowMap& map : row_maps_) {
+    table.row_maps_.emplace_back(map.SelectRows(rm));
+    PERFETTO_DCHECK(table.row_maps_.back().size() == table.row_count());
+  }
+
+  // Remove the sorted flag from all the columns.
+  for (auto& col : table.columns_) {
+    col.flags_ &= ~Column::Flag::kSorted;
+  }
+
+  // For the first order by, make the column flag itself as sorted but
+  // only if the sort was in ascending order.
+  if (!od.front().desc) {
+    table.columns_[od.front().col_idx].flags_ |= Column::Flag::kSorted;
+  }
+
+  return table;
+}
+
+RowMap Table::SortToRowMap(RowMap rm, const std::vector<Order>& od) const {
+  if (od.empty())
+    return rm;
+
+  // As |rm| does not reorder the table, there's nothing to do if there is a
+  // single constraint to sort by a column which is already sorted.
+  const auto& first_col = GetColumn(od.front().col_idx);
+  if (od.size() == 1 && first_col.IsSorted() && !od.front().desc)
+    return rm;
+
+  // Build an index vector with all the indices in |rm|.
+  std::vector<uint32_t> idx(rm.size());
+  if (rm.IsRange()) {
+    std::iota(idx.begin(), idx.end(), rm.size() == 0 ? 0 : rm.Get(0));
+  } else {
+    uint32_t i = 0;
+    for (auto it = rm.IterateRows(); it; it.Next()) {
+      idx[i++] = it.index();
+    }
+  }
 
   if (od.size() == 1 && first_col.IsSorted()) {
     // We special case a single constraint in descending order as this
@@ -83,7 +155,7 @@ Table Table::Sort(const std::vector<Order>& od) const {
     // more efficient as this column is already sorted so we simply need
     // to reverse the order of this column.
     PERFETTO_DCHECK(od.front().desc);
-    std::iota(idx.rbegin(), idx.rend(), 0);
+    std::reverse(idx.begin(), idx.end());
   } else {
     // As our data is columnar, it's always more efficient to sort one column
     // at a time rather than try and sort lexiographically all at once.
@@ -115,33 +187,11 @@ Table Table::Sort(const std::vector<Order>& od) const {
     // worthwhile. This also needs changes to the constraint modification logic
     // in DbSqliteTable which currently eliminates constraints on sorted
     // columns.
-    std::iota(idx.begin(), idx.end(), 0);
     for (auto it = od.rbegin(); it != od.rend(); ++it) {
       columns_[it->col_idx].StableSort(it->desc, &idx);
     }
   }
-
-  // Return a copy of this table with the RowMaps using the computed ordered
-  // RowMap.
-  Table table = CopyExceptRowMaps();
-  RowMap rm(std::move(idx));
-  for (const RowMap& map : row_maps_) {
-    table.row_maps_.emplace_back(map.SelectRows(rm));
-    PERFETTO_DCHECK(table.row_maps_.back().size() == table.row_count());
-  }
-
-  // Remove the sorted flag from all the columns.
-  for (auto& col : table.columns_) {
-    col.flags_ &= ~Column::Flag::kSorted;
-  }
-
-  // For the first order by, make the column flag itself as sorted but
-  // only if the sort was in ascending order.
-  if (!od.front().desc) {
-    table.columns_[od.front().col_idx].flags_ |= Column::Flag::kSorted;
-  }
-
-  return table;
+  return RowMap(std::move(idx));
 }
 
 }  // namespace trace_processor
@@ -20,6 +20,7 @@
 #include <stdint.h>
 
 #include <limits>
+#include <memory>
 #include <numeric>
 #include <vector>
 
@@ -71,6 +72,69 @@ class Table {
     std::vector<RowMap::Iterator> its_;
   };
 
+  // Iterator over the rows selected from the table by a RowMap (e.g. one
+  // returned by FilterToRowMap or SortToRowMap).
+  //
+  // This is equivalent to Apply(rm).IterateRows() but the RowMaps of the
+  // columns are only computed if they are needed: the ones backing columns in
+  // |cols_used| are computed upfront and any other is computed the first time
+  // one of its columns is read. This means that queries which only read a few
+  // columns of a wide table don't pay for selecting rows from the RowMaps of
+  // all its columns.
+  class LazyIterator {
+   public:
+    LazyIterator(const Table* table, RowMap rm, const BitVector& cols_used);
+
+    LazyIterator(LazyIterator&&) noexcept = default;
+    LazyIterator& operator=(LazyIterator&&) = default;
+
+    // Advances the iterator to the next row.
+    void Next() {
+      ++row_;
+      for (auto& selected : selected_) {
+        if (selected)
+          selected->it.Next();
+      }
+    }
+
+    // Returns whether the row the iterator is pointing at is valid.
+    operator bool() const { return row_ < row_count_; }
+
+    // Returns the value at the current row for column |col_idx|.
+    SqlValue Get(uint32_t col_idx) {
+      const auto& col = table_->columns_[col_idx];
+      if (PERFETTO_UNLIKELY(!selected_[col.row_map_idx_]))
+        Select(col.row_map_idx_);
+      return col.GetAtIdx(selected_[col.row_map_idx_]->it.index());
+    }
+
+   private:
+    // A RowMap of the table with the rows of |rm_| selected from it together
+    // with an iterator over it.
+    struct SelectedRowMap {
+      explicit SelectedRowMap(RowMap r) : rm(std::move(r)), it(&rm) {}
+
+      RowMap rm;
+      RowMap::Iterator it;
+    };
+
+    LazyIterator(const LazyIterator&) = delete;
+    LazyIterator& operator=(const LazyIterator&) = delete;
+
+    // Computes the RowMap at |row_map_idx| in the table and moves its iterator
+    // to the current row.
+    void Select(uint32_t row_map_idx);
+
+    const Table* table_ = nullptr;
+    RowMap rm_;
+    uint32_t row_count_ = 0;
+    uint32_t row_ = 0;
+
+    // Indexed by the index of the RowMap in the table; null if the RowMap has
+    // not been computed yet.
+    std::vector<std::unique_ptr<SelectedRowMap>> selected_;
+  };
+
   // Helper class storing the schema of the table. This allows decisions to be
   // made about operations on the table without materializing the table - this
   // may be expensive for dynamically computed tables.
@@ -84,6 +148,7 @@ class Table {
       bool is_id;
       bool is_sorted;
       bool is_hidden;
+      bool is_indexed;
     };
     std::vector<Column> columns;
   };
@@ -134,6 +199,11 @@ class Table {
   // Sorts the Table using the specified order by constraints.
   Table Sort(const std::vector<Order>& od) const;
 
+  // Sorts the rows in |rm| (which should not reorder this table; see Apply)
+  // using the specified order by constraints. Returns a RowMap which, if
+  // applied to the table, would contain the rows in |rm| in sorted order.
+  RowMap SortToRowMap(RowMap rm, const std::vector<Order>& od) const;
+
   // Extends the table with a new column called |name| with data |sv|.
   template <typename T>
   Table ExtendWithColumn(const char* name,
@@ -195,6 +265,13 @@ class Table {
   // Returns an iterator into the Table.
   Iterator IterateRows() const { return Iterator(this); }
 
+  // Returns an iterator over the rows of the Table selected by |rm|, only
+  // computing the RowMaps needed by the columns in |cols_used| upfront. See
+  // LazyIterator for details.
+  LazyIterator IterateRows(RowMap rm, const BitVector& cols_used) const {
+    return LazyIterator(this, std::move(rm), cols_used);
+  }
+
   // Creates a copy of this table.
   Table Copy() const;
 
@@ -204,6 +281,10 @@ class Table {
  protected:
   Table(StringPool* pool, const Table* parent);
 
+  // Removes all the rows of the table. The storage of the columns is not
+  // touched: it's up to the caller to reset it.
+  void ClearRows();
+
   std::vector<RowMap> row_maps_;
   std::vector<Column> columns_;
   uint32_t row_count_ = 0;
@@ -212,6 +293,7 @@ class Table {
 
  private:
   friend class Column;
+  friend class StorageSnapshot;
 
   Table CopyExceptRowMaps() const;
 };
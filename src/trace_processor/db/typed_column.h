@@ -85,6 +85,7 @@ struct TypedColumn : public Column {
 
   // Sets the data in the column at index |row|.
   void Set(uint32_t row, non_optional_type v) {
+    InvalidateIndex();
     auto serialized = Serializer::Serialize(v);
     mutable_nullable_vector()->Set(row_map().Get(row), serialized);
   }
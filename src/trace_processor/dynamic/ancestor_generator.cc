@@ -183,7 +183,8 @@ Table::Schema AncestorGenerator::CreateSchema() {
   }
   final_schema.columns.push_back(Table::Schema::Column{
       "start_id", SqlValue::Type::kLong, /* is_id = */ false,
-      /* is_sorted = */ false, /* is_hidden = */ true});
+      /* is_sorted = */ false, /* is_hidden = */ true,
+      /* is_indexed = */ false});
   return final_schema;
 }
 
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/args_generator.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+using ColumnIndex = tables::ArgTable::ColumnIndex;
+
+// Expansions of fewer arg sets are cheap enough to be recomputed every time:
+// caching them would only evict the expensive ones (e.g. when joining on
+// arg_set_id, which filters the table once per arg set).
+constexpr uint32_t kMinArgSetsToCache = 64;
+
+// Estimates the memory owned by |table|: its columns store about as much per
+// row as an ArgTable::Row.
+uint64_t EstimateBytes(const tables::ArgTable& table) {
+  return sizeof(tables::ArgTable) +
+         uint64_t{table.row_count()} * sizeof(tables::ArgTable::Row);
+}
+
+// A copy of a cached expansion which keeps the expansion (which owns the data
+// of the columns) alive even if it is evicted from the cache.
+class SharedArgTable : public Table {
+ public:
+  explicit SharedArgTable(std::shared_ptr<tables::ArgTable> table)
+      : Table(table->Copy()), table_(std::move(table)) {}
+
+ private:
+  std::shared_ptr<tables::ArgTable> table_;
+};
+
+bool IsColumn(const Constraint& c, ColumnIndex col) {
+  return c.col_idx == static_cast<uint32_t>(col);
+}
+
+// Narrows the half-open range [*begin, *end) of uint32 values to the values
+// which can satisfy |op| |value|. Constraints which can't be represented as a
+// range (or with non-integer values) are ignored: the rows are filtered again
+// by DbSqliteTable after being computed.
+void NarrowRange(FilterOp op,
+                 const SqlValue& value,
+                 int64_t* begin,
+                 int64_t* end) {
+  if (value.type != SqlValue::Type::kLong)
+    return;
+  int64_t v = value.AsLong();
+  // The first value after |v|, avoiding overflows.
+  int64_t next = v == std::numeric_limits<int64_t>::max() ? v : v + 1;
+  switch (op) {
+    case FilterOp::kEq:
+      *begin = std::max(*begin, v);
+      *end = std::min(*end, next);
+      break;
+    case FilterOp::kGe:
+      *begin = std::max(*begin, v);
+      break;
+    case FilterOp::kGt:
+      *begin = std::max(*begin, next);
+      break;
+    case FilterOp::kLe:
+      *end = std::min(*end, next);
+      break;
+    case FilterOp::kLt:
+      *end = std::min(*end, v);
+      break;
+    case FilterOp::kNe:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+    case FilterOp::kLike:
+      break;
+  }
+}
+
+// Converts a range of arg ids into the range of the ids of the arg sets
+// containing them.
+void ArgIdRangeToArgSetIdRange(const ArgSetStorage& arg_sets,
+                               int64_t arg_begin,
+                               int64_t arg_end,
+                               int64_t* begin,
+                               int64_t* end) {
+  if (arg_begin >= arg_end) {
+    *end = *begin;
+    return;
+  }
+  int64_t max_arg_id = static_cast<int64_t>(arg_sets.arg_count());
+  if (arg_begin > 0) {
+    uint32_t first = static_cast<uint32_t>(std::min(arg_begin, max_arg_id));
+    *begin = std::max(*begin, int64_t{arg_sets.ArgSetIdForArgId(first)});
+  }
+  if (arg_end <= max_arg_id) {
+    uint32_t last = static_cast<uint32_t>(arg_end - 1);
+    *end = std::min(*end, int64_t{arg_sets.ArgSetIdForArgId(last)} + 1);
+  }
+}
+
+void SetValue(const Variadic& value, tables::ArgTable::Row* row) {
+  switch (value.type) {
+    case Variadic::Type::kInt:
+      row->int_value = value.int_value;
+      break;
+    case Variadic::Type::kUint:
+      row->int_value = static_cast<int64_t>(value.uint_value);
+      break;
+    case Variadic::Type::kString:
+      row->string_value = value.string_value;
+      break;
+    case Variadic::Type::kReal:
+      row->real_value = value.real_value;
+      break;
+    case Variadic::Type::kPointer:
+      row->int_value = static_cast<int64_t>(value.pointer_value);
+      break;
+    case Variadic::Type::kBool:
+      row->int_value = value.bool_value;
+      break;
+    case Variadic::Type::kJson:
+      row->string_value = value.json_value;
+      break;
+    case Variadic::Type::kNull:
+      break;
+  }
+}
+
+}  // namespace
+
+constexpr uint64_t ArgsGenerator::kDefaultMaxCachedBytes;
+
+ArgsGenerator::ArgsGenerator(TraceStorage* storage, uint64_t max_cached_bytes)
+    : storage_(storage), max_cached_bytes_(max_cached_bytes) {}
+ArgsGenerator::~ArgsGenerator() = default;
+
+Table::Schema ArgsGenerator::CreateSchema() {
+  return tables::ArgTable::Schema();
+}
+
+std::string ArgsGenerator::TableName() {
+  return "internal_args";
+}
+
+uint32_t ArgsGenerator::EstimateRowCount() {
+  return storage_->arg_sets().arg_count();
+}
+
+base::Status ArgsGenerator::ValidateConstraints(const QueryConstraints&) {
+  return base::OkStatus();
+}
+
+base::Status ArgsGenerator::ComputeTable(const std::vector<Constraint>& cs,
+                                         const std::vector<Order>&,
+                                         const BitVector&,
+                                         std::unique_ptr<Table>& table_return) {
+  const ArgSetStorage& arg_sets = storage_->arg_sets();
+
+  int64_t begin = 0;
+  int64_t end = arg_sets.size();
+  int64_t arg_begin = 0;
+  int64_t arg_end = arg_sets.arg_count();
+  base::Optional<StringId> key;
+  bool empty = false;
+  for (const Constraint& c : cs) {
+    if (IsColumn(c, ColumnIndex::arg_set_id)) {
+      NarrowRange(c.op, c.value, &begin, &end);
+    } else if (IsColumn(c, ColumnIndex::arg_id)) {
+      NarrowRange(c.op, c.value, &arg_begin, &arg_end);
+    } else if (IsColumn(c, ColumnIndex::key) && c.op == FilterOp::kEq &&
+               c.value.type == SqlValue::Type::kString) {
+      key = storage_->string_pool().GetId(c.value.AsString());
+      // A key which was never interned can't match any arg.
+      empty |= !key.has_value();
+    }
+  }
+  ArgIdRangeToArgSetIdRange(arg_sets, arg_begin, arg_end, &begin, &end);
+
+  if (empty || begin >= end) {
+    table_return = Expand(0, 0, key);
+    return base::OkStatus();
+  }
+
+  uint32_t first = static_cast<uint32_t>(begin);
+  uint32_t last = static_cast<uint32_t>(end);
+  if (last - first < kMinArgSetsToCache) {
+    table_return = Expand(first, last, key);
+    return base::OkStatus();
+  }
+
+  for (auto it = expansions_.begin(); it != expansions_.end();) {
+    if (it->arg_count != arg_sets.arg_count()) {
+      cached_bytes_ -= it->bytes;
+      it = expansions_.erase(it);
+      continue;
+    }
+    if (it->begin == first && it->end == last && it->key == key) {
+      expansions_.splice(expansions_.begin(), expansions_, it);
+      table_return.reset(new SharedArgTable(it->table));
+      return base::OkStatus();
+    }
+    ++it;
+  }
+
+  std::shared_ptr<tables::ArgTable> table = Expand(first, last, key);
+  uint64_t bytes = EstimateBytes(*table);
+  if (bytes > max_cached_bytes_) {
+    table_return.reset(new SharedArgTable(std::move(table)));
+    return base::OkStatus();
+  }
+  expansions_.push_front(
+      Expansion{first, last, key, arg_sets.arg_count(), table, bytes});
+  cached_bytes_ += bytes;
+  while (cached_bytes_ > max_cached_bytes_) {
+    cached_bytes_ -= expansions_.back().bytes;
+    expansions_.pop_back();
+  }
+  table_return.reset(new SharedArgTable(std::move(table)));
+  return base::OkStatus();
+}
+
+std::unique_ptr<tables::ArgTable> ArgsGenerator::Expand(
+    uint32_t begin,
+    uint32_t end,
+    base::Optional<StringId> key) {
+  const ArgSetStorage& arg_sets = storage_->arg_sets();
+  std::unique_ptr<tables::ArgTable> table(
+      new tables::ArgTable(storage_->mutable_string_pool(), nullptr));
+  for (uint32_t arg_set_id = begin; arg_set_id < end; ++arg_set_id) {
+    ArgSetStorage::ArgSet arg_set = arg_sets.Get(arg_set_id);
+    for (uint32_t i = 0; i < arg_set.size(); ++i) {
+      if (key && arg_set.key(i) != *key)
+        continue;
+      tables::ArgTable::Row row;
+      row.arg_set_id = arg_set_id;
+      row.arg_id = arg_set.arg_id(i);
+      row.flat_key = arg_set.flat_key(i);
+      row.key = arg_set.key(i);
+      SetValue(arg_set.value(i), &row);
+      row.value_type = storage_->GetIdForVariadicType(arg_set.type(i));
+      table->Insert(row);
+    }
+  }
+  return table;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
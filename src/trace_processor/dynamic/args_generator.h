@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DYNAMIC_ARGS_GENERATOR_H_
+#define SRC_TRACE_PROCESSOR_DYNAMIC_ARGS_GENERATOR_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Implements the internal_args table (on top of which the args view is built)
+// by expanding the arg sets in ArgSetStorage into rows.
+//
+// Only the arg sets which can match the constraints on arg_set_id, arg_id and
+// key are expanded: in particular, looking up the args of a single arg set
+// (e.g. when joining with another table) only creates the rows of that set.
+//
+// Expanding many arg sets is not cheap while SQLite can filter the table many
+// times in a query (e.g. in a correlated subquery): the tables most recently
+// expanded from more than a handful of arg sets are cached and shared by the
+// cursors filtering them until the storage changes. Up to |max_cached_bytes|
+// worth of expansions are kept, so that the cache stays small compared to the
+// arg sets it is expanded from; larger expansions are never cached.
+class ArgsGenerator : public DbSqliteTable::DynamicTableGenerator {
+ public:
+  static constexpr uint64_t kDefaultMaxCachedBytes = 16ull * 1024 * 1024;
+
+  explicit ArgsGenerator(TraceStorage*,
+                         uint64_t max_cached_bytes = kDefaultMaxCachedBytes);
+  ~ArgsGenerator() override;
+
+  Table::Schema CreateSchema() override;
+  std::string TableName() override;
+  uint32_t EstimateRowCount() override;
+  base::Status ValidateConstraints(const QueryConstraints&) override;
+  base::Status ComputeTable(const std::vector<Constraint>& cs,
+                            const std::vector<Order>& ob,
+                            const BitVector& cols_used,
+                            std::unique_ptr<Table>& table_return) override;
+
+  // Returns the (estimated) number of bytes used by the cached expansions.
+  uint64_t cached_bytes() const { return cached_bytes_; }
+
+ private:
+  // The args of the arg sets with ids in [begin, end), restricted to the ones
+  // with key |key| if set.
+  struct Expansion {
+    uint32_t begin;
+    uint32_t end;
+    base::Optional<StringId> key;
+
+    // The number of args in the storage when |table| was computed. Arg sets
+    // are only appended so a mismatch means |table| is stale.
+    uint32_t arg_count;
+    std::shared_ptr<tables::ArgTable> table;
+    uint64_t bytes;
+  };
+
+  std::unique_ptr<tables::ArgTable> Expand(uint32_t begin,
+                                           uint32_t end,
+                                           base::Optional<StringId> key);
+
+  TraceStorage* storage_ = nullptr;
+  uint64_t max_cached_bytes_ = 0;
+
+  // Cached expansions, the most recently used first.
+  std::list<Expansion> expansions_;
+  uint64_t cached_bytes_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DYNAMIC_ARGS_GENERATOR_H_
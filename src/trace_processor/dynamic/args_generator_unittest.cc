@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/args_generator.h"
+
+#include "src/trace_processor/containers/bit_vector.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ColumnIndex = tables::ArgTable::ColumnIndex;
+
+class ArgsGeneratorTest : public ::testing::Test {
+ protected:
+  uint32_t AddArgSet(std::vector<std::pair<const char*, int64_t>> args) {
+    std::vector<ArgSetStorage::Arg> set_args;
+    for (const auto& key_and_value : args) {
+      StringId key = storage_.InternString(key_and_value.first);
+      set_args.push_back(ArgSetStorage::Arg{
+          key, key, Variadic::Integer(key_and_value.second)});
+    }
+    return storage_.mutable_arg_sets()->AddArgSet(
+        set_args.data(), static_cast<uint32_t>(set_args.size()));
+  }
+
+  std::unique_ptr<Table> Compute(const std::vector<Constraint>& cs) {
+    std::unique_ptr<Table> table;
+    base::Status status = generator_.ComputeTable(cs, {}, BitVector(), table);
+    EXPECT_TRUE(status.ok());
+    return table;
+  }
+
+  static int64_t IntValue(const Table& table, uint32_t row) {
+    return table.GetColumn(static_cast<uint32_t>(ColumnIndex::int_value))
+        .Get(row)
+        .AsLong();
+  }
+
+  TraceStorage storage_;
+  ArgsGenerator generator_{&storage_};
+};
+
+TEST_F(ArgsGeneratorTest, SingleArgSet) {
+  AddArgSet({{"a", 1}, {"b", 2}});
+  uint32_t id = AddArgSet({{"a", 3}, {"b", 4}});
+
+  auto table = Compute({Constraint{
+      static_cast<uint32_t>(ColumnIndex::arg_set_id), FilterOp::kEq,
+      SqlValue::Long(id)}});
+  ASSERT_EQ(table->row_count(), 2u);
+  ASSERT_EQ(IntValue(*table, 0), 3);
+  ASSERT_EQ(IntValue(*table, 1), 4);
+}
+
+TEST_F(ArgsGeneratorTest, CachedExpansion) {
+  for (int64_t i = 0; i < 100; ++i)
+    AddArgSet({{"a", i}, {"b", -i}});
+
+  auto first = Compute({});
+  auto second = Compute({});
+  ASSERT_EQ(first->row_count(), 200u);
+  ASSERT_EQ(second->row_count(), 200u);
+  ASSERT_EQ(IntValue(*second, 198), 99);
+  uint64_t cached_bytes = generator_.cached_bytes();
+  ASSERT_GT(cached_bytes, 0u);
+
+  auto only_b = Compute({Constraint{static_cast<uint32_t>(ColumnIndex::key),
+                                    FilterOp::kEq, SqlValue::String("b")}});
+  ASSERT_EQ(only_b->row_count(), 100u);
+  ASSERT_EQ(IntValue(*only_b, 99), -99);
+  ASSERT_GT(generator_.cached_bytes(), cached_bytes);
+
+  // The cached expansions are stale once arg sets are added.
+  AddArgSet({{"c", 1000}});
+  auto third = Compute({});
+  ASSERT_EQ(third->row_count(), 201u);
+  ASSERT_EQ(IntValue(*third, 200), 1000);
+
+  // Tables computed before remain valid.
+  ASSERT_EQ(first->row_count(), 200u);
+  ASSERT_EQ(IntValue(*first, 199), -99);
+}
+
+TEST_F(ArgsGeneratorTest, CacheBudget) {
+  for (int64_t i = 0; i < 100; ++i)
+    AddArgSet({{"a", i}, {"b", -i}});
+  auto key = [](const char* k) {
+    return Constraint{static_cast<uint32_t>(ColumnIndex::key), FilterOp::kEq,
+                      SqlValue::String(k)};
+  };
+
+  // Only the most recent expansion fits in the budget.
+  ArgsGenerator generator(&storage_, sizeof(tables::ArgTable) +
+                                         150 * sizeof(tables::ArgTable::Row));
+  std::unique_ptr<Table> table;
+  ASSERT_TRUE(generator.ComputeTable({key("a")}, {}, BitVector(), table).ok());
+  uint64_t cached_bytes = generator.cached_bytes();
+  ASSERT_GT(cached_bytes, 0u);
+  ASSERT_TRUE(generator.ComputeTable({key("b")}, {}, BitVector(), table).ok());
+  ASSERT_EQ(generator.cached_bytes(), cached_bytes);
+
+  // Expansions larger than the budget are not cached at all.
+  ASSERT_TRUE(generator.ComputeTable({}, {}, BitVector(), table).ok());
+  ASSERT_EQ(table->row_count(), 200u);
+  ASSERT_EQ(generator.cached_bytes(), cached_bytes);
+}
+
+TEST_F(ArgsGeneratorTest, ExtractArgDuplicateKey) {
+  uint32_t id = AddArgSet({{"a", 1}, {"b", 2}, {"a", 3}});
+
+  base::Optional<Variadic> value;
+  ASSERT_TRUE(storage_.ExtractArg(id, "b", &value).ok());
+  ASSERT_EQ(value, Variadic::Integer(2));
+  ASSERT_FALSE(storage_.ExtractArg(id, "a", &value).ok());
+  ASSERT_FALSE(value.has_value());
+  ASSERT_TRUE(storage_.ExtractArg(id, "missing", &value).ok());
+  ASSERT_FALSE(value.has_value());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -20,6 +20,7 @@
 #include <queue>
 #include <set>
 
+#include "src/trace_processor/analysis/slice_nesting_index.h"
 #include "src/trace_processor/dynamic/ancestor_generator.h"
 #include "src/trace_processor/dynamic/descendant_generator.h"
 #include "src/trace_processor/importers/common/flow_tracker.h"
@@ -128,7 +129,8 @@ class BFS {
     if (visit_relatives & VISIT_DESCENDANTS) {
       base::Optional<RowMap> descendants =
           DescendantGenerator::GetDescendantSlices(
-              context_->storage->slice_table(), slice_id);
+              context_->storage->slice_table(),
+              SliceNestingIndex::GetOrCreate(context_), slice_id);
       GoToRelativesImpl(descendants->IterateRows());
     }
     return *this;
@@ -256,7 +258,8 @@ Table::Schema ConnectedFlowGenerator::CreateSchema() {
   auto schema = tables::FlowTable::Schema();
   schema.columns.push_back(Table::Schema::Column{
       "start_id", SqlValue::Type::kLong, /* is_id = */ false,
-      /* is_sorted = */ false, /* is_hidden = */ true});
+      /* is_sorted = */ false, /* is_hidden = */ true,
+      /* is_indexed = */ false});
   return schema;
 }
 
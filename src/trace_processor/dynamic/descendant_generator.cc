@@ -19,6 +19,7 @@
 #include <memory>
 #include <set>
 
+#include "src/trace_processor/analysis/slice_nesting_index.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 #include "src/trace_processor/util/status_macros.h"
 
@@ -42,6 +43,7 @@ Table ExtendTableWithStartId(const T& table, int64_t constraint_value) {
 }
 
 base::Status BuildDescendantsRowMap(const tables::SliceTable& slices,
+                                    const SliceNestingIndex& index,
                                     SliceId starting_id,
                                     RowMap& rowmap_return) {
   auto start_row = slices.id().IndexOf(starting_id);
@@ -51,24 +53,21 @@ base::Status BuildDescendantsRowMap(const tables::SliceTable& slices,
                            static_cast<uint32_t>(starting_id.value));
   }
 
-  // All nested descendents must be on the same track, with a ts between
-  // |start_id.ts| and |start_id.ts| + |start_id.dur|, and who's depth is larger
-  // then |start_row|'s. So we just use Filter to select all relevant slices.
-  rowmap_return = slices.FilterToRowMap(
-      {slices.ts().ge(slices.ts()[*start_row]),
-       slices.ts().le(slices.ts()[*start_row] + slices.dur()[*start_row]),
-       slices.track_id().eq(slices.track_id()[*start_row].value),
-       slices.depth().gt(slices.depth()[*start_row])});
+  // The descendants are a contiguous range of the pre-order of the slices so
+  // there is no need to look at any other slice.
+  rowmap_return = RowMap(index.GetDescendantRows(*start_row));
   return base::OkStatus();
 }
 
 base::Status BuildDescendantsTable(int64_t constraint_value,
                                    const tables::SliceTable& slices,
+                                   const SliceNestingIndex& index,
                                    SliceId starting_id,
                                    std::unique_ptr<Table>& table_return) {
   // Build up all the children row ids.
   RowMap descendants;
-  RETURN_IF_ERROR(BuildDescendantsRowMap(slices, starting_id, descendants));
+  RETURN_IF_ERROR(
+      BuildDescendantsRowMap(slices, index, starting_id, descendants));
 
   table_return.reset(new Table(ExtendTableWithStartId(
       slices.Apply(std::move(descendants)), constraint_value)));
@@ -99,6 +98,7 @@ base::Status DescendantGenerator::ComputeTable(
     const BitVector&,
     std::unique_ptr<Table>& table_return) {
   const auto& slices = context_->storage->slice_table();
+  const auto& index = SliceNestingIndex::GetOrCreate(context_);
 
   uint32_t column = GetConstraintColumnIndex(context_);
   auto constraint_it =
@@ -115,7 +115,7 @@ base::Status DescendantGenerator::ComputeTable(
   switch (type_) {
     case Descendant::kSlice: {
       RETURN_IF_ERROR(BuildDescendantsTable(
-          start_id, slices, SliceId(static_cast<uint32_t>(start_id)),
+          start_id, slices, index, SliceId(static_cast<uint32_t>(start_id)),
           table_return));
       return base::OkStatus();
     }
@@ -127,7 +127,7 @@ base::Status DescendantGenerator::ComputeTable(
       for (auto id_it = slice_ids.IterateRows(); id_it; id_it.Next()) {
         auto slice_id = slices.id()[id_it.index()];
 
-        auto descendants = GetDescendantSlices(slices, slice_id);
+        auto descendants = GetDescendantSlices(slices, index, slice_id);
         for (auto row_it = descendants->IterateRows(); row_it; row_it.Next()) {
           result.Insert(row_it.index());
         }
@@ -145,7 +145,8 @@ Table::Schema DescendantGenerator::CreateSchema() {
   auto schema = tables::SliceTable::Schema();
   schema.columns.push_back(Table::Schema::Column{
       "start_id", SqlValue::Type::kLong, /* is_id = */ false,
-      /* is_sorted = */ false, /* is_hidden = */ true});
+      /* is_sorted = */ false, /* is_hidden = */ true,
+      /* is_indexed = */ false});
   return schema;
 }
 
@@ -166,9 +167,10 @@ uint32_t DescendantGenerator::EstimateRowCount() {
 // static
 base::Optional<RowMap> DescendantGenerator::GetDescendantSlices(
     const tables::SliceTable& slices,
+    const SliceNestingIndex& index,
     SliceId slice_id) {
   RowMap ret;
-  auto status = BuildDescendantsRowMap(slices, slice_id, ret);
+  auto status = BuildDescendantsRowMap(slices, index, slice_id, ret);
   if (!status.ok())
     return base::nullopt;
   return std::move(ret);  // -Wreturn-std-move-in-c++11
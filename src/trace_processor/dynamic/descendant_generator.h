@@ -25,6 +25,7 @@
 namespace perfetto {
 namespace trace_processor {
 
+class SliceNestingIndex;
 class TraceProcessorContext;
 
 // Implements the following dynamic tables:
@@ -50,8 +51,11 @@ class DescendantGenerator : public DbSqliteTable::DynamicTableGenerator {
   // Returns a RowMap of slice IDs which are descendants of |slice_id|. Returns
   // NULL if an invalid |slice_id| is given. This is used by
   // ConnectedFlowGenerator to traverse flow indirectly connected flow events.
+  // |index| should be the nesting index of |slices| (see
+  // SliceNestingIndex::GetOrCreate).
   static base::Optional<RowMap> GetDescendantSlices(
       const tables::SliceTable& slices,
+      const SliceNestingIndex& index,
       SliceId slice_id);
 
  private:
@@ -97,10 +97,12 @@ Table::Schema ExperimentalAnnotatedStackGenerator::CreateSchema() {
   auto schema = tables::StackProfileCallsiteTable::Schema();
   schema.columns.push_back(Table::Schema::Column{
       "annotation", SqlValue::Type::kString, /* is_id = */ false,
-      /* is_sorted = */ false, /* is_hidden = */ false});
+      /* is_sorted = */ false, /* is_hidden = */ false,
+      /* is_indexed = */ false});
   schema.columns.push_back(Table::Schema::Column{
       "start_id", SqlValue::Type::kLong, /* is_id = */ false,
-      /* is_sorted = */ false, /* is_hidden = */ true});
+      /* is_sorted = */ false, /* is_hidden = */ true,
+      /* is_indexed = */ false});
   return schema;
 }
 
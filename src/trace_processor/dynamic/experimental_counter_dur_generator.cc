@@ -28,10 +28,12 @@ Table::Schema ExperimentalCounterDurGenerator::CreateSchema() {
   Table::Schema schema = tables::CounterTable::Schema();
   schema.columns.emplace_back(
       Table::Schema::Column{"dur", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+                            false /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
   schema.columns.emplace_back(
       Table::Schema::Column{"delta", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+                            false /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
   return schema;
 }
 
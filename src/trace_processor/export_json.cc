@@ -92,14 +92,21 @@ const char* GetNonNullString(const TraceStorage* storage,
              : storage->GetString(*id).c_str();
 }
 
+// The JSON of the events is accumulated into a buffer of this size before
+// being passed to the OutputWriter, so the exporter's memory use doesn't grow
+// with the size of the trace.
+constexpr size_t kWriteBufferSize = 256 * 1024;
+
 class JsonExporter {
  public:
   JsonExporter(const TraceStorage* storage,
                OutputWriter* output,
+               const EventFilter& event_filter,
                ArgumentFilterPredicate argument_filter,
                MetadataFilterPredicate metadata_filter,
                LabelFilterPredicate label_filter)
       : storage_(storage),
+        event_filter_(event_filter),
         args_builder_(storage_),
         writer_(output, argument_filter, metadata_filter, label_filter) {}
 
@@ -108,6 +115,10 @@ class JsonExporter {
     if (!status.ok())
       return status;
 
+    status = ComputeUpidFilter();
+    if (!status.ok())
+      return status;
+
     status = ExportThreadNames();
     if (!status.ok())
       return status;
@@ -166,6 +177,7 @@ class JsonExporter {
       Json::StreamWriterBuilder b;
       b.settings_["indentation"] = "";
       writer_.reset(b.newStreamWriter());
+      buffer_.reserve(kWriteBufferSize);
       WriteHeader();
     }
 
@@ -182,21 +194,21 @@ class JsonExporter {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_begin_events_.push_back(event);
+      async_begin_events_.push_back(SerializeAsyncEvent(event));
     }
 
     void AddAsyncInstantEvent(const Json::Value& event) {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_instant_events_.push_back(event);
+      async_instant_events_.push_back(SerializeAsyncEvent(event));
     }
 
     void AddAsyncEndEvent(const Json::Value& event) {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_end_events_.push_back(event);
+      async_end_events_.push_back(SerializeAsyncEvent(event));
     }
 
     void SortAndEmitAsyncEvents() {
@@ -212,8 +224,8 @@ class JsonExporter {
       // the same timestamp. To accomplish this, we perform a stable sort in
       // descending order and later iterate via reverse iterators.
       struct {
-        bool operator()(const Json::Value& a, const Json::Value& b) const {
-          return a["ts"].asInt64() > b["ts"].asInt64();
+        bool operator()(const AsyncEvent& a, const AsyncEvent& b) const {
+          return a.ts > b.ts;
         }
       } CompareEvents;
       std::stable_sort(async_end_events_.begin(), async_end_events_.end(),
@@ -232,25 +244,24 @@ class JsonExporter {
       auto has_begin_event = begin_event_it != async_begin_events_.end();
 
       auto emit_next_instant = [&instant_event_it, &has_instant_event, this]() {
-        DoWriteEvent(*instant_event_it);
+        AppendEvent(instant_event_it->json);
         instant_event_it++;
         has_instant_event = instant_event_it != async_instant_events_.end();
       };
       auto emit_next_end = [&end_event_it, &has_end_event, this]() {
-        DoWriteEvent(*end_event_it);
+        AppendEvent(end_event_it->json);
         end_event_it++;
         has_end_event = end_event_it != async_end_events_.rend();
       };
       auto emit_next_begin = [&begin_event_it, &has_begin_event, this]() {
-        DoWriteEvent(*begin_event_it);
+        AppendEvent(begin_event_it->json);
         begin_event_it++;
         has_begin_event = begin_event_it != async_begin_events_.end();
       };
 
       auto emit_next_instant_or_end = [&instant_event_it, &end_event_it,
                                        &emit_next_instant, &emit_next_end]() {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*end_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <= end_event_it->ts) {
           emit_next_instant();
         } else {
           emit_next_end();
@@ -259,8 +270,7 @@ class JsonExporter {
       auto emit_next_instant_or_begin = [&instant_event_it, &begin_event_it,
                                          &emit_next_instant,
                                          &emit_next_begin]() {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*begin_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <= begin_event_it->ts) {
           emit_next_instant();
         } else {
           emit_next_begin();
@@ -268,8 +278,7 @@ class JsonExporter {
       };
       auto emit_next_end_or_begin = [&end_event_it, &begin_event_it,
                                      &emit_next_end, &emit_next_begin]() {
-        if ((*end_event_it)["ts"].asInt64() <=
-            (*begin_event_it)["ts"].asInt64()) {
+        if (end_event_it->ts <= begin_event_it->ts) {
           emit_next_end();
         } else {
           emit_next_begin();
@@ -278,8 +287,7 @@ class JsonExporter {
 
       // While we still have events in all iterators, consider each.
       while (has_instant_event && has_end_event && has_begin_event) {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*end_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <= end_event_it->ts) {
           emit_next_instant_or_begin();
         } else {
           emit_next_end_or_begin();
@@ -325,10 +333,6 @@ class JsonExporter {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      std::ostringstream ss;
-      if (!first_event_)
-        ss << ",\n";
-
       Json::Value value;
       value["ph"] = "M";
       value["cat"] = "__metadata";
@@ -341,9 +345,7 @@ class JsonExporter {
       args[metadata_arg_name] = metadata_arg_value;
       value["args"] = args;
 
-      writer_->write(value, &ss);
-      output_->AppendString(ss.str());
-      first_event_ = false;
+      AppendEvent(Serialize(value));
     }
 
     void MergeMetadata(const Json::Value& value) {
@@ -405,7 +407,7 @@ class JsonExporter {
    private:
     void WriteHeader() {
       if (!label_filter_)
-        output_->AppendString("{\"traceEvents\":[\n");
+        Append("{\"traceEvents\":[\n");
     }
 
     void WriteFooter() {
@@ -440,32 +442,43 @@ class JsonExporter {
         }
       }
 
-      std::ostringstream ss;
       if (!label_filter_)
-        ss << "]";
+        Append("]");
 
       if ((!label_filter_ || label_filter_("systemTraceEvents")) &&
           !system_trace_data_.empty()) {
-        ss << ",\"systemTraceEvents\":\n";
-        writer_->write(Json::Value(system_trace_data_), &ss);
+        Append(",\"systemTraceEvents\":\n");
+        Append(Serialize(Json::Value(system_trace_data_)));
       }
 
       if ((!label_filter_ || label_filter_("metadata")) && !metadata_.empty()) {
-        ss << ",\"metadata\":\n";
-        writer_->write(metadata_, &ss);
+        Append(",\"metadata\":\n");
+        Append(Serialize(metadata_));
       }
 
       if (!label_filter_)
-        ss << "}";
+        Append("}");
 
-      output_->AppendString(ss.str());
+      Flush();
+    }
+
+    // Async events are kept until the footer is written, so only the JSON
+    // (with the argument filter already applied) and timestamp needed to
+    // order them are retained.
+    struct AsyncEvent {
+      int64_t ts;
+      std::string json;
+    };
+
+    AsyncEvent SerializeAsyncEvent(const Json::Value& event) {
+      return AsyncEvent{event["ts"].asInt64(), SerializeFilteredEvent(event)};
     }
 
     void DoWriteEvent(const Json::Value& event) {
-      std::ostringstream ss;
-      if (!first_event_)
-        ss << ",\n";
+      AppendEvent(SerializeFilteredEvent(event));
+    }
 
+    std::string SerializeFilteredEvent(const Json::Value& event) {
       ArgumentNameFilterPredicate argument_name_filter;
       bool strip_args =
           argument_filter_ &&
@@ -482,13 +495,42 @@ class JsonExporter {
               args[member] = kStrippedArgument;
           }
         }
-        writer_->write(event_copy, &ss);
-      } else {
-        writer_->write(event, &ss);
+        return Serialize(event_copy);
       }
+      return Serialize(event);
+    }
+
+    std::string Serialize(const Json::Value& value) {
+      stream_.str(std::string());
+      writer_->write(value, &stream_);
+      return stream_.str();
+    }
+
+    void AppendEvent(const std::string& json) {
+      if (!first_event_)
+        Append(",\n");
+      Append(json);
       first_event_ = false;
+    }
+
+    void Append(const char* str) { Append(std::string(str)); }
 
-      output_->AppendString(ss.str());
+    void Append(const std::string& str) {
+      if (buffer_.size() + str.size() > kWriteBufferSize)
+        Flush();
+      // Events larger than the buffer bypass it.
+      if (str.size() > kWriteBufferSize) {
+        output_->AppendString(str);
+        return;
+      }
+      buffer_.append(str);
+    }
+
+    void Flush() {
+      if (buffer_.empty())
+        return;
+      output_->AppendString(buffer_);
+      buffer_.clear();
     }
 
     OutputWriter* output_;
@@ -497,46 +539,37 @@ class JsonExporter {
     LabelFilterPredicate label_filter_;
 
     std::unique_ptr<Json::StreamWriter> writer_;
+    std::ostringstream stream_;
+    std::string buffer_;
     bool first_event_;
     Json::Value metadata_;
     std::string system_trace_data_;
     std::string user_trace_data_;
-    std::vector<Json::Value> async_begin_events_;
-    std::vector<Json::Value> async_instant_events_;
-    std::vector<Json::Value> async_end_events_;
+    std::vector<AsyncEvent> async_begin_events_;
+    std::vector<AsyncEvent> async_instant_events_;
+    std::vector<AsyncEvent> async_end_events_;
   };
 
+  // Converts arg sets to JSON when they are needed. Converting all the arg sets
+  // of the trace upfront would need memory proportional to the size of the
+  // trace.
   class ArgsBuilder {
    public:
     explicit ArgsBuilder(const TraceStorage* storage)
         : storage_(storage),
-          empty_value_(Json::objectValue),
           nan_value_(Json::StaticString("NaN")),
           inf_value_(Json::StaticString("Infinity")),
-          neg_inf_value_(Json::StaticString("-Infinity")) {
-      const auto& arg_table = storage_->arg_table();
-      uint32_t count = arg_table.row_count();
-      if (count == 0) {
-        args_sets_.resize(1, empty_value_);
-        return;
-      }
-      args_sets_.resize(arg_table.arg_set_id()[count - 1] + 1, empty_value_);
-
-      for (uint32_t i = 0; i < count; ++i) {
-        ArgSetId set_id = arg_table.arg_set_id()[i];
-        const char* key = arg_table.key().GetString(i).c_str();
-        Variadic value = storage_->GetArgValue(i);
-        AppendArg(set_id, key, VariadicToJson(value));
+          neg_inf_value_(Json::StaticString("-Infinity")) {}
+
+    Json::Value GetArgs(ArgSetId set_id) {
+      Json::Value args(Json::objectValue);
+      ArgSetStorage::ArgSet arg_set = storage_->arg_sets().Get(set_id);
+      for (uint32_t i = 0; i < arg_set.size(); ++i) {
+        const char* key = storage_->GetString(arg_set.key(i)).c_str();
+        AppendArg(&args, key, VariadicToJson(arg_set.value(i)));
       }
-      PostprocessArgs();
-    }
-
-    const Json::Value& GetArgs(ArgSetId set_id) const {
-      // If |set_id| was empty and added to the storage last, it may not be in
-      // args_sets_.
-      if (set_id > args_sets_.size())
-        return empty_value_;
-      return args_sets_[set_id];
+      PostprocessArgs(&args);
+      return args;
     }
 
    private:
@@ -578,15 +611,15 @@ class JsonExporter {
       PERFETTO_FATAL("Not reached");  // For gcc.
     }
 
-    void AppendArg(ArgSetId set_id,
+    void AppendArg(Json::Value* args,
                    const std::string& key,
                    const Json::Value& value) {
-      Json::Value* target = &args_sets_[set_id];
+      Json::Value* target = args;
       for (base::StringSplitter parts(key, '.'); parts.Next();) {
         if (PERFETTO_UNLIKELY(!target->isNull() && !target->isObject())) {
           PERFETTO_DLOG("Malformed arguments. Can't append %s to %s.",
                         key.c_str(),
-                        args_sets_[set_id].toStyledString().c_str());
+                        args->toStyledString().c_str());
           return;
         }
         std::string key_part = parts.cur_token();
@@ -605,7 +638,7 @@ class JsonExporter {
             if (PERFETTO_UNLIKELY(!target->isNull() && !target->isArray())) {
               PERFETTO_DLOG("Malformed arguments. Can't append %s to %s.",
                             key.c_str(),
-                            args_sets_[set_id].toStyledString().c_str());
+                            args->toStyledString().c_str());
               return;
             }
             base::Optional<uint32_t> index = base::StringToUInt32(s);
@@ -622,46 +655,43 @@ class JsonExporter {
       *target = value;
     }
 
-    void PostprocessArgs() {
-      for (Json::Value& args : args_sets_) {
-        // Move all fields from "debug" key to upper level.
-        if (args.isMember("debug")) {
-          Json::Value debug = args["debug"];
-          args.removeMember("debug");
-          for (const auto& member : debug.getMemberNames()) {
-            args[member] = debug[member];
-          }
+    void PostprocessArgs(Json::Value* args_ptr) {
+      Json::Value& args = *args_ptr;
+      // Move all fields from "debug" key to upper level.
+      if (args.isMember("debug")) {
+        Json::Value debug = args["debug"];
+        args.removeMember("debug");
+        for (const auto& member : debug.getMemberNames()) {
+          args[member] = debug[member];
         }
+      }
 
-        // Rename source fields.
-        if (args.isMember("task")) {
-          if (args["task"].isMember("posted_from")) {
-            Json::Value posted_from = args["task"]["posted_from"];
-            args["task"].removeMember("posted_from");
-            if (posted_from.isMember("function_name")) {
-              args["src_func"] = posted_from["function_name"];
-              args["src_file"] = posted_from["file_name"];
-            } else if (posted_from.isMember("file_name")) {
-              args["src"] = posted_from["file_name"];
-            }
+      // Rename source fields.
+      if (args.isMember("task")) {
+        if (args["task"].isMember("posted_from")) {
+          Json::Value posted_from = args["task"]["posted_from"];
+          args["task"].removeMember("posted_from");
+          if (posted_from.isMember("function_name")) {
+            args["src_func"] = posted_from["function_name"];
+            args["src_file"] = posted_from["file_name"];
+          } else if (posted_from.isMember("file_name")) {
+            args["src"] = posted_from["file_name"];
           }
-          if (args["task"].empty())
-            args.removeMember("task");
         }
-        if (args.isMember("source")) {
-          Json::Value source = args["source"];
-          if (source.isObject() && source.isMember("function_name")) {
-            args["function_name"] = source["function_name"];
-            args["file_name"] = source["file_name"];
-            args.removeMember("source");
-          }
+        if (args["task"].empty())
+          args.removeMember("task");
+      }
+      if (args.isMember("source")) {
+        Json::Value source = args["source"];
+        if (source.isObject() && source.isMember("function_name")) {
+          args["function_name"] = source["function_name"];
+          args["file_name"] = source["file_name"];
+          args.removeMember("source");
         }
       }
     }
 
     const TraceStorage* storage_;
-    std::vector<Json::Value> args_sets_;
-    const Json::Value empty_value_;
     const Json::Value nan_value_;
     const Json::Value inf_value_;
     const Json::Value neg_inf_value_;
@@ -705,9 +735,83 @@ class JsonExporter {
     return util::OkStatus();
   }
 
+  // Finds the tracks of the process selected by the event filter and its
+  // threads.
+  util::Status ComputeUpidFilter() {
+    if (!event_filter_.upid)
+      return util::OkStatus();
+
+    UniquePid upid = *event_filter_.upid;
+    if (upid >= storage_->process_table().row_count())
+      return util::ErrStatus("JSON export: invalid upid %u", upid);
+
+    tracks_in_upid_.resize(storage_->track_table().row_count());
+    const auto& thread_tracks = storage_->thread_track_table();
+    for (uint32_t i = 0; i < thread_tracks.row_count(); ++i) {
+      if (UtidMatchesFilter(thread_tracks.utid()[i]))
+        tracks_in_upid_[thread_tracks.id()[i].value] = true;
+    }
+    const auto& process_tracks = storage_->process_track_table();
+    for (uint32_t i = 0; i < process_tracks.row_count(); ++i) {
+      if (process_tracks.upid()[i] == upid)
+        tracks_in_upid_[process_tracks.id()[i].value] = true;
+    }
+    return util::OkStatus();
+  }
+
+  bool TsMatchesFilter(int64_t ts) const {
+    return ts >= event_filter_.min_ts && ts <= event_filter_.max_ts;
+  }
+
+  bool UpidMatchesFilter(UniquePid upid) const {
+    return !event_filter_.upid || *event_filter_.upid == upid;
+  }
+
+  bool UtidMatchesFilter(UniqueTid utid) const {
+    return !event_filter_.upid ||
+           storage_->thread_table().upid()[utid] == event_filter_.upid;
+  }
+
+  bool TrackMatchesFilter(TrackId track_id) const {
+    return !event_filter_.upid || tracks_in_upid_[track_id.value];
+  }
+
+  bool SliceMatchesFilter(SliceId slice_id) const {
+    const auto& slices = storage_->slice_table();
+    base::Optional<uint32_t> opt_row = slices.id().IndexOf(slice_id);
+    return opt_row && TsMatchesFilter(slices.ts()[*opt_row]) &&
+           TrackMatchesFilter(slices.track_id()[*opt_row]);
+  }
+
+  // Returns the range of rows of a table whose timestamps are in the time
+  // range of the event filter, given the table's sorted timestamp column.
+  std::pair<uint32_t, uint32_t> RowsInTimeRange(const Column& ts) const {
+    PERFETTO_DCHECK(ts.IsSorted() && ts.IsColumnType<int64_t>());
+    auto begin = std::lower_bound(ts.begin(), ts.end(), event_filter_.min_ts,
+                                  [](const SqlValue& value, int64_t min_ts) {
+                                    return value.AsLong() < min_ts;
+                                  });
+    auto end = std::upper_bound(begin, ts.end(), event_filter_.max_ts,
+                                [](int64_t max_ts, const SqlValue& value) {
+                                  return max_ts < value.AsLong();
+                                });
+    return std::make_pair(begin.row(), end.row());
+  }
+
+  // Tracks have few arg sets, which are needed for each of their slices, so
+  // unlike the args of the events these are only converted once.
+  const Json::Value& GetTrackArgs(ArgSetId set_id) {
+    auto it = track_args_.find(set_id);
+    if (it == track_args_.end())
+      it = track_args_.emplace(set_id, args_builder_.GetArgs(set_id)).first;
+    return it->second;
+  }
+
   util::Status ExportThreadNames() {
     const auto& thread_table = storage_->thread_table();
     for (UniqueTid utid = 0; utid < thread_table.row_count(); ++utid) {
+      if (!UtidMatchesFilter(utid))
+        continue;
       auto opt_name = thread_table.name()[utid];
       if (opt_name.has_value()) {
         const char* thread_name = GetNonNullString(storage_, opt_name);
@@ -722,6 +826,8 @@ class JsonExporter {
   util::Status ExportProcessNames() {
     const auto& process_table = storage_->process_table();
     for (UniquePid upid = 0; upid < process_table.row_count(); ++upid) {
+      if (!UpidMatchesFilter(upid))
+        continue;
       auto opt_name = process_table.name()[upid];
       if (opt_name.has_value()) {
         const char* process_name = GetNonNullString(storage_, opt_name);
@@ -742,6 +848,8 @@ class JsonExporter {
 
     const auto& process_table = storage_->process_table();
     for (UniquePid upid = 0; upid < process_table.row_count(); ++upid) {
+      if (!UpidMatchesFilter(upid))
+        continue;
       base::Optional<int64_t> start_timestamp_ns =
           process_table.start_ts()[upid];
       if (!start_timestamp_ns.has_value())
@@ -777,7 +885,8 @@ class JsonExporter {
 
   util::Status ExportSlices() {
     const auto& slices = storage_->slice_table();
-    for (uint32_t i = 0; i < slices.row_count(); ++i) {
+    auto rows = RowsInTimeRange(slices.ts());
+    for (uint32_t i = rows.first; i < rows.second; ++i) {
       // Skip slices with empty category - these are ftrace/system slices that
       // were also imported into the raw table and will be exported from there
       // by trace_to_text.
@@ -786,6 +895,9 @@ class JsonExporter {
       if (cat.c_str() == nullptr || cat == "binder")
         continue;
 
+      if (!TrackMatchesFilter(slices.track_id()[i]))
+        continue;
+
       Json::Value event;
       event["ts"] = Json::Int64(slices.ts()[i] / 1000);
       event["cat"] = GetNonNullString(storage_, slices.category()[i]);
@@ -825,7 +937,7 @@ class JsonExporter {
       bool legacy_chrome_track = false;
       bool is_child_track = false;
       if (track_args_id) {
-        track_args = &args_builder_.GetArgs(*track_args_id);
+        track_args = &GetTrackArgs(*track_args_id);
         legacy_chrome_track = (*track_args)["source"].asString() == "chrome";
         is_child_track = track_args->isMember("is_root_in_scope") &&
                          !(*track_args)["is_root_in_scope"].asBool();
@@ -1101,6 +1213,8 @@ class JsonExporter {
     for (uint32_t i = 0; i < flow_table.row_count(); i++) {
       SliceId slice_out = flow_table.slice_out()[i];
       SliceId slice_in = flow_table.slice_in()[i];
+      if (!SliceMatchesFilter(slice_out) || !SliceMatchesFilter(slice_in))
+        continue;
       uint32_t arg_set_id = flow_table.arg_set_id()[i];
 
       std::string cat;
@@ -1228,6 +1342,12 @@ class JsonExporter {
     for (uint32_t i = 0; i < events.row_count(); ++i) {
       if (raw_legacy_event_key_id &&
           events.name()[i] == *raw_legacy_event_key_id) {
+        // The other raw events hold data for the whole trace, which is
+        // exported regardless of the event filter.
+        if (!TsMatchesFilter(events.ts()[i]) ||
+            !UtidMatchesFilter(events.utid()[i])) {
+          continue;
+        }
         Json::Value event = ConvertLegacyRawEventToJson(i);
         writer_.WriteCommonEvent(event);
       } else if (raw_legacy_system_trace_event_id &&
@@ -1373,11 +1493,15 @@ class JsonExporter {
 
     const tables::CpuProfileStackSampleTable& samples =
         storage_->cpu_profile_stack_sample_table();
-    for (uint32_t i = 0; i < samples.row_count(); ++i) {
+    auto rows = RowsInTimeRange(samples.ts());
+    for (uint32_t i = rows.first; i < rows.second; ++i) {
+      UniqueTid utid = static_cast<UniqueTid>(samples.utid()[i]);
+      if (!UtidMatchesFilter(utid))
+        continue;
+
       Json::Value event;
       event["ts"] = Json::Int64(samples.ts()[i] / 1000);
 
-      UniqueTid utid = static_cast<UniqueTid>(samples.utid()[i]);
       auto pid_and_tid = UtidToPidAndTid(utid);
       event["pid"] = Json::Int(pid_and_tid.first);
       event["tid"] = Json::Int(pid_and_tid.second);
@@ -1567,13 +1691,16 @@ class JsonExporter {
 
     for (uint32_t memory_index = 0; memory_index < memory_snapshots.row_count();
          ++memory_index) {
+      int64_t snapshot_ts = memory_snapshots.timestamp()[memory_index];
+      if (!TsMatchesFilter(snapshot_ts))
+        continue;
+
       Json::Value event_base;
 
       event_base["ph"] = "v";
       event_base["cat"] = "disabled-by-default-memory-infra";
       auto snapshot_id = memory_snapshots.id()[memory_index].value;
       event_base["id"] = base::Uint64ToHexString(snapshot_id);
-      int64_t snapshot_ts = memory_snapshots.timestamp()[memory_index];
       event_base["ts"] = Json::Int64(snapshot_ts / 1000);
       // TODO(crbug:1116359): Add dump type to the snapshot proto
       // to properly fill event_base["name"]
@@ -1584,6 +1711,8 @@ class JsonExporter {
       // Export OS dump events for processes with relevant data.
       const auto& process_table = storage_->process_table();
       for (UniquePid upid = 0; upid < process_table.row_count(); ++upid) {
+        if (!UpidMatchesFilter(upid))
+          continue;
         Json::Value event =
             FillInProcessEventDetails(event_base, process_table.pid()[upid]);
         Json::Value& totals = event["args"]["dumps"]["process_totals"];
@@ -1609,11 +1738,10 @@ class JsonExporter {
 
         auto process_args_id = process_table.arg_set_id()[upid];
         if (process_args_id) {
-          const Json::Value* process_args =
-              &args_builder_.GetArgs(process_args_id);
-          if (process_args->isMember("is_peak_rss_resettable")) {
+          Json::Value process_args = args_builder_.GetArgs(process_args_id);
+          if (process_args.isMember("is_peak_rss_resettable")) {
             totals["is_peak_rss_resettable"] =
-                (*process_args)["is_peak_rss_resettable"];
+                process_args["is_peak_rss_resettable"];
           }
         }
 
@@ -1682,6 +1810,8 @@ class JsonExporter {
            process_index < process_snapshots.row_count(); ++process_index) {
         if (process_snapshots.snapshot_id()[process_index].value != snapshot_id)
           continue;
+        if (!UpidMatchesFilter(process_snapshots.upid()[process_index]))
+          continue;
 
         auto process_snapshot_id = process_snapshots.id()[process_index].value;
         uint32_t pid = UpidToPid(process_snapshots.upid()[process_index]);
@@ -1731,17 +1861,16 @@ class JsonExporter {
           auto node_args_id = snapshot_nodes.arg_set_id()[node_index];
           if (!node_args_id)
             continue;
-          const Json::Value* node_args =
-              &args_builder_.GetArgs(node_args_id.value());
-          for (const auto& arg_name : node_args->getMemberNames()) {
-            const Json::Value& arg_value = (*node_args)[arg_name]["value"];
+          Json::Value node_args = args_builder_.GetArgs(node_args_id.value());
+          for (const auto& arg_name : node_args.getMemberNames()) {
+            const Json::Value& arg_value = node_args[arg_name]["value"];
             if (arg_value.empty())
               continue;
             if (arg_value.isString()) {
               AddAttributeToMemoryNode(&event, path, arg_name,
                                        arg_value.asString());
             } else if (arg_value.isInt64()) {
-              Json::Value unit = (*node_args)[arg_name]["unit"];
+              Json::Value unit = node_args[arg_name]["unit"];
               if (unit.empty())
                 unit = "unknown";
               AddAttributeToMemoryNode(&event, path, arg_name,
@@ -1872,9 +2001,15 @@ class JsonExporter {
   }
 
   const TraceStorage* storage_;
+  const EventFilter event_filter_;
   ArgsBuilder args_builder_;
   TraceFormatWriter writer_;
 
+  // Indexed by TrackId. Only populated if the event filter has a upid.
+  std::vector<bool> tracks_in_upid_;
+
+  std::unordered_map<ArgSetId, Json::Value> track_args_;
+
   // If a pid/tid is duplicated between two or more  different processes/threads
   // (pid/tid reuse), we export the subsequent occurrences with different
   // pids/tids that is visibly different from regular pids/tids - counting down
@@ -1902,13 +2037,25 @@ util::Status ExportJson(const TraceStorage* storage,
                         ArgumentFilterPredicate argument_filter,
                         MetadataFilterPredicate metadata_filter,
                         LabelFilterPredicate label_filter) {
+  return ExportJson(storage, output, EventFilter(), std::move(argument_filter),
+                    std::move(metadata_filter), std::move(label_filter));
+}
+
+util::Status ExportJson(const TraceStorage* storage,
+                        OutputWriter* output,
+                        const EventFilter& event_filter,
+                        ArgumentFilterPredicate argument_filter,
+                        MetadataFilterPredicate metadata_filter,
+                        LabelFilterPredicate label_filter) {
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
-  JsonExporter exporter(storage, output, std::move(argument_filter),
-                        std::move(metadata_filter), std::move(label_filter));
+  JsonExporter exporter(storage, output, event_filter,
+                        std::move(argument_filter), std::move(metadata_filter),
+                        std::move(label_filter));
   return exporter.Export();
 #else
   perfetto::base::ignore_result(storage);
   perfetto::base::ignore_result(output);
+  perfetto::base::ignore_result(event_filter);
   perfetto::base::ignore_result(argument_filter);
   perfetto::base::ignore_result(metadata_filter);
   perfetto::base::ignore_result(label_filter);
@@ -1921,16 +2068,37 @@ util::Status ExportJson(TraceProcessorStorage* tp,
                         ArgumentFilterPredicate argument_filter,
                         MetadataFilterPredicate metadata_filter,
                         LabelFilterPredicate label_filter) {
-  const TraceStorage* storage = reinterpret_cast<TraceProcessorStorageImpl*>(tp)
-                                    ->context()
-                                    ->storage.get();
+  // The thread_state table may still be being computed in the background.
+  auto* impl = reinterpret_cast<TraceProcessorStorageImpl*>(tp);
+  impl->WaitForBackgroundWork();
+  const TraceStorage* storage = impl->context()->storage.get();
   return ExportJson(storage, output, argument_filter, metadata_filter,
                     label_filter);
 }
 
+util::Status ExportJson(TraceProcessorStorage* tp,
+                        OutputWriter* output,
+                        const EventFilter& event_filter,
+                        ArgumentFilterPredicate argument_filter,
+                        MetadataFilterPredicate metadata_filter,
+                        LabelFilterPredicate label_filter) {
+  // The thread_state table may still be being computed in the background.
+  auto* impl = reinterpret_cast<TraceProcessorStorageImpl*>(tp);
+  impl->WaitForBackgroundWork();
+  const TraceStorage* storage = impl->context()->storage.get();
+  return ExportJson(storage, output, event_filter, argument_filter,
+                    metadata_filter, label_filter);
+}
+
 util::Status ExportJson(const TraceStorage* storage, FILE* output) {
+  return ExportJson(storage, output, EventFilter());
+}
+
+util::Status ExportJson(const TraceStorage* storage,
+                        FILE* output,
+                        const EventFilter& event_filter) {
   FileWriter writer(output);
-  return ExportJson(storage, &writer, nullptr, nullptr, nullptr);
+  return ExportJson(storage, &writer, event_filter, nullptr, nullptr, nullptr);
 }
 
 }  // namespace json
@@ -30,12 +30,24 @@ namespace json {
 // Export trace to a file stream in json format.
 util::Status ExportJson(const TraceStorage*, FILE* output);
 
+// Export the events selected by |event_filter| to a file stream in json
+// format.
+util::Status ExportJson(const TraceStorage*,
+                        FILE* output,
+                        const EventFilter& event_filter);
+
 // For testing.
 util::Status ExportJson(const TraceStorage* storage,
                         OutputWriter*,
                         ArgumentFilterPredicate = nullptr,
                         MetadataFilterPredicate = nullptr,
                         LabelFilterPredicate = nullptr);
+util::Status ExportJson(const TraceStorage* storage,
+                        OutputWriter*,
+                        const EventFilter& event_filter,
+                        ArgumentFilterPredicate = nullptr,
+                        MetadataFilterPredicate = nullptr,
+                        LabelFilterPredicate = nullptr);
 
 }  // namespace json
 }  // namespace trace_processor
@@ -1750,6 +1750,117 @@ TEST_F(ExportJsonTest, LabelFilter) {
   EXPECT_EQ(result[1]["name"].asString(), kName);
 }
 
+TEST_F(ExportJsonTest, TimeRangeFilter) {
+  UniqueTid utid = context_.process_tracker->GetOrCreateThread(1);
+  TrackId track = context_.track_tracker->InternThreadTrack(utid);
+  context_.args_tracker->Flush();  // Flush track args.
+
+  StringId cat_id = context_.storage->InternString(base::StringView("cat"));
+  StringId name_id = context_.storage->InternString(base::StringView("name"));
+  for (int64_t ts = 1000; ts <= 5000; ts += 1000) {
+    context_.storage->mutable_slice_table()->Insert(
+        {ts, 0, track, cat_id, name_id, 0, 0, 0});
+  }
+
+  EventFilter event_filter;
+  event_filter.min_ts = 2000;
+  event_filter.max_ts = 4000;
+  StringOutputWriter writer;
+  util::Status status =
+      ExportJson(context_.storage.get(), &writer, event_filter);
+  EXPECT_TRUE(status.ok());
+
+  Json::Value result = ToJsonValue(writer.TakeStr());
+  ASSERT_EQ(result["traceEvents"].size(), 3u);
+  EXPECT_EQ(result["traceEvents"][0]["ts"].asInt64(), 2);
+  EXPECT_EQ(result["traceEvents"][1]["ts"].asInt64(), 3);
+  EXPECT_EQ(result["traceEvents"][2]["ts"].asInt64(), 4);
+}
+
+TEST_F(ExportJsonTest, UpidFilter) {
+  UniquePid upid1 = context_.process_tracker->GetOrCreateProcess(1);
+  UniquePid upid2 = context_.process_tracker->GetOrCreateProcess(2);
+  UniqueTid utid1 = context_.process_tracker->UpdateThread(10, 1);
+  UniqueTid utid2 = context_.process_tracker->UpdateThread(20, 2);
+  ASSERT_EQ(upid1, *context_.storage->thread_table().upid()[utid1]);
+  ASSERT_EQ(upid2, *context_.storage->thread_table().upid()[utid2]);
+
+  TrackId track1 = context_.track_tracker->InternThreadTrack(utid1);
+  TrackId track2 = context_.track_tracker->InternThreadTrack(utid2);
+  context_.args_tracker->Flush();  // Flush track args.
+
+  StringId cat_id = context_.storage->InternString(base::StringView("cat"));
+  StringId name1_id = context_.storage->InternString(base::StringView("name1"));
+  StringId name2_id = context_.storage->InternString(base::StringView("name2"));
+  context_.storage->mutable_slice_table()->Insert(
+      {1000, 0, track1, cat_id, name1_id, 0, 0, 0});
+  context_.storage->mutable_slice_table()->Insert(
+      {2000, 0, track2, cat_id, name2_id, 0, 0, 0});
+  context_.storage->mutable_slice_table()->Insert(
+      {3000, 0, track1, cat_id, name1_id, 0, 0, 0});
+
+  EventFilter event_filter;
+  event_filter.upid = upid1;
+  StringOutputWriter writer;
+  util::Status status =
+      ExportJson(context_.storage.get(), &writer, event_filter);
+  EXPECT_TRUE(status.ok());
+
+  Json::Value result = ToJsonValue(writer.TakeStr());
+  ASSERT_EQ(result["traceEvents"].size(), 2u);
+  for (const Json::Value& event : result["traceEvents"]) {
+    EXPECT_EQ(event["pid"].asInt(), 1);
+    EXPECT_EQ(event["tid"].asInt(), 10);
+    EXPECT_EQ(event["name"].asString(), "name1");
+  }
+
+  // An invalid upid is an error.
+  event_filter.upid = 100;
+  StringOutputWriter invalid_writer;
+  status = ExportJson(context_.storage.get(), &invalid_writer, event_filter);
+  EXPECT_FALSE(status.ok());
+}
+
+TEST_F(ExportJsonTest, OutputIsBuffered) {
+  const size_t kNumSlices = 10000;
+
+  UniqueTid utid = context_.process_tracker->GetOrCreateThread(1);
+  TrackId track = context_.track_tracker->InternThreadTrack(utid);
+  context_.args_tracker->Flush();  // Flush track args.
+
+  StringId cat_id = context_.storage->InternString(base::StringView("cat"));
+  StringId name_id = context_.storage->InternString(base::StringView("name"));
+  StringId arg_id = context_.storage->InternString(base::StringView("arg"));
+  auto* slices = context_.storage->mutable_slice_table();
+  for (size_t i = 0; i < kNumSlices; ++i) {
+    auto id = slices
+                  ->Insert({static_cast<int64_t>(i) * 1000, 1000, track, cat_id,
+                            name_id, 0, 0, 0})
+                  .id;
+    context_.args_tracker->AddArgsTo(id).AddArg(
+        arg_id, Variadic::Integer(static_cast<int64_t>(i)));
+  }
+  context_.args_tracker->Flush();
+
+  class CountingOutputWriter : public StringOutputWriter {
+   public:
+    util::Status AppendString(const std::string& str) override {
+      append_count++;
+      return StringOutputWriter::AppendString(str);
+    }
+    size_t append_count = 0;
+  };
+  CountingOutputWriter writer;
+  util::Status status = ExportJson(context_.storage.get(), &writer);
+  EXPECT_TRUE(status.ok());
+  EXPECT_LT(writer.append_count, kNumSlices / 100);
+
+  Json::Value result = ToJsonValue(writer.TakeStr());
+  ASSERT_EQ(result["traceEvents"].size(), kNumSlices);
+  for (uint32_t i = 0; i < kNumSlices; ++i)
+    EXPECT_EQ(result["traceEvents"][i]["args"]["arg"].asUInt(), i);
+}
+
 TEST_F(ExportJsonTest, MemorySnapshotOsDumpEvent) {
   const int64_t kTimestamp = 10000000;
   const int64_t kPeakResidentSetSize = 100000;
@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <atomic>
 #include <cinttypes>
+#include <limits>
 #include <queue>
 
 #include "perfetto/base/logging.h"
@@ -43,9 +44,6 @@ ClockTracker::~ClockTracker() = default;
 uint32_t ClockTracker::AddSnapshot(const std::vector<ClockValue>& clocks) {
   const auto snapshot_id = cur_snapshot_id_++;
 
-  // Clear the cache
-  cache_.fill({});
-
   // Compute the fingerprint of the snapshot by hashing all clock ids. This is
   // used by the clock pathfinding logic.
   base::Hash hasher;
@@ -53,6 +51,11 @@ uint32_t ClockTracker::AddSnapshot(const std::vector<ClockValue>& clocks) {
     hasher.Update(clock.clock_id);
   const auto snapshot_hash = static_cast<SnapshotHash>(hasher.digest());
 
+  // The conversion tables computed from the previous snapshots with the same
+  // hash are out of date as soon as we append to them below (even if we then
+  // bail out because of an invalid clock).
+  InvalidateConversionTables(snapshot_hash);
+
   // Add a new entry in each clock's snapshot vector.
   for (const auto& clock : clocks) {
     ClockId clock_id = clock.clock_id;
@@ -134,7 +137,11 @@ uint32_t ClockTracker::AddSnapshot(const std::vector<ClockValue>& clocks) {
       // ones that end on this clock).
       auto begin = graph_.lower_bound(ClockGraphEdge{clock_id, 0, 0});
       auto end = graph_.lower_bound(ClockGraphEdge{clock_id + 1, 0, 0});
-      graph_.erase(begin, end);
+      if (begin != end) {
+        graph_.erase(begin, end);
+        // The paths between any two clocks may have changed.
+        ClearConversionTables();
+      }
     }
     vect.snapshot_ids.emplace_back(snapshot_id);
     vect.timestamps_ns.emplace_back(timestamp_ns);
@@ -147,20 +154,45 @@ uint32_t ClockTracker::AddSnapshot(const std::vector<ClockValue>& clocks) {
   // snapshots of type (hash).
   // Clocks that were previously marked as non-monotonic won't be added as
   // valid sources.
+  bool graph_changed = false;
   for (auto it1 = clocks.begin(); it1 != clocks.end(); ++it1) {
     auto it2 = it1;
     ++it2;
     for (; it2 != clocks.end(); ++it2) {
-      if (!non_monotonic_clocks_.count(it1->clock_id))
-        graph_.emplace(it1->clock_id, it2->clock_id, snapshot_hash);
+      if (!non_monotonic_clocks_.count(it1->clock_id)) {
+        graph_changed |=
+            graph_.emplace(it1->clock_id, it2->clock_id, snapshot_hash).second;
+      }
 
-      if (!non_monotonic_clocks_.count(it2->clock_id))
-        graph_.emplace(it2->clock_id, it1->clock_id, snapshot_hash);
+      if (!non_monotonic_clocks_.count(it2->clock_id)) {
+        graph_changed |=
+            graph_.emplace(it2->clock_id, it1->clock_id, snapshot_hash).second;
+      }
     }
   }
+
+  // New edges can create shorter paths between any two clocks.
+  if (graph_changed)
+    ClearConversionTables();
   return snapshot_id;
 }
 
+void ClockTracker::InvalidateConversionTables(SnapshotHash hash) {
+  auto it = conversion_tables_for_hash_.find(hash);
+  if (it == conversion_tables_for_hash_.end())
+    return;
+  for (const ClockPair& pair : it->second)
+    conversion_tables_.Erase(pair);
+  conversion_tables_for_hash_.erase(it);
+  last_conversion_table_ = nullptr;
+}
+
+void ClockTracker::ClearConversionTables() {
+  conversion_tables_.Clear();
+  conversion_tables_for_hash_.clear();
+  last_conversion_table_ = nullptr;
+}
+
 // Finds the shortest clock resolution path in the graph that allows to
 // translate a timestamp from |src| to |target| clocks.
 // The return value looks like the following: "If you want to convert a
@@ -221,14 +253,22 @@ base::Optional<int64_t> ClockTracker::ConvertSlowpath(ClockId src_clock_id,
     return base::nullopt;
   }
 
-  // We can cache only single-path resolutions between two clocks.
-  // Caching multi-path resolutions is harder because the (src,target) tuple
-  // is not enough as a cache key: at any step the |ns| value can yield to a
-  // different choice of the next snapshot. Multi-path resolutions don't seem
-  // too frequent these days, so we focus only on caching the more frequent
-  // one-step resolutions (typically from any clock to the trace clock).
-  const bool cacheable = path.len == 1;
-  CachedClockPath cache_entry{};
+  // Compute the conversion table of the two clocks so that the next
+  // conversions between them don't need to find the path again.
+  ClockPair pair{src_clock_id, target_clock_id};
+  if (!conversion_tables_.Find(pair)) {
+    ConversionTable table;
+    if (BuildConversionTable(path, &table)) {
+      table.src_domain = GetClock(src_clock_id);
+      conversion_tables_.Insert(pair, std::move(table));
+      last_conversion_table_ = nullptr;
+      for (uint32_t i = 0; i < path.len; ++i) {
+        auto& pairs = conversion_tables_for_hash_[std::get<2>(path.at(i))];
+        if (pairs.empty() || !(pairs.back() == pair))
+          pairs.push_back(pair);
+      }
+    }
+  }
 
   // Iterate trough the path found and translate timestamps onto the new clock
   // domain on each step, until the target domain is reached.
@@ -279,31 +319,89 @@ base::Optional<int64_t> ClockTracker::ConvertSlowpath(ClockId src_clock_id,
     const int64_t adj = next_timestamp_ns - *it;
     ns += adj;
 
-    // On the first iteration, keep track of the bounds for the cache entry.
-    // This will allow future Convert() calls to skip the pathfinder logic
-    // as long as the query stays within the bound.
-    if (cacheable) {
-      PERFETTO_DCHECK(i == 0);
-      const int64_t kInt64Min = std::numeric_limits<int64_t>::min();
-      const int64_t kInt64Max = std::numeric_limits<int64_t>::max();
-      cache_entry.min_ts_ns = it == ts_vec.begin() ? kInt64Min : *it;
-      auto ubound = it + 1;
-      cache_entry.max_ts_ns = ubound == ts_vec.end() ? kInt64Max : *ubound;
-      cache_entry.translation_ns = adj;
-    }
-
     // The last clock in the path must be the target clock.
     PERFETTO_DCHECK(i < path.len - 1 || std::get<1>(edge) == target_clock_id);
   }
 
-  if (cacheable) {
-    cache_entry.src = src_clock_id;
-    cache_entry.src_domain = src_domain;
-    cache_entry.target = target_clock_id;
-    cache_[rnd_() % cache_.size()] = cache_entry;
+  return ns;
+}
+
+// Computes the segments of the conversion along |path| one step at a time:
+// |table| always holds the conversion from the source clock to the last clock
+// reached so far. The conversion of a single step (e.g. A->B via S1) has a
+// segment for each snapshot of A in S1. Appending a step to a conversion
+// splits each of its segments where the timestamps it is translated to cross
+// the start of a segment of the step.
+bool ClockTracker::BuildConversionTable(const ClockPath& path,
+                                        ConversionTable* table) {
+  // Start with the identity.
+  std::vector<int64_t> starts_ns{std::numeric_limits<int64_t>::min()};
+  std::vector<int64_t> translations_ns{0};
+
+  std::vector<int64_t> step_translations_ns;
+  for (uint32_t i = 0; i < path.len; ++i) {
+    const ClockGraphEdge edge = path.at(i);
+    const ClockSnapshots& cur_snap =
+        GetClock(std::get<0>(edge))->GetSnapshot(std::get<2>(edge));
+    const ClockSnapshots& next_snap =
+        GetClock(std::get<1>(edge))->GetSnapshot(std::get<2>(edge));
+
+    // Compute the translation of each segment of this step, as done by
+    // ConvertSlowpath().
+    const std::vector<int64_t>& step_starts_ns = cur_snap.timestamps_ns;
+    if (step_starts_ns.empty())
+      return false;
+    step_translations_ns.clear();
+    for (size_t j = 0; j < step_starts_ns.size(); ++j) {
+      uint32_t snapshot_id = cur_snap.snapshot_ids[j];
+      auto next_it = std::lower_bound(next_snap.snapshot_ids.begin(),
+                                      next_snap.snapshot_ids.end(),
+                                      snapshot_id);
+      if (next_it == next_snap.snapshot_ids.end() || *next_it != snapshot_id)
+        return false;
+      size_t next_index = static_cast<size_t>(
+          std::distance(next_snap.snapshot_ids.begin(), next_it));
+      step_translations_ns.push_back(next_snap.timestamps_ns[next_index] -
+                                     step_starts_ns[j]);
+    }
+
+    // Append the step to the conversion computed so far.
+    std::vector<int64_t> new_starts_ns;
+    std::vector<int64_t> new_translations_ns;
+    for (size_t k = 0; k < starts_ns.size(); ++k) {
+      const int64_t translation_ns = translations_ns[k];
+      const bool is_first = k == 0;
+      const bool is_last = k + 1 == starts_ns.size();
+
+      // The segment of the step the start of this segment is translated into.
+      size_t j = 0;
+      if (!is_first) {
+        auto it = std::upper_bound(step_starts_ns.begin() + 1,
+                                   step_starts_ns.end(),
+                                   starts_ns[k] + translation_ns);
+        j = static_cast<size_t>(std::distance(step_starts_ns.begin(), it)) - 1;
+      }
+      new_starts_ns.push_back(starts_ns[k]);
+      new_translations_ns.push_back(translation_ns + step_translations_ns[j]);
+
+      // Split this segment at the starts of the following segments of the
+      // step, as long as they are reached before its end.
+      for (++j; j < step_starts_ns.size(); ++j) {
+        if (!is_last && step_starts_ns[j] >= starts_ns[k + 1] + translation_ns)
+          break;
+        new_starts_ns.push_back(step_starts_ns[j] - translation_ns);
+        new_translations_ns.push_back(translation_ns + step_translations_ns[j]);
+      }
+    }
+    starts_ns = std::move(new_starts_ns);
+    translations_ns = std::move(new_translations_ns);
   }
+  PERFETTO_DCHECK(starts_ns.size() == translations_ns.size());
+  PERFETTO_DCHECK(std::is_sorted(starts_ns.begin() + 1, starts_ns.end()));
 
-  return ns;
+  table->starts_ns = std::move(starts_ns);
+  table->translations_ns = std::move(translations_ns);
+  return true;
 }
 
 }  // namespace trace_processor
@@ -19,14 +19,15 @@
 
 #include <stdint.h>
 
+#include <algorithm>
 #include <array>
 #include <cinttypes>
 #include <map>
-#include <random>
 #include <set>
 #include <vector>
 
 #include "perfetto/base/logging.h"
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/optional.h"
 
 namespace perfetto {
@@ -107,6 +108,17 @@ class TraceProcessorContext;
 // Clock C:                    |                  |
 //   S2                        {t: 2000, id: 2}   |
 //   S3                                           {t:5000, id:3}
+//
+// Conversion tables:
+// The path between two clocks only depends on the graph and, for each step
+// of the path, the translation to apply to a timestamp only changes at the
+// timestamps of the snapshots. So, once a path has been found, the conversion
+// between its two clocks is a piecewise function (ns -> ns + translation),
+// whose segments can be computed from the snapshots of the path.
+// The segments are cached in a ConversionTable for each (src, target) pair
+// and Convert() just binary searches the segment of a timestamp in it. Tables
+// are dropped when a snapshot changes the graph or the snapshots they were
+// computed from, and are recomputed on the next conversion.
 
 class ClockTracker {
  public:
@@ -157,20 +169,23 @@ class ClockTracker {
   // Returns the internal snapshot id of this set of clocks.
   uint32_t AddSnapshot(const std::vector<ClockValue>&);
 
-  // Converts a timestamp between two clock domains. Tries to use the cache
-  // first (only for single-path resolutions), then falls back on path finding
+  // Converts a timestamp between two clock domains. Tries to use the
+  // conversion table of the two clocks first, then falls back on path finding
   // as described in the header.
   base::Optional<int64_t> Convert(ClockId src_clock_id,
                                   int64_t src_timestamp,
                                   ClockId target_clock_id) {
     if (PERFETTO_LIKELY(!cache_lookups_disabled_for_testing_)) {
-      for (const auto& ce : cache_) {
-        if (ce.src != src_clock_id || ce.target != target_clock_id)
-          continue;
-        int64_t ns = ce.src_domain->ToNs(src_timestamp);
-        if (ns >= ce.min_ts_ns && ns < ce.max_ts_ns)
-          return ns + ce.translation_ns;
+      ClockPair pair{src_clock_id, target_clock_id};
+      // Most conversions are between the same clocks as the previous one.
+      ConversionTable* table = last_conversion_table_;
+      if (!table || !(last_conversion_pair_ == pair)) {
+        table = conversion_tables_.Find(pair);
+        last_conversion_table_ = table;
+        last_conversion_pair_ = pair;
       }
+      if (PERFETTO_LIKELY(table))
+        return table->Convert(table->src_domain->ToNs(src_timestamp));
     }
     return ConvertSlowpath(src_clock_id, src_timestamp, target_clock_id);
   }
@@ -279,15 +294,55 @@ class ClockTracker {
     }
   };
 
-  // Holds data for cached entries. At the moment only single-path resolution
-  // are cached.
-  struct CachedClockPath {
+  // The conversion between two clocks, as a piecewise function of the
+  // timestamps (in ns) of the source clock.
+  struct ConversionTable {
+    // Returns the timestamp in the target clock for |ns|.
+    int64_t Convert(int64_t ns) {
+      // Timestamps mostly increase, so they are often in the same segment as
+      // the previous one. The first segment also applies to the timestamps
+      // before its start.
+      size_t segment = last_segment;
+      bool before = segment > 0 && ns < starts_ns[segment];
+      bool after =
+          segment + 1 < starts_ns.size() && ns >= starts_ns[segment + 1];
+      if (PERFETTO_UNLIKELY(before || after)) {
+        auto it = std::upper_bound(starts_ns.begin() + 1, starts_ns.end(), ns);
+        segment = static_cast<size_t>(std::distance(starts_ns.begin(), it)) - 1;
+        last_segment = segment;
+      }
+      return ns + translations_ns[segment];
+    }
+
+    ClockDomain* src_domain = nullptr;
+
+    // The segment of the last converted timestamp.
+    size_t last_segment = 0;
+
+    // Invariant: both vectors have the same, non-zero, length.
+    // The segment i starts at |starts_ns[i]| (included) and ends at
+    // |starts_ns[i + 1]| (excluded). Its timestamps are converted by adding
+    // |translations_ns[i]|.
+    std::vector<int64_t> starts_ns;
+    std::vector<int64_t> translations_ns;
+  };
+
+  struct ClockPair {
     ClockId src;
     ClockId target;
-    ClockDomain* src_domain;
-    int64_t min_ts_ns;
-    int64_t max_ts_ns;
-    int64_t translation_ns;
+
+    bool operator==(const ClockPair& other) const {
+      return src == other.src && target == other.target;
+    }
+  };
+
+  struct ClockPairHasher {
+    size_t operator()(const ClockPair& pair) const {
+      // Sequence-scoped clock ids differ only in their upper 32 bits, so mix
+      // them into the lower ones.
+      uint64_t h = (pair.src ^ (pair.target << 1)) * 0x9e3779b97f4a7c15ull;
+      return static_cast<size_t>(h ^ (h >> 32));
+    }
   };
 
   ClockTracker(const ClockTracker&) = delete;
@@ -295,6 +350,16 @@ class ClockTracker {
 
   ClockPath FindPath(ClockId src, ClockId target);
 
+  // Computes the conversion table for |path|. Returns false if the snapshots
+  // of the path are inconsistent.
+  bool BuildConversionTable(const ClockPath& path, ConversionTable* table);
+
+  // Drops the conversion tables computed from the snapshots with |hash|.
+  void InvalidateConversionTables(SnapshotHash hash);
+
+  // Drops all the conversion tables.
+  void ClearConversionTables();
+
   ClockDomain* GetClock(ClockId clock_id) {
     auto it = clocks_.find(clock_id);
     PERFETTO_DCHECK(it != clocks_.end());
@@ -306,9 +371,17 @@ class ClockTracker {
   std::map<ClockId, ClockDomain> clocks_;
   std::set<ClockGraphEdge> graph_;
   std::set<ClockId> non_monotonic_clocks_;
-  std::array<CachedClockPath, 2> cache_{};
+  base::FlatHashMap<ClockPair, ConversionTable, ClockPairHasher>
+      conversion_tables_;
+  // The table used by the last Convert() call (or null if there is no table
+  // for |last_conversion_pair_|). Must be reset whenever |conversion_tables_|
+  // is changed as this points into it.
+  ConversionTable* last_conversion_table_ = nullptr;
+  ClockPair last_conversion_pair_{};
+  // The (src, target) pairs of the conversion tables computed from the
+  // snapshots with a given hash.
+  std::map<SnapshotHash, std::vector<ClockPair>> conversion_tables_for_hash_;
   bool cache_lookups_disabled_for_testing_ = false;
-  std::minstd_rand rnd_;  // For cache eviction.
   uint32_t cur_snapshot_id_ = 0;
   bool trace_time_clock_id_used_for_conversion_ = false;
 };
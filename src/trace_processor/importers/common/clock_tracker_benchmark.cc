@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "src/trace_processor/importers/common/clock_tracker.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+
+#include "protos/perfetto/common/builtin_clock.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr uint32_t kRandomSeed = 476;
+
+constexpr auto BOOTTIME = protos::pbzero::BUILTIN_CLOCK_BOOTTIME;
+constexpr auto MONOTONIC = protos::pbzero::BUILTIN_CLOCK_MONOTONIC;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Args: {number of snapshots, 0 = path finding only / 1 = cached}.
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Args({16, 1});
+  } else {
+    for (int64_t snapshots : {16, 1024}) {
+      for (int64_t cached : {0, 1})
+        b->Args({snapshots, cached});
+    }
+  }
+  b->ArgNames({"snapshots", "cached"});
+}
+
+// Adds |num_snapshots| snapshots of MONOTONIC and BOOTTIME, drifting apart
+// by a few us every second, and returns the last MONOTONIC timestamp.
+int64_t AddSnapshots(ClockTracker* ct, int64_t num_snapshots) {
+  std::minstd_rand0 rnd(kRandomSeed);
+  int64_t mono = 1000000000;
+  int64_t boot = 5000000000;
+  for (int64_t i = 0; i < num_snapshots; ++i) {
+    mono += 1000000000;
+    boot += 1000000000 + rnd() % 10000;
+    ct->AddSnapshot({{MONOTONIC, mono}, {BOOTTIME, boot}});
+  }
+  return mono;
+}
+
+// Generates increasing timestamps with some jitter (up to 10ms), as the
+// timestamps of the packets of a trace.
+std::vector<int64_t> GenerateTimestamps(int64_t max_ts) {
+  static constexpr size_t kNumTimestamps = 4096;
+  std::minstd_rand0 rnd(kRandomSeed);
+  std::uniform_int_distribution<int64_t> jitter(-10000000, 10000000);
+  std::vector<int64_t> timestamps;
+  for (size_t i = 0; i < kNumTimestamps; ++i) {
+    int64_t ts = max_ts / kNumTimestamps * static_cast<int64_t>(i);
+    timestamps.push_back(ts + jitter(rnd));
+  }
+  return timestamps;
+}
+
+}  // namespace
+
+// Conversions to the trace clock from a global clock, e.g. for ftrace events
+// or packets with a timestamp_clock_id.
+static void BM_ClockTrackerConvertGlobal(benchmark::State& state) {
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  ClockTracker ct(&context);
+  int64_t max_ts = AddSnapshots(&ct, state.range(0));
+  ct.set_cache_lookups_disabled_for_testing(state.range(1) == 0);
+  std::vector<int64_t> timestamps = GenerateTimestamps(max_ts);
+
+  for (auto _ : state) {
+    for (int64_t ts : timestamps)
+      benchmark::DoNotOptimize(ct.ToTraceTime(MONOTONIC, ts));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(timestamps.size()) *
+                          static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_ClockTrackerConvertGlobal)->Apply(BenchmarkArgs);
+
+// Conversions to the trace clock from sequence-scoped incremental clocks,
+// which are snapshotted against MONOTONIC (as done by Chrome): this needs two
+// steps (sequence clock -> MONOTONIC -> BOOTTIME).
+static void BM_ClockTrackerConvertSeqScopedIncremental(
+    benchmark::State& state) {
+  static constexpr uint32_t kNumSequences = 8;
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  ClockTracker ct(&context);
+  int64_t max_ts = AddSnapshots(&ct, state.range(0));
+  ct.set_cache_lookups_disabled_for_testing(state.range(1) == 0);
+
+  std::vector<ClockTracker::ClockId> clocks;
+  for (uint32_t seq = 1; seq <= kNumSequences; ++seq) {
+    ClockTracker::ClockId clock =
+        ClockTracker::SeqScopedClockIdToGlobal(seq, 64);
+    ct.AddSnapshot({{MONOTONIC, max_ts / 2},
+                    {clock, 0, /*unit_multiplier_ns=*/1000,
+                     /*is_incremental=*/true}});
+    clocks.push_back(clock);
+  }
+
+  std::minstd_rand0 rnd(kRandomSeed);
+  std::vector<int64_t> deltas(4096);
+  for (int64_t& delta : deltas)
+    delta = rnd() % 100;
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < deltas.size(); ++i) {
+      benchmark::DoNotOptimize(
+          ct.ToTraceTime(clocks[i % kNumSequences], deltas[i]));
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(deltas.size()) *
+                          static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_ClockTrackerConvertSeqScopedIncremental)->Apply(BenchmarkArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -285,6 +285,58 @@ TEST_F(ClockTrackerTest, CacheDoesntAffectResults) {
   }
 }
 
+// Tests that snapshots added after a conversion are taken into account by the
+// next conversions between the same clocks.
+TEST_F(ClockTrackerTest, CacheFollowsNewSnapshots) {
+  ct_.AddSnapshot({{MONOTONIC, 100}, {BOOTTIME, 1100}});
+  EXPECT_EQ(ct_.Convert(MONOTONIC, 300, BOOTTIME), 1300);
+
+  // Same clocks: only the conversions after the snapshot change.
+  ct_.AddSnapshot({{MONOTONIC, 200}, {BOOTTIME, 2200}});
+  EXPECT_EQ(ct_.Convert(MONOTONIC, 300, BOOTTIME), 2300);
+  EXPECT_EQ(ct_.Convert(MONOTONIC, 150, BOOTTIME), 1150);
+
+  // MONOTONIC_RAW -> MONOTONIC -> BOOTTIME.
+  ct_.AddSnapshot({{MONOTONIC_RAW, 10}, {MONOTONIC, 20}});
+  EXPECT_EQ(ct_.Convert(MONOTONIC_RAW, 290, BOOTTIME), 2300);
+  EXPECT_EQ(ct_.Convert(MONOTONIC_RAW, 140, BOOTTIME), 1150);
+
+  // A direct path from MONOTONIC_RAW to BOOTTIME replaces the one above.
+  ct_.AddSnapshot({{MONOTONIC_RAW, 10}, {BOOTTIME, 5000}});
+  EXPECT_EQ(ct_.Convert(MONOTONIC_RAW, 290, BOOTTIME), 5280);
+}
+
+// Same as CacheDoesntAffectResults, but with multi-step conversions computed
+// while snapshots are being added.
+TEST_F(ClockTrackerTest, CacheDoesntAffectResultsInterleaved) {
+  std::minstd_rand rnd;
+  int64_t last_mono = 0;
+  int64_t last_boot = 0;
+  int64_t last_raw = 0;
+  for (int i = 0; i < 200; i++) {
+    last_mono += rnd() % 100;
+    last_boot += rnd() % 100;
+    ct_.AddSnapshot({{MONOTONIC, last_mono}, {BOOTTIME, last_boot}});
+
+    last_raw += rnd() % 100;
+    last_mono += rnd() % 100;
+    ct_.AddSnapshot({{MONOTONIC_RAW, last_raw}, {MONOTONIC, last_mono}});
+
+    for (int j = 0; j < 10; j++) {
+      int64_t val = static_cast<int64_t>(rnd() % 20000) - 1000;
+      for (auto src_and_tgt : {std::make_pair(MONOTONIC_RAW, BOOTTIME),
+                               std::make_pair(BOOTTIME, MONOTONIC_RAW)}) {
+        ct_.set_cache_lookups_disabled_for_testing(true);
+        auto not_cached =
+            ct_.Convert(src_and_tgt.first, val, src_and_tgt.second);
+        ct_.set_cache_lookups_disabled_for_testing(false);
+        auto cached = ct_.Convert(src_and_tgt.first, val, src_and_tgt.second);
+        ASSERT_EQ(not_cached, cached);
+      }
+    }
+  }
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
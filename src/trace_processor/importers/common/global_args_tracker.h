@@ -114,54 +114,25 @@ class GlobalArgsTracker {
       hash.Update(ArgHasher()(args[i]));
     }
 
-    auto* arg_table = context_->storage->mutable_arg_table();
-
     ArgSetHash digest = hash.digest();
-    auto it_and_inserted =
-        arg_row_for_hash_.Insert(digest, arg_table->row_count());
+    auto* arg_sets = context_->storage->mutable_arg_sets();
+    auto it_and_inserted = arg_set_for_hash_.Insert(digest, arg_sets->size());
     if (!it_and_inserted.second) {
       // Already inserted.
-      return arg_table->arg_set_id()[*it_and_inserted.first];
+      return *it_and_inserted.first;
     }
 
-    // Taking size() after the Insert() ensures that nothing has an id == 0
-    // (0 == kInvalidArgSetId).
-    ArgSetId id = static_cast<uint32_t>(arg_row_for_hash_.size());
+    base::SmallVector<ArgSetStorage::Arg, 64> set_args;
     for (uint32_t i : valid_indexes) {
       const auto& arg = args[i];
-
-      tables::ArgTable::Row row;
-      row.arg_set_id = id;
-      row.flat_key = arg.flat_key;
-      row.key = arg.key;
-      switch (arg.value.type) {
-        case Variadic::Type::kInt:
-          row.int_value = arg.value.int_value;
-          break;
-        case Variadic::Type::kUint:
-          row.int_value = static_cast<int64_t>(arg.value.uint_value);
-          break;
-        case Variadic::Type::kString:
-          row.string_value = arg.value.string_value;
-          break;
-        case Variadic::Type::kReal:
-          row.real_value = arg.value.real_value;
-          break;
-        case Variadic::Type::kPointer:
-          row.int_value = static_cast<int64_t>(arg.value.pointer_value);
-          break;
-        case Variadic::Type::kBool:
-          row.int_value = arg.value.bool_value;
-          break;
-        case Variadic::Type::kJson:
-          row.string_value = arg.value.json_value;
-          break;
-        case Variadic::Type::kNull:
-          break;
-      }
-      row.value_type = context_->storage->GetIdForVariadicType(arg.value.type);
-      arg_table->Insert(row);
+      set_args.emplace_back(
+          ArgSetStorage::Arg{arg.flat_key, arg.key, arg.value});
     }
+    // The storage hands out ids in order, starting at 1 (0 ==
+    // kInvalidArgSetId), so this is the id inserted in the map above.
+    ArgSetId id = arg_sets->AddArgSet(
+        set_args.data(), static_cast<uint32_t>(set_args.size()));
+    PERFETTO_DCHECK(*it_and_inserted.first == id);
     return id;
   }
 
@@ -175,8 +146,8 @@ class GlobalArgsTracker {
  private:
   using ArgSetHash = uint64_t;
 
-  base::FlatHashMap<ArgSetHash, uint32_t, base::AlreadyHashed<ArgSetHash>>
-      arg_row_for_hash_;
+  base::FlatHashMap<ArgSetHash, ArgSetId, base::AlreadyHashed<ArgSetHash>>
+      arg_set_for_hash_;
 
   TraceProcessorContext* context_;
 };
@@ -161,15 +161,14 @@ TEST(SliceTrackerTest, OneSliceWithArgs) {
   EXPECT_EQ(slices.depth()[0], 0u);
   auto set_id = slices.arg_set_id()[0];
 
-  const auto& args = context.storage->arg_table();
-  EXPECT_EQ(args.arg_set_id()[0], set_id);
-  EXPECT_EQ(args.flat_key()[0].raw_id(), 1u);
-  EXPECT_EQ(args.key()[0].raw_id(), 2u);
-  EXPECT_EQ(args.int_value()[0], 10);
-  EXPECT_EQ(args.arg_set_id()[1], set_id);
-  EXPECT_EQ(args.flat_key()[1].raw_id(), 3u);
-  EXPECT_EQ(args.key()[1].raw_id(), 4u);
-  EXPECT_EQ(args.int_value()[1], 20);
+  auto args = context.storage->arg_sets().Get(set_id);
+  ASSERT_EQ(args.size(), 2u);
+  EXPECT_EQ(args.flat_key(0).raw_id(), 1u);
+  EXPECT_EQ(args.key(0).raw_id(), 2u);
+  EXPECT_EQ(args.value(0).int_value, 10);
+  EXPECT_EQ(args.flat_key(1).raw_id(), 3u);
+  EXPECT_EQ(args.key(1).raw_id(), 4u);
+  EXPECT_EQ(args.value(1).int_value, 20);
 }
 
 TEST(SliceTrackerTest, OneSliceWithArgsWithTranslatedName) {
@@ -210,15 +209,14 @@ TEST(SliceTrackerTest, OneSliceWithArgsWithTranslatedName) {
   EXPECT_EQ(slices.depth()[0], 0u);
   auto set_id = slices.arg_set_id()[0];
 
-  const auto& args = context.storage->arg_table();
-  EXPECT_EQ(args.arg_set_id()[0], set_id);
-  EXPECT_EQ(args.flat_key()[0].raw_id(), 1u);
-  EXPECT_EQ(args.key()[0].raw_id(), 2u);
-  EXPECT_EQ(args.int_value()[0], 10);
-  EXPECT_EQ(args.arg_set_id()[1], set_id);
-  EXPECT_EQ(args.flat_key()[1].raw_id(), 3u);
-  EXPECT_EQ(args.key()[1].raw_id(), 4u);
-  EXPECT_EQ(args.int_value()[1], 20);
+  auto args = context.storage->arg_sets().Get(set_id);
+  ASSERT_EQ(args.size(), 2u);
+  EXPECT_EQ(args.flat_key(0).raw_id(), 1u);
+  EXPECT_EQ(args.key(0).raw_id(), 2u);
+  EXPECT_EQ(args.value(0).int_value, 10);
+  EXPECT_EQ(args.flat_key(1).raw_id(), 3u);
+  EXPECT_EQ(args.key(1).raw_id(), 4u);
+  EXPECT_EQ(args.value(1).int_value, 20);
 }
 
 TEST(SliceTrackerTest, TwoSliceDetailed) {
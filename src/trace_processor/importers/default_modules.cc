@@ -37,6 +37,11 @@ void RegisterDefaultModules(TraceProcessorContext* context) {
   context->modules.emplace_back(new MemoryTrackerSnapshotModule(context));
   context->modules.emplace_back(new ChromeSystemProbesModule(context));
   context->modules.emplace_back(new TrackEventModule(context));
+  // Track events are parsed with their TrackEventData, which the parser fills
+  // in, rather than through ParsePacket(). So we need to store a pointer to it
+  // separately too.
+  context->track_module =
+      static_cast<TrackEventModule*>(context->modules.back().get());
   context->modules.emplace_back(new ProfileModule(context));
   context->modules.emplace_back(new MetadataModule(context));
   context->modules.emplace_back(new AndroidCameraEventModule(context));
@@ -14,58 +14,60 @@
  * limitations under the License.
  */
 
-#include "src/trace_processor/dynamic/thread_state_generator.h"
+#include "src/trace_processor/importers/ftrace/thread_state_tracker.h"
 
-#include <memory>
-#include <set>
+#include <algorithm>
+#include <tuple>
 
 #include "src/trace_processor/types/trace_processor_context.h"
 
 namespace perfetto {
 namespace trace_processor {
 
-ThreadStateGenerator::ThreadStateGenerator(TraceProcessorContext* context)
+ThreadStateTracker::ThreadStateTracker(TraceProcessorContext* context)
     : running_string_id_(context->storage->InternString("Running")),
       runnable_string_id_(context->storage->InternString("R")),
       context_(context) {}
 
-ThreadStateGenerator::~ThreadStateGenerator() = default;
-
-base::Status ThreadStateGenerator::ValidateConstraints(
-    const QueryConstraints&) {
-  return base::OkStatus();
-}
-
-base::Status ThreadStateGenerator::ComputeTable(
-    const std::vector<Constraint>&,
-    const std::vector<Order>&,
-    const BitVector&,
-    std::unique_ptr<Table>& table_return) {
-  if (!unsorted_thread_state_table_) {
-    int64_t trace_end_ts =
-        context_->storage->GetTraceTimestampBoundsNs().second;
-
-    unsorted_thread_state_table_ = ComputeThreadStateTable(trace_end_ts);
-
-    // We explicitly sort by ts here as ComputeThreadStateTable does not insert
-    // rows in sorted order but we expect our clients to always want to sort
-    // on ts. Writing ComputeThreadStateTable to insert in sorted order is
-    // more trouble than its worth.
-    sorted_thread_state_table_ = unsorted_thread_state_table_->Sort(
-        {unsorted_thread_state_table_->ts().ascending()});
+ThreadStateTracker::~ThreadStateTracker() = default;
+
+void ThreadStateTracker::ComputeThreadStates(int64_t trace_end_ts) {
+  PendingRows rows;
+  ComputeUnsortedRows(trace_end_ts, &rows);
+
+  // Rows are not computed in timestamp order (e.g. the descheduled period of
+  // a thread is only added when it is next scheduled) so sort them before
+  // inserting them into the storage: this way the ts column of the
+  // thread_state table is sorted and filters on it are binary searches.
+  // Rows with the same timestamp are kept in the order they were computed.
+  std::sort(rows.begin(), rows.end(),
+            [](const PendingRow& a, const PendingRow& b) {
+              return std::tie(a.ts, a.seq) < std::tie(b.ts, b.seq);
+            });
+
+  // Pop the rows while inserting them so that the memory of the pending rows
+  // is released as the table grows rather than holding both at the end.
+  auto* table = context_->storage->mutable_thread_state_table();
+  while (!rows.empty()) {
+    const PendingRow& row = rows.front();
+    tables::ThreadStateTable::Row r;
+    r.ts = row.ts;
+    r.dur = row.dur;
+    if (row.has_cpu)
+      r.cpu = row.cpu;
+    r.utid = row.utid;
+    r.state = row.state;
+    if (row.has_io_wait)
+      r.io_wait = row.io_wait;
+    if (row.has_blocked_function)
+      r.blocked_function = row.blocked_function;
+    table->Insert(r);
+    rows.pop_front();
   }
-  // TODO(rsavitski): return base::ErrStatus instead?
-  PERFETTO_CHECK(sorted_thread_state_table_);
-  table_return =
-      std::unique_ptr<Table>(new Table(sorted_thread_state_table_->Copy()));
-  return base::OkStatus();
 }
 
-std::unique_ptr<tables::ThreadStateTable>
-ThreadStateGenerator::ComputeThreadStateTable(int64_t trace_end_ts) {
-  std::unique_ptr<tables::ThreadStateTable> table(new tables::ThreadStateTable(
-      context_->storage->mutable_string_pool(), nullptr));
-
+void ThreadStateTracker::ComputeUnsortedRows(int64_t trace_end_ts,
+                                             PendingRows* rows) {
   const auto& raw_sched = context_->storage->sched_slice_table();
   const auto& instants = context_->storage->instant_table();
 
@@ -113,7 +115,7 @@ ThreadStateGenerator::ComputeThreadStateTable(int64_t trace_end_ts) {
     // to process that event.
     int64_t min_ts = std::min({sched_ts, waking_ts, blocked_ts});
     if (min_ts == sched_ts) {
-      AddSchedEvent(sched, sched_idx++, state_map, trace_end_ts, table.get());
+      AddSchedEvent(sched, sched_idx++, state_map, trace_end_ts, rows);
     } else if (min_ts == waking_ts) {
       AddWakingEvent(waking, waking_idx++, state_map);
     } else /* (min_ts == blocked_ts) */ {
@@ -126,17 +128,15 @@ ThreadStateGenerator::ComputeThreadStateTable(int64_t trace_end_ts) {
     // for (const auto& utid_to_pending_info : state_map) {
     UniqueTid utid = it.key();
     const ThreadSchedInfo& pending_info = it.value();
-    FlushPendingEventsForThread(utid, pending_info, table.get(), base::nullopt);
+    FlushPendingEventsForThread(utid, pending_info, rows, base::nullopt);
   }
-
-  return table;
 }
 
-void ThreadStateGenerator::AddSchedEvent(const Table& sched,
-                                         uint32_t sched_idx,
-                                         TidInfoMap& state_map,
-                                         int64_t trace_end_ts,
-                                         tables::ThreadStateTable* table) {
+void ThreadStateTracker::AddSchedEvent(const Table& sched,
+                                       uint32_t sched_idx,
+                                       TidInfoMap& state_map,
+                                       int64_t trace_end_ts,
+                                       PendingRows* rows) {
   int64_t ts = sched.GetTypedColumnByName<int64_t>("ts")[sched_idx];
   UniqueTid utid = sched.GetTypedColumnByName<uint32_t>("utid")[sched_idx];
   ThreadSchedInfo* info = &state_map[utid];
@@ -153,19 +153,19 @@ void ThreadStateGenerator::AddSchedEvent(const Table& sched,
   //
   // See b/186509316 for details and an example on when this happens.
   if (info->desched_ts && info->desched_ts.value() > ts) {
-    uint32_t prev_sched_row = info->scheduled_row.value();
-    int64_t prev_sched_start = table->ts()[prev_sched_row];
+    PendingRow& prev_sched_row = (*rows)[info->scheduled_row.value()];
+    int64_t prev_sched_start = prev_sched_row.ts;
 
     // Just a double check that descheduling slice would have started at the
     // same time the scheduling slice would have ended.
-    PERFETTO_DCHECK(prev_sched_start + table->dur()[prev_sched_row] ==
+    PERFETTO_DCHECK(prev_sched_start + prev_sched_row.dur ==
                     info->desched_ts.value());
 
     // Truncate the duration of the old slice to end at the start of this
     // scheduling slice.
-    table->mutable_dur()->Set(prev_sched_row, ts - prev_sched_start);
+    prev_sched_row.dur = ts - prev_sched_start;
   } else {
-    FlushPendingEventsForThread(utid, *info, table, ts);
+    FlushPendingEventsForThread(utid, *info, rows, ts);
   }
 
   // Reset so we don't have any leftover data on the next round.
@@ -183,14 +183,15 @@ void ThreadStateGenerator::AddSchedEvent(const Table& sched,
 
   // Now add the sched slice itself as "Running" with the other fields
   // unchanged.
-  tables::ThreadStateTable::Row sched_row;
+  PendingRow sched_row{};
   sched_row.ts = ts;
   sched_row.dur = dur;
+  sched_row.seq = static_cast<uint32_t>(rows->size());
   sched_row.cpu = sched.GetTypedColumnByName<uint32_t>("cpu")[sched_idx];
+  sched_row.has_cpu = true;
   sched_row.state = running_string_id_;
   sched_row.utid = utid;
-
-  auto id_and_row = table->Insert(sched_row);
+  rows->push_back(sched_row);
 
   // If the sched row had a negative duration, don't add any descheduled slice
   // because it would be meaningless.
@@ -203,12 +204,12 @@ void ThreadStateGenerator::AddSchedEvent(const Table& sched,
   info->desched_ts = ts + dur;
   info->desched_end_state =
       sched.GetTypedColumnByName<StringId>("end_state")[sched_idx];
-  info->scheduled_row = id_and_row.row;
+  info->scheduled_row = sched_row.seq;
 }
 
-void ThreadStateGenerator::AddWakingEvent(const Table& waking,
-                                          uint32_t waking_idx,
-                                          TidInfoMap& state_map) {
+void ThreadStateTracker::AddWakingEvent(const Table& waking,
+                                        uint32_t waking_idx,
+                                        TidInfoMap& state_map) {
   int64_t ts = waking.GetTypedColumnByName<int64_t>("ts")[waking_idx];
   UniqueTid utid = static_cast<UniqueTid>(
       waking.GetTypedColumnByName<int64_t>("ref")[waking_idx]);
@@ -248,27 +249,10 @@ void ThreadStateGenerator::AddWakingEvent(const Table& waking,
   info->runnable_ts = ts;
 }
 
-Table::Schema ThreadStateGenerator::CreateSchema() {
-  auto schema = tables::ThreadStateTable::Schema();
-
-  // Because we expect our users to generally want ordered by ts, we set the
-  // ordering for the schema to match our forced sort pass in ComputeTable.
-  auto ts_it = std::find_if(
-      schema.columns.begin(), schema.columns.end(),
-      [](const Table::Schema::Column& col) { return col.name == "ts"; });
-  ts_it->is_sorted = true;
-  auto id_it = std::find_if(
-      schema.columns.begin(), schema.columns.end(),
-      [](const Table::Schema::Column& col) { return col.name == "id"; });
-  id_it->is_sorted = false;
-
-  return schema;
-}
-
-void ThreadStateGenerator::FlushPendingEventsForThread(
+void ThreadStateTracker::FlushPendingEventsForThread(
     UniqueTid utid,
     const ThreadSchedInfo& info,
-    tables::ThreadStateTable* table,
+    PendingRows* rows,
     base::Optional<int64_t> end_ts) {
   // First, let's flush the descheduled period (if any) to the table.
   if (info.desched_ts) {
@@ -282,30 +266,34 @@ void ThreadStateGenerator::FlushPendingEventsForThread(
       dur = -1;
     }
 
-    tables::ThreadStateTable::Row row;
+    PendingRow row{};
     row.ts = *info.desched_ts;
     row.dur = dur;
+    row.seq = static_cast<uint32_t>(rows->size());
     row.state = *info.desched_end_state;
     row.utid = utid;
-    row.io_wait = info.io_wait;
-    row.blocked_function = info.blocked_function;
-    table->Insert(row);
+    row.has_io_wait = info.io_wait.has_value();
+    row.io_wait = info.io_wait.value_or(false);
+    row.has_blocked_function = info.blocked_function.has_value();
+    row.blocked_function = info.blocked_function.value_or(StringId::Null());
+    rows->push_back(row);
   }
 
   // Next, flush the runnable period (if any) to the table.
   if (info.runnable_ts) {
-    tables::ThreadStateTable::Row row;
+    PendingRow row{};
     row.ts = *info.runnable_ts;
     row.dur = end_ts ? *end_ts - row.ts : -1;
+    row.seq = static_cast<uint32_t>(rows->size());
     row.state = runnable_string_id_;
     row.utid = utid;
-    table->Insert(row);
+    rows->push_back(row);
   }
 }
 
-void ThreadStateGenerator::AddBlockedReasonEvent(const Table& blocked_reason,
-                                                 uint32_t blocked_idx,
-                                                 TidInfoMap& state_map) {
+void ThreadStateTracker::AddBlockedReasonEvent(const Table& blocked_reason,
+                                               uint32_t blocked_idx,
+                                               TidInfoMap& state_map) {
   const auto& utid_col = blocked_reason.GetTypedColumnByName<int64_t>("ref");
   const auto& arg_set_id_col =
       blocked_reason.GetTypedColumnByName<uint32_t>("arg_set_id");
@@ -332,13 +320,5 @@ void ThreadStateGenerator::AddBlockedReasonEvent(const Table& blocked_reason,
   }
 }
 
-std::string ThreadStateGenerator::TableName() {
-  return "thread_state";
-}
-
-uint32_t ThreadStateGenerator::EstimateRowCount() {
-  return context_->storage->sched_slice_table().row_count();
-}
-
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_THREAD_STATE_TRACKER_H_
+#define SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_THREAD_STATE_TRACKER_H_
+
+#include <deque>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceProcessorContext;
+
+// Computes the thread_state table from the sched slices and the
+// sched_waking/sched_wakeup and sched_blocked_reason instants.
+// This table is a basically the same as sched with extra information added
+// about wakeups and the periods where threads are descheduled.
+//
+// The table is computed once all the trace data has been parsed: the state
+// of a descheduled thread is only known when the thread is next scheduled
+// (or woken) so rows cannot be emitted while the events are being parsed.
+class ThreadStateTracker {
+ public:
+  explicit ThreadStateTracker(TraceProcessorContext* context);
+  ~ThreadStateTracker();
+
+  // Computes the thread states and inserts them, in timestamp order, into the
+  // thread_state table of the storage. |trace_end_ts| is the end of the trace
+  // (i.e. where the last sched slice of each CPU was expanded to). Should only
+  // be called once all the sched events have been flushed to the storage (see
+  // SchedEventTracker::FlushPendingEvents).
+  //
+  // Only reads the other tables in the storage (and does not intern any
+  // string) so can be called on a different thread than the one executing
+  // queries as long as the thread_state table is not accessed concurrently.
+  void ComputeThreadStates(int64_t trace_end_ts);
+
+ private:
+  // A thread_state row which has been computed but not yet inserted into the
+  // storage. Kept much smaller than a table row (which has nullable columns
+  // and an id) as all the rows are buffered until they can be sorted.
+  struct PendingRow {
+    int64_t ts;
+    int64_t dur;
+    // Index of the row in the order the rows were computed: used to keep the
+    // order of rows with the same timestamp when sorting.
+    uint32_t seq;
+    UniqueTid utid;
+    StringId state;
+    StringId blocked_function;
+    uint32_t cpu;
+    bool has_cpu;
+    bool has_blocked_function;
+    bool has_io_wait;
+    bool io_wait;
+  };
+  using PendingRows = std::deque<PendingRow>;
+
+  // Computes the thread states into |rows|. The rows are *not* computed in
+  // timestamp order.
+  void ComputeUnsortedRows(int64_t trace_end_ts, PendingRows* rows);
+
+  struct ThreadSchedInfo {
+    base::Optional<int64_t> desched_ts;
+    base::Optional<StringId> desched_end_state;
+    base::Optional<uint32_t> scheduled_row;
+    base::Optional<bool> io_wait;
+    base::Optional<int64_t> runnable_ts;
+    base::Optional<StringId> blocked_function;
+  };
+  using TidInfoMap = base::FlatHashMap<UniqueTid,
+                                       ThreadSchedInfo,
+                                       base::AlreadyHashed<UniqueTid>,
+                                       base::QuadraticProbe,
+                                       /*AppendOnly=*/true>;
+
+  void AddSchedEvent(const Table& sched,
+                     uint32_t sched_idx,
+                     TidInfoMap& state_map,
+                     int64_t trace_end_ts,
+                     PendingRows* rows);
+
+  void AddWakingEvent(const Table& wakeup,
+                      uint32_t wakeup_idx,
+                      TidInfoMap& state_map);
+
+  void AddBlockedReasonEvent(const Table& blocked_reason,
+                             uint32_t blocked_idx,
+                             TidInfoMap& state_map);
+
+  void FlushPendingEventsForThread(UniqueTid utid,
+                                   const ThreadSchedInfo&,
+                                   PendingRows* rows,
+                                   base::Optional<int64_t> end_ts);
+
+  const StringId running_string_id_;
+  const StringId runnable_string_id_;
+
+  TraceProcessorContext* context_ = nullptr;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_THREAD_STATE_TRACKER_H_
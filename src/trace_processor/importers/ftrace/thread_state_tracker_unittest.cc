@@ -14,7 +14,7 @@
  * limitations under the License.
  */
 
-#include "src/trace_processor/dynamic/thread_state_generator.h"
+#include "src/trace_processor/importers/ftrace/thread_state_tracker.h"
 
 #include <algorithm>
 
@@ -27,17 +27,17 @@ namespace perfetto {
 namespace trace_processor {
 namespace {
 
-class ThreadStateGeneratorUnittest : public testing::Test {
+class ThreadStateTrackerUnittest : public testing::Test {
  public:
   struct Ts {
     int64_t ts;
   };
 
-  ThreadStateGeneratorUnittest() : idle_thread_(0), thread_a_(1), thread_b_(2) {
+  ThreadStateTrackerUnittest() : idle_thread_(0), thread_a_(1), thread_b_(2) {
     context_.storage.reset(new TraceStorage());
     context_.global_args_tracker.reset(new GlobalArgsTracker(&context_));
     context_.args_tracker.reset(new ArgsTracker(&context_));
-    thread_state_generator_.reset(new ThreadStateGenerator(&context_));
+    thread_state_tracker_.reset(new ThreadStateTracker(&context_));
   }
 
   void ForwardSchedTo(Ts ts) { sched_insert_ts_ = ts.ts; }
@@ -91,10 +91,8 @@ class ThreadStateGeneratorUnittest : public testing::Test {
 
   void RunThreadStateComputation(Ts trace_end_ts = Ts{
                                      std::numeric_limits<int64_t>::max()}) {
-    unsorted_table_ =
-        thread_state_generator_->ComputeThreadStateTable(trace_end_ts.ts);
-    table_.reset(
-        new Table(unsorted_table_->Sort({unsorted_table_->ts().ascending()})));
+    thread_state_tracker_->ComputeThreadStates(trace_end_ts.ts);
+    table_ = &context_.storage->thread_state_table();
   }
 
   void VerifyThreadState(Ts from,
@@ -148,14 +146,13 @@ class ThreadStateGeneratorUnittest : public testing::Test {
 
   uint32_t thread_state_verify_row_ = 0;
 
-  std::unique_ptr<ThreadStateGenerator> thread_state_generator_;
-  std::unique_ptr<tables::ThreadStateTable> unsorted_table_;
-  std::unique_ptr<Table> table_;
+  std::unique_ptr<ThreadStateTracker> thread_state_tracker_;
+  const tables::ThreadStateTable* table_ = nullptr;
 };
 
-constexpr char ThreadStateGeneratorUnittest::kRunning[];
+constexpr char ThreadStateTrackerUnittest::kRunning[];
 
-TEST_F(ThreadStateGeneratorUnittest, MultipleThreadWithOnlySched) {
+TEST_F(ThreadStateTrackerUnittest, MultipleThreadWithOnlySched) {
   ForwardSchedTo(Ts{0});
   AddSched(Ts{10}, thread_a_, "S");
   AddSched(Ts{15}, thread_b_, "D");
@@ -173,7 +170,7 @@ TEST_F(ThreadStateGeneratorUnittest, MultipleThreadWithOnlySched) {
   VerifyEndOfThreadState();
 }
 
-TEST_F(ThreadStateGeneratorUnittest, WakingFirst) {
+TEST_F(ThreadStateTrackerUnittest, WakingFirst) {
   AddWaking(Ts{10}, thread_a_);
 
   ForwardSchedTo(Ts{20});
@@ -188,7 +185,7 @@ TEST_F(ThreadStateGeneratorUnittest, WakingFirst) {
   VerifyEndOfThreadState();
 }
 
-TEST_F(ThreadStateGeneratorUnittest, SchedWithWaking) {
+TEST_F(ThreadStateTrackerUnittest, SchedWithWaking) {
   ForwardSchedTo(Ts{0});
   AddSched(Ts{10}, thread_a_, "S");
 
@@ -208,7 +205,7 @@ TEST_F(ThreadStateGeneratorUnittest, SchedWithWaking) {
   VerifyEndOfThreadState();
 }
 
-TEST_F(ThreadStateGeneratorUnittest, SchedWithWakeup) {
+TEST_F(ThreadStateTrackerUnittest, SchedWithWakeup) {
   ForwardSchedTo(Ts{0});
   AddSched(Ts{10}, thread_a_, "S");
 
@@ -228,7 +225,7 @@ TEST_F(ThreadStateGeneratorUnittest, SchedWithWakeup) {
   VerifyEndOfThreadState();
 }
 
-TEST_F(ThreadStateGeneratorUnittest, SchedIdleIgnored) {
+TEST_F(ThreadStateTrackerUnittest, SchedIdleIgnored) {
   ForwardSchedTo(Ts{0});
   AddSched(Ts{10}, idle_thread_, "R");
   AddSched(Ts{15}, thread_a_, "R");
@@ -241,7 +238,7 @@ TEST_F(ThreadStateGeneratorUnittest, SchedIdleIgnored) {
   VerifyEndOfThreadState();
 }
 
-TEST_F(ThreadStateGeneratorUnittest, NegativeSchedDuration) {
+TEST_F(ThreadStateTrackerUnittest, NegativeSchedDuration) {
   ForwardSchedTo(Ts{0});
 
   AddSched(Ts{10}, thread_a_, "S");
@@ -261,7 +258,7 @@ TEST_F(ThreadStateGeneratorUnittest, NegativeSchedDuration) {
   VerifyEndOfThreadState();
 }
 
-TEST_F(ThreadStateGeneratorUnittest, WakingOnRunningThreadAtEnd) {
+TEST_F(ThreadStateTrackerUnittest, WakingOnRunningThreadAtEnd) {
   AddWaking(Ts{5}, thread_a_);
 
   ForwardSchedTo(Ts{10});
@@ -278,7 +275,7 @@ TEST_F(ThreadStateGeneratorUnittest, WakingOnRunningThreadAtEnd) {
   VerifyEndOfThreadState();
 }
 
-TEST_F(ThreadStateGeneratorUnittest, SchedDataLoss) {
+TEST_F(ThreadStateTrackerUnittest, SchedDataLoss) {
   ForwardSchedTo(Ts{10});
   AddSched(base::nullopt, thread_a_, "");
   ForwardSchedTo(Ts{30});
@@ -293,7 +290,7 @@ TEST_F(ThreadStateGeneratorUnittest, SchedDataLoss) {
   VerifyEndOfThreadState();
 }
 
-TEST_F(ThreadStateGeneratorUnittest, StrechedSchedIgnored) {
+TEST_F(ThreadStateTrackerUnittest, StrechedSchedIgnored) {
   ForwardSchedTo(Ts{10});
   AddSched(Ts{100}, thread_a_, "");
 
@@ -304,7 +301,7 @@ TEST_F(ThreadStateGeneratorUnittest, StrechedSchedIgnored) {
   VerifyEndOfThreadState();
 }
 
-TEST_F(ThreadStateGeneratorUnittest, WakingAfterStrechedSched) {
+TEST_F(ThreadStateTrackerUnittest, WakingAfterStrechedSched) {
   ForwardSchedTo(Ts{10});
   AddSched(Ts{100}, thread_a_, "");
 
@@ -318,7 +315,7 @@ TEST_F(ThreadStateGeneratorUnittest, WakingAfterStrechedSched) {
   VerifyEndOfThreadState();
 }
 
-TEST_F(ThreadStateGeneratorUnittest, BlockedReason) {
+TEST_F(ThreadStateTrackerUnittest, BlockedReason) {
   ForwardSchedTo(Ts{10});
   AddSched(Ts{12}, thread_a_, "D");
   AddWaking(Ts{15}, thread_a_);
@@ -16,16 +16,32 @@
 
 #include "src/trace_processor/importers/gzip/gzip_trace_parser.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
 #include <string>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/trace_processor/trace_blob_view.h"
 #include "src/trace_processor/forwarding_trace_parser.h"
+#include "src/trace_processor/storage/stats.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+#include "src/trace_processor/util/bounded_queue.h"
 #include "src/trace_processor/util/gzip_utils.h"
 #include "src/trace_processor/util/status_macros.h"
 
+// WASM builds are single threaded: chunks are always decompressed on the
+// calling thread.
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+#include <thread>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 
@@ -33,85 +49,310 @@ namespace {
 
 using ResultCode = util::GzipDecompressor::ResultCode;
 
+// Our default uncompressed buffer size is 32MB as it allows for good
+// throughput.
+constexpr size_t kUncompressedBufferSize = 32 * 1024 * 1024;
+
+// Max number of compressed chunks handed to the decompression thread and not
+// fully decompressed yet. Together with the size of the output queue, this
+// bounds how far decompression can get ahead of parsing.
+constexpr size_t kMaxInputChunksInFlight = 4;
+constexpr size_t kMaxOutputBlobsInFlight = 2;
+
+// The first bytes of each gzip member.
+constexpr uint8_t kGzipMagic[] = {0x1f, 0x8b};
+
+bool IsPipelineEnabled() {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  return false;
+#else
+  // Shares the kill switch of the reader thread in ReadTrace().
+  const char* no_pipeline = getenv("TRACE_PROCESSOR_NO_PIPELINE");
+  return !no_pipeline || *no_pipeline != '1';
+#endif
+}
+
 }  // namespace
 
+// The queues between the calling thread and the decompression thread.
+struct GzipTraceParser::Pipeline {
+  struct Output {
+    // A decompressed blob, possibly empty.
+    TraceBlobView blob;
+
+    // Set on the last output of each compressed chunk, which is handed back
+    // in |input|: the refcount of TraceBlobView is not thread safe, so views
+    // must be released on the thread which created them.
+    bool consumed_input = false;
+    TraceBlobView input;
+
+    util::Status status;
+  };
+
+  Pipeline()
+      : input(kMaxInputChunksInFlight), output(kMaxOutputBlobsInFlight) {}
+
+  util::BoundedQueue<TraceBlobView> input;
+  util::BoundedQueue<Output> output;
+
+  // Only accessed on the calling thread.
+  size_t chunks_in_flight = 0;
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  std::thread thread;
+#endif
+};
+
 GzipTraceParser::GzipTraceParser(TraceProcessorContext* context)
     : context_(context) {}
 
-GzipTraceParser::GzipTraceParser(std::unique_ptr<ChunkedTraceReader> reader)
-    : context_(nullptr), inner_(std::move(reader)) {}
+GzipTraceParser::GzipTraceParser(std::unique_ptr<ChunkedTraceReader> reader,
+                                 TraceProcessorContext* context)
+    : context_(context), inner_(std::move(reader)) {}
 
-GzipTraceParser::~GzipTraceParser() = default;
+GzipTraceParser::~GzipTraceParser() {
+  StopPipeline();
+}
 
 util::Status GzipTraceParser::Parse(TraceBlobView blob) {
-  return ParseUnowned(blob.data(), blob.size());
+  const uint8_t* data = blob.data();
+  size_t size = blob.size();
+  const bool is_first_chunk = !first_chunk_parsed_;
+  MaybeSkipHeader(&data, &size);
+
+  if (is_first_chunk && IsPipelineEnabled()) {
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+    pipeline_.reset(new Pipeline());
+    pipeline_->thread = std::thread(&GzipTraceParser::RunPipeline, this);
+#endif
+  }
+  if (!pipeline_)
+    return ParseUnowned(data, size);
+
+  if (size > 0) {
+    // Never blocks: ParsePipelineOutput() below keeps the number of chunks in
+    // flight under the capacity of the input queue.
+    pipeline_->input.Push(blob.slice(data, size));
+    pipeline_->chunks_in_flight++;
+  }
+  util::Status status = ParsePipelineOutput(/*wait_for_eof=*/false);
+  if (!status.ok())
+    StopPipeline();
+  return status;
 }
 
 util::Status GzipTraceParser::ParseUnowned(const uint8_t* data, size_t size) {
   const uint8_t* start = data;
   size_t len = size;
+  MaybeSkipHeader(&start, &len);
 
   if (!inner_) {
     PERFETTO_CHECK(context_);
     inner_.reset(new ForwardingTraceParser(context_));
   }
+  return Decompress(start, len, [this](TraceBlobView decompressed) {
+    return inner_->Parse(std::move(decompressed));
+  });
+}
 
-  if (!first_chunk_parsed_) {
-    // .ctrace files begin with: "TRACE:\n" or "done. TRACE:\n" strip this if
-    // present.
-    base::StringView beginning(reinterpret_cast<const char*>(start), size);
+void GzipTraceParser::MaybeSkipHeader(const uint8_t** data, size_t* size) {
+  if (first_chunk_parsed_)
+    return;
+  first_chunk_parsed_ = true;
 
-    static const char* kSystraceFileHeader = "TRACE:\n";
-    size_t offset = Find(kSystraceFileHeader, beginning);
-    if (offset != std::string::npos) {
-      start += strlen(kSystraceFileHeader) + offset;
-      len -= strlen(kSystraceFileHeader) + offset;
-    }
-    first_chunk_parsed_ = true;
-  }
+  // .ctrace files begin with: "TRACE:\n" or "done. TRACE:\n" strip this if
+  // present.
+  base::StringView beginning(reinterpret_cast<const char*>(*data), *size);
 
-  // Our default uncompressed buffer size is 32MB as it allows for good
-  // throughput.
-  constexpr size_t kUncompressedBufferSize = 32 * 1024 * 1024;
+  static const char* kSystraceFileHeader = "TRACE:\n";
+  size_t offset = Find(kSystraceFileHeader, beginning);
+  if (offset != std::string::npos) {
+    *data += strlen(kSystraceFileHeader) + offset;
+    *size -= strlen(kSystraceFileHeader) + offset;
+  }
+}
 
+util::Status GzipTraceParser::Decompress(const uint8_t* data,
+                                         size_t size,
+                                         const OutputFn& output_fn) {
   needs_more_input_ = false;
-  decompressor_.Feed(start, len);
+  if (trailing_garbage_)
+    return util::OkStatus();
 
-  for (auto ret = ResultCode::kOk; ret != ResultCode::kEof;) {
+  RecordMemberHeader(data, size);
+  decompressor_.Feed(data, size);
+  for (;;) {
     if (!buffer_) {
       buffer_.reset(new uint8_t[kUncompressedBufferSize]);
       bytes_written_ = 0;
     }
 
+    if (decompressor_.AvailIn() > 0)
+      in_member_ = true;
+    base::TimeNanos start_ns = base::GetWallTimeNs();
     auto result =
         decompressor_.ExtractOutput(buffer_.get() + bytes_written_,
                                     kUncompressedBufferSize - bytes_written_);
-    ret = result.ret;
-    if (ret == ResultCode::kError)
+    decompression_duration_ns_ += (base::GetWallTimeNs() - start_ns).count();
+
+    if (result.ret == ResultCode::kError) {
+      // Like gzip(1), ignore data following a complete gzip member if it is
+      // not another gzip member (e.g. zero padding). A member which starts
+      // with the gzip magic is corrupt instead, so it's an error.
+      bool is_member =
+          member_header_size_ == sizeof(kGzipMagic) &&
+          memcmp(member_header_, kGzipMagic, sizeof(kGzipMagic)) == 0;
+      if (has_complete_member_ && !member_has_output_ && !is_member) {
+        PERFETTO_ELOG("Ignoring trailing garbage after the gzip trace");
+        trailing_garbage_ = true;
+        in_member_ = false;
+        return FlushBuffer(output_fn);
+      }
       return util::ErrStatus("Failed to decompress trace chunk");
+    }
 
-    if (ret == ResultCode::kNeedsMoreInput) {
+    if (result.ret == ResultCode::kNeedsMoreInput) {
       PERFETTO_DCHECK(result.bytes_written == 0);
-      needs_more_input_ = true;
+      needs_more_input_ = in_member_;
       return util::OkStatus();
     }
     bytes_written_ += result.bytes_written;
+    member_has_output_ |= result.bytes_written > 0;
 
-    if (bytes_written_ == kUncompressedBufferSize || ret == ResultCode::kEof) {
-      TraceBlob blob =
-          TraceBlob::TakeOwnership(std::move(buffer_), bytes_written_);
-      RETURN_IF_ERROR(inner_->Parse(TraceBlobView(std::move(blob))));
+    bool end_of_input = false;
+    if (result.ret == ResultCode::kEof) {
+      // The end of a gzip member. There might be more of them: multi-member
+      // files are equivalent to the concatenation of their members.
+      decompressor_.Reset();
+      has_complete_member_ = true;
+      member_has_output_ = false;
+      in_member_ = false;
+      end_of_input = decompressor_.AvailIn() == 0;
+      member_header_size_ = 0;
+      RecordMemberHeader(data + size - decompressor_.AvailIn(),
+                         decompressor_.AvailIn());
     }
+
+    if (bytes_written_ == kUncompressedBufferSize || end_of_input)
+      RETURN_IF_ERROR(FlushBuffer(output_fn));
   }
-  return util::OkStatus();
+}
+
+void GzipTraceParser::RecordMemberHeader(const uint8_t* data, size_t size) {
+  size_t len = std::min(sizeof(member_header_) - member_header_size_, size);
+  memcpy(member_header_ + member_header_size_, data, len);
+  member_header_size_ += len;
+}
+
+util::Status GzipTraceParser::FlushBuffer(const OutputFn& output_fn) {
+  if (bytes_written_ == 0)
+    return util::OkStatus();
+
+  // Don't pin a whole buffer for a small blob (e.g. the tail of a member).
+  TraceBlob blob =
+      bytes_written_ < kUncompressedBufferSize / 4
+          ? TraceBlob::CopyFrom(buffer_.get(), bytes_written_)
+          : TraceBlob::TakeOwnership(std::move(buffer_), bytes_written_);
+  bytes_written_ = 0;
+  return output_fn(TraceBlobView(std::move(blob)));
+}
+
+void GzipTraceParser::RunPipeline() {
+  auto output_fn = [this](TraceBlobView decompressed) {
+    Pipeline::Output output;
+    output.blob = std::move(decompressed);
+    if (!pipeline_->output.Push(std::move(output)))
+      return util::ErrStatus("Gzip trace parsing was stopped");
+    return util::OkStatus();
+  };
+
+  util::Status status;
+  for (;;) {
+    TraceBlobView chunk;
+    if (!pipeline_->input.Pop(&chunk)) {
+      // End of file: hand over the tail of a truncated trace.
+      status = FlushBuffer(output_fn);
+      break;
+    }
+    status = Decompress(chunk.data(), chunk.size(), output_fn);
+
+    Pipeline::Output output;
+    output.consumed_input = true;
+    output.input = std::move(chunk);
+    output.status = status;
+    if (!pipeline_->output.Push(std::move(output)) || !status.ok())
+      break;
+  }
+
+  // Signals the end of the output to the calling thread and, in case of
+  // errors, makes any further Parse() fail.
+  pipeline_->input.Close();
+  pipeline_->output.Close();
+}
+
+util::Status GzipTraceParser::ParsePipelineOutput(bool wait_for_eof) {
+  if (!inner_) {
+    PERFETTO_CHECK(context_);
+    inner_.reset(new ForwardingTraceParser(context_));
+  }
+  for (;;) {
+    // Wait for the decompression thread if it's too far behind: this is what
+    // keeps the number of chunks in flight bounded.
+    bool wait = wait_for_eof ||
+                pipeline_->chunks_in_flight >= kMaxInputChunksInFlight;
+    Pipeline::Output output;
+    if (wait ? !pipeline_->output.Pop(&output)
+             : !pipeline_->output.TryPop(&output)) {
+      return util::OkStatus();
+    }
+    if (output.consumed_input)
+      pipeline_->chunks_in_flight--;
+    RETURN_IF_ERROR(output.status);
+    if (output.blob.size() > 0)
+      RETURN_IF_ERROR(inner_->Parse(std::move(output.blob)));
+  }
+}
+
+void GzipTraceParser::StopPipeline() {
+  if (!pipeline_)
+    return;
+  pipeline_->input.Close();
+  pipeline_->output.Close();
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  pipeline_->thread.join();
+#endif
+  pipeline_.reset();
 }
 
 void GzipTraceParser::NotifyEndOfFile() {
-  // TODO(lalitm): this should really be an error returned to the caller but
-  // due to historical implementation, NotifyEndOfFile does not return a
-  // util::Status.
+  if (pipeline_) {
+    pipeline_->input.Close();
+    util::Status status = ParsePipelineOutput(/*wait_for_eof=*/true);
+    StopPipeline();
+    // TODO(lalitm): this should really be an error returned to the caller but
+    // due to historical implementation, NotifyEndOfFile does not return a
+    // util::Status.
+    if (!status.ok()) {
+      PERFETTO_ELOG("Failed parsing the end of the gzip trace: %s",
+                    status.c_message());
+      if (context_)
+        context_->storage->IncrementStats(stats::gzip_trace_eof_error);
+    }
+  } else if (inner_) {
+    util::Status status = FlushBuffer([this](TraceBlobView decompressed) {
+      return inner_->Parse(std::move(decompressed));
+    });
+    if (!status.ok()) {
+      PERFETTO_ELOG("Failed parsing the end of the gzip trace: %s",
+                    status.c_message());
+    }
+  }
   PERFETTO_DCHECK(!needs_more_input_);
-  PERFETTO_DCHECK(!buffer_);
+
+  if (context_) {
+    context_->storage->SetStats(stats::gzip_decompression_duration_ns,
+                                decompression_duration_ns_);
+  }
 }
 
 }  // namespace trace_processor
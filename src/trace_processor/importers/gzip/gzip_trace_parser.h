@@ -17,6 +17,12 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_GZIP_GZIP_TRACE_PARSER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_GZIP_GZIP_TRACE_PARSER_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+
 #include "src/trace_processor/importers/common/chunked_trace_reader.h"
 #include "src/trace_processor/util/gzip_utils.h"
 
@@ -25,10 +31,18 @@ namespace trace_processor {
 
 class TraceProcessorContext;
 
+// Decompresses gzip traces (including multi-member files, e.g. the result of
+// concatenating several .gz files) and forwards the output to a nested reader.
+//
+// Chunks passed to Parse() are decompressed on a separate thread, pipelined
+// with the parsing of the previous output on the calling thread. Chunks passed
+// to ParseUnowned() are decompressed synchronously.
 class GzipTraceParser : public ChunkedTraceReader {
  public:
   explicit GzipTraceParser(TraceProcessorContext*);
-  explicit GzipTraceParser(std::unique_ptr<ChunkedTraceReader>);
+  // |context|, if not null, is only used to record stats.
+  explicit GzipTraceParser(std::unique_ptr<ChunkedTraceReader>,
+                           TraceProcessorContext* context = nullptr);
   ~GzipTraceParser() override;
 
   // ChunkedTraceReader implementation
@@ -40,15 +54,57 @@ class GzipTraceParser : public ChunkedTraceReader {
   bool needs_more_input() const { return needs_more_input_; }
 
  private:
+  struct Pipeline;
+  using OutputFn = std::function<util::Status(TraceBlobView)>;
+
+  // Strips the "TRACE:\n" header of .ctrace files from the first chunk.
+  void MaybeSkipHeader(const uint8_t** data, size_t* size);
+
+  // Decompresses |data|, passing the output to |output_fn| in blobs of up to
+  // kUncompressedBufferSize bytes.
+  util::Status Decompress(const uint8_t* data,
+                          size_t size,
+                          const OutputFn& output_fn);
+
+  // Appends the beginning of |data| to |member_header_|, up to its size.
+  void RecordMemberHeader(const uint8_t* data, size_t size);
+
+  // Passes the partially filled |buffer_|, if any, to |output_fn|.
+  util::Status FlushBuffer(const OutputFn& output_fn);
+
+  // Body of the decompression thread.
+  void RunPipeline();
+
+  // Passes the blobs decompressed so far by the decompression thread to
+  // |inner_|. If |wait_for_eof| is true, blocks until the decompression thread
+  // is done.
+  util::Status ParsePipelineOutput(bool wait_for_eof);
+
+  void StopPipeline();
+
   TraceProcessorContext* const context_;
   util::GzipDecompressor decompressor_;
   std::unique_ptr<ChunkedTraceReader> inner_;
 
+  // Used by the decompression thread, if any, while the pipeline is running.
   std::unique_ptr<uint8_t[]> buffer_;
   size_t bytes_written_ = 0;
+  bool needs_more_input_ = false;
+  int64_t decompression_duration_ns_ = 0;
+
+  // The state of the multi-member parsing, see Decompress().
+  bool in_member_ = false;
+  bool member_has_output_ = false;
+  bool has_complete_member_ = false;
+  bool trailing_garbage_ = false;
+
+  // The first bytes of the current member, used to tell a corrupt member from
+  // trailing garbage.
+  uint8_t member_header_[2] = {};
+  size_t member_header_size_ = 0;
 
   bool first_chunk_parsed_ = false;
-  bool needs_more_input_ = false;
+  std::unique_ptr<Pipeline> pipeline_;
 };
 
 }  // namespace trace_processor
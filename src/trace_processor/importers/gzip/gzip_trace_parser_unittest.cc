@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/gzip/gzip_trace_parser.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/trace_processor/trace_blob.h"
+#include "perfetto/trace_processor/trace_blob_view.h"
+#include "src/trace_processor/storage/stats.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+#include "src/trace_processor/util/status_macros.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Returns a single gzip member containing |input|.
+std::string GzipCompress(const std::string& input) {
+  z_stream stream{};
+  // 16 selects the gzip format rather than the zlib one.
+  PERFETTO_CHECK(deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED,
+                              MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+  std::string output(deflateBound(&stream, static_cast<uLong>(input.size())),
+                     '\0');
+  stream.next_in =
+      const_cast<Bytef*>(reinterpret_cast<const Bytef*>(input.data()));
+  stream.avail_in = static_cast<uInt>(input.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+  stream.avail_out = static_cast<uInt>(output.size());
+  PERFETTO_CHECK(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+  output.resize(stream.total_out);
+  deflateEnd(&stream);
+  return output;
+}
+
+// A deterministic, not too compressible string.
+std::string MakeData(size_t size, uint32_t seed) {
+  std::string data(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = static_cast<char>('a' + (seed >> 16) % 16);
+  }
+  return data;
+}
+
+class FakeReader : public ChunkedTraceReader {
+ public:
+  explicit FakeReader(std::string* output) : output_(output) {}
+
+  util::Status Parse(TraceBlobView blob) override {
+    if (fail_)
+      return util::ErrStatus("Inner reader failure");
+    output_->append(reinterpret_cast<const char*>(blob.data()), blob.size());
+    return util::OkStatus();
+  }
+  void NotifyEndOfFile() override {}
+
+  bool fail_ = false;
+
+ private:
+  std::string* output_;
+};
+
+class GzipTraceParserTest : public ::testing::Test {
+ protected:
+  GzipTraceParserTest() {
+    context_.storage.reset(new TraceStorage());
+    std::unique_ptr<FakeReader> reader(new FakeReader(&output_));
+    reader_ = reader.get();
+    parser_.reset(new GzipTraceParser(std::move(reader), &context_));
+  }
+
+  // Passes |data| to Parse() in chunks of |chunk_size| bytes, which are
+  // decompressed on the decompression thread. Returns the first error.
+  util::Status Parse(const std::string& data, size_t chunk_size) {
+    for (size_t off = 0; off < data.size(); off += chunk_size) {
+      size_t size = std::min(chunk_size, data.size() - off);
+      RETURN_IF_ERROR(parser_->Parse(
+          TraceBlobView(TraceBlob::CopyFrom(data.data() + off, size))));
+    }
+    return util::OkStatus();
+  }
+
+  // Like Parse() but uses ParseUnowned(), which decompresses synchronously.
+  util::Status ParseUnowned(const std::string& data, size_t chunk_size) {
+    for (size_t off = 0; off < data.size(); off += chunk_size) {
+      size_t size = std::min(chunk_size, data.size() - off);
+      RETURN_IF_ERROR(parser_->ParseUnowned(
+          reinterpret_cast<const uint8_t*>(data.data()) + off, size));
+    }
+    return util::OkStatus();
+  }
+
+  int64_t eof_errors() {
+    return context_.storage->stats()[stats::gzip_trace_eof_error].value;
+  }
+
+  TraceProcessorContext context_;
+  std::string output_;
+  FakeReader* reader_ = nullptr;
+  std::unique_ptr<GzipTraceParser> parser_;
+};
+
+TEST_F(GzipTraceParserTest, DecompressionThread) {
+  // Larger than the uncompressed buffer, so that the output is split in
+  // several blobs.
+  std::string data = MakeData(33 * 1024 * 1024, 1);
+  ASSERT_TRUE(Parse(GzipCompress(data), 64 * 1024).ok());
+  parser_->NotifyEndOfFile();
+  ASSERT_EQ(eof_errors(), 0);
+  ASSERT_TRUE(output_ == data);
+  ASSERT_GT(context_.storage->stats()[stats::gzip_decompression_duration_ns]
+                .value,
+            0);
+}
+
+TEST_F(GzipTraceParserTest, MultiMember) {
+  std::string first = MakeData(10000, 1);
+  std::string second = MakeData(20000, 2);
+  std::string trace = GzipCompress(first) + GzipCompress(second);
+  // Single byte chunks split the gzip magic of the second member.
+  ASSERT_TRUE(ParseUnowned(trace, 1).ok());
+  parser_->NotifyEndOfFile();
+  ASSERT_EQ(output_, first + second);
+}
+
+TEST_F(GzipTraceParserTest, MultiMemberDecompressionThread) {
+  std::string first = MakeData(10000, 1);
+  std::string second = MakeData(20000, 2);
+  ASSERT_TRUE(Parse(GzipCompress(first) + GzipCompress(second), 777).ok());
+  parser_->NotifyEndOfFile();
+  ASSERT_EQ(eof_errors(), 0);
+  ASSERT_EQ(output_, first + second);
+}
+
+TEST_F(GzipTraceParserTest, TrailingGarbage) {
+  std::string data = MakeData(10000, 1);
+  std::string trace = GzipCompress(data) + std::string(512, '\0');
+  ASSERT_TRUE(ParseUnowned(trace, 100).ok());
+  parser_->NotifyEndOfFile();
+  ASSERT_EQ(output_, data);
+}
+
+TEST_F(GzipTraceParserTest, CorruptSecondMember) {
+  std::string data = MakeData(10000, 1);
+  std::string corrupt = GzipCompress(MakeData(10000, 2));
+  // Keep the gzip magic but break the compression method.
+  corrupt[2] = 0x42;
+  ASSERT_FALSE(ParseUnowned(GzipCompress(data) + corrupt, 100).ok());
+}
+
+TEST_F(GzipTraceParserTest, CorruptSecondMemberDecompressionThread) {
+  std::string corrupt = GzipCompress(MakeData(10000, 2));
+  corrupt[2] = 0x42;
+  // The error is returned by Parse() or, if the decompression thread didn't
+  // get to it yet, recorded at the end of the file.
+  bool failed =
+      !Parse(GzipCompress(MakeData(10000, 1)) + corrupt, 100).ok();
+  parser_->NotifyEndOfFile();
+  ASSERT_TRUE(failed || eof_errors() == 1);
+}
+
+TEST_F(GzipTraceParserTest, EofErrorStat) {
+  // A truncated member: its output is only handed to the inner reader at the
+  // end of the file, which then fails.
+  std::string trace = GzipCompress(MakeData(10000, 1));
+  trace.resize(trace.size() / 2);
+  reader_->fail_ = true;
+  ASSERT_TRUE(Parse(trace, 100).ok());
+  parser_->NotifyEndOfFile();
+  ASSERT_EQ(eof_errors(), 1);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
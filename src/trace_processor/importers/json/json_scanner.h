@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_IMPORTERS_JSON_JSON_SCANNER_H_
+#define SRC_TRACE_PROCESSOR_IMPORTERS_JSON_JSON_SCANNER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/compiler.h"
+#include "perfetto/base/logging.h"
+#include "src/trace_processor/util/cpu_features.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT) || PERFETTO_TP_AVX2_DISPATCH()
+#include <immintrin.h>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace json {
+
+// This file contains a scanner which finds the characters relevant to the
+// structure of a JSON document (quotes, backslashes, braces and brackets) 64
+// bytes at a time, producing their positions as the bits of a word. This
+// allows the tokenizer to jump directly from one structural character to the
+// next instead of looking at every character of the (mostly string) content
+// of the trace.
+
+// The positions of the structural characters in a block of (up to) 64 bytes:
+// bit i of each mask is set iff the ith byte of the block is one of the
+// corresponding characters.
+struct StructuralMasks {
+  // '"'
+  uint64_t quotes;
+  // '\\'
+  uint64_t backslashes;
+  // '{', '}', '[' and ']'
+  uint64_t brackets;
+};
+
+static constexpr size_t kScanBlockSize = 64;
+
+// Returns the index of the lowest set bit of |word|. Undefined if |word| is 0.
+inline uint32_t LowestSetBit(uint64_t word) {
+  PERFETTO_DCHECK(word != 0);
+  return static_cast<uint32_t>(PERFETTO_POPCOUNT(~word & (word - 1)));
+}
+
+#if PERFETTO_TP_AVX2_DISPATCH()
+
+// Only called if util::HasAvx2(): compares 32 bytes at a time.
+PERFETTO_TP_AVX2_TARGET inline StructuralMasks ScanFullBlockAvx2(
+    const char* block) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i lower_case = _mm256_set1_epi8(0x20);
+  const __m256i open_brace = _mm256_set1_epi8('{');
+  const __m256i close_brace = _mm256_set1_epi8('}');
+  StructuralMasks masks{0, 0, 0};
+  for (uint32_t i = 0; i < kScanBlockSize; i += 32) {
+    __m256i d =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+    // Setting bit 5 maps '[' to '{' and ']' to '}' (and no other character
+    // to either of them).
+    __m256i d_lower = _mm256_or_si256(d, lower_case);
+    auto q = _mm256_movemask_epi8(_mm256_cmpeq_epi8(d, quote));
+    auto b = _mm256_movemask_epi8(_mm256_cmpeq_epi8(d, backslash));
+    auto br = _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(d_lower, open_brace),
+                        _mm256_cmpeq_epi8(d_lower, close_brace)));
+    masks.quotes |= static_cast<uint64_t>(static_cast<uint32_t>(q)) << i;
+    masks.backslashes |= static_cast<uint64_t>(static_cast<uint32_t>(b)) << i;
+    masks.brackets |= static_cast<uint64_t>(static_cast<uint32_t>(br)) << i;
+  }
+  return masks;
+}
+
+#endif  // PERFETTO_TP_AVX2_DISPATCH()
+
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+
+// The scanner used when AVX2 is not available. When building with x64
+// optimizations, SSE4.2 is guaranteed to be available (see
+// CheckCpuOptimizations() in src/base/utils.cc) so we can compare 16 bytes at
+// a time.
+inline StructuralMasks ScanFullBlockFallback(const char* block) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i lower_case = _mm_set1_epi8(0x20);
+  const __m128i open_brace = _mm_set1_epi8('{');
+  const __m128i close_brace = _mm_set1_epi8('}');
+  StructuralMasks masks{0, 0, 0};
+  for (uint32_t i = 0; i < kScanBlockSize; i += 16) {
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+    // Setting bit 5 maps '[' to '{' and ']' to '}' (and no other character
+    // to either of them).
+    __m128i d_lower = _mm_or_si128(d, lower_case);
+    auto q = _mm_movemask_epi8(_mm_cmpeq_epi8(d, quote));
+    auto b = _mm_movemask_epi8(_mm_cmpeq_epi8(d, backslash));
+    auto br = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(d_lower, open_brace),
+                     _mm_cmpeq_epi8(d_lower, close_brace)));
+    masks.quotes |= static_cast<uint64_t>(static_cast<uint32_t>(q)) << i;
+    masks.backslashes |= static_cast<uint64_t>(static_cast<uint32_t>(b)) << i;
+    masks.brackets |= static_cast<uint64_t>(static_cast<uint32_t>(br)) << i;
+  }
+  return masks;
+}
+
+#else  // PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+
+#if !(PERFETTO_IS_LITTLE_ENDIAN())
+#error "The JSON scanner assumes a little-endian architecture."
+#endif
+
+// Returns a word with the top bit of each byte of |word| which is equal to
+// the corresponding byte of |pattern| set and all other bits cleared.
+inline uint64_t MatchBytes(uint64_t word, uint64_t pattern) {
+  static constexpr uint64_t kLow7 = 0x7F7F7F7F7F7F7F7Full;
+  uint64_t x = word ^ pattern;
+  // Exact (i.e. no false positives) zero byte detection: the top bit of a
+  // byte ends up set iff the byte is zero.
+  return ~(((x & kLow7) + kLow7) | x | kLow7);
+}
+
+// Packs the top bit of each of the 8 bytes of |word| into the low 8 bits of
+// the result.
+inline uint64_t PackTopBits(uint64_t word) {
+  return ((word >> 7) * 0x0102040810204080ull) >> 56;
+}
+
+// The portable version of the scanner, used when AVX2 is not available: looks
+// at 8 bytes at a time using "SIMD within a register" techniques.
+inline StructuralMasks ScanFullBlockFallback(const char* block) {
+  static constexpr uint64_t kOnes = 0x0101010101010101ull;
+  StructuralMasks masks{0, 0, 0};
+  for (uint32_t i = 0; i < kScanBlockSize; i += 8) {
+    uint64_t word;
+    memcpy(&word, block + i, sizeof(word));
+    // Setting bit 5 maps '[' to '{' and ']' to '}' (and no other character
+    // to either of them).
+    uint64_t word_lower = word | (kOnes * 0x20);
+    uint64_t q = MatchBytes(word, kOnes * '"');
+    uint64_t b = MatchBytes(word, kOnes * '\\');
+    uint64_t br = MatchBytes(word_lower, kOnes * '{') |
+                  MatchBytes(word_lower, kOnes * '}');
+    masks.quotes |= PackTopBits(q) << i;
+    masks.backslashes |= PackTopBits(b) << i;
+    masks.brackets |= PackTopBits(br) << i;
+  }
+  return masks;
+}
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+
+// Scans the 64 bytes starting at |block|.
+inline StructuralMasks ScanFullBlock(const char* block) {
+#if PERFETTO_TP_AVX2_DISPATCH()
+  if (util::HasAvx2())
+    return ScanFullBlockAvx2(block);
+#endif
+  return ScanFullBlockFallback(block);
+}
+
+// Scans the first |size| (at most 64) bytes starting at |block|.
+inline StructuralMasks ScanBlock(const char* block, size_t size) {
+  PERFETTO_DCHECK(size <= kScanBlockSize);
+  if (PERFETTO_LIKELY(size == kScanBlockSize))
+    return ScanFullBlock(block);
+
+  // NUL is not a structural character so padding the block with zeros does
+  // not change the result.
+  char padded[kScanBlockSize] = {};
+  memcpy(padded, block, size);
+  return ScanFullBlock(padded);
+}
+
+}  // namespace json
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_IMPORTERS_JSON_JSON_SCANNER_H_
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the different stages of importing a JSON trace: splitting the
+// trace into events, parsing the events and the end-to-end ingestion.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/string_view.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/importers/json/json_trace_tokenizer.h"
+#include "src/trace_processor/importers/json/json_utils.h"
+#include "src/trace_processor/importers/json/simple_json_event.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr uint32_t kRandomSeed = 476;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+size_t NumEvents() {
+  return IsBenchmarkFunctionalOnly() ? 1024 : 256 * 1024;
+}
+
+// Generates the events of a trace resembling those emitted by Chrome: mostly
+// complete events with a few args, some begin/end pairs and counters.
+std::vector<std::string> GenerateEvents(size_t num_events) {
+  std::minstd_rand0 rnd(kRandomSeed);
+  std::vector<std::string> events;
+  events.reserve(num_events);
+  int64_t ts = 1000;
+  char buf[512];
+  for (size_t i = 0; i < num_events; ++i) {
+    ts += rnd() % 100;
+    uint32_t tid = 1 + rnd() % 16;
+    uint32_t kind = rnd() % 8;
+    if (kind < 5) {
+      snprintf(buf, sizeof(buf),
+               R"({"ph":"X","pid":1,"tid":%u,"ts":%)" PRId64
+               R"(,"dur":%u,"tts":%)" PRId64
+               R"(,"cat":"toplevel,benchmark","name":"Task%u",)"
+               R"("args":{"src_file":"../../base/task/sequence_manager.cc",)"
+               R"("src_func":"PostTask","id":%u}})",
+               tid, ts, static_cast<uint32_t>(rnd() % 50), ts / 2,
+               static_cast<uint32_t>(rnd() % 32),
+               static_cast<uint32_t>(rnd()));
+    } else if (kind < 7) {
+      snprintf(buf, sizeof(buf),
+               R"({"ph":"B","pid":1,"tid":%u,"ts":%)" PRId64
+               R"(,"cat":"benchmark","name":"Nested%u","args":{}})",
+               tid, ts, static_cast<uint32_t>(rnd() % 32));
+      events.emplace_back(buf);
+      snprintf(buf, sizeof(buf),
+               R"({"ph":"E","pid":1,"tid":%u,"ts":%)" PRId64 "}", tid,
+               ts + 1);
+    } else {
+      snprintf(buf, sizeof(buf),
+               R"({"ph":"C","pid":1,"tid":%u,"ts":%)" PRId64
+               R"(,"name":"Memory","args":{"used":%u,"free":%u.5}})",
+               tid, ts, static_cast<uint32_t>(rnd() % 10000),
+               static_cast<uint32_t>(rnd() % 10000));
+    }
+    events.emplace_back(buf);
+  }
+  return events;
+}
+
+std::string GenerateTrace(size_t num_events) {
+  std::string trace = R"({"traceEvents":[)";
+  for (const std::string& event : GenerateEvents(num_events)) {
+    trace += event;
+    trace += ",\n";
+  }
+  trace += R"({"ph":"M","pid":1,"name":"process_name",)"
+           R"("args":{"name":"benchmark"}}]})";
+  return trace;
+}
+
+}  // namespace
+
+static void BM_JsonReadOneDict(benchmark::State& state) {
+  std::string trace = GenerateTrace(NumEvents());
+  const char* begin = trace.data() + strlen(R"({"traceEvents":[)");
+  const char* end = trace.data() + trace.size();
+
+  for (auto _ : state) {
+    const char* next = begin;
+    base::StringView value;
+    while (ReadOneJsonDict(next, end, &value, &next) ==
+           ReadDictRes::kFoundDict) {
+      benchmark::DoNotOptimize(value.data());
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(trace.size()) *
+                          static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_JsonReadOneDict);
+
+// Args: {0 = jsoncpp, 1 = ParseSimpleJsonEvent}.
+static void BM_JsonParseEvent(benchmark::State& state) {
+  std::vector<std::string> events = GenerateEvents(NumEvents());
+  bool simple = state.range(0) == 1;
+  size_t bytes = 0;
+  for (const std::string& event : events)
+    bytes += event.size();
+
+  for (auto _ : state) {
+    for (const std::string& event : events) {
+      if (simple) {
+        json::SimpleJsonEvent parsed;
+        benchmark::DoNotOptimize(
+            json::ParseSimpleJsonEvent(base::StringView(event), &parsed));
+      } else {
+        auto parsed = json::ParseJsonString(base::StringView(event));
+        benchmark::DoNotOptimize(parsed.has_value());
+      }
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(bytes) *
+                          static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_JsonParseEvent)->Arg(0)->Arg(1)->ArgName("simple");
+
+static void BM_JsonIngest(benchmark::State& state) {
+  std::string trace = GenerateTrace(NumEvents());
+  static constexpr size_t kChunkSize = 1024 * 1024;
+
+  for (auto _ : state) {
+    auto tp = TraceProcessor::CreateInstance(Config());
+    for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+      size_t size = std::min(kChunkSize, trace.size() - off);
+      std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+      memcpy(buf.get(), trace.data() + off, size);
+      PERFETTO_CHECK(tp->Parse(std::move(buf), size).ok());
+    }
+    tp->NotifyEndOfFile();
+    benchmark::DoNotOptimize(tp.get());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(trace.size()) *
+                          static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_JsonIngest)->Unit(benchmark::kMillisecond);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -31,6 +31,7 @@
 #include "src/trace_processor/importers/common/slice_tracker.h"
 #include "src/trace_processor/importers/common/track_tracker.h"
 #include "src/trace_processor/importers/json/json_utils.h"
+#include "src/trace_processor/importers/json/simple_json_event.h"
 #include "src/trace_processor/tables/slice_tables.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 
@@ -80,6 +81,15 @@ void JsonTraceParser::ParseTracePacket(int64_t timestamp,
     return;
   }
 
+  // Most events have a simple shape which can be imported without the cost
+  // of building a Json::Value.
+  json::SimpleJsonEvent simple_event;
+  if (json::ParseSimpleJsonEvent(base::StringView(ttp.json_value),
+                                 &simple_event)) {
+    ParseSimpleEvent(timestamp, simple_event);
+    return;
+  }
+
   auto opt_value = json::ParseJsonString(base::StringView(ttp.json_value));
   if (!opt_value) {
     context_->storage->IncrementStats(stats::json_parser_failure);
@@ -325,6 +335,111 @@ void JsonTraceParser::ParseTracePacket(int64_t timestamp,
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
 }
 
+void JsonTraceParser::ParseSimpleEvent(int64_t timestamp,
+                                       const json::SimpleJsonEvent& event) {
+  ProcessTracker* procs = context_->process_tracker.get();
+  TraceStorage* storage = context_->storage.get();
+  SliceTracker* slice_tracker = context_->slice_tracker.get();
+
+  uint32_t pid = event.pid.value_or(0);
+  uint32_t tid = event.tid.value_or(pid);
+
+  StringId cat_id = storage->InternString(event.cat);
+  StringId name_id = storage->InternString(event.name);
+  UniqueTid utid = procs->UpdateThread(tid, pid);
+
+  // Equivalent to json::AddJsonValueToArgs() for a flat dictionary.
+  auto args_inserter = [storage, &event](ArgsTracker::BoundInserter* inserter) {
+    std::string key;
+    for (const auto& arg : event.args) {
+      key = "args.";
+      key.append(arg.key.data(), arg.key.size());
+      StringId key_id = storage->InternString(base::StringView(key));
+      Variadic value = Variadic::Integer(0);
+      switch (arg.type) {
+        case json::SimpleJsonEvent::Arg::Type::kInt:
+          value = Variadic::Integer(arg.int_value);
+          break;
+        case json::SimpleJsonEvent::Arg::Type::kReal:
+          value = Variadic::Real(arg.real_value);
+          break;
+        case json::SimpleJsonEvent::Arg::Type::kString:
+          value = Variadic::String(storage->InternString(arg.string_value));
+          break;
+        case json::SimpleJsonEvent::Arg::Type::kBool:
+          value = Variadic::Boolean(arg.bool_value);
+          break;
+      }
+      inserter->AddArg(key_id, key_id, value);
+    }
+  };
+
+  auto make_thread_slice_row = [&](TrackId track_id) {
+    tables::ThreadSliceTable::Row row;
+    row.ts = timestamp;
+    row.track_id = track_id;
+    row.category = cat_id;
+    row.name = name_id;
+    row.thread_ts = event.tts;
+    row.thread_dur = event.tdur;
+    row.thread_instruction_count = base::nullopt;
+    row.thread_instruction_delta = base::nullopt;
+    return row;
+  };
+
+  switch (event.phase) {
+    case 'B': {
+      TrackId track_id = context_->track_tracker->InternThreadTrack(utid);
+      slice_tracker->BeginTyped(storage->mutable_thread_slice_table(),
+                                make_thread_slice_row(track_id), args_inserter);
+      break;
+    }
+    case 'E': {
+      TrackId track_id = context_->track_tracker->InternThreadTrack(utid);
+      auto opt_slice_id = slice_tracker->End(timestamp, track_id, cat_id,
+                                             name_id, args_inserter);
+      if (opt_slice_id.has_value() && event.tts) {
+        auto* thread_slice = storage->mutable_thread_slice_table();
+        auto maybe_row = thread_slice->id().IndexOf(*opt_slice_id);
+        PERFETTO_DCHECK(maybe_row.has_value());
+        auto start_tts = thread_slice->thread_ts()[*maybe_row];
+        if (start_tts) {
+          thread_slice->mutable_thread_dur()->Set(*maybe_row,
+                                                  *event.tts - *start_tts);
+        }
+      }
+      break;
+    }
+    case 'X': {
+      if (!event.dur.has_value())
+        return;
+      TrackId track_id = context_->track_tracker->InternThreadTrack(utid);
+      auto row = make_thread_slice_row(track_id);
+      row.dur = event.dur.value();
+      slice_tracker->ScopedTyped(storage->mutable_thread_slice_table(),
+                                 std::move(row), args_inserter);
+      break;
+    }
+    case 'C': {
+      std::string counter_name_prefix = event.name.ToStdString();
+      for (const auto& arg : event.args) {
+        double counter = arg.type == json::SimpleJsonEvent::Arg::Type::kInt
+                             ? static_cast<double>(arg.int_value)
+                             : arg.real_value;
+        std::string counter_name =
+            counter_name_prefix + " " + arg.key.ToStdString();
+        StringId counter_name_id =
+            storage->InternString(base::StringView(counter_name));
+        context_->event_tracker->PushProcessCounterForThread(
+            timestamp, counter, counter_name_id, utid);
+      }
+      break;
+    }
+    default:
+      PERFETTO_DFATAL("Unexpected phase %c", event.phase);
+  }
+}
+
 void JsonTraceParser::MaybeAddFlow(TrackId track_id, const Json::Value& event) {
   PERFETTO_DCHECK(json::IsJsonSupported());
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
@@ -35,6 +35,10 @@ namespace trace_processor {
 
 class TraceProcessorContext;
 
+namespace json {
+struct SimpleJsonEvent;
+}  // namespace json
+
 // Parses legacy chrome JSON traces. The support for now is extremely rough
 // and supports only explicit TRACE_EVENT_BEGIN/END events.
 class JsonTraceParser : public TraceParser {
@@ -51,6 +55,11 @@ class JsonTraceParser : public TraceParser {
   SystraceLineParser systrace_line_parser_;
 
   void MaybeAddFlow(TrackId track_id, const Json::Value& event);
+
+  // Imports an event which was parsed without going through jsoncpp. The
+  // result is the same as parsing the event with jsoncpp and going through
+  // the main path of ParseTracePacket().
+  void ParseSimpleEvent(int64_t timestamp, const json::SimpleJsonEvent& event);
 };
 
 }  // namespace trace_processor
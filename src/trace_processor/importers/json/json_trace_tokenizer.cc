@@ -16,12 +16,14 @@
 
 #include "src/trace_processor/importers/json/json_trace_tokenizer.h"
 
+#include <algorithm>
 #include <memory>
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/string_utils.h"
 
 #include "perfetto/trace_processor/trace_blob_view.h"
+#include "src/trace_processor/importers/json/json_scanner.h"
 #include "src/trace_processor/importers/json/json_utils.h"
 #include "src/trace_processor/storage/stats.h"
 #include "src/trace_processor/trace_sorter.h"
@@ -113,43 +115,75 @@ ReadDictRes ReadOneJsonDict(const char* start,
   int square_brackets = 0;
   const char* dict_begin = nullptr;
   bool in_string = false;
-  bool is_escaping = false;
-  for (const char* s = start; s < end; s++) {
-    if (isspace(*s) || *s == ',')
-      continue;
-    if (*s == '"' && !is_escaping) {
-      in_string = !in_string;
-      continue;
-    }
-    if (in_string) {
-      // If we're in a string and we see a backslash and the last character was
-      // not a backslash the next character is escaped:
-      is_escaping = *s == '\\' && !is_escaping;
-      // If we're currently parsing a string we should ignore otherwise special
-      // characters:
-      continue;
-    }
-    if (*s == '{') {
-      if (braces == 0)
-        dict_begin = s;
-      braces++;
-      continue;
-    }
-    if (*s == '}') {
-      if (braces <= 0)
-        return ReadDictRes::kEndOfTrace;
-      if (--braces > 0)
+  // Set when a block ends with a backslash inside a string: the first
+  // character of the next block is escaped.
+  bool escape_next_block = false;
+
+  // Rather than looking at every character, we scan the input in blocks of 64
+  // bytes and only visit the characters which can change the structure of
+  // the JSON: quotes and backslashes inside strings; quotes, braces and
+  // brackets outside them.
+  size_t size = static_cast<size_t>(end - start);
+  for (size_t offset = 0; offset < size; offset += json::kScanBlockSize) {
+    const char* block = start + offset;
+    size_t block_size = std::min(size - offset, json::kScanBlockSize);
+    json::StructuralMasks masks = json::ScanBlock(block, block_size);
+
+    // The bits of the characters of the block we've already visited (or
+    // which should be ignored because they are escaped).
+    uint64_t visited = escape_next_block ? 1 : 0;
+    escape_next_block = false;
+    for (;;) {
+      uint64_t candidates =
+          (in_string ? masks.quotes | masks.backslashes
+                     : masks.quotes | masks.brackets) &
+          ~visited;
+      if (candidates == 0)
+        break;
+
+      uint32_t idx = json::LowestSetBit(candidates);
+      visited = idx == 63 ? ~0ull : (2ull << idx) - 1;
+
+      const char* s = block + idx;
+      if (in_string) {
+        if (*s == '"') {
+          in_string = false;
+          continue;
+        }
+        // If we're in a string and we see a backslash the next character is
+        // escaped so skip over it.
+        if (idx == 63) {
+          escape_next_block = true;
+        } else {
+          visited |= 2ull << idx;
+        }
         continue;
-      size_t len = static_cast<size_t>((s + 1) - dict_begin);
-      *value = base::StringView(dict_begin, len);
-      *next = s + 1;
-      return ReadDictRes::kFoundDict;
-    }
-    if (*s == '[') {
-      square_brackets++;
-      continue;
-    }
-    if (*s == ']') {
+      }
+      if (*s == '"') {
+        in_string = true;
+        continue;
+      }
+      if (*s == '{') {
+        if (braces == 0)
+          dict_begin = s;
+        braces++;
+        continue;
+      }
+      if (*s == '}') {
+        if (braces <= 0)
+          return ReadDictRes::kEndOfTrace;
+        if (--braces > 0)
+          continue;
+        size_t len = static_cast<size_t>((s + 1) - dict_begin);
+        *value = base::StringView(dict_begin, len);
+        *next = s + 1;
+        return ReadDictRes::kFoundDict;
+      }
+      if (*s == '[') {
+        square_brackets++;
+        continue;
+      }
+      PERFETTO_DCHECK(*s == ']');
       if (square_brackets == 0) {
         // We've reached the end of [traceEvents] array.
         // There might be other top level keys in the json (e.g. metadata)
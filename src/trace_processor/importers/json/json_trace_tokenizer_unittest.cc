@@ -18,7 +18,12 @@
 
 #include <json/value.h>
 
+#include <string>
+#include <vector>
+
+#include "src/trace_processor/importers/json/json_scanner.h"
 #include "src/trace_processor/importers/json/json_utils.h"
+#include "src/trace_processor/util/cpu_features.h"
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -85,6 +90,56 @@ TEST(JsonTraceTokenizerTest, ReadDictNeedMoreData) {
   ASSERT_EQ(next, nullptr);
 }
 
+TEST(JsonTraceTokenizerTest, ReadDictLongStrings) {
+  // Place escaped quotes and backslashes at all the offsets around the
+  // boundaries of the 64 byte blocks the scanner works on.
+  for (size_t padding = 0; padding < 80; ++padding) {
+    std::string dict = R"({"foo": ")" + std::string(padding, 'a') +
+                       R"(\"}\\", "bar": [{"baz": "\\\""}]})";
+    std::string input = dict + R"(, {"x": 1})";
+    const char* start = input.data();
+    const char* end = start + input.size();
+    const char* next = nullptr;
+    base::StringView value;
+
+    ASSERT_EQ(ReadOneJsonDict(start, end, &value, &next),
+              ReadDictRes::kFoundDict);
+    ASSERT_EQ(value.ToStdString(), dict);
+    ASSERT_EQ(next, start + dict.size());
+
+    Json::Value parsed = *json::ParseJsonString(value);
+    ASSERT_EQ(parsed["foo"].asString(), std::string(padding, 'a') + "\"}\\");
+    ASSERT_EQ(parsed["bar"][0]["baz"].asString(), "\\\"");
+  }
+}
+
+TEST(JsonTraceTokenizerTest, ReadDictEscapeAtEndOfInput) {
+  // The input stops right after a backslash: whatever comes next is escaped
+  // so we can't know where the string ends yet.
+  for (size_t padding = 0; padding < 80; ++padding) {
+    std::string input = R"({"foo": ")" + std::string(padding, 'a') + "\\";
+    const char* start = input.data();
+    const char* end = start + input.size();
+    const char* next = nullptr;
+    base::StringView value;
+
+    ASSERT_EQ(ReadOneJsonDict(start, end, &value, &next),
+              ReadDictRes::kNeedsMoreData);
+  }
+}
+
+TEST(JsonTraceTokenizerTest, ReadDictEndOfArray) {
+  std::string input = std::string(100, ' ') + R"(], "metadata": {})";
+  const char* start = input.data();
+  const char* end = start + input.size();
+  const char* next = nullptr;
+  base::StringView value;
+
+  ASSERT_EQ(ReadOneJsonDict(start, end, &value, &next),
+            ReadDictRes::kEndOfArray);
+  ASSERT_EQ(next, start + 101);
+}
+
 TEST(JsonTraceTokenizerTest, ReadKeyIntValue) {
   const char* start = R"("Test": 01234, )";
   const char* middle = start + strlen(R"("Test": )");
@@ -272,6 +327,46 @@ TEST(JsonTraceTokenizerTest, ExtractValueForJsonKey) {
   ASSERT_EQ(*line, R"({"ts": 149029, "foo": "bar"})");
 }
 
+// Checks the scanner kernels against a byte by byte scan of |block|.
+void CheckScanFullBlock(const char* block) {
+  json::StructuralMasks expected{0, 0, 0};
+  for (uint32_t i = 0; i < json::kScanBlockSize; ++i) {
+    char c = block[i];
+    expected.quotes |= static_cast<uint64_t>(c == '"') << i;
+    expected.backslashes |= static_cast<uint64_t>(c == '\\') << i;
+    expected.brackets |=
+        static_cast<uint64_t>(c == '{' || c == '}' || c == '[' || c == ']')
+        << i;
+  }
+
+  std::vector<json::StructuralMasks> results{
+      json::ScanFullBlock(block), json::ScanFullBlockFallback(block)};
+#if PERFETTO_TP_AVX2_DISPATCH()
+  if (util::HasAvx2())
+    results.push_back(json::ScanFullBlockAvx2(block));
+#endif
+  for (const json::StructuralMasks& masks : results) {
+    ASSERT_EQ(masks.quotes, expected.quotes);
+    ASSERT_EQ(masks.backslashes, expected.backslashes);
+    ASSERT_EQ(masks.brackets, expected.brackets);
+  }
+}
+
+TEST(JsonTraceTokenizerTest, ScanFullBlock) {
+  std::string block(json::kScanBlockSize, 'a');
+  CheckScanFullBlock(block.data());
+
+  // Every byte value at every position of a block of structural characters.
+  for (uint32_t i = 0; i < json::kScanBlockSize; ++i) {
+    for (int c = 0; c < 256; ++c) {
+      std::string test = R"({"a":[1,"\"x\""]}{ }[ {)" + std::string(64, ' ');
+      test.resize(json::kScanBlockSize);
+      test[i] = static_cast<char>(c);
+      CheckScanFullBlock(test.data());
+    }
+  }
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
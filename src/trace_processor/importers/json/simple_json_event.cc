@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/json/simple_json_event.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace perfetto {
+namespace trace_processor {
+namespace json {
+
+namespace {
+
+// A JSON number. |is_integer| is true iff the number has neither a fraction
+// nor an exponent, which is how jsoncpp decides between integer and real
+// values.
+struct Number {
+  bool is_integer = false;
+  int64_t int_value = 0;
+  double real_value = 0;
+};
+
+// The top level keys which can appear in a simple event.
+enum Key : uint32_t {
+  kPh = 1 << 0,
+  kTs = 1 << 1,
+  kDur = 1 << 2,
+  kPid = 1 << 3,
+  kTid = 1 << 4,
+  kCat = 1 << 5,
+  kName = 1 << 6,
+  kTts = 1 << 7,
+  kTdur = 1 << 8,
+  kArgs = 1 << 9,
+};
+
+uint32_t LookupKey(base::StringView key) {
+  if (key == "ph")
+    return kPh;
+  if (key == "ts")
+    return kTs;
+  if (key == "dur")
+    return kDur;
+  if (key == "pid")
+    return kPid;
+  if (key == "tid")
+    return kTid;
+  if (key == "cat")
+    return kCat;
+  if (key == "name")
+    return kName;
+  if (key == "tts")
+    return kTts;
+  if (key == "tdur")
+    return kTdur;
+  if (key == "args")
+    return kArgs;
+  return 0;
+}
+
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Orders keys in the same way as jsoncpp orders the members of an object.
+bool KeyLessThan(base::StringView a, base::StringView b) {
+  size_t min_size = std::min(a.size(), b.size());
+  int res = min_size == 0 ? 0 : memcmp(a.data(), b.data(), min_size);
+  return res < 0 || (res == 0 && a.size() < b.size());
+}
+
+// A minimal reader over the JSON of a single event. All the Read* methods
+// return false if the input is not what they expect or is something we
+// don't support on the fast path.
+class Reader {
+ public:
+  Reader(const char* start, const char* end) : cur_(start), end_(end) {}
+
+  void SkipWhitespace() {
+    while (cur_ < end_ &&
+           (*cur_ == ' ' || *cur_ == '\n' || *cur_ == '\r' || *cur_ == '\t')) {
+      cur_++;
+    }
+  }
+
+  // Skips whitespace and then consumes |c| if it's the next character.
+  bool Consume(char c) {
+    SkipWhitespace();
+    if (cur_ == end_ || *cur_ != c)
+      return false;
+    cur_++;
+    return true;
+  }
+
+  // Skips whitespace and returns the next character (or 0 at the end of the
+  // input) without consuming it.
+  char Peek() {
+    SkipWhitespace();
+    return cur_ == end_ ? 0 : *cur_;
+  }
+
+  // Reads a string which doesn't need unescaping.
+  bool ReadString(base::StringView* out) {
+    if (!Consume('"'))
+      return false;
+    const char* start = cur_;
+    for (; cur_ < end_; cur_++) {
+      char c = *cur_;
+      if (c == '"') {
+        *out = base::StringView(start, static_cast<size_t>(cur_ - start));
+        cur_++;
+        return true;
+      }
+      // Escapes need unescaping and control characters are not valid JSON:
+      // leave both to jsoncpp.
+      if (c == '\\' || static_cast<unsigned char>(c) < 0x20)
+        return false;
+    }
+    return false;
+  }
+
+  bool ReadNumber(Number* out) {
+    SkipWhitespace();
+    const char* start = cur_;
+    bool negative = cur_ < end_ && *cur_ == '-';
+    if (negative)
+      cur_++;
+    const char* digits = cur_;
+    uint64_t magnitude = 0;
+    for (; cur_ < end_ && IsDigit(*cur_); cur_++) {
+      uint64_t digit = static_cast<uint64_t>(*cur_ - '0');
+      if (magnitude > (std::numeric_limits<int64_t>::max() - digit) / 10)
+        return false;
+      magnitude = magnitude * 10 + digit;
+    }
+    // JSON doesn't allow leading zeros.
+    size_t num_digits = static_cast<size_t>(cur_ - digits);
+    if (num_digits == 0 || (num_digits > 1 && *digits == '0'))
+      return false;
+
+    out->is_integer = true;
+    if (cur_ < end_ && *cur_ == '.') {
+      cur_++;
+      if (!ReadDigits())
+        return false;
+      out->is_integer = false;
+    }
+    if (cur_ < end_ && (*cur_ == 'e' || *cur_ == 'E')) {
+      cur_++;
+      if (cur_ < end_ && (*cur_ == '+' || *cur_ == '-'))
+        cur_++;
+      if (!ReadDigits())
+        return false;
+      out->is_integer = false;
+    }
+
+    if (out->is_integer) {
+      out->int_value = negative ? -static_cast<int64_t>(magnitude)
+                                : static_cast<int64_t>(magnitude);
+      return true;
+    }
+
+    // strtod needs a null terminated string.
+    char buf[64];
+    size_t size = static_cast<size_t>(cur_ - start);
+    if (size >= sizeof(buf))
+      return false;
+    memcpy(buf, start, size);
+    buf[size] = '\0';
+    out->real_value = strtod(buf, nullptr);
+    return true;
+  }
+
+  bool ReadArg(SimpleJsonEvent::Arg* arg) {
+    if (!ReadString(&arg->key) || !Consume(':'))
+      return false;
+    char c = Peek();
+    if (c == '"') {
+      arg->type = SimpleJsonEvent::Arg::Type::kString;
+      return ReadString(&arg->string_value);
+    }
+    if (c == 't' || c == 'f') {
+      arg->type = SimpleJsonEvent::Arg::Type::kBool;
+      arg->bool_value = c == 't';
+      return ReadLiteral(c == 't' ? "true" : "false");
+    }
+    Number number;
+    if (!ReadNumber(&number))
+      return false;
+    if (number.is_integer) {
+      arg->type = SimpleJsonEvent::Arg::Type::kInt;
+      arg->int_value = number.int_value;
+    } else {
+      arg->type = SimpleJsonEvent::Arg::Type::kReal;
+      arg->real_value = number.real_value;
+    }
+    return true;
+  }
+
+  bool AtEnd() {
+    SkipWhitespace();
+    return cur_ == end_;
+  }
+
+ private:
+  bool ReadDigits() {
+    const char* start = cur_;
+    while (cur_ < end_ && IsDigit(*cur_))
+      cur_++;
+    return cur_ != start;
+  }
+
+  bool ReadLiteral(const char* literal) {
+    size_t size = strlen(literal);
+    if (static_cast<size_t>(end_ - cur_) < size ||
+        memcmp(cur_, literal, size) != 0) {
+      return false;
+    }
+    cur_ += size;
+    return true;
+  }
+
+  const char* cur_;
+  const char* end_;
+};
+
+// Converts a number in the same way as CoerceToTs() does for the equivalent
+// Json::Value.
+int64_t NumberToTs(const Number& number) {
+  return number.is_integer
+             ? number.int_value * 1000
+             : static_cast<int64_t>(number.real_value * 1000.0);
+}
+
+// Converts a number in the same way as CoerceToUint32() does for the
+// equivalent Json::Value. Only integers are supported.
+base::Optional<uint32_t> NumberToUint32(const Number& number) {
+  int64_t n = number.int_value;
+  if (n < 0 || n > std::numeric_limits<uint32_t>::max())
+    return base::nullopt;
+  return static_cast<uint32_t>(n);
+}
+
+bool ReadArgs(Reader* reader, std::vector<SimpleJsonEvent::Arg>* args) {
+  if (!reader->Consume('{'))
+    return false;
+  if (reader->Consume('}'))
+    return true;
+  do {
+    SimpleJsonEvent::Arg arg;
+    if (!reader->ReadArg(&arg))
+      return false;
+    args->emplace_back(arg);
+  } while (reader->Consume(','));
+  if (!reader->Consume('}'))
+    return false;
+
+  std::sort(args->begin(), args->end(),
+            [](const SimpleJsonEvent::Arg& a, const SimpleJsonEvent::Arg& b) {
+              return KeyLessThan(a.key, b.key);
+            });
+  // jsoncpp keeps the last value of a duplicated key: just don't bother.
+  for (size_t i = 1; i < args->size(); ++i) {
+    if ((*args)[i - 1].key == (*args)[i].key)
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool ParseSimpleJsonEvent(base::StringView json, SimpleJsonEvent* event) {
+  Reader reader(json.data(), json.data() + json.size());
+  if (!reader.Consume('{'))
+    return false;
+
+  uint32_t seen_keys = 0;
+  bool first = true;
+  while (!reader.Consume('}')) {
+    if (!first && !reader.Consume(','))
+      return false;
+    first = false;
+
+    base::StringView key_str;
+    if (!reader.ReadString(&key_str) || !reader.Consume(':'))
+      return false;
+    uint32_t key = LookupKey(key_str);
+    if (key == 0 || (seen_keys & key))
+      return false;
+    seen_keys |= key;
+
+    switch (key) {
+      case kPh: {
+        base::StringView ph;
+        if (!reader.ReadString(&ph) || ph.size() != 1)
+          return false;
+        event->phase = ph.at(0);
+        break;
+      }
+      case kTs: {
+        // The timestamp is extracted by the tokenizer.
+        base::StringView unused_str;
+        Number unused_number;
+        if (reader.Peek() == '"' ? !reader.ReadString(&unused_str)
+                                 : !reader.ReadNumber(&unused_number)) {
+          return false;
+        }
+        break;
+      }
+      case kPid:
+      case kTid: {
+        Number number;
+        if (!reader.ReadNumber(&number) || !number.is_integer)
+          return false;
+        (key == kPid ? event->pid : event->tid) = NumberToUint32(number);
+        break;
+      }
+      case kDur:
+      case kTts:
+      case kTdur: {
+        Number number;
+        if (!reader.ReadNumber(&number))
+          return false;
+        auto* field = key == kDur   ? &event->dur
+                      : key == kTts ? &event->tts
+                                    : &event->tdur;
+        *field = NumberToTs(number);
+        break;
+      }
+      case kCat:
+        if (!reader.ReadString(&event->cat))
+          return false;
+        break;
+      case kName:
+        if (!reader.ReadString(&event->name))
+          return false;
+        break;
+      case kArgs:
+        if (!ReadArgs(&reader, &event->args))
+          return false;
+        break;
+    }
+  }
+  if (!reader.AtEnd())
+    return false;
+
+  switch (event->phase) {
+    case 'B':
+    case 'E':
+    case 'X':
+      return true;
+    case 'C':
+      // Counter values can also be strings which need to be converted to
+      // doubles: leave those to the slow path.
+      if (!(seen_keys & kArgs))
+        return false;
+      for (const auto& arg : event->args) {
+        if (arg.type != SimpleJsonEvent::Arg::Type::kInt &&
+            arg.type != SimpleJsonEvent::Arg::Type::kReal) {
+          return false;
+        }
+      }
+      return true;
+  }
+  return false;
+}
+
+}  // namespace json
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_IMPORTERS_JSON_SIMPLE_JSON_EVENT_H_
+#define SRC_TRACE_PROCESSOR_IMPORTERS_JSON_SIMPLE_JSON_EVENT_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "perfetto/ext/base/optional.h"
+#include "perfetto/ext/base/string_view.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace json {
+
+// A trace event with one of the most common shapes: a begin ('B'), end ('E'),
+// complete ('X') or counter ('C') event whose args are a flat dictionary of
+// numbers, strings and booleans. These make up the vast majority of the events
+// in JSON traces and can be imported without building a Json::Value.
+//
+// All the string views point into the JSON passed to ParseSimpleJsonEvent().
+struct SimpleJsonEvent {
+  struct Arg {
+    enum class Type {
+      kInt,
+      kReal,
+      kString,
+      kBool,
+    };
+
+    base::StringView key;
+    Type type = Type::kInt;
+    int64_t int_value = 0;
+    double real_value = 0;
+    base::StringView string_value;
+    bool bool_value = false;
+  };
+
+  char phase = 0;
+
+  // Have the same values as the json::CoerceTo* functions would return for
+  // the corresponding Json::Value.
+  base::Optional<uint32_t> pid;
+  base::Optional<uint32_t> tid;
+  base::Optional<int64_t> dur;
+  base::Optional<int64_t> tts;
+  base::Optional<int64_t> tdur;
+
+  // Null (i.e. data() == nullptr) if the key is not present.
+  base::StringView cat;
+  base::StringView name;
+
+  // Sorted by key, which is the order in which Json::Value iterates over the
+  // members of a dictionary.
+  std::vector<Arg> args;
+};
+
+// Parses |json|, the dictionary of a single trace event, into |event| if it
+// has one of the shapes described above. Returns false if the event (or the
+// JSON) is anything else, in which case it should be parsed with jsoncpp.
+//
+// The set of accepted events is deliberately conservative: anything which
+// might be interpreted differently by jsoncpp (e.g. escaped strings, duplicate
+// keys, numbers out of range) is rejected.
+bool ParseSimpleJsonEvent(base::StringView json, SimpleJsonEvent* event);
+
+}  // namespace json
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_IMPORTERS_JSON_SIMPLE_JSON_EVENT_H_
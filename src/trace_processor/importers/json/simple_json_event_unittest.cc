@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/json/simple_json_event.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace json {
+namespace {
+
+using Arg = SimpleJsonEvent::Arg;
+
+bool Parse(const char* json, SimpleJsonEvent* event) {
+  return ParseSimpleJsonEvent(base::StringView(json), event);
+}
+
+TEST(SimpleJsonEventTest, CompleteEvent) {
+  SimpleJsonEvent event;
+  ASSERT_TRUE(Parse(R"({"ph": "X", "pid": 1, "tid": 2, "ts": 100,
+                        "dur": 1.5, "tts": 3, "cat": "c", "name": "n"})",
+                    &event));
+  ASSERT_EQ(event.phase, 'X');
+  ASSERT_EQ(event.pid, 1u);
+  ASSERT_EQ(event.tid, 2u);
+  ASSERT_EQ(event.dur, 1500);
+  ASSERT_EQ(event.tts, 3000);
+  ASSERT_EQ(event.tdur, base::nullopt);
+  ASSERT_EQ(event.cat, "c");
+  ASSERT_EQ(event.name, "n");
+  ASSERT_TRUE(event.args.empty());
+}
+
+TEST(SimpleJsonEventTest, MissingKeys) {
+  SimpleJsonEvent event;
+  ASSERT_TRUE(Parse(R"({"ph":"E","ts":"100"})", &event));
+  ASSERT_EQ(event.phase, 'E');
+  ASSERT_EQ(event.pid, base::nullopt);
+  ASSERT_EQ(event.tid, base::nullopt);
+  ASSERT_EQ(event.cat.data(), nullptr);
+  ASSERT_EQ(event.name.data(), nullptr);
+}
+
+TEST(SimpleJsonEventTest, ArgsAreSorted) {
+  SimpleJsonEvent event;
+  ASSERT_TRUE(Parse(R"({"ph": "B", "ts": 1,
+                        "args": {"b": "str", "ab": -2, "a": 0.5, "c": true}})",
+                    &event));
+  ASSERT_EQ(event.args.size(), 4u);
+  ASSERT_EQ(event.args[0].key, "a");
+  ASSERT_EQ(event.args[0].type, Arg::Type::kReal);
+  ASSERT_EQ(event.args[0].real_value, 0.5);
+  ASSERT_EQ(event.args[1].key, "ab");
+  ASSERT_EQ(event.args[1].type, Arg::Type::kInt);
+  ASSERT_EQ(event.args[1].int_value, -2);
+  ASSERT_EQ(event.args[2].key, "b");
+  ASSERT_EQ(event.args[2].type, Arg::Type::kString);
+  ASSERT_EQ(event.args[2].string_value, "str");
+  ASSERT_EQ(event.args[3].key, "c");
+  ASSERT_EQ(event.args[3].type, Arg::Type::kBool);
+  ASSERT_TRUE(event.args[3].bool_value);
+}
+
+TEST(SimpleJsonEventTest, Counter) {
+  SimpleJsonEvent event;
+  ASSERT_TRUE(Parse(R"({"ph": "C", "ts": 1, "name": "mem",
+                        "args": {"used": 10, "free": 1e3}})",
+                    &event));
+  ASSERT_EQ(event.args.size(), 2u);
+  ASSERT_EQ(event.args[0].key, "free");
+  ASSERT_EQ(event.args[0].real_value, 1000.0);
+  ASSERT_EQ(event.args[1].key, "used");
+  ASSERT_EQ(event.args[1].int_value, 10);
+
+  // String counter values need to be converted.
+  SimpleJsonEvent string_counter;
+  ASSERT_FALSE(Parse(R"({"ph": "C", "ts": 1, "args": {"used": "10"}})",
+                     &string_counter));
+}
+
+TEST(SimpleJsonEventTest, OutOfRangePid) {
+  SimpleJsonEvent event;
+  ASSERT_TRUE(Parse(R"({"ph": "B", "pid": -1, "tid": 4294967296})", &event));
+  ASSERT_EQ(event.pid, base::nullopt);
+  ASSERT_EQ(event.tid, base::nullopt);
+}
+
+TEST(SimpleJsonEventTest, NotSimple) {
+  const char* const kEvents[] = {
+      // Phases other than B, E, X and C.
+      R"({"ph": "i", "ts": 1})",
+      R"({"ph": "BE", "ts": 1})",
+      R"({"ts": 1})",
+      // Unknown or duplicate keys.
+      R"({"ph": "X", "ts": 1, "dur": 1, "bind_id": 1})",
+      R"({"ph": "X", "ts": 1, "dur": 1, "dur": 2})",
+      R"({"ph": "B", "ts": 1, "args": {"a": 1, "a": 2}})",
+      // Values needing unescaping or conversion.
+      R"({"ph": "B", "ts": 1, "name": "a\"b"})",
+      R"({"ph": "B", "ts": 1, "pid": "1"})",
+      R"({"ph": "B", "ts": 1, "pid": 1.0})",
+      R"({"ph": "B", "ts": 1, "pid": null})",
+      R"({"ph": "X", "ts": 1, "dur": "1"})",
+      R"({"ph": "B", "ts": 1, "args": {"a": null}})",
+      R"({"ph": "B", "ts": 1, "args": {"a": {"b": 1}}})",
+      R"({"ph": "B", "ts": 1, "args": {"a": [1]}})",
+      R"({"ph": "B", "ts": 1, "args": {"a": 9223372036854775808}})",
+      // Invalid JSON.
+      R"({"ph": "B", "ts": 01})",
+      R"({"ph": "B", "ts": 1.})",
+      R"({"ph": "B", "ts": 1,})",
+      R"({"ph": "B" "ts": 1})",
+      R"({"ph": "B", "ts": 1} x)",
+      R"({"ph": "B", "ts": 1, "args": {"a": tru}})",
+  };
+  for (const char* json : kEvents) {
+    SimpleJsonEvent event;
+    ASSERT_FALSE(Parse(json, &event)) << json;
+  }
+}
+
+}  // namespace
+}  // namespace json
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -16,20 +16,32 @@
 
 #include "src/trace_processor/importers/proto/heap_graph_tracker.h"
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "src/trace_processor/importers/proto/profiler_util.h"
 #include "src/trace_processor/tables/profiler_tables.h"
 
+#include <algorithm>
+#include <memory>
 #include <set>
 #include <utility>
 
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+#include <thread>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 
 namespace {
 
+// The maximum number of dumps analyzed at the same time. Each analysis holds
+// arrays of the size of its graph until it is written to the storage so this,
+// rather than the number of cores, bounds the memory used by the analyses.
+constexpr size_t kMaxGraphsAnalyzedInParallel = 4;
+
 // Iterates all the references owned by the object `id`.
 //
 // Calls bool(*fn)(uint32_t) with the row index of each reference owned by `id`
@@ -57,45 +69,185 @@ void ForReferenceSet(const TraceStorage& storage,
   }
 }
 
-std::set<tables::HeapGraphObjectTable::Id> GetChildren(
-    const TraceStorage& storage,
-    tables::HeapGraphObjectTable::Id id) {
-  uint32_t obj_row = *storage.heap_graph_object_table().id().IndexOf(id);
-  uint32_t cls_row = *storage.heap_graph_class_table().id().IndexOf(
-      storage.heap_graph_object_table().type_id()[obj_row]);
-
-  StringPool::Id kind = storage.heap_graph_class_table().kind()[cls_row];
-  base::Optional<StringPool::Id> weakref_kind =
-      storage.string_pool().GetId("KIND_WEAK_REFERENCE");
-  base::Optional<StringPool::Id> softref_kind =
-      storage.string_pool().GetId("KIND_SOFT_REFERENCE");
-  base::Optional<StringPool::Id> finalizerref_kind =
-      storage.string_pool().GetId("KIND_FINALIZER_REFERENCE");
-  base::Optional<StringPool::Id> phantomref_kind =
-      storage.string_pool().GetId("KIND_PHANTOM_REFERENCE");
-
-  if ((weakref_kind && kind == *weakref_kind) ||
-      (softref_kind && kind == *softref_kind) ||
-      (finalizerref_kind && kind == *finalizerref_kind) ||
-      (phantomref_kind && kind == *phantomref_kind)) {
-    // Do not follow weak / soft / finalizer / phantom references.
-    return {};
+// Returns whether the references owned by the objects of each class (by row in
+// the heap_graph_class table) keep the referred objects alive: weak / soft /
+// finalizer / phantom references do not.
+std::vector<bool> GetStrongReferenceClassRows(const TraceStorage& storage) {
+  std::set<StringPool::Id> weak_kinds;
+  for (const char* kind :
+       {"KIND_WEAK_REFERENCE", "KIND_SOFT_REFERENCE",
+        "KIND_FINALIZER_REFERENCE", "KIND_PHANTOM_REFERENCE"}) {
+    base::Optional<StringPool::Id> kind_id = storage.string_pool().GetId(kind);
+    if (kind_id)
+      weak_kinds.insert(*kind_id);
   }
 
-  std::set<tables::HeapGraphObjectTable::Id> children;
-  ForReferenceSet(
-      storage, id, [&storage, &children, id](uint32_t reference_row) {
-        PERFETTO_CHECK(
-            storage.heap_graph_reference_table().owner_id()[reference_row] ==
-            id);
-        auto opt_owned =
-            storage.heap_graph_reference_table().owned_id()[reference_row];
-        if (opt_owned) {
-          children.emplace(*opt_owned);
-        }
+  const auto& classes = storage.heap_graph_class_table();
+  std::vector<bool> strong_class_rows(classes.row_count());
+  for (uint32_t row = 0; row < classes.row_count(); ++row)
+    strong_class_rows[row] = weak_kinds.count(classes.kind()[row]) == 0;
+  return strong_class_rows;
+}
+
+// Builds the graph of the objects at `rows` (sorted) in the
+// heap_graph_object table from their references.
+ObjectGraph BuildObjectGraph(const TraceStorage& storage,
+                             std::vector<uint32_t> rows,
+                             const std::vector<bool>& strong_class_rows) {
+  const auto& objects = storage.heap_graph_object_table();
+  const auto& classes = storage.heap_graph_class_table();
+  const auto& references = storage.heap_graph_reference_table();
+
+  ObjectGraph graph;
+  graph.rows = std::move(rows);
+  if (!graph.rows.empty()) {
+    graph.first_row = graph.rows.front();
+    graph.node_for_row.assign(graph.rows.back() - graph.first_row + 1,
+                              DominatorTree::kNoNode);
+  }
+  for (uint32_t node = 0; node < graph.rows.size(); ++node)
+    graph.node_for_row[graph.rows[node] - graph.first_row] = node;
+
+  std::vector<uint32_t>& offsets = graph.graph.offsets;
+  std::vector<uint32_t>& targets = graph.graph.targets;
+  offsets.reserve(graph.rows.size() + 1);
+  offsets.push_back(0);
+  for (uint32_t row : graph.rows) {
+    size_t begin = targets.size();
+    uint32_t class_row = *classes.id().IndexOf(objects.type_id()[row]);
+    if (strong_class_rows[class_row]) {
+      ForReferenceSet(storage, objects.id()[row], [&](uint32_t reference_row) {
+        auto opt_owned = references.owned_id()[reference_row];
+        if (!opt_owned)
+          return true;
+        base::Optional<uint32_t> owned_node =
+            graph.NodeForRow(*objects.id().IndexOf(*opt_owned));
+        if (owned_node)
+          targets.push_back(*owned_node);
         return true;
       });
-  return children;
+    }
+    // Visit the children of an object once each, in the order of their ids.
+    std::sort(targets.begin() + static_cast<ptrdiff_t>(begin), targets.end());
+    targets.erase(
+        std::unique(targets.begin() + static_cast<ptrdiff_t>(begin),
+                    targets.end()),
+        targets.end());
+    offsets.push_back(static_cast<uint32_t>(targets.size()));
+  }
+  return graph;
+}
+
+// The analysis of a heap graph dump, by node of its ObjectGraph.
+struct GraphAnalysis {
+  ObjectGraph graph;
+  // Shortest distance to a GC root, -1 if the node is not reachable.
+  std::vector<int32_t> root_distance;
+  std::unique_ptr<DominatorTree> dominator_tree;
+  std::vector<int64_t> retained_size;
+  std::vector<int64_t> retained_native_size;
+  std::vector<int64_t> retained_count;
+};
+
+// Only reads the tables in `storage`, so that dumps can be analyzed
+// concurrently.
+GraphAnalysis AnalyzeGraph(const TraceStorage& storage,
+                           std::vector<uint32_t> object_rows,
+                           const std::vector<uint32_t>& root_rows,
+                           const std::vector<bool>& strong_class_rows) {
+  const auto& objects = storage.heap_graph_object_table();
+
+  GraphAnalysis analysis;
+  analysis.graph =
+      BuildObjectGraph(storage, std::move(object_rows), strong_class_rows);
+  const ObjectGraph& graph = analysis.graph;
+  const uint32_t node_count = graph.node_count();
+
+  std::vector<uint32_t> roots;
+  for (uint32_t row : root_rows) {
+    base::Optional<uint32_t> node = graph.NodeForRow(row);
+    if (node)
+      roots.push_back(*node);
+  }
+
+  // Breadth first traversal from all the roots at once.
+  std::vector<int32_t>& root_distance = analysis.root_distance;
+  root_distance.assign(node_count, -1);
+  std::vector<uint32_t> queue;
+  for (uint32_t root : roots) {
+    if (root_distance[root] == -1) {
+      root_distance[root] = 0;
+      queue.push_back(root);
+    }
+  }
+  for (size_t i = 0; i < queue.size(); ++i) {
+    uint32_t node = queue[i];
+    for (const uint32_t* it = graph.graph.successors_begin(node);
+         it != graph.graph.successors_end(node); ++it) {
+      if (root_distance[*it] == -1) {
+        root_distance[*it] = root_distance[node] + 1;
+        queue.push_back(*it);
+      }
+    }
+  }
+
+  analysis.dominator_tree.reset(new DominatorTree(graph.graph, roots));
+  const DominatorTree& tree = *analysis.dominator_tree;
+  analysis.retained_size.assign(node_count, 0);
+  analysis.retained_native_size.assign(node_count, 0);
+  analysis.retained_count.assign(node_count, 0);
+  for (uint32_t node : tree.reachable_nodes()) {
+    uint32_t row = graph.rows[node];
+    analysis.retained_size[node] = objects.self_size()[row];
+    analysis.retained_native_size[node] = objects.native_size()[row];
+    analysis.retained_count[node] = 1;
+  }
+  // Dominators come first in reachable_nodes(): in reverse order, the retained
+  // sizes of a node are final when they are added to its dominator.
+  for (auto it = tree.reachable_nodes().rbegin();
+       it != tree.reachable_nodes().rend(); ++it) {
+    uint32_t idom = tree.ImmediateDominator(*it);
+    if (idom == DominatorTree::kNoNode)
+      continue;
+    analysis.retained_size[idom] += analysis.retained_size[*it];
+    analysis.retained_native_size[idom] += analysis.retained_native_size[*it];
+    analysis.retained_count[idom] += analysis.retained_count[*it];
+  }
+  return analysis;
+}
+
+// Writes the analysis of the dump of |upid| at |ts| to the storage: the
+// reachable and root_distance columns of its objects and its rows of the
+// dominator tree table.
+void WriteGraphAnalysis(TraceStorage* storage,
+                        UniquePid upid,
+                        int64_t ts,
+                        const GraphAnalysis& analysis) {
+  auto* objects_tbl = storage->mutable_heap_graph_object_table();
+  auto* dominator_tree_tbl = storage->mutable_heap_graph_dominator_tree_table();
+  const ObjectGraph& graph = analysis.graph;
+  for (uint32_t node = 0; node < graph.node_count(); ++node) {
+    int32_t distance = analysis.root_distance[node];
+    if (distance == -1)
+      continue;
+    objects_tbl->mutable_reachable()->Set(graph.rows[node], 1);
+    objects_tbl->mutable_root_distance()->Set(graph.rows[node], distance);
+  }
+
+  const DominatorTree& tree = *analysis.dominator_tree;
+  for (uint32_t node : tree.reachable_nodes()) {
+    tables::HeapGraphDominatorTreeTable::Row row{};
+    row.upid = upid;
+    row.graph_sample_ts = ts;
+    row.object_id = objects_tbl->id()[graph.rows[node]];
+    uint32_t idom = tree.ImmediateDominator(node);
+    if (idom != DominatorTree::kNoNode)
+      row.idom_id = objects_tbl->id()[graph.rows[idom]];
+    row.retained_size = analysis.retained_size[node];
+    row.retained_native_size = analysis.retained_native_size[node];
+    row.retained_count = analysis.retained_count[node];
+    dominator_tree_tbl->Insert(row);
+  }
 }
 
 struct ClassDescriptor {
@@ -198,46 +350,6 @@ int64_t GetSizeFromNativeAllocationRegistry(int64_t nar_size) {
 
 }  // namespace
 
-void MarkRoot(TraceStorage* storage,
-              tables::HeapGraphObjectTable::Id id,
-              StringPool::Id type) {
-  uint32_t row = *storage->heap_graph_object_table().id().IndexOf(id);
-  storage->mutable_heap_graph_object_table()->mutable_root_type()->Set(row,
-                                                                       type);
-
-  // Calculate shortest distance to a GC root.
-  std::deque<std::pair<int32_t, tables::HeapGraphObjectTable::Id>>
-      reachable_nodes{{0, id}};
-  while (!reachable_nodes.empty()) {
-    tables::HeapGraphObjectTable::Id cur_node;
-    int32_t distance;
-    std::tie(distance, cur_node) = reachable_nodes.front();
-    reachable_nodes.pop_front();
-    uint32_t cur_row =
-        *storage->heap_graph_object_table().id().IndexOf(cur_node);
-    int32_t cur_distance =
-        storage->heap_graph_object_table().root_distance()[cur_row];
-    if (cur_distance == -1 || cur_distance > distance) {
-      if (cur_distance == -1) {
-        storage->mutable_heap_graph_object_table()->mutable_reachable()->Set(
-            cur_row, 1);
-      }
-      storage->mutable_heap_graph_object_table()->mutable_root_distance()->Set(
-          cur_row, distance);
-
-      for (tables::HeapGraphObjectTable::Id child_node :
-           GetChildren(*storage, cur_node)) {
-        uint32_t child_row =
-            *storage->heap_graph_object_table().id().IndexOf(child_node);
-        int32_t child_distance =
-            storage->heap_graph_object_table().root_distance()[child_row];
-        if (child_distance == -1 || child_distance > distance + 1)
-          reachable_nodes.emplace_back(distance + 1, child_node);
-      }
-    }
-  }
-}
-
 base::Optional<base::StringView> GetStaticClassTypeName(base::StringView type) {
   static const base::StringView kJavaClassTemplate("java.lang.Class<");
   if (!type.empty() && type.at(type.size() - 1) == '>' &&
@@ -679,6 +791,9 @@ void HeapGraphTracker::FinalizeProfile(uint32_t seq_id) {
         static_cast<int>(sequence_state.current_upid));
   }
 
+  auto* objects_tbl = context_->storage->mutable_heap_graph_object_table();
+  PendingGraph pending{sequence_state.current_upid, sequence_state.current_ts,
+                       {}, {}};
   for (const SourceRoot& root : sequence_state.current_roots) {
     for (uint64_t obj_id : root.object_ids) {
       auto it = sequence_state.object_id_to_db_id.find(obj_id);
@@ -691,16 +806,80 @@ void HeapGraphTracker::FinalizeProfile(uint32_t seq_id) {
       auto it_and_success = roots_[std::make_pair(sequence_state.current_upid,
                                                   sequence_state.current_ts)]
                                 .emplace(db_id);
-      if (it_and_success.second)
-        MarkRoot(context_->storage.get(), db_id, root.root_type);
+      if (it_and_success.second) {
+        uint32_t row = *objects_tbl->id().IndexOf(db_id);
+        objects_tbl->mutable_root_type()->Set(row, root.root_type);
+        pending.root_rows.push_back(row);
+      }
     }
   }
 
   PopulateSuperClasses(sequence_state);
   PopulateNativeSize(sequence_state);
+
+  // Walking the graph is by far the most expensive part of the import of
+  // large dumps: it is deferred to AnalyzePendingGraphs() so that all the
+  // dumps of the trace are walked in parallel.
+  if (!pending.root_rows.empty()) {
+    pending.object_rows.reserve(sequence_state.object_id_to_db_id.size());
+    for (const auto& p : sequence_state.object_id_to_db_id)
+      pending.object_rows.push_back(*objects_tbl->id().IndexOf(p.second));
+    std::sort(pending.object_rows.begin(), pending.object_rows.end());
+    pending_graphs_.emplace_back(std::move(pending));
+  }
   sequence_state_.erase(seq_id);
 }
 
+void HeapGraphTracker::AnalyzePendingGraphs() {
+  if (pending_graphs_.empty())
+    return;
+
+  TraceStorage* storage = context_->storage.get();
+  std::vector<PendingGraph> graphs = std::move(pending_graphs_);
+  pending_graphs_.clear();
+  std::vector<bool> strong_class_rows = GetStrongReferenceClassRows(*storage);
+
+  // The graphs are analyzed in batches of at most |batch_size| dumps, one per
+  // thread, and each batch is written back (in dump order) and freed before
+  // the next one starts: an analysis is about as large as its graph so only
+  // a few of them should be alive at once.
+  size_t batch_size = 1;
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  batch_size = std::min(
+      {graphs.size(), kMaxGraphsAnalyzedInParallel,
+       std::max<size_t>(std::thread::hardware_concurrency(), 1)});
+#endif
+  for (size_t begin = 0; begin < graphs.size(); begin += batch_size) {
+    size_t end = std::min(begin + batch_size, graphs.size());
+    std::vector<GraphAnalysis> analyses(end - begin);
+    auto analyze_graph = [storage, &graphs, &analyses, &strong_class_rows,
+                          begin](size_t i) {
+      analyses[i - begin] =
+          AnalyzeGraph(*storage, std::move(graphs[i].object_rows),
+                       graphs[i].root_rows, strong_class_rows);
+    };
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+    for (size_t i = begin; i < end; ++i)
+      analyze_graph(i);
+#else
+    std::vector<std::thread> threads;
+    for (size_t i = begin + 1; i < end; ++i)
+      threads.emplace_back(analyze_graph, i);
+    analyze_graph(begin);
+    for (std::thread& thread : threads)
+      thread.join();
+#endif
+
+    for (size_t i = begin; i < end; ++i) {
+      WriteGraphAnalysis(storage, graphs[i].upid, graphs[i].ts,
+                         analyses[i - begin]);
+      analyses[i - begin] = GraphAnalysis();
+      graphs[i] = PendingGraph();
+    }
+  }
+}
+
 base::Optional<tables::HeapGraphObjectTable::Id>
 HeapGraphTracker::GetReferenceByFieldName(tables::HeapGraphObjectTable::Id obj,
                                           StringPool::Id field) {
@@ -849,30 +1028,32 @@ void HeapGraphTracker::PopulateSuperClasses(const SequenceState& seq) {
 }
 
 void FindPathFromRoot(TraceStorage* storage,
-                      tables::HeapGraphObjectTable::Id id,
+                      const ObjectGraph& graph,
+                      uint32_t root_node,
                       PathFromRoot* path) {
   // We have long retention chains (e.g. from LinkedList). If we use the stack
   // here, we risk running out of stack space. This is why we use a vector to
   // simulate the stack.
   struct StackElem {
-    tables::HeapGraphObjectTable::Id node;  // Node in the original graph.
+    uint32_t node;     // Node in the original graph.
     size_t parent_id;  // id of parent node in the result tree.
-    size_t i;          // Index of the next child of this node to handle.
+    uint32_t i;        // Index of the next child of this node to handle.
     uint32_t depth;    // Depth in the resulting tree
                        // (including artificial root).
-    std::vector<tables::HeapGraphObjectTable::Id> children;
   };
 
-  std::vector<StackElem> stack{{id, PathFromRoot::kRoot, 0, 0, {}}};
+  path->visited.resize(graph.node_count());
+  std::vector<StackElem> stack{{root_node, PathFromRoot::kRoot, 0, 0}};
 
   while (!stack.empty()) {
-    tables::HeapGraphObjectTable::Id n = stack.back().node;
-    uint32_t row = *storage->heap_graph_object_table().id().IndexOf(n);
+    uint32_t n = stack.back().node;
+    uint32_t row = graph.rows[n];
     size_t parent_id = stack.back().parent_id;
     uint32_t depth = stack.back().depth;
-    size_t& i = stack.back().i;
-    std::vector<tables::HeapGraphObjectTable::Id>& children =
-        stack.back().children;
+    uint32_t& i = stack.back().i;
+    const uint32_t* children = graph.graph.successors_begin(n);
+    uint32_t children_size =
+        static_cast<uint32_t>(graph.graph.successors_end(n) - children);
 
     tables::HeapGraphClassTable::Id type_id =
         storage->heap_graph_object_table().type_id()[row];
@@ -912,10 +1093,6 @@ void FindPathFromRoot(TraceStorage* storage,
       output_tree_node->size +=
           storage->heap_graph_object_table().self_size()[row];
       output_tree_node->count++;
-      std::set<tables::HeapGraphObjectTable::Id> children_set =
-          GetChildren(*storage, n);
-      children.assign(children_set.cbegin(), children_set.cend());
-      PERFETTO_CHECK(children.size() == children_set.size());
 
       if (storage->heap_graph_object_table().native_size()[row]) {
         StringPool::Id native_class_name_id = storage->InternString(
@@ -941,12 +1118,11 @@ void FindPathFromRoot(TraceStorage* storage,
     }
 
     // We have already handled this node and just need to get its i-th child.
-    if (!children.empty()) {
-      PERFETTO_CHECK(i < children.size());
-      tables::HeapGraphObjectTable::Id child = children[i];
-      uint32_t child_row =
-          *storage->heap_graph_object_table().id().IndexOf(child);
-      if (++i == children.size())
+    if (children_size != 0) {
+      PERFETTO_CHECK(i < children_size);
+      uint32_t child = children[i];
+      uint32_t child_row = graph.rows[child];
+      if (++i == children_size)
         stack.pop_back();
 
       int32_t child_distance =
@@ -956,11 +1132,9 @@ void FindPathFromRoot(TraceStorage* storage,
       PERFETTO_CHECK(n_distance >= 0);
       PERFETTO_CHECK(child_distance >= 0);
 
-      bool visited = path->visited.count(child);
-
-      if (child_distance == n_distance + 1 && !visited) {
-        path->visited.emplace(child);
-        stack.emplace_back(StackElem{child, path_id, 0, depth + 1, {}});
+      if (child_distance == n_distance + 1 && !path->visited[child]) {
+        path->visited[child] = true;
+        stack.emplace_back(StackElem{child, path_id, 0, depth + 1});
       }
     } else {
       stack.pop_back();
@@ -971,6 +1145,8 @@ void FindPathFromRoot(TraceStorage* storage,
 std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
 HeapGraphTracker::BuildFlamegraph(const int64_t current_ts,
                                   const UniquePid current_upid) {
+  AnalyzePendingGraphs();
+
   auto profile_type = context_->storage->InternString("graph");
   auto java_mapping = context_->storage->InternString("JAVA");
 
@@ -1005,9 +1181,24 @@ HeapGraphTracker::BuildFlamegraph(const int64_t current_ts,
 
   const std::set<tables::HeapGraphObjectTable::Id>& roots = it->second;
 
+  const auto& objects_tbl = context_->storage->heap_graph_object_table();
+  RowMap object_rows = objects_tbl.FilterToRowMap(
+      {objects_tbl.upid().eq(current_upid),
+       objects_tbl.graph_sample_ts().eq(current_ts)});
+  std::vector<uint32_t> rows;
+  rows.reserve(object_rows.size());
+  for (auto row_it = object_rows.IterateRows(); row_it; row_it.Next())
+    rows.push_back(row_it.index());
+  ObjectGraph graph =
+      BuildObjectGraph(*context_->storage, std::move(rows),
+                       GetStrongReferenceClassRows(*context_->storage));
+
   PathFromRoot init_path;
   for (tables::HeapGraphObjectTable::Id root : roots) {
-    FindPathFromRoot(context_->storage.get(), root, &init_path);
+    base::Optional<uint32_t> root_node =
+        graph.NodeForRow(*objects_tbl.id().IndexOf(root));
+    if (root_node)
+      FindPathFromRoot(context_->storage.get(), graph, *root_node, &init_path);
   }
 
   std::vector<int64_t> node_to_cumulative_size(init_path.nodes.size());
@@ -1059,6 +1250,7 @@ void HeapGraphTracker::FinalizeAllProfiles() {
       FinalizeProfile(sequence_state_.begin()->first);
     }
   }
+  AnalyzePendingGraphs();
 }
 
 bool HeapGraphTracker::IsTruncated(UniquePid upid, int64_t ts) {
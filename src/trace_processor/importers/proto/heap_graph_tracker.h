@@ -26,6 +26,7 @@
 #include "perfetto/ext/base/string_view.h"
 
 #include "protos/perfetto/trace/profiling/heap_graph.pbzero.h"
+#include "src/trace_processor/analysis/dominator_tree.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 
@@ -52,14 +53,37 @@ struct PathFromRoot {
     std::map<StringId, size_t> children;
   };
   std::vector<Node> nodes{Node{}};
-  std::set<tables::HeapGraphObjectTable::Id> visited;
+  // Indexed by node of the ObjectGraph.
+  std::vector<bool> visited;
+};
+
+// The objects of one heap graph dump and the references between them, as a
+// graph whose nodes are numbered in the order of the objects' rows in the
+// heap_graph_object table. References owned by weak, soft, finalizer and
+// phantom reference objects are not part of the graph.
+struct ObjectGraph {
+  uint32_t node_count() const { return graph.node_count(); }
+
+  base::Optional<uint32_t> NodeForRow(uint32_t row) const {
+    if (row < first_row || row - first_row >= node_for_row.size())
+      return base::nullopt;
+    uint32_t node = node_for_row[row - first_row];
+    if (node == DominatorTree::kNoNode)
+      return base::nullopt;
+    return node;
+  }
+
+  // Sorted rows of the objects in the heap_graph_object table, by node.
+  std::vector<uint32_t> rows;
+  CsrGraph graph;
+
+  uint32_t first_row = 0;
+  std::vector<uint32_t> node_for_row;
 };
 
-void MarkRoot(TraceStorage* s,
-              tables::HeapGraphObjectTable::Id id,
-              StringPool::Id type);
 void FindPathFromRoot(TraceStorage* storage,
-                      tables::HeapGraphObjectTable::Id id,
+                      const ObjectGraph& graph,
+                      uint32_t root_node,
                       PathFromRoot* path);
 
 base::Optional<base::StringView> GetStaticClassTypeName(base::StringView type);
@@ -204,6 +228,21 @@ class HeapGraphTracker : public Destructible {
                               const InternedType* current_type);
   bool IsTruncated(UniquePid upid, int64_t ts);
 
+  // A finalized dump waiting for AnalyzePendingGraphs().
+  struct PendingGraph {
+    UniquePid upid;
+    int64_t ts;
+    // Sorted rows of the objects of the dump in the heap_graph_object table.
+    std::vector<uint32_t> object_rows;
+    std::vector<uint32_t> root_rows;
+  };
+
+  // Computes the reachability, distance to the GC roots and dominator tree of
+  // the finalized dumps. The dumps are independent, so they are analyzed in
+  // parallel in small batches. The results of each batch are written in the
+  // tables, in dump order, before the next batch is analyzed.
+  void AnalyzePendingGraphs();
+
   // Returns the object pointed to by `field` in `obj`.
   base::Optional<tables::HeapGraphObjectTable::Id> GetReferenceByFieldName(
       tables::HeapGraphObjectTable::Id obj,
@@ -231,6 +270,7 @@ class HeapGraphTracker : public Destructible {
            std::set<tables::HeapGraphObjectTable::Id>>
       roots_;
   std::set<std::pair<UniquePid, int64_t>> truncated_graphs_;
+  std::vector<PendingGraph> pending_graphs_;
 
   StringPool::Id cleaner_thunk_str_id_;
   StringPool::Id referent_str_id_;
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/importers/proto/heap_graph_tracker.h"
 
+#include <tuple>
+
 #include "perfetto/base/logging.h"
 #include "src/trace_processor/importers/common/process_tracker.h"
 #include "src/trace_processor/importers/proto/profiler_util.h"
@@ -334,6 +336,93 @@ TEST(HeapGraphTrackerTest, BuildFlamegraph) {
   EXPECT_THAT(counts, UnorderedElementsAre(1, 2, 1, 1, 1));
 }
 
+TEST(HeapGraphTrackerTest, DominatorTree) {
+  //     1@X     6@X (unreachable)
+  //     / \     /
+  //   2@X 3@X  /
+  //     \ / \ /
+  //     4@X 5@X
+
+  constexpr uint64_t kSeqId = 1;
+  constexpr UniquePid kPid = 1;
+  constexpr int64_t kTimestamp = 1;
+
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  context.process_tracker.reset(new ProcessTracker(&context));
+  context.process_tracker->GetOrCreateProcess(kPid);
+
+  HeapGraphTracker tracker(&context);
+
+  constexpr uint64_t kField = 1;
+  constexpr uint64_t kLocation = 0;
+  constexpr uint64_t kX = 1;
+
+  tracker.AddInternedFieldName(kSeqId, kField, base::StringView("foo"));
+  tracker.AddInternedLocationName(kSeqId, kLocation,
+                                  context.storage->InternString("location"));
+  StringPool::Id normal_kind = context.storage->InternString("KIND_NORMAL");
+  tracker.AddInternedType(kSeqId, kX, context.storage->InternString("X"),
+                          kLocation, /*object_size=*/0,
+                          /*field_name_ids=*/{}, /*superclass_id=*/0,
+                          /*classloader_id=*/0, /*no_fields=*/false,
+                          /*kind=*/normal_kind);
+
+  const std::vector<std::vector<uint64_t>> references = {
+      {}, {2, 3}, {4}, {4, 5}, {}, {}, {5}};
+  for (uint64_t id = 1; id <= 6; ++id) {
+    HeapGraphTracker::SourceObject obj;
+    obj.object_id = id;
+    obj.self_size = id;
+    obj.type_id = kX;
+    obj.field_name_ids.assign(references[id].size(), kField);
+    obj.referred_objects = references[id];
+    tracker.AddObject(kSeqId, kPid, kTimestamp, std::move(obj));
+  }
+
+  HeapGraphTracker::SourceRoot root;
+  root.root_type = context.storage->InternString("ROOT");
+  root.object_ids.emplace_back(1);
+  tracker.AddRoot(kSeqId, kPid, kTimestamp, root);
+
+  tracker.FinalizeProfile(kSeqId);
+  tracker.FinalizeAllProfiles();
+
+  // Objects are identified by their size below, as the order of their rows
+  // depends on the order of the references.
+  const auto& objects = context.storage->heap_graph_object_table();
+  auto size_of = [&objects](tables::HeapGraphObjectTable::Id id) {
+    return objects.self_size()[*objects.id().IndexOf(id)];
+  };
+
+  std::vector<std::tuple<int64_t, int64_t, int64_t, int64_t>> dominators;
+  const auto& dominator_tree =
+      context.storage->heap_graph_dominator_tree_table();
+  for (uint32_t row = 0; row < dominator_tree.row_count(); ++row) {
+    base::Optional<tables::HeapGraphObjectTable::Id> idom =
+        dominator_tree.idom_id()[row];
+    dominators.emplace_back(size_of(dominator_tree.object_id()[row]),
+                            idom ? size_of(*idom) : 0,
+                            dominator_tree.retained_size()[row],
+                            dominator_tree.retained_count()[row]);
+  }
+  // {object, immediate dominator, retained size, retained count}.
+  EXPECT_THAT(dominators,
+              UnorderedElementsAre(std::make_tuple(1, 0, 15, 5),
+                                   std::make_tuple(2, 1, 2, 1),
+                                   std::make_tuple(3, 1, 8, 2),
+                                   std::make_tuple(4, 1, 4, 1),
+                                   std::make_tuple(5, 3, 5, 1)));
+
+  // By object size.
+  const int32_t kRootDistance[] = {0, 0, 1, 1, 2, 2, -1};
+  for (uint32_t row = 0; row < objects.row_count(); ++row) {
+    int64_t size = objects.self_size()[row];
+    EXPECT_EQ(objects.reachable()[row], size == 6 ? 0 : 1);
+    EXPECT_EQ(objects.root_distance()[row], kRootDistance[size]);
+  }
+}
+
 static const char kArray[] = "X[]";
 static const char kDoubleArray[] = "X[][]";
 static const char kNoArray[] = "X";
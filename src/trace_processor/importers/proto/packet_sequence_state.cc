@@ -22,6 +22,14 @@ namespace trace_processor {
 void PacketSequenceStateGeneration::InternMessage(uint32_t field_id,
                                                   TraceBlobView message) {
   constexpr auto kIidFieldNumber = 1;
+  // Interned messages are only looked up by the field ids of InternedData,
+  // this bounds the size of |interned_data_|.
+  constexpr uint32_t kMaxFieldId = 1024;
+
+  if (PERFETTO_UNLIKELY(field_id > kMaxFieldId)) {
+    PERFETTO_DLOG("Interned message with unknown field id %u", field_id);
+    return;
+  }
 
   uint64_t iid = 0;
   auto message_start = message.data();
@@ -37,8 +45,9 @@ void PacketSequenceStateGeneration::InternMessage(uint32_t field_id,
   }
   iid = field.as_uint64();
 
-  auto res = interned_data_[field_id].emplace(
-      iid, InternedMessageView(std::move(message)));
+  if (field_id >= interned_data_.size())
+    interned_data_.resize(field_id + 1);
+  auto res = interned_data_[field_id].Insert(iid, std::move(message));
 
   // If a message with this ID is already interned in the same generation,
   // its data should not have changed (this is forbidden by the InternedData
@@ -46,21 +55,18 @@ void PacketSequenceStateGeneration::InternMessage(uint32_t field_id,
   // TODO(eseckler): This DCHECK assumes that the message is encoded the
   // same way if it is re-emitted.
   PERFETTO_DCHECK(res.second ||
-                  (res.first->second.message().length() == message_size &&
-                   memcmp(res.first->second.message().data(), message_start,
+                  (res.first->message().length() == message_size &&
+                   memcmp(res.first->message().data(), message_start,
                           message_size) == 0));
 }
 
 InternedMessageView* PacketSequenceStateGeneration::GetInternedMessageView(
     uint32_t field_id,
     uint64_t iid) {
-  auto field_it = interned_data_.find(field_id);
-  if (field_it != interned_data_.end()) {
-    auto* message_map = &field_it->second;
-    auto it = message_map->find(iid);
-    if (it != message_map->end()) {
-      return &it->second;
-    }
+  if (PERFETTO_LIKELY(field_id < interned_data_.size())) {
+    InternedMessageView* view = interned_data_[field_id].Find(iid);
+    if (PERFETTO_LIKELY(view))
+      return view;
   }
   state_->context()->storage->IncrementStats(
       stats::interned_data_tokenizer_errors);
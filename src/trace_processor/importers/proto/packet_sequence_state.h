@@ -19,7 +19,6 @@
 
 #include <stdint.h>
 
-#include <unordered_map>
 #include <vector>
 
 #include "perfetto/base/compiler.h"
@@ -29,6 +28,7 @@
 #include "src/trace_processor/importers/proto/stack_profile_tracker.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/types/trace_processor_context.h"
+#include "src/trace_processor/util/interned_message_table.h"
 #include "src/trace_processor/util/interned_message_view.h"
 
 #include "protos/perfetto/trace/trace_packet_defaults.pbzero.h"
@@ -37,10 +37,9 @@
 namespace perfetto {
 namespace trace_processor {
 
-using InternedMessageMap =
-    std::unordered_map<uint64_t /*iid*/, InternedMessageView>;
-using InternedFieldMap =
-    std::unordered_map<uint32_t /*field_id*/, InternedMessageMap>;
+// Interning tables of the fields of InternedData, indexed by field id (field
+// ids of InternedData are small).
+using InternedFieldMap = std::vector<InternedMessageTable>;
 
 class PacketSequenceState;
 
@@ -100,7 +99,7 @@ class PacketSequenceStateGeneration : public RefCounted {
                                 TraceBlobView defaults)
       : state_(state),
         generation_index_(generation_index),
-        interned_data_(interned_data),
+        interned_data_(std::move(interned_data)),
         trace_packet_defaults_(InternedMessageView(std::move(defaults))) {}
 
   void InternMessage(uint32_t field_id, TraceBlobView message);
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/proto/pipelined_proto_trace_tokenizer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/base/time.h"
+#include "perfetto/protozero/proto_utils.h"
+#include "src/trace_processor/util/status_macros.h"
+
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+using ResultCode = util::GzipDecompressor::ResultCode;
+
+constexpr uint8_t kTracePacketTag =
+    protozero::proto_utils::MakeTagLengthDelimited(
+        protos::pbzero::Trace::kPacketFieldNumber);
+
+// Max size of the packets (including the decompressed ones) of a batch and
+// max number of batches the tokenizer thread can get ahead of the calling
+// thread. Together they bound the decompressed data waiting to be parsed.
+constexpr size_t kMaxBatchBytes = 1024 * 1024;
+constexpr size_t kMaxBatchesInFlight = 4;
+
+}  // namespace
+
+constexpr uint32_t PipelinedProtoTraceTokenizer::kChunkBlob;
+
+PipelinedProtoTraceTokenizer::PipelinedProtoTraceTokenizer()
+    : chunks_(1), batches_(kMaxBatchesInFlight) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  PERFETTO_FATAL("Threads are not supported in WASM builds");
+#else
+  thread_ = std::thread(&PipelinedProtoTraceTokenizer::RunThread, this);
+#endif
+}
+
+PipelinedProtoTraceTokenizer::~PipelinedProtoTraceTokenizer() {
+  chunks_.Close();
+  batches_.Close();
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  thread_.join();
+#endif
+}
+
+util::Status PipelinedProtoTraceTokenizer::Tokenize(
+    TraceBlobView blob,
+    const PacketCallback& callback) {
+  // Never blocks: the previous chunk was consumed before returning.
+  if (!chunks_.Push(Chunk{blob.data(), blob.size()}))
+    return util::ErrStatus("Proto trace tokenization was stopped");
+
+  // Keep consuming the batches of the chunk after an error in |callback|: the
+  // tokenizer thread must be done with |blob| before returning.
+  util::Status status;
+  for (;;) {
+    Batch batch;
+    if (!batches_.Pop(&batch))
+      return util::ErrStatus("Proto trace tokenization was stopped");
+    decompression_duration_ns_ += batch.decompression_duration_ns;
+
+    std::vector<TraceBlobView> blobs;
+    blobs.reserve(batch.blobs.size());
+    for (TraceBlob& owned : batch.blobs)
+      blobs.emplace_back(std::move(owned));
+    for (const Packet& packet : batch.packets) {
+      if (!status.ok())
+        break;
+      const TraceBlobView& owner =
+          packet.blob == kChunkBlob ? blob : blobs[packet.blob];
+      status = callback(owner.slice(packet.data, packet.size));
+    }
+    if (batch.last)
+      return status.ok() ? batch.status : status;
+  }
+}
+
+void PipelinedProtoTraceTokenizer::RunThread() {
+  Chunk chunk;
+  while (chunks_.Pop(&chunk)) {
+    util::Status status = TokenizeChunk(chunk.data, chunk.size);
+    batch_.last = true;
+    batch_.status = status;
+    if (!FlushBatch())
+      return;
+  }
+}
+
+bool PipelinedProtoTraceTokenizer::FlushBatch() {
+  Batch batch = std::move(batch_);
+  batch_ = Batch();
+  batch_bytes_ = 0;
+  return batches_.Push(std::move(batch));
+}
+
+util::Status PipelinedProtoTraceTokenizer::TokenizeChunk(const uint8_t* data,
+                                                         size_t size) {
+  if (!partial_buf_.empty()) {
+    // It takes ~5 bytes for a proto preamble + the varint size.
+    const size_t kHeaderBytes = 5;
+    if (PERFETTO_UNLIKELY(partial_buf_.size() < kHeaderBytes)) {
+      size_t missing_len = std::min(kHeaderBytes - partial_buf_.size(), size);
+      partial_buf_.insert(partial_buf_.end(), &data[0], &data[missing_len]);
+      if (partial_buf_.size() < kHeaderBytes)
+        return util::OkStatus();
+      data += missing_len;
+      size -= missing_len;
+    }
+
+    // At this point we have enough data in |partial_buf_| to read at least
+    // the field header and know the size of the next TracePacket.
+    const uint8_t* pos = &partial_buf_[0];
+    uint8_t proto_field_tag = *pos;
+    uint64_t field_size = 0;
+    const uint8_t* next = protozero::proto_utils::ParseVarInt(
+        ++pos, &partial_buf_.front() + partial_buf_.size(), &field_size);
+    bool parse_failed = next == pos;
+    pos = next;
+    if (proto_field_tag != kTracePacketTag || field_size == 0 ||
+        parse_failed) {
+      return util::ErrStatus(
+          "Failed parsing a TracePacket from the partial buffer");
+    }
+
+    size_t hdr_size = static_cast<size_t>(pos - &partial_buf_[0]);
+    size_t size_incl_header = static_cast<size_t>(field_size + hdr_size);
+    PERFETTO_DCHECK(size_incl_header > partial_buf_.size());
+
+    if (partial_buf_.size() + size < size_incl_header) {
+      partial_buf_.insert(partial_buf_.end(), data, &data[size]);
+      return util::OkStatus();
+    }
+
+    // Glue the beginning of the TracePacket in |partial_buf_| with the rest of
+    // it in |data| into a new blob.
+    TraceBlob glued = TraceBlob::Allocate(size_incl_header);
+    memcpy(glued.data(), partial_buf_.data(), partial_buf_.size());
+    size_t size_missing = size_incl_header - partial_buf_.size();
+    memcpy(glued.data() + partial_buf_.size(), &data[0], size_missing);
+    data += size_missing;
+    size -= size_missing;
+    partial_buf_.clear();
+
+    const uint8_t* glued_data = glued.data();
+    batch_.blobs.emplace_back(std::move(glued));
+    uint32_t glued_blob = static_cast<uint32_t>(batch_.blobs.size() - 1);
+    RETURN_IF_ERROR(TokenizeBuffer(glued_blob, glued_data, size_incl_header));
+  }
+  return TokenizeBuffer(kChunkBlob, data, size);
+}
+
+util::Status PipelinedProtoTraceTokenizer::TokenizeBuffer(uint32_t blob,
+                                                          const uint8_t* data,
+                                                          size_t size) {
+  decompressed_.clear();
+  next_decompressed_ = 0;
+  protos::pbzero::Trace::Decoder decoder(data, size);
+  for (auto it = decoder.packet(); it; ++it) {
+    protozero::ConstBytes packet = *it;
+    RETURN_IF_ERROR(
+        TokenizePacket(blob, packet.data, packet.size, data + size));
+    if (blob == kChunkBlob && batch_bytes_ >= kMaxBatchBytes && !FlushBatch())
+      return util::ErrStatus("Proto trace tokenization was stopped");
+  }
+
+  const size_t bytes_left = decoder.bytes_left();
+  if (bytes_left > 0) {
+    PERFETTO_DCHECK(partial_buf_.empty());
+    partial_buf_.insert(partial_buf_.end(), &data[decoder.read_offset()],
+                        &data[decoder.read_offset() + bytes_left]);
+  }
+  return util::OkStatus();
+}
+
+util::Status PipelinedProtoTraceTokenizer::Decompress(
+    protozero::ConstBytes input,
+    const uint8_t* next_packet,
+    const uint8_t* buf_end) {
+  if (next_decompressed_ >= decompressed_.size() ||
+      decompressed_[next_decompressed_].first != input.data) {
+    if (!buf_end) {
+      std::vector<uint8_t> decompressed;
+      decompressed.reserve(input.size);
+      decompressor_.Reset();
+      ResultCode ret = decompressor_.FeedAndExtract(
+          input.data, input.size,
+          [&decompressed](const uint8_t* buffer, size_t len) {
+            decompressed.insert(decompressed.end(), buffer, buffer + len);
+          });
+      if (ret == ResultCode::kError || ret == ResultCode::kNeedsMoreInput) {
+        return util::ErrStatus("Failed to decompress (error code: %d)",
+                               static_cast<int>(ret));
+      }
+      batch_.blobs.emplace_back(
+          TraceBlob::CopyFrom(decompressed.data(), decompressed.size()));
+      return util::OkStatus();
+    }
+    next_decompressed_ = 0;
+    RETURN_IF_ERROR(ProtoTraceTokenizer::DecompressBatch(
+        input, next_packet, buf_end, &decompressed_));
+  }
+  batch_.blobs.emplace_back(
+      std::move(decompressed_[next_decompressed_++].second));
+  return util::OkStatus();
+}
+
+util::Status PipelinedProtoTraceTokenizer::TokenizePacket(
+    uint32_t blob,
+    const uint8_t* data,
+    size_t size,
+    const uint8_t* buf_end) {
+  protos::pbzero::TracePacket::Decoder decoder(data, size);
+  if (!decoder.has_compressed_packets()) {
+    batch_.packets.push_back(Packet{blob, data, size});
+    batch_bytes_ += size;
+    return util::OkStatus();
+  }
+
+  if (!util::IsGzipSupported())
+    return util::Status("Cannot decode compressed packets. Zlib not enabled");
+
+  protozero::ConstBytes field = decoder.compressed_packets();
+  base::TimeNanos start_ns = base::GetWallTimeNs();
+  util::Status status = Decompress(field, data + size, buf_end);
+  batch_.decompression_duration_ns +=
+      (base::GetWallTimeNs() - start_ns).count();
+  RETURN_IF_ERROR(status);
+
+  uint32_t packets_blob = static_cast<uint32_t>(batch_.blobs.size() - 1);
+  const uint8_t* start = batch_.blobs.back().data();
+  const uint8_t* end = start + batch_.blobs.back().size();
+  const uint8_t* ptr = start;
+  while ((end - ptr) > 2) {
+    const uint8_t* packet_outer = ptr;
+    if (PERFETTO_UNLIKELY(*ptr != kTracePacketTag))
+      return util::ErrStatus("Expected TracePacket tag");
+    uint64_t packet_size = 0;
+    ptr = protozero::proto_utils::ParseVarInt(++ptr, end, &packet_size);
+    const uint8_t* packet_start = ptr;
+    ptr += packet_size;
+    if (PERFETTO_UNLIKELY((ptr - packet_outer) < 2 || ptr > end))
+      return util::ErrStatus("Invalid packet size");
+
+    RETURN_IF_ERROR(TokenizePacket(packets_blob, packet_start,
+                                   static_cast<size_t>(packet_size),
+                                   nullptr));
+  }
+  return util::OkStatus();
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
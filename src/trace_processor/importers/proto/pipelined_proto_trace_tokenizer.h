@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PIPELINED_PROTO_TRACE_TOKENIZER_H_
+#define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PIPELINED_PROTO_TRACE_TOKENIZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/protozero/field.h"
+#include "perfetto/trace_processor/status.h"
+#include "perfetto/trace_processor/trace_blob.h"
+#include "perfetto/trace_processor/trace_blob_view.h"
+#include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
+#include "src/trace_processor/util/bounded_queue.h"
+#include "src/trace_processor/util/gzip_utils.h"
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+#include <thread>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+
+// Like ProtoTraceTokenizer, splits a protobuf trace into its packets
+// (decompressing compressed packets) but does so on a dedicated thread: the
+// packets of a chunk are passed to the callback on the calling thread in
+// batches, while the tokenizer thread works on the following ones.
+//
+// The refcount of TraceBlobView is not thread safe, so the tokenizer thread
+// never touches the views passed to Tokenize(): it only reads their bytes and
+// hands back the boundaries of the packets, together with the TraceBlobs it
+// allocated for decompressed packets and for packets split across chunks. All
+// the views are created on the calling thread.
+//
+// Not available in WASM builds, which are single threaded.
+class PipelinedProtoTraceTokenizer {
+ public:
+  using PacketCallback = std::function<util::Status(TraceBlobView)>;
+
+  PipelinedProtoTraceTokenizer();
+  ~PipelinedProtoTraceTokenizer();
+
+  // Tokenizes |blob| and passes its packets to |callback|, in order. Returns
+  // once all the packets of |blob| have been passed to |callback| or at the
+  // first error, after the packets preceding it.
+  util::Status Tokenize(TraceBlobView blob, const PacketCallback& callback);
+
+  // Wall time spent decompressing compressed packets so far.
+  int64_t decompression_duration_ns() const {
+    return decompression_duration_ns_;
+  }
+
+ private:
+  // The bytes of a chunk passed to Tokenize().
+  struct Chunk {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+  };
+
+  // A packet in the current chunk (if |blob| is kChunkBlob) or in one of the
+  // blobs of the Batch it belongs to.
+  struct Packet {
+    uint32_t blob;
+    const uint8_t* data;
+    size_t size;
+  };
+  static constexpr uint32_t kChunkBlob = static_cast<uint32_t>(-1);
+
+  // A run of consecutive packets of a chunk.
+  struct Batch {
+    std::vector<TraceBlob> blobs;
+    std::vector<Packet> packets;
+    int64_t decompression_duration_ns = 0;
+
+    // Set on the last batch of each chunk, with the status of its
+    // tokenization.
+    bool last = false;
+    util::Status status;
+  };
+
+  // Body of the tokenizer thread.
+  void RunThread();
+
+  // The following methods run on the tokenizer thread. They mirror the ones
+  // of ProtoTraceTokenizer, adding the packets to |batch_|. Batches are only
+  // flushed between the top-level packets of the chunk, so that the blobs
+  // of a batch are never referenced by the packets of another one.
+  util::Status TokenizeChunk(const uint8_t* data, size_t size);
+  util::Status TokenizeBuffer(uint32_t blob, const uint8_t* data, size_t size);
+
+  // |buf_end| is the end of the buffer which contains the packet and the
+  // packets following it, or null if the packet is nested in a compressed
+  // packet. Runs of top-level compressed packets are decompressed in parallel
+  // with ProtoTraceTokenizer::DecompressBatch().
+  util::Status TokenizePacket(uint32_t blob,
+                              const uint8_t* data,
+                              size_t size,
+                              const uint8_t* buf_end);
+
+  // Appends the decompressed content of |input| to |batch_.blobs|.
+  util::Status Decompress(protozero::ConstBytes input,
+                          const uint8_t* next_packet,
+                          const uint8_t* buf_end);
+
+  // Hands |batch_| over to the calling thread. Returns false if the pipeline
+  // was stopped.
+  bool FlushBatch();
+
+  util::BoundedQueue<Chunk> chunks_;
+  util::BoundedQueue<Batch> batches_;
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  std::thread thread_;
+#endif
+
+  // Only accessed on the calling thread.
+  int64_t decompression_duration_ns_ = 0;
+
+  // Only accessed on the tokenizer thread.
+  std::vector<uint8_t> partial_buf_;
+  util::GzipDecompressor decompressor_;
+  // The current batch of decompressed top-level packets.
+  std::vector<ProtoTraceTokenizer::DecompressedPacket> decompressed_;
+  size_t next_decompressed_ = 0;
+  Batch batch_;
+  size_t batch_bytes_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PIPELINED_PROTO_TRACE_TOKENIZER_H_
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/proto/pipelined_proto_trace_tokenizer.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace/test_event.pbzero.h"
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+
+std::string Compress(const std::string& input) {
+  std::string output(compressBound(static_cast<uLong>(input.size())), '\0');
+  uLongf output_size = static_cast<uLongf>(output.size());
+  PERFETTO_CHECK(compress(reinterpret_cast<Bytef*>(&output[0]), &output_size,
+                          reinterpret_cast<const Bytef*>(input.data()),
+                          static_cast<uLong>(input.size())) == Z_OK);
+  output.resize(output_size);
+  return output;
+}
+
+class PipelinedProtoTraceTokenizerTest : public ::testing::Test {
+ protected:
+  void AddPacket(uint64_t ts, size_t padding = 0) {
+    auto* packet = trace_->add_packet();
+    packet->set_timestamp(ts);
+    if (padding)
+      packet->set_for_testing()->set_str(std::string(padding, 'x'));
+  }
+
+  // Adds a compressed packet containing packets with timestamps |ts|.
+  void AddCompressedPacket(const std::vector<uint64_t>& ts) {
+    protozero::HeapBuffered<protos::pbzero::Trace> inner;
+    for (uint64_t t : ts)
+      inner->add_packet()->set_timestamp(t);
+    trace_->add_packet()->set_compressed_packets(
+        Compress(inner.SerializeAsString()));
+  }
+
+  void AddRawCompressedPacket(const std::string& bytes) {
+    trace_->add_packet()->set_compressed_packets(bytes);
+  }
+
+  // Passes the trace to the tokenizer in chunks of |chunk_size| bytes,
+  // stopping at the first error.
+  util::Status Tokenize(size_t chunk_size = 0) {
+    std::string trace = trace_.SerializeAsString();
+    if (!chunk_size)
+      chunk_size = trace.size();
+    for (size_t off = 0; off < trace.size(); off += chunk_size) {
+      size_t size = std::min(chunk_size, trace.size() - off);
+      TraceBlobView chunk(TraceBlob::CopyFrom(trace.data() + off, size));
+      util::Status status = tokenizer_.Tokenize(
+          std::move(chunk), [this](TraceBlobView packet) {
+            protos::pbzero::TracePacket::Decoder decoder(packet.data(),
+                                                         packet.length());
+            timestamps_.push_back(decoder.timestamp());
+            if (decoder.timestamp() == fail_at_)
+              return util::ErrStatus("Callback failure");
+            return util::OkStatus();
+          });
+      if (!status.ok())
+        return status;
+    }
+    return util::OkStatus();
+  }
+
+  protozero::HeapBuffered<protos::pbzero::Trace> trace_;
+  PipelinedProtoTraceTokenizer tokenizer_;
+  std::vector<uint64_t> timestamps_;
+  uint64_t fail_at_ = static_cast<uint64_t>(-1);
+};
+
+TEST_F(PipelinedProtoTraceTokenizerTest, PacketsSplitAcrossChunks) {
+  std::vector<uint64_t> expected;
+  for (uint64_t ts = 0; ts < 100; ts++) {
+    AddPacket(ts, ts % 10);
+    expected.push_back(ts);
+  }
+  ASSERT_TRUE(Tokenize(/*chunk_size=*/3).ok());
+  ASSERT_EQ(timestamps_, expected);
+}
+
+TEST_F(PipelinedProtoTraceTokenizerTest, ManyBatches) {
+  // Enough data for the tokenizer thread to fill several batches.
+  std::vector<uint64_t> expected;
+  for (uint64_t ts = 0; ts < 10000; ts++) {
+    AddPacket(ts, 1000);
+    expected.push_back(ts);
+  }
+  ASSERT_TRUE(Tokenize(/*chunk_size=*/1024 * 1024 + 7).ok());
+  ASSERT_EQ(timestamps_, expected);
+}
+
+TEST_F(PipelinedProtoTraceTokenizerTest, CompressedPackets) {
+  AddPacket(1);
+  AddCompressedPacket({2, 3});
+  AddCompressedPacket({4});
+  AddCompressedPacket({5, 6});
+  AddPacket(7);
+  AddCompressedPacket({8});
+  ASSERT_TRUE(Tokenize(/*chunk_size=*/5).ok());
+  ASSERT_THAT(timestamps_, ElementsAre(1, 2, 3, 4, 5, 6, 7, 8));
+  ASSERT_GT(tokenizer_.decompression_duration_ns(), 0);
+}
+
+TEST_F(PipelinedProtoTraceTokenizerTest, NestedCompressedPackets) {
+  protozero::HeapBuffered<protos::pbzero::Trace> inner;
+  inner->add_packet()->set_timestamp(2);
+  protozero::HeapBuffered<protos::pbzero::Trace> innermost;
+  innermost->add_packet()->set_timestamp(3);
+  inner->add_packet()->set_compressed_packets(
+      Compress(innermost.SerializeAsString()));
+  inner->add_packet()->set_timestamp(4);
+
+  AddPacket(1);
+  AddRawCompressedPacket(Compress(inner.SerializeAsString()));
+  AddCompressedPacket({5});
+  ASSERT_TRUE(Tokenize().ok());
+  ASSERT_THAT(timestamps_, ElementsAre(1, 2, 3, 4, 5));
+}
+
+TEST_F(PipelinedProtoTraceTokenizerTest, DecompressionErrorAfterPackets) {
+  AddPacket(1);
+  AddCompressedPacket({2});
+  AddRawCompressedPacket("not gzip");
+  AddCompressedPacket({3});
+  util::Status status = Tokenize();
+  ASSERT_FALSE(status.ok());
+  ASSERT_THAT(status.message(), ::testing::HasSubstr("Failed to decompress"));
+  ASSERT_THAT(timestamps_, ElementsAre(1, 2));
+}
+
+TEST_F(PipelinedProtoTraceTokenizerTest, CallbackError) {
+  for (uint64_t ts = 0; ts < 10000; ts++)
+    AddPacket(ts, 1000);
+  fail_at_ = 5;
+  util::Status status = Tokenize();
+  ASSERT_FALSE(status.ok());
+  ASSERT_EQ(status.message(), "Callback failure");
+  ASSERT_THAT(timestamps_, ElementsAre(0, 1, 2, 3, 4, 5));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -39,6 +39,7 @@
 #include "src/trace_processor/importers/ftrace/ftrace_module.h"
 #include "src/trace_processor/importers/proto/metadata_tracker.h"
 #include "src/trace_processor/importers/proto/packet_sequence_state.h"
+#include "src/trace_processor/importers/proto/track_event_module.h"
 #include "src/trace_processor/storage/metadata.h"
 #include "src/trace_processor/storage/stats.h"
 #include "src/trace_processor/timestamped_trace_piece.h"
@@ -78,18 +79,24 @@ ProtoTraceParser::ProtoTraceParser(TraceProcessorContext* context)
 ProtoTraceParser::~ProtoTraceParser() = default;
 
 void ProtoTraceParser::ParseTracePacket(int64_t ts, TimestampedTracePiece ttp) {
+  TrackEventData* track_event_data = nullptr;
   const TracePacketData* data = nullptr;
-  if (ttp.type == TimestampedTracePiece::Type::kTracePacket) {
-    data = &ttp.packet_data;
+  if (ttp.type == TimestampedTracePiece::Type::kTrackEvent) {
+    track_event_data = &ttp.track_event_data;
+    data = track_event_data;
   } else {
-    PERFETTO_DCHECK(ttp.type == TimestampedTracePiece::Type::kTrackEvent);
-    data = ttp.track_event_data.get();
+    PERFETTO_DCHECK(ttp.type == TimestampedTracePiece::Type::kTracePacket);
+    data = &ttp.packet_data;
   }
 
   const TraceBlobView& blob = data->packet;
   protos::pbzero::TracePacket::Decoder packet(blob.data(), blob.length());
 
-  ParseTracePacketImpl(ts, ttp, data->sequence_state.get(), packet);
+  if (track_event_data) {
+    context_->track_module->ParseTrackEventData(packet, ts, track_event_data);
+  } else {
+    ParseTracePacketImpl(ts, ttp, data->sequence_state.get(), packet);
+  }
 
   // TODO(lalitm): maybe move this to the flush method in the trace processor
   // once we have it. This may reduce performance in the ArgsTracker though so
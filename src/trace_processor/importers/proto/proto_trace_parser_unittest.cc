@@ -266,13 +266,12 @@ class ProtoTraceParserTest : public ::testing::Test {
   }
 
   bool HasArg(ArgSetId set_id, StringId key_id, Variadic value) {
-    const auto& args = storage_->arg_table();
-    RowMap rm = args.FilterToRowMap({args.arg_set_id().eq(set_id)});
+    auto args = storage_->arg_sets().Get(set_id);
     bool found = false;
-    for (auto it = rm.IterateRows(); it; it.Next()) {
-      if (args.key()[it.index()] == key_id) {
-        EXPECT_EQ(args.flat_key()[it.index()], key_id);
-        if (storage_->GetArgValue(it.index()) == value) {
+    for (uint32_t i = 0; i < args.size(); ++i) {
+      if (args.key(i) == key_id) {
+        EXPECT_EQ(args.flat_key(i), key_id);
+        if (args.value(i) == value) {
           found = true;
           break;
         }
@@ -357,21 +356,27 @@ TEST_F(ProtoTraceParserTest, LoadEventsIntoRaw) {
 
   const auto& raw = context_.storage->raw_table();
   ASSERT_EQ(raw.row_count(), 2u);
-  const auto& args = context_.storage->arg_table();
-  ASSERT_EQ(args.row_count(), 6u);
+  ASSERT_EQ(context_.storage->arg_sets().arg_count(), 6u);
   // Order is by row and then by StringIds.
-  ASSERT_EQ(args.key()[0], context_.storage->InternString("comm"));
-  ASSERT_EQ(args.key()[1], context_.storage->InternString("pid"));
-  ASSERT_EQ(args.key()[2], context_.storage->InternString("oom_score_adj"));
-  ASSERT_EQ(args.key()[3], context_.storage->InternString("clone_flags"));
-  ASSERT_EQ(args.key()[4], context_.storage->InternString("ip"));
-  ASSERT_EQ(args.key()[5], context_.storage->InternString("buf"));
-  ASSERT_STREQ(args.string_value().GetString(0).c_str(), task_newtask);
-  ASSERT_EQ(args.int_value()[1], 123);
-  ASSERT_EQ(args.int_value()[2], 15);
-  ASSERT_EQ(args.int_value()[3], 12);
-  ASSERT_EQ(args.int_value()[4], 20);
-  ASSERT_STREQ(args.string_value().GetString(5).c_str(), buf_value);
+  auto args = context_.storage->arg_sets().Get(raw.arg_set_id()[0]);
+  ASSERT_EQ(args.size(), 4u);
+  ASSERT_EQ(args.key(0), context_.storage->InternString("comm"));
+  ASSERT_EQ(args.key(1), context_.storage->InternString("pid"));
+  ASSERT_EQ(args.key(2), context_.storage->InternString("oom_score_adj"));
+  ASSERT_EQ(args.key(3), context_.storage->InternString("clone_flags"));
+  ASSERT_STREQ(context_.storage->GetString(args.value(0).string_value).c_str(),
+               task_newtask);
+  ASSERT_EQ(args.value(1).int_value, 123);
+  ASSERT_EQ(args.value(2).int_value, 15);
+  ASSERT_EQ(args.value(3).int_value, 12);
+
+  args = context_.storage->arg_sets().Get(raw.arg_set_id()[1]);
+  ASSERT_EQ(args.size(), 2u);
+  ASSERT_EQ(args.key(0), context_.storage->InternString("ip"));
+  ASSERT_EQ(args.key(1), context_.storage->InternString("buf"));
+  ASSERT_EQ(args.value(0).int_value, 20);
+  ASSERT_STREQ(context_.storage->GetString(args.value(1).string_value).c_str(),
+               buf_value);
 
   // TODO(hjd): Add test ftrace event with all field types
   // and test here.
@@ -416,19 +421,17 @@ TEST_F(ProtoTraceParserTest, LoadGenericFtrace) {
 
   auto set_id = raw.arg_set_id()[raw.row_count() - 1];
 
-  const auto& args = storage_->arg_table();
-  RowMap rm = args.FilterToRowMap({args.arg_set_id().eq(set_id)});
+  auto args = storage_->arg_sets().Get(set_id);
+  ASSERT_EQ(args.size(), 3u);
 
-  auto row = rm.Get(0);
+  ASSERT_EQ(storage_->GetString(args.key(0)), "meta1");
+  ASSERT_EQ(storage_->GetString(args.value(0).string_value), "value1");
 
-  ASSERT_EQ(args.key().GetString(row), "meta1");
-  ASSERT_EQ(args.string_value().GetString(row++), "value1");
+  ASSERT_EQ(storage_->GetString(args.key(1)), "meta2");
+  ASSERT_EQ(args.value(1).int_value, -2);
 
-  ASSERT_EQ(args.key().GetString(row), "meta2");
-  ASSERT_EQ(args.int_value()[row++], -2);
-
-  ASSERT_EQ(args.key().GetString(row), "meta3");
-  ASSERT_EQ(args.int_value()[row++], 3);
+  ASSERT_EQ(storage_->GetString(args.key(2)), "meta3");
+  ASSERT_EQ(args.value(2).int_value, 3);
 }
 
 TEST_F(ProtoTraceParserTest, LoadMultipleEvents) {
@@ -2339,7 +2342,7 @@ TEST_F(ProtoTraceParserTest, TrackEventParseLegacyEventIntoRawTable) {
   EXPECT_EQ(raw_table.utid()[0], 1u);
   EXPECT_EQ(raw_table.arg_set_id()[0], 1u);
 
-  EXPECT_GE(storage_->arg_table().row_count(), 10u);
+  EXPECT_GE(storage_->arg_sets().arg_count(), 10u);
 
   EXPECT_TRUE(HasArg(1u, storage_->InternString("legacy_event.category"),
                      Variadic::String(cat_1)));
@@ -2456,7 +2459,7 @@ TEST_F(ProtoTraceParserTest, ParseChromeMetadataEventIntoRawTable) {
             storage_->InternString("chrome_event.metadata"));
   EXPECT_EQ(raw_table.arg_set_id()[0], 1u);
 
-  EXPECT_EQ(storage_->arg_table().row_count(), 2u);
+  EXPECT_EQ(storage_->arg_sets().arg_count(), 2u);
   EXPECT_TRUE(HasArg(1u, storage_->InternString(kStringName),
                      Variadic::String(storage_->InternString(kStringValue))));
   EXPECT_TRUE(HasArg(1u, storage_->InternString(kIntName),
@@ -2503,7 +2506,7 @@ TEST_F(ProtoTraceParserTest, ParseChromeCombinedMetadataPacket) {
             storage_->InternString("chrome_event.metadata"));
   EXPECT_EQ(raw_table.arg_set_id()[0], 1u);
 
-  EXPECT_EQ(storage_->arg_table().row_count(), 1u);
+  EXPECT_EQ(storage_->arg_sets().arg_count(), 1u);
   EXPECT_TRUE(HasArg(1u, storage_->InternString(kStringName),
                      Variadic::String(storage_->InternString(kStringValue))));
 }
@@ -2532,7 +2535,7 @@ TEST_F(ProtoTraceParserTest, ParseChromeLegacyFtraceIntoRawTable) {
             storage_->InternString("chrome_event.legacy_system_trace"));
   EXPECT_EQ(raw_table.arg_set_id()[0], 1u);
 
-  EXPECT_EQ(storage_->arg_table().row_count(), 1u);
+  EXPECT_EQ(storage_->arg_sets().arg_count(), 1u);
   EXPECT_TRUE(HasArg(1u, storage_->InternString("data"),
                      Variadic::String(storage_->InternString(kFullData))));
 }
@@ -2560,7 +2563,7 @@ TEST_F(ProtoTraceParserTest, ParseChromeLegacyJsonIntoRawTable) {
             storage_->InternString("chrome_event.legacy_user_trace"));
   EXPECT_EQ(raw_table.arg_set_id()[0], 1u);
 
-  EXPECT_EQ(storage_->arg_table().row_count(), 1u);
+  EXPECT_EQ(storage_->arg_sets().arg_count(), 1u);
   EXPECT_TRUE(
       HasArg(1u, storage_->InternString("data"),
              Variadic::String(storage_->InternString(kUserTraceEvent))));
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/importers/proto/proto_trace_reader.h"
 
+#include <stdlib.h>
+
 #include <string>
 
 #include "perfetto/base/build_config.h"
@@ -32,6 +34,7 @@
 #include "src/trace_processor/importers/ftrace/ftrace_module.h"
 #include "src/trace_processor/importers/proto/metadata_tracker.h"
 #include "src/trace_processor/importers/proto/packet_sequence_state.h"
+#include "src/trace_processor/importers/proto/pipelined_proto_trace_tokenizer.h"
 #include "src/trace_processor/importers/proto/proto_incremental_state.h"
 #include "src/trace_processor/storage/stats.h"
 #include "src/trace_processor/storage/trace_storage.h"
@@ -51,14 +54,47 @@
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+bool IsPipelineEnabled() {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  return false;
+#else
+  // Shares the kill switch of the reader thread in ReadTrace().
+  const char* no_pipeline = getenv("TRACE_PROCESSOR_NO_PIPELINE");
+  return !no_pipeline || *no_pipeline != '1';
+#endif
+}
+
+}  // namespace
+
 ProtoTraceReader::ProtoTraceReader(TraceProcessorContext* ctx)
-    : context_(ctx) {}
+    : context_(ctx) {
+  if (IsPipelineEnabled())
+    pipelined_tokenizer_.reset(new PipelinedProtoTraceTokenizer());
+}
 ProtoTraceReader::~ProtoTraceReader() = default;
 
 util::Status ProtoTraceReader::Parse(TraceBlobView blob) {
-  return tokenizer_.Tokenize(std::move(blob), [this](TraceBlobView packet) {
+  auto parse_packet = [this](TraceBlobView packet) {
     return ParsePacket(std::move(packet));
-  });
+  };
+  util::Status status;
+  int64_t decompression_duration_ns = 0;
+  if (pipelined_tokenizer_) {
+    status = pipelined_tokenizer_->Tokenize(std::move(blob), parse_packet);
+    decompression_duration_ns =
+        pipelined_tokenizer_->decompression_duration_ns();
+  } else {
+    status = tokenizer_.Tokenize(std::move(blob), parse_packet);
+    decompression_duration_ns = tokenizer_.decompression_duration_ns();
+  }
+  if (decompression_duration_ns > 0) {
+    context_->storage->SetStats(
+        stats::compressed_packets_decompression_duration_ns,
+        decompression_duration_ns);
+  }
+  return status;
 }
 
 util::Status ProtoTraceReader::ParseExtensionDescriptor(ConstBytes descriptor) {
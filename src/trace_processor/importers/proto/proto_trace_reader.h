@@ -41,6 +41,7 @@ class TraceConfig_Decoder;
 namespace trace_processor {
 
 class PacketSequenceState;
+class PipelinedProtoTraceTokenizer;
 class TraceProcessorContext;
 class TraceSorter;
 class TraceStorage;
@@ -49,6 +50,10 @@ class TraceStorage;
 // trace into packets, handles parsing of any packets which need to be
 // handled in trace-order and passes the remainder to TraceSorter to sort
 // into timestamp order.
+//
+// Unless disabled with TRACE_PROCESSOR_NO_PIPELINE=1 (and in WASM builds),
+// tokenization runs on a separate thread, pipelined with the parsing and
+// sorting of the packets on the calling thread.
 class ProtoTraceReader : public ChunkedTraceReader {
  public:
   // |reader| is the abstract method of getting chunks of size |chunk_size_b|
@@ -87,6 +92,7 @@ class ProtoTraceReader : public ChunkedTraceReader {
   TraceProcessorContext* context_;
 
   ProtoTraceTokenizer tokenizer_;
+  std::unique_ptr<PipelinedProtoTraceTokenizer> pipelined_tokenizer_;
 
   // Temporary. Currently trace packets do not have a timestamp, so the
   // timestamp given is latest_timestamp_.
@@ -17,28 +17,62 @@
 #include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
 #include "perfetto/trace_processor/trace_blob.h"
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/utils.h"
+#include "perfetto/protozero/proto_decoder.h"
+
+// WASM builds are single threaded: batches of compressed packets are
+// decompressed on the calling thread.
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+#include <thread>
+#endif
 
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+using ResultCode = util::GzipDecompressor::ResultCode;
+
+// Max size of the compressed packets decompressed in one batch. This bounds
+// the amount of decompressed data waiting to be tokenized.
+constexpr size_t kMaxBatchBytes = 4 * 1024 * 1024;
+
+// Max number of threads, including the calling one, decompressing a batch.
+constexpr size_t kMaxDecompressionThreads = 8;
+
+ResultCode DecompressStream(util::GzipDecompressor* decompressor,
+                            protozero::ConstBytes input,
+                            std::vector<uint8_t>* output) {
+  output->reserve(input.size);
+
+  // Ensure that the decompressor is able to cope with a new stream of data.
+  decompressor->Reset();
+  return decompressor->FeedAndExtract(
+      input.data, input.size, [output](const uint8_t* buffer, size_t len) {
+        output->insert(output->end(), buffer, buffer + len);
+      });
+}
+
+}  // namespace
+
 ProtoTraceTokenizer::ProtoTraceTokenizer() = default;
 
 util::Status ProtoTraceTokenizer::Decompress(TraceBlobView input,
                                              TraceBlobView* output) {
   PERFETTO_DCHECK(util::IsGzipSupported());
 
+  base::TimeNanos start_ns = base::GetWallTimeNs();
   std::vector<uint8_t> data;
-  data.reserve(input.length());
-
-  // Ensure that the decompressor is able to cope with a new stream of data.
-  decompressor_.Reset();
-  using ResultCode = util::GzipDecompressor::ResultCode;
-  ResultCode ret = decompressor_.FeedAndExtract(
-      input.data(), input.length(),
-      [&data](const uint8_t* buffer, size_t buffer_len) {
-        data.insert(data.end(), buffer, buffer + buffer_len);
-      });
+  ResultCode ret = DecompressStream(
+      &decompressor_, protozero::ConstBytes{input.data(), input.length()},
+      &data);
+  decompression_duration_ns_ += (base::GetWallTimeNs() - start_ns).count();
 
   if (ret == ResultCode::kError || ret == ResultCode::kNeedsMoreInput) {
     return util::ErrStatus("Failed to decompress (error code: %d)",
@@ -50,5 +84,89 @@ util::Status ProtoTraceTokenizer::Decompress(TraceBlobView input,
   return util::OkStatus();
 }
 
+util::Status ProtoTraceTokenizer::DecompressNextBatch(
+    protozero::ConstBytes first,
+    const uint8_t* next_packet,
+    const uint8_t* buf_end) {
+  base::TimeNanos start_ns = base::GetWallTimeNs();
+  std::vector<DecompressedPacket> output;
+  util::Status status = DecompressBatch(first, next_packet, buf_end, &output);
+  decompression_duration_ns_ += (base::GetWallTimeNs() - start_ns).count();
+
+  decompressed_.clear();
+  next_decompressed_ = 0;
+  for (DecompressedPacket& packet : output)
+    decompressed_.emplace_back(packet.first,
+                               TraceBlobView(std::move(packet.second)));
+  return status;
+}
+
+// static
+util::Status ProtoTraceTokenizer::DecompressBatch(
+    protozero::ConstBytes first,
+    const uint8_t* next_packet,
+    const uint8_t* buf_end,
+    std::vector<DecompressedPacket>* output) {
+  PERFETTO_DCHECK(util::IsGzipSupported());
+
+  // The service writes compressed packets back to back: stop at the first
+  // uncompressed one rather than scanning the whole buffer.
+  std::vector<protozero::ConstBytes> inputs{first};
+  size_t batch_bytes = first.size;
+  protos::pbzero::Trace::Decoder trace(
+      next_packet, static_cast<size_t>(buf_end - next_packet));
+  for (auto it = trace.packet(); it && batch_bytes < kMaxBatchBytes; ++it) {
+    protozero::ProtoDecoder packet(*it);
+    protozero::Field field = packet.FindField(
+        protos::pbzero::TracePacket::kCompressedPacketsFieldNumber);
+    if (!field.valid())
+      break;
+    inputs.push_back(field.as_bytes());
+    batch_bytes += field.size();
+  }
+
+  std::vector<std::unique_ptr<TraceBlob>> outputs(inputs.size());
+  std::vector<ResultCode> results(inputs.size(), ResultCode::kOk);
+  std::atomic<size_t> next_input{0};
+  auto decompress_inputs = [&inputs, &outputs, &results, &next_input] {
+    util::GzipDecompressor decompressor;
+    for (size_t i = next_input++; i < inputs.size(); i = next_input++) {
+      std::vector<uint8_t> data;
+      results[i] = DecompressStream(&decompressor, inputs[i], &data);
+      outputs[i].reset(
+          new TraceBlob(TraceBlob::CopyFrom(data.data(), data.size())));
+    }
+  };
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  decompress_inputs();
+#else
+  size_t num_threads =
+      std::min({inputs.size(), kMaxDecompressionThreads,
+                std::max<size_t>(std::thread::hardware_concurrency(), 1)});
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++)
+    threads.emplace_back(decompress_inputs);
+  decompress_inputs();
+  for (std::thread& thread : threads)
+    thread.join();
+#endif
+
+  output->clear();
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (results[i] == ResultCode::kError ||
+        results[i] == ResultCode::kNeedsMoreInput) {
+      // Report the failure only when the tokenizer gets to the broken packet,
+      // after the ones preceding it have been handed out.
+      if (i > 0)
+        break;
+      return util::ErrStatus("Failed to decompress (error code: %d)",
+                             static_cast<int>(results[i]));
+    }
+    output->emplace_back(inputs[i].data, std::move(*outputs[i]));
+  }
+  return util::OkStatus();
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -17,6 +17,7 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PROTO_TRACE_TOKENIZER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PROTO_TRACE_TOKENIZER_H_
 
+#include <utility>
 #include <vector>
 
 #include "perfetto/protozero/proto_utils.h"
@@ -38,6 +39,28 @@ class ProtoTraceTokenizer {
  public:
   ProtoTraceTokenizer();
 
+  // Wall time spent decompressing compressed packets so far.
+  int64_t decompression_duration_ns() const {
+    return decompression_duration_ns_;
+  }
+
+  // The content of a compressed packet, keyed by the address of its
+  // compressed_packets field.
+  using DecompressedPacket = std::pair<const uint8_t*, TraceBlob>;
+
+  // Decompresses |first| together with the compressed packets which directly
+  // follow it in [|next_packet|, |buf_end|). As each compressed packet is an
+  // independent gzip stream, the batch is decompressed on multiple threads.
+  // |output| stops before the first packet which fails to decompress: the
+  // failure is only returned if it's |first|, so that it is reported when the
+  // tokenizer gets to the broken packet.
+  //
+  // Only reads the passed bytes, so it can be called from any thread.
+  static util::Status DecompressBatch(protozero::ConstBytes first,
+                                      const uint8_t* next_packet,
+                                      const uint8_t* buf_end,
+                                      std::vector<DecompressedPacket>* output);
+
   template <typename Callback = util::Status(TraceBlobView)>
   util::Status Tokenize(TraceBlobView blob, Callback callback) {
     const uint8_t* data = blob.data();
@@ -113,11 +136,14 @@ class ProtoTraceTokenizer {
   template <typename Callback = util::Status(TraceBlobView)>
   util::Status ParseInternal(TraceBlobView whole_buf, Callback callback) {
     const uint8_t* const start = whole_buf.data();
+    const uint8_t* const end = start + whole_buf.size();
+    decompressed_.clear();
+    next_decompressed_ = 0;
     protos::pbzero::Trace::Decoder decoder(whole_buf.data(), whole_buf.size());
     for (auto it = decoder.packet(); it; ++it) {
       protozero::ConstBytes packet = *it;
       TraceBlobView sliced = whole_buf.slice(packet.data, packet.size);
-      RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback));
+      RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback, end));
     }
 
     const size_t bytes_left = decoder.bytes_left();
@@ -129,8 +155,12 @@ class ProtoTraceTokenizer {
     return util::OkStatus();
   }
 
+  // |buf_end| is the end of the buffer which contains |packet| and the packets
+  // following it, or null if |packet| is nested in a compressed packet.
   template <typename Callback = util::Status(TraceBlobView)>
-  util::Status ParsePacket(TraceBlobView packet, Callback callback) {
+  util::Status ParsePacket(TraceBlobView packet,
+                           Callback callback,
+                           const uint8_t* buf_end = nullptr) {
     protos::pbzero::TracePacket::Decoder decoder(packet.data(),
                                                  packet.length());
     if (decoder.has_compressed_packets()) {
@@ -140,10 +170,18 @@ class ProtoTraceTokenizer {
       }
 
       protozero::ConstBytes field = decoder.compressed_packets();
-      TraceBlobView compressed_packets = packet.slice(field.data, field.size);
       TraceBlobView packets;
-
-      RETURN_IF_ERROR(Decompress(std::move(compressed_packets), &packets));
+      if (!TakeDecompressed(field.data, &packets)) {
+        if (buf_end) {
+          const uint8_t* next_packet = packet.data() + packet.length();
+          RETURN_IF_ERROR(DecompressNextBatch(field, next_packet, buf_end));
+          PERFETTO_CHECK(TakeDecompressed(field.data, &packets));
+        } else {
+          TraceBlobView compressed_packets =
+              packet.slice(field.data, field.size);
+          RETURN_IF_ERROR(Decompress(std::move(compressed_packets), &packets));
+        }
+      }
 
       const uint8_t* start = packets.data();
       const uint8_t* end = packets.data() + packets.length();
@@ -170,12 +208,37 @@ class ProtoTraceTokenizer {
 
   util::Status Decompress(TraceBlobView input, TraceBlobView* output);
 
+  // Replaces the current batch of decompressed packets with the one starting
+  // at |first| (see DecompressBatch()). The results are then consumed in order
+  // by TakeDecompressed().
+  util::Status DecompressNextBatch(protozero::ConstBytes first,
+                                   const uint8_t* next_packet,
+                                   const uint8_t* buf_end);
+
+  // If |compressed| is the next compressed packet of the current batch, moves
+  // its decompressed content in |output| and returns true.
+  bool TakeDecompressed(const uint8_t* compressed, TraceBlobView* output) {
+    if (next_decompressed_ >= decompressed_.size() ||
+        decompressed_[next_decompressed_].first != compressed) {
+      return false;
+    }
+    *output = std::move(decompressed_[next_decompressed_++].second);
+    return true;
+  }
+
   // Used to glue together trace packets that span across two (or more)
   // Parse() boundaries.
   std::vector<uint8_t> partial_buf_;
 
   // Allows support for compressed trace packets.
   util::GzipDecompressor decompressor_;
+
+  // The current batch of decompressed packets (see DecompressNextBatch()),
+  // keyed by the address of their compressed_packets field.
+  std::vector<std::pair<const uint8_t*, TraceBlobView>> decompressed_;
+  size_t next_decompressed_ = 0;
+
+  int64_t decompression_duration_ns_ = 0;
 };
 
 }  // namespace trace_processor
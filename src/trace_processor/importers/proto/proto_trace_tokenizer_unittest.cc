@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
+
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+
+std::string Compress(const std::string& input) {
+  std::string output(compressBound(static_cast<uLong>(input.size())), '\0');
+  uLongf output_size = static_cast<uLongf>(output.size());
+  PERFETTO_CHECK(compress(reinterpret_cast<Bytef*>(&output[0]), &output_size,
+                          reinterpret_cast<const Bytef*>(input.data()),
+                          static_cast<uLong>(input.size())) == Z_OK);
+  output.resize(output_size);
+  return output;
+}
+
+// Returns the serialized packets with timestamps |ts|.
+std::string Packets(const std::vector<uint64_t>& ts) {
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  for (uint64_t t : ts)
+    trace->add_packet()->set_timestamp(t);
+  return trace.SerializeAsString();
+}
+
+class ProtoTraceTokenizerTest : public ::testing::Test {
+ protected:
+  void AddPacket(uint64_t ts) { trace_->add_packet()->set_timestamp(ts); }
+
+  void AddCompressedPacket(const std::string& bytes) {
+    trace_->add_packet()->set_compressed_packets(bytes);
+  }
+
+  util::Status Tokenize() {
+    std::string trace = trace_.SerializeAsString();
+    TraceBlobView blob(TraceBlob::CopyFrom(trace.data(), trace.size()));
+    return tokenizer_.Tokenize(std::move(blob), [this](TraceBlobView packet) {
+      protos::pbzero::TracePacket::Decoder decoder(packet.data(),
+                                                   packet.length());
+      timestamps_.push_back(decoder.timestamp());
+      return util::OkStatus();
+    });
+  }
+
+  protozero::HeapBuffered<protos::pbzero::Trace> trace_;
+  ProtoTraceTokenizer tokenizer_;
+  std::vector<uint64_t> timestamps_;
+};
+
+TEST_F(ProtoTraceTokenizerTest, DecompressBatchKeepsOrder) {
+  // A long run of compressed packets, which is decompressed in parallel.
+  std::vector<uint64_t> expected;
+  uint64_t ts = 0;
+  for (int i = 0; i < 64; i++) {
+    AddCompressedPacket(Compress(Packets({ts, ts + 1, ts + 2})));
+    expected.insert(expected.end(), {ts, ts + 1, ts + 2});
+    ts += 3;
+    if (i % 16 == 15) {
+      AddPacket(ts);
+      expected.push_back(ts++);
+    }
+  }
+  ASSERT_TRUE(Tokenize().ok());
+  ASSERT_EQ(timestamps_, expected);
+  ASSERT_GT(tokenizer_.decompression_duration_ns(), 0);
+}
+
+TEST_F(ProtoTraceTokenizerTest, DecompressBatchErrorAtFailingPacket) {
+  AddPacket(1);
+  AddCompressedPacket(Compress(Packets({2})));
+  AddCompressedPacket(Compress(Packets({3, 4})));
+  AddCompressedPacket("not gzip");
+  AddCompressedPacket(Compress(Packets({5})));
+  util::Status status = Tokenize();
+  ASSERT_FALSE(status.ok());
+  ASSERT_THAT(status.message(), ::testing::HasSubstr("Failed to decompress"));
+  ASSERT_THAT(timestamps_, ElementsAre(1, 2, 3, 4));
+}
+
+TEST_F(ProtoTraceTokenizerTest, DecompressBatchStopsBeforeFailingPacket) {
+  AddCompressedPacket(Compress(Packets({1})));
+  AddCompressedPacket(Compress(Packets({2})));
+  AddCompressedPacket("not gzip");
+  AddCompressedPacket(Compress(Packets({3})));
+  std::string trace = trace_.SerializeAsString();
+  const uint8_t* start = reinterpret_cast<const uint8_t*>(trace.data());
+  const uint8_t* end = start + trace.size();
+
+  // The compressed_packets field of each packet and the end of the packet.
+  std::vector<protozero::ConstBytes> compressed;
+  std::vector<const uint8_t*> packet_ends;
+  protos::pbzero::Trace::Decoder decoder(start, trace.size());
+  for (auto it = decoder.packet(); it; ++it) {
+    protos::pbzero::TracePacket::Decoder packet(*it);
+    compressed.push_back(packet.compressed_packets());
+    packet_ends.push_back((*it).data + (*it).size);
+  }
+  ASSERT_EQ(compressed.size(), 4u);
+
+  // The batch starting at the first packet stops before the broken one.
+  std::vector<ProtoTraceTokenizer::DecompressedPacket> output;
+  ASSERT_TRUE(ProtoTraceTokenizer::DecompressBatch(
+                  compressed[0], packet_ends[0], end, &output)
+                  .ok());
+  ASSERT_EQ(output.size(), 2u);
+  ASSERT_EQ(output[0].first, compressed[0].data);
+  ASSERT_EQ(output[1].first, compressed[1].data);
+  std::string second(reinterpret_cast<const char*>(output[1].second.data()),
+                     output[1].second.size());
+  ASSERT_EQ(second, Packets({2}));
+
+  // The one starting at the broken packet fails.
+  ASSERT_FALSE(ProtoTraceTokenizer::DecompressBatch(
+                   compressed[2], packet_ends[2], end, &output)
+                   .ok());
+  ASSERT_TRUE(output.empty());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
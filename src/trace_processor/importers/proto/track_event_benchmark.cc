@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the ingestion of synthetic track event traces which, like Chrome
+// traces, intern the names of their events, categories and debug annotations.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/trace_processor/trace_processor.h"
+
+#include "protos/perfetto/trace/interned_data/interned_data.pbzero.h"
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+#include "protos/perfetto/trace/track_event/debug_annotation.pbzero.h"
+#include "protos/perfetto/trace/track_event/thread_descriptor.pbzero.h"
+#include "protos/perfetto/trace/track_event/track_descriptor.pbzero.h"
+#include "protos/perfetto/trace/track_event/track_event.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using protos::pbzero::TracePacket;
+using protos::pbzero::TrackEvent;
+
+constexpr uint32_t kNumSequences = 8;
+constexpr uint64_t kNumCategories = 8;
+constexpr uint64_t kNumEventsPerSequence = 20000;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Args: {number of distinct event names, 0 = sequential iids / 1 = sparse
+// iids}.
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Args({16, 0});
+  } else {
+    for (int64_t names : {16, 4096}) {
+      for (int64_t sparse : {0, 1})
+        b->Args({names, sparse});
+    }
+  }
+  b->ArgNames({"names", "sparse"});
+  b->Unit(benchmark::kMillisecond);
+}
+
+// Returns the iid of the |index|-th interned message of a sequence. Sparse
+// iids are spread over the whole uint64 range, as when producers derive them
+// from hashes or addresses.
+uint64_t Iid(uint64_t index, bool sparse) {
+  return sparse ? (index + 1) * 0x9E3779B97F4A7C15ull : index + 1;
+}
+
+// Generates a trace with |kNumSequences| threads, each emitting
+// |kNumEventsPerSequence| nested slices with a debug annotation. The names of
+// the slices are interned on first use, as done by the TrackEvent SDK.
+std::string GenerateTrace(uint64_t num_names, bool sparse) {
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  std::vector<std::vector<bool>> name_interned(
+      kNumSequences, std::vector<bool>(num_names, false));
+
+  for (uint32_t seq = 0; seq < kNumSequences; ++seq) {
+    auto* packet = trace->add_packet();
+    packet->set_trusted_packet_sequence_id(seq + 1);
+    packet->set_timestamp(1000);
+    packet->set_sequence_flags(TracePacket::SEQ_INCREMENTAL_STATE_CLEARED);
+    auto* track = packet->set_track_descriptor();
+    track->set_uuid(seq + 1);
+    auto* thread = track->set_thread();
+    thread->set_pid(1);
+    thread->set_tid(static_cast<int32_t>(seq + 1));
+
+    auto* interned_data = packet->set_interned_data();
+    for (uint64_t i = 0; i < kNumCategories; ++i) {
+      auto* category = interned_data->add_event_categories();
+      category->set_iid(Iid(i, sparse));
+      category->set_name("category" + std::to_string(i));
+    }
+    auto* annotation_name = interned_data->add_debug_annotation_names();
+    annotation_name->set_iid(Iid(0, sparse));
+    annotation_name->set_name("arg");
+  }
+
+  int64_t ts = 2000;
+  for (uint64_t i = 0; i < kNumEventsPerSequence; ++i) {
+    for (uint32_t seq = 0; seq < kNumSequences; ++seq) {
+      uint64_t name = (i * 7 + seq) % num_names;
+      auto* packet = trace->add_packet();
+      packet->set_trusted_packet_sequence_id(seq + 1);
+      packet->set_timestamp(static_cast<uint64_t>(ts++));
+      packet->set_sequence_flags(TracePacket::SEQ_NEEDS_INCREMENTAL_STATE);
+      if (!name_interned[seq][name]) {
+        name_interned[seq][name] = true;
+        auto* event_name = packet->set_interned_data()->add_event_names();
+        event_name->set_iid(Iid(name, sparse));
+        event_name->set_name("event" + std::to_string(name));
+      }
+      auto* event = packet->set_track_event();
+      event->set_track_uuid(seq + 1);
+      event->set_type(TrackEvent::TYPE_SLICE_BEGIN);
+      event->add_category_iids(Iid(name % kNumCategories, sparse));
+      event->set_name_iid(Iid(name, sparse));
+      auto* annotation = event->add_debug_annotations();
+      annotation->set_name_iid(Iid(0, sparse));
+      annotation->set_int_value(static_cast<int64_t>(i));
+
+      packet = trace->add_packet();
+      packet->set_trusted_packet_sequence_id(seq + 1);
+      packet->set_timestamp(static_cast<uint64_t>(ts++));
+      packet->set_sequence_flags(TracePacket::SEQ_NEEDS_INCREMENTAL_STATE);
+      event = packet->set_track_event();
+      event->set_track_uuid(seq + 1);
+      event->set_type(TrackEvent::TYPE_SLICE_END);
+    }
+  }
+  return trace.SerializeAsString();
+}
+
+}  // namespace
+
+static void BM_TrackEventIngestion(benchmark::State& state) {
+  std::string trace = GenerateTrace(static_cast<uint64_t>(state.range(0)),
+                                    state.range(1) != 0);
+
+  for (auto _ : state) {
+    auto tp = TraceProcessor::CreateInstance(Config());
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[trace.size()]);
+    memcpy(buf.get(), trace.data(), trace.size());
+    util::Status status = tp->Parse(std::move(buf), trace.size());
+    PERFETTO_CHECK(status.ok());
+    tp->NotifyEndOfFile();
+    benchmark::DoNotOptimize(tp.get());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(kNumSequences *
+                                               kNumEventsPerSequence) *
+                          static_cast<int64_t>(state.iterations()));
+  state.SetBytesProcessed(static_cast<int64_t>(trace.size()) *
+                          static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_TrackEventIngestion)->Apply(BenchmarkArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -73,9 +73,7 @@ void TrackEventModule::ParsePacket(const TracePacket::Decoder& decoder,
       parser_.ParseTrackDescriptor(decoder.track_descriptor());
       break;
     case TracePacket::kTrackEventFieldNumber:
-      PERFETTO_DCHECK(ttp.type == TimestampedTracePiece::Type::kTrackEvent);
-      parser_.ParseTrackEvent(ttp.timestamp, ttp.track_event_data.get(),
-                              decoder.track_event());
+      PERFETTO_DFATAL("Track events are parsed by ParseTrackEventData()");
       break;
     case TracePacket::kProcessDescriptorFieldNumber:
       // TODO(eseckler): Remove once Chrome has switched to TrackDescriptors.
@@ -90,6 +88,12 @@ void TrackEventModule::ParsePacket(const TracePacket::Decoder& decoder,
   }
 }
 
+void TrackEventModule::ParseTrackEventData(const TracePacket::Decoder& decoder,
+                                           int64_t ts,
+                                           TrackEventData* data) {
+  parser_.ParseTrackEvent(ts, data, decoder.track_event());
+}
+
 void TrackEventModule::OnIncrementalStateCleared(uint32_t packet_sequence_id) {
   track_event_tracker_->OnIncrementalStateCleared(packet_sequence_id);
 }
@@ -45,6 +45,12 @@ class TrackEventModule : public ProtoImporterModule {
                    const TimestampedTracePiece& ttp,
                    uint32_t field_id) override;
 
+  // Called by ProtoTraceParser for the pieces of type kTrackEvent. |data| is
+  // updated while parsing (e.g. with the thread time of extra counters).
+  void ParseTrackEventData(const protos::pbzero::TracePacket::Decoder& decoder,
+                           int64_t ts,
+                           TrackEventData* data);
+
  private:
   std::unique_ptr<TrackEventTracker> track_event_tracker_;
   TrackEventTokenizer tokenizer_;
@@ -38,6 +38,18 @@ IteratorImpl::IteratorImpl(TraceProcessorImpl* trace_processor,
       stmt_metadata_(std::move(metadata)),
       sql_stats_row_(sql_stats_row) {}
 
+IteratorImpl::IteratorImpl(TraceProcessorImpl* trace_processor,
+                           NativeAggregateQuery::Result result,
+                           uint32_t sql_stats_row)
+    : trace_processor_(trace_processor),
+      native_result_(new NativeAggregateQuery::Result(std::move(result))),
+      sql_stats_row_(sql_stats_row) {
+  stmt_metadata_.column_count =
+      static_cast<uint32_t>(native_result_->column_names.size());
+  stmt_metadata_.statement_count = 1;
+  stmt_metadata_.statement_count_with_output = 1;
+}
+
 IteratorImpl::~IteratorImpl() {
   if (trace_processor_) {
     base::TimeNanos t_end = base::GetWallTimeNs();
@@ -54,6 +66,16 @@ void IteratorImpl::RecordFirstNextInSqlStats() {
   sql_stats->RecordQueryFirstNext(sql_stats_row_, t_first_next.count());
 }
 
+int IteratorImpl::Step() {
+  // The queries run by the statement (e.g. by RUN_METRIC) are part of the
+  // query of this iterator.
+  TraceProcessorImpl* tp = trace_processor_.get();
+  tp->running_queries_++;
+  int ret = sqlite3_step(*stmt_);
+  tp->running_queries_--;
+  return ret;
+}
+
 Iterator::Iterator(std::unique_ptr<IteratorImpl> iterator)
     : iterator_(std::move(iterator)) {}
 Iterator::~Iterator() = default;
@@ -27,6 +27,7 @@
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/iterator.h"
 #include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/sqlite/native_aggregate_query.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 
@@ -49,6 +50,12 @@ class IteratorImpl {
                ScopedStmt,
                StmtMetadata,
                uint32_t sql_stats_row);
+
+  // Creates an iterator over the result of a query which was executed
+  // natively rather than by SQLite.
+  IteratorImpl(TraceProcessorImpl* impl,
+               NativeAggregateQuery::Result,
+               uint32_t sql_stats_row);
   ~IteratorImpl();
 
   IteratorImpl(IteratorImpl&) noexcept = delete;
@@ -59,7 +66,7 @@ class IteratorImpl {
 
   // Methods called by the base Iterator class.
   bool Next() {
-    PERFETTO_DCHECK(stmt_ || !status_.ok());
+    PERFETTO_DCHECK(stmt_ || native_result_ || !status_.ok());
 
     if (!called_next_) {
       // Delegate to the cc file to prevent trace_storage.h include in this
@@ -77,13 +84,21 @@ class IteratorImpl {
       // (i.e. implement operator bool, make Next return nothing similar to C++
       // iterators); however, too many clients depend on the current behavior so
       // we have to keep the API as is.
+      if (native_result_)
+        return native_row_ < native_result_->row_count();
       return status_.ok() && !sqlite_utils::IsStmtDone(*stmt_);
     }
 
     if (!status_.ok())
       return false;
 
-    int ret = sqlite3_step(*stmt_);
+    if (native_result_) {
+      if (native_row_ < native_result_->row_count())
+        native_row_++;
+      return native_row_ < native_result_->row_count();
+    }
+
+    int ret = Step();
     if (PERFETTO_UNLIKELY(ret != SQLITE_ROW && ret != SQLITE_DONE)) {
       status_ = base::ErrStatus("%s (errcode %d)", sqlite3_errmsg(db_), ret);
       stmt_.reset();
@@ -93,6 +108,11 @@ class IteratorImpl {
   }
 
   SqlValue Get(uint32_t col) {
+    if (native_result_) {
+      size_t idx = native_row_ * native_result_->column_names.size() + col;
+      return native_result_->values[idx];
+    }
+
     auto column = static_cast<int>(col);
     auto col_type = sqlite3_column_type(*stmt_, column);
     SqlValue value;
@@ -124,6 +144,8 @@ class IteratorImpl {
   }
 
   std::string GetColumnName(uint32_t col) {
+    if (native_result_)
+      return native_result_->column_names[col];
     return stmt_ ? sqlite3_column_name(*stmt_, static_cast<int>(col)) : "";
   }
 
@@ -152,6 +174,9 @@ class IteratorImpl {
 
   void RecordFirstNextInSqlStats();
 
+  // Steps |stmt_|. Defined in the cc file for the same reason as above.
+  int Step();
+
   ScopedTraceProcessor trace_processor_;
   sqlite3* db_ = nullptr;
   base::Status status_;
@@ -159,6 +184,10 @@ class IteratorImpl {
   ScopedStmt stmt_;
   StmtMetadata stmt_metadata_;
 
+  // Set instead of |stmt_| if the query was executed natively.
+  std::unique_ptr<NativeAggregateQuery::Result> native_result_;
+  uint32_t native_row_ = 0;
+
   uint32_t sql_stats_row_ = 0;
   bool called_next_ = false;
 };
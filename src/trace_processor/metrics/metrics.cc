@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/metrics/metrics.h"
 
+#include <map>
 #include <regex>
 #include <unordered_map>
 #include <vector>
@@ -24,6 +25,7 @@
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
+#include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 #include "src/trace_processor/tp_metatrace.h"
 #include "src/trace_processor/util/descriptors.h"
@@ -88,6 +90,191 @@ base::Status ValidateSingleNonEmptyMessage(const uint8_t* ptr,
 
 }  // namespace
 
+RunMetricCache::RunMetricCache(sqlite3* db,
+                               const CreateFunction::State* created_functions)
+    : db_(db), created_functions_(created_functions) {}
+
+void RunMetricCache::Begin() {
+  enabled_ = true;
+  runs_.clear();
+  change_counts_.clear();
+  total_change_count_ = 0;
+  running_.clear();
+  sqlite3_set_authorizer(db_, &RunMetricCache::Authorize, this);
+}
+
+void RunMetricCache::End() {
+  sqlite3_set_authorizer(db_, nullptr, nullptr);
+  enabled_ = false;
+  runs_.clear();
+  change_counts_.clear();
+  total_change_count_ = 0;
+  running_.clear();
+}
+
+bool RunMetricCache::CanSkip(const std::string& key) {
+  if (!enabled_)
+    return false;
+
+  auto run_it = runs_.find(key);
+  if (run_it == runs_.end())
+    return false;
+
+  const Run& run = run_it->second;
+  if (run.calls_created_function &&
+      run.total_change_count != total_change_count_) {
+    return false;
+  }
+  for (const auto& name_and_count : run.change_counts) {
+    if (ChangeCount(name_and_count.first) != name_and_count.second)
+      return false;
+  }
+
+  // The run calling this file (if any) uses what the skipped run used.
+  if (!running_.empty()) {
+    UsedObjects& caller = running_.back();
+    for (const auto& name_and_count : run.change_counts)
+      caller.names.insert(name_and_count.first);
+    caller.calls_created_function |= run.calls_created_function;
+  }
+  return true;
+}
+
+void RunMetricCache::StartRun() {
+  if (!enabled_)
+    return;
+  running_.emplace_back();
+}
+
+void RunMetricCache::RecordRun(const std::string& key) {
+  if (!enabled_)
+    return;
+
+  UsedObjects used = PopRun();
+  Run& run = runs_[key];
+  run.change_counts.clear();
+  for (const std::string& name : used.names)
+    run.change_counts[name] = ChangeCount(name);
+  run.calls_created_function = used.calls_created_function;
+  run.total_change_count = total_change_count_;
+}
+
+void RunMetricCache::AbortRun() {
+  if (!enabled_)
+    return;
+  PopRun();
+}
+
+RunMetricCache::UsedObjects RunMetricCache::PopRun() {
+  PERFETTO_DCHECK(!running_.empty());
+  UsedObjects used = std::move(running_.back());
+  running_.pop_back();
+
+  // Whatever a nested run used is also used by the run calling it.
+  if (!running_.empty()) {
+    UsedObjects& caller = running_.back();
+    caller.names.insert(used.names.begin(), used.names.end());
+    caller.calls_created_function |= used.calls_created_function;
+  }
+  return used;
+}
+
+// static
+int RunMetricCache::Authorize(void* self,
+                              int action,
+                              const char* arg3,
+                              const char* arg4,
+                              const char*,
+                              const char*) {
+  auto* cache = static_cast<RunMetricCache*>(self);
+  switch (action) {
+    case SQLITE_READ:
+      cache->RecordUse(arg3);
+      break;
+    case SQLITE_FUNCTION:
+      cache->RecordFunctionCall(arg4);
+      break;
+    case SQLITE_CREATE_TABLE:
+    case SQLITE_CREATE_TEMP_TABLE:
+    case SQLITE_CREATE_VIEW:
+    case SQLITE_CREATE_TEMP_VIEW:
+    case SQLITE_CREATE_VTABLE:
+    case SQLITE_DROP_TABLE:
+    case SQLITE_DROP_TEMP_TABLE:
+    case SQLITE_DROP_VIEW:
+    case SQLITE_DROP_TEMP_VIEW:
+    case SQLITE_DROP_VTABLE:
+    case SQLITE_INSERT:
+    case SQLITE_UPDATE:
+    case SQLITE_DELETE:
+      cache->RecordChange(arg3);
+      break;
+    case SQLITE_ALTER_TABLE:
+      cache->RecordChange(arg4);
+      break;
+    default:
+      break;
+  }
+  return SQLITE_OK;
+}
+
+void RunMetricCache::RecordUse(const char* name) {
+  if (!name || running_.empty())
+    return;
+  std::string lower = base::ToLower(name);
+  // SQLite's own tables (e.g. sqlite_master) are read and written by every
+  // schema change: the changes to the objects themselves are tracked instead.
+  if (base::StartsWith(lower, "sqlite_"))
+    return;
+  running_.back().names.insert(std::move(lower));
+}
+
+void RunMetricCache::RecordFunctionCall(const char* name) {
+  if (!name || running_.empty())
+    return;
+  for (const auto& function : *created_functions_) {
+    if (base::CaseInsensitiveEqual(function.first.name, name)) {
+      running_.back().calls_created_function = true;
+      return;
+    }
+  }
+}
+
+void RunMetricCache::RecordChange(const char* name) {
+  if (!name)
+    return;
+  std::string lower = base::ToLower(name);
+  if (base::StartsWith(lower, "sqlite_"))
+    return;
+  change_counts_[lower]++;
+  total_change_count_++;
+
+  // The objects changed by a run are used by it: if they are changed again
+  // later (e.g. by another file dropping them), the run should be repeated.
+  if (!running_.empty())
+    running_.back().names.insert(std::move(lower));
+}
+
+uint64_t RunMetricCache::ChangeCount(const std::string& name) const {
+  auto it = change_counts_.find(name);
+  return it == change_counts_.end() ? 0 : it->second;
+}
+
+std::string RunMetricCache::Key(
+    const std::string& path,
+    const std::unordered_map<std::string, std::string>& substitutions) {
+  std::map<std::string, std::string> sorted(substitutions.begin(),
+                                            substitutions.end());
+  std::string key = path;
+  for (const auto& sub : sorted) {
+    key += '\n';
+    key += sub.first;
+    key += '=';
+    key += sub.second;
+  }
+  return key;
+}
+
 ProtoBuilder::ProtoBuilder(const DescriptorPool* pool,
                            const ProtoDescriptor* descriptor)
     : pool_(pool), descriptor_(descriptor) {}
@@ -643,6 +830,10 @@ base::Status RunMetric::Run(RunMetric::Context* ctx,
     substitutions[*key_str] = *value_str;
   }
 
+  std::string key = RunMetricCache::Key(path, substitutions);
+  if (ctx->cache->CanSkip(key))
+    return base::OkStatus();
+
   std::string subbed_sql;
   int ret = TemplateReplace(metric_it->sql, substitutions, &subbed_sql);
   if (ret) {
@@ -651,14 +842,17 @@ base::Status RunMetric::Run(RunMetric::Context* ctx,
         metric_it->sql.c_str());
   }
 
+  ctx->cache->StartRun();
   auto it = ctx->tp->ExecuteQuery(subbed_sql);
   it.Next();
 
   base::Status status = it.Status();
   if (!status.ok()) {
+    ctx->cache->AbortRun();
     return base::ErrStatus("RUN_METRIC: Error when running file %s: %s", path,
                            status.c_message());
   }
+  ctx->cache->RecordRun(key);
   return base::OkStatus();
 }
 
@@ -709,11 +903,17 @@ base::Status UnwrapMetricProto::Run(Context*,
 }
 
 base::Status ComputeMetrics(TraceProcessor* tp,
+                            RunMetricCache* cache,
                             const std::vector<std::string> metrics_to_compute,
                             const std::vector<SqlMetricFile>& sql_metrics,
                             const DescriptorPool& pool,
                             const ProtoDescriptor& root_descriptor,
                             std::vector<uint8_t>* metrics_proto) {
+  // Metrics commonly depend on the same files (e.g. the process metadata) so
+  // only run each of them once for all the metrics computed here.
+  cache->Begin();
+  auto end_cache = base::OnScopeExit([cache] { cache->End(); });
+
   ProtoBuilder metric_builder(&pool, &root_descriptor);
   for (const auto& name : metrics_to_compute) {
     auto metric_it =
@@ -726,9 +926,17 @@ base::Status ComputeMetrics(TraceProcessor* tp,
       return base::ErrStatus("Unknown metric %s", name.c_str());
 
     const auto& sql_metric = *metric_it;
-    auto prep_it = tp->ExecuteQuery(sql_metric.sql);
-    prep_it.Next();
-    RETURN_IF_ERROR(prep_it.Status());
+    std::string key = RunMetricCache::Key(sql_metric.path, {});
+    if (!cache->CanSkip(key)) {
+      cache->StartRun();
+      auto prep_it = tp->ExecuteQuery(sql_metric.sql);
+      prep_it.Next();
+      if (!prep_it.Status().ok()) {
+        cache->AbortRun();
+        return prep_it.Status();
+      }
+      cache->RecordRun(key);
+    }
 
     auto output_query =
         "SELECT * FROM " + sql_metric.output_table_name.value() + ";";
@@ -19,6 +19,8 @@
 
 #include <sqlite3.h>
 
+#include <map>
+#include <set>
 #include <unordered_map>
 #include <vector>
 
@@ -27,6 +29,7 @@
 #include "perfetto/protozero/message.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/sqlite/create_function.h"
 #include "src/trace_processor/sqlite/register_function.h"
 #include "src/trace_processor/util/descriptors.h"
 
@@ -57,6 +60,90 @@ struct SqlMetricFile {
   std::string sql;
 };
 
+// Remembers the RUN_METRIC invocations made while computing metrics so that
+// the files shared by many metrics (e.g. android/process_metadata.sql) are only
+// run once rather than once per metric depending on them.
+//
+// An invocation is only skipped if running it again could not change
+// anything. While enabled, the cache uses an SQLite authorizer to record the
+// objects (tables, views and functions) read, written, created or dropped by
+// each run and to count the changes (creations, drops and modified rows) made
+// to every object. A run can only be skipped if none of the objects it used
+// changed since it ended: e.g. a table it read was not dropped and recreated
+// with different data. As the statements of the functions created with
+// CREATE_FUNCTION are prepared once, their reads cannot be attributed to
+// callers: runs calling them can only be skipped if nothing changed at all.
+class RunMetricCache {
+ public:
+  RunMetricCache(sqlite3* db, const CreateFunction::State* created_functions);
+
+  // Enables the cache until |End()| is called. Outside of this window (i.e.
+  // when RUN_METRIC is called directly by a query) files are always run.
+  void Begin();
+  void End();
+
+  // Returns whether the file run as |key| (see |Key()|) ran previously and
+  // running it again can be skipped.
+  bool CanSkip(const std::string& key);
+
+  // Should be called before running a file which cannot be skipped: from now
+  // on, the objects used are recorded as used by this run. Runs can be nested.
+  void StartRun();
+
+  // Records that the file run as |key| (the last started run) just ran
+  // successfully.
+  void RecordRun(const std::string& key);
+
+  // Discards the last started run as it failed.
+  void AbortRun();
+
+  // Returns the key identifying the run of the file at |path| with the given
+  // template substitutions.
+  static std::string Key(
+      const std::string& path,
+      const std::unordered_map<std::string, std::string>& substitutions);
+
+ private:
+  // The objects used by a run, by lowercase name.
+  struct UsedObjects {
+    std::set<std::string> names;
+    bool calls_created_function = false;
+  };
+  struct Run {
+    // The number of changes made to each object used by the run when it
+    // ended.
+    std::map<std::string, uint64_t> change_counts;
+    bool calls_created_function = false;
+    uint64_t total_change_count = 0;
+  };
+
+  static int Authorize(void* self,
+                       int action,
+                       const char* arg3,
+                       const char* arg4,
+                       const char* db_name,
+                       const char* trigger_or_view);
+
+  void RecordUse(const char* name);
+  void RecordFunctionCall(const char* name);
+  void RecordChange(const char* name);
+  uint64_t ChangeCount(const std::string& name) const;
+  UsedObjects PopRun();
+
+  sqlite3* db_ = nullptr;
+  const CreateFunction::State* created_functions_ = nullptr;
+  bool enabled_ = false;
+  std::unordered_map<std::string, Run> runs_;
+
+  // The number of changes made to each object (by lowercase name) and to all
+  // of them since the cache was enabled.
+  std::unordered_map<std::string, uint64_t> change_counts_;
+  uint64_t total_change_count_ = 0;
+
+  // The objects used by the runs in progress, innermost last.
+  std::vector<UsedObjects> running_;
+};
+
 // Helper class to build a nested (metric) proto checking the schema against
 // a descriptor.
 // Visible for testing.
@@ -177,6 +264,7 @@ struct RunMetric : public SqlFunction {
   struct Context {
     TraceProcessor* tp;
     std::vector<SqlMetricFile>* metrics;
+    RunMetricCache* cache;
   };
   static base::Status Run(Context* ctx,
                           size_t argc,
@@ -199,6 +287,7 @@ void RepeatedFieldStep(sqlite3_context* ctx, int argc, sqlite3_value** argv);
 void RepeatedFieldFinal(sqlite3_context* ctx);
 
 base::Status ComputeMetrics(TraceProcessor* impl,
+                            RunMetricCache* cache,
                             const std::vector<std::string> metrics_to_compute,
                             const std::vector<SqlMetricFile>& metrics,
                             const DescriptorPool& pool,
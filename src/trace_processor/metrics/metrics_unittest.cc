@@ -18,6 +18,8 @@
 
 #include <vector>
 
+#include "src/trace_processor/sqlite/scoped_db.h"
+
 #include "protos/perfetto/common/descriptor.pbzero.h"
 #include "test/gtest_and_gmock.h"
 
@@ -50,6 +52,152 @@ TEST(MetricsTest, TemplateReplace) {
   ASSERT_NE(TemplateReplace("{{missing}}", {{}}, &unused), 0);
 }
 
+class RunMetricCacheTest : public ::testing::Test {
+ public:
+  RunMetricCacheTest() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_initialize() == SQLITE_OK);
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+    cache_.reset(new RunMetricCache(*db_, &created_functions_));
+  }
+
+ protected:
+  void Exec(const char* sql) {
+    ASSERT_EQ(sqlite3_exec(*db_, sql, nullptr, nullptr, nullptr), SQLITE_OK);
+  }
+
+  // Runs |sql| as the file |key|.
+  void Run(const std::string& key, const char* sql) {
+    cache_->StartRun();
+    Exec(sql);
+    cache_->RecordRun(key);
+  }
+
+  ScopedDb db_;
+  CreateFunction::State created_functions_;
+  std::unique_ptr<RunMetricCache> cache_;
+};
+
+TEST_F(RunMetricCacheTest, Key) {
+  ASSERT_EQ(RunMetricCache::Key("a.sql", {}), "a.sql");
+  ASSERT_EQ(RunMetricCache::Key("a.sql", {{"x", "1"}, {"y", "2"}}),
+            RunMetricCache::Key("a.sql", {{"y", "2"}, {"x", "1"}}));
+  ASSERT_NE(RunMetricCache::Key("a.sql", {{"x", "1"}}),
+            RunMetricCache::Key("a.sql", {{"x", "2"}}));
+}
+
+TEST_F(RunMetricCacheTest, SkipsUnchangedRun) {
+  cache_->Begin();
+  ASSERT_FALSE(cache_->CanSkip("a.sql"));
+
+  Run("a.sql", "CREATE TABLE a AS SELECT 1 AS x");
+  ASSERT_TRUE(cache_->CanSkip("a.sql"));
+
+  // Objects created after the run do not matter.
+  Exec("CREATE VIEW b AS SELECT x FROM a; CREATE TABLE c(x INT)");
+  ASSERT_TRUE(cache_->CanSkip("a.sql"));
+
+  cache_->End();
+  ASSERT_FALSE(cache_->CanSkip("a.sql"));
+}
+
+TEST_F(RunMetricCacheTest, RedefinedObject) {
+  cache_->Begin();
+  Run("a.sql", "CREATE VIEW v AS SELECT 1 AS x");
+  ASSERT_TRUE(cache_->CanSkip("a.sql"));
+
+  Exec("DROP VIEW v; CREATE VIEW v AS SELECT 2 AS x");
+  ASSERT_FALSE(cache_->CanSkip("a.sql"));
+
+  Exec("DROP VIEW v");
+  ASSERT_FALSE(cache_->CanSkip("a.sql"));
+}
+
+TEST_F(RunMetricCacheTest, ModifiedRows) {
+  cache_->Begin();
+  Run("a.sql", "CREATE TABLE t(x INT)");
+  ASSERT_TRUE(cache_->CanSkip("a.sql"));
+
+  Exec("INSERT INTO t VALUES (1)");
+  ASSERT_FALSE(cache_->CanSkip("a.sql"));
+}
+
+TEST_F(RunMetricCacheTest, RecreatedInputTable) {
+  Exec("CREATE TABLE input AS SELECT 1 AS x");
+
+  cache_->Begin();
+  Run("a.sql", "CREATE VIEW out AS SELECT x FROM input");
+  Run("b.sql",
+      "DROP TABLE IF EXISTS out_table; "
+      "CREATE TABLE out_table AS SELECT x FROM input");
+  ASSERT_TRUE(cache_->CanSkip("a.sql"));
+  ASSERT_TRUE(cache_->CanSkip("b.sql"));
+
+  // The table read by b.sql is recreated with different data: the table it
+  // created is now stale. The view created by a.sql reads the new data.
+  Exec("DROP TABLE input; CREATE TABLE input AS SELECT 2 AS x");
+  ASSERT_TRUE(cache_->CanSkip("a.sql"));
+  ASSERT_FALSE(cache_->CanSkip("b.sql"));
+
+  Run("b.sql",
+      "DROP TABLE IF EXISTS out_table; "
+      "CREATE TABLE out_table AS SELECT x FROM input");
+  ASSERT_TRUE(cache_->CanSkip("b.sql"));
+}
+
+TEST_F(RunMetricCacheTest, NestedRuns) {
+  Exec("CREATE TABLE input AS SELECT 1 AS x");
+
+  cache_->Begin();
+  cache_->StartRun();
+  Run("inner.sql", "CREATE TABLE inner_table AS SELECT x FROM input");
+  Exec("CREATE VIEW outer_view AS SELECT 1 AS y");
+  cache_->RecordRun("outer.sql");
+
+  // A second run calling inner.sql skips it but still depends on it.
+  cache_->StartRun();
+  ASSERT_TRUE(cache_->CanSkip("inner.sql"));
+  cache_->RecordRun("other.sql");
+
+  Exec("INSERT INTO input VALUES (2)");
+  ASSERT_FALSE(cache_->CanSkip("inner.sql"));
+  ASSERT_FALSE(cache_->CanSkip("outer.sql"));
+  ASSERT_FALSE(cache_->CanSkip("other.sql"));
+}
+
+TEST_F(RunMetricCacheTest, FailedRun) {
+  cache_->Begin();
+  cache_->StartRun();
+  ASSERT_NE(sqlite3_exec(*db_, "SELECT * FROM missing", nullptr, nullptr,
+                         nullptr),
+            SQLITE_OK);
+  cache_->AbortRun();
+  ASSERT_FALSE(cache_->CanSkip("a.sql"));
+}
+
+TEST_F(RunMetricCacheTest, CreatedFunction) {
+  // Stands for a function defined with CREATE_FUNCTION, whose statement reads
+  // tables outside of the runs calling it.
+  auto identity = [](sqlite3_context* ctx, int, sqlite3_value** argv) {
+    sqlite3_result_value(ctx, argv[0]);
+  };
+  ASSERT_EQ(sqlite3_create_function(*db_, "IDENTITY", 1, SQLITE_UTF8, nullptr,
+                                    identity, nullptr, nullptr),
+            SQLITE_OK);
+  created_functions_[CreateFunction::NameAndArgc{"IDENTITY", 1}];
+
+  cache_->Begin();
+  Run("b.sql", "CREATE TABLE b AS SELECT abs(1) AS x");
+  Run("a.sql", "CREATE TABLE a AS SELECT identity(1) AS x");
+  ASSERT_TRUE(cache_->CanSkip("a.sql"));
+  ASSERT_TRUE(cache_->CanSkip("b.sql"));
+
+  Exec("CREATE TABLE unrelated(x INT)");
+  ASSERT_FALSE(cache_->CanSkip("a.sql"));
+  ASSERT_TRUE(cache_->CanSkip("b.sql"));
+}
+
 class ProtoBuilderTest : public ::testing::Test {
  protected:
   template <bool repeated>
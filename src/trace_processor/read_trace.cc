@@ -16,6 +16,7 @@
 
 #include "perfetto/trace_processor/read_trace.h"
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
@@ -28,6 +29,7 @@
 #include "src/trace_processor/forwarding_trace_parser.h"
 #include "src/trace_processor/importers/gzip/gzip_trace_parser.h"
 #include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
+#include "src/trace_processor/util/bounded_queue.h"
 #include "src/trace_processor/util/gzip_utils.h"
 #include "src/trace_processor/util/status_macros.h"
 
@@ -40,6 +42,14 @@
 #include <unistd.h>
 #endif
 
+// WASM builds are single threaded: the file is read on the parsing thread.
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+#define TRACE_PROCESSOR_HAS_THREADS() 0
+#else
+#define TRACE_PROCESSOR_HAS_THREADS() 1
+#include <thread>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 namespace {
@@ -74,6 +84,75 @@ util::Status ReadTraceUsingRead(
   return util::OkStatus();
 }
 
+#if TRACE_PROCESSOR_HAS_THREADS()
+// Maximum number of chunks the reader thread can get ahead of the parsing
+// thread. This bounds the memory buffered between the threads to 8 * kChunkSize.
+constexpr size_t kMaxChunksInFlight = 8;
+
+// A chunk handed from the reader thread to the parsing thread. An empty |blob|
+// signals either EOF (|read_errno| == 0) or a read error.
+struct ReadChunk {
+  TraceBlobView blob;
+  int read_errno = 0;
+};
+
+// Like ReadTraceUsingRead() but read() is issued on a dedicated thread which
+// hands chunks over to the calling thread through a bounded queue. This is the
+// first stage of the ingestion pipeline: proto traces are then tokenized on
+// another thread (see PipelinedProtoTraceTokenizer) while the packets are
+// sorted and parsed on the calling thread. Sorting and parsing stay on the
+// same thread as they both update the trackers and tables in TraceStorage,
+// which are not thread-safe.
+util::Status ReadTraceUsingReaderThread(
+    TraceProcessor* tp,
+    int fd,
+    uint64_t* file_size,
+    const std::function<void(uint64_t parsed_size)>& progress_callback) {
+  util::BoundedQueue<ReadChunk> queue(kMaxChunksInFlight);
+  std::thread reader([fd, &queue] {
+    for (;;) {
+      TraceBlob blob = TraceBlob::Allocate(kChunkSize);
+      auto rsize = base::Read(fd, blob.data(), blob.size());
+      ReadChunk chunk;
+      if (rsize < 0) {
+        chunk.read_errno = errno;
+      } else if (rsize > 0) {
+        chunk.blob =
+            TraceBlobView(std::move(blob), 0, static_cast<size_t>(rsize));
+      }
+      // Stop on EOF, on errors or if the parsing thread closed the queue.
+      if (!queue.Push(std::move(chunk)) || rsize <= 0)
+        return;
+    }
+  });
+
+  util::Status status = util::OkStatus();
+  ReadChunk chunk;
+  for (int i = 0; queue.Pop(&chunk); i++) {
+    if (progress_callback && i % 128 == 0)
+      progress_callback(*file_size);
+
+    if (chunk.read_errno != 0) {
+      status = util::ErrStatus("Reading trace file failed (errno: %d, %s)",
+                               chunk.read_errno, strerror(chunk.read_errno));
+      break;
+    }
+    if (chunk.blob.size() == 0)
+      break;
+
+    *file_size += chunk.blob.size();
+    status = tp->Parse(std::move(chunk.blob));
+    if (!status.ok())
+      break;
+  }
+
+  // Unblocks the reader thread if we bailed out early because of an error.
+  queue.Close();
+  reader.join();
+  return status;
+}
+#endif  // TRACE_PROCESSOR_HAS_THREADS()
+
 class SerializingProtoTraceReader : public ChunkedTraceReader {
  public:
   explicit SerializingProtoTraceReader(std::vector<uint8_t>* output)
@@ -136,6 +215,16 @@ util::Status ReadTrace(
         progress_callback(bytes_read);
         const size_t bytes_read_z = static_cast<size_t>(bytes_read);
         size_t slice_size = std::min(whole_size - bytes_read_z, kMmapChunkSize);
+
+        // Ask the kernel to start paging in the next chunk while we parse
+        // this one, so that page faults don't stall the parsing thread.
+        const size_t next_off = bytes_read_z + slice_size;
+        if (next_off < whole_size) {
+          size_t next_size = std::min(whole_size - next_off, kMmapChunkSize);
+          madvise(static_cast<char*>(file_mm) + next_off, next_size,
+                  MADV_WILLNEED);
+        }
+
         TraceBlobView slice = whole_mmap.slice_off(bytes_read_z, slice_size);
         RETURN_IF_ERROR(tp->Parse(std::move(slice)));
         bytes_read += slice_size;
@@ -145,6 +234,13 @@ util::Status ReadTrace(
   if (bytes_read == 0)
     PERFETTO_LOG("Cannot use mmap on this system. Falling back on read()");
 #endif  // TRACE_PROCESSOR_HAS_MMAP()
+#if TRACE_PROCESSOR_HAS_THREADS()
+  char* no_pipeline = getenv("TRACE_PROCESSOR_NO_PIPELINE");
+  if (bytes_read == 0 && (!no_pipeline || *no_pipeline != '1')) {
+    RETURN_IF_ERROR(
+        ReadTraceUsingReaderThread(tp, *fd, &bytes_read, progress_callback));
+  }
+#endif  // TRACE_PROCESSOR_HAS_THREADS()
   if (bytes_read == 0) {
     RETURN_IF_ERROR(
         ReadTraceUsingRead(tp, *fd, &bytes_read, progress_callback));
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the end-to-end load time (read + tokenize + sort + parse) of the
+// traces in test/data, comparing the different ways ReadTrace() can feed the
+// file into trace processor.
+
+#include <stdlib.h>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/utils.h"
+#include "perfetto/trace_processor/read_trace.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/base/test/utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Traces covering the main importers: ftrace-heavy system traces, track
+// event, gzip, JSON and Fuchsia.
+const char* const kTraces[] = {
+    "test/data/android_sched_and_ps.pb",
+    "test/data/example_android_trace_30s.pb",
+    "test/data/chrome_scroll_without_vsync.pftrace",
+    "test/data/example_android_trace_30s.pb.gz",
+    "test/data/sfgate.json",
+    "test/data/fuchsia_workstation.fxt",
+};
+
+// All the modes but kMmap and kRead tokenize proto traces on a separate
+// thread.
+enum ReadMode {
+  kMmap = 0,
+  kRead = 1,
+  kReaderThread = 2,
+  kMmapTokenizerThread = 3,
+};
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  int64_t num_traces = IsBenchmarkFunctionalOnly()
+                           ? 1
+                           : static_cast<int64_t>(base::ArraySize(kTraces));
+  for (int64_t trace = 0; trace < num_traces; trace++) {
+    for (int64_t mode : {kMmap, kRead, kReaderThread, kMmapTokenizerThread})
+      b->Args({trace, mode});
+  }
+  b->ArgNames({"trace", "mode"});
+  b->Unit(benchmark::kMillisecond);
+}
+
+void SetReadMode(ReadMode mode) {
+  bool mmap = mode == kMmap || mode == kMmapTokenizerThread;
+  bool pipeline = mode == kReaderThread || mode == kMmapTokenizerThread;
+  setenv("TRACE_PROCESSOR_NO_MMAP", mmap ? "0" : "1", 1);
+  setenv("TRACE_PROCESSOR_NO_PIPELINE", pipeline ? "0" : "1", 1);
+}
+
+}  // namespace
+
+static void BM_ReadTrace(benchmark::State& state) {
+  const char* trace = kTraces[static_cast<size_t>(state.range(0))];
+  std::string path = base::GetTestDataPath(trace);
+  if (!base::FileExists(path)) {
+    state.SkipWithError("Test data missing, run install-build-deps");
+    return;
+  }
+  state.SetLabel(trace);
+  SetReadMode(static_cast<ReadMode>(state.range(1)));
+
+  uint64_t bytes_read = 0;
+  for (auto _ : state) {
+    auto tp = TraceProcessor::CreateInstance(Config());
+    util::Status status = ReadTrace(
+        tp.get(), path.c_str(), [&bytes_read](uint64_t parsed_size) {
+          bytes_read = parsed_size;
+        });
+    PERFETTO_CHECK(status.ok());
+    benchmark::DoNotOptimize(tp.get());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(bytes_read) *
+                          static_cast<int64_t>(state.iterations()));
+
+  unsetenv("TRACE_PROCESSOR_NO_MMAP");
+  unsetenv("TRACE_PROCESSOR_NO_PIPELINE");
+}
+BENCHMARK(BM_ReadTrace)->Apply(BenchmarkArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
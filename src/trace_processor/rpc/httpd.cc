@@ -20,11 +20,22 @@
 
 #include "src/trace_processor/rpc/httpd.h"
 
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "perfetto/base/task_runner.h"
 #include "perfetto/ext/base/http/http_server.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/unix_task_runner.h"
 #include "perfetto/ext/base/utils.h"
+#include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/trace_processor/trace_processor.h"
 #include "src/trace_processor/rpc/rpc.h"
@@ -38,6 +49,11 @@ namespace {
 
 constexpr int kBindPort = 9001;
 
+// Max number of response chunks produced by the RPC thread which have not been
+// written to the socket yet. Past this the RPC thread blocks, so a slow client
+// doesn't cause a whole query result to be buffered in memory.
+constexpr uint32_t kMaxPendingChunks = 32;
+
 // Sets the Access-Control-Allow-Origin: $origin on the following origins.
 // This affects only browser clients that use CORS. Other HTTP clients (e.g. the
 // python API) don't look at CORS headers.
@@ -47,55 +63,158 @@ const char* kAllowedCORSOrigins[] = {
     "http://127.0.0.1:10000",
 };
 
-class Httpd : public base::HttpRequestHandler {
+// The endpoints served by the RPC thread (see ServeRpcRequest()).
+const char* kRpcEndpoints[] = {
+    "/rpc",
+    "/parse",
+    "/notify_eof",
+    "/restore_initial_tables",
+    "/query",
+    "/raw_query",
+    "/compute_metric",
+    "/enable_metatrace",
+    "/disable_and_read_metatrace",
+};
+
+// The HTTP server runs on the thread of |task_runner_|, while all the calls
+// into the Rpc which use the TraceProcessor happen on a dedicated RPC thread.
+// TraceProcessor has a single SQLite connection, so queries can't run in
+// parallel: the RPC thread runs the requests of each connection in order, and
+// serves the connections with queued requests round robin, so that a client
+// queuing many requests doesn't delay the others.
+//
+// The HTTP thread stays responsive while a long query or metric is running: it
+// answers /status and handles /interrupt itself. If the client which issued the
+// running request disconnects, its query is interrupted and its queued requests
+// are dropped. The RPC thread refers to connections by id rather than by
+// pointer, as they can be destroyed at any time by the HTTP thread.
+class Httpd : public base::HttpRequestHandler, public HttpRpcServer {
  public:
-  explicit Httpd(std::unique_ptr<TraceProcessor>);
+  // kData and kEndOfResponse stream the body of a chunked response (or
+  // websocket messages). kResponse is a whole response, sent with identity
+  // transfer encoding.
+  enum class ChunkType { kData, kEndOfResponse, kClose, kResponse };
+
+  Httpd(std::unique_ptr<TraceProcessor>, base::TaskRunner*);
   ~Httpd() override;
-  void Run(int port);
+
+  // HttpRpcServer implementation.
+  void Start(int port) override;
+
+  // Sends a chunk of the response (or a whole response) to the connection
+  // |conn_id|, blocking if too many chunks are in flight. Dropped if the
+  // connection has been closed. Called only on the RPC thread.
+  void SendChunk(uint64_t conn_id, ChunkType, const void* data, size_t len);
 
  private:
   // HttpRequestHandler implementation.
   void OnHttpRequest(const base::HttpRequest&) override;
   void OnWebsocketMessage(const base::WebsocketMessage&) override;
+  void OnHttpConnectionClosed(base::HttpServerConnection*) override;
 
   void ServeHelpPage(const base::HttpRequest&);
 
+  // Returns the id of |conn|, assigning one the first time it is seen.
+  uint64_t GetConnId(base::HttpServerConnection*);
+
+  // Queues |fn| to run on the RPC thread after the requests of |conn_id|
+  // queued before, unless the connection is closed first.
+  void PostRpcTask(uint64_t conn_id, std::function<void()> fn);
+
+  // Runs the queued requests until the server is destroyed.
+  void RpcThreadMain();
+
+  // Serves the HTTP request for |uri| on the RPC thread.
+  void ServeRpcRequest(uint64_t conn_id,
+                       const std::string& uri,
+                       const std::string& body);
+
+  // Writes a chunk on the HTTP thread. See SendChunk().
+  void WriteChunk(uint64_t conn_id, ChunkType, const std::string& chunk);
+
   Rpc trace_processor_rpc_;
-  base::UnixTaskRunner task_runner_;
+  base::TaskRunner* const task_runner_;
   base::HttpServer http_srv_;
+
+  // Only accessed on the HTTP thread.
+  uint64_t last_conn_id_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable pending_chunks_cv_;
+  std::condition_variable queued_requests_cv_;
+
+  // The open connections which issued at least one RPC request. The pointers
+  // are dereferenced only on the HTTP thread.
+  std::map<uint64_t, base::HttpServerConnection*> conns_;  // Guarded by mutex_.
+
+  // The requests waiting to run on the RPC thread, by connection. Connections
+  // without queued requests have no entry.
+  std::map<uint64_t, std::deque<std::function<void()>>>
+      queued_requests_;  // Guarded by mutex_.
+
+  // The connection of the request running on the RPC thread, 0 if none.
+  uint64_t running_conn_id_ = 0;  // Guarded by mutex_.
+
+  // The connection of the last request run, to pick the next one round robin.
+  uint64_t last_run_conn_id_ = 0;  // Guarded by mutex_.
+
+  uint32_t pending_chunks_ = 0;  // Guarded by mutex_.
+  bool quit_ = false;            // Guarded by mutex_.
+
+  // Joined in the destructor, before the members above (which it uses) are
+  // destroyed.
+  std::thread rpc_thread_;
+
+  // Chunks can be posted to the HTTP thread right before the server is
+  // destroyed.
+  base::WeakPtrFactory<Httpd> weak_ptr_factory_;  // Keep last.
 };
 
-base::HttpServerConnection* g_cur_conn;
+// The headers of all the responses. The transfer encoding is added by the
+// callers.
+const char kCacheControlHdr[] = "Cache-Control: no-cache";
+const char kContentTypeHdr[] = "Content-Type: application/x-protobuf";
 
-base::StringView Vec2Sv(const std::vector<uint8_t>& v) {
-  return base::StringView(reinterpret_cast<const char*>(v.data()), v.size());
-}
+// The fields below are accessed only on the RPC thread.
+Httpd* g_httpd;
+uint64_t g_cur_conn_id;
 
 // Used both by websockets and /rpc chunked HTTP endpoints.
 void SendRpcChunk(const void* data, uint32_t len) {
   if (data == nullptr) {
     // Unrecoverable RPC error case.
-    if (!g_cur_conn->is_websocket())
-      g_cur_conn->SendResponseBody("0\r\n\r\n", 5);
-    g_cur_conn->Close();
+    g_httpd->SendChunk(g_cur_conn_id, Httpd::ChunkType::kClose, nullptr, 0);
     return;
   }
-  if (g_cur_conn->is_websocket()) {
-    g_cur_conn->SendWebsocketMessage(data, len);
-  } else {
-    base::StackString<32> chunk_hdr("%x\r\n", len);
-    g_cur_conn->SendResponseBody(chunk_hdr.c_str(), chunk_hdr.len());
-    g_cur_conn->SendResponseBody(data, len);
-    g_cur_conn->SendResponseBody("\r\n", 2);
-  }
+  g_httpd->SendChunk(g_cur_conn_id, Httpd::ChunkType::kData, data, len);
 }
 
-Httpd::Httpd(std::unique_ptr<TraceProcessor> preloaded_instance)
+Httpd::Httpd(std::unique_ptr<TraceProcessor> preloaded_instance,
+             base::TaskRunner* task_runner)
     : trace_processor_rpc_(std::move(preloaded_instance)),
-      http_srv_(&task_runner_, this) {}
-Httpd::~Httpd() = default;
+      task_runner_(task_runner),
+      http_srv_(task_runner_, this),
+      rpc_thread_(&Httpd::RpcThreadMain, this),
+      weak_ptr_factory_(this) {
+  g_httpd = this;
+}
+
+Httpd::~Httpd() {
+  // Unblock the RPC thread if it is waiting on a client that is not reading,
+  // and make it exit once the running request (if any) is interrupted.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    conns_.clear();
+    queued_requests_.clear();
+    quit_ = true;
+  }
+  pending_chunks_cv_.notify_all();
+  queued_requests_cv_.notify_all();
+  trace_processor_rpc_.InterruptQuery();
+  rpc_thread_.join();
+}
 
-void Httpd::Run(int port) {
+void Httpd::Start(int port) {
   PERFETTO_ILOG("[HTTP] Starting RPC server on localhost:%d", port);
   PERFETTO_LOG(
       "[HTTP] This server can be used by reloading https://ui.perfetto.dev and "
@@ -106,7 +225,6 @@ void Httpd::Run(int port) {
   for (size_t i = 0; i < base::ArraySize(kAllowedCORSOrigins); ++i)
     http_srv_.AddAllowedOrigin(kAllowedCORSOrigins[i]);
   http_srv_.Start(port);
-  task_runner_.Run();
 }
 
 void Httpd::OnHttpRequest(const base::HttpRequest& req) {
@@ -126,24 +244,68 @@ void Httpd::OnHttpRequest(const base::HttpRequest& req) {
     last_req_id = seq_id;
   }
 
-  // This is the default. Overridden by the /query handler for chunked replies.
+  if (req.uri == "/websocket" && req.is_websocket_handshake) {
+    // Will trigger OnWebsocketMessage() when is received.
+    // It returns a 403 if the origin is not in kAllowedCORSOrigins.
+    return conn.UpgradeToWebsocket(req);
+  }
+
+  // This is the default. Overridden below for the chunked replies.
   char transfer_encoding_hdr[255] = "Transfer-Encoding: identity";
   std::initializer_list<const char*> headers = {
-      "Cache-Control: no-cache",               //
-      "Content-Type: application/x-protobuf",  //
-      transfer_encoding_hdr,                   //
+      kCacheControlHdr,       //
+      kContentTypeHdr,        //
+      transfer_encoding_hdr,  //
   };
 
+  // Answered right away, even if a query is running on the RPC thread.
   if (req.uri == "/status") {
-    auto status = trace_processor_rpc_.GetStatus();
-    return conn.SendResponse("200 OK", headers, Vec2Sv(status));
+    std::vector<uint8_t> status = trace_processor_rpc_.GetStatus();
+    return conn.SendResponse(
+        "200 OK", headers,
+        base::StringView(reinterpret_cast<const char*>(status.data()),
+                         status.size()));
   }
 
-  if (req.uri == "/websocket" && req.is_websocket_handshake) {
-    // Will trigger OnWebsocketMessage() when is received.
-    // It returns a 403 if the origin is not in kAllowedCORSOrigins.
-    return conn.UpgradeToWebsocket(req);
+  // Interrupts the query or metric running on the RPC thread, if any, which
+  // then returns an error to its client.
+  if (req.uri == "/interrupt") {
+    trace_processor_rpc_.InterruptQuery();
+    return conn.SendResponse("200 OK", headers);
+  }
+
+  bool is_rpc_endpoint = false;
+  for (size_t i = 0; i < base::ArraySize(kRpcEndpoints); ++i)
+    is_rpc_endpoint |= req.uri == kRpcEndpoints[i];
+  if (!is_rpc_endpoint)
+    return conn.SendResponseAndClose("404 Not Found", headers);
+
+  // /rpc and /query stream their reply using chunked transfer encoding: the
+  // headers are sent right away, the body is streamed from the RPC thread once
+  // the request gets to run there. The other endpoints send their whole
+  // response from the RPC thread (see WriteChunk()). In both cases the
+  // response is completed later, the requests pipelined on this connection are
+  // held back by the HttpServer until then.
+  if (req.uri == "/rpc" || req.uri == "/query") {
+    base::StringCopy(transfer_encoding_hdr, "Transfer-Encoding: chunked",
+                     sizeof(transfer_encoding_hdr));
+    conn.SendResponseHeaders("200 OK", headers,
+                             base::HttpServerConnection::kOmitContentLength);
   }
+  conn.DeferResponse();
+  uint64_t conn_id = GetConnId(req.conn);
+  std::string uri = req.uri.ToStdString();
+  std::string body = req.body.ToStdString();
+  PostRpcTask(conn_id, [this, conn_id, uri, body] {
+    ServeRpcRequest(conn_id, uri, body);
+  });
+}
+
+void Httpd::ServeRpcRequest(uint64_t conn_id,
+                            const std::string& uri,
+                            const std::string& body) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(body.data());
+  std::vector<uint8_t> res;
 
   // --- Everything below this line is a legacy endpoint not used by the UI.
   // There are two generations of pre-websocket legacy-ness:
@@ -153,125 +315,239 @@ void Httpd::OnHttpRequest(const base::HttpRequest& req) {
   // 2. The REST API, with one enpoint per RPC method (/parse, /query, ...).
   //    This is unused and will be removed at some point.
 
-  if (req.uri == "/rpc") {
-    // Start the chunked reply.
-    base::StringCopy(transfer_encoding_hdr, "Transfer-Encoding: chunked",
-                     sizeof(transfer_encoding_hdr));
-    conn.SendResponseHeaders("200 OK", headers,
-                             base::HttpServerConnection::kOmitContentLength);
-    PERFETTO_CHECK(g_cur_conn == nullptr);
-    g_cur_conn = req.conn;
+  if (uri == "/rpc") {
+    g_cur_conn_id = conn_id;
     trace_processor_rpc_.SetRpcResponseFunction(SendRpcChunk);
     // OnRpcRequest() will call SendRpcChunk() one or more times.
-    trace_processor_rpc_.OnRpcRequest(req.body.data(), req.body.size());
+    trace_processor_rpc_.OnRpcRequest(body.data(), body.size());
     trace_processor_rpc_.SetRpcResponseFunction(nullptr);
-    g_cur_conn = nullptr;
-
-    // Terminate chunked stream.
-    conn.SendResponseBody("0\r\n\r\n", 5);
-    return;
+    g_cur_conn_id = 0;
   }
 
-  if (req.uri == "/parse") {
-    base::Status status = trace_processor_rpc_.Parse(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size());
+  if (uri == "/parse") {
+    base::Status status = trace_processor_rpc_.Parse(data, body.size());
     protozero::HeapBuffered<protos::pbzero::AppendTraceDataResult> result;
     if (!status.ok()) {
       result->set_error(status.c_message());
     }
-    return conn.SendResponse("200 OK", headers,
-                             Vec2Sv(result.SerializeAsArray()));
+    res = result.SerializeAsArray();
   }
 
-  if (req.uri == "/notify_eof") {
+  if (uri == "/notify_eof")
     trace_processor_rpc_.NotifyEndOfFile();
-    return conn.SendResponse("200 OK", headers);
-  }
 
-  if (req.uri == "/restore_initial_tables") {
+  if (uri == "/restore_initial_tables")
     trace_processor_rpc_.RestoreInitialTables();
-    return conn.SendResponse("200 OK", headers);
-  }
 
   // New endpoint, returns data in batches using chunked transfer encoding.
   // The batch size is determined by |cells_per_batch_| and
   // |batch_split_threshold_| in query_result_serializer.h.
   // This is temporary, it will be switched to WebSockets soon.
-  if (req.uri == "/query") {
-    std::vector<uint8_t> response;
-
-    // Start the chunked reply.
-    base::StringCopy(transfer_encoding_hdr, "Transfer-Encoding: chunked",
-                     sizeof(transfer_encoding_hdr));
-    conn.SendResponseHeaders("200 OK", headers,
-                             base::HttpServerConnection::kOmitContentLength);
-
+  if (uri == "/query") {
     // |on_result_chunk| will be called nested within the same callstack of the
     // rpc.Query() call. No further calls will be made once Query() returns.
     auto on_result_chunk = [&](const uint8_t* buf, size_t len, bool has_more) {
       PERFETTO_DLOG("Sending response chunk, len=%zu eof=%d", len, !has_more);
-      char chunk_hdr[32];
-      auto hdr_len = static_cast<size_t>(sprintf(chunk_hdr, "%zx\r\n", len));
-      conn.SendResponseBody(chunk_hdr, hdr_len);
-      conn.SendResponseBody(buf, len);
-      conn.SendResponseBody("\r\n", 2);
-      if (!has_more) {
-        hdr_len = static_cast<size_t>(sprintf(chunk_hdr, "0\r\n\r\n"));
-        conn.SendResponseBody(chunk_hdr, hdr_len);
-      }
+      SendChunk(conn_id, ChunkType::kData, buf, len);
     };
-    trace_processor_rpc_.Query(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size(),
-        on_result_chunk);
-    return;
+    trace_processor_rpc_.Query(data, body.size(), on_result_chunk);
   }
 
   // Legacy endpoint.
   // Returns a columnar-oriented one-shot result. Very inefficient for large
   // result sets. Very inefficient in general too.
-  if (req.uri == "/raw_query") {
-    std::vector<uint8_t> response = trace_processor_rpc_.RawQuery(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size());
-    return conn.SendResponse("200 OK", headers, Vec2Sv(response));
+  if (uri == "/raw_query")
+    res = trace_processor_rpc_.RawQuery(data, body.size());
+
+  if (uri == "/compute_metric")
+    res = trace_processor_rpc_.ComputeMetric(data, body.size());
+
+  if (uri == "/enable_metatrace")
+    trace_processor_rpc_.EnableMetatrace();
+
+  if (uri == "/disable_and_read_metatrace")
+    res = trace_processor_rpc_.DisableAndReadMetatrace();
+
+  if (uri == "/rpc" || uri == "/query") {
+    SendChunk(conn_id, ChunkType::kEndOfResponse, nullptr, 0);
+  } else {
+    SendChunk(conn_id, ChunkType::kResponse, res.data(), res.size());
   }
+}
 
-  if (req.uri == "/compute_metric") {
-    std::vector<uint8_t> res = trace_processor_rpc_.ComputeMetric(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size());
-    return conn.SendResponse("200 OK", headers, Vec2Sv(res));
+void Httpd::OnWebsocketMessage(const base::WebsocketMessage& msg) {
+  uint64_t conn_id = GetConnId(msg.conn);
+  std::string data = msg.data.ToStdString();
+  PostRpcTask(conn_id, [this, conn_id, data] {
+    g_cur_conn_id = conn_id;
+    trace_processor_rpc_.SetRpcResponseFunction(SendRpcChunk);
+    // OnRpcRequest() will call SendRpcChunk() one or more times.
+    trace_processor_rpc_.OnRpcRequest(data.data(), data.size());
+    trace_processor_rpc_.SetRpcResponseFunction(nullptr);
+    g_cur_conn_id = 0;
+  });
+}
+
+void Httpd::OnHttpConnectionClosed(base::HttpServerConnection* conn) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = conns_.begin(); it != conns_.end(); ++it) {
+    if (it->second != conn)
+      continue;
+    // Nobody is going to read the result of the running query anymore: stop
+    // it, so the requests from other clients don't have to wait for it.
+    if (running_conn_id_ == it->first) {
+      PERFETTO_ILOG("[HTTP] Client disconnected, interrupting its query");
+      trace_processor_rpc_.InterruptQuery();
+    }
+    queued_requests_.erase(it->first);
+    conns_.erase(it);
+    break;
   }
+  // Wake up the RPC thread if it is waiting to send chunks to |conn|.
+  pending_chunks_cv_.notify_all();
+}
 
-  if (req.uri == "/enable_metatrace") {
-    trace_processor_rpc_.EnableMetatrace();
-    return conn.SendResponse("200 OK", headers);
+uint64_t Httpd::GetConnId(base::HttpServerConnection* conn) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& it : conns_) {
+    if (it.second == conn)
+      return it.first;
   }
+  uint64_t conn_id = ++last_conn_id_;
+  conns_[conn_id] = conn;
+  return conn_id;
+}
 
-  if (req.uri == "/disable_and_read_metatrace") {
-    std::vector<uint8_t> res = trace_processor_rpc_.DisableAndReadMetatrace();
-    return conn.SendResponse("200 OK", headers, Vec2Sv(res));
+void Httpd::PostRpcTask(uint64_t conn_id, std::function<void()> fn) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_requests_[conn_id].push_back(std::move(fn));
   }
+  queued_requests_cv_.notify_one();
+}
 
-  return conn.SendResponseAndClose("404 Not Found", headers);
+void Httpd::RpcThreadMain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    queued_requests_cv_.wait(
+        lock, [this] { return quit_ || !queued_requests_.empty(); });
+    if (quit_)
+      return;
+
+    // The first connection after the one served last with queued requests.
+    auto it = queued_requests_.upper_bound(last_run_conn_id_);
+    if (it == queued_requests_.end())
+      it = queued_requests_.begin();
+    uint64_t conn_id = it->first;
+    std::function<void()> fn = std::move(it->second.front());
+    it->second.pop_front();
+    if (it->second.empty())
+      queued_requests_.erase(it);
+
+    running_conn_id_ = last_run_conn_id_ = conn_id;
+    lock.unlock();
+    fn();
+    lock.lock();
+    running_conn_id_ = 0;
+  }
 }
 
-void Httpd::OnWebsocketMessage(const base::WebsocketMessage& msg) {
-  PERFETTO_CHECK(g_cur_conn == nullptr);
-  g_cur_conn = msg.conn;
-  trace_processor_rpc_.SetRpcResponseFunction(SendRpcChunk);
-  // OnRpcRequest() will call SendRpcChunk() one or more times.
-  trace_processor_rpc_.OnRpcRequest(msg.data.data(), msg.data.size());
-  trace_processor_rpc_.SetRpcResponseFunction(nullptr);
-  g_cur_conn = nullptr;
+void Httpd::SendChunk(uint64_t conn_id,
+                      ChunkType type,
+                      const void* data,
+                      size_t len) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    pending_chunks_cv_.wait(lock, [this, conn_id] {
+      return pending_chunks_ < kMaxPendingChunks || conns_.count(conn_id) == 0;
+    });
+    if (conns_.count(conn_id) == 0)
+      return;
+    pending_chunks_++;
+  }
+  std::string chunk(static_cast<const char*>(data), len);
+  std::shared_ptr<std::string> chunk_ptr(new std::string(std::move(chunk)));
+  base::WeakPtr<Httpd> weak_this = weak_ptr_factory_.GetWeakPtr();
+  task_runner_->PostTask([weak_this, conn_id, type, chunk_ptr] {
+    if (weak_this)
+      weak_this->WriteChunk(conn_id, type, *chunk_ptr);
+  });
+}
+
+void Httpd::WriteChunk(uint64_t conn_id,
+                       ChunkType type,
+                       const std::string& chunk) {
+  base::HttpServerConnection* conn = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_chunks_--;
+    auto it = conns_.find(conn_id);
+    if (it != conns_.end()) {
+      conn = it->second;
+      // Drop any further chunk queued for a connection being closed.
+      if (type == ChunkType::kClose)
+        conns_.erase(it);
+    }
+  }
+  pending_chunks_cv_.notify_all();
+  if (!conn)
+    return;
+
+  if (type == ChunkType::kResponse) {
+    std::initializer_list<const char*> headers = {
+        kCacheControlHdr,               //
+        kContentTypeHdr,                //
+        "Transfer-Encoding: identity",  //
+    };
+    conn->SendResponse("200 OK", headers,
+                       base::StringView(chunk.data(), chunk.size()));
+    conn->EndDeferredResponse();
+    return;
+  }
+
+  if (type == ChunkType::kData) {
+    if (conn->is_websocket()) {
+      conn->SendWebsocketMessage(chunk.data(), chunk.size());
+    } else if (!chunk.empty()) {
+      // An empty chunk would terminate the chunked stream.
+      base::StackString<32> chunk_hdr("%zx\r\n", chunk.size());
+      conn->SendResponseBody(chunk_hdr.c_str(), chunk_hdr.len());
+      conn->SendResponseBody(chunk.data(), chunk.size());
+      conn->SendResponseBody("\r\n", 2);
+    }
+    return;
+  }
+
+  // Terminate the chunked stream.
+  if (!conn->is_websocket())
+    conn->SendResponseBody("0\r\n\r\n", 5);
+  if (type == ChunkType::kClose) {
+    conn->Close();
+  } else if (!conn->is_websocket()) {
+    conn->EndDeferredResponse();
+  }
 }
 
 }  // namespace
 
+HttpRpcServer::~HttpRpcServer() = default;
+
+// static
+std::unique_ptr<HttpRpcServer> HttpRpcServer::Create(
+    std::unique_ptr<TraceProcessor> preloaded_instance,
+    base::TaskRunner* task_runner) {
+  return std::unique_ptr<HttpRpcServer>(
+      new Httpd(std::move(preloaded_instance), task_runner));
+}
+
 void RunHttpRPCServer(std::unique_ptr<TraceProcessor> preloaded_instance,
                       std::string port_number) {
-  Httpd srv(std::move(preloaded_instance));
+  base::UnixTaskRunner task_runner;
+  Httpd srv(std::move(preloaded_instance), &task_runner);
   base::Optional<int> port_opt = base::StringToInt32(port_number);
   int port = port_opt.has_value() ? *port_opt : kBindPort;
-  srv.Run(port);
+  srv.Start(port);
+  task_runner.Run();
 }
 
 void Httpd::ServeHelpPage(const base::HttpRequest& req) {
@@ -21,6 +21,11 @@
 #include <string>
 
 namespace perfetto {
+
+namespace base {
+class TaskRunner;
+}  // namespace base
+
 namespace trace_processor {
 
 class TraceProcessor;
@@ -32,6 +37,19 @@ class TraceProcessor;
 // instance when pushing data into the /parse endpoint.
 void RunHttpRPCServer(std::unique_ptr<TraceProcessor>, std::string);
 
+// The server run by RunHttpRPCServer(), exposed for testing. It serves HTTP
+// requests on the thread of |task_runner|, which must outlive it, and should be
+// created and destroyed on that thread.
+class HttpRpcServer {
+ public:
+  static std::unique_ptr<HttpRpcServer> Create(std::unique_ptr<TraceProcessor>,
+                                               base::TaskRunner* task_runner);
+  virtual ~HttpRpcServer();
+
+  // Starts listening on localhost:|port|.
+  virtual void Start(int port) = 0;
+};
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
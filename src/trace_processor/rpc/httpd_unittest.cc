@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/base/build_config.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_TP_HTTPD)
+
+#include "src/trace_processor/rpc/httpd.h"
+
+#include <memory>
+#include <string>
+
+#include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/thread_task_runner.h"
+#include "perfetto/ext/base/unix_socket.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace_processor/trace_processor.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr int kTestPort = 5128;
+
+// Never completes unless interrupted.
+constexpr char kEndlessQuery[] =
+    "WITH RECURSIVE n(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM n) "
+    "SELECT COUNT(*) FROM n";
+
+class HttpCli {
+ public:
+  HttpCli() {
+    sock_ = base::UnixSocketRaw::CreateMayFail(base::SockFamily::kInet,
+                                               base::SockType::kStream);
+    sock_.SetBlocking(true);
+    PERFETTO_CHECK(sock_.Connect("127.0.0.1:" + std::to_string(kTestPort)));
+  }
+
+  void Post(const std::string& uri, const std::string& body = "") {
+    sock_.SendStr("POST " + uri + " HTTP/1.1\r\n");
+    sock_.SendStr("Content-Length: " + std::to_string(body.size()) + "\r\n");
+    sock_.SendStr("\r\n");
+    sock_.SendStr(body);
+  }
+
+  // Receives until |rxbuf_| contains |str|, waiting for at most |timeout_ms|
+  // for each read. Returns whether |str| was received.
+  bool RecvUntil(const std::string& str, uint32_t timeout_ms) {
+    sock_.SetRxTimeout(timeout_ms);
+    while (rxbuf_.find(str) == std::string::npos) {
+      char buf[1024];
+      ssize_t rsize = sock_.Receive(buf, sizeof(buf));
+      if (rsize <= 0)
+        return false;
+      rxbuf_.append(buf, static_cast<size_t>(rsize));
+    }
+    return true;
+  }
+
+  const std::string& rxbuf() const { return rxbuf_; }
+
+ private:
+  base::UnixSocketRaw sock_;
+  std::string rxbuf_;
+};
+
+class HttpdTest : public ::testing::Test {
+ protected:
+  HttpdTest()
+      : server_thread_(base::ThreadTaskRunner::CreateAndStart("httpd")) {
+    server_thread_.PostTaskAndWaitForTesting([this] {
+      server_ = HttpRpcServer::Create(TraceProcessor::CreateInstance(Config()),
+                                      server_thread_.get());
+      server_->Start(kTestPort);
+    });
+  }
+
+  ~HttpdTest() override {
+    server_thread_.PostTaskAndWaitForTesting([this] { server_.reset(); });
+  }
+
+  base::ThreadTaskRunner server_thread_;
+  std::unique_ptr<HttpRpcServer> server_;
+};
+
+TEST_F(HttpdTest, StatusWhileQueryRuns) {
+  protozero::HeapBuffered<protos::pbzero::QueryArgs> args;
+  args->set_sql_query(kEndlessQuery);
+  HttpCli query_cli;
+  query_cli.Post("/query", args.SerializeAsString());
+  ASSERT_TRUE(query_cli.RecvUntil("\r\n\r\n", 10000));
+  ASSERT_TRUE(base::StartsWith(query_cli.rxbuf(), "HTTP/1.1 200 OK"));
+
+  // The query never completes: /status is only answered if it is not queued
+  // behind it.
+  HttpCli status_cli;
+  status_cli.Post("/status");
+  ASSERT_TRUE(status_cli.RecvUntil("\r\n\r\n", 10000));
+  ASSERT_TRUE(base::StartsWith(status_cli.rxbuf(), "HTTP/1.1 200 OK"));
+
+  // Pipelined behind the query, this is answered only once the query returns.
+  query_cli.Post("/restore_initial_tables");
+
+  // Interrupting the query before it started running is a no-op: retry until
+  // the query returns.
+  bool query_returned = false;
+  for (int i = 0; i < 100 && !query_returned; ++i) {
+    HttpCli interrupt_cli;
+    interrupt_cli.Post("/interrupt");
+    ASSERT_TRUE(interrupt_cli.RecvUntil("\r\n\r\n", 10000));
+    query_returned = query_cli.RecvUntil("\r\n0\r\n\r\n", 100);
+  }
+  ASSERT_TRUE(query_returned);
+  ASSERT_NE(query_cli.rxbuf().find("interrupted"), std::string::npos);
+
+  // The non-streaming endpoints reply with identity transfer encoding.
+  std::string query_reply = query_cli.rxbuf();
+  ASSERT_TRUE(query_cli.RecvUntil("Content-Length: 0\r\n", 10000));
+  std::string restore_reply = query_cli.rxbuf().substr(query_reply.size());
+  ASSERT_TRUE(base::StartsWith(restore_reply, "HTTP/1.1 200 OK"));
+  ASSERT_NE(restore_reply.find("Transfer-Encoding: identity"),
+            std::string::npos);
+}
+
+TEST_F(HttpdTest, InterruptMultiStatementQuery) {
+  // The interrupt must not be lost if it's received between two statements.
+  std::string sql;
+  for (int i = 0; i < 1000; ++i) {
+    sql += "SELECT COUNT(*) FROM (WITH RECURSIVE n(x) AS (SELECT 1 UNION ALL "
+           "SELECT x + 1 FROM n LIMIT 10000) SELECT x FROM n);";
+  }
+  sql += kEndlessQuery;
+  protozero::HeapBuffered<protos::pbzero::QueryArgs> args;
+  args->set_sql_query(sql);
+  HttpCli query_cli;
+  query_cli.Post("/query", args.SerializeAsString());
+  ASSERT_TRUE(query_cli.RecvUntil("\r\n\r\n", 10000));
+
+  bool query_returned = false;
+  for (int i = 0; i < 100 && !query_returned; ++i) {
+    HttpCli interrupt_cli;
+    interrupt_cli.Post("/interrupt");
+    ASSERT_TRUE(interrupt_cli.RecvUntil("\r\n\r\n", 10000));
+    query_returned = query_cli.RecvUntil("\r\n0\r\n\r\n", 100);
+  }
+  ASSERT_TRUE(query_returned);
+  ASSERT_NE(query_cli.rxbuf().find("interrupted"), std::string::npos);
+
+  // The interrupt only applies to the query running at the time.
+  args.Reset();
+  args->set_sql_query("SELECT 1");
+  HttpCli next_cli;
+  next_cli.Post("/query", args.SerializeAsString());
+  ASSERT_TRUE(next_cli.RecvUntil("\r\n0\r\n\r\n", 10000));
+  ASSERT_EQ(next_cli.rxbuf().find("interrupted"), std::string::npos);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_TP_HTTPD)
@@ -16,8 +16,10 @@
 
 #include "src/trace_processor/rpc/query_result_serializer.h"
 
+#include <string>
 #include <vector>
 
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/protozero/packed_repeated_fields.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
@@ -32,10 +34,13 @@ namespace {
 
 namespace pu = ::protozero::proto_utils;
 using BatchProto = protos::pbzero::QueryResult::CellsBatch;
+using ColumnsBatchProto = protos::pbzero::QueryResult::ColumnsBatch;
+using ColumnProto = protos::pbzero::QueryResult::ColumnsBatch::Column;
 using ResultProto = protos::pbzero::QueryResult;
 
-// The reserved field in trace_processor.proto.
+// The reserved fields in trace_processor.proto.
 static constexpr uint32_t kPaddingFieldId = 7;
+static constexpr uint32_t kColumnPaddingFieldId = 8;
 
 uint8_t MakeLenDelimTag(uint32_t field_num) {
   uint32_t tag = pu::MakeTagLengthDelimited(field_num);
@@ -43,10 +48,64 @@ uint8_t MakeLenDelimTag(uint32_t field_num) {
   return static_cast<uint8_t>(tag);
 }
 
+// Appends |size| bytes of |data| as the |field_num| field of |msg|, making sure
+// that the payload starts at an offset of the stream which is a multiple of
+// |alignment|. This is so that JS can access the payload by overlaying a
+// TypedArray, without extra copies. |padding_field_num| must be a reserved
+// field of |msg|, which is used to fill the gap.
+void AppendAlignedBytes(protozero::Message* msg,
+                        const protozero::ScatteredStreamWriter& writer,
+                        uint32_t field_num,
+                        uint32_t padding_field_num,
+                        const void* data,
+                        uint32_t size,
+                        uint32_t alignment) {
+  uint8_t preamble[16];
+  uint8_t* preamble_end = &preamble[0];
+  *(preamble_end++) = MakeLenDelimTag(field_num);
+  preamble_end = pu::WriteVarInt(size, preamble_end);
+  uint32_t preamble_size = static_cast<uint32_t>(preamble_end - &preamble[0]);
+
+  // The byte after the preamble must start at an aligned offset.
+  // The padding needs to be > 1 Byte because of proto encoding.
+  const uint32_t off = static_cast<uint32_t>(writer.written() + preamble_size);
+  const uint32_t aligned_off = (off + alignment - 1) & ~(alignment - 1);
+  uint32_t padding = aligned_off - off;
+  padding = padding == 1 ? padding + alignment : padding;
+  if (padding > 0) {
+    uint8_t pad_buf[10];
+    uint8_t* pad = pad_buf;
+    *(pad++) = pu::MakeTagVarInt(padding_field_num);
+    for (uint32_t i = 0; i < padding - 2; i++)
+      *(pad++) = 0x80;
+    *(pad++) = 0;
+    msg->AppendRawProtoBytes(pad_buf, static_cast<size_t>(pad - pad_buf));
+  }
+  msg->AppendRawProtoBytes(preamble, preamble_size);
+  PERFETTO_CHECK(writer.written() % alignment == 0);
+  msg->AppendRawProtoBytes(data, size);
+}
+
+ColumnProto::Type CellTypeToColumnType(uint8_t cell_type) {
+  switch (cell_type) {
+    case BatchProto::CELL_VARINT:
+      return ColumnProto::COLUMN_LONG;
+    case BatchProto::CELL_FLOAT64:
+      return ColumnProto::COLUMN_DOUBLE;
+    case BatchProto::CELL_STRING:
+      return ColumnProto::COLUMN_STRING;
+    case BatchProto::CELL_BLOB:
+      return ColumnProto::COLUMN_BLOB;
+  }
+  PERFETTO_FATAL("Unexpected cell type %u", static_cast<uint32_t>(cell_type));
+}
+
 }  // namespace
 
-QueryResultSerializer::QueryResultSerializer(Iterator iter)
-    : iter_(iter.take_impl()), num_cols_(iter_->ColumnCount()) {}
+QueryResultSerializer::QueryResultSerializer(Iterator iter, Format format)
+    : iter_(iter.take_impl()),
+      num_cols_(iter_->ColumnCount()),
+      format_(format) {}
 
 QueryResultSerializer::~QueryResultSerializer() = default;
 
@@ -71,7 +130,11 @@ bool QueryResultSerializer::Serialize(protos::pbzero::QueryResult* res) {
   // write an empty batch with the EOF marker. Errors can happen also in the
   // middle of a query, not just before starting it.
 
-  SerializeBatch(res);
+  if (format_ == Format::kColumnar) {
+    SerializeColumnsBatch(res);
+  } else {
+    SerializeBatch(res);
+  }
   MaybeSerializeError(res);
   return !eof_reached_;
 }
@@ -206,32 +269,10 @@ void QueryResultSerializer::SerializeBatch(protos::pbzero::QueryResult* res) {
   // a TypedArray, without extra copies.
   const uint32_t doubles_size = static_cast<uint32_t>(doubles.size());
   if (doubles_size > 0) {
-    uint8_t preamble[16];
-    uint8_t* preamble_end = &preamble[0];
-    *(preamble_end++) = MakeLenDelimTag(BatchProto::kFloat64CellsFieldNumber);
-    preamble_end = pu::WriteVarInt(doubles_size, preamble_end);
-    uint32_t preamble_size = static_cast<uint32_t>(preamble_end - &preamble[0]);
-
-    // The byte after the preamble must start at a 64bit-aligned offset.
-    // The padding needs to be > 1 Byte because of proto encoding.
-    const uint32_t off =
-        static_cast<uint32_t>(writer.written() + preamble_size);
-    const uint32_t aligned_off = (off + 7) & ~7u;
-    uint32_t padding = aligned_off - off;
-    padding = padding == 1 ? 9 : padding;
-    if (padding > 0) {
-      uint8_t pad_buf[10];
-      uint8_t* pad = pad_buf;
-      *(pad++) = pu::MakeTagVarInt(kPaddingFieldId);
-      for (uint32_t i = 0; i < padding - 2; i++)
-        *(pad++) = 0x80;
-      *(pad++) = 0;
-      batch->AppendRawProtoBytes(pad_buf, static_cast<size_t>(pad - pad_buf));
-    }
-    batch->AppendRawProtoBytes(preamble, preamble_size);
-    PERFETTO_CHECK(writer.written() % 8 == 0);
-    batch->AppendRawProtoBytes(doubles.data(), doubles_size);
-  }  // if (doubles_size > 0)
+    AppendAlignedBytes(batch, writer, BatchProto::kFloat64CellsFieldNumber,
+                       kPaddingFieldId, doubles.data(), doubles_size,
+                       sizeof(double));
+  }
 
   // Append the blobs.
   batch->AppendRawProtoBytes(blobs.data(), blobs.size());
@@ -246,6 +287,184 @@ void QueryResultSerializer::SerializeBatch(protos::pbzero::QueryResult* res) {
   batch->Finalize();
 }
 
+void QueryResultSerializer::SerializeColumnsBatch(
+    protos::pbzero::QueryResult* res) {
+  // Unlike SerializeBatch(), the cells are buffered per column until the end of
+  // the batch, as each column is written contiguously. The non-null cells of a
+  // column usually all have the same type, in which case only their values
+  // (and a null bitmap) are written. Strings are deduplicated across the batch.
+  struct ColumnBuffer {
+    std::vector<uint8_t> cell_types;
+    // The CellType of the non-null cells, if they all have the same type.
+    uint8_t value_type = BatchProto::CELL_INVALID;
+    bool mixed = false;
+    bool has_nulls = false;
+
+    std::vector<int64_t> longs;
+    std::vector<double> doubles;
+    std::vector<uint32_t> string_ids;
+    // Blobs are written with their preamble, as in SerializeBatch().
+    std::vector<uint8_t> blobs;
+  };
+
+  const auto& writer = *res->stream_writer();
+  std::vector<ColumnBuffer> columns(num_cols_);
+
+  std::string dictionary;
+  base::FlatHashMap<std::string, uint32_t> dictionary_ids;
+  uint32_t num_strings = 0;
+
+  // See SerializeBatch().
+  uint32_t approx_batch_size = 16;
+
+  uint32_t num_rows = 0;
+  bool batch_full = false;
+  for (;; ++num_rows) {
+    // |col_| is 0 only if the previous batch was split after moving the
+    // iterator to a row which has not been serialized yet.
+    if (col_ != 0 && !iter_->Next())
+      break;  // EOF or error.
+    col_ = 0;
+
+    PERFETTO_DCHECK(num_cols_ > 0);
+    // As for cells, a batch always contains whole rows (and at least one).
+    if (num_rows > 0 && ((num_rows + 1) * num_cols_ > cells_per_batch_ ||
+                         approx_batch_size > batch_split_threshold_)) {
+      batch_full = true;
+      break;
+    }
+
+    for (uint32_t c = 0; c < num_cols_; ++c) {
+      ColumnBuffer& column = columns[c];
+      auto value = iter_->Get(c);
+      uint8_t cell_type = BatchProto::CELL_INVALID;
+      switch (value.type) {
+        case SqlValue::Type::kNull: {
+          cell_type = BatchProto::CELL_NULL;
+          column.has_nulls = true;
+          break;
+        }
+        case SqlValue::Type::kLong: {
+          cell_type = BatchProto::CELL_VARINT;
+          column.longs.push_back(value.long_value);
+          approx_batch_size += sizeof(int64_t);
+          break;
+        }
+        case SqlValue::Type::kDouble: {
+          cell_type = BatchProto::CELL_FLOAT64;
+          column.doubles.push_back(value.double_value);
+          approx_batch_size += sizeof(double);
+          break;
+        }
+        case SqlValue::Type::kString: {
+          cell_type = BatchProto::CELL_STRING;
+          uint32_t len = static_cast<uint32_t>(strlen(value.string_value));
+          auto id_and_inserted = dictionary_ids.Insert(
+              std::string(value.string_value, len), num_strings);
+          if (id_and_inserted.second) {
+            dictionary.append(value.string_value, len + 1);
+            approx_batch_size += len + 1;
+            ++num_strings;
+          }
+          column.string_ids.push_back(*id_and_inserted.first);
+          approx_batch_size += sizeof(uint32_t);
+          break;
+        }
+        case SqlValue::Type::kBytes: {
+          cell_type = BatchProto::CELL_BLOB;
+          auto* src = static_cast<const uint8_t*>(value.bytes_value);
+          uint32_t len = static_cast<uint32_t>(value.bytes_count);
+          uint8_t preamble[16];
+          uint8_t* preamble_end = &preamble[0];
+          *(preamble_end++) =
+              MakeLenDelimTag(ColumnProto::kBlobValuesFieldNumber);
+          preamble_end = pu::WriteVarInt(len, preamble_end);
+          column.blobs.insert(column.blobs.end(), preamble, preamble_end);
+          column.blobs.insert(column.blobs.end(), src, src + len);
+          approx_batch_size += len + 4;  // 4 is a guess on the preamble size.
+          break;
+        }
+      }
+      PERFETTO_DCHECK(cell_type != BatchProto::CELL_INVALID);
+      column.cell_types.push_back(cell_type);
+      if (cell_type != BatchProto::CELL_NULL) {
+        if (column.value_type == BatchProto::CELL_INVALID) {
+          column.value_type = cell_type;
+        } else if (column.value_type != cell_type) {
+          column.mixed = true;
+        }
+      }
+    }  // for (col)
+    col_ = num_cols_;
+  }  // for (row)
+
+  auto* batch = res->add_columns_batch();
+  batch->set_num_rows(num_rows);
+  for (const ColumnBuffer& column : columns) {
+    auto* column_proto = batch->add_columns();
+
+    ColumnProto::Type type;
+    if (column.mixed) {
+      type = ColumnProto::COLUMN_MIXED;
+    } else if (column.value_type == BatchProto::CELL_INVALID) {
+      type = ColumnProto::COLUMN_NULL;
+    } else {
+      type = CellTypeToColumnType(column.value_type);
+    }
+    column_proto->set_type(type);
+
+    if (type == ColumnProto::COLUMN_MIXED) {
+      column_proto->AppendBytes(ColumnProto::kCellTypesFieldNumber,
+                                column.cell_types.data(), num_rows);
+    } else if (column.has_nulls && type != ColumnProto::COLUMN_NULL) {
+      std::vector<uint8_t> null_bitmap((num_rows + 7) / 8);
+      for (uint32_t i = 0; i < num_rows; ++i) {
+        if (column.cell_types[i] == BatchProto::CELL_NULL)
+          null_bitmap[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+      }
+      column_proto->AppendBytes(ColumnProto::kNullBitmapFieldNumber,
+                                null_bitmap.data(), null_bitmap.size());
+    }
+
+    if (!column.longs.empty()) {
+      AppendAlignedBytes(
+          column_proto, writer, ColumnProto::kLongValuesFieldNumber,
+          kColumnPaddingFieldId, column.longs.data(),
+          static_cast<uint32_t>(column.longs.size() * sizeof(int64_t)),
+          sizeof(int64_t));
+    }
+    if (!column.doubles.empty()) {
+      AppendAlignedBytes(
+          column_proto, writer, ColumnProto::kDoubleValuesFieldNumber,
+          kColumnPaddingFieldId, column.doubles.data(),
+          static_cast<uint32_t>(column.doubles.size() * sizeof(double)),
+          sizeof(double));
+    }
+    if (!column.string_ids.empty()) {
+      AppendAlignedBytes(
+          column_proto, writer, ColumnProto::kStringIdsFieldNumber,
+          kColumnPaddingFieldId, column.string_ids.data(),
+          static_cast<uint32_t>(column.string_ids.size() * sizeof(uint32_t)),
+          sizeof(uint32_t));
+    }
+    column_proto->AppendRawProtoBytes(column.blobs.data(), column.blobs.size());
+  }
+
+  if (!dictionary.empty()) {
+    batch->AppendBytes(ColumnsBatchProto::kStringDictionaryFieldNumber,
+                       dictionary.data(), dictionary.size());
+  }
+
+  // If this is the last batch, write the EOF field.
+  if (!batch_full) {
+    eof_reached_ = true;
+    batch->set_is_last_batch(true);
+  }
+
+  // Finally backfill the size of the whole |batch| sub-message.
+  batch->Finalize();
+}
+
 void QueryResultSerializer::MaybeSerializeError(
     protos::pbzero::QueryResult* res) {
   if (iter_->Status().ok())
@@ -51,10 +51,18 @@ class IteratorImpl;
 //   of a row).
 // The intended use case is streaaming these batches onto through a
 // chunked-encoded HTTP response, or through a repetition of Wasm calls.
+// Rows are encoded either cell by cell (CellsBatch) or column by column
+// (ColumnsBatch), depending on the Format passed to the constructor.
 class QueryResultSerializer {
  public:
+  // Matches QueryArgs.ResultFormat in trace_processor.proto.
+  enum class Format {
+    kCells = 0,
+    kColumnar = 1,
+  };
+
   static constexpr uint32_t kDefaultBatchSplitThreshold = 128 * 1024;
-  explicit QueryResultSerializer(Iterator);
+  explicit QueryResultSerializer(Iterator, Format = Format::kCells);
   ~QueryResultSerializer();
 
   // No copy or move.
@@ -78,10 +86,12 @@ class QueryResultSerializer {
  private:
   void SerializeMetadata(protos::pbzero::QueryResult*);
   void SerializeBatch(protos::pbzero::QueryResult*);
+  void SerializeColumnsBatch(protos::pbzero::QueryResult*);
   void MaybeSerializeError(protos::pbzero::QueryResult*);
 
   std::unique_ptr<IteratorImpl> iter_;
   const uint32_t num_cols_;
+  const Format format_;
   bool did_write_metadata_ = false;
   bool eof_reached_ = false;
   uint32_t col_ = UINT32_MAX;
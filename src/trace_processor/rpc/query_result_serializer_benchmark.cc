@@ -25,6 +25,7 @@ using perfetto::trace_processor::Config;
 using perfetto::trace_processor::QueryResultSerializer;
 using perfetto::trace_processor::TraceProcessor;
 using VectorType = std::vector<uint8_t>;
+using Format = QueryResultSerializer::Format;
 
 namespace {
 
@@ -46,51 +47,78 @@ void RunQueryChecked(TraceProcessor* tp, const std::string& query) {
   PERFETTO_CHECK(iter.Status().ok());
 }
 
-}  // namespace
-
-static void BM_QueryResultSerializer_Mixed(benchmark::State& state) {
-  auto tp = TraceProcessor::CreateInstance(Config());
-  RunQueryChecked(tp.get(), "create virtual table win using window;");
-  RunQueryChecked(tp.get(),
-                  "update win set window_start=0, window_dur=50000, quantum=1 "
-                  "where rowid = 0");
+void BenchmarkSerializer(benchmark::State* state,
+                         TraceProcessor* tp,
+                         const std::string& query,
+                         Format format) {
   VectorType buf;
-  for (auto _ : state) {
-    auto iter = tp->ExecuteQuery(
-        "select dur || dur as x, ts, dur * 1.0 as dur, quantum_ts from win");
-    QueryResultSerializer serializer(std::move(iter));
+  size_t bytes = 0;
+  for (auto _ : *state) {
+    auto iter = tp->ExecuteQuery(query);
+    QueryResultSerializer serializer(std::move(iter), format);
     serializer.set_batch_size_for_testing(
-        static_cast<uint32_t>(state.range(0)),
-        static_cast<uint32_t>(state.range(1)));
+        static_cast<uint32_t>(state->range(0)),
+        static_cast<uint32_t>(state->range(1)));
     while (serializer.Serialize(&buf)) {
     }
     benchmark::DoNotOptimize(buf.data());
+    bytes = buf.size();
     buf.clear();
   }
   benchmark::ClobberMemory();
+  state->counters["bytes"] = static_cast<double>(bytes);
 }
 
+}  // namespace
+
+template <Format format>
+static void BM_QueryResultSerializer_Mixed(benchmark::State& state) {
+  auto tp = TraceProcessor::CreateInstance(Config());
+  RunQueryChecked(tp.get(), "create virtual table win using window;");
+  RunQueryChecked(tp.get(),
+                  "update win set window_start=0, window_dur=50000, quantum=1 "
+                  "where rowid = 0");
+  BenchmarkSerializer(&state, tp.get(),
+                      "select dur || dur as x, ts, dur * 1.0 as dur, "
+                      "quantum_ts from win",
+                      format);
+}
+
+template <Format format>
 static void BM_QueryResultSerializer_Strings(benchmark::State& state) {
   auto tp = TraceProcessor::CreateInstance(Config());
   RunQueryChecked(tp.get(), "create virtual table win using window;");
   RunQueryChecked(tp.get(),
                   "update win set window_start=0, window_dur=100000, quantum=1 "
                   "where rowid = 0");
-  VectorType buf;
-  for (auto _ : state) {
-    auto iter = tp->ExecuteQuery(
-        "select  ts || '-' || ts , (dur * 1.0) || dur from win");
-    QueryResultSerializer serializer(std::move(iter));
-    serializer.set_batch_size_for_testing(
-        static_cast<uint32_t>(state.range(0)),
-        static_cast<uint32_t>(state.range(1)));
-    while (serializer.Serialize(&buf)) {
-    }
-    benchmark::DoNotOptimize(buf.data());
-    buf.clear();
-  }
-  benchmark::ClobberMemory();
+  BenchmarkSerializer(&state, tp.get(),
+                      "select  ts || '-' || ts , (dur * 1.0) || dur from win",
+                      format);
+}
+
+// Low cardinality strings, as commonly found in thread or slice names.
+template <Format format>
+static void BM_QueryResultSerializer_RepeatedStrings(benchmark::State& state) {
+  auto tp = TraceProcessor::CreateInstance(Config());
+  RunQueryChecked(tp.get(), "create virtual table win using window;");
+  RunQueryChecked(tp.get(),
+                  "update win set window_start=0, window_dur=100000, quantum=1 "
+                  "where rowid = 0");
+  BenchmarkSerializer(&state, tp.get(),
+                      "select 'thread_' || (ts % 32) as name, ts from win",
+                      format);
 }
 
-BENCHMARK(BM_QueryResultSerializer_Mixed)->Apply(BenchmarkArgs);
-BENCHMARK(BM_QueryResultSerializer_Strings)->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_QueryResultSerializer_Mixed, Format::kCells)
+    ->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_QueryResultSerializer_Mixed, Format::kColumnar)
+    ->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_QueryResultSerializer_Strings, Format::kCells)
+    ->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_QueryResultSerializer_Strings, Format::kColumnar)
+    ->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_QueryResultSerializer_RepeatedStrings, Format::kCells)
+    ->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_QueryResultSerializer_RepeatedStrings,
+                   Format::kColumnar)
+    ->Apply(BenchmarkArgs);
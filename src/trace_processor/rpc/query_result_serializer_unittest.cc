@@ -71,7 +71,10 @@ namespace {
 
 using ::testing::ElementsAre;
 using BatchProto = protos::pbzero::QueryResult::CellsBatch;
+using ColumnsBatchProto = protos::pbzero::QueryResult::ColumnsBatch;
+using ColumnProto = protos::pbzero::QueryResult::ColumnsBatch::Column;
 using ResultProto = protos::pbzero::QueryResult;
+using Format = QueryResultSerializer::Format;
 
 void RunQueryChecked(TraceProcessor* tp, const std::string& query) {
   auto iter = tp->ExecuteQuery(query);
@@ -90,7 +93,15 @@ class TestDeserializer {
   std::string error;
   bool eof_reached = false;
 
+  // Stats about the ColumnsBatch(es), if any.
+  uint32_t num_mixed_columns = 0;
+  uint32_t num_dictionary_strings = 0;
+
  private:
+  void DeserializeColumnsBatch(protozero::ConstBytes);
+  SqlValue CopyString(const std::string&);
+  SqlValue CopyBytes(const std::string&);
+
   std::vector<std::unique_ptr<char[]>> copied_buf_;
 };
 
@@ -161,21 +172,13 @@ void TestDeserializer::DeserializeBuffer(const uint8_t* start, size_t size) {
           break;
         case BatchProto::CELL_STRING: {
           ASSERT_GT(strings.size(), 0u);
-          const std::string& str = strings.front();
-          copied_buf_.emplace_back(new char[str.size() + 1]);
-          char* new_buf = copied_buf_.back().get();
-          memcpy(new_buf, str.c_str(), str.size() + 1);
-          cells.emplace_back(SqlValue::String(new_buf));
+          cells.emplace_back(CopyString(strings.front()));
           strings.pop_front();
           break;
         }
         case BatchProto::CELL_BLOB: {
           ASSERT_GT(blobs.size(), 0u);
-          auto bytes = blobs.front();
-          copied_buf_.emplace_back(new char[bytes.size()]);
-          memcpy(copied_buf_.back().get(), bytes.data(), bytes.size());
-          cells.emplace_back(
-              SqlValue::Bytes(copied_buf_.back().get(), bytes.size()));
+          cells.emplace_back(CopyBytes(blobs.front()));
           blobs.pop_front();
           break;
         }
@@ -191,6 +194,122 @@ void TestDeserializer::DeserializeBuffer(const uint8_t* start, size_t size) {
       EXPECT_EQ(num_cells % columns.size(), 0u);
     }
   }
+
+  for (auto batch_it = result.columns_batch(); batch_it; ++batch_it) {
+    ASSERT_FALSE(eof_reached);
+    DeserializeColumnsBatch(batch_it->as_bytes());
+  }
+}
+
+void TestDeserializer::DeserializeColumnsBatch(protozero::ConstBytes bytes) {
+  ColumnsBatchProto::Decoder batch(bytes.data, bytes.size);
+  eof_reached = batch.is_last_batch();
+  const uint32_t num_rows = batch.num_rows();
+
+  std::string merged_strings = batch.string_dictionary().ToStdString();
+  std::vector<std::string> dictionary;
+  for (size_t pos = 0; pos < merged_strings.size();) {
+    size_t next_sep = merged_strings.find('\0', pos);
+    ASSERT_NE(next_sep, std::string::npos);
+    dictionary.emplace_back(merged_strings.substr(pos, next_sep - pos));
+    pos = next_sep + 1;
+  }
+  num_dictionary_strings += static_cast<uint32_t>(dictionary.size());
+
+  // Decodes all the columns and then transposes them into |cells|.
+  std::vector<std::vector<SqlValue>> values;
+  for (auto col_it = batch.columns(); col_it; ++col_it) {
+    auto col_bytes = col_it->as_bytes();
+    ColumnProto::Decoder col(col_bytes.data, col_bytes.size);
+
+    // The numeric arrays must be aligned so that they can be accessed in place.
+    auto long_values = col.long_values();
+    auto double_values = col.double_values();
+    auto string_ids = col.string_ids();
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(long_values.data) % 8, 0u);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(double_values.data) % 8, 0u);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(string_ids.data) % 4, 0u);
+    const auto* longs = reinterpret_cast<const int64_t*>(long_values.data);
+    const auto* doubles = reinterpret_cast<const double*>(double_values.data);
+    const auto* ids = reinterpret_cast<const uint32_t*>(string_ids.data);
+    std::deque<std::string> blobs;
+    for (auto it = col.blob_values(); it; ++it)
+      blobs.emplace_back((*it).ToStdString());
+
+    auto type = static_cast<ColumnProto::Type>(col.type());
+    if (type == ColumnProto::COLUMN_MIXED) {
+      ASSERT_EQ(col.cell_types().size, num_rows);
+      num_mixed_columns++;
+    }
+    auto null_bitmap = col.null_bitmap();
+
+    values.emplace_back();
+    size_t long_idx = 0, double_idx = 0, string_idx = 0;
+    for (uint32_t row = 0; row < num_rows; ++row) {
+      uint8_t cell_type;
+      if (type == ColumnProto::COLUMN_MIXED) {
+        cell_type = col.cell_types().data[row];
+      } else if (type == ColumnProto::COLUMN_NULL ||
+                 (null_bitmap.size > 0 &&
+                  (null_bitmap.data[row / 8] & (1u << (row % 8))))) {
+        cell_type = BatchProto::CELL_NULL;
+      } else if (type == ColumnProto::COLUMN_LONG) {
+        cell_type = BatchProto::CELL_VARINT;
+      } else if (type == ColumnProto::COLUMN_DOUBLE) {
+        cell_type = BatchProto::CELL_FLOAT64;
+      } else if (type == ColumnProto::COLUMN_STRING) {
+        cell_type = BatchProto::CELL_STRING;
+      } else {
+        cell_type = BatchProto::CELL_BLOB;
+      }
+
+      switch (cell_type) {
+        case BatchProto::CELL_NULL:
+          values.back().emplace_back(SqlValue());
+          break;
+        case BatchProto::CELL_VARINT:
+          ASSERT_LT(long_idx * sizeof(int64_t), long_values.size);
+          values.back().emplace_back(SqlValue::Long(longs[long_idx++]));
+          break;
+        case BatchProto::CELL_FLOAT64:
+          ASSERT_LT(double_idx * sizeof(double), double_values.size);
+          values.back().emplace_back(SqlValue::Double(doubles[double_idx++]));
+          break;
+        case BatchProto::CELL_STRING:
+          ASSERT_LT(string_idx * sizeof(uint32_t), string_ids.size);
+          ASSERT_LT(ids[string_idx], dictionary.size());
+          values.back().emplace_back(
+              CopyString(dictionary[ids[string_idx++]]));
+          break;
+        case BatchProto::CELL_BLOB:
+          ASSERT_GT(blobs.size(), 0u);
+          values.back().emplace_back(CopyBytes(blobs.front()));
+          blobs.pop_front();
+          break;
+        default:
+          FAIL() << "Unknown cell type " << cell_type;
+      }
+    }
+  }
+
+  ASSERT_EQ(values.size(), columns.size());
+  for (uint32_t row = 0; row < num_rows; ++row) {
+    for (const auto& column : values)
+      cells.emplace_back(column[row]);
+  }
+}
+
+SqlValue TestDeserializer::CopyString(const std::string& str) {
+  copied_buf_.emplace_back(new char[str.size() + 1]);
+  char* new_buf = copied_buf_.back().get();
+  memcpy(new_buf, str.c_str(), str.size() + 1);
+  return SqlValue::String(new_buf);
+}
+
+SqlValue TestDeserializer::CopyBytes(const std::string& bytes) {
+  copied_buf_.emplace_back(new char[bytes.size()]);
+  memcpy(copied_buf_.back().get(), bytes.data(), bytes.size());
+  return SqlValue::Bytes(copied_buf_.back().get(), bytes.size());
 }
 
 TEST(QueryResultSerializerTest, ShortBatch) {
@@ -316,13 +435,15 @@ TEST(QueryResultSerializerTest, LargeStringAndBlobs) {
   sql_values.resize(sql_values.size() - 1);  // Remove trailing comma.
   RunQueryChecked(tp.get(), "insert into tab (colz) values " + sql_values);
 
-  auto iter = tp->ExecuteQuery("select colz from tab");
-  QueryResultSerializer ser(std::move(iter));
-  TestDeserializer deser;
-  deser.SerializeAndDeserialize(&ser);
-  ASSERT_EQ(deser.cells.size(), expected.size());
-  for (size_t i = 0; i < expected.size(); i++) {
-    EXPECT_EQ(deser.cells[i], expected[i]) << "Cell " << i;
+  for (Format format : {Format::kCells, Format::kColumnar}) {
+    auto iter = tp->ExecuteQuery("select colz from tab");
+    QueryResultSerializer ser(std::move(iter), format);
+    TestDeserializer deser;
+    deser.SerializeAndDeserialize(&ser);
+    ASSERT_EQ(deser.cells.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+      EXPECT_EQ(deser.cells[i], expected[i]) << "Cell " << i;
+    }
   }
 }
 
@@ -386,9 +507,10 @@ TEST(QueryResultSerializerTest, RandomSizes) {
   }
 
   // Serialize and de-serialize with different batch and payload sizes.
-  for (int rep = 0; rep < 10; rep++) {
+  for (int rep = 0; rep < 20; rep++) {
     auto iter = tp->ExecuteQuery("select * from tab");
-    QueryResultSerializer ser(std::move(iter));
+    QueryResultSerializer ser(std::move(iter),
+                              rep % 2 ? Format::kColumnar : Format::kCells);
     uint32_t cells_per_batch = 1 << (rnd_engine() % 8 + 2);
     uint32_t binary_payload_size = 1 << (rnd_engine() % 8 + 8);
     ser.set_batch_size_for_testing(cells_per_batch, binary_payload_size);
@@ -401,6 +523,87 @@ TEST(QueryResultSerializerTest, RandomSizes) {
   }
 }
 
+TEST(QueryResultSerializerTest, ColumnarShortBatch) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+
+  auto iter = tp->ExecuteQuery(
+      "select 1 as i8, 128 as i16, 100000 as i32, 42001001001 as i64, 1e9 as "
+      "f64, 'a_string' as str, cast('a_blob' as blob) as blb, null as nul");
+  QueryResultSerializer ser(std::move(iter), Format::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+
+  EXPECT_THAT(deser.columns, ElementsAre("i8", "i16", "i32", "i64", "f64",
+                                         "str", "blb", "nul"));
+  EXPECT_THAT(deser.cells,
+              ElementsAre(SqlValue::Long(1), SqlValue::Long(128),
+                          SqlValue::Long(100000), SqlValue::Long(42001001001),
+                          SqlValue::Double(1e9), SqlValue::String("a_string"),
+                          SqlValue::Bytes("a_blob", 6), SqlValue()));
+  EXPECT_EQ(deser.num_mixed_columns, 0u);
+}
+
+TEST(QueryResultSerializerTest, ColumnarLongBatch) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+
+  RunQueryChecked(tp.get(), "create virtual table win using window;");
+  RunQueryChecked(tp.get(),
+                  "update win set window_start=0, window_dur=8192, quantum=1 "
+                  "where rowid = 0");
+
+  auto iter = tp->ExecuteQuery(
+      "select 'x' as x, ts, dur * 1.0 as dur, quantum_ts from win");
+  QueryResultSerializer ser(std::move(iter), Format::kColumnar);
+  ser.set_batch_size_for_testing(4096, 128 * 1024);
+
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+
+  ASSERT_THAT(deser.columns, ElementsAre("x", "ts", "dur", "quantum_ts"));
+  ASSERT_EQ(deser.cells.size(), 4 * 8192u);
+  for (uint32_t row = 0; row < 8192; row++) {
+    uint32_t cell = row * 4;
+    ASSERT_EQ(deser.cells[cell].type, SqlValue::kString);
+    ASSERT_STREQ(deser.cells[cell].string_value, "x");
+
+    ASSERT_EQ(deser.cells[cell + 1].type, SqlValue::kLong);
+    ASSERT_EQ(deser.cells[cell + 1].long_value, row);
+
+    ASSERT_EQ(deser.cells[cell + 2].type, SqlValue::kDouble);
+    ASSERT_EQ(deser.cells[cell + 2].double_value, 1.0);
+
+    ASSERT_EQ(deser.cells[cell + 3].type, SqlValue::kLong);
+    ASSERT_EQ(deser.cells[cell + 3].long_value, row);
+  }
+
+  // 1024 rows per batch, each with a single copy of the string.
+  EXPECT_EQ(deser.num_dictionary_strings, 8u);
+}
+
+TEST(QueryResultSerializerTest, ColumnarNullsAndMixedTypes) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  RunQueryChecked(tp.get(), "create table tab (a, b, c, d)");
+  RunQueryChecked(tp.get(),
+                  "insert into tab (a, b, c, d) values "
+                  "(1, 'x', NULL, 1), (NULL, 'y', NULL, 'z'), "
+                  "(3, 'x', NULL, NULL), (4, NULL, NULL, 2.5)");
+  auto iter = tp->ExecuteQuery("select * from tab");
+  QueryResultSerializer ser(std::move(iter), Format::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+
+  EXPECT_THAT(
+      deser.cells,
+      ElementsAre(SqlValue::Long(1), SqlValue::String("x"), SqlValue(),
+                  SqlValue::Long(1), SqlValue(), SqlValue::String("y"),
+                  SqlValue(), SqlValue::String("z"), SqlValue::Long(3),
+                  SqlValue::String("x"), SqlValue(), SqlValue(),
+                  SqlValue::Long(4), SqlValue(), SqlValue(),
+                  SqlValue::Double(2.5)));
+  EXPECT_EQ(deser.num_mixed_columns, 1u);
+  EXPECT_EQ(deser.num_dictionary_strings, 3u);
+}
+
 TEST(QueryResultSerializerTest, ErrorBeforeStartingQuery) {
   auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
   auto iter = tp->ExecuteQuery("insert into incomplete_input");
@@ -426,6 +629,31 @@ TEST(QueryResultSerializerTest, ErrorAfterSomeResults) {
   EXPECT_TRUE(deser.eof_reached);
 }
 
+TEST(QueryResultSerializerTest, ColumnarErrorAfterSomeResults) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  RunQueryChecked(tp.get(), "create table tab (x)");
+  RunQueryChecked(tp.get(), "insert into tab (x) values (0), (1), ('error')");
+  auto iter = tp->ExecuteQuery("select str_split('a;b', ';', x) as s from tab");
+  QueryResultSerializer ser(std::move(iter), Format::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+  EXPECT_NE(deser.error, "");
+  EXPECT_THAT(deser.cells,
+              ElementsAre(SqlValue::String("a"), SqlValue::String("b")));
+  EXPECT_TRUE(deser.eof_reached);
+}
+
+TEST(QueryResultSerializerTest, ColumnarNoResultQuery) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  auto iter = tp->ExecuteQuery("create table tab (x)");
+  QueryResultSerializer ser(std::move(iter), Format::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+  EXPECT_EQ(deser.error, "");
+  EXPECT_EQ(deser.cells.size(), 0u);
+  EXPECT_TRUE(deser.eof_reached);
+}
+
 TEST(QueryResultSerializerTest, NoResultQuery) {
   auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
   {
@@ -48,6 +48,15 @@ using RpcProto = protos::pbzero::TraceProcessorRpc;
 constexpr auto kSliceSize =
     QueryResultSerializer::kDefaultBatchSplitThreshold + 4096;
 
+// Returns the result encoding requested by the QueryArgs proto in |args|.
+QueryResultSerializer::Format GetResultFormat(const uint8_t* args,
+                                              size_t len) {
+  protos::pbzero::QueryArgs::Decoder query(args, len);
+  if (query.result_format() == protos::pbzero::QueryArgs::COLUMNAR)
+    return QueryResultSerializer::Format::kColumnar;
+  return QueryResultSerializer::Format::kCells;
+}
+
 // Holds a trace_processor::TraceProcessorRpc pbzero message. Avoids extra
 // copies by doing direct scattered calls from the fragmented heap buffer onto
 // the RpcResponseFunction (the receiver is expected to deal with arbitrary
@@ -92,13 +101,22 @@ Rpc::Rpc(std::unique_ptr<TraceProcessor> preloaded_instance)
     : trace_processor_(std::move(preloaded_instance)) {
   if (!trace_processor_)
     ResetTraceProcessor();
+  UpdateLoadedTraceName();
 }
 
 Rpc::Rpc() : Rpc(nullptr) {}
 Rpc::~Rpc() = default;
 
 void Rpc::ResetTraceProcessor() {
-  trace_processor_ = TraceProcessor::CreateInstance(Config());
+  // The old instance, which can hold a large trace, is destroyed outside of
+  // the lock so that InterruptQuery() is never blocked for long.
+  std::unique_ptr<TraceProcessor> old_instance;
+  {
+    std::lock_guard<std::mutex> lock(trace_processor_mutex_);
+    old_instance = std::move(trace_processor_);
+    trace_processor_ = TraceProcessor::CreateInstance(Config());
+    loaded_trace_name_ = trace_processor_->GetCurrentTraceName();
+  }
   bytes_parsed_ = bytes_last_progress_ = 0;
   t_parse_started_ = base::GetWallTimeNs().count();
   // Deliberately not resetting the RPC channel state (rxbuf_, {tx,rx}_seq_id_).
@@ -183,7 +201,8 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
       } else {
         protozero::ConstBytes args = req.query_args();
         auto it = QueryInternal(args.data, args.size);
-        QueryResultSerializer serializer(std::move(it));
+        QueryResultSerializer serializer(std::move(it),
+                                         GetResultFormat(args.data, args.size));
         for (bool has_more = true; has_more;) {
           Response resp(tx_seq_id_++, req_type);
           has_more = serializer.Serialize(resp->set_query_result());
@@ -280,15 +299,24 @@ util::Status Rpc::Parse(const uint8_t* data, size_t len) {
   // TraceProcessor needs take ownership of the memory chunk.
   std::unique_ptr<uint8_t[]> data_copy(new uint8_t[len]);
   memcpy(data_copy.get(), data, len);
-  return trace_processor_->Parse(std::move(data_copy), len);
+  util::Status status = trace_processor_->Parse(std::move(data_copy), len);
+  UpdateLoadedTraceName();
+  return status;
 }
 
 void Rpc::NotifyEndOfFile() {
   trace_processor_->NotifyEndOfFile();
   eof_ = true;
+  UpdateLoadedTraceName();
   MaybePrintProgress();
 }
 
+void Rpc::UpdateLoadedTraceName() {
+  std::string name = trace_processor_->GetCurrentTraceName();
+  std::lock_guard<std::mutex> lock(trace_processor_mutex_);
+  loaded_trace_name_ = std::move(name);
+}
+
 void Rpc::MaybePrintProgress() {
   if (eof_ || bytes_parsed_ - bytes_last_progress_ > kProgressUpdateBytes) {
     bytes_last_progress_ = bytes_parsed_;
@@ -307,7 +335,7 @@ void Rpc::Query(const uint8_t* args,
                 size_t len,
                 QueryResultBatchCallback result_callback) {
   auto it = QueryInternal(args, len);
-  QueryResultSerializer serializer(std::move(it));
+  QueryResultSerializer serializer(std::move(it), GetResultFormat(args, len));
 
   std::vector<uint8_t> res;
   for (bool has_more = true; has_more;) {
@@ -465,6 +493,12 @@ void Rpc::RestoreInitialTables() {
   trace_processor_->RestoreInitialTables();
 }
 
+void Rpc::InterruptQuery() {
+  std::lock_guard<std::mutex> lock(trace_processor_mutex_);
+  if (trace_processor_)
+    trace_processor_->InterruptQuery();
+}
+
 std::vector<uint8_t> Rpc::ComputeMetric(const uint8_t* args, size_t len) {
   protozero::HeapBuffered<protos::pbzero::ComputeMetricResult> result;
   ComputeMetricInternal(args, len, result.get());
@@ -540,7 +574,10 @@ void Rpc::DisableAndReadMetatraceInternal(
 
 std::vector<uint8_t> Rpc::GetStatus() {
   protozero::HeapBuffered<protos::pbzero::StatusResult> status;
-  status->set_loaded_trace_name(trace_processor_->GetCurrentTraceName());
+  {
+    std::lock_guard<std::mutex> lock(trace_processor_mutex_);
+    status->set_loaded_trace_name(loaded_trace_name_);
+  }
   status->set_human_readable_version(base::GetVersionString());
   status->set_api_version(protos::pbzero::TRACE_PROCESSOR_CURRENT_API_VERSION);
   return status.SerializeAsArray();
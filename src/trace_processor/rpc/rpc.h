@@ -19,6 +19,8 @@
 
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 #include <stddef.h>
@@ -106,6 +108,9 @@ class Rpc {
   std::vector<uint8_t> ComputeMetric(const uint8_t* data, size_t len);
   void EnableMetatrace();
   std::vector<uint8_t> DisableAndReadMetatrace();
+
+  // Unlike most of the other methods, this can be called from any thread, even
+  // while a query is running.
   std::vector<uint8_t> GetStatus();
 
   // Creates a new RPC session by deleting all tables and views that have been
@@ -113,8 +118,14 @@ class Rpc {
   // tables/view created by the ingestion process are preserved.
   void RestoreInitialTables();
 
+  // Interrupts the query or metric computation currently running, if any. The
+  // interrupted call returns an error. Unlike all the other methods, this can
+  // be called from any thread.
+  void InterruptQuery();
+
   // Runs a query and returns results in batch. Each batch is a proto-encoded
-  // TraceProcessor.QueryResult message and contains a variable number of rows.
+  // TraceProcessor.QueryResult message and contains a variable number of rows,
+  // encoded as requested by QueryArgs.result_format.
   // The callbacks are called inline, so the whole callstack looks as follows:
   // Query(..., callback)
   //   callback(..., has_more=true)
@@ -136,6 +147,8 @@ class Rpc {
  private:
   void ParseRpcRequest(const uint8_t* data, size_t len);
   void ResetTraceProcessor();
+  // Updates |loaded_trace_name_| from |trace_processor_|.
+  void UpdateLoadedTraceName();
   void MaybePrintProgress();
   Iterator QueryInternal(const uint8_t* args, size_t len);
   void RawQueryInternal(const uint8_t* args,
@@ -148,6 +161,17 @@ class Rpc {
       protos::pbzero::DisableAndReadMetatraceResult*);
 
   std::unique_ptr<TraceProcessor> trace_processor_;
+
+  // Guards replacing |trace_processor_| against InterruptQuery() and
+  // |loaded_trace_name_| against GetStatus(), which can be called from other
+  // threads.
+  std::mutex trace_processor_mutex_;
+
+  // The name of the trace reported by GetStatus(). A copy of the one returned
+  // by TraceProcessor::GetCurrentTraceName(), which can't be called while
+  // another thread parses or queries the trace.
+  std::string loaded_trace_name_;
+
   RpcResponseFunction rpc_response_fn_;
   protozero::ProtoRingBuffer rxbuf_;
   int64_t tx_seq_id_ = 0;
@@ -48,8 +48,9 @@ base::Optional<FilterOp> SqliteOpToFilterOp(int sqlite_op) {
     case SQLITE_INDEX_CONSTRAINT_ISNOTNULL:
       return FilterOp::kIsNotNull;
     case SQLITE_INDEX_CONSTRAINT_LIKE:
+      return FilterOp::kLike;
     case SQLITE_INDEX_CONSTRAINT_GLOB:
-      return base::nullopt;
+      return FilterOp::kGlob;
 #if SQLITE_VERSION_NUMBER >= 3038000
     // LIMIT and OFFSET constraints were introduced in 3.38 but we
     // still build for older versions in most places. We still need
@@ -64,6 +65,23 @@ base::Optional<FilterOp> SqliteOpToFilterOp(int sqlite_op) {
   }
 }
 
+// Returns the FilterOp for the constraint |c| or nullopt if the constraint
+// should be handled by SQLite rather than by the table.
+base::Optional<FilterOp> ConstraintToFilterOp(
+    const Table::Schema& schema,
+    const QueryConstraints::Constraint& c) {
+  base::Optional<FilterOp> op = SqliteOpToFilterOp(c.op);
+
+  // SQLite converts numerics to strings when pattern matching: leave this to
+  // SQLite on non-string columns.
+  if (op && (*op == FilterOp::kGlob || *op == FilterOp::kLike) &&
+      schema.columns[static_cast<uint32_t>(c.column)].type !=
+          SqlValue::Type::kString) {
+    return base::nullopt;
+  }
+  return op;
+}
+
 SqlValue SqliteValueToSqlValue(sqlite3_value* sqlite_val) {
   auto col_type = sqlite3_value_type(sqlite_val);
   SqlValue value;
@@ -197,10 +215,10 @@ void DbSqliteTable::BestIndex(const Table::Schema& schema,
 
   const auto& cs = qc.constraints();
   for (uint32_t i = 0; i < cs.size(); ++i) {
-    // SqliteOpToFilterOp will return nullopt for any constraint which we don't
-    // support filtering ourselves. Only omit filtering by SQLite when we can
-    // handle filtering.
-    base::Optional<FilterOp> opt_op = SqliteOpToFilterOp(cs[i].op);
+    // ConstraintToFilterOp will return nullopt for any constraint which we
+    // don't support filtering ourselves. Only omit filtering by SQLite when we
+    // can handle filtering.
+    base::Optional<FilterOp> opt_op = ConstraintToFilterOp(schema, cs[i]);
     info->sqlite_omit_constraint[i] = opt_op.has_value();
   }
 
@@ -236,6 +254,11 @@ void DbSqliteTable::ModifyConstraints(const Table::Schema& schema,
     if (a_col.is_sorted && !b_col.is_sorted)
       return true;
 
+    // Indexed columns only need a binary search on the index so order them
+    // after sorted columns.
+    if (a_col.is_indexed && !b_col.is_indexed && !b_col.is_sorted)
+      return true;
+
     // TODO(lalitm): introduce more orderings here based on empirical data.
     return false;
   });
@@ -313,12 +336,13 @@ DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
       // to sort by that column and then binary search if we see the constraint
       // set often. Model this by dividing by the log of the number of rows as
       // a good approximation. Otherwise, we'll need to do a full table scan.
-      // Alternatively, if the column is sorted, we can use the same binary
-      // search logic so we have the same low cost (even better because we don't
-      // have to sort at all).
-      filter_cost += cs.size() == 1 || col_schema.is_sorted
-                         ? log2(current_row_count)
-                         : current_row_count;
+      // Alternatively, if the column is sorted or indexed, we can use the same
+      // binary search logic so we have the same low cost (even better because
+      // we don't have to sort at all).
+      filter_cost +=
+          cs.size() == 1 || col_schema.is_sorted || col_schema.is_indexed
+              ? log2(current_row_count)
+              : current_row_count;
 
       // As an extremely rough heuristic, assume that an equalty constraint will
       // cut down the number of rows by approximately double log of the number
@@ -412,16 +436,18 @@ void DbSqliteTable::Cursor::TryCacheCreateSortedTable(
   if (!sqlite_utils::IsOpEq(c.op))
     return;
 
-  // If the column is already sorted, we don't need to cache at all.
+  // If the column is already sorted or indexed, we don't need to cache at all.
   uint32_t col = static_cast<uint32_t>(c.column);
-  if (upstream_table_->GetColumn(col).IsSorted())
+  const auto& column = upstream_table_->GetColumn(col);
+  if (column.IsSorted() || column.IsIndexed())
     return;
 
   // Try again to get the result or start caching it.
   sorted_cache_table_ =
-      cache_->GetOrCache(upstream_table_, qc.constraints(), [this, col]() {
-        return upstream_table_->Sort({Order{col, false}});
-      });
+      cache_->GetOrCache(upstream_table_, qc.constraints(), {},
+                         [this, col]() {
+                           return upstream_table_->Sort({Order{col, false}});
+                         });
 }
 
 int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
@@ -440,11 +466,21 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
 
     // If we get a nullopt FilterOp, that means we should allow SQLite
     // to handle the constraint.
-    base::Optional<FilterOp> opt_op = SqliteOpToFilterOp(cs.op);
+    base::Optional<FilterOp> opt_op =
+        ConstraintToFilterOp(db_sqlite_table_->schema_, cs);
     if (!opt_op)
       continue;
 
     SqlValue value = SqliteValueToSqlValue(argv[i]);
+
+    // SQLite matches patterns against the text form of numbers (e.g. GLOB 123
+    // is GLOB '123'): convert them like SQLite does as the constraint is
+    // omitted.
+    if ((*opt_op == FilterOp::kGlob || *opt_op == FilterOp::kLike) &&
+        !value.is_null() && value.type != SqlValue::kString) {
+      value = SqlValue::String(
+          reinterpret_cast<const char*>(sqlite3_value_text(argv[i])));
+    }
     constraints_[constraints_pos++] = Constraint{col, *opt_op, value};
   }
   constraints_.resize(constraints_pos);
@@ -457,6 +493,11 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
     orders_[i] = Order{col, static_cast<bool>(ob.desc)};
   }
 
+  // The columns read by SQLite; only these need to be computed for dynamic
+  // tables or have their RowMaps built below.
+  BitVector cols_used = ColsUsedBitVector(
+      qc.cols_used(), db_sqlite_table_->schema_.columns.size());
+
   // Setup the upstream table based on the computation state.
   switch (db_sqlite_table_->computation_) {
     case TableComputation::kStatic:
@@ -475,10 +516,8 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
       // If we have a dynamically created table, regenerate the table based on
       // the new constraints.
       std::unique_ptr<Table> computed_table;
-      BitVector cols_used_bv = ColsUsedBitVector(
-          qc.cols_used(), db_sqlite_table_->schema_.columns.size());
       auto status = db_sqlite_table_->generator_->ComputeTable(
-          constraints_, orders_, cols_used_bv, computed_table);
+          constraints_, orders_, cols_used, computed_table);
 
       if (!status.ok()) {
         auto* sqlite_err = sqlite3_mprintf(
@@ -526,6 +565,12 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
         case FilterOp::kIsNotNull:
           writer.AppendString("IS NOT");
           break;
+        case FilterOp::kGlob:
+          writer.AppendString("GLOB");
+          break;
+        case FilterOp::kLike:
+          writer.AppendString("LIKE");
+          break;
       }
       writer.AppendChar(' ');
 
@@ -590,11 +635,12 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
   } else {
     mode_ = Mode::kTable;
 
-    db_table_ = SourceTable()->Apply(std::move(filter_map));
+    // Rather than applying the RowMap to the table (which would select the
+    // rows from the RowMap of every column), sort the RowMap itself and only
+    // materialize the columns which are actually read.
     if (!orders_.empty())
-      db_table_ = db_table_->Sort(orders_);
-
-    iterator_ = db_table_->IterateRows();
+      filter_map = SourceTable()->SortToRowMap(std::move(filter_map), orders_);
+    iterator_ = SourceTable()->IterateRows(std::move(filter_map), cols_used);
 
     eof_ = !*iterator_;
   }
@@ -118,19 +118,20 @@ class DbSqliteTable : public SqliteTable {
     // Only valid for Mode::kSingleRow.
     base::Optional<uint32_t> single_row_;
 
-    // Only valid for Mode::kTable.
-    base::Optional<Table> db_table_;
-    base::Optional<Table::Iterator> iterator_;
+    // Only valid for Mode::kTable. Iterates over the filtered (and sorted)
+    // rows of SourceTable() without materializing them into a new table;
+    // only the RowMaps of the columns SQLite reads are computed.
+    base::Optional<Table::LazyIterator> iterator_;
 
     bool eof_ = true;
 
-    // Stores a sorted version of |db_table_| sorted on a repeated equals
+    // Stores a sorted version of |upstream_table_| sorted on a repeated equals
     // constraint. This allows speeding up repeated subqueries in joins
     // significantly.
     std::shared_ptr<Table> sorted_cache_table_;
 
     // Stores the count of repeated equality queries to decide whether it is
-    // wortwhile to sort |db_table_| to create |sorted_cache_table_|.
+    // wortwhile to sort |upstream_table_| to create |sorted_cache_table_|.
     uint32_t repeated_cache_count_ = 0;
 
     Mode mode_ = Mode::kSingleRow;
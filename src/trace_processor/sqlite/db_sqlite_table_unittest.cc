@@ -26,15 +26,23 @@ namespace {
 Table::Schema CreateSchema() {
   Table::Schema schema;
   schema.columns.push_back({"id", SqlValue::Type::kLong, true /* is_id */,
-                            true /* is_sorted */, false /* is_hidden */});
+                            true /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
   schema.columns.push_back({"type", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+                            false /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
   schema.columns.push_back({"test1", SqlValue::Type::kLong, false /* is_id */,
-                            true /* is_sorted */, false /* is_hidden */});
+                            true /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
   schema.columns.push_back({"test2", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+                            false /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
   schema.columns.push_back({"test3", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+                            false /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
+  schema.columns.push_back({"test4", SqlValue::Type::kLong, false /* is_id */,
+                            false /* is_sorted */, false /* is_hidden */,
+                            true /* is_indexed */});
   return schema;
 }
 
@@ -118,6 +126,30 @@ TEST(DbSqliteTable, MultiSortedEqCheaperThanMultiUnsortedEq) {
   ASSERT_EQ(sorted_cost.rows, unsorted_cost.rows);
 }
 
+TEST(DbSqliteTable, MultiIndexedEqCheaperThanMultiUnsortedEq) {
+  auto schema = CreateSchema();
+  constexpr uint32_t kRowCount = 1234;
+
+  QueryConstraints indexed_eq;
+  indexed_eq.AddConstraint(5u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  indexed_eq.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+
+  auto indexed_cost =
+      DbSqliteTable::EstimateCost(schema, kRowCount, indexed_eq);
+
+  QueryConstraints unsorted_eq;
+  unsorted_eq.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  unsorted_eq.AddConstraint(4u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+
+  auto unsorted_cost =
+      DbSqliteTable::EstimateCost(schema, kRowCount, unsorted_eq);
+
+  // The number of rows should be the same but the cost of the indexed
+  // query should be less.
+  ASSERT_LT(indexed_cost.cost, unsorted_cost.cost);
+  ASSERT_EQ(indexed_cost.rows, unsorted_cost.rows);
+}
+
 TEST(DbSqliteTable, EmptyTableCosting) {
   auto schema = CreateSchema();
 
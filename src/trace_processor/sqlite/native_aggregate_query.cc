@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/native_aggregate_query.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <limits>
+#include <map>
+
+#include "perfetto/ext/base/string_utils.h"
+#include "src/trace_processor/db/compare.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+struct Token {
+  enum Type {
+    kIdentifier,
+    kInteger,
+    kFloat,
+    kString,
+    kPunctuation,
+    kEnd,
+  };
+
+  Type type;
+
+  // For string literals, the unescaped contents of the string; otherwise the
+  // text of the token.
+  std::string text;
+
+  // The span of the token in the query.
+  size_t begin;
+  size_t end;
+};
+
+bool IsIdentifierStart(char c) {
+  return isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool IsIdentifierChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool IsDigit(char c) {
+  return isdigit(static_cast<unsigned char>(c)) != 0;
+}
+
+// Splits |sql| into tokens. Returns false if |sql| contains anything which is
+// not supported (e.g. comments, quoted identifiers, blobs) to keep the parser
+// simple: such queries are left to SQLite.
+bool Tokenize(const std::string& sql, std::vector<Token>* tokens) {
+  size_t i = 0;
+  while (i < sql.size()) {
+    char c = sql[i];
+    size_t begin = i;
+    if (isspace(static_cast<unsigned char>(c))) {
+      ++i;
+      continue;
+    }
+    if (IsIdentifierStart(c)) {
+      while (i < sql.size() && IsIdentifierChar(sql[i]))
+        ++i;
+      if (i < sql.size() && sql[i] == '$')
+        return false;
+      tokens->push_back(
+          {Token::kIdentifier, sql.substr(begin, i - begin), begin, i});
+      continue;
+    }
+    if (IsDigit(c)) {
+      bool is_float = false;
+      while (i < sql.size() && IsDigit(sql[i]))
+        ++i;
+      if (i < sql.size() && sql[i] == '.') {
+        is_float = true;
+        for (++i; i < sql.size() && IsDigit(sql[i]);)
+          ++i;
+      }
+      if (i < sql.size() && (sql[i] == 'e' || sql[i] == 'E')) {
+        is_float = true;
+        ++i;
+        if (i < sql.size() && (sql[i] == '+' || sql[i] == '-'))
+          ++i;
+        if (i == sql.size() || !IsDigit(sql[i]))
+          return false;
+        while (i < sql.size() && IsDigit(sql[i]))
+          ++i;
+      }
+      // Reject things like hex literals and numbers directly followed by
+      // identifiers.
+      if (i < sql.size() && (IsIdentifierChar(sql[i]) || sql[i] == '.'))
+        return false;
+      tokens->push_back({is_float ? Token::kFloat : Token::kInteger,
+                         sql.substr(begin, i - begin), begin, i});
+      continue;
+    }
+    if (c == '\'') {
+      std::string value;
+      for (++i;; ++i) {
+        if (i == sql.size())
+          return false;
+        if (sql[i] == '\'') {
+          if (i + 1 < sql.size() && sql[i + 1] == '\'') {
+            value.push_back('\'');
+            ++i;
+            continue;
+          }
+          break;
+        }
+        value.push_back(sql[i]);
+      }
+      ++i;
+      tokens->push_back({Token::kString, std::move(value), begin, i});
+      continue;
+    }
+
+    static const char* const kPunctuation[] = {
+        "==", "!=", "<>", "<=", ">=", "(", ")", ",",
+        "*",  ";",  "=",  "<",  ">",  "-"};
+    bool found = false;
+    for (const char* p : kPunctuation) {
+      size_t len = strlen(p);
+      if (sql.compare(i, len, p) == 0) {
+        i += len;
+        tokens->push_back({Token::kPunctuation, p, begin, i});
+        found = true;
+        break;
+      }
+    }
+    if (!found)
+      return false;
+  }
+  tokens->push_back({Token::kEnd, "", sql.size(), sql.size()});
+  return true;
+}
+
+// Simple recursive-descent helper over a list of tokens.
+class TokenStream {
+ public:
+  explicit TokenStream(std::vector<Token> tokens)
+      : tokens_(std::move(tokens)) {}
+
+  const Token& Peek(size_t ahead = 0) const {
+    size_t idx = pos_ + ahead;
+    return idx < tokens_.size() ? tokens_[idx] : tokens_.back();
+  }
+
+  const Token& Consume() {
+    const Token& token = Peek();
+    if (pos_ < tokens_.size() - 1)
+      ++pos_;
+    return token;
+  }
+
+  bool IsKeyword(const char* keyword, size_t ahead = 0) const {
+    const Token& token = Peek(ahead);
+    return token.type == Token::kIdentifier &&
+           base::CaseInsensitiveEqual(token.text, keyword);
+  }
+
+  bool IsPunctuation(const char* p, size_t ahead = 0) const {
+    const Token& token = Peek(ahead);
+    return token.type == Token::kPunctuation && token.text == p;
+  }
+
+  bool ConsumeKeyword(const char* keyword) {
+    if (!IsKeyword(keyword))
+      return false;
+    Consume();
+    return true;
+  }
+
+  bool ConsumePunctuation(const char* p) {
+    if (!IsPunctuation(p))
+      return false;
+    Consume();
+    return true;
+  }
+
+  // Consumes an identifier which is not one of the keywords used by the
+  // grammar.
+  bool ConsumeIdentifier(std::string* out) {
+    static const char* const kKeywords[] = {
+        "select", "from", "where", "and", "or",   "group", "by",   "as",
+        "is",     "not",  "null",  "order", "limit", "having", "distinct",
+        "all"};
+    const Token& token = Peek();
+    if (token.type != Token::kIdentifier)
+      return false;
+    for (const char* keyword : kKeywords) {
+      if (base::CaseInsensitiveEqual(token.text, keyword))
+        return false;
+    }
+    *out = Consume().text;
+    return true;
+  }
+
+ private:
+  std::vector<Token> tokens_;
+  size_t pos_ = 0;
+};
+
+struct SqlValueLess {
+  bool operator()(const SqlValue& a, const SqlValue& b) const {
+    return compare::SqlValue(a, b) < 0;
+  }
+};
+
+}  // namespace
+
+// static
+base::Optional<NativeAggregateQuery> NativeAggregateQuery::Parse(
+    const std::string& sql) {
+  std::vector<Token> tokens;
+  if (!Tokenize(sql, &tokens))
+    return base::nullopt;
+
+  NativeAggregateQuery query;
+  TokenStream ts(std::move(tokens));
+  if (!ts.ConsumeKeyword("select"))
+    return base::nullopt;
+
+  // Parse the list of items being selected.
+  do {
+    Item item;
+    size_t begin = ts.Peek().begin;
+    std::string ident;
+    if (!ts.ConsumeIdentifier(&ident))
+      return base::nullopt;
+
+    size_t end;
+    if (ts.ConsumePunctuation("(")) {
+      std::string fn = base::ToLower(ident);
+      if (fn == "count" && ts.ConsumePunctuation("*")) {
+        item.type = ItemType::kCountStar;
+      } else {
+        if (fn == "count") {
+          item.type = ItemType::kCount;
+        } else if (fn == "sum") {
+          item.type = ItemType::kSum;
+        } else if (fn == "avg") {
+          item.type = ItemType::kAvg;
+        } else if (fn == "min") {
+          item.type = ItemType::kMin;
+        } else if (fn == "max") {
+          item.type = ItemType::kMax;
+        } else {
+          return base::nullopt;
+        }
+        if (!ts.ConsumeIdentifier(&item.column))
+          return base::nullopt;
+      }
+      end = ts.Peek().end;
+      if (!ts.ConsumePunctuation(")"))
+        return base::nullopt;
+
+      // SQLite names columns which are not plain column references using the
+      // text of the expression as written in the query.
+      item.name = sql.substr(begin, end - begin);
+    } else {
+      // The name of plain column references is filled in when executing the
+      // query as SQLite uses the name of the column in the table.
+      item.type = ItemType::kGroupColumn;
+      item.column = ident;
+    }
+
+    if (ts.ConsumeKeyword("as") && !ts.ConsumeIdentifier(&item.name))
+      return base::nullopt;
+
+    query.items_.emplace_back(std::move(item));
+  } while (ts.ConsumePunctuation(","));
+
+  if (!ts.ConsumeKeyword("from"))
+    return base::nullopt;
+  if (!ts.ConsumeIdentifier(&query.table_name_))
+    return base::nullopt;
+  query.table_name_ = base::ToLower(query.table_name_);
+
+  // Parse the constraints.
+  if (ts.ConsumeKeyword("where")) {
+    do {
+      Condition cond;
+      if (!ts.ConsumeIdentifier(&cond.column))
+        return base::nullopt;
+
+      if (ts.ConsumeKeyword("is")) {
+        cond.op = ts.ConsumeKeyword("not") ? FilterOp::kIsNotNull
+                                           : FilterOp::kIsNull;
+        if (!ts.ConsumeKeyword("null"))
+          return base::nullopt;
+        cond.value_type = SqlValue::kNull;
+        query.conditions_.emplace_back(std::move(cond));
+        continue;
+      }
+
+      if (ts.ConsumePunctuation("=") || ts.ConsumePunctuation("==")) {
+        cond.op = FilterOp::kEq;
+      } else if (ts.ConsumePunctuation("!=") || ts.ConsumePunctuation("<>")) {
+        cond.op = FilterOp::kNe;
+      } else if (ts.ConsumePunctuation("<")) {
+        cond.op = FilterOp::kLt;
+      } else if (ts.ConsumePunctuation("<=")) {
+        cond.op = FilterOp::kLe;
+      } else if (ts.ConsumePunctuation(">")) {
+        cond.op = FilterOp::kGt;
+      } else if (ts.ConsumePunctuation(">=")) {
+        cond.op = FilterOp::kGe;
+      } else {
+        return base::nullopt;
+      }
+
+      bool negate = ts.ConsumePunctuation("-");
+      const Token& literal = ts.Consume();
+      if (literal.type == Token::kInteger) {
+        // SQLite treats integers which don't fit in an int64 as doubles:
+        // simply don't handle anything close to that.
+        base::Optional<int64_t> value = base::StringToInt64(literal.text);
+        if (!value || literal.text.size() > 18)
+          return base::nullopt;
+        cond.value_type = SqlValue::kLong;
+        cond.long_value = negate ? -*value : *value;
+      } else if (literal.type == Token::kFloat) {
+        base::Optional<double> value = base::StringToDouble(literal.text);
+        if (!value)
+          return base::nullopt;
+        cond.value_type = SqlValue::kDouble;
+        cond.double_value = negate ? -*value : *value;
+      } else if (literal.type == Token::kString && !negate) {
+        cond.value_type = SqlValue::kString;
+        cond.string_value = literal.text;
+      } else {
+        return base::nullopt;
+      }
+      query.conditions_.emplace_back(std::move(cond));
+    } while (ts.ConsumeKeyword("and"));
+  }
+
+  if (ts.ConsumeKeyword("group")) {
+    std::string group_by;
+    if (!ts.ConsumeKeyword("by") || !ts.ConsumeIdentifier(&group_by))
+      return base::nullopt;
+    query.group_by_ = std::move(group_by);
+  }
+
+  ts.ConsumePunctuation(";");
+  if (ts.Peek().type != Token::kEnd)
+    return base::nullopt;
+
+  // Without a GROUP BY, SQLite returns the value of plain columns from an
+  // arbitrary row; with one, only the grouped column can be returned.
+  for (const Item& item : query.items_) {
+    if (item.type != ItemType::kGroupColumn)
+      continue;
+    if (!query.group_by_ ||
+        !base::CaseInsensitiveEqual(item.column, *query.group_by_)) {
+      return base::nullopt;
+    }
+  }
+  return base::make_optional(std::move(query));
+}
+
+base::Optional<NativeAggregateQuery::Result> NativeAggregateQuery::Execute(
+    const Table& table) const {
+  // Convert the conditions into constraints on the table. Only literals with
+  // the same type as the column are handled to avoid any subtlety with
+  // SQLite's type conversions.
+  std::vector<Constraint> cs;
+  for (const Condition& cond : conditions_) {
+    base::Optional<uint32_t> col_idx = FindColumn(table, cond.column);
+    if (!col_idx)
+      return base::nullopt;
+
+    bool is_string_column =
+        table.GetColumn(*col_idx).type() == SqlValue::kString;
+    SqlValue value;
+    switch (cond.value_type) {
+      case SqlValue::kNull:
+        break;
+      case SqlValue::kLong:
+        if (is_string_column)
+          return base::nullopt;
+        value = SqlValue::Long(cond.long_value);
+        break;
+      case SqlValue::kDouble:
+        if (is_string_column)
+          return base::nullopt;
+        value = SqlValue::Double(cond.double_value);
+        break;
+      case SqlValue::kString:
+        if (!is_string_column)
+          return base::nullopt;
+        value = SqlValue::String(cond.string_value.c_str());
+        break;
+      case SqlValue::kBytes:
+        return base::nullopt;
+    }
+    cs.push_back(Constraint{*col_idx, cond.op, value});
+  }
+
+  Result result;
+  BitVector cols_used(table.GetColumnCount(), false);
+  std::vector<uint32_t> item_cols(items_.size());
+  for (uint32_t i = 0; i < items_.size(); ++i) {
+    const Item& item = items_[i];
+    result.column_names.push_back(item.name);
+    if (item.type == ItemType::kCountStar)
+      continue;
+
+    base::Optional<uint32_t> col_idx = FindColumn(table, item.column);
+    if (!col_idx)
+      return base::nullopt;
+
+    // SUM and AVG convert strings to numbers: leave this to SQLite.
+    SqlValue::Type type = table.GetColumn(*col_idx).type();
+    if ((item.type == ItemType::kSum || item.type == ItemType::kAvg) &&
+        type != SqlValue::kLong && type != SqlValue::kDouble) {
+      return base::nullopt;
+    }
+    if (result.column_names.back().empty())
+      result.column_names.back() = table.GetColumn(*col_idx).name();
+
+    item_cols[i] = *col_idx;
+    cols_used.Set(*col_idx);
+  }
+
+  base::Optional<uint32_t> group_col;
+  if (group_by_) {
+    group_col = FindColumn(table, *group_by_);
+    if (!group_col)
+      return base::nullopt;
+    cols_used.Set(*group_col);
+  }
+
+  RowMap rm = table.FilterToRowMap(cs);
+  auto it = table.IterateRows(std::move(rm), cols_used);
+  size_t item_count = items_.size();
+
+  if (!group_col) {
+    // Without a GROUP BY, there's always exactly one row in the result.
+    std::vector<AggregateState> states(item_count);
+    for (; it; it.Next()) {
+      for (uint32_t i = 0; i < item_count; ++i) {
+        ItemType type = items_[i].type;
+        SqlValue value =
+            type == ItemType::kCountStar ? SqlValue() : it.Get(item_cols[i]);
+        Step(type, value, &states[i]);
+      }
+    }
+    for (uint32_t i = 0; i < item_count; ++i) {
+      base::Optional<SqlValue> value = Finalize(items_[i].type, states[i]);
+      if (!value)
+        return base::nullopt;
+      result.values.push_back(*value);
+    }
+    return base::make_optional(std::move(result));
+  }
+
+  // SQLite returns groups sorted by their key so use an ordered map. Rows
+  // with the same key are usually consecutive so remember the last group to
+  // avoid looking up the map for every row.
+  std::map<SqlValue, uint32_t, SqlValueLess> groups;
+  std::vector<AggregateState> states;
+  SqlValue last_key;
+  uint32_t last_group = std::numeric_limits<uint32_t>::max();
+  for (; it; it.Next()) {
+    SqlValue key = it.Get(*group_col);
+    if (last_group == std::numeric_limits<uint32_t>::max() ||
+        compare::SqlValue(key, last_key) != 0) {
+      auto group_it = groups.find(key);
+      if (group_it == groups.end()) {
+        uint32_t group = static_cast<uint32_t>(groups.size());
+        group_it = groups.emplace(key, group).first;
+        states.resize(states.size() + item_count);
+      }
+      last_key = key;
+      last_group = group_it->second;
+    }
+
+    AggregateState* group_states = &states[last_group * item_count];
+    for (uint32_t i = 0; i < item_count; ++i) {
+      ItemType type = items_[i].type;
+      if (type == ItemType::kGroupColumn)
+        continue;
+      SqlValue value =
+          type == ItemType::kCountStar ? SqlValue() : it.Get(item_cols[i]);
+      Step(type, value, &group_states[i]);
+    }
+  }
+
+  for (const auto& key_and_group : groups) {
+    const AggregateState* group_states =
+        &states[key_and_group.second * item_count];
+    for (uint32_t i = 0; i < item_count; ++i) {
+      if (items_[i].type == ItemType::kGroupColumn) {
+        result.values.push_back(key_and_group.first);
+        continue;
+      }
+      base::Optional<SqlValue> value =
+          Finalize(items_[i].type, group_states[i]);
+      if (!value)
+        return base::nullopt;
+      result.values.push_back(*value);
+    }
+  }
+  return base::make_optional(std::move(result));
+}
+
+// static
+base::Optional<uint32_t> NativeAggregateQuery::FindColumn(
+    const Table& table,
+    const std::string& name) {
+  for (uint32_t i = 0; i < table.GetColumnCount(); ++i) {
+    const auto& col = table.GetColumn(i);
+    if (!col.IsDummy() && base::CaseInsensitiveEqual(col.name(), name))
+      return i;
+  }
+  return base::nullopt;
+}
+
+// static
+void NativeAggregateQuery::Step(ItemType type,
+                                const SqlValue& value,
+                                AggregateState* state) {
+  if (type == ItemType::kCountStar) {
+    state->count++;
+    return;
+  }
+
+  // All the other aggregates ignore nulls.
+  if (value.is_null())
+    return;
+
+  switch (type) {
+    case ItemType::kCount:
+      state->count++;
+      break;
+    case ItemType::kSum:
+    case ItemType::kAvg:
+      // This mirrors the implementation of sum() in SQLite: the sum is
+      // computed both as an integer and as a double and the former is only
+      // used if all values are integers and it did not overflow.
+      state->count++;
+      if (value.type == SqlValue::kLong) {
+        int64_t v = value.long_value;
+        state->double_sum += static_cast<double>(v);
+        if (!state->is_approx && !state->overflow) {
+          if ((v > 0 &&
+               state->int_sum > std::numeric_limits<int64_t>::max() - v) ||
+              (v < 0 &&
+               state->int_sum < std::numeric_limits<int64_t>::min() - v)) {
+            state->is_approx = state->overflow = true;
+          } else {
+            state->int_sum += v;
+          }
+        }
+      } else {
+        state->double_sum += value.double_value;
+        state->is_approx = true;
+      }
+      break;
+    case ItemType::kMin:
+      if (state->value.is_null() || compare::SqlValue(value, state->value) < 0)
+        state->value = value;
+      break;
+    case ItemType::kMax:
+      if (state->value.is_null() || compare::SqlValue(value, state->value) > 0)
+        state->value = value;
+      break;
+    case ItemType::kCountStar:
+    case ItemType::kGroupColumn:
+      PERFETTO_FATAL("Should be handled above");
+  }
+}
+
+// static
+base::Optional<SqlValue> NativeAggregateQuery::Finalize(
+    ItemType type,
+    const AggregateState& state) {
+  switch (type) {
+    case ItemType::kCountStar:
+    case ItemType::kCount:
+      return SqlValue::Long(state.count);
+    case ItemType::kSum:
+      if (state.count == 0)
+        return SqlValue();
+      // SQLite reports an "integer overflow" error in this case.
+      if (state.overflow)
+        return base::nullopt;
+      return state.is_approx ? SqlValue::Double(state.double_sum)
+                             : SqlValue::Long(state.int_sum);
+    case ItemType::kAvg:
+      if (state.count == 0)
+        return SqlValue();
+      return SqlValue::Double(state.double_sum /
+                              static_cast<double>(state.count));
+    case ItemType::kMin:
+    case ItemType::kMax:
+      return state.value;
+    case ItemType::kGroupColumn:
+      PERFETTO_FATAL("Should be handled by the caller");
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
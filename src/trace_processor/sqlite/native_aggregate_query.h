@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_SQLITE_NATIVE_AGGREGATE_QUERY_H_
+#define SRC_TRACE_PROCESSOR_SQLITE_NATIVE_AGGREGATE_QUERY_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/optional.h"
+#include "perfetto/trace_processor/basic_types.h"
+#include "src/trace_processor/db/table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// A simple aggregation query over a single db table which can be executed
+// directly on the columns of the table rather than by SQLite, avoiding the
+// per-row cost of going through the virtual table interface.
+//
+// Only queries of the following form are supported:
+//   SELECT <item> [, <item>]* FROM <table>
+//   [WHERE <column> <op> <literal> [AND <column> <op> <literal>]*]
+//   [GROUP BY <column>]
+// where each <item> is either COUNT(*) or COUNT/SUM/AVG/MIN/MAX(<column>),
+// optionally followed by AS <alias>, or the GROUP BY column itself. <op> is
+// one of =, ==, !=, <>, <, <=, >, >=, IS NULL and IS NOT NULL.
+//
+// The results (including the names and order of the rows and columns) are
+// the same as if the query was executed by SQLite; any query which does not
+// match the above exactly (e.g. joins, expressions, ORDER BY, comments) is
+// left to SQLite.
+class NativeAggregateQuery {
+ public:
+  // The result of executing a query.
+  struct Result {
+    uint32_t row_count() const {
+      return static_cast<uint32_t>(values.size() / column_names.size());
+    }
+
+    std::vector<std::string> column_names;
+
+    // The values of the result, row by row. Strings point into the StringPool
+    // of the table the query was executed on.
+    std::vector<SqlValue> values;
+  };
+
+  // Parses |sql| returning nullopt if it is not a query supported by this
+  // class.
+  static base::Optional<NativeAggregateQuery> Parse(const std::string& sql);
+
+  // Executes the query on |table|, which should be the table named by
+  // table_name(). Returns nullopt if the query cannot be executed natively
+  // on this table (e.g. it refers to columns which don't exist or the result
+  // of an aggregate needs SQLite to be computed): the query should be passed
+  // to SQLite in this case.
+  base::Optional<Result> Execute(const Table& table) const;
+
+  // The (lowercased) name of the table being queried.
+  const std::string& table_name() const { return table_name_; }
+
+ private:
+  enum class ItemType {
+    kGroupColumn,
+    kCountStar,
+    kCount,
+    kSum,
+    kAvg,
+    kMin,
+    kMax,
+  };
+
+  struct Item {
+    ItemType type;
+    std::string column;
+    std::string name;
+  };
+
+  struct Condition {
+    std::string column;
+    FilterOp op;
+
+    // Only one of the below is valid depending on |value_type|.
+    SqlValue::Type value_type;
+    int64_t long_value;
+    double double_value;
+    std::string string_value;
+  };
+
+  // The state of an aggregate for a single group.
+  struct AggregateState {
+    int64_t count = 0;
+    int64_t int_sum = 0;
+    double double_sum = 0;
+    bool is_approx = false;
+    bool overflow = false;
+    SqlValue value;
+  };
+
+  // Returns the index of the column named |name| in |table| if it exists.
+  static base::Optional<uint32_t> FindColumn(const Table& table,
+                                             const std::string& name);
+
+  static void Step(ItemType, const SqlValue&, AggregateState*);
+  static base::Optional<SqlValue> Finalize(ItemType, const AggregateState&);
+
+  std::vector<Item> items_;
+  std::string table_name_;
+  std::vector<Condition> conditions_;
+  base::Optional<std::string> group_by_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SQLITE_NATIVE_AGGREGATE_QUERY_H_
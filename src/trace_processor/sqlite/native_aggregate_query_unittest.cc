@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/native_aggregate_query.h"
+
+#include <limits>
+
+#include "perfetto/ext/base/string_utils.h"
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/sqlite/query_cache.h"
+#include "src/trace_processor/sqlite/scoped_db.h"
+#include "src/trace_processor/tables/macros.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+#define PERFETTO_TP_TEST_AGGREGATE_TABLE(NAME, PARENT, C) \
+  NAME(TestAggregateTable, "test_table")                 \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                      \
+  C(uint32_t, cpu)                                       \
+  C(int64_t, ts)                                         \
+  C(base::Optional<int64_t>, dur)                        \
+  C(double, value)                                       \
+  C(StringPool::Id, name)                                \
+  C(base::Optional<StringPool::Id>, category)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_AGGREGATE_TABLE);
+
+TestAggregateTable::~TestAggregateTable() = default;
+
+// A query result converted to strings to make it easy to compare.
+struct StringResult {
+  std::vector<std::string> column_names;
+  std::vector<std::string> values;
+};
+
+std::string ToString(const SqlValue& value) {
+  switch (value.type) {
+    case SqlValue::kNull:
+      return "NULL";
+    case SqlValue::kLong:
+      return "L" + std::to_string(value.long_value);
+    case SqlValue::kDouble:
+      return "D" + std::to_string(value.double_value);
+    case SqlValue::kString:
+      return "S" + std::string(value.string_value);
+    case SqlValue::kBytes:
+      return "B";
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+class NativeAggregateQueryTest : public ::testing::Test {
+ public:
+  NativeAggregateQueryTest() : table_(&pool_, nullptr) {
+    sqlite3_initialize();
+
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+    PERFETTO_CHECK(sqlite3_exec(*db_, "CREATE TABLE perfetto_tables(name TEXT)",
+                                nullptr, nullptr, nullptr) == SQLITE_OK);
+    DbSqliteTable::RegisterTable(*db_, &cache_, TestAggregateTable::Schema(),
+                                 &table_, table_.table_name());
+
+    const char* kNames[] = {"foo", "bar", "baz"};
+    for (uint32_t i = 0; i < 100; ++i) {
+      TestAggregateTable::Row row;
+      row.cpu = i % 4;
+      row.ts = static_cast<int64_t>(i * 7 % 23) - 5;
+      if (i % 3 != 0)
+        row.dur = static_cast<int64_t>(i % 11);
+      row.value = static_cast<double>(i % 13) * 0.5;
+      row.name = pool_.InternString(kNames[i % 3]);
+      if (i % 5 != 0)
+        row.category = pool_.InternString(kNames[i % 2]);
+      table_.Insert(row);
+    }
+  }
+
+ protected:
+  StringResult RunSqlite(const std::string& sql) {
+    sqlite3_stmt* raw_stmt = nullptr;
+    int ret = sqlite3_prepare_v2(*db_, sql.c_str(), -1, &raw_stmt, nullptr);
+    PERFETTO_CHECK(ret == SQLITE_OK);
+    ScopedStmt stmt(raw_stmt);
+
+    StringResult result;
+    int col_count = sqlite3_column_count(*stmt);
+    for (int i = 0; i < col_count; ++i)
+      result.column_names.push_back(sqlite3_column_name(*stmt, i));
+    while (sqlite3_step(*stmt) == SQLITE_ROW) {
+      for (int i = 0; i < col_count; ++i) {
+        SqlValue value;
+        switch (sqlite3_column_type(*stmt, i)) {
+          case SQLITE_INTEGER:
+            value = SqlValue::Long(sqlite3_column_int64(*stmt, i));
+            break;
+          case SQLITE_FLOAT:
+            value = SqlValue::Double(sqlite3_column_double(*stmt, i));
+            break;
+          case SQLITE_TEXT:
+            value = SqlValue::String(
+                reinterpret_cast<const char*>(sqlite3_column_text(*stmt, i)));
+            break;
+        }
+        result.values.push_back(ToString(value));
+      }
+    }
+    return result;
+  }
+
+  base::Optional<StringResult> RunNative(const std::string& sql) {
+    auto query = NativeAggregateQuery::Parse(sql);
+    if (!query)
+      return base::nullopt;
+    EXPECT_EQ(query->table_name(), "test_table");
+
+    auto native = query->Execute(table_);
+    if (!native)
+      return base::nullopt;
+
+    StringResult result;
+    result.column_names = native->column_names;
+    for (const SqlValue& value : native->values)
+      result.values.push_back(ToString(value));
+    return result;
+  }
+
+  // Checks that |sql| is executed natively and has the same result as when
+  // executed by SQLite.
+  void CheckSameAsSqlite(const std::string& sql) {
+    SCOPED_TRACE(sql);
+    base::Optional<StringResult> native = RunNative(sql);
+    ASSERT_TRUE(native.has_value());
+
+    StringResult expected = RunSqlite(sql);
+    ASSERT_EQ(native->column_names, expected.column_names);
+    ASSERT_EQ(native->values, expected.values);
+  }
+
+  StringPool pool_;
+  TestAggregateTable table_;
+  QueryCache cache_;
+  ScopedDb db_;
+};
+
+TEST_F(NativeAggregateQueryTest, Aggregates) {
+  CheckSameAsSqlite("SELECT COUNT(*) FROM test_table");
+  CheckSameAsSqlite("select count(dur), count(category) from test_table");
+  CheckSameAsSqlite("SELECT SUM(ts), SUM(dur), SUM(value) FROM test_table");
+  CheckSameAsSqlite("SELECT AVG(ts), AVG(dur), avg( value ) FROM test_table");
+  CheckSameAsSqlite(
+      "SELECT MIN(ts), MAX(ts), MIN(dur), MAX(dur), MIN(value), MAX(value), "
+      "MIN(name), MAX(name), MIN(category), MAX(category) FROM test_table");
+  CheckSameAsSqlite(
+      "SELECT COUNT(*) AS cnt, SUM(dur) AS total FROM test_table;");
+}
+
+TEST_F(NativeAggregateQueryTest, Where) {
+  CheckSameAsSqlite("SELECT COUNT(*) FROM test_table WHERE ts > 3");
+  CheckSameAsSqlite(
+      "SELECT COUNT(*), SUM(value) FROM test_table WHERE ts >= -2 AND ts < 10 "
+      "AND cpu != 2");
+  CheckSameAsSqlite("SELECT COUNT(*) FROM test_table WHERE value <= 2.5");
+  CheckSameAsSqlite("SELECT COUNT(*) FROM test_table WHERE ts = -5");
+  CheckSameAsSqlite("SELECT COUNT(*) FROM test_table WHERE name = 'bar'");
+  CheckSameAsSqlite("SELECT COUNT(*) FROM test_table WHERE name <> 'bar'");
+  CheckSameAsSqlite("SELECT COUNT(*) FROM test_table WHERE dur IS NULL");
+  CheckSameAsSqlite(
+      "SELECT COUNT(*) FROM test_table WHERE category IS NOT NULL");
+
+  // No rows match: aggregates other than COUNT should return NULL.
+  CheckSameAsSqlite(
+      "SELECT COUNT(*), SUM(ts), AVG(ts), MIN(name), MAX(dur) FROM test_table "
+      "WHERE ts > 1000");
+}
+
+TEST_F(NativeAggregateQueryTest, GroupBy) {
+  CheckSameAsSqlite("SELECT cpu, COUNT(*) FROM test_table GROUP BY cpu");
+  CheckSameAsSqlite(
+      "SELECT COUNT(*), name, SUM(dur), MAX(ts) FROM test_table GROUP BY name");
+  CheckSameAsSqlite(
+      "SELECT dur, COUNT(*), MIN(value) FROM test_table GROUP BY dur");
+  CheckSameAsSqlite(
+      "SELECT category AS cat, COUNT(*) FROM test_table WHERE ts < 10 GROUP "
+      "BY category");
+  CheckSameAsSqlite("SELECT COUNT(*) FROM test_table GROUP BY value");
+  CheckSameAsSqlite(
+      "SELECT cpu, COUNT(*) FROM test_table WHERE ts > 1000 GROUP BY cpu");
+}
+
+TEST_F(NativeAggregateQueryTest, UnsupportedQueries) {
+  const char* kQueries[] = {
+      "SELECT * FROM test_table",
+      "SELECT ts FROM test_table",
+      "SELECT cpu, COUNT(*) FROM test_table GROUP BY name",
+      "SELECT COUNT(*) FROM test_table ORDER BY 1",
+      "SELECT COUNT(*) FROM test_table LIMIT 1",
+      "SELECT COUNT(DISTINCT ts) FROM test_table",
+      "SELECT COUNT(*) FROM test_table t",
+      "SELECT COUNT(*) FROM test_table WHERE ts > 1 OR ts < 0",
+      "SELECT COUNT(*) FROM test_table WHERE ts = 0x10",
+      "SELECT COUNT(*) FROM test_table WHERE 1 < ts",
+      "SELECT COUNT(*) FROM test_table WHERE ts > 99999999999999999999",
+      "SELECT COUNT(*) FROM test_table -- comment",
+      "SELECT COUNT(*) FROM \"test_table\"",
+      "SELECT SUM(ts) + 1 FROM test_table",
+      "SELECT TOTAL(ts) FROM test_table",
+      "SELECT COUNT(*) FROM test_table; SELECT 1",
+      "SELECT COUNT(*) FROM test_table JOIN test_table USING(ts)",
+  };
+  for (const char* sql : kQueries) {
+    SCOPED_TRACE(sql);
+    ASSERT_FALSE(NativeAggregateQuery::Parse(sql).has_value());
+  }
+}
+
+TEST_F(NativeAggregateQueryTest, UnsupportedOnTable) {
+  const char* kQueries[] = {
+      // Unknown columns.
+      "SELECT COUNT(foo) FROM test_table",
+      "SELECT COUNT(*) FROM test_table WHERE foo = 1",
+      // Literals with a different type than the column.
+      "SELECT COUNT(*) FROM test_table WHERE name = 1",
+      "SELECT COUNT(*) FROM test_table WHERE ts = '1'",
+      // SQLite converts strings to numbers when summing.
+      "SELECT SUM(name) FROM test_table",
+  };
+  for (const char* sql : kQueries) {
+    SCOPED_TRACE(sql);
+    ASSERT_TRUE(NativeAggregateQuery::Parse(sql).has_value());
+    ASSERT_FALSE(RunNative(sql).has_value());
+  }
+}
+
+TEST_F(NativeAggregateQueryTest, SumOverflow) {
+  TestAggregateTable::Row row;
+  row.ts = std::numeric_limits<int64_t>::max();
+  row.name = pool_.InternString("foo");
+  table_.Insert(row);
+
+  // SQLite returns an error when the sum overflows so the query should be left
+  // to it.
+  ASSERT_FALSE(RunNative("SELECT SUM(ts) FROM test_table").has_value());
+  CheckSameAsSqlite("SELECT AVG(ts) FROM test_table");
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
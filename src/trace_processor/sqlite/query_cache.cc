@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_cache.h"
+
+#include <algorithm>
+
+#include "src/trace_processor/storage/stats.h"
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// Estimates the memory owned by |table|. The column data is shared with the
+// source table so only the RowMaps (which are index vectors for sorted
+// tables) are accounted for.
+uint64_t EstimateBytes(const Table& table) {
+  uint64_t bytes = sizeof(Table) + table.GetColumnCount() * sizeof(Column);
+  for (const RowMap& rm : table.row_maps()) {
+    if (!rm.IsRange())
+      bytes += uint64_t(rm.size()) * sizeof(uint32_t);
+  }
+  return bytes;
+}
+
+bool SameConstraints(const std::vector<QueryCache::Constraint>& a,
+                     const std::vector<QueryCache::Constraint>& b) {
+  auto p = [](const QueryCache::Constraint& x,
+              const QueryCache::Constraint& y) {
+    return x.column == y.column && x.op == y.op;
+  };
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), p);
+}
+
+bool SameOrders(const std::vector<Order>& a, const std::vector<Order>& b) {
+  auto p = [](const Order& x, const Order& y) {
+    return x.col_idx == y.col_idx && x.desc == y.desc;
+  };
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), p);
+}
+
+}  // namespace
+
+constexpr uint64_t QueryCache::kDefaultMaxBytes;
+
+QueryCache::QueryCache(uint64_t max_bytes, TraceStorage* storage)
+    : max_bytes_(max_bytes), storage_(storage) {}
+
+QueryCache::~QueryCache() = default;
+
+std::shared_ptr<Table> QueryCache::GetIfCached(
+    const Table* source,
+    const std::vector<Constraint>& cs,
+    const std::vector<Order>& ob) {
+  auto it = Find(source, cs, ob);
+  if (it == entries_.end())
+    return nullptr;
+
+  // Move the entry to the front to mark it as the most recently used.
+  entries_.splice(entries_.begin(), entries_, it);
+  hits_++;
+  UpdateStats();
+  return it->table;
+}
+
+std::shared_ptr<Table> QueryCache::GetOrCache(
+    const Table* source,
+    const std::vector<Constraint>& cs,
+    const std::vector<Order>& ob,
+    std::function<Table()> fn) {
+  std::shared_ptr<Table> cached = GetIfCached(source, cs, ob);
+  if (cached)
+    return cached;
+
+  misses_++;
+  std::shared_ptr<Table> table(new Table(fn()));
+  uint64_t bytes = EstimateBytes(*table);
+
+  // Tables which would not fit in the cache even if it were empty are
+  // returned without being cached.
+  if (bytes <= max_bytes_) {
+    Entry entry;
+    entry.source = source;
+    entry.source_row_count = source->row_count();
+    entry.constraints = cs;
+    entry.order_by = ob;
+    entry.table = table;
+    entry.bytes = bytes;
+    entries_.emplace_front(std::move(entry));
+    bytes_ += bytes;
+    EvictToBudget();
+  }
+  UpdateStats();
+  return table;
+}
+
+void QueryCache::Invalidate() {
+  entries_.clear();
+  bytes_ = 0;
+  UpdateStats();
+}
+
+std::list<QueryCache::Entry>::iterator QueryCache::Find(
+    const Table* source,
+    const std::vector<Constraint>& cs,
+    const std::vector<Order>& ob) {
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->source != source || !SameConstraints(it->constraints, cs) ||
+        !SameOrders(it->order_by, ob)) {
+      continue;
+    }
+
+    if (it->source_row_count != source->row_count()) {
+      bytes_ -= it->bytes;
+      entries_.erase(it);
+      return entries_.end();
+    }
+    return it;
+  }
+  return entries_.end();
+}
+
+void QueryCache::EvictToBudget() {
+  while (bytes_ > max_bytes_) {
+    PERFETTO_DCHECK(!entries_.empty());
+    bytes_ -= entries_.back().bytes;
+    entries_.pop_back();
+    evictions_++;
+  }
+}
+
+void QueryCache::UpdateStats() {
+  if (!storage_)
+    return;
+  storage_->SetStats(stats::query_cache_hits, static_cast<int64_t>(hits_));
+  storage_->SetStats(stats::query_cache_misses, static_cast<int64_t>(misses_));
+  storage_->SetStats(stats::query_cache_evictions,
+                     static_cast<int64_t>(evictions_));
+  storage_->SetStats(stats::query_cache_bytes, static_cast<int64_t>(bytes_));
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
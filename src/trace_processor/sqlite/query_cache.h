@@ -17,7 +17,12 @@
 #ifndef SRC_TRACE_PROCESSOR_SQLITE_QUERY_CACHE_H_
 #define SRC_TRACE_PROCESSOR_SQLITE_QUERY_CACHE_H_
 
-#include "perfetto/ext/base/optional.h"
+#include <stdint.h>
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
 
 #include "src/trace_processor/db/table.h"
 #include "src/trace_processor/sqlite/query_constraints.h"
@@ -25,54 +30,94 @@
 namespace perfetto {
 namespace trace_processor {
 
-// Implements a simple caching strategy for commonly executed queries.
-// TODO(lalitm): the design of this class is very experimental. It was mainly
-// introduced to solve a specific problem (slow process summary tracks in the
-// Perfetto UI) and should not be modified without a full design discussion.
+class TraceStorage;
+
+// Caches tables derived from the static tables (e.g. copies sorted on the
+// column of a repeated equality constraint or on the partition and timestamp
+// columns of a span join) so they can be shared between cursors and queries.
+//
+// Entries are keyed on the source table, on the columns and operators of the
+// constraint set (the values are not part of the key as the cached table can
+// be used for any of them) and on the order by. Up to |max_bytes| worth of
+// entries are kept; when the budget is exceeded, the least recently used
+// entries are evicted.
+//
+// Hits, misses, evictions and the size of the cache are reported in the stats
+// table if a TraceStorage is passed to the constructor.
 class QueryCache {
  public:
   using Constraint = QueryConstraints::Constraint;
 
-  // Returns a cached table if the passed query set are currenly cached or
+  static constexpr uint64_t kDefaultMaxBytes = 256ull * 1024 * 1024;
+
+  explicit QueryCache(uint64_t max_bytes = kDefaultMaxBytes,
+                      TraceStorage* storage = nullptr);
+  ~QueryCache();
+
+  // Returns a cached table if the passed query set is currently cached or
   // nullptr otherwise.
   std::shared_ptr<Table> GetIfCached(const Table* source,
-                                     const std::vector<Constraint>& cs) const {
-    if (cached_.source != source || cs.size() != cached_.constraints.size())
-      return nullptr;
-
-    auto p = [](const Constraint& a, const Constraint& b) {
-      return a.column == b.column && a.op == b.op;
-    };
-    bool same_cs =
-        std::equal(cs.begin(), cs.end(), cached_.constraints.begin(), p);
-    return same_cs ? cached_.table : nullptr;
-  }
-
-  // Caches the table with the given source, constraint and order set. Returns
-  // a pointer to the newly cached table.
-  std::shared_ptr<Table> GetOrCache(
-      const Table* source,
-      const std::vector<QueryConstraints::Constraint>& cs,
-      std::function<Table()> fn) {
-    std::shared_ptr<Table> cached = GetIfCached(source, cs);
-    if (cached)
-      return cached;
-
-    cached_.source = source;
-    cached_.constraints = cs;
-    cached_.table.reset(new Table(fn()));
-    return cached_.table;
-  }
+                                     const std::vector<Constraint>& cs,
+                                     const std::vector<Order>& ob = {});
 
- private:
-  struct CachedTable {
-    std::shared_ptr<Table> table;
+  // Returns the cached table with the given source, constraint and order set,
+  // computing it using |fn| and caching it if it is not already cached. The
+  // returned table remains valid even if it is later evicted from the cache.
+  std::shared_ptr<Table> GetOrCache(const Table* source,
+                                    const std::vector<Constraint>& cs,
+                                    const std::vector<Order>& ob,
+                                    std::function<Table()> fn);
+
+  // Drops all the cached tables. Should be called whenever the tables the
+  // cached tables were computed from are modified.
+  void Invalidate();
+
+  // Returns the number of tables currently cached.
+  size_t size() const { return entries_.size(); }
+
+  // Returns the (estimated) number of bytes used by the cached tables.
+  uint64_t bytes() const { return bytes_; }
+
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+  uint64_t evictions() const { return evictions_; }
 
+ private:
+  struct Entry {
     const Table* source = nullptr;
+
+    // The row count of |source| when |table| was computed. Tables are only
+    // appended to during ingestion so a mismatch means |table| is stale.
+    uint32_t source_row_count = 0;
+
     std::vector<Constraint> constraints;
+    std::vector<Order> order_by;
+    std::shared_ptr<Table> table;
+    uint64_t bytes = 0;
   };
 
-  CachedTable cached_;
+  // Returns an iterator to the entry for the given source, constraint and
+  // order set or |entries_.end()| if there is none. Stale entries are removed.
+  std::list<Entry>::iterator Find(const Table* source,
+                                  const std::vector<Constraint>& cs,
+                                  const std::vector<Order>& ob);
+
+  // Evicts the least recently used entries until the cache fits in
+  // |max_bytes_|.
+  void EvictToBudget();
+
+  void UpdateStats();
+
+  uint64_t max_bytes_ = 0;
+  TraceStorage* storage_ = nullptr;
+
+  // Entries in order of most recent use; the front is the most recently used.
+  std::list<Entry> entries_;
+  uint64_t bytes_ = 0;
+
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t evictions_ = 0;
 };
 
 }  // namespace trace_processor
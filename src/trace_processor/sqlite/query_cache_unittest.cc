@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_cache.h"
+
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/tables/macros.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+#define PERFETTO_TP_TEST_CACHE_TABLE(NAME, PARENT, C) \
+  NAME(TestCacheTable, "test_table")                 \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                  \
+  C(uint32_t, a)                                     \
+  C(uint32_t, b)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_CACHE_TABLE);
+
+TestCacheTable::~TestCacheTable() = default;
+
+using Constraint = QueryCache::Constraint;
+
+class QueryCacheTest : public ::testing::Test {
+ public:
+  QueryCacheTest() : table_(&pool_, nullptr), other_table_(&pool_, nullptr) {
+    for (uint32_t i = 0; i < 1000; ++i) {
+      table_.Insert({i % 7, i % 13});
+      other_table_.Insert({i % 3, i % 5});
+    }
+  }
+
+ protected:
+  static std::vector<Constraint> EqOn(int column) {
+    Constraint c{};
+    c.column = column;
+    c.op = SQLITE_INDEX_CONSTRAINT_EQ;
+    return {c};
+  }
+
+  std::function<Table()> SortFn(const Table* table, uint32_t col) {
+    return [table, col]() { return table->Sort({Order{col, false}}); };
+  }
+
+  StringPool pool_;
+  TestCacheTable table_;
+  TestCacheTable other_table_;
+};
+
+TEST_F(QueryCacheTest, MultipleEntries) {
+  QueryCache cache;
+  uint32_t a = static_cast<uint32_t>(TestCacheTable::ColumnIndex::a);
+  uint32_t b = static_cast<uint32_t>(TestCacheTable::ColumnIndex::b);
+
+  auto a_sorted = cache.GetOrCache(&table_, EqOn(a), {}, SortFn(&table_, a));
+  auto b_sorted = cache.GetOrCache(&table_, EqOn(b), {}, SortFn(&table_, b));
+  auto other_sorted =
+      cache.GetOrCache(&other_table_, EqOn(a), {}, SortFn(&other_table_, a));
+  ASSERT_EQ(cache.size(), 3u);
+  ASSERT_EQ(cache.misses(), 3u);
+  ASSERT_EQ(cache.hits(), 0u);
+
+  // None of the entries should have evicted the others.
+  ASSERT_EQ(cache.GetIfCached(&table_, EqOn(a)), a_sorted);
+  ASSERT_EQ(cache.GetIfCached(&table_, EqOn(b)), b_sorted);
+  ASSERT_EQ(cache.GetIfCached(&other_table_, EqOn(a)), other_sorted);
+  ASSERT_EQ(cache.hits(), 3u);
+
+  ASSERT_TRUE(a_sorted->GetColumn(a).IsSorted());
+  ASSERT_TRUE(b_sorted->GetColumn(b).IsSorted());
+
+  // Different operators are different entries.
+  std::vector<Constraint> lt = EqOn(a);
+  lt[0].op = SQLITE_INDEX_CONSTRAINT_LT;
+  ASSERT_EQ(cache.GetIfCached(&table_, lt), nullptr);
+}
+
+TEST_F(QueryCacheTest, EvictsLeastRecentlyUsed) {
+  uint32_t a = static_cast<uint32_t>(TestCacheTable::ColumnIndex::a);
+  uint32_t b = static_cast<uint32_t>(TestCacheTable::ColumnIndex::b);
+
+  // Figure out the size of a single entry; all the entries below have the
+  // same size.
+  uint64_t entry_bytes;
+  {
+    QueryCache cache;
+    cache.GetOrCache(&table_, EqOn(a), {}, SortFn(&table_, a));
+    entry_bytes = cache.bytes();
+  }
+
+  TraceStorage storage;
+  QueryCache cache(entry_bytes * 2, &storage);
+  cache.GetOrCache(&table_, EqOn(a), {}, SortFn(&table_, a));
+  cache.GetOrCache(&table_, EqOn(b), {}, SortFn(&table_, b));
+  ASSERT_EQ(cache.bytes(), entry_bytes * 2);
+
+  // Use the first entry so that the second one is evicted by the third.
+  ASSERT_NE(cache.GetIfCached(&table_, EqOn(a)), nullptr);
+  auto other_sorted =
+      cache.GetOrCache(&other_table_, EqOn(a), {}, SortFn(&other_table_, a));
+  ASSERT_EQ(cache.size(), 2u);
+  ASSERT_EQ(cache.evictions(), 1u);
+  ASSERT_NE(cache.GetIfCached(&table_, EqOn(a)), nullptr);
+  ASSERT_EQ(cache.GetIfCached(&table_, EqOn(b)), nullptr);
+  ASSERT_EQ(cache.GetIfCached(&other_table_, EqOn(a)), other_sorted);
+
+  const auto& stats = storage.stats();
+  ASSERT_EQ(stats[stats::query_cache_hits].value, 3);
+  ASSERT_EQ(stats[stats::query_cache_misses].value, 3);
+  ASSERT_EQ(stats[stats::query_cache_evictions].value, 1);
+  ASSERT_EQ(stats[stats::query_cache_bytes].value,
+            static_cast<int64_t>(entry_bytes * 2));
+
+  // Tables larger than the budget are computed but not cached.
+  QueryCache small_cache(entry_bytes - 1);
+  ASSERT_NE(small_cache.GetOrCache(&table_, EqOn(a), {}, SortFn(&table_, a)),
+            nullptr);
+  ASSERT_EQ(small_cache.size(), 0u);
+  ASSERT_EQ(small_cache.bytes(), 0u);
+}
+
+TEST_F(QueryCacheTest, Invalidation) {
+  QueryCache cache;
+  uint32_t a = static_cast<uint32_t>(TestCacheTable::ColumnIndex::a);
+
+  auto sorted = cache.GetOrCache(&table_, EqOn(a), {}, SortFn(&table_, a));
+  ASSERT_EQ(cache.GetIfCached(&table_, EqOn(a)), sorted);
+
+  // Appending to the source table makes the entry stale.
+  table_.Insert({1, 1});
+  ASSERT_EQ(cache.GetIfCached(&table_, EqOn(a)), nullptr);
+  ASSERT_EQ(cache.size(), 0u);
+  ASSERT_EQ(cache.bytes(), 0u);
+
+  auto resorted = cache.GetOrCache(&table_, EqOn(a), {}, SortFn(&table_, a));
+  ASSERT_EQ(resorted->row_count(), table_.row_count());
+
+  // Tables previously returned stay valid after an explicit invalidation.
+  cache.Invalidate();
+  ASSERT_EQ(cache.size(), 0u);
+  ASSERT_EQ(cache.GetIfCached(&table_, EqOn(a)), nullptr);
+  ASSERT_EQ(resorted->row_count(), table_.row_count());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
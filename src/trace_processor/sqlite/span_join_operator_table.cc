@@ -81,6 +81,32 @@ std::string OpToString(int op) {
   }
 }
 
+base::Optional<FilterOp> OpToFilterOp(int op) {
+  switch (op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+      return FilterOp::kEq;
+    case SQLITE_INDEX_CONSTRAINT_NE:
+      return FilterOp::kNe;
+    case SQLITE_INDEX_CONSTRAINT_GE:
+    case SpanJoinOperatorTable::kSourceGeqOpCode:
+      return FilterOp::kGe;
+    case SQLITE_INDEX_CONSTRAINT_GT:
+      return FilterOp::kGt;
+    case SQLITE_INDEX_CONSTRAINT_LE:
+      return FilterOp::kLe;
+    case SQLITE_INDEX_CONSTRAINT_LT:
+      return FilterOp::kLt;
+    case SQLITE_INDEX_CONSTRAINT_LIKE:
+      return FilterOp::kLike;
+    case SQLITE_INDEX_CONSTRAINT_ISNULL:
+      return FilterOp::kIsNull;
+    case SQLITE_INDEX_CONSTRAINT_ISNOTNULL:
+      return FilterOp::kIsNotNull;
+    default:
+      return base::nullopt;
+  }
+}
+
 std::string EscapedSqliteValueAsString(sqlite3_value* value) {
   switch (sqlite3_value_type(value)) {
     case SQLITE_INTEGER:
@@ -103,20 +129,19 @@ std::string EscapedSqliteValueAsString(sqlite3_value* value) {
 
 }  // namespace
 
-SpanJoinOperatorTable::SpanJoinOperatorTable(sqlite3* db, const TraceStorage*)
-    : db_(db) {}
+SpanJoinOperatorTable::SpanJoinOperatorTable(sqlite3* db, Context context)
+    : db_(db), context_(context) {}
 
-void SpanJoinOperatorTable::RegisterTable(sqlite3* db,
-                                          const TraceStorage* storage) {
-  SqliteTable::Register<SpanJoinOperatorTable>(db, storage, "span_join",
+void SpanJoinOperatorTable::RegisterTable(sqlite3* db, Context context) {
+  SqliteTable::Register<SpanJoinOperatorTable>(db, context, "span_join",
                                                /* read_write */ false,
                                                /* requires_args */ true);
 
-  SqliteTable::Register<SpanJoinOperatorTable>(db, storage, "span_left_join",
+  SqliteTable::Register<SpanJoinOperatorTable>(db, context, "span_left_join",
                                                /* read_write */ false,
                                                /* requires_args */ true);
 
-  SqliteTable::Register<SpanJoinOperatorTable>(db, storage, "span_outer_join",
+  SqliteTable::Register<SpanJoinOperatorTable>(db, context, "span_outer_join",
                                                /* read_write */ false,
                                                /* requires_args */ true);
 }
@@ -288,12 +313,12 @@ int SpanJoinOperatorTable::FindFunction(const char* name,
   return 0;
 }
 
-std::vector<std::string>
-SpanJoinOperatorTable::ComputeSqlConstraintsForDefinition(
+std::vector<SpanJoinOperatorTable::ChildConstraint>
+SpanJoinOperatorTable::ComputeChildConstraintsForDefinition(
     const TableDefinition& defn,
     const QueryConstraints& qc,
     sqlite3_value** argv) {
-  std::vector<std::string> constraints;
+  std::vector<ChildConstraint> constraints;
   for (size_t i = 0; i < qc.constraints().size(); i++) {
     const auto& cs = qc.constraints()[i];
     auto col_name = GetNameForGlobalColumnIndex(defn, cs.column);
@@ -318,15 +343,54 @@ SpanJoinOperatorTable::ComputeSqlConstraintsForDefinition(
     if (defn.ShouldEmitPresentPartitionShadow())
       continue;
 
+    constraints.push_back(ChildConstraint{col_name, cs.op, argv[i]});
+  }
+  return constraints;
+}
+
+std::vector<std::string>
+SpanJoinOperatorTable::ComputeSqlConstraintsForDefinition(
+    const TableDefinition& defn,
+    const QueryConstraints& qc,
+    sqlite3_value** argv) {
+  std::vector<std::string> constraints;
+  for (const auto& cs : ComputeChildConstraintsForDefinition(defn, qc, argv)) {
     auto op = OpToString(cs.op == kSourceGeqOpCode ? SQLITE_INDEX_CONSTRAINT_GE
                                                    : cs.op);
-    auto value = EscapedSqliteValueAsString(argv[i]);
+    auto value = EscapedSqliteValueAsString(cs.value);
 
-    constraints.emplace_back("`" + col_name + "`" + op + value);
+    constraints.emplace_back("`" + cs.col_name + "`" + op + value);
   }
   return constraints;
 }
 
+base::Optional<std::vector<Constraint>>
+SpanJoinOperatorTable::ComputeDbConstraintsForDefinition(
+    const TableDefinition& defn,
+    const Table& table,
+    const QueryConstraints& qc,
+    sqlite3_value** argv) {
+  std::vector<Constraint> constraints;
+  for (const auto& cs : ComputeChildConstraintsForDefinition(defn, qc, argv)) {
+    const auto* col = table.GetColumnByName(cs.col_name.c_str());
+    base::Optional<FilterOp> op = OpToFilterOp(cs.op);
+    if (!col || !op)
+      return base::nullopt;
+
+    // Only pass down constraints whose value has the same type as the column
+    // as SQLite's type conversion rules would apply otherwise.
+    SqlValue value = sqlite_utils::SqliteValueToSqlValue(cs.value);
+    bool is_null_op = *op == FilterOp::kIsNull || *op == FilterOp::kIsNotNull;
+    if (!is_null_op && value.type != col->type())
+      return base::nullopt;
+    if (*op == FilterOp::kLike && col->type() != SqlValue::Type::kString)
+      return base::nullopt;
+
+    constraints.push_back(Constraint{col->index_in_table(), *op, value});
+  }
+  return base::make_optional(std::move(constraints));
+}
+
 util::Status SpanJoinOperatorTable::CreateTableDefinition(
     const TableDescriptor& desc,
     EmitShadowType emit_shadow_type,
@@ -624,8 +688,10 @@ util::Status SpanJoinOperatorTable::Query::Initialize(
     sqlite3_value** argv,
     InitialEofBehavior eof_behavior) {
   *this = Query(table_, definition(), db_);
-  sql_query_ = CreateSqlQuery(
-      table_->ComputeSqlConstraintsForDefinition(*defn_, qc, argv));
+  if (!InitializeDbTable(qc, argv)) {
+    sql_query_ = CreateSqlQuery(
+        table_->ComputeSqlConstraintsForDefinition(*defn_, qc, argv));
+  }
   util::Status status = Rewind();
   if (!status.ok())
     return status;
@@ -747,16 +813,95 @@ util::Status SpanJoinOperatorTable::Query::NextSliceState() {
   PERFETTO_FATAL("For GCC");
 }
 
-util::Status SpanJoinOperatorTable::Query::Rewind() {
-  sqlite3_stmt* stmt = nullptr;
-  int res =
-      sqlite3_prepare_v2(db_, sql_query_.c_str(),
-                         static_cast<int>(sql_query_.size()), &stmt, nullptr);
-  stmt_.reset(stmt);
+bool SpanJoinOperatorTable::Query::InitializeDbTable(
+    const QueryConstraints& qc,
+    sqlite3_value** argv) {
+  const Context& context = table_->context_;
+  if (!context.db_tables)
+    return false;
+
+  auto it = context.db_tables->find(base::ToLower(defn_->name()));
+  if (it == context.db_tables->end())
+    return false;
+
+  // Tables and views in the temp schema shadow the db tables: make sure the
+  // name still refers to the db table.
+  if (sqlite_utils::HasTempObject(db_, defn_->name()))
+    return false;
+
+  const Table* table = it->second;
+  std::vector<uint32_t> cols;
+  for (const SqliteTable::Column& c : defn_->columns()) {
+    const auto* col = table->GetColumnByName(c.name().c_str());
+    if (!col)
+      return false;
+    cols.push_back(col->index_in_table());
+  }
 
-  cursor_eof_ = res != SQLITE_OK;
-  if (res != SQLITE_OK)
-    return util::ErrStatus("%s", sqlite3_errmsg(db_));
+  // The SQLite path fails the query if the partition is not an integer and
+  // treats null ts and dur as 0 which DbTableLong() also does; just make
+  // sure the columns can only contain integers.
+  auto is_long_col = [table, &cols](uint32_t idx) {
+    return table->GetColumn(cols[idx]).type() == SqlValue::Type::kLong;
+  };
+  if (!is_long_col(defn_->ts_idx()) || !is_long_col(defn_->dur_idx()))
+    return false;
+  if (defn_->IsPartitioned() && !is_long_col(defn_->partition_idx()))
+    return false;
+
+  base::Optional<std::vector<Constraint>> cs =
+      table_->ComputeDbConstraintsForDefinition(*defn_, *table, qc, argv);
+  if (!cs)
+    return false;
+
+  PERFETTO_TP_TRACE("SPAN_JOIN_DB_TABLE", [this](metatrace::Record* r) {
+    r->AddArg("Table", defn_->name());
+  });
+
+  std::vector<Order> ob;
+  if (defn_->IsPartitioned())
+    ob.push_back(Order{cols[defn_->partition_idx()], false});
+  ob.push_back(Order{cols[defn_->ts_idx()], false});
+
+  auto sort_fn = [table, &ob]() { return table->Sort(ob); };
+  if (context.cache) {
+    sorted_table_ = context.cache->GetOrCache(table, {}, ob, sort_fn);
+  } else {
+    sorted_table_.reset(new Table(sort_fn()));
+  }
+  db_cols_ = std::move(cols);
+
+  // As |sorted_table_| is sorted by partition and ts, the filtered rows are
+  // also in that order.
+  if (cs->empty()) {
+    db_rows_filtered_ = false;
+    db_row_count_ = sorted_table_->row_count();
+  } else {
+    RowMap rm = sorted_table_->FilterToRowMap(*cs);
+    db_rows_filtered_ = true;
+    db_rows_.clear();
+    db_rows_.reserve(rm.size());
+    for (auto rm_it = rm.IterateRows(); rm_it; rm_it.Next())
+      db_rows_.push_back(rm_it.index());
+    db_row_count_ = static_cast<uint32_t>(db_rows_.size());
+  }
+  return true;
+}
+
+util::Status SpanJoinOperatorTable::Query::Rewind() {
+  if (sorted_table_) {
+    db_next_pos_ = 0;
+  } else {
+    sqlite3_stmt* stmt = nullptr;
+    int res =
+        sqlite3_prepare_v2(db_, sql_query_.c_str(),
+                           static_cast<int>(sql_query_.size()), &stmt, nullptr);
+    stmt_.reset(stmt);
+
+    cursor_eof_ = res != SQLITE_OK;
+    if (res != SQLITE_OK)
+      return util::ErrStatus("%s", sqlite3_errmsg(db_));
+  }
 
   RETURN_IF_ERROR(CursorNext());
 
@@ -781,6 +926,24 @@ util::Status SpanJoinOperatorTable::Query::Rewind() {
 }
 
 util::Status SpanJoinOperatorTable::Query::CursorNext() {
+  if (sorted_table_) {
+    // Fastforward through any rows with null partition keys.
+    for (;;) {
+      cursor_eof_ = db_next_pos_ >= db_row_count_;
+      if (cursor_eof_)
+        return util::OkStatus();
+
+      uint32_t pos = db_next_pos_++;
+      db_row_ = db_rows_filtered_ ? db_rows_[pos] : pos;
+      if (!defn_->IsPartitioned())
+        return util::OkStatus();
+
+      uint32_t partition_col = db_cols_[defn_->partition_idx()];
+      if (!sorted_table_->GetColumn(partition_col).Get(db_row_).is_null())
+        return util::OkStatus();
+    }
+  }
+
   auto* stmt = stmt_.get();
   int res;
   if (defn_->IsPartitioned()) {
@@ -832,6 +995,15 @@ void SpanJoinOperatorTable::Query::ReportSqliteResult(sqlite3_context* context,
     return;
   }
 
+  if (sorted_table_) {
+    // All strings come from the string pool and so are valid for the lifetime
+    // of trace processor.
+    SqlValue value = sorted_table_->GetColumn(db_cols_[index]).Get(db_row_);
+    sqlite_utils::ReportSqlValue(context, value, sqlite_utils::kSqliteStatic,
+                                 sqlite_utils::kSqliteStatic);
+    return;
+  }
+
   sqlite3_stmt* stmt = stmt_.get();
   int idx = static_cast<int>(index);
   switch (sqlite3_column_type(stmt, idx)) {
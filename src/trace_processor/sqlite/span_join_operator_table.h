@@ -25,11 +25,14 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/db/table.h"
+#include "src/trace_processor/sqlite/query_cache.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/sqlite/sqlite_table.h"
 
@@ -68,10 +71,29 @@ namespace trace_processor {
 //
 // All other columns apart from timestamp (ts), duration (dur) and the join key
 // are passed through unchanged.
+//
+// Child tables are usually queried through SQLite, ordered by partition and
+// ts. When a child is one of the db tables though, the span join runs directly
+// on its columns: the table is sorted by partition and ts once (and kept in
+// the QueryCache for later queries) and only the constraints are applied on
+// every query.
 class SpanJoinOperatorTable : public SqliteTable {
  public:
   static constexpr int kSourceGeqOpCode = SQLITE_INDEX_CONSTRAINT_FUNCTION + 1;
 
+  // Maps the (lowercase) names of the db tables to the tables.
+  using DbTableMap = std::unordered_map<std::string, const Table*>;
+
+  struct Context {
+    // Used to share the sorted copies of db tables between queries. Can be
+    // null.
+    QueryCache* cache = nullptr;
+
+    // The db tables which can be joined without going through SQLite. Can be
+    // null in which case all the child tables are queried through SQLite.
+    const DbTableMap* db_tables = nullptr;
+  };
+
   // Enum indicating whether the queries on the two inner tables should
   // emit shadows.
   enum class EmitShadowType {
@@ -255,6 +277,18 @@ class SpanJoinOperatorTable : public SqliteTable {
     // Creates an SQL query from the given set of constraint strings.
     std::string CreateSqlQuery(const std::vector<std::string>& cs) const;
 
+    // Sets up the query to run directly on the columns of the db table for
+    // |defn_| (if there is one). Returns false if this is not possible and
+    // the query needs to go through SQLite.
+    bool InitializeDbTable(const QueryConstraints& qc, sqlite3_value** argv);
+
+    // Returns the value of the column at |col| in |sorted_table_| as a long
+    // for the current row; nulls are returned as 0 like sqlite3_column_int64.
+    int64_t DbTableLong(uint32_t col) const {
+      SqlValue value = sorted_table_->GetColumn(col).Get(db_row_);
+      return value.is_null() ? 0 : value.AsLong();
+    }
+
     // Returns whether the current slice pointed to is a present partition
     // shadow.
     bool IsPresentPartitionShadow() const {
@@ -277,12 +311,16 @@ class SpanJoinOperatorTable : public SqliteTable {
 
     int64_t CursorTs() const {
       PERFETTO_DCHECK(!cursor_eof_);
+      if (sorted_table_)
+        return DbTableLong(db_cols_[defn_->ts_idx()]);
       auto ts_idx = static_cast<int>(defn_->ts_idx());
       return sqlite3_column_int64(stmt_.get(), ts_idx);
     }
 
     int64_t CursorDur() const {
       PERFETTO_DCHECK(!cursor_eof_);
+      if (sorted_table_)
+        return DbTableLong(db_cols_[defn_->dur_idx()]);
       auto dur_idx = static_cast<int>(defn_->dur_idx());
       return sqlite3_column_int64(stmt_.get(), dur_idx);
     }
@@ -290,6 +328,8 @@ class SpanJoinOperatorTable : public SqliteTable {
     int64_t CursorPartition() const {
       PERFETTO_DCHECK(!cursor_eof_);
       PERFETTO_DCHECK(defn_->IsPartitioned());
+      if (sorted_table_)
+        return DbTableLong(db_cols_[defn_->partition_idx()]);
       auto partition_idx = static_cast<int>(defn_->partition_idx());
       return sqlite3_column_int64(stmt_.get(), partition_idx);
     }
@@ -311,6 +351,26 @@ class SpanJoinOperatorTable : public SqliteTable {
     std::string sql_query_;
     ScopedStmt stmt_;
 
+    // Only set when the query runs directly on a db table: a copy of the
+    // table sorted by partition and ts.
+    std::shared_ptr<Table> sorted_table_;
+
+    // Only valid when |sorted_table_| is set. The indices of the columns of
+    // |defn_| in |sorted_table_|.
+    std::vector<uint32_t> db_cols_;
+
+    // Only valid when |sorted_table_| is set. The rows of |sorted_table_|
+    // matching the constraints, in order: either all the rows
+    // (|db_rows_filtered_| == false) or the ones in |db_rows_|.
+    bool db_rows_filtered_ = false;
+    std::vector<uint32_t> db_rows_;
+    uint32_t db_row_count_ = 0;
+
+    // Only valid when |sorted_table_| is set. The position of the next row
+    // to read and the current row of |sorted_table_|.
+    uint32_t db_next_pos_ = 0;
+    uint32_t db_row_ = 0;
+
     const TableDefinition* defn_ = nullptr;
     sqlite3* db_ = nullptr;
     SpanJoinOperatorTable* table_ = nullptr;
@@ -353,9 +413,9 @@ class SpanJoinOperatorTable : public SqliteTable {
     SpanJoinOperatorTable* table_;
   };
 
-  SpanJoinOperatorTable(sqlite3*, const TraceStorage*);
+  SpanJoinOperatorTable(sqlite3*, Context);
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  static void RegisterTable(sqlite3* db, Context context);
 
   // Table implementation.
   util::Status Init(int, const char* const*, SqliteTable::Schema*) override;
@@ -414,11 +474,32 @@ class SpanJoinOperatorTable : public SqliteTable {
       EmitShadowType emit_shadow_type,
       SpanJoinOperatorTable::TableDefinition* defn);
 
+  // A constraint on the span join table which should be passed down to one
+  // of the child tables.
+  struct ChildConstraint {
+    std::string col_name;
+    int op;
+    sqlite3_value* value;
+  };
+
+  std::vector<ChildConstraint> ComputeChildConstraintsForDefinition(
+      const TableDefinition& defn,
+      const QueryConstraints& qc,
+      sqlite3_value** argv);
+
   std::vector<std::string> ComputeSqlConstraintsForDefinition(
       const TableDefinition& defn,
       const QueryConstraints& qc,
       sqlite3_value** argv);
 
+  // Returns the db constraints to apply on |table| for |defn| or nullopt if
+  // some of the constraints cannot be applied directly on the table.
+  base::Optional<std::vector<Constraint>> ComputeDbConstraintsForDefinition(
+      const TableDefinition& defn,
+      const Table& table,
+      const QueryConstraints& qc,
+      sqlite3_value** argv);
+
   std::string GetNameForGlobalColumnIndex(const TableDefinition& defn,
                                           int global_column);
 
@@ -431,6 +512,7 @@ class SpanJoinOperatorTable : public SqliteTable {
   base::FlatHashMap<size_t, ColumnLocator> global_index_to_column_locator_;
 
   sqlite3* const db_;
+  Context context_;
 };
 
 }  // namespace trace_processor
@@ -16,6 +16,9 @@
 
 #include "src/trace_processor/sqlite/span_join_operator_table.h"
 
+#include "perfetto/ext/base/string_utils.h"
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/tables/macros.h"
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -30,7 +33,8 @@ class SpanJoinOperatorTableTest : public ::testing::Test {
     PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
     db_.reset(db);
 
-    SpanJoinOperatorTable::RegisterTable(db_.get(), nullptr);
+    SpanJoinOperatorTable::RegisterTable(db_.get(),
+                                         SpanJoinOperatorTable::Context());
   }
 
   void PrepareValidStatement(const std::string& sql) {
@@ -340,6 +344,192 @@ TEST_F(SpanJoinOperatorTableTest, LeftJoinTwoSpanTables_EmptyRight) {
   ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
 }
 
+#define PERFETTO_TP_TEST_SPAN_TABLE(NAME, PARENT, C) \
+  NAME(TestSpanTable, "test_span_table")            \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                 \
+  C(int64_t, ts)                                    \
+  C(int64_t, dur)                                   \
+  C(base::Optional<uint32_t>, cpu)                  \
+  C(StringPool::Id, name)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_SPAN_TABLE);
+
+TestSpanTable::~TestSpanTable() = default;
+
+// Checks that span joins on db tables, which run directly on the columns of
+// the table, return the same results as span joins on SQLite tables with the
+// same contents.
+class SpanJoinOperatorTableDbTest : public ::testing::Test {
+ public:
+  SpanJoinOperatorTableDbTest() : table_(&pool_, nullptr) {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_initialize() == SQLITE_OK);
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    RunStatement("CREATE TABLE perfetto_tables(name TEXT)");
+    DbSqliteTable::RegisterTable(*db_, &cache_, TestSpanTable::Schema(),
+                                 &table_, table_.table_name());
+    db_tables_[table_.table_name()] = &table_;
+
+    SpanJoinOperatorTable::Context context;
+    context.cache = &cache_;
+    context.db_tables = &db_tables_;
+    SpanJoinOperatorTable::RegisterTable(*db_, context);
+
+    const char* kNames[] = {"foo", "bar", "baz"};
+    for (uint32_t i = 0; i < 200; ++i) {
+      TestSpanTable::Row row;
+      row.ts = static_cast<int64_t>(i * 13 % 1000);
+      row.dur = static_cast<int64_t>(i * 7 % 40);
+      if (i % 17 != 0)
+        row.cpu = i % 4;
+      row.name = pool_.InternString(kNames[i % 3]);
+      table_.Insert(row);
+    }
+
+    // A copy of |table_| in SQLite.
+    RunStatement(
+        "CREATE TABLE sql_span_table(id BIG INT, type STRING, ts BIG INT, "
+        "dur BIG INT, cpu BIG INT, name STRING)");
+    RunStatement("INSERT INTO sql_span_table SELECT * FROM test_span_table");
+
+    RunStatement("CREATE TABLE other(ts BIG INT, dur BIG INT, cpu BIG INT)");
+    RunStatement("CREATE TABLE other_slot(ts BIG INT, dur BIG INT, slot INT)");
+    for (uint32_t i = 0; i < 50; ++i) {
+      std::string values = std::to_string(i * 20) + ", " +
+                           std::to_string(i * 3 % 25) + ", " +
+                           std::to_string(i % 5);
+      RunStatement("INSERT INTO other VALUES(" + values + ")");
+      RunStatement("INSERT INTO other_slot VALUES(" + values + ")");
+    }
+  }
+
+ protected:
+  void RunStatement(const std::string& sql) {
+    ASSERT_EQ(sqlite3_exec(*db_, sql.c_str(), nullptr, nullptr, nullptr),
+              SQLITE_OK)
+        << sqlite3_errmsg(*db_);
+  }
+
+  std::vector<std::string> RunQuery(const std::string& sql) {
+    sqlite3_stmt* raw_stmt = nullptr;
+    EXPECT_EQ(sqlite3_prepare_v2(*db_, sql.c_str(), -1, &raw_stmt, nullptr),
+              SQLITE_OK)
+        << sqlite3_errmsg(*db_);
+    ScopedStmt stmt(raw_stmt);
+
+    std::vector<std::string> rows;
+    int ret;
+    while ((ret = sqlite3_step(*stmt)) == SQLITE_ROW) {
+      std::string row;
+      for (int i = 0; i < sqlite3_column_count(*stmt); ++i) {
+        const auto* text = sqlite3_column_text(*stmt, i);
+        row += text ? reinterpret_cast<const char*>(text) : "NULL";
+        row += " ";
+      }
+      rows.push_back(row);
+    }
+    EXPECT_EQ(ret, SQLITE_DONE) << sqlite3_errmsg(*db_);
+    return rows;
+  }
+
+  // Creates the span join |type| between |left| and |right| once using the db
+  // table and once using its SQLite copy and checks that the results of |sql|
+  // on both are the same.
+  void CheckSameAsSqlite(const std::string& type,
+                         const std::string& left,
+                         const std::string& right,
+                         const std::string& sql) {
+    SCOPED_TRACE(type + "(" + left + ", " + right + "): " + sql);
+    auto replace = [](std::string str, const std::string& with) {
+      return base::ReplaceAll(str, "$table", with);
+    };
+    RunStatement("CREATE VIRTUAL TABLE db_sp USING " + type + "(" +
+                 replace(left, "test_span_table") + ", " +
+                 replace(right, "test_span_table") + ")");
+    RunStatement("CREATE VIRTUAL TABLE sql_sp USING " + type + "(" +
+                 replace(left, "sql_span_table") + ", " +
+                 replace(right, "sql_span_table") + ")");
+
+    std::vector<std::string> db_rows = RunQuery(replace(sql, "db_sp"));
+    std::vector<std::string> sql_rows = RunQuery(replace(sql, "sql_sp"));
+    ASSERT_FALSE(sql_rows.empty());
+    ASSERT_EQ(db_rows, sql_rows);
+
+    RunStatement("DROP TABLE db_sp");
+    RunStatement("DROP TABLE sql_sp");
+  }
+
+  StringPool pool_;
+  TestSpanTable table_;
+  QueryCache cache_;
+  SpanJoinOperatorTable::DbTableMap db_tables_;
+  ScopedDb db_;
+};
+
+TEST_F(SpanJoinOperatorTableDbTest, SamePartitioning) {
+  const char* kTypes[] = {"span_join", "span_left_join", "span_outer_join"};
+  for (const char* type : kTypes) {
+    CheckSameAsSqlite(type, "$table PARTITIONED cpu", "other PARTITIONED cpu",
+                      "SELECT * FROM $table");
+    CheckSameAsSqlite(type, "other PARTITIONED cpu", "$table PARTITIONED cpu",
+                      "SELECT * FROM $table");
+  }
+
+  // Constraints are passed down to the table when no shadows are emitted.
+  CheckSameAsSqlite("span_join", "$table PARTITIONED cpu",
+                    "other PARTITIONED cpu",
+                    "SELECT * FROM $table WHERE name = 'foo' AND ts <= 700");
+  CheckSameAsSqlite("span_join", "$table PARTITIONED cpu",
+                    "other PARTITIONED cpu",
+                    "SELECT * FROM $table WHERE name LIKE 'B%' AND cpu > 1");
+  CheckSameAsSqlite(
+      "span_join", "$table PARTITIONED cpu", "other PARTITIONED cpu",
+      "SELECT * FROM $table WHERE ts >= 100 AND id < 100 AND type = 'test_span_table'");
+}
+
+TEST_F(SpanJoinOperatorTableDbTest, MixedAndNoPartitioning) {
+  const char* kTypes[] = {"span_join", "span_left_join", "span_outer_join"};
+  for (const char* type : kTypes) {
+    CheckSameAsSqlite(type, "$table", "other_slot PARTITIONED slot",
+                      "SELECT * FROM $table");
+    CheckSameAsSqlite(type, "other_slot PARTITIONED slot", "$table",
+                      "SELECT * FROM $table");
+    CheckSameAsSqlite(type, "$table PARTITIONED cpu", "other_slot",
+                      "SELECT * FROM $table");
+    CheckSameAsSqlite(type, "$table", "other_slot", "SELECT * FROM $table");
+  }
+}
+
+TEST_F(SpanJoinOperatorTableDbTest, SortedTableIsCached) {
+  CheckSameAsSqlite("span_join", "$table PARTITIONED cpu",
+                    "other PARTITIONED cpu", "SELECT * FROM $table");
+  ASSERT_EQ(cache_.size(), 1u);
+  ASSERT_EQ(cache_.misses(), 1u);
+
+  CheckSameAsSqlite("span_join", "$table PARTITIONED cpu",
+                    "other PARTITIONED cpu",
+                    "SELECT * FROM $table WHERE name = 'bar'");
+  ASSERT_EQ(cache_.size(), 1u);
+  ASSERT_EQ(cache_.misses(), 1u);
+  ASSERT_EQ(cache_.hits(), 1u);
+
+  // Shadowing the db table with a temp table means the span join has to go
+  // through SQLite.
+  RunStatement(
+      "CREATE TEMP TABLE test_span_table(ts BIG INT, dur BIG INT, cpu BIG "
+      "INT)");
+  RunStatement(
+      "INSERT INTO test_span_table SELECT ts, dur, cpu FROM sql_span_table "
+      "WHERE cpu = 2");
+  RunStatement(
+      "CREATE VIRTUAL TABLE sp USING span_join(test_span_table PARTITIONED "
+      "cpu, other PARTITIONED cpu)");
+  ASSERT_EQ(RunQuery("SELECT DISTINCT cpu FROM sp"),
+            std::vector<std::string>{"2 "});
+  ASSERT_EQ(cache_.hits(), 1u);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
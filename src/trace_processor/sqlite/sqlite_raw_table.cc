@@ -70,32 +70,31 @@ class ArgsSerializer {
 
   // Arg writing functions.
   void WriteArgForField(uint32_t field_id, ValueWriter writer) {
-    base::Optional<uint32_t> row = FieldIdToRow(field_id);
-    if (!row)
+    base::Optional<uint32_t> index = FieldIdToIndex(field_id);
+    if (!index)
       return;
-    WriteArgAtRow(*row, writer);
+    WriteArgAtIndex(*index, writer);
   }
   void WriteArgForField(uint32_t field_id,
                         base::StringView key,
                         ValueWriter writer) {
-    base::Optional<uint32_t> row = FieldIdToRow(field_id);
-    if (!row)
+    base::Optional<uint32_t> index = FieldIdToIndex(field_id);
+    if (!index)
       return;
-    WriteArg(key, storage_->GetArgValue(*row), writer);
+    WriteArg(key, arg_set_.value(*index), writer);
   }
-  void WriteArgAtRow(uint32_t arg_row, ValueWriter writer) {
-    const auto& args = storage_->arg_table();
-    const auto& key = storage_->GetString(args.key()[arg_row]);
-    WriteArg(key, storage_->GetArgValue(arg_row), writer);
+  void WriteArgAtIndex(uint32_t index, ValueWriter writer) {
+    const auto& key = storage_->GetString(arg_set_.key(index));
+    WriteArg(key, arg_set_.value(index), writer);
   }
   void WriteArg(base::StringView key, Variadic value, ValueWriter writer);
 
   // Value writing functions.
   void WriteValueForField(uint32_t field_id, ValueWriter writer) {
-    base::Optional<uint32_t> row = FieldIdToRow(field_id);
-    if (!row)
+    base::Optional<uint32_t> index = FieldIdToIndex(field_id);
+    if (!index)
       return;
-    writer(storage_->GetArgValue(*row));
+    writer(arg_set_.value(*index));
   }
   void WriteKernelFnValue(const Variadic& value) {
     if (value.type == Variadic::Type::kUint) {
@@ -114,15 +113,11 @@ class ArgsSerializer {
     return [this, writer](const Variadic& v) { (this->*writer)(v); };
   }
 
-  // Converts a field id to a row in the args table.
-  base::Optional<uint32_t> FieldIdToRow(uint32_t field_id) {
+  // Converts a field id to the index of the arg in the arg set.
+  base::Optional<uint32_t> FieldIdToIndex(uint32_t field_id) {
     PERFETTO_DCHECK(field_id > 0);
     PERFETTO_DCHECK(field_id < field_id_to_arg_index_->size());
-    base::Optional<uint32_t> index_in_arg_set =
-        (*field_id_to_arg_index_)[field_id];
-    return index_in_arg_set.has_value()
-               ? base::make_optional(start_row_ + *index_in_arg_set)
-               : base::nullopt;
+    return (*field_id_to_arg_index_)[field_id];
   }
 
   const TraceStorage* storage_ = nullptr;
@@ -131,8 +126,7 @@ class ArgsSerializer {
   NullTermStringView event_name_;
   std::vector<base::Optional<uint32_t>>* field_id_to_arg_index_;
 
-  RowMap row_map_;
-  uint32_t start_row_ = 0;
+  ArgSetStorage::ArgSet arg_set_;
 
   base::StringWriter* writer_ = nullptr;
 };
@@ -143,20 +137,13 @@ ArgsSerializer::ArgsSerializer(
     NullTermStringView event_name,
     std::vector<base::Optional<uint32_t>>* field_id_to_arg_index,
     base::StringWriter* writer)
-    : context_(context),
+    : storage_(context->storage.get()),
+      context_(context),
       arg_set_id_(arg_set_id),
       event_name_(event_name),
       field_id_to_arg_index_(field_id_to_arg_index),
+      arg_set_(storage_->arg_sets().Get(arg_set_id)),
       writer_(writer) {
-  storage_ = context_->storage.get();
-  const auto& args = storage_->arg_table();
-  const auto& set_ids = args.arg_set_id();
-
-  // We assume that the row map is a contiguous range (which is always the case
-  // because arg_set_ids are contiguous by definition).
-  row_map_ = args.FilterToRowMap({set_ids.eq(arg_set_id_)});
-  start_row_ = row_map_.empty() ? 0 : row_map_.Get(0);
-
   // If the vector already has entries, we've previously cached the mapping
   // from field id to arg index.
   if (!field_id_to_arg_index->empty())
@@ -181,10 +168,10 @@ ArgsSerializer::ArgsSerializer(
 
   // Go through each field id and find the entry in the args table for that
   for (uint32_t i = 1; i <= max; ++i) {
-    for (auto it = row_map_.IterateRows(); it; it.Next()) {
-      base::StringView key = args.key().GetString(it.index());
+    for (uint32_t j = 0; j < arg_set_.size(); ++j) {
+      base::StringView key = storage_->GetString(arg_set_.key(j));
       if (key == descriptor->fields[i].name) {
-        (*field_id_to_arg_index)[i] = it.row();
+        (*field_id_to_arg_index)[i] = j;
         break;
       }
     }
@@ -192,7 +179,7 @@ ArgsSerializer::ArgsSerializer(
 }
 
 void ArgsSerializer::SerializeArgs() {
-  if (row_map_.empty())
+  if (arg_set_.size() == 0)
     return;
 
   if (event_name_ == "sched_switch") {
@@ -467,8 +454,8 @@ void ArgsSerializer::SerializeArgs() {
     WriteArgForField(CAT::kCommFieldNumber, DVW());
     return;
   }
-  for (auto it = row_map_.IterateRows(); it; it.Next()) {
-    WriteArgAtRow(it.index(), DVW());
+  for (uint32_t i = 0; i < arg_set_.size(); ++i) {
+    WriteArgAtIndex(i, DVW());
   }
 }
 
@@ -228,6 +228,22 @@ inline util::Status GetColumnsForTable(
   return util::OkStatus();
 }
 
+// Returns whether a table, view or index named |name| exists in the temp
+// schema. Such objects shadow the tables with the same name in the main
+// schema (e.g. the db tables). Also returns true if this cannot be determined.
+inline bool HasTempObject(sqlite3* db, const std::string& name) {
+  static const char kTempObjectQuery[] =
+      "SELECT 1 FROM sqlite_temp_master WHERE name = ? COLLATE NOCASE";
+  sqlite3_stmt* raw_stmt = nullptr;
+  if (sqlite3_prepare_v2(db, kTempObjectQuery, -1, &raw_stmt, nullptr) !=
+      SQLITE_OK) {
+    return true;
+  }
+  ScopedStmt stmt(raw_stmt);
+  sqlite3_bind_text(*stmt, 1, name.c_str(), -1, nullptr);
+  return sqlite3_step(*stmt) != SQLITE_DONE;
+}
+
 }  // namespace sqlite_utils
 }  // namespace trace_processor
 }  // namespace perfetto
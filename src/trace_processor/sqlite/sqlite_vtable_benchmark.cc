@@ -26,7 +26,42 @@
 #include <sqlite3.h>
 
 #include "perfetto/base/compiler.h"
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/sqlite/query_cache.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
+#include "src/trace_processor/tables/macros.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// A wide table with a parent, similar to the thread_slice and slice tables.
+#define PERFETTO_TP_BENCHMARK_ROOT_TABLE(NAME, PARENT, C) \
+  NAME(BenchmarkRootTable, "root_table")                  \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                       \
+  C(int64_t, root_0)                                      \
+  C(int64_t, root_1)                                      \
+  C(int64_t, root_2)                                      \
+  C(int64_t, root_3)                                      \
+  C(int64_t, root_4)                                      \
+  C(int64_t, root_5)
+PERFETTO_TP_TABLE(PERFETTO_TP_BENCHMARK_ROOT_TABLE);
+
+#define PERFETTO_TP_BENCHMARK_CHILD_TABLE(NAME, PARENT, C) \
+  NAME(BenchmarkChildTable, "child_table")                 \
+  PARENT(PERFETTO_TP_BENCHMARK_ROOT_TABLE, C)              \
+  C(int64_t, child_0)                                      \
+  C(int64_t, child_1)                                      \
+  C(int64_t, child_2)                                      \
+  C(int64_t, child_3)
+PERFETTO_TP_TABLE(PERFETTO_TP_BENCHMARK_CHILD_TABLE);
+
+BenchmarkRootTable::~BenchmarkRootTable() = default;
+BenchmarkChildTable::~BenchmarkChildTable() = default;
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
 
 namespace {
 
@@ -200,4 +235,92 @@ static void BM_SqliteStepAndResult(benchmark::State& state) {
 
 BENCHMARK(BM_SqliteStepAndResult)->Apply(BenchmarkArgs);
 
+void DbSqliteTableArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Args({1024, 1});
+  } else {
+    for (int64_t cols : {1, 2, 4, 8}) {
+      b->Args({1024 * 128, cols});
+    }
+  }
+}
+
+// Measures the cost of filtering a wide table through DbSqliteTable when only
+// |state.range(1)| of its columns are read by the query.
+static void BM_DbSqliteTableFilterNarrowSelect(benchmark::State& state) {
+  using perfetto::trace_processor::BenchmarkChildTable;
+  using perfetto::trace_processor::BenchmarkRootTable;
+  using perfetto::trace_processor::DbSqliteTable;
+  using perfetto::trace_processor::QueryCache;
+  using perfetto::trace_processor::StringPool;
+
+  static constexpr uint32_t kRandomSeed = 476;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  uint32_t size = static_cast<uint32_t>(state.range(0));
+  uint32_t cols = static_cast<uint32_t>(state.range(1));
+
+  StringPool pool;
+  BenchmarkRootTable root(&pool, nullptr);
+  BenchmarkChildTable child(&pool, &root);
+  for (uint32_t i = 0; i < size; ++i) {
+    BenchmarkChildTable::Row row;
+    row.root_0 = rnd_engine() % 100;
+    row.child_0 = rnd_engine() % 100;
+
+    // Interleave rows in the parent to make its RowMap in the child
+    // non-trivial.
+    root.Insert({});
+    child.Insert(row);
+  }
+
+  sqlite3_initialize();
+
+  QueryCache cache;
+  ScopedDb db;
+  sqlite3* raw_db = nullptr;
+  PERFETTO_CHECK(sqlite3_open(":memory:", &raw_db) == SQLITE_OK);
+  db.reset(raw_db);
+  PERFETTO_CHECK(sqlite3_exec(*db, "CREATE TABLE perfetto_tables(name STRING)",
+                              nullptr, nullptr, nullptr) == SQLITE_OK);
+  DbSqliteTable::RegisterTable(*db, &cache, BenchmarkChildTable::Schema(),
+                               &child, child.table_name());
+
+  // Read |cols| columns, alternating between the ones in the child and in the
+  // parent.
+  const char* kCols[] = {"child_0", "root_0", "child_1", "root_1",
+                         "child_2", "root_2", "child_3", "root_3"};
+  std::string sql = "SELECT ";
+  for (uint32_t i = 0; i < cols; ++i) {
+    sql += std::string(i == 0 ? "" : ", ") + kCols[i];
+  }
+  sql += " FROM child_table WHERE child_0 < 50";
+
+  int64_t value = 0;
+  uint32_t rows = 0;
+  for (auto _ : state) {
+    ScopedStmt stmt;
+    sqlite3_stmt* raw_stmt;
+    int err = sqlite3_prepare_v2(*db, sql.c_str(),
+                                 static_cast<int>(sql.size()), &raw_stmt,
+                                 nullptr);
+    PERFETTO_CHECK(err == SQLITE_OK);
+    stmt.reset(raw_stmt);
+
+    rows = 0;
+    while (sqlite3_step(*stmt) == SQLITE_ROW) {
+      for (int col = 0; col < static_cast<int>(cols); col++) {
+        value ^= sqlite3_column_int64(*stmt, col);
+      }
+      rows++;
+    }
+    PERFETTO_CHECK(value != 42);
+  }
+
+  state.counters["rows"] = Counter(static_cast<double>(rows),
+                                   Counter::kIsIterationInvariantRate);
+}
+
+BENCHMARK(BM_DbSqliteTableFilterNarrowSelect)->Apply(DbSqliteTableArgs);
+
 }  // namespace
@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage/arg_set_storage.h"
+
+#include <algorithm>
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+enum class ValueKind { kInt, kReal, kString, kNone };
+
+ValueKind GetValueKind(Variadic::Type type) {
+  switch (type) {
+    case Variadic::Type::kInt:
+    case Variadic::Type::kUint:
+    case Variadic::Type::kPointer:
+    case Variadic::Type::kBool:
+      return ValueKind::kInt;
+    case Variadic::Type::kReal:
+      return ValueKind::kReal;
+    case Variadic::Type::kString:
+    case Variadic::Type::kJson:
+      return ValueKind::kString;
+    case Variadic::Type::kNull:
+      return ValueKind::kNone;
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+int64_t ToIntValue(const Variadic& value) {
+  switch (value.type) {
+    case Variadic::Type::kInt:
+      return value.int_value;
+    case Variadic::Type::kUint:
+      return static_cast<int64_t>(value.uint_value);
+    case Variadic::Type::kPointer:
+      return static_cast<int64_t>(value.pointer_value);
+    case Variadic::Type::kBool:
+      return value.bool_value;
+    case Variadic::Type::kReal:
+    case Variadic::Type::kString:
+    case Variadic::Type::kJson:
+    case Variadic::Type::kNull:
+      break;
+  }
+  PERFETTO_FATAL("Not an integer value");
+}
+
+template <typename T>
+size_t VectorBytes(const std::vector<T>& v) {
+  return v.capacity() * sizeof(T);
+}
+
+}  // namespace
+
+Variadic ArgSetStorage::ArgSet::value(uint32_t i) const {
+  const ShapeArg& arg = shape_->args[i];
+  Variadic v;
+  v.type = static_cast<Variadic::Type>(arg.type);
+
+  // Force initialization of union to stop GCC complaining.
+  v.int_value = 0;
+
+  switch (GetValueKind(v.type)) {
+    case ValueKind::kInt: {
+      int64_t value =
+          shape_->int_values[row_ * shape_->ints_per_row + arg.value_index];
+      switch (v.type) {
+        case Variadic::Type::kUint:
+          v.uint_value = static_cast<uint64_t>(value);
+          break;
+        case Variadic::Type::kPointer:
+          v.pointer_value = static_cast<uint64_t>(value);
+          break;
+        case Variadic::Type::kBool:
+          v.bool_value = value != 0;
+          break;
+        default:
+          v.int_value = value;
+          break;
+      }
+      break;
+    }
+    case ValueKind::kReal:
+      v.real_value =
+          shape_->real_values[row_ * shape_->reals_per_row + arg.value_index];
+      break;
+    case ValueKind::kString: {
+      StringPool::Id value =
+          shape_->string_values[row_ * shape_->strings_per_row +
+                                arg.value_index];
+      if (v.type == Variadic::Type::kJson) {
+        v.json_value = value;
+      } else {
+        v.string_value = value;
+      }
+      break;
+    }
+    case ValueKind::kNone:
+      break;
+  }
+  return v;
+}
+
+ArgSetStorage::ArgSetStorage() {
+  // Reserve the id 0 for kInvalidArgSetId.
+  AddArgSet(nullptr, 0);
+}
+
+ArgSetStorage::~ArgSetStorage() = default;
+
+uint32_t ArgSetStorage::AddArgSet(const Arg* args, uint32_t count) {
+  uint32_t shape_idx = GetOrCreateShape(args, count);
+  Shape& shape = *shapes_[shape_idx];
+
+  for (uint32_t i = 0; i < count; ++i) {
+    const Variadic& value = args[i].value;
+    switch (GetValueKind(value.type)) {
+      case ValueKind::kInt:
+        shape.int_values.push_back(ToIntValue(value));
+        break;
+      case ValueKind::kReal:
+        shape.real_values.push_back(value.real_value);
+        break;
+      case ValueKind::kString:
+        shape.string_values.push_back(value.type == Variadic::Type::kJson
+                                          ? value.json_value
+                                          : value.string_value);
+        break;
+      case ValueKind::kNone:
+        break;
+    }
+  }
+
+  uint32_t id = static_cast<uint32_t>(arg_sets_.size());
+  arg_sets_.push_back(ArgSetEntry{shape_idx, shape.row_count++, arg_count_});
+  arg_count_ += count;
+  return id;
+}
+
+uint32_t ArgSetStorage::ArgSetIdForArgId(uint32_t arg_id) const {
+  if (arg_id >= arg_count_)
+    return size();
+
+  // Find the last arg set starting at or before |arg_id|: as empty arg sets
+  // have the same first arg id as the set following them, this is the only
+  // one which contains it.
+  auto it = std::upper_bound(arg_sets_.begin(), arg_sets_.end(), arg_id,
+                             [](uint32_t id, const ArgSetEntry& entry) {
+                               return id < entry.first_arg_id;
+                             });
+  return static_cast<uint32_t>(std::distance(arg_sets_.begin(), it)) - 1;
+}
+
+size_t ArgSetStorage::GetMemoryUsageBytes() const {
+  size_t bytes = VectorBytes(arg_sets_) + VectorBytes(shapes_);
+  for (const auto& shape : shapes_) {
+    bytes += sizeof(Shape) + VectorBytes(shape->args) +
+             VectorBytes(shape->int_values) + VectorBytes(shape->real_values) +
+             VectorBytes(shape->string_values);
+  }
+  // Each slot of the map has a tag byte on top of the key and the value.
+  bytes +=
+      shape_for_hash_.capacity() * (sizeof(uint64_t) + sizeof(uint32_t) + 1);
+  return bytes;
+}
+
+// static
+std::unique_ptr<ArgSetStorage::Shape> ArgSetStorage::CreateShape(
+    const Arg* args,
+    uint32_t count) {
+  std::unique_ptr<Shape> shape(new Shape());
+  shape->args.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    ShapeArg arg;
+    arg.flat_key = args[i].flat_key;
+    arg.key = args[i].key;
+    arg.type = static_cast<uint32_t>(args[i].value.type);
+    switch (GetValueKind(args[i].value.type)) {
+      case ValueKind::kInt:
+        arg.value_index = shape->ints_per_row++;
+        break;
+      case ValueKind::kReal:
+        arg.value_index = shape->reals_per_row++;
+        break;
+      case ValueKind::kString:
+        arg.value_index = shape->strings_per_row++;
+        break;
+      case ValueKind::kNone:
+        arg.value_index = 0;
+        break;
+    }
+    shape->args.push_back(arg);
+  }
+  return shape;
+}
+
+// static
+uint64_t ArgSetStorage::HashShape(const Arg* args, uint32_t count) {
+  base::Hash hash;
+  hash.Update(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    hash.Update(args[i].flat_key.raw_id());
+    hash.Update(args[i].key.raw_id());
+    hash.Update(static_cast<uint32_t>(args[i].value.type));
+  }
+  return hash.digest();
+}
+
+uint32_t ArgSetStorage::GetOrCreateShape(const Arg* args, uint32_t count) {
+  uint32_t new_idx = static_cast<uint32_t>(shapes_.size());
+  auto it_and_inserted =
+      shape_for_hash_.Insert(HashShape(args, count), new_idx);
+  if (!it_and_inserted.second) {
+    uint32_t idx = *it_and_inserted.first;
+    const Shape& shape = *shapes_[idx];
+    bool equal = shape.args.size() == count;
+    for (uint32_t i = 0; equal && i < count; ++i) {
+      const ShapeArg& arg = shape.args[i];
+      equal = arg.flat_key == args[i].flat_key && arg.key == args[i].key &&
+              arg.type == static_cast<uint32_t>(args[i].value.type);
+    }
+    if (PERFETTO_LIKELY(equal))
+      return idx;
+    // On a hash collision, the new shape is just not indexed: arg sets with
+    // its keys will each get their own shape.
+  }
+  shapes_.emplace_back(CreateShape(args, count));
+  return new_idx;
+}
+
+void ArgSetStorage::RebuildShapeIndex() {
+  shape_for_hash_.Clear();
+  std::vector<Arg> args;
+  for (uint32_t i = 0; i < shapes_.size(); ++i) {
+    args.clear();
+    for (const ShapeArg& shape_arg : shapes_[i]->args) {
+      // Only the type of the value is part of the shape.
+      Variadic value = Variadic::Null();
+      value.type = static_cast<Variadic::Type>(shape_arg.type);
+      args.push_back(Arg{shape_arg.flat_key, shape_arg.key, value});
+    }
+    // On collisions, keep the first shape as GetOrCreateShape() does.
+    shape_for_hash_.Insert(
+        HashShape(args.data(), static_cast<uint32_t>(args.size())), i);
+  }
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
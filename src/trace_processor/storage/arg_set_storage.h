@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_STORAGE_ARG_SET_STORAGE_H_
+#define SRC_TRACE_PROCESSOR_STORAGE_ARG_SET_STORAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/hash.h"
+#include "perfetto/ext/base/optional.h"
+#include "src/trace_processor/containers/string_pool.h"
+#include "src/trace_processor/types/variadic.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Stores the args of all the arg sets in the trace.
+//
+// Most arg sets have the same keys (and value types) as many others: e.g. all
+// the slices emitted by the same TRACE_EVENT call site. The list of keys and
+// value types of an arg set, its "shape", is stored only once and arg sets only
+// store their values, in typed arrays owned by their shape. Each row of these
+// arrays holds the values of one arg set, so an arg needs 4 (strings) or 8
+// (numbers) bytes rather than a row in a table with columns for its keys, its
+// type and every possible type of value.
+//
+// Arg sets have consecutive ids starting at 1: 0 is kInvalidArgSetId, which is
+// always empty. Args also have consecutive ids, in the order of their arg sets,
+// which are the ids of the rows of the args table.
+class ArgSetStorage {
+ private:
+  struct Shape;
+
+ public:
+  struct Arg {
+    StringPool::Id flat_key;
+    StringPool::Id key;
+    Variadic value;
+  };
+
+  // The args of a single arg set. Remains valid until the storage is
+  // destroyed, even if arg sets are added.
+  class ArgSet {
+   public:
+    uint32_t size() const {
+      return static_cast<uint32_t>(shape_->args.size());
+    }
+
+    StringPool::Id flat_key(uint32_t i) const {
+      return shape_->args[i].flat_key;
+    }
+    StringPool::Id key(uint32_t i) const { return shape_->args[i].key; }
+    Variadic::Type type(uint32_t i) const {
+      return static_cast<Variadic::Type>(shape_->args[i].type);
+    }
+    Variadic value(uint32_t i) const;
+
+    // Returns the id of the i-th arg of the set.
+    uint32_t arg_id(uint32_t i) const { return first_arg_id_ + i; }
+
+    // Returns the index of the arg with the given key, if any.
+    base::Optional<uint32_t> IndexOf(StringPool::Id key) const {
+      for (uint32_t i = 0; i < size(); ++i) {
+        if (shape_->args[i].key == key)
+          return i;
+      }
+      return base::nullopt;
+    }
+
+   private:
+    friend class ArgSetStorage;
+
+    ArgSet(const Shape* shape, uint32_t row, uint32_t first_arg_id)
+        : shape_(shape), row_(row), first_arg_id_(first_arg_id) {}
+
+    const Shape* shape_;
+    uint32_t row_;
+    uint32_t first_arg_id_;
+  };
+
+  ArgSetStorage();
+  ~ArgSetStorage();
+
+  // Adds a new arg set with the |count| args at |args| and returns its id. Arg
+  // sets are not deduplicated and neither are the keys of an arg set: this is
+  // done by GlobalArgsTracker.
+  uint32_t AddArgSet(const Arg* args, uint32_t count);
+
+  ArgSet Get(uint32_t arg_set_id) const {
+    PERFETTO_DCHECK(arg_set_id < arg_sets_.size());
+    const ArgSetEntry& entry = arg_sets_[arg_set_id];
+    return ArgSet(shapes_[entry.shape].get(), entry.row, entry.first_arg_id);
+  }
+
+  // Returns the id of the arg set containing the arg with id |arg_id| or
+  // size() if there is no such arg.
+  uint32_t ArgSetIdForArgId(uint32_t arg_id) const;
+
+  // Number of arg sets, including the invalid arg set 0.
+  uint32_t size() const { return static_cast<uint32_t>(arg_sets_.size()); }
+
+  // Number of args in all the arg sets.
+  uint32_t arg_count() const { return arg_count_; }
+
+  // Number of distinct shapes of the arg sets.
+  uint32_t shape_count() const {
+    return static_cast<uint32_t>(shapes_.size());
+  }
+
+  // Returns the number of bytes allocated to store the args.
+  size_t GetMemoryUsageBytes() const;
+
+ private:
+  friend class StorageSnapshot;
+
+  struct ShapeArg {
+    StringPool::Id flat_key;
+    StringPool::Id key;
+    uint32_t type;
+    // Index of the value in the row of the array for |type|.
+    uint32_t value_index;
+  };
+
+  struct Shape {
+    std::vector<ShapeArg> args;
+    uint32_t ints_per_row = 0;
+    uint32_t reals_per_row = 0;
+    uint32_t strings_per_row = 0;
+    uint32_t row_count = 0;
+
+    // Integers, uints, pointers and bools.
+    std::vector<int64_t> int_values;
+    std::vector<double> real_values;
+    // Strings and JSON values.
+    std::vector<StringPool::Id> string_values;
+  };
+
+  struct ArgSetEntry {
+    uint32_t shape;
+    uint32_t row;
+    uint32_t first_arg_id;
+  };
+
+  // Creates a shape with the keys and types of |args| (without any rows).
+  static std::unique_ptr<Shape> CreateShape(const Arg* args, uint32_t count);
+
+  static uint64_t HashShape(const Arg* args, uint32_t count);
+
+  uint32_t GetOrCreateShape(const Arg* args, uint32_t count);
+
+  // Recreates |shape_for_hash_| from |shapes_|.
+  void RebuildShapeIndex();
+
+  std::vector<std::unique_ptr<Shape>> shapes_;
+  std::vector<ArgSetEntry> arg_sets_;
+  uint32_t arg_count_ = 0;
+
+  base::FlatHashMap<uint64_t, uint32_t, base::AlreadyHashed<uint64_t>>
+      shape_for_hash_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_STORAGE_ARG_SET_STORAGE_H_
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage/arg_set_storage.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class ArgSetStorageTest : public ::testing::Test {
+ protected:
+  ArgSetStorage::Arg MakeArg(const char* key, Variadic value) {
+    StringPool::Id id = pool_.InternString(key);
+    return ArgSetStorage::Arg{id, id, value};
+  }
+
+  StringPool pool_;
+  ArgSetStorage storage_;
+};
+
+TEST_F(ArgSetStorageTest, InvalidArgSetIsEmpty) {
+  ASSERT_EQ(storage_.size(), 1u);
+  ASSERT_EQ(storage_.arg_count(), 0u);
+  ASSERT_EQ(storage_.Get(0).size(), 0u);
+}
+
+TEST_F(ArgSetStorageTest, AllValueTypes) {
+  ArgSetStorage::Arg args[] = {
+      MakeArg("int", Variadic::Integer(-42)),
+      MakeArg("uint", Variadic::UnsignedInteger(~0ull)),
+      MakeArg("string", Variadic::String(pool_.InternString("foo"))),
+      MakeArg("real", Variadic::Real(1.5)),
+      MakeArg("pointer", Variadic::Pointer(0xdeadbeef)),
+      MakeArg("bool", Variadic::Boolean(true)),
+      MakeArg("json", Variadic::Json(pool_.InternString("{}"))),
+      MakeArg("null", Variadic::Null()),
+  };
+  uint32_t id = storage_.AddArgSet(args, 8);
+  ASSERT_EQ(id, 1u);
+
+  ArgSetStorage::ArgSet set = storage_.Get(id);
+  ASSERT_EQ(set.size(), 8u);
+  for (uint32_t i = 0; i < set.size(); ++i) {
+    ASSERT_EQ(set.key(i), args[i].key);
+    ASSERT_EQ(set.flat_key(i), args[i].flat_key);
+    ASSERT_EQ(set.type(i), args[i].value.type);
+    ASSERT_EQ(set.value(i), args[i].value);
+  }
+  ASSERT_EQ(set.IndexOf(pool_.InternString("real")), 3u);
+  ASSERT_FALSE(set.IndexOf(pool_.InternString("missing")).has_value());
+}
+
+TEST_F(ArgSetStorageTest, SameKeysShareShape) {
+  for (int i = 0; i < 100; ++i) {
+    ArgSetStorage::Arg args[] = {
+        MakeArg("a", Variadic::Integer(i)),
+        MakeArg("b", Variadic::String(pool_.InternString("b"))),
+    };
+    storage_.AddArgSet(args, 2);
+  }
+  // One shape for the empty arg set and one for all the others.
+  ASSERT_EQ(storage_.shape_count(), 2u);
+
+  // A different key or type of value needs a new shape.
+  ArgSetStorage::Arg other_type[] = {
+      MakeArg("a", Variadic::Real(1)),
+      MakeArg("b", Variadic::String(pool_.InternString("b"))),
+  };
+  storage_.AddArgSet(other_type, 2);
+  ASSERT_EQ(storage_.shape_count(), 3u);
+
+  ArgSetStorage::Arg other_key[] = {MakeArg("c", Variadic::Integer(1))};
+  storage_.AddArgSet(other_key, 1);
+  ASSERT_EQ(storage_.shape_count(), 4u);
+
+  // Each arg set should still have its own values.
+  for (uint32_t i = 0; i < 100; ++i) {
+    ASSERT_EQ(storage_.Get(i + 1).value(0).int_value,
+              static_cast<int64_t>(i));
+  }
+  ASSERT_EQ(storage_.Get(101).value(0).real_value, 1.0);
+}
+
+TEST_F(ArgSetStorageTest, ArgIds) {
+  ArgSetStorage::Arg two[] = {MakeArg("a", Variadic::Integer(1)),
+                              MakeArg("b", Variadic::Integer(2))};
+  ArgSetStorage::Arg one[] = {MakeArg("a", Variadic::Integer(3))};
+
+  ASSERT_EQ(storage_.AddArgSet(two, 2), 1u);
+  ASSERT_EQ(storage_.AddArgSet(nullptr, 0), 2u);
+  ASSERT_EQ(storage_.AddArgSet(one, 1), 3u);
+  ASSERT_EQ(storage_.AddArgSet(two, 2), 4u);
+  ASSERT_EQ(storage_.arg_count(), 5u);
+
+  ASSERT_EQ(storage_.Get(1).arg_id(0), 0u);
+  ASSERT_EQ(storage_.Get(1).arg_id(1), 1u);
+  ASSERT_EQ(storage_.Get(3).arg_id(0), 2u);
+  ASSERT_EQ(storage_.Get(4).arg_id(1), 4u);
+
+  ASSERT_EQ(storage_.ArgSetIdForArgId(0), 1u);
+  ASSERT_EQ(storage_.ArgSetIdForArgId(1), 1u);
+  ASSERT_EQ(storage_.ArgSetIdForArgId(2), 3u);
+  ASSERT_EQ(storage_.ArgSetIdForArgId(3), 4u);
+  ASSERT_EQ(storage_.ArgSetIdForArgId(4), 4u);
+  ASSERT_EQ(storage_.ArgSetIdForArgId(5), storage_.size());
+}
+
+TEST_F(ArgSetStorageTest, MemoryUsage) {
+  size_t empty = storage_.GetMemoryUsageBytes();
+  for (int i = 0; i < 1000; ++i) {
+    ArgSetStorage::Arg args[] = {MakeArg("a", Variadic::Integer(i)),
+                                 MakeArg("b", Variadic::Integer(i))};
+    storage_.AddArgSet(args, 2);
+  }
+  // The values and the arg sets are stored, not the keys of each arg.
+  size_t per_set = (storage_.GetMemoryUsageBytes() - empty) / 1000;
+  ASSERT_GE(per_set, 2 * sizeof(int64_t));
+  ASSERT_LT(per_set, 4 * 2 * sizeof(int64_t) + 3 * 2 * sizeof(uint32_t));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
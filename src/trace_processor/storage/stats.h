@@ -29,6 +29,16 @@ namespace stats {
   F(android_log_num_failed,             kSingle,  kError,    kTrace,    ""),   \
   F(android_log_num_skipped,            kSingle,  kInfo,     kTrace,    ""),   \
   F(android_log_num_total,              kSingle,  kInfo,     kTrace,    ""),   \
+  F(arg_set_shapes,                     kSingle,  kInfo,     kAnalysis,        \
+      "Number of distinct lists of keys (and value types) among the arg "      \
+      "sets."),                                                                \
+  F(args_memory_bytes,                  kSingle,  kInfo,     kAnalysis,        \
+      "Memory used to store the args of all the arg sets (not including "      \
+      "the strings they refer to)."),                                          \
+  F(compressed_packets_decompression_duration_ns,                              \
+                                        kSingle,  kInfo,     kAnalysis,        \
+      "Wall time spent decompressing TracePacket.compressed_packets. "         \
+      "Independent compressed packets are decompressed in parallel."),         \
   F(counter_events_out_of_order,        kSingle,  kError,    kAnalysis, ""),   \
   F(deobfuscate_location_parse_error,   kSingle,  kError,    kTrace,    ""),   \
   F(frame_timeline_event_parser_errors, kSingle,  kInfo,     kAnalysis, ""),   \
@@ -68,6 +78,15 @@ namespace stats {
   F(gpu_render_stage_parser_errors,     kSingle,  kError,    kAnalysis, ""),   \
   F(graphics_frame_event_parser_errors, kSingle,  kInfo,     kAnalysis, ""),   \
   F(guess_trace_type_duration_ns,       kSingle,  kInfo,     kAnalysis, ""),   \
+  F(gzip_decompression_duration_ns,     kSingle,  kInfo,     kAnalysis,        \
+      "Time spent decompressing a gzip trace. This happens on a separate "     \
+      "thread, overlapped with parsing, unless TRACE_PROCESSOR_NO_PIPELINE=1 " \
+      "is set."),                                                              \
+  F(gzip_trace_eof_error,               kSingle,  kError,    kTrace,           \
+      "Decompressing or parsing the end of a gzip trace failed. As gzip "      \
+      "traces are decompressed on a separate thread, these errors can only "   \
+      "be detected after the whole file has been read: the events which "      \
+      "follow the failure point are missing."),                                \
   F(interned_data_tokenizer_errors,     kSingle,  kInfo,     kAnalysis, ""),   \
   F(invalid_clock_snapshots,            kSingle,  kError,    kAnalysis, ""),   \
   F(invalid_cpu_times,                  kSingle,  kError,    kAnalysis, ""),   \
@@ -206,6 +225,26 @@ namespace stats {
       "Trace events are out of order event after sorting. This can happen "    \
       "due to many factors including clock sync drift, producers emitting "    \
       "events out of order or a bug in trace processor's logic of sorting."),  \
+  F(sorter_window_late_event_dropped,   kSingle,  kDataLoss, kTrace,           \
+      "An event arrived after the sorting window (see "                        \
+      "Config::sorting_window_ns/sorting_window_bytes) had already moved "     \
+      "past its timestamp and was dropped. Consider increasing the size of "   \
+      "the window."),                                                          \
+  F(sorter_window_extractions,          kSingle,  kInfo,     kTrace,           \
+      "Number of times events were extracted eagerly from the sorter "         \
+      "because the sorting window was exceeded."),                             \
+  F(query_cache_hits,                   kSingle,  kInfo,     kAnalysis,        \
+      "Number of times a table derived from a static table (e.g. a copy "      \
+      "sorted for a repeated equality constraint) was served from the query "  \
+      "cache."),                                                               \
+  F(query_cache_misses,                 kSingle,  kInfo,     kAnalysis,        \
+      "Number of times a table derived from a static table had to be "         \
+      "computed because it was not in the query cache."),                      \
+  F(query_cache_evictions,              kSingle,  kInfo,     kAnalysis,        \
+      "Number of tables evicted from the query cache to stay within "          \
+      "Config::query_cache_max_bytes."),                                       \
+  F(query_cache_bytes,                  kSingle,  kInfo,     kAnalysis,        \
+      "Estimated number of bytes used by the tables in the query cache."),     \
   F(unknown_extension_fields,           kSingle,  kError,    kTrace,           \
       "TraceEvent had unknown extension fields, which might result in "        \
       "missing some arguments. You may need a newer version of trace "         \
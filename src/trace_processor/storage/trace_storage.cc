@@ -143,5 +143,61 @@ std::pair<int64_t, int64_t> TraceStorage::GetTraceTimestampBoundsNs() const {
   return std::make_pair(start_ns, end_ns);
 }
 
+std::vector<macros_internal::MacroTable*> TraceStorage::GetAllTables() {
+  return {
+      &metadata_table_,
+      &clock_snapshot_table_,
+      &track_table_,
+      &gpu_track_table_,
+      &process_track_table_,
+      &thread_track_table_,
+      &counter_track_table_,
+      &thread_counter_track_table_,
+      &process_counter_track_table_,
+      &cpu_counter_track_table_,
+      &irq_counter_track_table_,
+      &softirq_counter_track_table_,
+      &gpu_counter_track_table_,
+      &gpu_counter_group_table_,
+      &perf_counter_track_table_,
+      &thread_table_,
+      &process_table_,
+      &slice_table_,
+      &flow_table_,
+      &sched_slice_table_,
+      &thread_state_table_,
+      &thread_slice_table_,
+      &gpu_slice_table_,
+      &counter_table_,
+      &instant_table_,
+      &raw_table_,
+      &cpu_table_,
+      &cpu_freq_table_,
+      &android_log_table_,
+      &stack_profile_mapping_table_,
+      &stack_profile_frame_table_,
+      &stack_profile_callsite_table_,
+      &stack_sample_table_,
+      &heap_profile_allocation_table_,
+      &cpu_profile_stack_sample_table_,
+      &perf_sample_table_,
+      &package_list_table_,
+      &profiler_smaps_table_,
+      &symbol_table_,
+      &heap_graph_object_table_,
+      &heap_graph_class_table_,
+      &heap_graph_reference_table_,
+      &heap_graph_dominator_tree_table_,
+      &vulkan_memory_allocations_table_,
+      &graphics_frame_slice_table_,
+      &memory_snapshot_table_,
+      &process_memory_snapshot_table_,
+      &memory_snapshot_node_table_,
+      &memory_snapshot_edge_table_,
+      &expected_frame_timeline_slice_table_,
+      &actual_frame_timeline_slice_table_,
+  };
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -34,6 +34,7 @@
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
 #include "src/trace_processor/containers/string_pool.h"
+#include "src/trace_processor/storage/arg_set_storage.h"
 #include "src/trace_processor/storage/metadata.h"
 #include "src/trace_processor/storage/stats.h"
 #include "src/trace_processor/tables/android_tables.h"
@@ -402,6 +403,13 @@ class TraceStorage {
     return &sched_slice_table_;
   }
 
+  const tables::ThreadStateTable& thread_state_table() const {
+    return thread_state_table_;
+  }
+  tables::ThreadStateTable* mutable_thread_state_table() {
+    return &thread_state_table_;
+  }
+
   const tables::SliceTable& slice_table() const { return slice_table_; }
   tables::SliceTable* mutable_slice_table() { return &slice_table_; }
 
@@ -457,8 +465,8 @@ class TraceStorage {
     return &clock_snapshot_table_;
   }
 
-  const tables::ArgTable& arg_table() const { return arg_table_; }
-  tables::ArgTable* mutable_arg_table() { return &arg_table_; }
+  const ArgSetStorage& arg_sets() const { return arg_sets_; }
+  ArgSetStorage* mutable_arg_sets() { return &arg_sets_; }
 
   const tables::RawTable& raw_table() const { return raw_table_; }
   tables::RawTable* mutable_raw_table() { return &raw_table_; }
@@ -562,6 +570,16 @@ class TraceStorage {
     return &heap_graph_reference_table_;
   }
 
+  const tables::HeapGraphDominatorTreeTable& heap_graph_dominator_tree_table()
+      const {
+    return heap_graph_dominator_tree_table_;
+  }
+
+  tables::HeapGraphDominatorTreeTable*
+  mutable_heap_graph_dominator_tree_table() {
+    return &heap_graph_dominator_tree_table_;
+  }
+
   const tables::GpuTrackTable& gpu_track_table() const {
     return gpu_track_table_;
   }
@@ -644,62 +662,32 @@ class TraceStorage {
   // Returns (0, 0) if the trace is empty.
   std::pair<int64_t, int64_t> GetTraceTimestampBoundsNs() const;
 
+  // Returns all the tables owned by this class in the order they are declared
+  // (parents always come before their children). Used to serialize the storage
+  // as a whole (see StorageSnapshot).
+  std::vector<macros_internal::MacroTable*> GetAllTables();
+
   util::Status ExtractArg(uint32_t arg_set_id,
                           const char* key,
                           base::Optional<Variadic>* result) {
-    const auto& args = arg_table();
-    RowMap filtered = args.FilterToRowMap(
-        {args.arg_set_id().eq(arg_set_id), args.key().eq(key)});
-    if (filtered.empty()) {
-      *result = base::nullopt;
+    *result = base::nullopt;
+    if (arg_set_id >= arg_sets_.size())
       return util::OkStatus();
-    }
-    if (filtered.size() > 1) {
-      return util::ErrStatus(
-          "EXTRACT_ARG: received multiple args matching arg set id and key");
-    }
-    uint32_t idx = filtered.Get(0);
-    *result = GetArgValue(idx);
-    return util::OkStatus();
-  }
-
-  Variadic GetArgValue(uint32_t row) const {
-    Variadic v;
-    v.type = *GetVariadicTypeForId(arg_table_.value_type()[row]);
-
-    // Force initialization of union to stop GCC complaining.
-    v.int_value = 0;
-
-    switch (v.type) {
-      case Variadic::Type::kBool:
-        v.bool_value = static_cast<bool>(*arg_table_.int_value()[row]);
-        break;
-      case Variadic::Type::kInt:
-        v.int_value = *arg_table_.int_value()[row];
-        break;
-      case Variadic::Type::kUint:
-        v.uint_value = static_cast<uint64_t>(*arg_table_.int_value()[row]);
-        break;
-      case Variadic::Type::kString: {
-        auto opt_value = arg_table_.string_value()[row];
-        v.string_value = opt_value ? *opt_value : kNullStringId;
-        break;
-      }
-      case Variadic::Type::kPointer:
-        v.pointer_value = static_cast<uint64_t>(*arg_table_.int_value()[row]);
-        break;
-      case Variadic::Type::kReal:
-        v.real_value = *arg_table_.real_value()[row];
-        break;
-      case Variadic::Type::kJson: {
-        auto opt_value = arg_table_.string_value()[row];
-        v.json_value = opt_value ? *opt_value : kNullStringId;
-        break;
+    base::Optional<StringId> key_id = string_pool_.GetId(key);
+    if (!key_id)
+      return util::OkStatus();
+    ArgSetStorage::ArgSet arg_set = arg_sets_.Get(arg_set_id);
+    for (uint32_t i = 0; i < arg_set.size(); ++i) {
+      if (arg_set.key(i) != *key_id)
+        continue;
+      if (result->has_value()) {
+        *result = base::nullopt;
+        return util::ErrStatus(
+            "EXTRACT_ARG: received multiple args matching arg set id and key");
       }
-      case Variadic::Type::kNull:
-        break;
+      *result = arg_set.value(i);
     }
-    return v;
+    return util::OkStatus();
   }
 
   StringId GetIdForVariadicType(Variadic::Type type) const {
@@ -764,7 +752,7 @@ class TraceStorage {
       &string_pool_, &counter_track_table_};
 
   // Args for all other tables.
-  tables::ArgTable arg_table_{&string_pool_, nullptr};
+  ArgSetStorage arg_sets_;
 
   // Information about all the threads and processes in the trace.
   tables::ThreadTable thread_table_{&string_pool_, nullptr};
@@ -779,6 +767,11 @@ class TraceStorage {
   // Slices from CPU scheduling data.
   tables::SchedSliceTable sched_slice_table_{&string_pool_, nullptr};
 
+  // The state of threads over time, derived from the sched slices and the
+  // waking and blocked reason instants once the trace is fully parsed (see
+  // ThreadStateTracker).
+  tables::ThreadStateTable thread_state_table_{&string_pool_, nullptr};
+
   // Additional attributes for threads slices (sub-type of NestableSlices).
   tables::ThreadSliceTable thread_slice_table_{&string_pool_, &slice_table_};
 
@@ -834,6 +827,8 @@ class TraceStorage {
   tables::HeapGraphClassTable heap_graph_class_table_{&string_pool_, nullptr};
   tables::HeapGraphReferenceTable heap_graph_reference_table_{&string_pool_,
                                                               nullptr};
+  tables::HeapGraphDominatorTreeTable heap_graph_dominator_tree_table_{
+      &string_pool_, nullptr};
 
   tables::VulkanMemoryAllocationsTable vulkan_memory_allocations_table_{
       &string_pool_, nullptr};
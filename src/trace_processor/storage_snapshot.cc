@@ -0,0 +1,757 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage_snapshot.h"
+
+#include <fcntl.h>
+#include <string.h>
+
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/optional.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_view.h"
+#include "perfetto/trace_processor/trace_blob.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/variadic.h"
+
+#if TRACE_PROCESSOR_HAS_MMAP()
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+constexpr char kMagic[8] = {'P', 'F', 'T', 'P', 'S', 'N', 'A', 'P'};
+constexpr uint32_t kByteOrderMarker = 0x01020304;
+constexpr size_t kArrayAlignment = 8;
+
+}  // namespace
+
+// Writes the snapshot sequentially to a file, buffering the output to avoid
+// issuing a syscall for every (small) field.
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(base::ScopedFile fd) : fd_(std::move(fd)) {
+    buffer_.reserve(kBufferSize);
+  }
+
+  void WriteU32(uint32_t value) { Write(&value, sizeof(value)); }
+  void WriteU64(uint64_t value) { Write(&value, sizeof(value)); }
+  void WriteI64(int64_t value) { Write(&value, sizeof(value)); }
+
+  void WriteString(base::StringView str) {
+    WriteU32(static_cast<uint32_t>(str.size()));
+    Write(str.data(), str.size());
+  }
+
+  // Writes an array of |size| bytes, prefixed by its size and aligned to
+  // kArrayAlignment.
+  void WriteArray(const void* data, size_t size) {
+    WriteArrayHeader(size);
+    Write(data, size);
+  }
+
+  // Writes the size and alignment padding of an array of |size| bytes: the
+  // contents of the array should be written next, in one or more Write()s.
+  void WriteArrayHeader(size_t size) {
+    WriteU64(size);
+    size_t padding = offset_ % kArrayAlignment;
+    if (padding != 0) {
+      static constexpr uint8_t kZeros[kArrayAlignment] = {};
+      Write(kZeros, kArrayAlignment - padding);
+    }
+  }
+
+  void Write(const void* data, size_t size) {
+    offset_ += size;
+    if (buffer_.size() + size > kBufferSize) {
+      Flush();
+      if (size > kBufferSize) {
+        WriteToFile(data, size);
+        return;
+      }
+    }
+    const uint8_t* ptr = static_cast<const uint8_t*>(data);
+    buffer_.insert(buffer_.end(), ptr, ptr + size);
+  }
+
+  bool Finish() {
+    Flush();
+    return !failed_;
+  }
+
+ private:
+  static constexpr size_t kBufferSize = 1024 * 1024;
+
+  void Flush() {
+    WriteToFile(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+
+  void WriteToFile(const void* data, size_t size) {
+    if (failed_ || size == 0)
+      return;
+    ssize_t res = base::WriteAll(*fd_, data, size);
+    failed_ = res < 0 || static_cast<size_t>(res) != size;
+  }
+
+  base::ScopedFile fd_;
+  std::vector<uint8_t> buffer_;
+  uint64_t offset_ = 0;
+  bool failed_ = false;
+};
+
+// Reads the snapshot from a buffer containing the whole file. All reads are
+// bounds checked: once a read goes out of bounds, all subsequent reads fail
+// and return zero/empty values.
+class SnapshotReader {
+ public:
+  SnapshotReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  uint32_t ReadU32() {
+    uint32_t value = 0;
+    Read(&value, sizeof(value));
+    return value;
+  }
+  uint64_t ReadU64() {
+    uint64_t value = 0;
+    Read(&value, sizeof(value));
+    return value;
+  }
+  int64_t ReadI64() {
+    int64_t value = 0;
+    Read(&value, sizeof(value));
+    return value;
+  }
+
+  base::StringView ReadString() {
+    uint32_t size = ReadU32();
+    const uint8_t* ptr = Advance(size);
+    return ptr ? base::StringView(reinterpret_cast<const char*>(ptr), size)
+               : base::StringView();
+  }
+
+  // Returns a pointer to an array of |*count| elements of type T stored
+  // in-place in the buffer. The pointer is suitably aligned for T as long as
+  // the buffer itself is 8-byte aligned.
+  template <typename T>
+  const T* ReadArray(size_t* count) {
+    static_assert(alignof(T) <= kArrayAlignment, "Unsupported alignment");
+    *count = 0;
+    uint64_t size = ReadU64();
+    if (offset_ % kArrayAlignment != 0)
+      Advance(kArrayAlignment - offset_ % kArrayAlignment);
+    if (size % sizeof(T) != 0)
+      ok_ = false;
+    const uint8_t* ptr = Advance(size);
+    if (!ptr)
+      return nullptr;
+    *count = static_cast<size_t>(size / sizeof(T));
+    return reinterpret_cast<const T*>(ptr);
+  }
+
+  bool Read(void* out, size_t size) {
+    const uint8_t* ptr = Advance(size);
+    if (!ptr)
+      return false;
+    memcpy(out, ptr, size);
+    return true;
+  }
+
+  bool ok() const { return ok_; }
+
+ private:
+  const uint8_t* Advance(uint64_t size) {
+    if (!ok_ || size > size_ - offset_) {
+      ok_ = false;
+      return nullptr;
+    }
+    const uint8_t* ptr = data_ + offset_;
+    offset_ += static_cast<size_t>(size);
+    return ptr;
+  }
+
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  size_t offset_ = 0;
+  bool ok_ = true;
+};
+
+// static
+constexpr uint32_t StorageSnapshot::kVersion;
+
+// static
+util::Status StorageSnapshot::Save(TraceStorage* storage,
+                                   const std::string& path) {
+  base::ScopedFile fd(
+      base::OpenFile(path, O_WRONLY | O_CREAT | O_TRUNC, 0644));
+  if (!fd)
+    return util::ErrStatus("Could not open snapshot file (path: %s)",
+                           path.c_str());
+
+  SnapshotWriter writer(std::move(fd));
+  writer.Write(kMagic, sizeof(kMagic));
+  writer.WriteU32(kVersion);
+  writer.WriteU32(kByteOrderMarker);
+
+  WriteStringPool(&writer, storage->string_pool());
+
+  writer.WriteU32(static_cast<uint32_t>(stats::kNumKeys));
+  for (const TraceStorage::Stats& stat : storage->stats()) {
+    writer.WriteI64(stat.value);
+    writer.WriteU32(static_cast<uint32_t>(stat.indexed_values.size()));
+    for (const auto& index_and_value : stat.indexed_values) {
+      writer.WriteI64(index_and_value.first);
+      writer.WriteI64(index_and_value.second);
+    }
+  }
+
+  const auto& vtrack_slices = storage->virtual_track_slices();
+  writer.WriteU32(vtrack_slices.slice_count());
+  for (uint32_t i = 0; i < vtrack_slices.slice_count(); ++i) {
+    writer.WriteU32(vtrack_slices.slice_ids()[i].value);
+    writer.WriteI64(vtrack_slices.thread_timestamp_ns()[i]);
+    writer.WriteI64(vtrack_slices.thread_duration_ns()[i]);
+    writer.WriteI64(vtrack_slices.thread_instruction_counts()[i]);
+    writer.WriteI64(vtrack_slices.thread_instruction_deltas()[i]);
+  }
+
+  WriteArgSets(&writer, storage->arg_sets());
+
+  std::vector<macros_internal::MacroTable*> tables = storage->GetAllTables();
+  writer.WriteU32(static_cast<uint32_t>(tables.size()));
+  for (const macros_internal::MacroTable* table : tables)
+    WriteTable(&writer, *table, table->table_name());
+
+  if (!writer.Finish())
+    return util::ErrStatus("Failed to write snapshot file (path: %s)",
+                           path.c_str());
+  return util::OkStatus();
+}
+
+// static
+util::Status StorageSnapshot::Load(const std::string& path,
+                                   TraceStorage* storage) {
+  base::ScopedFile fd(base::OpenFile(path, O_RDONLY));
+  if (!fd)
+    return util::ErrStatus("Could not open snapshot file (path: %s)",
+                           path.c_str());
+
+  // Map the file rather than reading it so that the column arrays can be
+  // copied straight from the page cache into the tables.
+  base::Optional<TraceBlob> mapped;
+#if TRACE_PROCESSOR_HAS_MMAP()
+  off_t file_size = lseek(*fd, 0, SEEK_END);
+  lseek(*fd, 0, SEEK_SET);
+  if (file_size > 0) {
+    size_t size = static_cast<size_t>(file_size);
+    void* mm = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, *fd, 0);
+    if (mm != MAP_FAILED) {
+      madvise(mm, size, MADV_SEQUENTIAL);
+      mapped = TraceBlob::FromMmap(mm, size);
+    }
+  }
+#endif
+  std::string file_contents;
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  if (mapped) {
+    data = mapped->data();
+    size = mapped->size();
+  } else {
+    if (!base::ReadFileDescriptor(*fd, &file_contents))
+      return util::ErrStatus("Could not read snapshot file (path: %s)",
+                             path.c_str());
+    data = reinterpret_cast<const uint8_t*>(file_contents.data());
+    size = file_contents.size();
+  }
+
+  SnapshotReader reader(data, size);
+  char magic[sizeof(kMagic)] = {};
+  reader.Read(magic, sizeof(magic));
+  if (memcmp(magic, kMagic, sizeof(kMagic)) != 0)
+    return util::ErrStatus("%s is not a trace processor snapshot",
+                           path.c_str());
+
+  uint32_t version = reader.ReadU32();
+  if (version != kVersion) {
+    return util::ErrStatus(
+        "Snapshot version %u is not supported (expected %u); the snapshot "
+        "needs to be recreated from the original trace",
+        version, kVersion);
+  }
+  if (reader.ReadU32() != kByteOrderMarker)
+    return util::ErrStatus("Snapshot was saved on a machine with a different "
+                           "byte order");
+
+  if (!ReadStringPool(&reader, storage->mutable_string_pool()))
+    return util::ErrStatus("Snapshot string pool is corrupt");
+
+  // The storage interns the names of the variadic types on construction: as
+  // the restored pool replaced the one in the storage, check that the ids
+  // still refer to the same strings.
+  for (uint32_t i = 0; i <= Variadic::kMaxType; ++i) {
+    StringId id = storage->GetIdForVariadicType(static_cast<Variadic::Type>(i));
+    if (storage->GetString(id) != Variadic::kTypeNames[i])
+      return util::ErrStatus("Snapshot string pool is incompatible");
+  }
+
+  if (reader.ReadU32() != stats::kNumKeys)
+    return util::ErrStatus("Snapshot stats are incompatible");
+  for (size_t key = 0; key < stats::kNumKeys && reader.ok(); ++key) {
+    int64_t value = reader.ReadI64();
+    if (stats::kTypes[key] == stats::kSingle)
+      storage->SetStats(key, value);
+    uint32_t indexed_count = reader.ReadU32();
+    for (uint32_t i = 0; i < indexed_count && reader.ok(); ++i) {
+      int index = static_cast<int>(reader.ReadI64());
+      int64_t indexed_value = reader.ReadI64();
+      if (stats::kTypes[key] == stats::kIndexed)
+        storage->SetIndexedStats(key, index, indexed_value);
+    }
+  }
+
+  auto* vtrack_slices = storage->mutable_virtual_track_slices();
+  uint32_t vtrack_slice_count = reader.ReadU32();
+  for (uint32_t i = 0; i < vtrack_slice_count && reader.ok(); ++i) {
+    SliceId slice_id(reader.ReadU32());
+    int64_t thread_ts = reader.ReadI64();
+    int64_t thread_dur = reader.ReadI64();
+    int64_t thread_instruction_count = reader.ReadI64();
+    int64_t thread_instruction_delta = reader.ReadI64();
+    vtrack_slices->AddVirtualTrackSlice(slice_id, thread_ts, thread_dur,
+                                        thread_instruction_count,
+                                        thread_instruction_delta);
+  }
+  if (!reader.ok())
+    return util::ErrStatus("Snapshot file is truncated");
+
+  if (!ReadArgSets(&reader, storage->mutable_arg_sets()))
+    return util::ErrStatus("Snapshot arg sets are corrupt");
+
+  std::vector<macros_internal::MacroTable*> tables = storage->GetAllTables();
+  if (reader.ReadU32() != tables.size())
+    return util::ErrStatus("Snapshot tables are incompatible");
+  for (macros_internal::MacroTable* table : tables) {
+    if (!ReadTable(&reader, table, table->table_name())) {
+      return util::ErrStatus("Snapshot table %s is corrupt or incompatible",
+                             table->table_name());
+    }
+  }
+  return util::OkStatus();
+}
+
+// static
+void StorageSnapshot::WriteBitVector(SnapshotWriter* writer,
+                                     const BitVector& bv) {
+  writer->WriteU32(bv.size());
+  writer->WriteArray(bv.blocks_.data(),
+                     bv.blocks_.size() * sizeof(BitVector::Block));
+  writer->WriteArray(bv.counts_.data(), bv.counts_.size() * sizeof(uint32_t));
+}
+
+// static
+bool StorageSnapshot::ReadBitVector(SnapshotReader* reader, BitVector* bv) {
+  uint32_t size = reader->ReadU32();
+
+  size_t block_count = 0;
+  const auto* blocks = reader->ReadArray<BitVector::Block>(&block_count);
+  size_t counts_count = 0;
+  const auto* counts = reader->ReadArray<uint32_t>(&counts_count);
+  if (!reader->ok() || block_count != counts_count ||
+      block_count < BitVector::BlockCeil(size)) {
+    return false;
+  }
+  *bv = BitVector(std::vector<BitVector::Block>(blocks, blocks + block_count),
+                  std::vector<uint32_t>(counts, counts + counts_count), size);
+  return true;
+}
+
+// static
+void StorageSnapshot::WriteRowMap(SnapshotWriter* writer, const RowMap& rm) {
+  writer->WriteU32(static_cast<uint32_t>(rm.mode_));
+  writer->WriteU32(static_cast<uint32_t>(rm.optimize_for_));
+  switch (rm.mode_) {
+    case RowMap::Mode::kRange:
+      writer->WriteU32(rm.start_index_);
+      writer->WriteU32(rm.end_index_);
+      break;
+    case RowMap::Mode::kBitVector:
+      WriteBitVector(writer, rm.bit_vector_);
+      break;
+    case RowMap::Mode::kIndexVector:
+      writer->WriteArray(rm.index_vector_.data(),
+                         rm.index_vector_.size() * sizeof(uint32_t));
+      break;
+  }
+}
+
+// static
+bool StorageSnapshot::ReadRowMap(SnapshotReader* reader, RowMap* rm) {
+  uint32_t mode = reader->ReadU32();
+  uint32_t optimize_for = reader->ReadU32();
+  if (optimize_for > static_cast<uint32_t>(RowMap::OptimizeFor::kLookupSpeed))
+    return false;
+
+  RowMap out;
+  out.optimize_for_ = static_cast<RowMap::OptimizeFor>(optimize_for);
+  switch (static_cast<RowMap::Mode>(mode)) {
+    case RowMap::Mode::kRange:
+      out.mode_ = RowMap::Mode::kRange;
+      out.start_index_ = reader->ReadU32();
+      out.end_index_ = reader->ReadU32();
+      if (out.start_index_ > out.end_index_)
+        return false;
+      break;
+    case RowMap::Mode::kBitVector:
+      out.mode_ = RowMap::Mode::kBitVector;
+      if (!ReadBitVector(reader, &out.bit_vector_))
+        return false;
+      break;
+    case RowMap::Mode::kIndexVector: {
+      out.mode_ = RowMap::Mode::kIndexVector;
+      size_t count = 0;
+      const uint32_t* indices = reader->ReadArray<uint32_t>(&count);
+      if (!reader->ok())
+        return false;
+      out.index_vector_.assign(indices, indices + count);
+      break;
+    }
+    default:
+      return false;
+  }
+  *rm = std::move(out);
+  return reader->ok();
+}
+
+// static
+template <typename T>
+void StorageSnapshot::WriteNullableVector(SnapshotWriter* writer,
+                                          const NullableVector<T>& nv) {
+  writer->WriteU32(static_cast<uint32_t>(nv.mode_));
+  writer->WriteU32(nv.size_);
+  WriteRowMap(writer, nv.valid_);
+  writer->WriteArrayHeader(nv.data_.size() * sizeof(T));
+  for (const std::vector<T>& chunk : nv.data_.chunks())
+    writer->Write(chunk.data(), chunk.size() * sizeof(T));
+}
+
+// static
+template <typename T>
+bool StorageSnapshot::ReadNullableVector(SnapshotReader* reader,
+                                         NullableVector<T>* nv) {
+  // The mode is part of the schema of the table: check it rather than
+  // overwriting it.
+  if (reader->ReadU32() != static_cast<uint32_t>(nv->mode_))
+    return false;
+  uint32_t size = reader->ReadU32();
+  RowMap valid;
+  if (!ReadRowMap(reader, &valid))
+    return false;
+
+  size_t count = 0;
+  const T* data = reader->ReadArray<T>(&count);
+  if (!reader->ok())
+    return false;
+
+  size_t expected_count = nv->mode_ == NullableVector<T>::Mode::kDense
+                              ? size
+                              : valid.size();
+  if (count != expected_count)
+    return false;
+
+  nv->size_ = size;
+  nv->valid_ = std::move(valid);
+  nv->data_.Assign(data, data + count);
+  return true;
+}
+
+// static
+void StorageSnapshot::WriteColumn(SnapshotWriter* writer,
+                                  const Column& column) {
+  writer->WriteString(column.name_);
+  writer->WriteU32(static_cast<uint32_t>(column.type_));
+  switch (column.type_) {
+    case Column::ColumnType::kInt32:
+      WriteNullableVector(writer, column.nullable_vector<int32_t>());
+      break;
+    case Column::ColumnType::kUint32:
+      WriteNullableVector(writer, column.nullable_vector<uint32_t>());
+      break;
+    case Column::ColumnType::kInt64:
+      WriteNullableVector(writer, column.nullable_vector<int64_t>());
+      break;
+    case Column::ColumnType::kDouble:
+      WriteNullableVector(writer, column.nullable_vector<double>());
+      break;
+    case Column::ColumnType::kString:
+      WriteNullableVector(writer, column.nullable_vector<StringPool::Id>());
+      break;
+    case Column::ColumnType::kId:
+    case Column::ColumnType::kDummy:
+      PERFETTO_FATAL("Columns without storage should not be serialized");
+  }
+}
+
+// static
+bool StorageSnapshot::ReadColumn(SnapshotReader* reader, Column* column) {
+  if (reader->ReadString() != base::StringView(column->name_))
+    return false;
+  if (reader->ReadU32() != static_cast<uint32_t>(column->type_))
+    return false;
+  column->InvalidateIndex();
+  switch (column->type_) {
+    case Column::ColumnType::kInt32:
+      return ReadNullableVector(reader,
+                                column->mutable_nullable_vector<int32_t>());
+    case Column::ColumnType::kUint32:
+      return ReadNullableVector(reader,
+                                column->mutable_nullable_vector<uint32_t>());
+    case Column::ColumnType::kInt64:
+      return ReadNullableVector(reader,
+                                column->mutable_nullable_vector<int64_t>());
+    case Column::ColumnType::kDouble:
+      return ReadNullableVector(reader,
+                                column->mutable_nullable_vector<double>());
+    case Column::ColumnType::kString:
+      return ReadNullableVector(
+          reader, column->mutable_nullable_vector<StringPool::Id>());
+    case Column::ColumnType::kId:
+    case Column::ColumnType::kDummy:
+      break;
+  }
+  return false;
+}
+
+// static
+void StorageSnapshot::WriteTable(SnapshotWriter* writer,
+                                 const Table& table,
+                                 const char* name) {
+  writer->WriteString(name);
+  writer->WriteU32(table.row_count_);
+
+  writer->WriteU32(static_cast<uint32_t>(table.row_maps_.size()));
+  for (const RowMap& rm : table.row_maps_)
+    WriteRowMap(writer, rm);
+
+  uint32_t owned_columns = 0;
+  for (const Column& column : table.columns_)
+    owned_columns += IsOwnedColumn(table, column);
+  writer->WriteU32(owned_columns);
+  for (const Column& column : table.columns_) {
+    if (IsOwnedColumn(table, column))
+      WriteColumn(writer, column);
+  }
+}
+
+// static
+bool StorageSnapshot::ReadTable(SnapshotReader* reader,
+                                Table* table,
+                                const char* name) {
+  if (reader->ReadString() != base::StringView(name))
+    return false;
+  uint32_t row_count = reader->ReadU32();
+
+  if (reader->ReadU32() != table->row_maps_.size())
+    return false;
+  for (RowMap& rm : table->row_maps_) {
+    if (!ReadRowMap(reader, &rm) || rm.size() != row_count)
+      return false;
+  }
+
+  uint32_t owned_columns = 0;
+  for (const Column& column : table->columns_)
+    owned_columns += IsOwnedColumn(*table, column);
+  if (reader->ReadU32() != owned_columns)
+    return false;
+  for (Column& column : table->columns_) {
+    if (IsOwnedColumn(*table, column) && !ReadColumn(reader, &column))
+      return false;
+  }
+  table->row_count_ = row_count;
+  return true;
+}
+
+// static
+void StorageSnapshot::WriteStringPool(SnapshotWriter* writer,
+                                      const StringPool& pool) {
+  writer->WriteU32(static_cast<uint32_t>(pool.blocks_.size()));
+  for (const StringPool::Block& block : pool.blocks_)
+    writer->WriteArray(block.Get(0), block.pos());
+
+  writer->WriteU32(static_cast<uint32_t>(pool.large_strings_.size()));
+  for (const std::unique_ptr<std::string>& str : pool.large_strings_)
+    writer->WriteString(base::StringView(*str));
+}
+
+// static
+bool StorageSnapshot::ReadStringPool(SnapshotReader* reader,
+                                     StringPool* pool) {
+  // The ids handed out by the pool encode the position of each string in the
+  // blocks: restoring the blocks byte-for-byte keeps all the ids stored in the
+  // tables valid.
+  uint32_t block_count = reader->ReadU32();
+  if (block_count == 0 || block_count > (1u << StringPool::kNumBlockIndexBits))
+    return false;
+
+  std::vector<StringPool::Block> blocks;
+  for (uint32_t i = 0; i < block_count; ++i) {
+    size_t size = 0;
+    const uint8_t* data = reader->ReadArray<uint8_t>(&size);
+    if (!reader->ok() || size == 0 || size > StringPool::kBlockSizeBytes ||
+        data[size - 1] != '\0') {
+      return false;
+    }
+    blocks.emplace_back(StringPool::kBlockSizeBytes);
+    blocks.back().Restore(data, static_cast<uint32_t>(size));
+  }
+
+  std::vector<std::unique_ptr<std::string>> large_strings;
+  uint32_t large_string_count = reader->ReadU32();
+  for (uint32_t i = 0; i < large_string_count && reader->ok(); ++i) {
+    base::StringView str = reader->ReadString();
+    large_strings.emplace_back(new std::string(str.data(), str.size()));
+  }
+  if (!reader->ok())
+    return false;
+
+  pool->blocks_ = std::move(blocks);
+  pool->large_strings_ = std::move(large_strings);
+
+  // The hash index is not serialized as rebuilding it is cheap compared to
+  // the size it would take on disk.
+  pool->RebuildIndex();
+  return true;
+}
+
+// static
+void StorageSnapshot::WriteArgSets(SnapshotWriter* writer,
+                                   const ArgSetStorage& arg_sets) {
+  using ShapeArg = ArgSetStorage::ShapeArg;
+  writer->WriteU32(arg_sets.shape_count());
+  for (const auto& shape : arg_sets.shapes_) {
+    writer->WriteArray(shape->args.data(),
+                       shape->args.size() * sizeof(ShapeArg));
+    writer->WriteU32(shape->row_count);
+    writer->WriteArray(shape->int_values.data(),
+                       shape->int_values.size() * sizeof(int64_t));
+    writer->WriteArray(shape->real_values.data(),
+                       shape->real_values.size() * sizeof(double));
+    writer->WriteArray(shape->string_values.data(),
+                       shape->string_values.size() * sizeof(StringPool::Id));
+  }
+  writer->WriteArray(
+      arg_sets.arg_sets_.data(),
+      arg_sets.arg_sets_.size() * sizeof(ArgSetStorage::ArgSetEntry));
+}
+
+// static
+bool StorageSnapshot::ReadArgSets(SnapshotReader* reader,
+                                  ArgSetStorage* arg_sets) {
+  using ShapeArg = ArgSetStorage::ShapeArg;
+  std::vector<std::unique_ptr<ArgSetStorage::Shape>> shapes;
+  uint32_t shape_count = reader->ReadU32();
+  for (uint32_t i = 0; i < shape_count && reader->ok(); ++i) {
+    size_t arg_count = 0;
+    const ShapeArg* shape_args = reader->ReadArray<ShapeArg>(&arg_count);
+    uint32_t row_count = reader->ReadU32();
+    size_t int_count = 0;
+    const int64_t* ints = reader->ReadArray<int64_t>(&int_count);
+    size_t real_count = 0;
+    const double* reals = reader->ReadArray<double>(&real_count);
+    size_t string_count = 0;
+    const StringPool::Id* strings =
+        reader->ReadArray<StringPool::Id>(&string_count);
+    if (!reader->ok())
+      return false;
+
+    // Recreate the shape from its keys and types rather than trusting the
+    // value indices in the file.
+    std::vector<ArgSetStorage::Arg> args;
+    for (size_t j = 0; j < arg_count; ++j) {
+      if (shape_args[j].type > Variadic::kMaxType)
+        return false;
+      Variadic value = Variadic::Null();
+      value.type = static_cast<Variadic::Type>(shape_args[j].type);
+      args.push_back(
+          ArgSetStorage::Arg{shape_args[j].flat_key, shape_args[j].key, value});
+    }
+    std::unique_ptr<ArgSetStorage::Shape> shape = ArgSetStorage::CreateShape(
+        args.data(), static_cast<uint32_t>(args.size()));
+    if (int_count != uint64_t{row_count} * shape->ints_per_row ||
+        real_count != uint64_t{row_count} * shape->reals_per_row ||
+        string_count != uint64_t{row_count} * shape->strings_per_row) {
+      return false;
+    }
+    shape->row_count = row_count;
+    shape->int_values.assign(ints, ints + int_count);
+    shape->real_values.assign(reals, reals + real_count);
+    shape->string_values.assign(strings, strings + string_count);
+    shapes.emplace_back(std::move(shape));
+  }
+
+  size_t set_count = 0;
+  const auto* entries =
+      reader->ReadArray<ArgSetStorage::ArgSetEntry>(&set_count);
+  if (!reader->ok() || set_count == 0)
+    return false;
+
+  // Each row of each shape should be used by exactly one arg set, with the
+  // args of the sets numbered consecutively.
+  std::vector<uint32_t> rows_used(shapes.size());
+  uint64_t arg_count = 0;
+  for (size_t i = 0; i < set_count; ++i) {
+    const ArgSetStorage::ArgSetEntry& entry = entries[i];
+    if (entry.shape >= shapes.size() ||
+        entry.row != rows_used[entry.shape]++ ||
+        entry.first_arg_id != arg_count) {
+      return false;
+    }
+    arg_count += shapes[entry.shape]->args.size();
+    if (arg_count > std::numeric_limits<uint32_t>::max())
+      return false;
+  }
+  for (size_t i = 0; i < shapes.size(); ++i) {
+    if (rows_used[i] != shapes[i]->row_count)
+      return false;
+  }
+
+  arg_sets->shapes_ = std::move(shapes);
+  arg_sets->arg_sets_.assign(entries, entries + set_count);
+  arg_sets->arg_count_ = static_cast<uint32_t>(arg_count);
+  arg_sets->RebuildShapeIndex();
+  return true;
+}
+
+// static
+bool StorageSnapshot::IsOwnedColumn(const Table& table, const Column& column) {
+  // Columns inherited from the parent table use the parent's RowMaps; the
+  // last RowMap always maps to the table's own storage.
+  if (column.IsId() || column.IsDummy())
+    return false;
+  return column.row_map_idx_ + 1 == table.row_maps_.size();
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_STORAGE_SNAPSHOT_H_
+#define SRC_TRACE_PROCESSOR_STORAGE_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/containers/bit_vector.h"
+#include "src/trace_processor/containers/nullable_vector.h"
+#include "src/trace_processor/containers/row_map.h"
+#include "src/trace_processor/containers/string_pool.h"
+#include "src/trace_processor/db/column.h"
+#include "src/trace_processor/db/table.h"
+#include "src/trace_processor/storage/arg_set_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class SnapshotReader;
+class SnapshotWriter;
+class TraceStorage;
+
+// Saves the contents of a fully loaded TraceStorage to a file on disk and
+// restores them into a fresh TraceStorage, skipping parsing of the trace
+// altogether.
+//
+// The file is columnar: the header (magic, format version and a byte order
+// marker) is followed by the raw blocks of the StringPool, the stats, the arg
+// sets and then, for each table, its RowMaps and the data of every column it
+// owns. Every array in the file is prefixed by its size in bytes and starts at
+// an 8-byte aligned offset so it can be used in-place from a mapping of the
+// file: on load, the file is mmap-ed and the arrays are bulk-copied into the
+// containers backing the tables.
+//
+// Only the tables in TraceStorage (and the data needed to query them) are
+// saved: the state of the trackers used during parsing is not, so a restored
+// storage cannot be used to parse more data.
+class StorageSnapshot {
+ public:
+  // Bumped every time the layout of the file or the schema of any table
+  // changes; snapshots with a different version are rejected on load.
+  static constexpr uint32_t kVersion = 4;
+
+  // Writes the contents of |storage| to the file at |path|, overwriting it if
+  // it already exists.
+  static util::Status Save(TraceStorage* storage, const std::string& path);
+
+  // Reads the snapshot at |path| into |storage|, which should be freshly
+  // constructed: any rows already in its tables (e.g. the ones inserted when
+  // trace processor is initialized) are replaced by the ones in the snapshot.
+  // On failure, |storage| may have been partially modified and should be
+  // discarded.
+  static util::Status Load(const std::string& path, TraceStorage* storage);
+
+ private:
+  static void WriteBitVector(SnapshotWriter*, const BitVector&);
+  static bool ReadBitVector(SnapshotReader*, BitVector*);
+
+  static void WriteRowMap(SnapshotWriter*, const RowMap&);
+  static bool ReadRowMap(SnapshotReader*, RowMap*);
+
+  template <typename T>
+  static void WriteNullableVector(SnapshotWriter*, const NullableVector<T>&);
+  template <typename T>
+  static bool ReadNullableVector(SnapshotReader*, NullableVector<T>*);
+
+  static void WriteColumn(SnapshotWriter*, const Column&);
+  static bool ReadColumn(SnapshotReader*, Column*);
+
+  static void WriteTable(SnapshotWriter*, const Table&, const char* name);
+  static bool ReadTable(SnapshotReader*, Table*, const char* name);
+
+  static void WriteStringPool(SnapshotWriter*, const StringPool&);
+  static bool ReadStringPool(SnapshotReader*, StringPool*);
+
+  static void WriteArgSets(SnapshotWriter*, const ArgSetStorage&);
+  static bool ReadArgSets(SnapshotReader*, ArgSetStorage*);
+
+  // Returns whether the data of |column| is owned by |table| (rather than by
+  // one of its parents) and so should be serialized along with it.
+  static bool IsOwnedColumn(const Table& table, const Column& column);
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_STORAGE_SNAPSHOT_H_
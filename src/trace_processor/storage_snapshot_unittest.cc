@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage_snapshot.h"
+
+#include <string>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Checks that every column of every table in |a| and |b| contains the same
+// values (strings are compared by value rather than by id).
+void ExpectSameTables(TraceStorage* a, TraceStorage* b) {
+  std::vector<macros_internal::MacroTable*> a_tables = a->GetAllTables();
+  std::vector<macros_internal::MacroTable*> b_tables = b->GetAllTables();
+  ASSERT_EQ(a_tables.size(), b_tables.size());
+  for (size_t i = 0; i < a_tables.size(); ++i) {
+    const Table& a_table = *a_tables[i];
+    const Table& b_table = *b_tables[i];
+    ASSERT_EQ(a_table.row_count(), b_table.row_count())
+        << a_tables[i]->table_name();
+    for (uint32_t col = 0; col < a_table.GetColumnCount(); ++col) {
+      for (uint32_t row = 0; row < a_table.row_count(); ++row) {
+        SqlValue a_value = a_table.GetColumn(col).Get(row);
+        SqlValue b_value = b_table.GetColumn(col).Get(row);
+        ASSERT_EQ(a_value.type, b_value.type);
+        switch (a_value.type) {
+          case SqlValue::kLong:
+            ASSERT_EQ(a_value.long_value, b_value.long_value);
+            break;
+          case SqlValue::kDouble:
+            ASSERT_EQ(a_value.double_value, b_value.double_value);
+            break;
+          case SqlValue::kString:
+            ASSERT_STREQ(a_value.string_value, b_value.string_value);
+            break;
+          case SqlValue::kNull:
+          case SqlValue::kBytes:
+            break;
+        }
+      }
+    }
+  }
+}
+
+class StorageSnapshotTest : public ::testing::Test {
+ public:
+  StorageSnapshotTest() : file_(base::TempFile::Create()) {}
+
+ protected:
+  void Populate() {
+    StringId cat = storage_.InternString("cat");
+    StringId empty = storage_.InternString("");
+
+    for (uint32_t i = 0; i < 1000; ++i) {
+      tables::ThreadTrackTable::Row track;
+      track.name = storage_.InternString(
+          base::StringView("track " + std::to_string(i)));
+      track.utid = i;
+      TrackId track_id =
+          storage_.mutable_thread_track_table()->Insert(track).id;
+
+      // Interleave slices with and without a thread timestamp so that both
+      // the parent and the child tables have non-trivial RowMaps and nulls.
+      tables::SliceTable::Row slice;
+      slice.ts = i * 100;
+      slice.dur = 10;
+      slice.track_id = track_id;
+      slice.category = i % 3 ? base::make_optional(cat) : base::nullopt;
+      slice.name = empty;
+      if (i % 2) {
+        storage_.mutable_slice_table()->Insert(slice);
+      } else {
+        tables::ThreadSliceTable::Row thread_slice;
+        static_cast<tables::SliceTable::Row&>(thread_slice) = slice;
+        thread_slice.thread_ts = i % 4 ? base::make_optional<int64_t>(i)
+                                       : base::nullopt;
+        storage_.mutable_thread_slice_table()->Insert(thread_slice);
+      }
+
+      tables::CounterTable::Row counter;
+      counter.ts = i;
+      counter.value = i / 3.0;
+      storage_.mutable_counter_table()->Insert(counter);
+    }
+
+    // Large strings are stored outside of the blocks of the pool.
+    std::string large(5 * 1024 * 1024, 'x');
+    StringId large_key = storage_.InternString("large");
+    ArgSetStorage::Arg large_arg{
+        large_key, large_key,
+        Variadic::String(storage_.InternString(base::StringView(large)))};
+    storage_.mutable_arg_sets()->AddArgSet(&large_arg, 1);
+
+    // Arg sets with the same keys share their shape.
+    StringId int_key = storage_.InternString("int");
+    StringId real_key = storage_.InternString("real");
+    for (int i = 0; i < 10; ++i) {
+      ArgSetStorage::Arg args[] = {
+          {int_key, int_key, Variadic::Integer(i)},
+          {real_key, real_key, Variadic::Real(i / 2.0)}};
+      storage_.mutable_arg_sets()->AddArgSet(args, 2);
+    }
+
+    storage_.SetStats(stats::guess_trace_type_duration_ns, 1234);
+    storage_.SetIndexedStats(stats::ftrace_cpu_bytes_read_end, 3, 42);
+    storage_.mutable_virtual_track_slices()->AddVirtualTrackSlice(
+        SliceId(1u), 10, 20, 30, 40);
+  }
+
+  base::TempFile file_;
+  TraceStorage storage_;
+};
+
+TEST_F(StorageSnapshotTest, RoundTrip) {
+  Populate();
+  ASSERT_TRUE(StorageSnapshot::Save(&storage_, file_.path()).ok());
+
+  // Rows already in the storage should be replaced by the snapshot.
+  TraceStorage restored;
+  restored.mutable_counter_table()->Insert({});
+  util::Status status = StorageSnapshot::Load(file_.path(), &restored);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  ExpectSameTables(&storage_, &restored);
+  ASSERT_EQ(restored.thread_slice_table().row_count(), 500u);
+  ASSERT_FALSE(restored.thread_slice_table().thread_ts()[0].has_value());
+  ASSERT_EQ(restored.thread_slice_table().thread_ts()[1], 2);
+
+  // The ids of strings must be preserved and the pool must still be usable
+  // for lookups and for interning new strings.
+  ASSERT_EQ(restored.string_count(), storage_.string_count());
+  ASSERT_EQ(restored.string_pool().GetId("cat"),
+            storage_.string_pool().GetId("cat"));
+  ASSERT_EQ(
+      restored.GetString(restored.arg_sets().Get(1).value(0).string_value)
+          .size(),
+      5u * 1024 * 1024);
+  StringId new_id = restored.InternString("new string");
+  ASSERT_EQ(restored.GetString(new_id), "new string");
+
+  ASSERT_EQ(restored.stats()[stats::guess_trace_type_duration_ns].value, 1234);
+  ASSERT_EQ(restored.GetIndexedStats(stats::ftrace_cpu_bytes_read_end, 3), 42);
+  ASSERT_EQ(restored.virtual_track_slices().slice_count(), 1u);
+  ASSERT_EQ(restored.virtual_track_slices().thread_duration_ns()[0], 20);
+
+  // Arg sets should keep their ids, the ids of their args and their shapes.
+  const ArgSetStorage& arg_sets = restored.arg_sets();
+  ASSERT_EQ(arg_sets.size(), 12u);
+  ASSERT_EQ(arg_sets.arg_count(), 21u);
+  ASSERT_EQ(arg_sets.shape_count(), storage_.arg_sets().shape_count());
+  ArgSetStorage::ArgSet last = arg_sets.Get(11);
+  ASSERT_EQ(last.arg_id(0), 19u);
+  ASSERT_EQ(restored.GetString(last.key(1)), "real");
+  ASSERT_EQ(last.value(0).int_value, 9);
+  ASSERT_DOUBLE_EQ(last.value(1).real_value, 4.5);
+  ASSERT_EQ(arg_sets.ArgSetIdForArgId(20), 11u);
+
+  // New arg sets should reuse the restored shapes.
+  StringId int_key = restored.InternString("int");
+  StringId real_key = restored.InternString("real");
+  ArgSetStorage::Arg args[] = {{int_key, int_key, Variadic::Integer(10)},
+                               {real_key, real_key, Variadic::Real(5)}};
+  ASSERT_EQ(restored.mutable_arg_sets()->AddArgSet(args, 2), 12u);
+  ASSERT_EQ(arg_sets.shape_count(), storage_.arg_sets().shape_count());
+
+  // Restored tables should still accept new rows.
+  tables::CounterTable::Row counter;
+  counter.ts = 2000;
+  auto id_and_row = restored.mutable_counter_table()->Insert(counter);
+  ASSERT_EQ(id_and_row.row, 1000u);
+  ASSERT_EQ(restored.counter_table().ts()[id_and_row.row], 2000);
+}
+
+TEST_F(StorageSnapshotTest, EmptyStorage) {
+  ASSERT_TRUE(StorageSnapshot::Save(&storage_, file_.path()).ok());
+
+  TraceStorage restored;
+  ASSERT_TRUE(StorageSnapshot::Load(file_.path(), &restored).ok());
+  ExpectSameTables(&storage_, &restored);
+}
+
+TEST_F(StorageSnapshotTest, RejectsInvalidFiles) {
+  Populate();
+  ASSERT_TRUE(StorageSnapshot::Save(&storage_, file_.path()).ok());
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(file_.path(), &contents));
+
+  // Truncated files should be detected rather than crash.
+  base::TempFile truncated = base::TempFile::Create();
+  base::WriteAll(truncated.fd(), contents.data(), contents.size() / 2);
+  TraceStorage restored;
+  ASSERT_FALSE(StorageSnapshot::Load(truncated.path(), &restored).ok());
+
+  // So should files which are not snapshots at all.
+  base::TempFile not_snapshot = base::TempFile::Create();
+  base::WriteAll(not_snapshot.fd(), "not a snapshot", 14);
+  TraceStorage restored2;
+  ASSERT_FALSE(StorageSnapshot::Load(not_snapshot.path(), &restored2).ok());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
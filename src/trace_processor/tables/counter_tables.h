@@ -26,12 +26,12 @@ namespace tables {
 
 // @tablegroup Events
 // @param arg_set_id {@joinable args.arg_set_id}
-#define PERFETTO_TP_COUNTER_TABLE_DEF(NAME, PARENT, C) \
-  NAME(CounterTable, "counter")                        \
-  PERFETTO_TP_ROOT_TABLE(PARENT, C)                    \
-  C(int64_t, ts, Column::Flag::kSorted)                \
-  C(CounterTrackTable::Id, track_id)                   \
-  C(double, value)                                     \
+#define PERFETTO_TP_COUNTER_TABLE_DEF(NAME, PARENT, C)       \
+  NAME(CounterTable, "counter")                              \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                          \
+  C(int64_t, ts, Column::Flag::kSorted)                      \
+  C(CounterTrackTable::Id, track_id, Column::Flag::kIndexed) \
+  C(double, value)                                           \
   C(base::Optional<uint32_t>, arg_set_id)
 
 PERFETTO_TP_TABLE(PERFETTO_TP_COUNTER_TABLE_DEF);
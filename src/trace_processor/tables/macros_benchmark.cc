@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <random>
+#include <string>
 
 #include <benchmark/benchmark.h>
 
@@ -28,7 +29,9 @@ namespace {
   C(uint32_t, root_sorted, Column::Flag::kSorted)    \
   C(uint32_t, root_non_null)                         \
   C(uint32_t, root_non_null_2)                       \
-  C(base::Optional<uint32_t>, root_nullable)
+  C(base::Optional<uint32_t>, root_nullable)         \
+  C(uint32_t, root_indexed, Column::Flag::kIndexed) \
+  C(StringPool::Id, root_string)
 
 PERFETTO_TP_TABLE(PERFETTO_TP_ROOT_TEST_TABLE);
 
@@ -230,6 +233,94 @@ static void BM_TableFilterRootNonNullEqMatchMany(benchmark::State& state) {
 }
 BENCHMARK(BM_TableFilterRootNonNullEqMatchMany)->Apply(TableFilterArgs);
 
+static void BM_TableFilterRootStringEqMatchMany(benchmark::State& state) {
+  StringPool pool;
+  RootTestTable root(&pool, nullptr);
+
+  uint32_t size = static_cast<uint32_t>(state.range(0));
+  uint32_t partitions = size / 1024;
+
+  std::minstd_rand0 rnd_engine;
+  for (uint32_t i = 0; i < size; ++i) {
+    RootTestTable::Row row;
+    uint32_t partition = static_cast<uint32_t>(rnd_engine() % partitions);
+    std::string name = "partition_" + std::to_string(partition);
+    row.root_string = pool.InternString(perfetto::base::StringView(name));
+    root.Insert(row);
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        root.Filter({root.root_string().eq("partition_0")}));
+  }
+}
+BENCHMARK(BM_TableFilterRootStringEqMatchMany)->Apply(TableFilterArgs);
+
+static void BM_TableFilterRootStringGlobMatchMany(benchmark::State& state) {
+  StringPool pool;
+  RootTestTable root(&pool, nullptr);
+
+  uint32_t size = static_cast<uint32_t>(state.range(0));
+  uint32_t partitions = size / 1024;
+
+  std::minstd_rand0 rnd_engine;
+  for (uint32_t i = 0; i < size; ++i) {
+    RootTestTable::Row row;
+    uint32_t partition = static_cast<uint32_t>(rnd_engine() % partitions);
+    std::string name = "partition_" + std::to_string(partition);
+    row.root_string = pool.InternString(perfetto::base::StringView(name));
+    root.Insert(row);
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(root.Filter(
+        {root.root_string().glob_value(SqlValue::String("*_1*"))}));
+  }
+}
+BENCHMARK(BM_TableFilterRootStringGlobMatchMany)->Apply(TableFilterArgs);
+
+static void BM_TableFilterRootIndexedEqMatchMany(benchmark::State& state) {
+  StringPool pool;
+  RootTestTable root(&pool, nullptr);
+
+  uint32_t size = static_cast<uint32_t>(state.range(0));
+  uint32_t partitions = size / 1024;
+
+  std::minstd_rand0 rnd_engine;
+  for (uint32_t i = 0; i < size; ++i) {
+    RootTestTable::Row row;
+    row.root_indexed = static_cast<uint32_t>(rnd_engine() % partitions);
+    root.Insert(row);
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(root.Filter({root.root_indexed().eq(0)}));
+  }
+}
+BENCHMARK(BM_TableFilterRootIndexedEqMatchMany)->Apply(TableFilterArgs);
+
+static void BM_TableFilterRootIndexedEqMatchFew(benchmark::State& state) {
+  StringPool pool;
+  RootTestTable root(&pool, nullptr);
+
+  uint32_t size = static_cast<uint32_t>(state.range(0));
+
+  std::minstd_rand0 rnd_engine;
+  for (uint32_t i = 0; i < size; ++i) {
+    RootTestTable::Row row;
+    row.root_non_null = static_cast<uint32_t>(rnd_engine() % size);
+    row.root_indexed = row.root_non_null;
+    root.Insert(row);
+  }
+
+  uint32_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        root.Filter({root.root_indexed().eq(i++ % size)}));
+  }
+}
+BENCHMARK(BM_TableFilterRootIndexedEqMatchFew)->Apply(TableFilterArgs);
+
 static void BM_TableFilterRootMultipleNonNull(benchmark::State& state) {
   StringPool pool;
   RootTestTable root(&pool, nullptr);
@@ -258,7 +258,9 @@ class MacroTable : public Table {
       static_cast<bool>(FlagsForColumn(ColumnIndex::name) & \
                         Column::Flag::kSorted),             \
       static_cast<bool>(FlagsForColumn(ColumnIndex::name) & \
-                        Column::Flag::kHidden)});
+                        Column::Flag::kHidden),             \
+      static_cast<bool>(FlagsForColumn(ColumnIndex::name) & \
+                        Column::Flag::kIndexed)});
 
 // Defines the accessors for a column.
 #define PERFETTO_TP_TABLE_COL_ACCESSOR(type, name, ...)       \
@@ -393,6 +395,17 @@ class MacroTable : public Table {
       return {id, row_number};                                                \
     }                                                                         \
                                                                               \
+    /*                                                                        \
+     * Removes all the rows. Only supported for root tables without any      \
+     * child table.                                                           \
+     */                                                                       \
+    void Clear() {                                                            \
+      PERFETTO_CHECK(parent_ == nullptr);                                     \
+      ClearRows();                                                            \
+      type_ = NullableVector<StringPool::Id>();                               \
+      PERFETTO_TP_TABLE_COLUMNS(DEF, PERFETTO_TP_TABLE_CONSTRUCTOR_SV);       \
+    }                                                                         \
+                                                                              \
     const IdColumn<Id>& id() const {                                          \
       return static_cast<const IdColumn<Id>&>(                                \
           columns_[static_cast<uint32_t>(ColumnIndex::id)]);                  \
@@ -406,9 +419,9 @@ class MacroTable : public Table {
     static Table::Schema Schema() {                                           \
       Table::Schema schema;                                                   \
       schema.columns.emplace_back(Table::Schema::Column{                      \
-          "id", SqlValue::Type::kLong, true, true, false});                   \
+          "id", SqlValue::Type::kLong, true, true, false, false});            \
       schema.columns.emplace_back(Table::Schema::Column{                      \
-          "type", SqlValue::Type::kString, false, false, false});             \
+          "type", SqlValue::Type::kString, false, false, false, false});      \
       PERFETTO_TP_ALL_COLUMNS(DEF, PERFETTO_TP_COLUMN_SCHEMA);                \
       return schema;                                                          \
     }                                                                         \
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/tables/macros.h"
 
+#include <thread>
+
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -51,10 +53,26 @@ PERFETTO_TP_TABLE(PERFETTO_TP_TEST_SLICE_TABLE_DEF);
   C(StringPool::Id, end_state)
 PERFETTO_TP_TABLE(PERFETTO_TP_TEST_CPU_SLICE_TABLE_DEF);
 
+#define PERFETTO_TP_TEST_INDEXED_TABLE_DEF(NAME, PARENT, C)      \
+  NAME(TestIndexedTable, "indexed")                              \
+  PARENT(PERFETTO_TP_ROOT_TABLE_PARENT_DEF, C)                   \
+  C(uint32_t, utid, Column::Flag::kIndexed)                      \
+  C(base::Optional<int64_t>, nullable, Column::Flag::kIndexed)   \
+  C(base::Optional<StringPool::Id>, name, Column::Flag::kIndexed)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_INDEXED_TABLE_DEF);
+
+#define PERFETTO_TP_TEST_INDEXED_CHILD_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestIndexedChildTable, "indexed_child")                    \
+  PARENT(PERFETTO_TP_TEST_INDEXED_TABLE_DEF, C)                   \
+  C(int64_t, extra)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_INDEXED_CHILD_TABLE_DEF);
+
 TestEventTable::~TestEventTable() = default;
 TestCounterTable::~TestCounterTable() = default;
 TestSliceTable::~TestSliceTable() = default;
 TestCpuSliceTable::~TestCpuSliceTable() = default;
+TestIndexedTable::~TestIndexedTable() = default;
+TestIndexedChildTable::~TestIndexedChildTable() = default;
 
 class TableMacrosUnittest : public ::testing::Test {
  protected:
@@ -64,6 +82,8 @@ class TableMacrosUnittest : public ::testing::Test {
   TestCounterTable counter_{&pool_, &event_};
   TestSliceTable slice_{&pool_, &event_};
   TestCpuSliceTable cpu_slice_{&pool_, &slice_};
+  TestIndexedTable indexed_{&pool_, nullptr};
+  TestIndexedChildTable indexed_child_{&pool_, &indexed_};
 };
 
 TEST_F(TableMacrosUnittest, Name) {
@@ -316,6 +336,49 @@ TEST_F(TableMacrosUnittest, NullableDoubleComparision) {
   ASSERT_DOUBLE_EQ(value->Get(1).double_value, 200);
 }
 
+TEST_F(TableMacrosUnittest, NonNullLongComparison) {
+  // Insert enough rows that the filter covers multiple full words.
+  for (uint32_t i = 0; i < 1000; ++i) {
+    event_.Insert(TestEventTable::Row(i, i % 10));
+  }
+
+  // Returns the number of rows matching |constraint| and checks that every one
+  // of them satisfies |pred|.
+  auto check = [this](Constraint constraint, bool (*pred)(int64_t)) {
+    Table out = event_.Filter({constraint});
+    const auto* arg_set_id = out.GetColumnByName("arg_set_id");
+    for (uint32_t i = 0; i < out.row_count(); ++i) {
+      EXPECT_TRUE(pred(arg_set_id->Get(i).long_value));
+    }
+    return out.row_count();
+  };
+
+  ASSERT_EQ(check(event_.arg_set_id().lt(5),
+                  [](int64_t v) { return v < 5; }),
+            500u);
+  ASSERT_EQ(check(event_.arg_set_id().eq(5),
+                  [](int64_t v) { return v == 5; }),
+            100u);
+  ASSERT_EQ(check(event_.arg_set_id().gt(5),
+                  [](int64_t v) { return v > 5; }),
+            400u);
+  ASSERT_EQ(check(event_.arg_set_id().ne(5),
+                  [](int64_t v) { return v != 5; }),
+            900u);
+  ASSERT_EQ(check(event_.arg_set_id().le(5),
+                  [](int64_t v) { return v <= 5; }),
+            600u);
+  ASSERT_EQ(check(event_.arg_set_id().ge(5),
+                  [](int64_t v) { return v >= 5; }),
+            500u);
+
+  // Filtering an already filtered range should only look at the rows in it.
+  Table out = event_.Filter(
+      {event_.ts().ge(100), event_.ts().lt(200), event_.arg_set_id().eq(3)});
+  ASSERT_EQ(out.row_count(), 10u);
+  ASSERT_EQ(out.GetColumnByName("ts")->Get(0).long_value, 103);
+}
+
 TEST_F(TableMacrosUnittest, NullableDoubleCompareWithLong) {
   counter_.Insert({});
 
@@ -406,6 +469,42 @@ TEST_F(TableMacrosUnittest, StringComparision) {
   ASSERT_STREQ(end_state->Get(1).string_value, "D");
 }
 
+TEST_F(TableMacrosUnittest, StringPatternAndUninternedComparision) {
+  const char* kStates[] = {"R", "R+", "D", "S", "R", "DK"};
+  for (const char* state : kStates) {
+    TestCpuSliceTable::Row row;
+    row.end_state = pool_.InternString(state);
+    cpu_slice_.Insert(row);
+  }
+  cpu_slice_.Insert({});
+
+  Table out = cpu_slice_.Filter(
+      {cpu_slice_.end_state().glob_value(SqlValue::String("R*"))});
+  const auto* end_state = out.GetColumnByName("end_state");
+  ASSERT_EQ(out.row_count(), 3u);
+  ASSERT_STREQ(end_state->Get(0).string_value, "R");
+  ASSERT_STREQ(end_state->Get(1).string_value, "R+");
+  ASSERT_STREQ(end_state->Get(2).string_value, "R");
+
+  out = cpu_slice_.Filter(
+      {cpu_slice_.end_state().like_value(SqlValue::String("d%"))});
+  end_state = out.GetColumnByName("end_state");
+  ASSERT_EQ(out.row_count(), 2u);
+  ASSERT_STREQ(end_state->Get(0).string_value, "D");
+  ASSERT_STREQ(end_state->Get(1).string_value, "DK");
+
+  // Pattern matching never matches non-string columns.
+  out = cpu_slice_.Filter({cpu_slice_.cpu().glob_value(SqlValue::String("*"))});
+  ASSERT_EQ(out.row_count(), 0u);
+
+  // Strings which were never interned are not equal to any row.
+  out = cpu_slice_.Filter({cpu_slice_.end_state().eq("X")});
+  ASSERT_EQ(out.row_count(), 0u);
+
+  out = cpu_slice_.Filter({cpu_slice_.end_state().ne("X")});
+  ASSERT_EQ(out.row_count(), 6u);
+}
+
 TEST_F(TableMacrosUnittest, FilterIdThenOther) {
   TestCpuSliceTable::Row row;
   row.cpu = 1;
@@ -445,6 +544,239 @@ TEST_F(TableMacrosUnittest, Sort) {
   ASSERT_EQ(arg_set_id->Get(2).long_value, 100);
 }
 
+TEST_F(TableMacrosUnittest, SortToRowMap) {
+  for (uint32_t i = 0; i < 10; ++i) {
+    event_.Insert(TestEventTable::Row(i /* ts */, i % 3 /* arg_set_id */));
+  }
+
+  // Only the rows in the RowMap should be returned, in sorted order.
+  RowMap rm = event_.FilterToRowMap({event_.ts().ge(4)});
+  RowMap sorted = event_.SortToRowMap(rm.Copy(),
+                                      {event_.arg_set_id().ascending(),
+                                       event_.ts().descending()});
+  std::vector<uint32_t> rows;
+  for (auto it = sorted.IterateRows(); it; it.Next()) {
+    rows.push_back(it.index());
+  }
+  ASSERT_THAT(rows, testing::ElementsAre(9, 6, 7, 4, 8, 5));
+
+  // Sorting by a sorted column should keep (or reverse) the order of |rm|.
+  sorted = event_.SortToRowMap(rm.Copy(), {event_.ts().descending()});
+  ASSERT_EQ(sorted.size(), 6u);
+  ASSERT_EQ(sorted.Get(0), 9u);
+  ASSERT_EQ(sorted.Get(5), 4u);
+}
+
+TEST_F(TableMacrosUnittest, LazyIterator) {
+  for (uint32_t i = 0; i < 100; ++i) {
+    // Interleave rows in the parent so the child has a non-trivial RowMap.
+    event_.Insert(TestEventTable::Row(2 * i, 0));
+    slice_.Insert(TestSliceTable::Row(2 * i + 1, i, i % 7, i % 5));
+  }
+
+  std::vector<Constraint> cs{slice_.depth().ne(0)};
+  std::vector<Order> od{slice_.dur().descending()};
+  Table expected = slice_.Filter(cs).Sort(od);
+
+  // Only compute the RowMap of the depth column upfront: the other columns
+  // (some of which use a different RowMap) should be computed on demand even
+  // once the iterator has moved forward.
+  BitVector cols_used(slice_.GetColumnCount(), false);
+  cols_used.Set(slice_.depth().index_in_table());
+  auto it = slice_.IterateRows(
+      slice_.SortToRowMap(slice_.FilterToRowMap(cs), od), cols_used);
+  auto expected_it = expected.IterateRows();
+  for (uint32_t row = 0; expected_it; ++row, it.Next(), expected_it.Next()) {
+    ASSERT_TRUE(it);
+    ASSERT_EQ(it.Get(slice_.depth().index_in_table()).long_value,
+              expected_it.Get(slice_.depth().index_in_table()).long_value);
+    if (row < 10)
+      continue;
+    for (uint32_t col = 0; col < slice_.GetColumnCount(); ++col) {
+      SqlValue value = it.Get(col);
+      SqlValue expected_value = expected_it.Get(col);
+      ASSERT_EQ(value.type, expected_value.type);
+      if (value.type == SqlValue::kLong)
+        ASSERT_EQ(value.long_value, expected_value.long_value);
+    }
+  }
+  ASSERT_FALSE(it);
+}
+
+TEST_F(TableMacrosUnittest, IndexedFilter) {
+  ASSERT_TRUE(indexed_.utid().IsIndexed());
+  ASSERT_TRUE(TestIndexedTable::Schema().columns[2].is_indexed);
+
+  StringPool::Id a = pool_.InternString("a");
+  StringPool::Id b = pool_.InternString("b");
+  for (uint32_t i = 0; i < 10; ++i) {
+    TestIndexedTable::Row row;
+    row.utid = (i * 7) % 5;
+    row.nullable = i % 3 ? base::make_optional<int64_t>(i % 4) : base::nullopt;
+    row.name = i % 2 ? base::make_optional(a) : base::make_optional(b);
+    if (i % 2) {
+      indexed_.Insert(row);
+    } else {
+      TestIndexedChildTable::Row child_row;
+      static_cast<TestIndexedTable::Row&>(child_row) = row;
+      indexed_child_.Insert(child_row);
+    }
+  }
+
+  // utid: 0 2 4 1 3 0 2 4 1 3
+  Table out = indexed_.Filter({indexed_.utid().eq(2)});
+  ASSERT_EQ(out.row_count(), 2u);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(0).long_value, 1);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(1).long_value, 6);
+
+  out = indexed_.Filter({indexed_.utid().gt(2)});
+  ASSERT_EQ(out.row_count(), 4u);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(0).long_value, 2);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(3).long_value, 9);
+
+  out = indexed_.Filter({indexed_.utid().le(1), indexed_.id().gt(3)});
+  ASSERT_EQ(out.row_count(), 2u);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(0).long_value, 5);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(1).long_value, 8);
+
+  out = indexed_.Filter({indexed_.utid().eq(-1)});
+  ASSERT_EQ(out.row_count(), 0u);
+
+  // nullable: null 1 2 null 0 1 null 3 0 null
+  out = indexed_.Filter({indexed_.nullable().lt(1)});
+  ASSERT_EQ(out.row_count(), 2u);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(0).long_value, 4);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(1).long_value, 8);
+
+  // Strings can only use the index for equality.
+  out = indexed_.Filter({indexed_.name().eq("a")});
+  ASSERT_EQ(out.row_count(), 5u);
+  out = indexed_.Filter({indexed_.name().eq("not interned")});
+  ASSERT_EQ(out.row_count(), 0u);
+  out = indexed_.Filter({indexed_.name().gt("a")});
+  ASSERT_EQ(out.row_count(), 5u);
+
+  // Child tables should see the same results.
+  out = indexed_child_.Filter({indexed_child_.utid().eq(2)});
+  ASSERT_EQ(out.row_count(), 1u);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(0).long_value, 6);
+}
+
+TEST_F(TableMacrosUnittest, IndexedFilterAfterUpdate) {
+  for (uint32_t i = 0; i < 4; ++i) {
+    TestIndexedTable::Row row;
+    row.utid = i;
+    indexed_.Insert(row);
+    TestIndexedChildTable::Row child_row;
+    child_row.utid = i;
+    indexed_child_.Insert(child_row);
+  }
+  ASSERT_EQ(indexed_.Filter({indexed_.utid().eq(1)}).row_count(), 2u);
+
+  // Rows inserted after the index was built should be found.
+  TestIndexedTable::Row row;
+  row.utid = 1;
+  indexed_.Insert(row);
+  ASSERT_EQ(indexed_.Filter({indexed_.utid().eq(1)}).row_count(), 3u);
+
+  // Changes made to the data through any table should be visible.
+  indexed_child_.mutable_utid()->Set(0, 1);
+  ASSERT_EQ(indexed_.Filter({indexed_.utid().eq(1)}).row_count(), 4u);
+  ASSERT_EQ(indexed_.Filter({indexed_.utid().eq(0)}).row_count(), 1u);
+}
+
+TEST_F(TableMacrosUnittest, Clear) {
+  TestIndexedTable table(&pool_, nullptr);
+  for (uint32_t i = 0; i < 10; ++i) {
+    TestIndexedTable::Row row;
+    row.utid = i;
+    table.Insert(row);
+  }
+  // Builds the index of the utid column.
+  ASSERT_EQ(table.Filter({table.utid().eq(2)}).row_count(), 1u);
+
+  table.Clear();
+  ASSERT_EQ(table.row_count(), 0u);
+  ASSERT_EQ(table.Filter({table.utid().eq(2)}).row_count(), 0u);
+
+  for (uint32_t utid : {5u, 2u, 2u}) {
+    TestIndexedTable::Row row;
+    row.utid = utid;
+    row.nullable = 7;
+    table.Insert(row);
+  }
+  ASSERT_EQ(table.row_count(), 3u);
+  ASSERT_EQ(table.id()[2].value, 2u);
+  ASSERT_EQ(table.type().GetString(2), "indexed");
+  ASSERT_EQ(table.nullable()[2], 7);
+  Table out = table.Filter({table.utid().eq(2)});
+  ASSERT_EQ(out.row_count(), 2u);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(0).long_value, 1);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(1).long_value, 2);
+}
+
+TEST_F(TableMacrosUnittest, FilterKernelsAcrossStorageChunks) {
+  // Enough rows for the values to be split between two chunks of storage.
+  for (int64_t i = 0; i < 70000; ++i)
+    event_.Insert(TestEventTable::Row(i, i % 3));
+
+  // The range of rows left by the ts constraint does not start on a multiple
+  // of 64 so the words compared by the kernels straddle the chunks.
+  Table out = event_.Filter({event_.ts().ge(65530), event_.arg_set_id().eq(0)});
+  ASSERT_EQ(out.row_count(), 1490u);
+  ASSERT_EQ(out.GetColumnByName("ts")->Get(0).long_value, 65532);
+  ASSERT_EQ(out.GetColumnByName("ts")->Get(1).long_value, 65535);
+}
+
+TEST_F(TableMacrosUnittest, IndexedFilterAfterFewAppends) {
+  for (uint32_t i = 0; i < 64; ++i) {
+    TestIndexedTable::Row row;
+    row.utid = i % 4;
+    indexed_.Insert(row);
+  }
+  ASSERT_EQ(indexed_.Filter({indexed_.utid().eq(1)}).row_count(), 16u);
+
+  // A few rows appended after the index was built are not merged into it but
+  // should still be found, after the indexed rows.
+  for (uint32_t utid : {1u, 5u, 1u}) {
+    TestIndexedTable::Row row;
+    row.utid = utid;
+    indexed_.Insert(row);
+  }
+  Table out = indexed_.Filter({indexed_.utid().eq(1)});
+  ASSERT_EQ(out.row_count(), 18u);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(15).long_value, 61);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(16).long_value, 64);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(17).long_value, 66);
+
+  out = indexed_.Filter({indexed_.utid().gt(3)});
+  ASSERT_EQ(out.row_count(), 1u);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(0).long_value, 65);
+  ASSERT_EQ(indexed_.Filter({indexed_.utid().le(1)}).row_count(), 34u);
+}
+
+TEST_F(TableMacrosUnittest, IndexedFilterConcurrent) {
+  for (uint32_t i = 0; i < 1000; ++i) {
+    TestIndexedTable::Row row;
+    row.utid = i % 10;
+    indexed_.Insert(row);
+  }
+
+  // The index is built by the first filter: filtering from several threads
+  // at once should be safe and give the same results.
+  std::vector<uint32_t> counts(4);
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < counts.size(); ++i) {
+    threads.emplace_back([this, &counts, i] {
+      counts[i] = indexed_.Filter({indexed_.utid().eq(i)}).row_count();
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+  for (uint32_t count : counts)
+    ASSERT_EQ(count, 100u);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
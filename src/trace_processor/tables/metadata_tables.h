@@ -35,11 +35,16 @@ namespace tables {
 
 PERFETTO_TP_TABLE(PERFETTO_TP_RAW_TABLE_DEF);
 
+// The args are stored in ArgSetStorage: the rows of this table are computed
+// from it when the table is queried (see ArgsGenerator). |arg_id| is the id of
+// the arg in the storage and is exposed as the id of the args view.
+//
 // @name args
 #define PERFETTO_TP_ARG_TABLE_DEF(NAME, PARENT, C) \
   NAME(ArgTable, "internal_args")                  \
   PERFETTO_TP_ROOT_TABLE(PARENT, C)                \
   C(uint32_t, arg_set_id, Column::Flag::kSorted)   \
+  C(uint32_t, arg_id, Column::Flag::kSorted)       \
   C(StringPool::Id, flat_key)                      \
   C(StringPool::Id, key)                           \
   C(base::Optional<int64_t>, int_value)            \
@@ -371,6 +371,37 @@ PERFETTO_TP_TABLE(PERFETTO_TP_HEAP_GRAPH_OBJECT_DEF);
 
 PERFETTO_TP_TABLE(PERFETTO_TP_HEAP_GRAPH_REFERENCE_DEF);
 
+// The dominator tree of the objects of each dump reachable from a GC root.
+//
+// An object dominates another if every path from the GC roots to the other
+// object goes through it: the dominated objects would be collected if the
+// object was. The retained size of an object is the size of all the objects
+// it dominates (including itself).
+// @param upid UniquePid of the target {@joinable process.upid}.
+// @param graph_sample_ts timestamp this dump was taken at.
+// @param object_id the object. {@joinable heap_graph_object.id}
+// @param idom_id the immediate dominator of the object (the closest object
+//        dominating it), NULL if it is only dominated by the GC roots as a
+//        whole (e.g. for GC roots). {@joinable heap_graph_object.id}
+// @param retained_size sum of the self_size of the objects dominated by this
+//        object.
+// @param retained_native_size sum of the native_size of the objects
+//        dominated by this object.
+// @param retained_count number of objects dominated by this object.
+// @tablegroup ART Heap Graphs
+#define PERFETTO_TP_HEAP_GRAPH_DOMINATOR_TREE_DEF(NAME, PARENT, C)     \
+  NAME(HeapGraphDominatorTreeTable, "heap_graph_dominator_tree")       \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                                    \
+  C(uint32_t, upid)                                                    \
+  C(int64_t, graph_sample_ts)                                          \
+  C(HeapGraphObjectTable::Id, object_id)                               \
+  C(base::Optional<HeapGraphObjectTable::Id>, idom_id)                 \
+  C(int64_t, retained_size)                                            \
+  C(int64_t, retained_native_size)                                     \
+  C(int64_t, retained_count)
+
+PERFETTO_TP_TABLE(PERFETTO_TP_HEAP_GRAPH_DOMINATOR_TREE_DEF);
+
 // @param arg_set_id {@joinable args.arg_set_id}
 #define PERFETTO_TP_VULKAN_MEMORY_ALLOCATIONS_DEF(NAME, PARENT, C) \
   NAME(VulkanMemoryAllocationsTable, "vulkan_memory_allocations")  \
@@ -29,18 +29,18 @@ namespace tables {
 // @param ts timestamp of the start of the slice (in nanoseconds)
 // @param dur duration of the slice (in nanoseconds)
 // @param arg_set_id {@joinable args.arg_set_id}
-#define PERFETTO_TP_SLICE_TABLE_DEF(NAME, PARENT, C) \
-  NAME(SliceTable, "internal_slice")                 \
-  PERFETTO_TP_ROOT_TABLE(PARENT, C)                  \
-  C(int64_t, ts, Column::Flag::kSorted)              \
-  C(int64_t, dur)                                    \
-  C(TrackTable::Id, track_id)                        \
-  C(base::Optional<StringPool::Id>, category)        \
-  C(base::Optional<StringPool::Id>, name)            \
-  C(uint32_t, depth)                                 \
-  C(int64_t, stack_id)                               \
-  C(int64_t, parent_stack_id)                        \
-  C(base::Optional<SliceTable::Id>, parent_id)       \
+#define PERFETTO_TP_SLICE_TABLE_DEF(NAME, PARENT, C)                   \
+  NAME(SliceTable, "internal_slice")                                   \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                                    \
+  C(int64_t, ts, Column::Flag::kSorted)                                \
+  C(int64_t, dur)                                                      \
+  C(TrackTable::Id, track_id, Column::Flag::kIndexed)                  \
+  C(base::Optional<StringPool::Id>, category)                          \
+  C(base::Optional<StringPool::Id>, name)                              \
+  C(uint32_t, depth)                                                   \
+  C(int64_t, stack_id)                                                 \
+  C(int64_t, parent_stack_id)                                          \
+  C(base::Optional<SliceTable::Id>, parent_id, Column::Flag::kIndexed) \
   C(uint32_t, arg_set_id)
 
 PERFETTO_TP_TABLE(PERFETTO_TP_SLICE_TABLE_DEF);
@@ -69,7 +69,7 @@ PERFETTO_TP_TABLE(PERFETTO_TP_INSTANT_TABLE_DEF);
   C(int64_t, ts, Column::Flag::kSorted)                    \
   C(int64_t, dur)                                          \
   C(uint32_t, cpu)                                         \
-  C(uint32_t, utid)                                        \
+  C(uint32_t, utid, Column::Flag::kIndexed)                \
   C(StringPool::Id, end_state)                             \
   C(int32_t, priority)
 
@@ -80,10 +80,10 @@ PERFETTO_TP_TABLE(PERFETTO_TP_SCHED_SLICE_TABLE_DEF);
 #define PERFETTO_TP_THREAD_STATE_TABLE_DEF(NAME, PARENT, C) \
   NAME(ThreadStateTable, "thread_state")                    \
   PERFETTO_TP_ROOT_TABLE(PARENT, C)                         \
-  C(int64_t, ts)                                            \
+  C(int64_t, ts, Column::Flag::kSorted)                     \
   C(int64_t, dur)                                           \
   C(base::Optional<uint32_t>, cpu)                          \
-  C(uint32_t, utid)                                         \
+  C(uint32_t, utid, Column::Flag::kIndexed)                 \
   C(StringPool::Id, state)                                  \
   C(base::Optional<uint32_t>, io_wait)                      \
   C(base::Optional<StringPool::Id>, blocked_function)
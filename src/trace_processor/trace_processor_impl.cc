@@ -26,6 +26,7 @@
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/trace_processor/demangle.h"
 #include "src/trace_processor/dynamic/ancestor_generator.h"
+#include "src/trace_processor/dynamic/args_generator.h"
 #include "src/trace_processor/dynamic/connected_flow_generator.h"
 #include "src/trace_processor/dynamic/descendant_generator.h"
 #include "src/trace_processor/dynamic/describe_slice_generator.h"
@@ -35,10 +36,10 @@
 #include "src/trace_processor/dynamic/experimental_flat_slice_generator.h"
 #include "src/trace_processor/dynamic/experimental_sched_upid_generator.h"
 #include "src/trace_processor/dynamic/experimental_slice_layout_generator.h"
-#include "src/trace_processor/dynamic/thread_state_generator.h"
 #include "src/trace_processor/export_json.h"
 #include "src/trace_processor/importers/additional_modules.h"
 #include "src/trace_processor/importers/ftrace/sched_event_tracker.h"
+#include "src/trace_processor/importers/ftrace/thread_state_tracker.h"
 #include "src/trace_processor/importers/fuchsia/fuchsia_trace_parser.h"
 #include "src/trace_processor/importers/fuchsia/fuchsia_trace_tokenizer.h"
 #include "src/trace_processor/importers/gzip/gzip_trace_parser.h"
@@ -59,6 +60,7 @@
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 #include "src/trace_processor/sqlite/stats_table.h"
 #include "src/trace_processor/sqlite/window_operator_table.h"
+#include "src/trace_processor/storage_snapshot.h"
 #include "src/trace_processor/tp_metatrace.h"
 #include "src/trace_processor/types/variadic.h"
 #include "src/trace_processor/util/protozero_to_text.h"
@@ -103,6 +105,20 @@ void RegisterFunction(sqlite3* db,
     PERFETTO_ELOG("%s", status.c_message());
 }
 
+// Number of virtual machine instructions between calls to
+// InterruptProgressHandler().
+constexpr int kInterruptCheckInstructions = 1000;
+
+// Aborts the running statement if the query was interrupted. Unlike
+// sqlite3_interrupt(), whose effect is reset by SQLite once no statement is
+// running, this also catches the statements of the query starting after the
+// interrupt.
+int InterruptProgressHandler(void* arg) {
+  return static_cast<std::atomic<bool>*>(arg)->load(std::memory_order_relaxed)
+             ? 1
+             : 0;
+}
+
 void InitializeSqlite(sqlite3* db) {
   char* error = nullptr;
   sqlite3_exec(db, "PRAGMA temp_store=2", 0, 0, &error);
@@ -306,7 +322,15 @@ void CreateBuiltinViews(sqlite3* db) {
   sqlite3_exec(db,
                "CREATE VIEW args AS "
                "SELECT "
-               "*, "
+               "arg_id AS id, "
+               "type, "
+               "arg_set_id, "
+               "flat_key, "
+               "key, "
+               "int_value, "
+               "string_value, "
+               "real_value, "
+               "value_type, "
                "CASE value_type "
                "  WHEN 'int' THEN CAST(int_value AS text) "
                "  WHEN 'uint' THEN CAST(int_value AS text) "
@@ -335,11 +359,34 @@ struct ExportJson : public SqlFunction {
                           Destructors&);
 };
 
+// EXPORT_JSON(output, [min_ts, [max_ts, [upid]]]) where |output| is a file
+// name or an FD. The optional arguments restrict the exported events, a NULL
+// argument doesn't restrict them.
 base::Status ExportJson::Run(TraceStorage* storage,
-                             size_t /*argc*/,
+                             size_t argc,
                              sqlite3_value** argv,
                              SqlValue& /*out*/,
                              Destructors&) {
+  if (argc < 1 || argc > 4)
+    return base::ErrStatus("EXPORT_JSON: expected 1 to 4 arguments");
+
+  json::EventFilter event_filter;
+  for (size_t i = 1; i < argc; ++i) {
+    int type = sqlite3_value_type(argv[i]);
+    if (type == SQLITE_NULL)
+      continue;
+    if (type != SQLITE_INTEGER)
+      return base::ErrStatus("EXPORT_JSON: argument %zu must be an integer", i);
+    int64_t value = sqlite3_value_int64(argv[i]);
+    if (i == 1) {
+      event_filter.min_ts = value;
+    } else if (i == 2) {
+      event_filter.max_ts = value;
+    } else {
+      event_filter.upid = static_cast<uint32_t>(value);
+    }
+  }
+
   FILE* output;
   if (sqlite3_value_type(argv[0]) == SQLITE_INTEGER) {
     // Assume input is an FD.
@@ -356,7 +403,7 @@ base::Status ExportJson::Run(TraceStorage* storage,
       return base::ErrStatus("EXPORT_JSON: Couldn't open output file");
     }
   }
-  return json::ExportJson(storage, output);
+  return json::ExportJson(storage, output, event_filter);
 }
 
 struct Hash : public SqlFunction {
@@ -688,6 +735,7 @@ struct Glob : public SqlFunction {
 void SetupMetrics(TraceProcessor* tp,
                   sqlite3* db,
                   std::vector<metrics::SqlMetricFile>* sql_metrics,
+                  metrics::RunMetricCache* run_metric_cache,
                   const std::vector<std::string>& extension_paths) {
   const std::vector<std::string> sanitized_extension_paths =
       SanitizeMetricMountPaths(extension_paths);
@@ -719,7 +767,8 @@ void SetupMetrics(TraceProcessor* tp,
   RegisterFunction<metrics::RunMetric>(
       db, "RUN_METRIC", -1,
       std::unique_ptr<metrics::RunMetric::Context>(
-          new metrics::RunMetric::Context{tp, sql_metrics}));
+          new metrics::RunMetric::Context{tp, sql_metrics,
+                                          run_metric_cache}));
 
   // TODO(lalitm): migrate this over to using RegisterFunction once aggregate
   // functions are supported.
@@ -878,13 +927,15 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   CreateBuiltinTables(db);
   CreateBuiltinViews(db);
   db_.reset(std::move(db));
+  sqlite3_progress_handler(db, kInterruptCheckInstructions,
+                           &InterruptProgressHandler, &query_interrupted_);
 
   // New style function registration.
   RegisterFunction<Glob>(db, "glob", 2);
   RegisterFunction<Hash>(db, "HASH", -1);
   RegisterFunction<Demangle>(db, "DEMANGLE", 1);
   RegisterFunction<SourceGeq>(db, "SOURCE_GEQ", -1);
-  RegisterFunction<ExportJson>(db, "EXPORT_JSON", 1, context_.storage.get(),
+  RegisterFunction<ExportJson>(db, "EXPORT_JSON", -1, context_.storage.get(),
                                false);
   RegisterFunction<ExtractArg>(db, "EXTRACT_ARG", 2, context_.storage.get());
   RegisterFunction<CreateFunction>(
@@ -902,10 +953,18 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   RegisterLastNonNullFunction(db);
   RegisterValueAtMaxTsFunction(db);
 
-  SetupMetrics(this, *db_, &sql_metrics_, cfg.skip_builtin_metric_paths);
+  run_metric_cache_.reset(
+      new metrics::RunMetricCache(*db_, &create_function_state_));
+  SetupMetrics(this, *db_, &sql_metrics_, run_metric_cache_.get(),
+               cfg.skip_builtin_metric_paths);
 
   // Setup the query cache.
-  query_cache_.reset(new QueryCache());
+  query_cache_.reset(
+      new QueryCache(cfg.query_cache_max_bytes, context_.storage.get()));
+
+  native_queries_enabled_ =
+      getenv("TRACE_PROCESSOR_NO_NATIVE_QUERIES") == nullptr;
+  compute_thread_state_in_background_ = cfg.compute_thread_state_in_background;
 
   const TraceStorage* storage = context_.storage.get();
 
@@ -913,7 +972,11 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   StatsTable::RegisterTable(*db_, storage);
 
   // Operator tables.
-  SpanJoinOperatorTable::RegisterTable(*db_, storage);
+  SpanJoinOperatorTable::Context span_join_context;
+  span_join_context.cache = query_cache_.get();
+  if (native_queries_enabled_)
+    span_join_context.db_tables = &db_tables_;
+  SpanJoinOperatorTable::RegisterTable(*db_, span_join_context);
   WindowOperatorTable::RegisterTable(*db_, storage);
   CreateViewFunction::RegisterTable(*db_, &create_view_function_state_);
 
@@ -955,15 +1018,14 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   RegisterDynamicTable(std::unique_ptr<ExperimentalSchedUpidGenerator>(
       new ExperimentalSchedUpidGenerator(storage->sched_slice_table(),
                                          storage->thread_table())));
-  RegisterDynamicTable(std::unique_ptr<ThreadStateGenerator>(
-      new ThreadStateGenerator(&context_)));
   RegisterDynamicTable(std::unique_ptr<ExperimentalAnnotatedStackGenerator>(
       new ExperimentalAnnotatedStackGenerator(&context_)));
   RegisterDynamicTable(std::unique_ptr<ExperimentalFlatSliceGenerator>(
       new ExperimentalFlatSliceGenerator(&context_)));
+  RegisterDynamicTable(std::unique_ptr<ArgsGenerator>(
+      new ArgsGenerator(context_.storage.get())));
 
   // New style db-backed tables.
-  RegisterDbTable(storage->arg_table());
   RegisterDbTable(storage->thread_table());
   RegisterDbTable(storage->process_table());
 
@@ -971,6 +1033,7 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   RegisterDbTable(storage->flow_table());
   RegisterDbTable(storage->thread_slice_table());
   RegisterDbTable(storage->sched_slice_table());
+  RegisterDbTable(storage->thread_state_table());
   RegisterDbTable(storage->instant_table());
   RegisterDbTable(storage->gpu_slice_table());
 
@@ -994,6 +1057,7 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   RegisterDbTable(storage->heap_graph_object_table());
   RegisterDbTable(storage->heap_graph_reference_table());
   RegisterDbTable(storage->heap_graph_class_table());
+  RegisterDbTable(storage->heap_graph_dominator_tree_table());
 
   RegisterDbTable(storage->symbol_table());
   RegisterDbTable(storage->heap_profile_allocation_table());
@@ -1025,10 +1089,20 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   RegisterDbTable(storage->memory_snapshot_edge_table());
 }
 
-TraceProcessorImpl::~TraceProcessorImpl() = default;
+TraceProcessorImpl::~TraceProcessorImpl() {
+  // The thread computing the thread_state table accesses the storage.
+  WaitForThreadStateTable();
+}
 
 base::Status TraceProcessorImpl::Parse(TraceBlobView blob) {
+  if (snapshot_loaded_)
+    return base::ErrStatus("Cannot parse trace data after loading a snapshot");
+  WaitForThreadStateTable();
   bytes_parsed_ += blob.size();
+
+  // Parsing can append to and modify any of the tables so the cached tables
+  // derived from them cannot be trusted anymore.
+  query_cache_->Invalidate();
   return TraceProcessorStorageImpl::Parse(std::move(blob));
 }
 
@@ -1044,15 +1118,46 @@ void TraceProcessorImpl::SetCurrentTraceName(const std::string& name) {
 }
 
 void TraceProcessorImpl::NotifyEndOfFile() {
+  // All the tables were already finalized when the snapshot was saved.
+  if (snapshot_loaded_)
+    return;
+
   if (current_trace_name_.empty())
     current_trace_name_ = "Unnamed trace";
 
   TraceProcessorStorageImpl::NotifyEndOfFile();
 
   SchedEventTracker::GetOrCreate(&context_)->FlushPendingEvents();
+  query_cache_->Invalidate();
   context_.metadata_tracker->SetMetadata(
       metadata::trace_size_bytes,
       Variadic::Integer(static_cast<int64_t>(bytes_parsed_)));
+  OnTablesLoaded();
+}
+
+base::Status TraceProcessorImpl::SaveSnapshot(const std::string& path) {
+  PERFETTO_TP_TRACE("SAVE_SNAPSHOT");
+  WaitForThreadStateTable();
+  return StorageSnapshot::Save(context_.storage.get(), path);
+}
+
+base::Status TraceProcessorImpl::LoadSnapshot(const std::string& path) {
+  PERFETTO_TP_TRACE("LOAD_SNAPSHOT");
+  if (bytes_parsed_ > 0 || snapshot_loaded_) {
+    return base::ErrStatus(
+        "Snapshots can only be loaded before any trace data is parsed");
+  }
+  RETURN_IF_ERROR(StorageSnapshot::Load(path, context_.storage.get()));
+  snapshot_loaded_ = true;
+  query_cache_->Invalidate();
+
+  if (current_trace_name_.empty())
+    current_trace_name_ = "Unnamed trace";
+  OnTablesLoaded();
+  return base::OkStatus();
+}
+
+void TraceProcessorImpl::OnTablesLoaded() {
   BuildBoundsTable(*db_, context_.storage->GetTraceTimestampBoundsNs());
 
   // Create a snapshot of all tables and views created so far. This is so later
@@ -1065,6 +1170,53 @@ void TraceProcessorImpl::NotifyEndOfFile() {
     PERFETTO_CHECK(value.type == SqlValue::Type::kString);
     initial_tables_.push_back(value.string_value);
   }
+
+  // Snapshots already contain the thread_state table.
+  if (!snapshot_loaded_)
+    ComputeThreadStateTable();
+}
+
+void TraceProcessorImpl::ComputeThreadStateTable() {
+  const TraceStorage& storage = *context_.storage;
+  uint32_t sched_rows = storage.sched_slice_table().row_count();
+  uint32_t instant_rows = storage.instant_table().row_count();
+  if (thread_state_computed_ && sched_rows == thread_state_sched_rows_ &&
+      instant_rows == thread_state_instant_rows_) {
+    return;
+  }
+  if (thread_state_computed_) {
+    WaitForThreadStateTable();
+    context_.storage->mutable_thread_state_table()->Clear();
+  }
+  thread_state_computed_ = true;
+  thread_state_sched_rows_ = sched_rows;
+  thread_state_instant_rows_ = instant_rows;
+
+  // The tracker interns the strings it needs on construction so that the
+  // computation itself does not modify anything but the thread_state table.
+  std::shared_ptr<ThreadStateTracker> tracker(
+      new ThreadStateTracker(&context_));
+  int64_t trace_end_ts = context_.storage->GetTraceTimestampBoundsNs().second;
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  if (compute_thread_state_in_background_) {
+    PERFETTO_DCHECK(!thread_state_thread_.joinable());
+    thread_state_thread_ = std::thread([tracker, trace_end_ts] {
+      tracker->ComputeThreadStates(trace_end_ts);
+    });
+    return;
+  }
+#endif
+  PERFETTO_TP_TRACE("THREAD_STATE_COMPUTE");
+  tracker->ComputeThreadStates(trace_end_ts);
+}
+
+void TraceProcessorImpl::WaitForThreadStateTable() {
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  if (thread_state_thread_.joinable()) {
+    PERFETTO_TP_TRACE("THREAD_STATE_WAIT");
+    thread_state_thread_.join();
+  }
+#endif
 }
 
 size_t TraceProcessorImpl::RestoreInitialTables() {
@@ -1096,27 +1248,68 @@ size_t TraceProcessorImpl::RestoreInitialTables() {
     if (!it.Status().ok() && tn.first != "index")
       PERFETTO_FATAL("%s -> %s", query.c_str(), it.Status().c_message());
   }
+
+  // Step 3: drop all the cached tables to also release the memory used for
+  // queries issued since the tables were loaded.
+  query_cache_->Invalidate();
   return deletion_list.size();
 }
 
 Iterator TraceProcessorImpl::ExecuteQuery(const std::string& sql) {
   PERFETTO_TP_TRACE("QUERY_EXECUTE");
 
+  // Any query could read the thread_state table (e.g. through a view) so
+  // make sure the table is fully computed.
+  WaitForThreadStateTable();
+
+  OnQueryBegin();
   uint32_t sql_stats_row =
       context_.storage->mutable_sql_stats()->RecordQueryBegin(
           sql, base::GetWallTimeNs().count());
 
+  base::Optional<NativeAggregateQuery::Result> native_result =
+      TryExecuteNativeQuery(sql);
+  if (native_result) {
+    OnQueryEnd();
+    std::unique_ptr<IteratorImpl> impl(
+        new IteratorImpl(this, std::move(*native_result), sql_stats_row));
+    return Iterator(std::move(impl));
+  }
+
   ScopedStmt stmt;
   IteratorImpl::StmtMetadata metadata;
   base::Status status =
       PrepareAndStepUntilLastValidStmt(*db_, sql, &stmt, &metadata);
   PERFETTO_DCHECK((status.ok() && stmt) || (!status.ok() && !stmt));
+  OnQueryEnd();
 
   std::unique_ptr<IteratorImpl> impl(new IteratorImpl(
       this, *db_, status, std::move(stmt), std::move(metadata), sql_stats_row));
   return Iterator(std::move(impl));
 }
 
+base::Optional<NativeAggregateQuery::Result>
+TraceProcessorImpl::TryExecuteNativeQuery(const std::string& sql) {
+  if (!native_queries_enabled_)
+    return base::nullopt;
+
+  base::Optional<NativeAggregateQuery> query = NativeAggregateQuery::Parse(sql);
+  if (!query)
+    return base::nullopt;
+
+  auto table_it = db_tables_.find(query->table_name());
+  if (table_it == db_tables_.end())
+    return base::nullopt;
+
+  // Tables and views in the temp schema shadow the db tables: make sure the
+  // name still refers to the db table.
+  if (sqlite_utils::HasTempObject(*db_, query->table_name()))
+    return base::nullopt;
+
+  PERFETTO_TP_TRACE("QUERY_EXECUTE_NATIVE");
+  return query->Execute(*table_it->second);
+}
+
 void TraceProcessorImpl::InterruptQuery() {
   if (!db_)
     return;
@@ -1124,6 +1317,11 @@ void TraceProcessorImpl::InterruptQuery() {
   sqlite3_interrupt(db_.get());
 }
 
+void TraceProcessorImpl::OnQueryBegin() {
+  if (running_queries_++ == 0)
+    query_interrupted_.store(false);
+}
+
 bool TraceProcessorImpl::IsRootMetricField(const std::string& metric_name) {
   base::Optional<uint32_t> desc_idx =
       pool_.FindDescriptorIdx(".perfetto.protos.TraceMetrics");
@@ -1230,8 +1428,12 @@ base::Status TraceProcessorImpl::ComputeMetric(
     return base::Status("Root metrics proto descriptor not found");
 
   const auto& root_descriptor = pool_.descriptors()[opt_idx.value()];
-  return metrics::ComputeMetrics(this, metric_names, sql_metrics_, pool_,
-                                 root_descriptor, metrics_proto);
+  OnQueryBegin();
+  base::Status status = metrics::ComputeMetrics(
+      this, run_metric_cache_.get(), metric_names, sql_metrics_, pool_,
+      root_descriptor, metrics_proto);
+  OnQueryEnd();
+  return status;
 }
 
 base::Status TraceProcessorImpl::ComputeMetricText(
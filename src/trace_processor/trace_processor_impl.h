@@ -23,8 +23,12 @@
 #include <functional>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/optional.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
@@ -32,6 +36,7 @@
 #include "src/trace_processor/sqlite/create_function.h"
 #include "src/trace_processor/sqlite/create_view_function.h"
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/sqlite/native_aggregate_query.h"
 #include "src/trace_processor/sqlite/query_cache.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/trace_processor_storage_impl.h"
@@ -39,6 +44,12 @@
 #include "src/trace_processor/metrics/metrics.h"
 #include "src/trace_processor/util/descriptors.h"
 
+// WASM builds are single threaded: the thread_state table is always computed
+// on the calling thread.
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+#include <thread>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 
@@ -61,6 +72,9 @@ class TraceProcessorImpl : public TraceProcessor,
   base::Status Parse(TraceBlobView) override;
   void NotifyEndOfFile() override;
 
+  // TraceProcessorStorageImpl implementation:
+  void WaitForBackgroundWork() override { WaitForThreadStateTable(); }
+
   // TraceProcessor implementation:
   Iterator ExecuteQuery(const std::string& sql) override;
 
@@ -83,6 +97,9 @@ class TraceProcessorImpl : public TraceProcessor,
 
   std::vector<uint8_t> GetMetricDescriptors() override;
 
+  base::Status SaveSnapshot(const std::string& path) override;
+  base::Status LoadSnapshot(const std::string& path) override;
+
   void InterruptQuery() override;
 
   size_t RestoreInitialTables() override;
@@ -99,10 +116,16 @@ class TraceProcessorImpl : public TraceProcessor,
   // Needed for iterators to be able to access the context.
   friend class IteratorImpl;
 
+  // Called when a query or a metric computation starts and ends. A query
+  // which is not part of another one clears the previous interrupt, if any.
+  void OnQueryBegin();
+  void OnQueryEnd() { running_queries_--; }
+
   template <typename Table>
   void RegisterDbTable(const Table& table) {
     DbSqliteTable::RegisterTable(*db_, query_cache_.get(), Table::Schema(),
                                  &table, table.table_name());
+    db_tables_[base::ToLower(table.table_name())] = &table;
   }
 
   void RegisterDynamicTable(
@@ -113,6 +136,27 @@ class TraceProcessorImpl : public TraceProcessor,
 
   bool IsRootMetricField(const std::string& metric_name);
 
+  // Tries to execute |sql| directly on the db tables, bypassing SQLite. See
+  // NativeAggregateQuery for the queries which are supported.
+  base::Optional<NativeAggregateQuery::Result> TryExecuteNativeQuery(
+      const std::string& sql);
+
+  // Builds the tables derived from the contents of the storage and snapshots
+  // the list of tables created during loading. Called once all the data has
+  // been loaded, either by parsing a trace or by loading a snapshot.
+  void OnTablesLoaded();
+
+  // Computes the thread_state table (replacing its previous content, if any),
+  // either synchronously or on |thread_state_thread_| depending on
+  // |compute_thread_state_in_background_|. Does nothing if the table is up to
+  // date with the sched data parsed so far.
+  void ComputeThreadStateTable();
+
+  // Blocks until the thread_state table has been computed if it is being
+  // computed in the background. Must be called before anything which may
+  // access the storage.
+  void WaitForThreadStateTable();
+
   // Keep this first: we need this to be destroyed after we clean up
   // everything else.
   ScopedDb db_;
@@ -128,14 +172,29 @@ class TraceProcessorImpl : public TraceProcessor,
 
   std::unique_ptr<QueryCache> query_cache_;
 
+  // The db tables registered with SQLite, keyed by their (lowercased) name.
+  std::unordered_map<std::string, const Table*> db_tables_;
+
+  // Whether simple queries on a single table (and span joins on db tables)
+  // can be executed natively rather than by SQLite. Can be disabled by setting
+  // the TRACE_PROCESSOR_NO_NATIVE_QUERIES environment variable.
+  bool native_queries_enabled_ = true;
+
   DescriptorPool pool_;
   std::vector<metrics::SqlMetricFile> sql_metrics_;
+  std::unique_ptr<metrics::RunMetricCache> run_metric_cache_;
   std::unordered_map<std::string, std::string> proto_field_to_sql_metric_path_;
 
   // This is atomic because it is set by the CTRL-C signal handler and we need
-  // to prevent single-flow compiler optimizations in ExecuteQuery().
+  // to prevent single-flow compiler optimizations in ExecuteQuery(). Checked
+  // by the SQLite progress handler until the next query starts.
   std::atomic<bool> query_interrupted_{false};
 
+  // Number of queries and metric computations running: the ones started while
+  // another is running (e.g. the queries of a metric) are part of it and
+  // don't clear |query_interrupted_|.
+  uint32_t running_queries_ = 0;
+
   // Keeps track of the tables created by the ingestion process. This is used
   // by RestoreInitialTables() to delete all the tables/view that have been
   // created after that point.
@@ -143,6 +202,23 @@ class TraceProcessorImpl : public TraceProcessor,
 
   std::string current_trace_name_;
   uint64_t bytes_parsed_ = 0;
+
+  // Set when the tables were loaded from a snapshot rather than by parsing a
+  // trace: no more data can be parsed in this case.
+  bool snapshot_loaded_ = false;
+
+  // Whether the thread_state table has been computed and, if so, the number
+  // of rows of the tables it is computed from at the time: if they changed,
+  // more sched data was parsed since and the table must be recomputed.
+  bool thread_state_computed_ = false;
+  uint32_t thread_state_sched_rows_ = 0;
+  uint32_t thread_state_instant_rows_ = 0;
+
+  // See Config::compute_thread_state_in_background.
+  bool compute_thread_state_in_background_ = false;
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  std::thread thread_state_thread_;
+#endif
 };
 
 }  // namespace trace_processor
@@ -21,6 +21,7 @@
 #include <cinttypes>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <unordered_set>
 #include <vector>
 
@@ -659,12 +660,16 @@ struct CommandLineOptions {
   std::string metric_names;
   std::string metric_output;
   std::string trace_file_path;
+  std::string save_snapshot_path;
+  std::string load_snapshot_path;
   std::string port_number;
   std::vector<std::string> raw_metric_extensions;
   bool launch_shell = false;
   bool enable_httpd = false;
   bool wide = false;
   bool force_full_sort = false;
+  uint64_t sorting_window_ms = 0;
+  uint64_t sorting_window_mb = 0;
   std::string metatrace_path;
   bool dev = false;
   bool no_ftrace_raw = false;
@@ -715,6 +720,18 @@ Options:
  --full-sort                          Forces the trace processor into performing
                                       a full sort ignoring any windowing
                                       logic.
+ --sorting-window-ms MS               Bounds the memory used for sorting by
+                                      parsing events eagerly once the sorter
+                                      holds more than MS milliseconds of the
+                                      trace. Late events are dropped.
+ --sorting-window-mb MB               Like --sorting-window-ms, but bounds the
+                                      size of the events held by the sorter.
+ --save-snapshot FILE                 Saves the tables of the loaded trace to
+                                      FILE so that they can be reopened later
+                                      with --load-snapshot.
+ --load-snapshot FILE                 Loads the tables from a snapshot saved
+                                      with --save-snapshot instead of parsing
+                                      a trace file.
  --metric-extension DISK_PATH@VIRTUAL_PATH
                                       Loads metric proto and sql files from
                                       DISK_PATH/protos and DISK_PATH/sql
@@ -744,6 +761,10 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     OPT_METRIC_EXTENSION,
     OPT_DEV,
     OPT_NO_FTRACE_RAW,
+    OPT_SORTING_WINDOW_MS,
+    OPT_SORTING_WINDOW_MB,
+    OPT_SAVE_SNAPSHOT,
+    OPT_LOAD_SNAPSHOT,
   };
 
   static const option long_options[] = {
@@ -765,6 +786,10 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       {"metric-extension", required_argument, nullptr, OPT_METRIC_EXTENSION},
       {"dev", no_argument, nullptr, OPT_DEV},
       {"no-ftrace-raw", no_argument, nullptr, OPT_NO_FTRACE_RAW},
+      {"sorting-window-ms", required_argument, nullptr, OPT_SORTING_WINDOW_MS},
+      {"sorting-window-mb", required_argument, nullptr, OPT_SORTING_WINDOW_MB},
+      {"save-snapshot", required_argument, nullptr, OPT_SAVE_SNAPSHOT},
+      {"load-snapshot", required_argument, nullptr, OPT_LOAD_SNAPSHOT},
       {nullptr, 0, nullptr, 0}};
 
   bool explicit_interactive = false;
@@ -866,6 +891,38 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       continue;
     }
 
+    if (option == OPT_SORTING_WINDOW_MS || option == OPT_SORTING_WINDOW_MB) {
+      // The window is converted to nanoseconds (which must fit in an int64_t)
+      // or to bytes, so larger values would overflow.
+      uint64_t max_value =
+          option == OPT_SORTING_WINDOW_MS
+              ? static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) /
+                    (1000 * 1000)
+              : std::numeric_limits<uint64_t>::max() / (1024 * 1024);
+      base::Optional<uint64_t> value = base::CStringToUInt64(optarg);
+      if (!value || *value > max_value) {
+        PERFETTO_ELOG("Sorting window %s is invalid or above %" PRIu64, optarg,
+                      max_value);
+        exit(1);
+      }
+      if (option == OPT_SORTING_WINDOW_MS) {
+        command_line_options.sorting_window_ms = *value;
+      } else {
+        command_line_options.sorting_window_mb = *value;
+      }
+      continue;
+    }
+
+    if (option == OPT_SAVE_SNAPSHOT) {
+      command_line_options.save_snapshot_path = optarg;
+      continue;
+    }
+
+    if (option == OPT_LOAD_SNAPSHOT) {
+      command_line_options.load_snapshot_path = optarg;
+      continue;
+    }
+
     PrintUsage(argv);
     exit(option == 'h' ? 0 : 1);
   }
@@ -883,12 +940,14 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     exit(1);
   }
 
-  // The only case where we allow omitting the trace file path is when running
-  // in --http mode. In all other cases, the last argument must be the trace
-  // file.
-  if (optind == argc - 1 && argv[optind]) {
+  // The only cases where we allow omitting the trace file path are when running
+  // in --http mode or when loading a snapshot. In all other cases, the last
+  // argument must be the trace file.
+  bool has_snapshot = !command_line_options.load_snapshot_path.empty();
+  if (optind == argc - 1 && argv[optind] && !has_snapshot) {
     command_line_options.trace_file_path = argv[optind];
-  } else if (!command_line_options.enable_httpd) {
+  } else if (optind != argc ||
+             (!has_snapshot && !command_line_options.enable_httpd)) {
     PrintUsage(argv);
     exit(1);
   }
@@ -1299,6 +1358,9 @@ base::Status TraceProcessorMain(int argc, char** argv) {
                             ? SortingMode::kForceFullSort
                             : SortingMode::kDefaultHeuristics;
   config.ingest_ftrace_in_raw_table = !options.no_ftrace_raw;
+  config.sorting_window_ns =
+      static_cast<int64_t>(options.sorting_window_ms * 1000 * 1000);
+  config.sorting_window_bytes = options.sorting_window_mb * 1024 * 1024;
 
   std::vector<MetricExtension> metric_extensions;
   RETURN_IF_ERROR(ParseMetricExtensionPaths(
@@ -1335,6 +1397,17 @@ base::Status TraceProcessorMain(int argc, char** argv) {
                   t_load_s, size_mb / t_load_s);
 
     RETURN_IF_ERROR(PrintStats());
+  } else if (!options.load_snapshot_path.empty()) {
+    base::TimeNanos t_load_start = base::GetWallTimeNs();
+    RETURN_IF_ERROR(tp->LoadSnapshot(options.load_snapshot_path));
+    t_load = base::GetWallTimeNs() - t_load_start;
+    PERFETTO_ILOG("Snapshot loaded in %.2fs",
+                  static_cast<double>(t_load.count()) / 1E9);
+  }
+
+  if (!options.save_snapshot_path.empty()) {
+    RETURN_IF_ERROR(tp->SaveSnapshot(options.save_snapshot_path));
+    PERFETTO_ILOG("Snapshot saved to %s", options.save_snapshot_path.c_str());
   }
 
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_HTTPD)
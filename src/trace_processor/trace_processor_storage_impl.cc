@@ -132,6 +132,12 @@ void TraceProcessorStorageImpl::NotifyEndOfFile() {
     module->NotifyEndOfFile();
   }
   context_.args_tracker->Flush();
+
+  const ArgSetStorage& arg_sets = context_.storage->arg_sets();
+  context_.storage->SetStats(stats::arg_set_shapes, arg_sets.shape_count());
+  context_.storage->SetStats(
+      stats::args_memory_bytes,
+      static_cast<int64_t>(arg_sets.GetMemoryUsageBytes()));
 }
 
 }  // namespace trace_processor
@@ -36,6 +36,11 @@ class TraceProcessorStorageImpl : public TraceProcessorStorage {
   util::Status Parse(TraceBlobView) override;
   void NotifyEndOfFile() override;
 
+  // Blocks until the work writing to the storage in the background (if any)
+  // is done. Must be called before reading the storage through |context()|
+  // from outside of the trace processor (e.g. to export it).
+  virtual void WaitForBackgroundWork() {}
+
   TraceProcessorContext* context() { return &context_; }
 
  protected:
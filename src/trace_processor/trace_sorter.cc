@@ -15,6 +15,7 @@
  */
 
 #include <algorithm>
+#include <functional>
 #include <utility>
 
 #include "perfetto/ext/base/utils.h"
@@ -34,6 +35,107 @@ TraceSorter::TraceSorter(TraceProcessorContext* context,
   bypass_next_stage_for_testing_ = env && !strcmp(env, "1");
   if (bypass_next_stage_for_testing_)
     PERFETTO_ELOG("TEST MODE: bypassing protobuf parsing stage");
+
+  window_ns_ = std::max<int64_t>(context_->config.sorting_window_ns, 0);
+  window_bytes_ = context_->config.sorting_window_bytes;
+  is_windowed_ = window_ns_ > 0 || window_bytes_ > 0;
+}
+
+bool TraceSorter::AdmitWindowedEvent(int64_t ts, uint64_t size) {
+  // Events older than what has already been pushed to the parser cannot be
+  // sorted anymore. Dropping them (rather than parsing them out of order)
+  // keeps the output of the next stages consistent.
+  if (ts < latest_pushed_event_ts_) {
+    context_->storage->IncrementStats(stats::sorter_window_late_event_dropped);
+    return false;
+  }
+  buffered_bytes_ += size;
+  return true;
+}
+
+void TraceSorter::MaybeExtractForWindow() {
+  // When the window is exceeded, extract down to half of it rather than just
+  // below it: this amortizes the cost of an extraction (which has to look at
+  // all the queues) over many pushed events.
+  int64_t limit_ts = kNoTsLimit;
+  uint64_t target_bytes = kNoBytesTarget;
+  if (window_ns_ > 0 && global_max_ts_ - global_min_ts_ > window_ns_)
+    limit_ts = global_max_ts_ - window_ns_ / 2;
+  if (window_bytes_ > 0 && buffered_bytes_ > window_bytes_)
+    target_bytes = std::max<uint64_t>(window_bytes_ / 2, 1);
+  if (limit_ts == kNoTsLimit && target_bytes == kNoBytesTarget)
+    return;
+
+  context_->storage->IncrementStats(stats::sorter_window_extractions);
+  SortAndExtractEvents(/*limit_to_snapshot=*/false, limit_ts, target_bytes);
+}
+
+uint64_t TraceSorter::EstimateSize(const TimestampedTracePiece& ttp) {
+  switch (ttp.type) {
+    case Type::kInvalid:
+      break;
+    case Type::kFtraceEvent:
+      return EstimateSize(ttp.ftrace_event);
+    case Type::kTracePacket:
+      return EstimateSize(ttp.packet_data);
+    case Type::kInlineSchedSwitch:
+      return EstimateSize(ttp.sched_switch);
+    case Type::kInlineSchedWaking:
+      return EstimateSize(ttp.sched_waking);
+    case Type::kJsonValue:
+      return EstimateSize(ttp.json_value);
+    case Type::kFuchsiaRecord:
+      return EstimateSize(ttp.fuchsia_record);
+    case Type::kTrackEvent:
+      return EstimateSize(ttp.track_event_data);
+    case Type::kSystraceLine:
+      return EstimateSize(ttp.systrace_line);
+  }
+  PERFETTO_FATAL("Invalid event type");
+}
+
+TimestampedTracePiece TraceSorter::Queue::Evict(
+    const TimestampedEvent& event) {
+  const int64_t ts = event.ts;
+  const uint64_t slot = event.payload_slot;
+  switch (event.event_type()) {
+    case Type::kInvalid:
+      break;
+    case Type::kFtraceEvent:
+      return TimestampedTracePiece(
+          ts, std::get<PayloadPool<FtraceEventData>>(payloads_).Evict(slot));
+    case Type::kTracePacket:
+      return TimestampedTracePiece(
+          ts, std::get<PayloadPool<TracePacketData>>(payloads_).Evict(slot));
+    case Type::kInlineSchedSwitch:
+      return TimestampedTracePiece(
+          ts,
+          std::get<PayloadPool<InlineSchedSwitch>>(payloads_).Evict(slot));
+    case Type::kInlineSchedWaking:
+      return TimestampedTracePiece(
+          ts,
+          std::get<PayloadPool<InlineSchedWaking>>(payloads_).Evict(slot));
+    case Type::kJsonValue:
+      return TimestampedTracePiece(
+          ts, std::get<PayloadPool<std::string>>(payloads_).Evict(slot));
+    case Type::kFuchsiaRecord:
+      return TimestampedTracePiece(
+          ts, std::get<PayloadPool<std::unique_ptr<FuchsiaRecord>>>(payloads_)
+                  .Evict(slot));
+    case Type::kTrackEvent:
+      return TimestampedTracePiece(
+          ts, std::get<PayloadPool<TrackEventData>>(payloads_).Evict(slot));
+    case Type::kSystraceLine:
+      return TimestampedTracePiece(
+          ts, std::get<PayloadPool<std::unique_ptr<SystraceLine>>>(payloads_)
+                  .Evict(slot));
+  }
+  PERFETTO_FATAL("Invalid event type");
+}
+
+void TraceSorter::Queue::SnapshotExtractionLimit() {
+  for (TimestampedEvent& event : events_)
+    event.before_extraction_limit = true;
 }
 
 void TraceSorter::Queue::Sort() {
@@ -50,8 +152,29 @@ void TraceSorter::Queue::Sort() {
   auto sort_end = events_.begin() + static_cast<ssize_t>(sort_start_idx_);
   PERFETTO_DCHECK(std::is_sorted(events_.begin(), sort_end));
   auto sort_begin = std::lower_bound(events_.begin(), sort_end, sort_min_ts_,
-                                     &TimestampedTracePiece::Compare);
-  std::sort(sort_begin, events_.end());
+                                     &TimestampedEvent::Compare);
+
+  // Find the ascending runs in [sort_begin, end). As [sort_begin, sort_end) is
+  // sorted, the first run boundary can only be at sort_end or after it. Stop
+  // as soon as there are too many runs for merging them to beat a full sort:
+  // this bounds the cost of the scan for badly shuffled tails.
+  static constexpr size_t kMaxRunsToMerge = 32;
+  run_starts_.clear();
+  run_starts_.push_back(0);
+  for (auto it = sort_end; it != events_.end(); ++it) {
+    if (!(*it < *(it - 1)))
+      continue;
+    if (run_starts_.size() == kMaxRunsToMerge) {
+      run_starts_.clear();
+      break;
+    }
+    run_starts_.push_back(static_cast<size_t>(it - sort_begin));
+  }
+  if (run_starts_.empty()) {
+    std::stable_sort(sort_begin, events_.end());
+  } else {
+    MergeRuns(sort_begin, events_.end());
+  }
   sort_start_idx_ = 0;
   sort_min_ts_ = 0;
 
@@ -59,119 +182,154 @@ void TraceSorter::Queue::Sort() {
   PERFETTO_DCHECK(std::is_sorted(events_.begin(), events_.end()));
 }
 
+void TraceSorter::Queue::MergeRuns(
+    base::CircularQueue<TimestampedEvent>::Iterator begin,
+    base::CircularQueue<TimestampedEvent>::Iterator end) {
+  const size_t size = static_cast<size_t>(end - begin);
+  while (run_starts_.size() > 1) {
+    // Merge runs pairwise: (0, 1), (2, 3) and so on. An odd run out is left
+    // as-is for the next pass.
+    size_t num_runs = run_starts_.size();
+    size_t num_merged_runs = 0;
+    for (size_t i = 0; i < num_runs; i += 2) {
+      run_starts_[num_merged_runs++] = run_starts_[i];
+      if (i + 1 == num_runs)
+        break;
+
+      auto first = begin + static_cast<ssize_t>(run_starts_[i]);
+      auto mid = begin + static_cast<ssize_t>(run_starts_[i + 1]);
+      auto last =
+          begin + static_cast<ssize_t>(i + 2 < num_runs ? run_starts_[i + 2]
+                                                        : size);
+      PERFETTO_DCHECK(std::is_sorted(first, mid));
+      PERFETTO_DCHECK(std::is_sorted(mid, last));
+
+      // Move the left run out of the way and merge it with the right run
+      // back into [first, last). The write cursor never overtakes the read
+      // cursor on the right run, so the merge can happen in place.
+      merge_buffer_.clear();
+      for (auto it = first; it != mid; ++it)
+        merge_buffer_.emplace_back(std::move(*it));
+
+      auto left = merge_buffer_.begin();
+      auto right = mid;
+      auto out = first;
+      while (left != merge_buffer_.end() && right != last) {
+        if (*right < *left) {
+          *out = std::move(*right);
+          ++right;
+        } else {
+          *out = std::move(*left);
+          ++left;
+        }
+        ++out;
+      }
+      for (; left != merge_buffer_.end(); ++left, ++out)
+        *out = std::move(*left);
+    }
+    run_starts_.resize(num_merged_runs);
+  }
+  merge_buffer_.clear();
+}
+
 // Removes all the events in |queues_| that are earlier than the given
 // packet index and moves them to the next parser stages, respecting global
 // timestamp order. This function is a "extract min from N sorted queues", with
 // some little cleverness: we know that events tend to be bursty, so events are
 // not going to be randomly distributed on the N |queues_|.
-// Upon each iteration this function finds the first two queues (if any) that
-// have the oldest events, and extracts events from the 1st until hitting the
-// min_ts of the 2nd. Imagine the queues are as follows:
+// Upon each iteration this function takes the queue with the oldest event
+// from a min-heap and extracts events from it until hitting the oldest event
+// of the next queue in the heap (i.e. the min_ts of the 2nd queue). Imagine
+// the queues are as follows:
 //
 //  q0           {min_ts: 10  max_ts: 30}
 //  q1    {min_ts:5              max_ts: 35}
 //  q2              {min_ts: 12    max_ts: 40}
 //
 // We know that we can extract all events from q1 until we hit ts=10 without
-// looking at any other queue. After hitting ts=10, we need to re-look to all of
-// them to figure out the next min-event.
-// There are more suitable data structures to do this (e.g. keeping a min-heap
-// to avoid re-scanning all the queues all the times) but doesn't seem worth it.
-// With Android traces (that have 8 CPUs) this function accounts for ~1-3% cpu
-// time in a profiler.
-void TraceSorter::SortAndExtractEventsUntilPacket(uint64_t limit_packet_idx) {
+// looking at any other queue. After hitting ts=10, q1 is pushed back into the
+// heap (if not empty) keyed on its new oldest event and the process repeats.
+void TraceSorter::SortAndExtractEvents(bool limit_to_snapshot,
+                                       int64_t limit_ts,
+                                       uint64_t target_buffered_bytes) {
   constexpr int64_t kTsMax = std::numeric_limits<int64_t>::max();
-  for (;;) {
-    size_t min_queue_idx = 0;  // The index of the queue with the min(ts).
-
-    // The top-2 min(ts) among all queues.
-    // queues_[min_queue_idx].events.timestamp == min_queue_ts[0].
-    int64_t min_queue_ts[2]{kTsMax, kTsMax};
-
-    // This loop identifies the queue which starts with the earliest event and
-    // also remembers the earliest event of the 2nd queue (in min_queue_ts[1]).
-    bool has_queues_with_expired_events = false;
-    for (size_t i = 0; i < queues_.size(); i++) {
-      auto& queue = queues_[i];
-      if (queue.events_.empty())
-        continue;
-      PERFETTO_DCHECK(queue.min_ts_ >= global_min_ts_);
-      PERFETTO_DCHECK(queue.max_ts_ <= global_max_ts_);
-      if (queue.min_ts_ < min_queue_ts[0]) {
-        min_queue_ts[1] = min_queue_ts[0];
-        min_queue_ts[0] = queue.min_ts_;
-        min_queue_idx = i;
-        has_queues_with_expired_events = true;
-      } else if (queue.min_ts_ < min_queue_ts[1]) {
-        min_queue_ts[1] = queue.min_ts_;
-      }
-    }
-    if (!has_queues_with_expired_events) {
-      // All the queues have events that start after the window (i.e. they are
-      // too recent and not eligible to be extracted given the current window).
-      break;
-    }
+  const auto heap_cmp = std::greater<QueueHeapEntry>();
+
+  queue_heap_.clear();
+  for (size_t i = 0; i < queues_.size(); i++) {
+    const Queue& queue = queues_[i];
+    if (queue.events_.empty())
+      continue;
+    PERFETTO_DCHECK(queue.min_ts_ >= global_min_ts_);
+    PERFETTO_DCHECK(queue.max_ts_ <= global_max_ts_);
+    queue_heap_.push_back({queue.min_ts_, i});
+  }
+  std::make_heap(queue_heap_.begin(), queue_heap_.end(), heap_cmp);
+
+  while (!queue_heap_.empty()) {
+    std::pop_heap(queue_heap_.begin(), queue_heap_.end(), heap_cmp);
+    const size_t min_queue_idx = queue_heap_.back().queue_idx;
+    queue_heap_.pop_back();
+
+    // The oldest event across all the other queues, capped by |limit_ts|.
+    const int64_t next_queue_min_ts = std::min(
+        limit_ts, queue_heap_.empty() ? kTsMax : queue_heap_.front().min_ts);
 
     Queue& queue = queues_[min_queue_idx];
     auto& events = queue.events_;
     if (queue.needs_sorting())
       queue.Sort();
-    PERFETTO_DCHECK(queue.min_ts_ == events.front().timestamp);
-    PERFETTO_DCHECK(queue.min_ts_ == global_min_ts_);
+    PERFETTO_DCHECK(queue.min_ts_ == events.front().ts);
 
     // Now that we identified the min-queue, extract all events from it until
-    // we hit either: (1) the min-ts of the 2nd queue or (2) the packet index
-    // limit, whichever comes first.
+    // we hit either: (1) the min-ts of the 2nd queue, (2) the extraction limit
+    // snapshot or (3) the buffered bytes target, whichever comes first.
     size_t num_extracted = 0;
-    for (auto& event : events) {
-      if (event.packet_idx >= limit_packet_idx ||
-          event.timestamp > min_queue_ts[1]) {
+    for (const auto& event : events) {
+      if ((limit_to_snapshot && !queue.IsBeforeExtractionLimit(event)) ||
+          event.ts > next_queue_min_ts) {
+        break;
+      }
+      if (is_windowed_ && target_buffered_bytes != kNoBytesTarget &&
+          buffered_bytes_ <= target_buffered_bytes) {
         break;
       }
 
       ++num_extracted;
-      MaybePushEvent(min_queue_idx, std::move(event));
+      TimestampedTracePiece ttp = queue.Evict(event);
+      if (is_windowed_)
+        buffered_bytes_ -= EstimateSize(ttp);
+      MaybePushEvent(min_queue_idx, std::move(ttp));
     }  // for (event: events)
 
     if (!num_extracted) {
-      // No events can be extracted from any of the queues. This means that
-      // either we hit the window or all queues are empty.
+      // The oldest event across all queues is past one of the limits: we hit
+      // the window.
       break;
     }
 
     // Now remove the entries from the event buffer and update the queue-local
-    // and global time bounds.
+    // time bounds.
     events.erase_front(num_extracted);
-
-    // Update the global_{min,max}_ts to reflect the bounds after extraction.
     if (events.empty()) {
       queue.min_ts_ = kTsMax;
       queue.max_ts_ = 0;
-      global_min_ts_ = min_queue_ts[1];
-
-      // If we extraced the max entry from a queue (i.e. we emptied the queue)
-      // we need to recompute the global max, because it might have been the one
-      // just extracted.
-      global_max_ts_ = 0;
-      for (auto& q : queues_)
-        global_max_ts_ = std::max(global_max_ts_, q.max_ts_);
-    } else {
-      queue.min_ts_ = queue.events_.front().timestamp;
-      global_min_ts_ = std::min(queue.min_ts_, min_queue_ts[1]);
+      continue;
     }
-  }  // for(;;)
-
-#if PERFETTO_DCHECK_IS_ON()
-  // Check that the global min/max are consistent.
-  int64_t dbg_min_ts = kTsMax;
-  int64_t dbg_max_ts = 0;
-  for (auto& q : queues_) {
-    dbg_min_ts = std::min(dbg_min_ts, q.min_ts_);
-    dbg_max_ts = std::max(dbg_max_ts, q.max_ts_);
+    queue.min_ts_ = events.front().ts;
+    queue_heap_.push_back({queue.min_ts_, min_queue_idx});
+    std::push_heap(queue_heap_.begin(), queue_heap_.end(), heap_cmp);
+  }  // while (!queue_heap_.empty())
+
+  // Update the global_{min,max}_ts to reflect the bounds after extraction.
+  // This is done once here rather than after every extraction step as the
+  // max can only be recomputed by looking at all the queues.
+  global_min_ts_ = kTsMax;
+  global_max_ts_ = 0;
+  for (const auto& q : queues_) {
+    global_min_ts_ = std::min(global_min_ts_, q.min_ts_);
+    global_max_ts_ = std::max(global_max_ts_, q.max_ts_);
   }
-  PERFETTO_DCHECK(global_min_ts_ == dbg_min_ts);
-  PERFETTO_DCHECK(global_max_ts_ == dbg_max_ts);
-#endif
 }
 
 void TraceSorter::MaybePushEvent(size_t queue_idx, TimestampedTracePiece ttp) {
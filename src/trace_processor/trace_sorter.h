@@ -18,7 +18,10 @@
 #define SRC_TRACE_PROCESSOR_TRACE_SORTER_H_
 
 #include <algorithm>
+#include <limits>
 #include <memory>
+#include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -79,6 +82,36 @@ struct SystraceLine;
 // We use a logarithmic bound search operation to figure out what is the index
 // within the first partition where sorting should start, and sort all events
 // from there to the end.
+//
+// Event storage
+//
+// Queues do not store TimestampedTracePiece objects. Each event is split into
+// a 16 byte key (TimestampedEvent: timestamp, type and payload slot), which
+// is what gets sorted, and a payload which is stored in a per-type
+// PayloadPool of the queue and is only moved out when the event is
+// extracted. This keeps the sorted arrays dense and the sort itself cheap
+// (keys are trivially copyable) and avoids padding every event to the size
+// of the largest payload type. Sorting is stable, so events with the same
+// timestamp are extracted in the order they were pushed.
+//
+// The unsorted tail is rarely random: the non-ftrace queue receives packets
+// from many sequences, each of which is ordered and written in chunks, so the
+// tail is usually a handful of ascending runs. Sorting detects these runs and,
+// if there are few of them, merges them rather than doing a full sort.
+//
+// The global merge keeps the queues in a min-heap keyed on their oldest
+// timestamp, so that finding the next queue to extract from costs
+// O(log(num queues)) rather than a scan of all the queues. This matters for
+// traces with many CPUs (i.e. many ftrace queues).
+//
+// Windowed sorting
+//
+// Both the full sort and the flush-based heuristics above can end up keeping
+// most of the trace in memory until EOF. When a sorting window is configured
+// (by time span and/or by bytes buffered, see Config), events are extracted
+// eagerly as soon as the window is exceeded, bounding memory usage
+// regardless of the size of the trace. Events which arrive after the window
+// has moved past them are dropped and recorded in the stats.
 class TraceSorter {
  public:
   enum class SortingMode {
@@ -93,43 +126,35 @@ class TraceSorter {
   inline void PushTracePacket(int64_t timestamp,
                               PacketSequenceState* state,
                               TraceBlobView packet) {
-    AppendNonFtraceEvent(TimestampedTracePiece(timestamp, packet_idx_++,
-                                               std::move(packet),
-                                               state->current_generation()));
+    AppendNonFtraceEvent(timestamp,
+                         TracePacketData{std::move(packet),
+                                         state->current_generation()});
   }
 
   inline void PushJsonValue(int64_t timestamp, std::string json_value) {
-    AppendNonFtraceEvent(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(json_value)));
+    AppendNonFtraceEvent(timestamp, std::move(json_value));
   }
 
   inline void PushFuchsiaRecord(int64_t timestamp,
                                 std::unique_ptr<FuchsiaRecord> record) {
-    AppendNonFtraceEvent(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(record)));
+    AppendNonFtraceEvent(timestamp, std::move(record));
   }
 
   inline void PushSystraceLine(std::unique_ptr<SystraceLine> systrace_line) {
     int64_t timestamp = systrace_line->ts;
-    AppendNonFtraceEvent(TimestampedTracePiece(timestamp, packet_idx_++,
-                                               std::move(systrace_line)));
+    AppendNonFtraceEvent(timestamp, std::move(systrace_line));
   }
 
-  inline void PushTrackEventPacket(int64_t timestamp,
-                                   std::unique_ptr<TrackEventData> data) {
-    AppendNonFtraceEvent(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(data)));
+  inline void PushTrackEventPacket(int64_t timestamp, TrackEventData data) {
+    AppendNonFtraceEvent(timestamp, std::move(data));
   }
 
   inline void PushFtraceEvent(uint32_t cpu,
                               int64_t timestamp,
                               TraceBlobView event,
                               PacketSequenceState* state) {
-    auto* queue = GetQueue(cpu + 1);
-    queue->Append(TimestampedTracePiece(
-        timestamp, packet_idx_++,
-        FtraceEventData{std::move(event), state->current_generation()}));
-    UpdateGlobalTs(queue);
+    AppendEvent(cpu + 1, timestamp,
+                FtraceEventData{std::move(event), state->current_generation()});
   }
   inline void PushInlineFtraceEvent(uint32_t cpu,
                                     int64_t timestamp,
@@ -140,25 +165,21 @@ class TraceSorter {
     // of the batch. We can do better as both sub-sequences are sorted however.
     // Consider adding extra queues, or pushing them in a merge-sort fashion
     // instead.
-    auto* queue = GetQueue(cpu + 1);
-    queue->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, inline_sched_switch));
-    UpdateGlobalTs(queue);
+    AppendEvent(cpu + 1, timestamp, inline_sched_switch);
   }
   inline void PushInlineFtraceEvent(uint32_t cpu,
                                     int64_t timestamp,
                                     InlineSchedWaking inline_sched_waking) {
-    auto* queue = GetQueue(cpu + 1);
-    queue->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, inline_sched_waking));
-    UpdateGlobalTs(queue);
+    AppendEvent(cpu + 1, timestamp, inline_sched_waking);
   }
 
   void ExtractEventsForced() {
-    SortAndExtractEventsUntilPacket(packet_idx_);
+    SortAndExtractEvents(/*limit_to_snapshot=*/false, kNoTsLimit,
+                         kNoBytesTarget);
+    // Clearing the queues also resets their extraction limit snapshots: any
+    // event pushed from now on is past the limit.
     queues_.resize(0);
 
-    packet_idx_for_extraction_ = packet_idx_;
     flushes_since_extraction_ = 0;
   }
 
@@ -170,8 +191,10 @@ class TraceSorter {
       return;
     }
 
-    SortAndExtractEventsUntilPacket(packet_idx_for_extraction_);
-    packet_idx_for_extraction_ = packet_idx_;
+    SortAndExtractEvents(/*limit_to_snapshot=*/true, kNoTsLimit,
+                         kNoBytesTarget);
+    for (Queue& queue : queues_)
+      queue.SnapshotExtractionLimit();
     flushes_since_extraction_ = 0;
   }
 
@@ -179,11 +202,86 @@ class TraceSorter {
 
  private:
   static constexpr uint32_t kNoBatch = std::numeric_limits<uint32_t>::max();
+  static constexpr int64_t kNoTsLimit = std::numeric_limits<int64_t>::max();
+  static constexpr uint64_t kNoBytesTarget = 0;
+
+  using Type = TimestampedTracePiece::Type;
+  static constexpr size_t kNumTypes =
+      static_cast<size_t>(Type::kSystraceLine) + 1;
+
+  // The key of an event buffered in a Queue. The payload of the event lives
+  // in the PayloadPool for |type| of the same Queue, at |payload_slot|.
+  struct TimestampedEvent {
+    int64_t ts;
+    uint64_t payload_slot : 59;
+    // Set by Queue::SnapshotExtractionLimit() on the events which can be
+    // extracted by the next incremental extraction.
+    uint64_t before_extraction_limit : 1;
+    uint64_t type : 4;
+
+    Type event_type() const { return static_cast<Type>(type); }
+
+    // For std::lower_bound().
+    static inline bool Compare(const TimestampedEvent& x, int64_t ts) {
+      return x.ts < ts;
+    }
+
+    // Only the timestamps are compared: as all the sorting in TraceSorter is
+    // stable, events with the same timestamp keep their push order.
+    inline bool operator<(const TimestampedEvent& o) const {
+      return ts < o.ts;
+    }
+  };
+  static_assert(sizeof(TimestampedEvent) == 16,
+                "TimestampedEvent should be kept as small as possible");
+
+  // Buffers the payloads of one type of event of a Queue. Payloads are
+  // evicted in timestamp order, not in push order, so the slot of each
+  // evicted payload is reused right away by the next appended one: the pool
+  // only grows up to the number of payloads buffered at once.
+  template <typename T>
+  class PayloadPool {
+   public:
+    // Returns the slot of |value|, to be passed to Evict().
+    uint64_t Append(T value) {
+      if (free_slots_.empty()) {
+        PERFETTO_CHECK(slots_.size() < std::numeric_limits<uint32_t>::max());
+        slots_.emplace_back(std::move(value));
+        return slots_.size() - 1;
+      }
+      uint32_t slot = free_slots_.back();
+      free_slots_.pop_back();
+      slots_[slot] = std::move(value);
+      return slot;
+    }
+
+    T Evict(uint64_t slot) {
+      PERFETTO_DCHECK(slot < slots_.size());
+      T value = std::move(slots_[static_cast<size_t>(slot)]);
+      free_slots_.push_back(static_cast<uint32_t>(slot));
+      return value;
+    }
+
+   private:
+    std::vector<T> slots_;
+    std::vector<uint32_t> free_slots_;
+  };
 
   struct Queue {
-    inline void Append(TimestampedTracePiece ttp) {
-      const int64_t timestamp = ttp.timestamp;
-      events_.emplace_back(std::move(ttp));
+    template <typename T>
+    inline void Append(int64_t ts, T payload) {
+      TimestampedEvent event;
+      event.ts = ts;
+      event.type = static_cast<uint64_t>(TypeOf(payload));
+      event.payload_slot =
+          std::get<PayloadPool<T>>(payloads_).Append(std::move(payload));
+      event.before_extraction_limit = false;
+      AppendKey(event);
+    }
+
+    inline void AppendKey(TimestampedEvent event) {
+      const int64_t timestamp = event.ts;
+      events_.emplace_back(event);
       min_ts_ = std::min(min_ts_, timestamp);
 
       // Events are often seen in order.
@@ -207,17 +305,115 @@ class TraceSorter {
       PERFETTO_DCHECK(min_ts_ <= max_ts_);
     }
 
+    // Moves the payload of |event| out of its PayloadPool.
+    TimestampedTracePiece Evict(const TimestampedEvent& event);
+
+    // Records the events currently in the queue as the ones which can be
+    // extracted by the next incremental extraction.
+    void SnapshotExtractionLimit();
+
+    static inline bool IsBeforeExtractionLimit(const TimestampedEvent& event) {
+      return event.before_extraction_limit;
+    }
+
     bool needs_sorting() const { return sort_start_idx_ != 0; }
     void Sort();
 
-    base::CircularQueue<TimestampedTracePiece> events_;
+    // Sorts [begin, end), which is made of the ascending runs starting at the
+    // offsets (from |begin|) in |run_starts_|, by merging adjacent pairs of
+    // runs until a single run is left.
+    void MergeRuns(base::CircularQueue<TimestampedEvent>::Iterator begin,
+                   base::CircularQueue<TimestampedEvent>::Iterator end);
+
+    base::CircularQueue<TimestampedEvent> events_;
     int64_t min_ts_ = std::numeric_limits<int64_t>::max();
     int64_t max_ts_ = 0;
     size_t sort_start_idx_ = 0;
     int64_t sort_min_ts_ = std::numeric_limits<int64_t>::max();
+
+    std::tuple<PayloadPool<FtraceEventData>,
+               PayloadPool<TracePacketData>,
+               PayloadPool<InlineSchedSwitch>,
+               PayloadPool<InlineSchedWaking>,
+               PayloadPool<std::string>,
+               PayloadPool<std::unique_ptr<FuchsiaRecord>>,
+               PayloadPool<TrackEventData>,
+               PayloadPool<std::unique_ptr<SystraceLine>>>
+        payloads_;
+
+    // Scratch space used by Sort() and MergeRuns(). Kept around to avoid
+    // reallocating it on every sort.
+    std::vector<size_t> run_starts_;
+    std::vector<TimestampedEvent> merge_buffer_;
   };
 
-  void SortAndExtractEventsUntilPacket(uint64_t limit_packet_idx);
+  static constexpr Type TypeOf(const FtraceEventData&) {
+    return Type::kFtraceEvent;
+  }
+  static constexpr Type TypeOf(const TracePacketData&) {
+    return Type::kTracePacket;
+  }
+  static constexpr Type TypeOf(const InlineSchedSwitch&) {
+    return Type::kInlineSchedSwitch;
+  }
+  static constexpr Type TypeOf(const InlineSchedWaking&) {
+    return Type::kInlineSchedWaking;
+  }
+  static constexpr Type TypeOf(const std::string&) { return Type::kJsonValue; }
+  static constexpr Type TypeOf(const std::unique_ptr<FuchsiaRecord>&) {
+    return Type::kFuchsiaRecord;
+  }
+  static constexpr Type TypeOf(const TrackEventData&) {
+    return Type::kTrackEvent;
+  }
+  static constexpr Type TypeOf(const std::unique_ptr<SystraceLine>&) {
+    return Type::kSystraceLine;
+  }
+
+  // Rough estimate of the memory held by an event while it sits in the
+  // sorter, including the part of the trace it references. Slices of a
+  // larger blob are counted by their own length only.
+  template <typename T>
+  static uint64_t EstimateSize(const T& payload) {
+    return sizeof(TimestampedEvent) + sizeof(T) + ReferencedSize(payload);
+  }
+  static uint64_t EstimateSize(const TimestampedTracePiece&);
+
+  static uint64_t ReferencedSize(const FtraceEventData& d) {
+    return d.event.length();
+  }
+  static uint64_t ReferencedSize(const TracePacketData& d) {
+    return d.packet.length();
+  }
+  static uint64_t ReferencedSize(const InlineSchedSwitch&) { return 0; }
+  static uint64_t ReferencedSize(const InlineSchedWaking&) { return 0; }
+  static uint64_t ReferencedSize(const std::string& s) { return s.size(); }
+  static uint64_t ReferencedSize(const std::unique_ptr<FuchsiaRecord>& r) {
+    return sizeof(FuchsiaRecord) + r->record_view()->length();
+  }
+  static uint64_t ReferencedSize(const std::unique_ptr<SystraceLine>&) {
+    return sizeof(SystraceLine);
+  }
+
+  // An entry of |queue_heap_|. Ties on the timestamp are broken by the index
+  // of the queue to keep the extraction order deterministic.
+  struct QueueHeapEntry {
+    int64_t min_ts;
+    size_t queue_idx;
+
+    bool operator>(const QueueHeapEntry& o) const {
+      return std::tie(min_ts, queue_idx) > std::tie(o.min_ts, o.queue_idx);
+    }
+  };
+
+  // Extracts events in timestamp order until reaching an event with timestamp
+  // > |limit_ts| or, if |limit_to_snapshot| is true, an event pushed after the
+  // last Queue::SnapshotExtractionLimit(). Also stops once the estimated size
+  // of the buffered events drops to |target_buffered_bytes| (if not
+  // kNoBytesTarget).
+  void SortAndExtractEvents(bool limit_to_snapshot,
+                            int64_t limit_ts,
+                            uint64_t target_buffered_bytes);
 
   inline Queue* GetQueue(size_t index) {
     if (PERFETTO_UNLIKELY(index >= queues_.size()))
@@ -225,12 +421,33 @@ class TraceSorter {
     return &queues_[index];
   }
 
-  inline void AppendNonFtraceEvent(TimestampedTracePiece ttp) {
-    Queue* queue = GetQueue(0);
-    queue->Append(std::move(ttp));
+  template <typename T>
+  inline void AppendNonFtraceEvent(int64_t ts, T payload) {
+    AppendEvent(0, ts, std::move(payload));
+  }
+
+  template <typename T>
+  inline void AppendEvent(size_t queue_idx, int64_t ts, T payload) {
+    if (PERFETTO_UNLIKELY(is_windowed_) &&
+        !AdmitWindowedEvent(ts, EstimateSize(payload))) {
+      return;
+    }
+    Queue* queue = GetQueue(queue_idx);
+    queue->Append(ts, std::move(payload));
     UpdateGlobalTs(queue);
+    if (PERFETTO_UNLIKELY(is_windowed_))
+      MaybeExtractForWindow();
   }
 
+  // When a sorting window is configured: returns false (dropping the event)
+  // if an event at |ts| is too late to be sorted, otherwise accounts for its
+  // |size| in |buffered_bytes_|.
+  bool AdmitWindowedEvent(int64_t ts, uint64_t size);
+
+  // When a sorting window is configured: extracts events eagerly if the
+  // window has been exceeded.
+  void MaybeExtractForWindow();
+
   inline void UpdateGlobalTs(Queue* queue) {
     global_min_ts_ = std::min(global_min_ts_, queue->min_ts_);
     global_max_ts_ = std::max(global_max_ts_, queue->max_ts_);
@@ -246,9 +463,15 @@ class TraceSorter {
   // forced extractionn at the end of the trace.
   SortingMode sorting_mode_ = SortingMode::kDefault;
 
-  // The packet index until which events should be extracted. Set based
-  // on the packet index in |OnReadBuffer|.
-  uint64_t packet_idx_for_extraction_ = 0;
+  // The sorting window (see |Config::sorting_window_ns| and
+  // |Config::sorting_window_bytes|). Zero means no limit.
+  int64_t window_ns_ = 0;
+  uint64_t window_bytes_ = 0;
+  bool is_windowed_ = false;
+
+  // Estimated size of the events currently held in |queues_|. Only tracked
+  // when |is_windowed_| is true.
+  uint64_t buffered_bytes_ = 0;
 
   // The number of flushes which have happened since the last incremental
   // extraction.
@@ -259,15 +482,17 @@ class TraceSorter {
   // queues_[x] is the ftrace queue for CPU(x - 1).
   std::vector<Queue> queues_;
 
+  // Min-heap of the non-empty queues, ordered by their oldest timestamp. Only
+  // valid during SortAndExtractEventsUntilPacket(); kept as a member to avoid
+  // reallocating it on every extraction.
+  std::vector<QueueHeapEntry> queue_heap_;
+
   // max(e.timestamp for e in queues_).
   int64_t global_max_ts_ = 0;
 
   // min(e.timestamp for e in queues_).
   int64_t global_min_ts_ = std::numeric_limits<int64_t>::max();
 
-  // Monotonic increasing value used to index timestamped trace pieces.
-  uint64_t packet_idx_ = 0;
-
   // Used for performance tests. True when setting TRACE_PROCESSOR_SORT_ONLY=1.
   bool bypass_next_stage_for_testing_ = false;
 
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/trace_processor/trace_blob.h"
+#include "perfetto/trace_processor/trace_blob_view.h"
+#include "src/trace_processor/importers/common/trace_parser.h"
+#include "src/trace_processor/importers/proto/packet_sequence_state.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/trace_sorter.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr uint32_t kRandomSeed = 476;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Args: {num cpus, num sequences writing to the non-ftrace queue}.
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Args({8, 4});
+  } else {
+    for (int64_t cpus : {8, 32, 128}) {
+      for (int64_t seqs : {1, 4, 32})
+        b->Args({cpus, seqs});
+    }
+  }
+  b->ArgNames({"cpus", "seqs"});
+}
+
+// Drops all the events on the floor so that the benchmark only measures the
+// cost of sorting and extraction.
+class NullTraceParser : public TraceParser {
+ public:
+  void ParseTracePacket(int64_t, TimestampedTracePiece ttp) override {
+    benchmark::DoNotOptimize(ttp.timestamp);
+  }
+  void ParseFtracePacket(uint32_t,
+                         int64_t,
+                         TimestampedTracePiece ttp) override {
+    benchmark::DoNotOptimize(ttp.timestamp);
+  }
+};
+
+struct Event {
+  int64_t ts;
+  uint32_t cpu;  // Only meaningful for ftrace events.
+  bool is_ftrace;
+};
+
+// Generates a stream of events resembling a system trace: ftrace events are
+// sorted within each CPU and arrive in per-CPU bundles; track event packets
+// are sorted within each sequence and arrive in per-sequence chunks which
+// overlap in time with each other.
+std::vector<Event> GenerateEvents(uint32_t num_cpus, uint32_t num_seqs) {
+  static constexpr size_t kNumEvents = 1024 * 1024;
+  static constexpr size_t kBundleSize = 64;
+  std::minstd_rand0 rnd(kRandomSeed);
+
+  std::vector<int64_t> cpu_ts(num_cpus, 0);
+  std::vector<int64_t> seq_ts(num_seqs, 0);
+  std::vector<Event> events;
+  events.reserve(kNumEvents);
+  while (events.size() < kNumEvents) {
+    bool is_ftrace = rnd() % 4 != 0;
+    uint32_t bucket = is_ftrace ? rnd() % num_cpus : rnd() % num_seqs;
+    int64_t* ts = is_ftrace ? &cpu_ts[bucket] : &seq_ts[bucket];
+    for (size_t i = 0; i < kBundleSize; i++) {
+      *ts += rnd() % 1000;
+      events.push_back(Event{*ts, bucket, is_ftrace});
+    }
+  }
+  return events;
+}
+
+}  // namespace
+
+static void BM_TraceSorterPushAndExtract(benchmark::State& state) {
+  const uint32_t num_cpus = static_cast<uint32_t>(state.range(0));
+  const uint32_t num_seqs = static_cast<uint32_t>(state.range(1));
+  std::vector<Event> events = GenerateEvents(num_cpus, num_seqs);
+  TraceBlobView blob(TraceBlob::Allocate(8));
+
+  for (auto _ : state) {
+    TraceProcessorContext context;
+    context.storage.reset(new TraceStorage());
+    PacketSequenceState seq_state(&context);
+    TraceSorter sorter(&context,
+                       std::unique_ptr<TraceParser>(new NullTraceParser()),
+                       TraceSorter::SortingMode::kFullSort);
+    for (const Event& e : events) {
+      if (e.is_ftrace) {
+        sorter.PushFtraceEvent(e.cpu, e.ts, blob.slice_off(0, 1), &seq_state);
+      } else {
+        sorter.PushTracePacket(e.ts, &seq_state, blob.slice_off(0, 1));
+      }
+    }
+    sorter.ExtractEventsForced();
+  }
+  state.counters["events/s"] = benchmark::Counter(
+      static_cast<double>(events.size()),
+      benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_TraceSorterPushAndExtract)->Apply(BenchmarkArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -15,6 +15,7 @@
  */
 #include "src/trace_processor/importers/proto/proto_trace_parser.h"
 
+#include <algorithm>
 #include <map>
 #include <random>
 #include <vector>
@@ -195,6 +196,56 @@ TEST_F(TraceSorterTest, IncrementalExtraction) {
   context_.sorter->ExtractEventsForced();
 }
 
+// A long-lived out-of-order event must not prevent the payload slots of the
+// events extracted after it from being reused.
+TEST_F(TraceSorterTest, IncrementalExtractionReusesPayloadSlots) {
+  CreateSorter(false);
+
+  PacketSequenceState state(&context_);
+  auto push = [&](int64_t ts, size_t len) {
+    context_.sorter->PushTracePacket(ts, &state,
+                                     test_buffer_.slice_off(0, len));
+  };
+  auto extract_up_to_snapshot = [&] {
+    context_.sorter->NotifyFlushEvent();
+    context_.sorter->NotifyFlushEvent();
+    context_.sorter->NotifyReadBufferEvent();
+  };
+
+  push(1000000, 8);
+  push(100, 1);
+  push(200, 2);
+  extract_up_to_snapshot();
+
+  push(300, 3);
+  push(400, 4);
+  {
+    InSequence s;
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(100, test_buffer_.data(), 1));
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(200, test_buffer_.data(), 2));
+  }
+  extract_up_to_snapshot();
+
+  // These reuse the slots of the two events extracted above.
+  push(500, 5);
+  push(600, 6);
+  {
+    InSequence s;
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(300, test_buffer_.data(), 3));
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(400, test_buffer_.data(), 4));
+  }
+  extract_up_to_snapshot();
+
+  {
+    InSequence s;
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(500, test_buffer_.data(), 5));
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(600, test_buffer_.data(), 6));
+    EXPECT_CALL(*parser_,
+                MOCK_ParseTracePacket(1000000, test_buffer_.data(), 8));
+  }
+  context_.sorter->ExtractEventsForced();
+}
+
 // Simulate a producer bug where the third packet is emitted
 // out of order. Verify that we track the stats correctly.
 TEST_F(TraceSorterTest, OutOfOrder) {
@@ -296,6 +347,107 @@ TEST_F(TraceSorterTest, MultiQueueSorting) {
   EXPECT_TRUE(expectations.empty());
 }
 
+// Simulates packets from several sequences being written into the non-ftrace
+// queue in per-sequence chunks: each chunk is sorted but chunks from different
+// sequences overlap in time. Tests that both the few-runs case (which merges
+// the runs) and the many-runs case (which falls back on a full sort) extract
+// packets in timestamp order.
+TEST_F(TraceSorterTest, InterleavedSortedRuns) {
+  // {num sequences, num chunks}: fewer chunks than TraceSorter's merge
+  // threshold for the first case, many more for the second.
+  for (auto params : {std::make_pair(3u, 20), std::make_pair(100u, 200)}) {
+    const uint32_t num_sequences = params.first;
+    const int num_chunks = params.second;
+    CreateSorter();
+    PacketSequenceState state(&context_);
+    std::minstd_rand0 rnd_engine(0);
+
+    std::vector<int64_t> expected;
+    std::vector<int64_t> last_ts(num_sequences, 0);
+    for (int chunk = 0; chunk < num_chunks; chunk++) {
+      uint32_t seq = rnd_engine() % num_sequences;
+      for (int i = 0; i < 50; i++) {
+        last_ts[seq] += static_cast<int64_t>(rnd_engine() % 100);
+        expected.push_back(last_ts[seq]);
+        context_.sorter->PushTracePacket(last_ts[seq], &state,
+                                         test_buffer_.slice_off(0, 1));
+      }
+    }
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<int64_t> extracted;
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(_, _, _))
+        .WillRepeatedly(Invoke([&extracted](int64_t ts, const uint8_t*,
+                                            size_t) {
+          extracted.push_back(ts);
+        }));
+    context_.sorter->ExtractEventsForced();
+    EXPECT_EQ(extracted, expected);
+  }
+}
+
+TEST_F(TraceSorterTest, WindowedByTime) {
+  context_.config.sorting_window_ns = 100;
+  CreateSorter();
+  PacketSequenceState state(&context_);
+
+  std::vector<int64_t> extracted;
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(_, _, _))
+      .WillRepeatedly(Invoke([&extracted](int64_t ts, const uint8_t*, size_t) {
+        extracted.push_back(ts);
+      }));
+
+  // Events spanning much more than the window are extracted eagerly and the
+  // ones still buffered never span more than the window.
+  for (int64_t ts = 1000; ts <= 2000; ts += 10) {
+    context_.sorter->PushTracePacket(ts, &state, test_buffer_.slice_off(0, 1));
+    if (!extracted.empty()) {
+      ASSERT_LE(ts - extracted.back(), 100 + 10);
+    }
+  }
+  ASSERT_FALSE(extracted.empty());
+  ASSERT_LT(extracted.back(), 2000 - 100 / 2);
+
+  // Reordering within the window is still fine...
+  context_.sorter->PushTracePacket(1995, &state, test_buffer_.slice_off(0, 1));
+
+  // ... but events behind the window are dropped.
+  context_.sorter->PushTracePacket(1005, &state, test_buffer_.slice_off(0, 1));
+  ASSERT_EQ(storage_->stats()[stats::sorter_window_late_event_dropped].value,
+            1);
+
+  context_.sorter->ExtractEventsForced();
+  ASSERT_TRUE(std::is_sorted(extracted.begin(), extracted.end()));
+  ASSERT_EQ(extracted.size(), 102u);
+  ASSERT_EQ(storage_->stats()[stats::sorter_push_event_out_of_order].value,
+            0);
+}
+
+TEST_F(TraceSorterTest, WindowedByBytes) {
+  // Every event takes at least 10 bytes of bookkeeping, so at most 100 events
+  // fit in the window.
+  context_.config.sorting_window_bytes = 1000;
+  CreateSorter();
+  PacketSequenceState state(&context_);
+
+  size_t num_extracted = 0;
+  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(_, _, _, _))
+      .WillRepeatedly(
+          Invoke([&num_extracted](uint32_t, int64_t, const uint8_t*, size_t) {
+            num_extracted++;
+          }));
+
+  for (int i = 0; i < 1000; i++) {
+    context_.sorter->PushFtraceEvent(static_cast<uint32_t>(i % 4), 1000 + i,
+                                     test_buffer_.slice_off(0, 1), &state);
+    ASSERT_LE(static_cast<size_t>(i + 1) - num_extracted, 100u);
+  }
+  ASSERT_GT(storage_->stats()[stats::sorter_window_extractions].value, 0);
+
+  context_.sorter->ExtractEventsForced();
+  ASSERT_EQ(num_extracted, 1000u);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -49,6 +49,7 @@ class FlowTracker;
 class TraceParser;
 class TraceSorter;
 class TraceStorage;
+class TrackEventModule;
 class TrackTracker;
 class DescriptorPool;
 
@@ -96,6 +97,7 @@ class TraceProcessorContext {
   std::unique_ptr<Destructible> systrace_parser;         // SystraceParser
   std::unique_ptr<Destructible> heap_graph_tracker;      // HeapGraphTracker
   std::unique_ptr<Destructible> system_info_tracker;     // SystemInfoTracker
+  std::unique_ptr<Destructible> slice_nesting_index;     // SliceNestingIndex
 
   // These fields are trace readers which will be called by |forwarding_parser|
   // once the format of the trace is discovered. They are placed here as they
@@ -120,6 +122,7 @@ class TraceProcessorContext {
   std::vector<std::vector<ProtoImporterModule*>> modules_by_field;
   std::vector<std::unique_ptr<ProtoImporterModule>> modules;
   FtraceModule* ftrace_module = nullptr;
+  TrackEventModule* track_module = nullptr;
 
   // Marks whether the uuid was read from the trace.
   // If the uuid was NOT read, the uuid will be made from the hash of the first
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/util/bounded_queue.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace util {
+namespace {
+
+TEST(BoundedQueueTest, PushPopSingleThread) {
+  BoundedQueue<int> queue(4);
+  ASSERT_TRUE(queue.Push(1));
+  ASSERT_TRUE(queue.Push(2));
+  ASSERT_TRUE(queue.Push(3));
+
+  int value = 0;
+  ASSERT_TRUE(queue.Pop(&value));
+  ASSERT_EQ(value, 1);
+  ASSERT_TRUE(queue.Pop(&value));
+  ASSERT_EQ(value, 2);
+  ASSERT_TRUE(queue.Pop(&value));
+  ASSERT_EQ(value, 3);
+}
+
+TEST(BoundedQueueTest, MoveOnly) {
+  BoundedQueue<std::unique_ptr<int>> queue(1);
+  ASSERT_TRUE(queue.Push(std::unique_ptr<int>(new int(42))));
+
+  std::unique_ptr<int> value;
+  ASSERT_TRUE(queue.Pop(&value));
+  ASSERT_EQ(*value, 42);
+}
+
+TEST(BoundedQueueTest, CloseDrainsRemaining) {
+  BoundedQueue<int> queue(4);
+  ASSERT_TRUE(queue.Push(1));
+  ASSERT_TRUE(queue.Push(2));
+  queue.Close();
+  ASSERT_FALSE(queue.Push(3));
+
+  int value = 0;
+  ASSERT_TRUE(queue.Pop(&value));
+  ASSERT_EQ(value, 1);
+  ASSERT_TRUE(queue.Pop(&value));
+  ASSERT_EQ(value, 2);
+  ASSERT_FALSE(queue.Pop(&value));
+}
+
+TEST(BoundedQueueTest, TryPop) {
+  BoundedQueue<int> queue(2);
+  int value = 0;
+  ASSERT_FALSE(queue.TryPop(&value));
+  ASSERT_TRUE(queue.Push(1));
+  ASSERT_TRUE(queue.Push(2));
+  ASSERT_TRUE(queue.TryPop(&value));
+  ASSERT_EQ(value, 1);
+
+  // Popping makes room for another element.
+  ASSERT_TRUE(queue.Push(3));
+  ASSERT_TRUE(queue.TryPop(&value));
+  ASSERT_EQ(value, 2);
+  ASSERT_TRUE(queue.TryPop(&value));
+  ASSERT_EQ(value, 3);
+  ASSERT_FALSE(queue.TryPop(&value));
+}
+
+TEST(BoundedQueueTest, ProducerConsumer) {
+  static constexpr int kNumValues = 10000;
+  BoundedQueue<int> queue(3);
+  std::thread producer([&queue] {
+    for (int i = 0; i < kNumValues; i++)
+      ASSERT_TRUE(queue.Push(i));
+    queue.Close();
+  });
+
+  std::vector<int> values;
+  int value = 0;
+  while (queue.Pop(&value))
+    values.push_back(value);
+  producer.join();
+
+  ASSERT_EQ(values.size(), static_cast<size_t>(kNumValues));
+  for (int i = 0; i < kNumValues; i++)
+    ASSERT_EQ(values[static_cast<size_t>(i)], i);
+}
+
+TEST(BoundedQueueTest, CloseUnblocksProducer) {
+  BoundedQueue<int> queue(1);
+  ASSERT_TRUE(queue.Push(1));
+
+  bool push_result = true;
+  std::thread producer([&queue, &push_result] {
+    // Blocks as the queue is full until Close() is called below.
+    push_result = queue.Push(2);
+  });
+  queue.Close();
+  producer.join();
+  ASSERT_FALSE(push_result);
+}
+
+}  // namespace
+}  // namespace util
+}  // namespace trace_processor
+}  // namespace perfetto
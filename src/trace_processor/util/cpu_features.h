@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_UTIL_CPU_FEATURES_H_
+#define SRC_TRACE_PROCESSOR_UTIL_CPU_FEATURES_H_
+
+#include "perfetto/base/build_config.h"
+
+// Runtime dispatch of the AVX2 kernels (see db/compare_kernels.h and
+// importers/json/json_scanner.h). The kernels are compiled for AVX2 with the
+// target attribute, independently of the flags of the rest of the build, and
+// are only called if HasAvx2() is true. Otherwise, callers fall back to the
+// SSE4.2 kernels (when building with enable_perfetto_x64_cpu_opt, which does
+// not guarantee AVX2) or to the portable ones.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && \
+    !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#define PERFETTO_TP_AVX2_DISPATCH() 1
+#define PERFETTO_TP_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define PERFETTO_TP_AVX2_DISPATCH() 0
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace util {
+
+#if PERFETTO_TP_AVX2_DISPATCH()
+// Returns whether the CPU (and the OS) support AVX2.
+inline bool HasAvx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+#else
+inline bool HasAvx2() {
+  return false;
+}
+#endif
+
+}  // namespace util
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_UTIL_CPU_FEATURES_H_
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/util/glob.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace perfetto {
+namespace trace_processor {
+namespace util {
+
+namespace {
+
+// The implementation below follows patternCompare() in SQLite's func.c so
+// that the results are exactly the same as SQLite's, including for invalid
+// UTF-8 and malformed patterns.
+
+enum MatchResult {
+  kMatch,
+  kNoMatch,
+  // A "*" or "%" was not able to match the rest of the string: no other way
+  // of matching the pattern can succeed so there's no need to backtrack.
+  kNoWildcardMatch,
+};
+
+struct PatternInfo {
+  uint32_t match_all;
+  uint32_t match_one;
+  // The character starting a set of characters or 0 if sets are not
+  // supported.
+  uint32_t match_set;
+  bool no_case;
+};
+
+constexpr PatternInfo kGlobInfo{'*', '?', '[', false};
+constexpr PatternInfo kLikeInfo{'%', '_', 0, true};
+
+// Reads a UTF-8 character the same way as sqlite3Utf8Read().
+uint32_t Utf8Read(const uint8_t** ptr) {
+  uint32_t c = *((*ptr)++);
+  if (c < 0xc0)
+    return c;
+
+  if (c < 0xe0) {
+    c -= 0xc0;
+  } else if (c < 0xf0) {
+    c -= 0xe0;
+  } else if (c < 0xf8) {
+    c -= 0xf0;
+  } else if (c < 0xfc) {
+    c -= 0xf8;
+  } else if (c < 0xfe) {
+    c -= 0xfc;
+  } else {
+    c = 0;
+  }
+  while ((**ptr & 0xc0) == 0x80)
+    c = (c << 6) + (0x3f & *((*ptr)++));
+  if (c < 0x80 || (c & 0xFFFFF800) == 0xD800 || (c & 0xFFFFFFFE) == 0xFFFE)
+    c = 0xFFFD;
+  return c;
+}
+
+void SkipUtf8(const uint8_t** ptr) {
+  if (*((*ptr)++) >= 0xc0) {
+    while ((**ptr & 0xc0) == 0x80)
+      (*ptr)++;
+  }
+}
+
+uint32_t ToLower(uint32_t c) {
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+uint32_t ToUpper(uint32_t c) {
+  return c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c;
+}
+
+MatchResult PatternCompare(const uint8_t* pattern,
+                           const uint8_t* str,
+                           const PatternInfo& info) {
+  uint32_t c;
+  uint32_t c2;
+  while ((c = Utf8Read(&pattern)) != 0) {
+    if (c == info.match_all) {
+      // Skip over multiple "*" characters in the pattern. If there are also
+      // "?" characters, skip those as well, but consume a single character of
+      // the string for each "?" skipped.
+      while ((c = Utf8Read(&pattern)) == info.match_all ||
+             c == info.match_one) {
+        if (c == info.match_one && Utf8Read(&str) == 0)
+          return kNoWildcardMatch;
+      }
+      if (c == 0)
+        return kMatch;
+
+      if (c == info.match_set && info.match_set != 0) {
+        // "[...]" immediately follows the "*": try to match at every position
+        // of the string.
+        while (*str) {
+          MatchResult res = PatternCompare(pattern - 1, str, info);
+          if (res != kNoMatch)
+            return res;
+          SkipUtf8(&str);
+        }
+        return kNoWildcardMatch;
+      }
+
+      // |c| is the first character of the pattern after the "*": look for it
+      // in the string and recursively try to match the rest from there.
+      if (c < 0x80) {
+        char stop[3];
+        if (info.no_case) {
+          stop[0] = static_cast<char>(ToUpper(c));
+          stop[1] = static_cast<char>(ToLower(c));
+          stop[2] = 0;
+        } else {
+          stop[0] = static_cast<char>(c);
+          stop[1] = 0;
+        }
+        for (;;) {
+          str += strcspn(reinterpret_cast<const char*>(str), stop);
+          if (str[0] == 0)
+            break;
+          str++;
+          MatchResult res = PatternCompare(pattern, str, info);
+          if (res != kNoMatch)
+            return res;
+        }
+      } else {
+        while ((c2 = Utf8Read(&str)) != 0) {
+          if (c2 != c)
+            continue;
+          MatchResult res = PatternCompare(pattern, str, info);
+          if (res != kNoMatch)
+            return res;
+        }
+      }
+      return kNoWildcardMatch;
+    }
+
+    if (c == info.match_set && info.match_set != 0) {
+      uint32_t prior_c = 0;
+      bool seen = false;
+      bool invert = false;
+      c = Utf8Read(&str);
+      if (c == 0)
+        return kNoMatch;
+      c2 = Utf8Read(&pattern);
+      if (c2 == '^') {
+        invert = true;
+        c2 = Utf8Read(&pattern);
+      }
+      if (c2 == ']') {
+        if (c == ']')
+          seen = true;
+        c2 = Utf8Read(&pattern);
+      }
+      while (c2 && c2 != ']') {
+        if (c2 == '-' && pattern[0] != ']' && pattern[0] != 0 && prior_c > 0) {
+          c2 = Utf8Read(&pattern);
+          if (c >= prior_c && c <= c2)
+            seen = true;
+          prior_c = 0;
+        } else {
+          if (c == c2)
+            seen = true;
+          prior_c = c2;
+        }
+        c2 = Utf8Read(&pattern);
+      }
+      if (c2 == 0 || seen == invert)
+        return kNoMatch;
+      continue;
+    }
+
+    c2 = Utf8Read(&str);
+    if (c == c2)
+      continue;
+    if (info.no_case && c < 0x80 && c2 < 0x80 && ToLower(c) == ToLower(c2))
+      continue;
+    if (c == info.match_one && c2 != 0)
+      continue;
+    return kNoMatch;
+  }
+  return *str == 0 ? kMatch : kNoMatch;
+}
+
+}  // namespace
+
+bool GlobMatches(const char* pattern, const char* str) {
+  return PatternCompare(reinterpret_cast<const uint8_t*>(pattern),
+                        reinterpret_cast<const uint8_t*>(str),
+                        kGlobInfo) == kMatch;
+}
+
+bool LikeMatches(const char* pattern, const char* str) {
+  return PatternCompare(reinterpret_cast<const uint8_t*>(pattern),
+                        reinterpret_cast<const uint8_t*>(str),
+                        kLikeInfo) == kMatch;
+}
+
+}  // namespace util
+}  // namespace trace_processor
+}  // namespace perfetto
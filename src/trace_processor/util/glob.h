@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_UTIL_GLOB_H_
+#define SRC_TRACE_PROCESSOR_UTIL_GLOB_H_
+
+namespace perfetto {
+namespace trace_processor {
+namespace util {
+
+// Returns whether |str| matches |pattern| using the same semantics as the
+// GLOB operator in SQLite: matching is case sensitive, '*' matches any
+// sequence of characters, '?' matches a single character and '[...]' matches
+// a single character from a set (or not from the set if it starts with '^').
+//
+// This allows the db code to evaluate GLOB constraints without depending on
+// SQLite.
+bool GlobMatches(const char* pattern, const char* str);
+
+// Returns whether |str| matches |pattern| using the same semantics as the
+// LIKE operator without an ESCAPE clause in SQLite: matching is case
+// insensitive for ASCII characters, '%' matches any sequence of characters
+// and '_' matches a single character.
+bool LikeMatches(const char* pattern, const char* str);
+
+}  // namespace util
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_UTIL_GLOB_H_
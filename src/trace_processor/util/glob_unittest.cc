@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/util/glob.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace util {
+namespace {
+
+TEST(GlobUnittest, Glob) {
+  ASSERT_TRUE(GlobMatches("", ""));
+  ASSERT_TRUE(GlobMatches("foo", "foo"));
+  ASSERT_FALSE(GlobMatches("foo", "Foo"));
+  ASSERT_FALSE(GlobMatches("foo", "fooo"));
+  ASSERT_FALSE(GlobMatches("fooo", "foo"));
+
+  ASSERT_TRUE(GlobMatches("*", ""));
+  ASSERT_TRUE(GlobMatches("*", "foo"));
+  ASSERT_TRUE(GlobMatches("f*", "foo"));
+  ASSERT_TRUE(GlobMatches("*o", "foo"));
+  ASSERT_TRUE(GlobMatches("*oo*", "foobar"));
+  ASSERT_TRUE(GlobMatches("f**r", "foobar"));
+  ASSERT_FALSE(GlobMatches("*z*", "foobar"));
+  ASSERT_TRUE(GlobMatches("*a*a*", "banana"));
+  ASSERT_FALSE(GlobMatches("*a*a*a*a*", "banana"));
+
+  ASSERT_TRUE(GlobMatches("f?o", "foo"));
+  ASSERT_FALSE(GlobMatches("f?o", "fo"));
+  ASSERT_TRUE(GlobMatches("*?", "f"));
+  ASSERT_FALSE(GlobMatches("*?", ""));
+
+  ASSERT_TRUE(GlobMatches("[bf]oo", "foo"));
+  ASSERT_FALSE(GlobMatches("[bf]oo", "zoo"));
+  ASSERT_TRUE(GlobMatches("[^bf]oo", "zoo"));
+  ASSERT_FALSE(GlobMatches("[^bf]oo", "foo"));
+  ASSERT_TRUE(GlobMatches("[a-g]oo", "foo"));
+  ASSERT_FALSE(GlobMatches("[a-e]oo", "foo"));
+  ASSERT_TRUE(GlobMatches("[]]", "]"));
+  ASSERT_TRUE(GlobMatches("[a-]", "-"));
+  ASSERT_TRUE(GlobMatches("*[0-9]", "cpu7"));
+  ASSERT_FALSE(GlobMatches("*[0-9]", "cpu"));
+
+  // Unterminated sets never match.
+  ASSERT_FALSE(GlobMatches("[abc", "a"));
+
+  // Multi-byte UTF-8 characters are matched as a single character.
+  ASSERT_TRUE(GlobMatches("?", "\xc3\xa9"));
+  ASSERT_TRUE(GlobMatches("*\xc3\xa9", "caf\xc3\xa9"));
+}
+
+TEST(GlobUnittest, Like) {
+  ASSERT_TRUE(LikeMatches("", ""));
+  ASSERT_TRUE(LikeMatches("foo", "foo"));
+  ASSERT_TRUE(LikeMatches("foo", "FoO"));
+  ASSERT_FALSE(LikeMatches("foo", "fooo"));
+
+  ASSERT_TRUE(LikeMatches("%", ""));
+  ASSERT_TRUE(LikeMatches("F%", "foo"));
+  ASSERT_TRUE(LikeMatches("%O", "foo"));
+  ASSERT_TRUE(LikeMatches("%oB%", "foobar"));
+  ASSERT_FALSE(LikeMatches("%z%", "foobar"));
+
+  ASSERT_TRUE(LikeMatches("f_o", "foo"));
+  ASSERT_FALSE(LikeMatches("f_o", "fo"));
+
+  // GLOB wildcards are not special for LIKE.
+  ASSERT_FALSE(LikeMatches("f*", "foo"));
+  ASSERT_TRUE(LikeMatches("[a]", "[A]"));
+
+  // Case insensitivity only applies to ASCII characters.
+  ASSERT_FALSE(LikeMatches("\xc3\xa9", "\xc3\x89"));
+}
+
+}  // namespace
+}  // namespace util
+}  // namespace trace_processor
+}  // namespace perfetto
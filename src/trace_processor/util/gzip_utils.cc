@@ -63,6 +63,10 @@ void GzipDecompressor::Feed(const uint8_t* data, size_t size) {
   z_stream_->avail_in = static_cast<uInt>(size);
 }
 
+size_t GzipDecompressor::AvailIn() const {
+  return z_stream_->avail_in;
+}
+
 GzipDecompressor::Result GzipDecompressor::ExtractOutput(uint8_t* out,
                                                          size_t out_size) {
   if (z_stream_->avail_in == 0)
@@ -76,6 +80,8 @@ GzipDecompressor::Result GzipDecompressor::ExtractOutput(uint8_t* out,
     case Z_NEED_DICT:
     case Z_DATA_ERROR:
     case Z_MEM_ERROR:
+    // Returned if the decompressor is used again after a previous error.
+    case Z_STREAM_ERROR:
       // Ignore inflateEnd error as we will error out anyway.
       inflateEnd(z_stream_.get());
       return Result{ResultCode::kError, 0};
@@ -94,6 +100,9 @@ GzipDecompressor::GzipDecompressor() = default;
 GzipDecompressor::~GzipDecompressor() = default;
 void GzipDecompressor::Reset() {}
 void GzipDecompressor::Feed(const uint8_t*, size_t) {}
+size_t GzipDecompressor::AvailIn() const {
+  return 0;
+}
 GzipDecompressor::Result GzipDecompressor::ExtractOutput(uint8_t*, size_t) {
   return Result{ResultCode::kError, 0};
 }
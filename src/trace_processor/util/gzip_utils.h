@@ -99,6 +99,11 @@ class GzipDecompressor {
   // i.e. (either 'kEof' or 'kNeedsMoreInput').
   Result ExtractOutput(uint8_t* out, size_t out_capacity);
 
+  // Returns the number of bytes passed to the last 'Feed' which have not been
+  // consumed yet. This is non-zero after 'kEof' if the mem-block contains the
+  // beginning of another gzip stream (e.g. a multi-member gzip file).
+  size_t AvailIn() const;
+
   // Sets the state of the decompressor to reuse with other gzip streams.
   // This is almost like constructing a new 'GzipDecompressor' object
   // but without paying the cost of internal memory allocation.
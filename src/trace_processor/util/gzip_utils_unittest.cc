@@ -109,6 +109,53 @@ TEST(GzipDecompressor, Streaming) {
   EXPECT_EQ(input, decompressed);
 }
 
+TEST(GzipDecompressor, MultipleStreams) {
+  string first = "Abc..Def..Ghi";
+  string second = "Jkl..Mno";
+  string compressed = TrivialGzipCompress(first) + TrivialGzipCompress(second);
+  auto compressed_u8 = reinterpret_cast<const uint8_t*>(compressed.data());
+
+  string decompressed;
+  auto consumer = [&](const uint8_t* data, size_t len) {
+    decompressed.append(reinterpret_cast<const char*>(data), len);
+  };
+  GzipDecompressor decompressor;
+  ASSERT_EQ(decompressor.FeedAndExtract(compressed_u8, compressed.size(),
+                                        consumer),
+            GzipDecompressor::ResultCode::kEof);
+  EXPECT_EQ(decompressed, first);
+
+  // The second stream has not been consumed yet.
+  size_t avail_in = decompressor.AvailIn();
+  ASSERT_EQ(avail_in, compressed.size() - TrivialGzipCompress(first).size());
+
+  decompressor.Reset();
+  decompressed.clear();
+  ASSERT_EQ(decompressor.FeedAndExtract(
+                compressed_u8 + compressed.size() - avail_in, avail_in,
+                consumer),
+            GzipDecompressor::ResultCode::kEof);
+  EXPECT_EQ(decompressed, second);
+  EXPECT_EQ(decompressor.AvailIn(), 0u);
+}
+
+TEST(GzipDecompressor, ErrorIsSticky) {
+  string garbage = "this is not a gzip stream";
+  auto garbage_u8 = reinterpret_cast<const uint8_t*>(garbage.data());
+  GzipDecompressor decompressor;
+  auto consumer = [](const uint8_t*, size_t) {};
+  ASSERT_EQ(decompressor.FeedAndExtract(garbage_u8, garbage.size(), consumer),
+            GzipDecompressor::ResultCode::kError);
+
+  // Must not spin forever when reused after an error.
+  decompressor.Reset();
+  string compressed = TrivialGzipCompress("Abc");
+  ASSERT_EQ(decompressor.FeedAndExtract(
+                reinterpret_cast<const uint8_t*>(compressed.data()),
+                compressed.size(), consumer),
+            GzipDecompressor::ResultCode::kError);
+}
+
 static std::string ReadFile(const std::string& file_name) {
   std::ifstream fd(file_name, std::ios::binary);
   std::stringstream buffer;
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_UTIL_INTERNED_MESSAGE_TABLE_H_
+#define SRC_TRACE_PROCESSOR_UTIL_INTERNED_MESSAGE_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "perfetto/base/compiler.h"
+#include "perfetto/trace_processor/trace_blob_view.h"
+#include "src/trace_processor/util/interned_message_view.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Interning index of the messages of one field of InternedData, by iid.
+//
+// Producers assign iids sequentially (starting from 1) in most cases, so iids
+// index directly into a vector. The few iids which would leave the vector
+// mostly empty (e.g. iids derived from hashes or addresses) are stored in a
+// hash map instead.
+//
+// Copies of the table share the views of the messages (and so their decoders)
+// rather than copying them: interned messages are immutable.
+class InternedMessageTable {
+ public:
+  // Returns the view of the message with the given |iid| or nullptr if there
+  // is no such message.
+  InternedMessageView* Find(uint64_t iid) const {
+    if (PERFETTO_LIKELY(iid < dense_.size() && dense_[iid]))
+      return dense_[iid].get();
+    if (PERFETTO_LIKELY(sparse_.empty()))
+      return nullptr;
+    auto it = sparse_.find(iid);
+    return it == sparse_.end() ? nullptr : it->second.get();
+  }
+
+  // Adds |message| with the given |iid|. If there is already a message with
+  // this |iid|, it is kept and returned with false.
+  std::pair<InternedMessageView*, bool> Insert(uint64_t iid,
+                                               TraceBlobView message) {
+    InternedMessageView* existing = Find(iid);
+    if (existing)
+      return std::make_pair(existing, false);
+
+    std::shared_ptr<InternedMessageView> view(
+        new InternedMessageView(std::move(message)));
+    InternedMessageView* ptr = view.get();
+    if (iid < dense_.size() || IsDense(iid)) {
+      if (iid >= dense_.size())
+        dense_.resize(static_cast<size_t>(iid) + 1);
+      dense_[iid] = std::move(view);
+      dense_count_++;
+    } else {
+      sparse_[iid] = std::move(view);
+    }
+    return std::make_pair(ptr, true);
+  }
+
+  // Number of messages in the table.
+  size_t size() const { return dense_count_ + sparse_.size(); }
+
+  // Number of messages in the hash map, for testing.
+  size_t sparse_size_for_testing() const { return sparse_.size(); }
+
+ private:
+  // Bounds the size of the vector, even if all the iids are dense.
+  static constexpr uint64_t kMaxDenseIid = 1u << 24;
+  // Iids up to this value are always in the vector.
+  static constexpr uint64_t kMinDenseIid = 1024;
+
+  // The vector only grows up to twice the number of messages it holds.
+  bool IsDense(uint64_t iid) const {
+    return iid < kMaxDenseIid && (iid < kMinDenseIid || iid < 2 * dense_count_);
+  }
+
+  std::vector<std::shared_ptr<InternedMessageView>> dense_;
+  size_t dense_count_ = 0;
+  std::unordered_map<uint64_t, std::shared_ptr<InternedMessageView>> sparse_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_UTIL_INTERNED_MESSAGE_TABLE_H_
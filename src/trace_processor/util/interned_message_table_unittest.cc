@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/util/interned_message_table.h"
+
+#include <string>
+
+#include "perfetto/trace_processor/trace_blob.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TraceBlobView Message(const std::string& content) {
+  return TraceBlobView(TraceBlob::CopyFrom(content.data(), content.size()));
+}
+
+std::string Content(InternedMessageView* view) {
+  return std::string(reinterpret_cast<const char*>(view->message().data()),
+                     view->message().length());
+}
+
+TEST(InternedMessageTableTest, FindInserted) {
+  InternedMessageTable table;
+  ASSERT_EQ(table.Find(1), nullptr);
+
+  auto res = table.Insert(1, Message("a"));
+  ASSERT_TRUE(res.second);
+  ASSERT_TRUE(table.Insert(3, Message("c")).second);
+
+  ASSERT_EQ(table.Find(0), nullptr);
+  ASSERT_EQ(table.Find(1), res.first);
+  ASSERT_EQ(table.Find(2), nullptr);
+  ASSERT_EQ(Content(table.Find(3)), "c");
+  ASSERT_EQ(table.Find(4), nullptr);
+  ASSERT_EQ(table.size(), 2u);
+}
+
+TEST(InternedMessageTableTest, KeepsFirstMessage) {
+  InternedMessageTable table;
+  InternedMessageView* view = table.Insert(1, Message("a")).first;
+
+  auto res = table.Insert(1, Message("b"));
+  ASSERT_FALSE(res.second);
+  ASSERT_EQ(res.first, view);
+  ASSERT_EQ(Content(table.Find(1)), "a");
+  ASSERT_EQ(table.size(), 1u);
+}
+
+TEST(InternedMessageTableTest, SparseIids) {
+  InternedMessageTable table;
+  for (uint64_t iid = 1; iid <= 2000; ++iid)
+    table.Insert(iid, Message(std::to_string(iid)));
+  ASSERT_EQ(table.sparse_size_for_testing(), 0u);
+
+  // Hash-like iids shouldn't grow the vector.
+  const uint64_t kLargeIids[] = {1ull << 40, 123456789, ~0ull};
+  for (uint64_t iid : kLargeIids)
+    table.Insert(iid, Message(std::to_string(iid)));
+  ASSERT_EQ(table.sparse_size_for_testing(), 3u);
+  ASSERT_EQ(table.size(), 2003u);
+
+  for (uint64_t iid = 1; iid <= 2000; ++iid)
+    ASSERT_EQ(Content(table.Find(iid)), std::to_string(iid));
+  for (uint64_t iid : kLargeIids)
+    ASSERT_EQ(Content(table.Find(iid)), std::to_string(iid));
+  ASSERT_EQ(table.Find(2001), nullptr);
+  ASSERT_EQ(table.Find(123456788), nullptr);
+}
+
+TEST(InternedMessageTableTest, SparseIidCoveredByVector) {
+  InternedMessageTable table;
+  // Too large for the vector when it's inserted...
+  table.Insert(5000, Message("sparse"));
+  ASSERT_EQ(table.sparse_size_for_testing(), 1u);
+
+  // ... but not anymore once there are enough iids.
+  for (uint64_t iid = 1; iid <= 4000; ++iid)
+    table.Insert(iid, Message("dense"));
+  table.Insert(6000, Message("dense"));
+  ASSERT_EQ(table.sparse_size_for_testing(), 1u);
+
+  ASSERT_EQ(Content(table.Find(5000)), "sparse");
+  ASSERT_FALSE(table.Insert(5000, Message("other")).second);
+  ASSERT_EQ(Content(table.Find(6000)), "dense");
+}
+
+TEST(InternedMessageTableTest, CopiesShareViews) {
+  InternedMessageTable table;
+  table.Insert(1, Message("a"));
+
+  InternedMessageTable copy = table;
+  copy.Insert(2, Message("b"));
+
+  // Decoders and submessages cached by the views are shared with the copy.
+  ASSERT_EQ(copy.Find(1), table.Find(1));
+  ASSERT_EQ(Content(copy.Find(2)), "b");
+  ASSERT_EQ(table.Find(2), nullptr);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
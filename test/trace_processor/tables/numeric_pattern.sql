@@ -0,0 +1,7 @@
+-- SQLite matches patterns against the text form of numbers.
+SELECT 'glob' AS op, name FROM thread WHERE name GLOB 123
+UNION ALL
+SELECT 'like' AS op, name FROM thread WHERE name LIKE 5
+UNION ALL
+SELECT 'like_real' AS op, name FROM thread WHERE name LIKE 2.5
+ORDER BY op, name;